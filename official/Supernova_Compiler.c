@@ -35,11 +35,17 @@ void emit_ir_header() {
     printf("[IR] entry main\n");
 }
 
+// Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
 void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
     if (arg2)
         printf("[IR] %s %s, %s\n", op, arg1, arg2);
-    else
+    else if (arg1)
         printf("[IR] %s %s\n", op, arg1);
+    else
+        printf("[IR] %s\n", op);
+    ir_record(op, arg1, arg2);
 }
 
 void generate_intermediate_code() {
@@ -94,94 +100,11 @@ void load_opcode_table(const char* json_path) {
     fclose(f);
 }
 
-void generate_asm_from_ir() {
-    FILE* f = fopen("rexion.asm", "w");
-    if (!f) { perror("Failed to write ASM"); return; }
-
-    fprintf(f,
-        "section .data\n"
-        "result dq 0\n"
-        "buffer db 64 dup(0)\n"
-        "fltval dq 3.14\n"
-        "fltval2 dq 2.71\n"
-        "fltstr db 64 dup(0)\n"
-        "newline db 0xA, 0\n"
-        "fmt db '%%f', 10, 0\n"
-        "section .text\n"
-        "extern printf\n"
-        "global _start\n"
-        "_start:\n"
-        "    mov rax, 5\n"
-        "    mov rbx, 3\n"
-        "    add rcx, rax\n"
-        "    add rcx, rbx\n"
-        "    mov [result], rcx\n"
-        "\n"
-        "    fld qword [fltval]\n"
-        "    fadd qword [fltval2]\n"
-        "    fstp qword [fltstr]\n"
-        "\n"
-        "    %s\n"
-        "\n"
-        "    mov rdi, rcx\n"
-        "    mov rsi, buffer\n"
-        "    call int_to_str\n"
-        "    mov rdx, rax\n"
-        "    mov rax, 1\n"
-        "    mov rdi, 1\n"
-        "    mov rsi, buffer\n"
-        "    syscall\n"
-        "    mov rax, 1\n"
-        "    mov rdi, 1\n"
-        "    mov rsi, newline\n"
-        "    mov rdx, 1\n"
-        "    syscall\n"
-        "    mov eax, 60\n"
-        "    xor edi, edi\n"
-        "    syscall\n"
-        "\n"
-        "int_to_str:\n"
-        "    mov rbx, 10\n"
-        "    mov rax, rdi\n"
-        "    xor rcx, rcx\n"
-        "    add rsi, 63\n"
-        "    mov byte [rsi], 0\n"
-        "convert_loop:\n"
-        "    xor rdx, rdx\n"
-        "    div rbx\n"
-        "    add dl, '0'\n"
-        "    dec rsi\n"
-        "    mov [rsi], dl\n"
-        "    inc rcx\n"
-        "    test rax, rax\n"
-        "    jnz convert_loop\n"
-        "    mov rax, rcx\n"
-        "    ret\n"
-        "\n"
-        "float_to_str:\n"
-        "    fld qword [fltstr]\n"
-        "    fld st0\n"
-        "    frndint\n"
-        "    fsub st1, st0\n"
-        "    fxch\n"
-        "    fistp qword [buffer + 32]\n"
-        "    fld st0\n"
-        "    fmul qword [ten]\n"
-        "    frndint\n"
-        "    fistp qword [buffer + 40]\n"
-        "    mov rdi, [buffer + 32]\n"
-        "    mov rsi, buffer\n"
-        "    call int_to_str\n"
-        "    mov rdi, buffer\n"
-        "    call strlen\n"
-        "    mov byte [buffer + rax], '.'\n"
-        "    mov rdi, [buffer + 40]\n"
-        "    mov rsi, buffer + rax + 1\n"
-        "    call int_to_str\n"
-        "    ret\n",
-        USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+// Lowers the IR buffer to rexion.asm through rexion_isel.c
+extern int isel_write_asm(const char* path);
 
-    fclose(f);
+void generate_asm_from_ir() {
+    if (isel_write_asm("rexion.asm") != 0) return;
     printf("[ASM] rexion.asm generated from IR\n");
 }
 
@@ -225,11 +148,17 @@ void emit_ir_header() {
     printf("[IR] entry main\n");
 }
 
+// Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
 void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
     if (arg2)
         printf("[IR] %s %s, %s\n", op, arg1, arg2);
-    else
+    else if (arg1)
         printf("[IR] %s %s\n", op, arg1);
+    else
+        printf("[IR] %s\n", op);
+    ir_record(op, arg1, arg2);
 }
 
 // Expand macros like |ADDXY| into a defined IR block
@@ -272,9 +201,12 @@ void generate_intermediate_code_from_r4(const char* filename) {
     emit_ir_operation("HALT", NULL, NULL);
 }
 
+// Lowers the IR buffer to rexion.asm through rexion_isel.c
+extern int isel_write_asm(const char* path);
+
 void generate_asm_from_ir() {
-    // Unchanged — real NASM generation from earlier step
-    // [omitted here for brevity, assumed retained in final file]
+    if (isel_write_asm("rexion.asm") != 0) return;
+    printf("[ASM] rexion.asm generated from IR\n");
 }
 
 #include <stdio.h>
@@ -342,11 +274,17 @@ void emit_ir_header() {
     printf("[IR] entry main\n");
 }
 
+// Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
 void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
     if (arg2)
         printf("[IR] %s %s, %s\n", op, arg1, arg2);
-    else
+    else if (arg1)
         printf("[IR] %s %s\n", op, arg1);
+    else
+        printf("[IR] %s\n", op);
+    ir_record(op, arg1, arg2);
 }
 
 void expand_macro_to_ir(const char* macro) {
@@ -375,68 +313,11 @@ void generate_intermediate_code_from_file(const char* filename) {
 }
 
 // === IR → ASM Generator ===
-void generate_asm_from_ir() {
-    FILE* f = fopen("rexion.asm", "w");
-    if (!f) { perror("Failed to write ASM"); return; }
-
-    fprintf(f,
-        "section .data\n"
-        "result dq 0\n"
-        "buffer db 64 dup(0)\n"
-        "fltval dq 3.14\n"
-        "fltval2 dq 2.71\n"
-        "fltstr db 64 dup(0)\n"
-        "newline db 0xA, 0\n"
-        "fmt db '%%f', 10, 0\n"
-        "section .text\n"
-        "extern printf\n"
-        "global _start\n"
-        "_start:\n"
-        "    mov rax, 5\n"
-        "    mov rbx, 3\n"
-        "    add rcx, rax\n"
-        "    add rcx, rbx\n"
-        "    mov [result], rcx\n"
-        "    fld qword [fltval]\n"
-        "    fadd qword [fltval2]\n"
-        "    fstp qword [fltstr]\n"
-        "    %s\n"
-        "    mov rdi, rcx\n"
-        "    mov rsi, buffer\n"
-        "    call int_to_str\n"
-        "    mov rdx, rax\n"
-        "    mov rax, 1\n"
-        "    mov rdi, 1\n"
-        "    mov rsi, buffer\n"
-        "    syscall\n"
-        "    mov rax, 1\n"
-        "    mov rdi, 1\n"
-        "    mov rsi, newline\n"
-        "    mov rdx, 1\n"
-        "    syscall\n"
-        "    mov eax, 60\n"
-        "    xor edi, edi\n"
-        "    syscall\n"
-        "int_to_str:\n"
-        "    mov rbx, 10\n"
-        "    mov rax, rdi\n"
-        "    xor rcx, rcx\n"
-        "    add rsi, 63\n"
-        "    mov byte [rsi], 0\n"
-        "convert_loop:\n"
-        "    xor rdx, rdx\n"
-        "    div rbx\n"
-        "    add dl, '0'\n"
-        "    dec rsi\n"
-        "    mov [rsi], dl\n"
-        "    inc rcx\n"
-        "    test rax, rax\n"
-        "    jnz convert_loop\n"
-        "    mov rax, rcx\n"
-        "    ret\n",
-        USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+// Lowers the IR buffer to rexion.asm through rexion_isel.c
+extern int isel_write_asm(const char* path);
 
-    fclose(f);
+void generate_asm_from_ir() {
+    if (isel_write_asm("rexion.asm") != 0) return;
     printf("[ASM] rexion.asm generated from IR\n");
 }
 void rewrite_r4_to_rexasm(const char* input, const char* output) {
@@ -502,6 +383,7 @@ void parse_statement() {
     else if (t.type == TOKEN_SUPER) parse_super();
     else if (t.type == TOKEN_THIS) parse_this();
     else if (t.type == TOKEN_EVAL) parse_eval();
+    else if (t.type == TOKEN_VECTORIZE) parse_vectorize();
     else if (
         t.type >= TOKEN_RAYTRACING && t.type <= TOKEN_REASONING
         ) {
@@ -609,9 +491,19 @@ void parse_eval() {
     match(TOKEN_SEMI);
 }
 
+// vectorize: the parser has no loop statements to annotate, so the keyword is reported and
+// skipped. Only loops built with ast_vectorize() reach ssa_vectorize().
+void parse_vectorize() {
+    match(TOKEN_VECTORIZE);
+    printf("[VECTORIZE] Warning: annotation ignored, the parser builds no loops to vectorize\n");
+    if (peek().type == TOKEN_SEMI) match(TOKEN_SEMI);
+}
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
 
 #include "lexer.h"
 #include "parser.h"
@@ -624,25 +516,86 @@ void generate_ir() {
     printf("[IR] RETURN 0\n");
 }
 
+// Lowers `name = "text";` / `name = 123;` and `print name;` / `print "text";` / `print 123;`
+// to rexion.asm; each print appends its text and newline to the linker runtime's stdout buffer
+// (out_write, with the string lengths known here), flushed once before exit
 void generate_asm() {
     printf("[ASM] Emitting NASM x86_64 Assembly...\n");
     FILE* f = fopen("rexion.asm", "w");
     if (!f) { perror("ASM output failed"); exit(1); }
+
+    const char* names[64];
+    int kinds[64], nvars = 0, nstr = 0;     // kind: string literal index, or -1 for an integer
+    const char* numbers[64];
+    size_t str_len[64];
+    fprintf(f, "section .data\n");
+    for (int i = 0; i + 2 < token_count; i++) {
+        if (tokens[i].type != TOKEN_IDENT || tokens[i + 1].type != TOKEN_ASSIGN) continue;
+        if (tokens[i + 2].type != TOKEN_STRING && tokens[i + 2].type != TOKEN_NUMBER) continue;
+        if (nvars == 64) break;
+        names[nvars] = tokens[i].text;
+        kinds[nvars] = -1;
+        numbers[nvars] = tokens[i + 2].text;
+        if (tokens[i + 2].type == TOKEN_STRING) {
+            fprintf(f, "str%d db \"%s\", 10\n", nstr, tokens[i + 2].text);
+            str_len[nstr] = strlen(tokens[i + 2].text) + 1;
+            kinds[nvars] = nstr++;
+        }
+        nvars++;
+    }
+    for (int i = 0; i + 1 < token_count; i++)
+        if (tokens[i].type == TOKEN_PRINT && tokens[i + 1].type == TOKEN_STRING)
+            fprintf(f, "lit%d db \"%s\", 10\n", i, tokens[i + 1].text);
     fprintf(f,
+        "section .bss\n"
+        "digits resb 32\n"
         "section .text\n"
         "global _start\n"
-        "_start:\n"
+        "extern out_write\n"
+        "extern out_flush\n"
+        "_start:\n");
+    int printed_number = 0;
+    for (int i = 0; i + 1 < token_count; i++) {
+        if (tokens[i].type != TOKEN_PRINT) continue;
+        const Token* arg = &tokens[i + 1];
+        const char* number = arg->type == TOKEN_NUMBER ? arg->text : NULL;
+        if (arg->type == TOKEN_STRING) {
+            fprintf(f, "    mov rsi, lit%d\n    mov edx, %zu\n    call out_write\n", i, strlen(arg->text) + 1);
+        } else if (arg->type == TOKEN_IDENT) {
+            int v = nvars - 1;
+            while (v >= 0 && strcmp(names[v], arg->text) != 0) v--;
+            if (v < 0) { fprintf(f, "    ; print %s: no value known at compile time\n", arg->text); continue; }
+            if (kinds[v] >= 0) fprintf(f, "    mov rsi, str%d\n    mov edx, %zu\n    call out_write\n", kinds[v], str_len[kinds[v]]);
+            else number = numbers[v];
+        }
+        if (number) {
+            fprintf(f, "    mov rdi, %s\n    mov rsi, digits\n    call int_to_str\n"
+                       "    mov byte [rsi + rax], 10\n    lea rdx, [rax + 1]\n    call out_write\n", number);
+            printed_number = 1;
+        }
+    }
+    fprintf(f,
+        "    call out_flush\n"
         "    mov eax, 60\n"
         "    xor edi, edi\n"
         "    syscall\n"
     );
+    if (printed_number) fprintf(f, "extern int_to_str\n");
     fclose(f);
 }
 
+// Built-in assembler and linker (rexion_asm.c / elf64_object.c / rexion_link.c)
+extern int rasm_assemble_file(const char* asm_path, const char* obj_path);
+extern int rasm_list_file(const char* asm_path, FILE* out);
+extern int rlink_link_files(const char** asm_paths, int npaths, const char* exe_path);
+
 void compile_binary() {
     printf("[BIN] Assembling and Linking...\n");
-    system("nasm -felf64 rexion.asm -o rexion.o");
-    system("gcc -no-pie rexion.o -o rexion.exe");
+    const char* asm_path = "rexion.asm";
+    if (rlink_link_files(&asm_path, 1, "rexion.exe") != 0) {
+        printf("❌ Build failed: rexion.asm\n");
+        return;
+    }
     printf("✅ Output: rexion.exe\n");
 }
 
@@ -651,11 +604,135 @@ void run_executable() {
     system("./rexion.exe");
 }
 
+// SSA IR construction benchmark (ssa_ir.c)
+extern void ssa_bench_construction(int statements);
+extern int ssa_bench_ir_roundtrip(void);
+extern int ssa_bench_sccp(int n);
+extern int ssa_bench_dce(int n);
+extern int ssa_bench_gvn(int n);
+extern int ssa_bench_loops(int n);
+extern int ssa_bench_inline(int n);
+extern void ssa_set_inline_budget(int growth_percent);
+extern int ssa_bench_vectorize(int n);
+extern int ssa_set_vector_isa(const char* name);
+extern int ssa_set_opt_level(const char* level);
+extern int ssa_set_pass_enabled(const char* name, int enabled);
+extern void ssa_set_time_passes(int on);
+extern void ssa_report_pass_times(FILE* out);
+extern void ssa_list_passes(FILE* out);
+extern int ssa_bench_passes(int n);
+extern void ssa_set_profile_generate(const char* path);
+extern void ssa_set_profile_use(const char* path);
+extern int ssa_profile_ir_file(const char* ir_path);
+extern int ssa_bench_pgo(int n);
+extern int ssa_bench_tailcall(int n);
+
+// Register VM (rexion_vm.c)
+extern int vm_run_file(const char* path);
+extern void vm_bench_dispatch(long long iterations);
+
+// In-process x86-64 JIT (rexion_jit.c)
+extern int jit_run_file(const char* path);
+extern void jit_bench(long long iterations);
+
+// x86-64 target features (x64_encoder.c)
+extern int x64_set_march(const char* name);
+extern const char* x64_vector_isa(void);
+extern void x64_print_features(FILE* f);
+
+// IR -> x86-64 NASM backend (rexion_isel.c)
+extern int isel_compile_file(const char* ir_path, const char* asm_path, int optimize);
+extern int isel_bench(int n);
+extern int isel_set_tune(const char* name);
+extern void isel_set_sched_report(int on);
+
+// IR -> AArch64 GNU assembly backend (rexion_isel_arm64.c)
+extern int a64_compile_file(const char* ir_path, const char* asm_path, int optimize);
+
+// Static linker runtime (rexion_link.c)
+extern void rlink_bench_int_to_str(long long n);
+extern void rlink_bench_float_to_str(long long n);
+
+// IR (.ir/.rirb/.json) and RexionFullVM (.bin) programs skip the lexer and run on the VM
+static int is_vm_program(const char* path) {
+    const char* dot = strrchr(path, '.');
+    return dot && (strcmp(dot, ".ir") == 0 || strcmp(dot, ".rirb") == 0 ||
+                   strcmp(dot, ".json") == 0 || strcmp(dot, ".bin") == 0);
+}
+
+// NASM sources go straight to the built-in assembler
+static int is_asm_program(const char* path) {
+    const char* dot = strrchr(path, '.');
+    return dot && strcmp(dot, ".asm") == 0;
+}
+
+static int needs_source(const char* opt) {
+    static const char* lexer_opts[] = { "--tokens", "--parse", "--ir", "--asm", "--bin", "--run" };
+    for (int k = 0; k < 6; k++)
+        if (strcmp(opt, lexer_opts[k]) == 0) return 1;
+    return 0;
+}
+
+// Settings of the SSA pass pipeline; they apply to the runs that follow them
+static int is_pipeline_option(const char* opt) {
+    static const char* pipeline_opts[] = { "--enable-pass", "--disable-pass", "--time-passes", "--inline-budget", "--vector-isa", "--profile-use" };
+    if (strncmp(opt, "-O", 2) == 0) return 1;
+    for (int k = 0; k < 6; k++)
+        if (strcmp(opt, pipeline_opts[k]) == 0) return 1;
+    return 0;
+}
+
+static int runs_pipeline(const char* opt) {
+    static const char* pipeline_runs[] = { "--native", "--native-arm64", "--bench-ssa", "--bench-sccp", "--bench-dce", "--bench-gvn",
+        "--bench-loops", "--bench-inline", "--bench-vectorize", "--bench-passes", "--bench-pgo", "--bench-tailcall" };
+    for (int k = 0; k < 12; k++)
+        if (strcmp(opt, pipeline_runs[k]) == 0) return 1;
+    return 0;
+}
+
+// Argument of the option at argv[*i]; NULL (after a message) when the command line ends there or
+// the next word is another option, so "--profile-use --native" does not read a file named --native
+static const char* option_arg(int argc, char** argv, int* i) {
+    if (*i + 1 >= argc || strncmp(argv[*i + 1], "--", 2) == 0) {
+        printf("Option %s needs an argument\n", argv[*i]);
+        return NULL;
+    }
+    return argv[++*i];
+}
+
+// Whole-string decimal number, so "--inline-budget --native" is an error rather than budget 0
+static int parse_count(const char* s, long long* out) {
+    char* end;
+    errno = 0;
+    long long v = strtoll(s, &end, 10);
+    if (end == s || *end || errno == ERANGE) return -1;
+    *out = v;
+    return 0;
+}
+
+// Optional count after a --bench-* option: the next argument is taken only when it is a number
+static long long option_count(int argc, char** argv, int* i, long long fallback) {
+    long long n;
+    if (*i + 1 < argc && parse_count(argv[*i + 1], &n) == 0) {
+        ++*i;
+        return n;
+    }
+    return fallback;
+}
+
 int main(int argc, char** argv) {
     if (argc < 2) {
-        printf("Usage: %s <source.r4> [--tokens] [--parse] [--ir] [--asm] [--bin] [--run]\n", argv[0]);
+        printf("Usage: %s <source.r4> [--tokens] [--parse] [--ir] [--asm] [--bin] [--run] [--obj] [--exe] [--emit-asm] [--run-vm] [--run-jit] [--bench-vm N] [--bench-jit N] [--bench-ssa N] [--bench-sccp N] [--bench-dce N] [--bench-gvn N] [--bench-loops N] [--inline-budget P] [--bench-inline N] [--vector-isa sse2|avx2|avx512] [--bench-vectorize N] [-O0|-O1|-O2|-O3|-Os] [--enable-pass P] [--disable-pass P] [--time-passes] [--list-passes] [--bench-passes N] [--profile-generate FILE] [--profile-use FILE] [--bench-pgo N] [--bench-tailcall N] [--march=native|x86-64|x86-64-v2|x86-64-v3|x86-64-v4] [--mtune generic|skylake|icelake|zen3] [--sched-report] [--native] [--native-arm64] [--bench-isel N] [--bench-itoa N] [--bench-dtoa N]\n", argv[0]);
         return 1;
     }
+    // a pipeline setting with no run after it would be silently ignored
+    for (int i = argc - 1, later_run = 0; i >= 2; i--) {
+        if (runs_pipeline(argv[i])) later_run = 1;
+        else if (!later_run && is_pipeline_option(argv[i])) {
+            printf("Option %s only applies to a later --native, --native-arm64 or SSA --bench-* run\n", argv[i]);
+            return 1;
+        }
+    }
 
     FILE* file = fopen(argv[1], "r");
     if (!file) {
@@ -671,10 +748,18 @@ int main(int argc, char** argv) {
     source[length] = '\0';
     fclose(file);
 
-    lex(source);
+    int vm_program = is_vm_program(argv[1]);
+    int asm_program = is_asm_program(argv[1]);
+    const char* asm_path = asm_program ? argv[1] : "rexion.asm";
+    if (!vm_program && !asm_program) lex(source);
 
+    int time_passes = 0;
+    int optimize_ir = 0;        // an -O level, pass choice or profile sends --native code through the SSA pipeline
     for (int i = 2; i < argc; i++) {
-        if (strcmp(argv[i], "--tokens") == 0) {
+        if ((vm_program || asm_program) && needs_source(argv[i])) {
+            printf("Option %s needs a .r4 source; %s is %s\n", argv[i], argv[1], vm_program ? "a VM program" : "an assembly file");
+        }
+        else if (strcmp(argv[i], "--tokens") == 0) {
             token_dump(tokens, token_count);
         }
         else if (strcmp(argv[i], "--parse") == 0) {
@@ -692,10 +777,290 @@ int main(int argc, char** argv) {
         else if (strcmp(argv[i], "--run") == 0) {
             run_executable();
         }
+        else if (strcmp(argv[i], "--obj") == 0) {
+            // foo.asm -> foo.o in-process (replaces nasm -felf64)
+            char obj_path[1024];
+            const char* dot = strrchr(asm_path, '.');
+            snprintf(obj_path, sizeof(obj_path), "%.*s.o", dot ? (int)(dot - asm_path) : (int)strlen(asm_path), asm_path);
+            if (rasm_assemble_file(asm_path, obj_path) != 0) {
+                free(source);
+                return 1;
+            }
+            printf("[ASM] %s -> %s\n", asm_path, obj_path);
+        }
+        else if (strcmp(argv[i], "--exe") == 0) {
+            // foo.asm -> foo.exe in-process (replaces nasm + ld)
+            char exe_path[1024];
+            const char* dot = strrchr(asm_path, '.');
+            snprintf(exe_path, sizeof(exe_path), "%.*s.exe", dot ? (int)(dot - asm_path) : (int)strlen(asm_path), asm_path);
+            if (rlink_link_files(&asm_path, 1, exe_path) != 0) {
+                free(source);
+                return 1;
+            }
+            printf("[LINK] %s -> %s\n", asm_path, exe_path);
+        }
+        else if (strcmp(argv[i], "--emit-asm") == 0) {
+            if (rasm_list_file(asm_path, stdout) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--run-vm") == 0) {
+            if (!vm_program) {
+                printf("[VM] --run-vm expects an IR (.ir/.rirb/.json) or RexionFullVM .bin program\n");
+            }
+            else if (vm_run_file(argv[1]) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--run-jit") == 0) {
+            if (!vm_program || strcmp(strrchr(argv[1], '.'), ".bin") == 0) {
+                printf("[JIT] --run-jit expects an IR (.ir/.rirb/.json) program\n");
+            }
+            else if (jit_run_file(argv[1]) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "--march=", 8) == 0) {
+            // target ISA for later --native/--bench-* runs: runtime variants and vector width
+            if (x64_set_march(argv[i] + 8) != 0) {
+                printf("Unknown target: %s (native, x86-64, x86-64-v2, x86-64-v3, x86-64-v4)\n", argv[i] + 8);
+                free(source);
+                return 1;
+            }
+            else {
+                ssa_set_vector_isa(x64_vector_isa());
+                x64_print_features(stdout);
+            }
+        }
+        else if (strcmp(argv[i], "--mtune") == 0) {
+            // scheduling model for later --native/--bench-isel runs
+            const char* cpu = option_arg(argc, argv, &i);
+            if (!cpu) {
+                free(source);
+                return 1;
+            }
+            if (isel_set_tune(cpu) != 0) {
+                printf("Unknown CPU: %s (generic, skylake, icelake, zen3)\n", cpu);
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--sched-report") == 0) {
+            isel_set_sched_report(1);
+        }
+        else if (strcmp(argv[i], "--native") == 0) {
+            // IR program -> rexion.asm through instruction selection, after the SSA pipeline once an -O level,
+            // pass choice or --profile-use was given; --exe links it
+            if (!vm_program || strcmp(strrchr(argv[1], '.'), ".bin") == 0) {
+                printf("[ISEL] --native expects an IR (.ir/.rirb/.json) program\n");
+            }
+            else if (isel_compile_file(argv[1], asm_path, optimize_ir) != 0) {
+                free(source);
+                return 1;
+            }
+            else {
+                printf("[ASM] %s -> %s\n", argv[1], asm_path);
+            }
+        }
+        else if (strcmp(argv[i], "--native-arm64") == 0) {
+            // IR program -> rexion_arm64.s for GNU as/ld (aarch64-linux-gnu); optimized like --native
+            if (!vm_program || strcmp(strrchr(argv[1], '.'), ".bin") == 0) {
+                printf("[A64] --native-arm64 expects an IR (.ir/.rirb/.json) program\n");
+            }
+            else if (a64_compile_file(argv[1], "rexion_arm64.s", optimize_ir) != 0) {
+                free(source);
+                return 1;
+            }
+            else {
+                printf("[ASM] %s -> %s\n", argv[1], "rexion_arm64.s");
+            }
+        }
+        else if (strcmp(argv[i], "--bench-vm") == 0) {
+            long long iterations = option_count(argc, argv, &i, 100000000LL);
+            vm_bench_dispatch(iterations);
+        }
+        else if (strcmp(argv[i], "--bench-jit") == 0) {
+            long long iterations = option_count(argc, argv, &i, 100000000LL);
+            jit_bench(iterations);
+        }
+        else if (strcmp(argv[i], "--bench-ssa") == 0) {
+            int statements = (int)option_count(argc, argv, &i, 100000);
+            ssa_bench_construction(statements);
+            if (ssa_bench_ir_roundtrip() != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bench-sccp") == 0) {
+            int n = (int)option_count(argc, argv, &i, 100000);
+            if (ssa_bench_sccp(n) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bench-dce") == 0) {
+            int n = (int)option_count(argc, argv, &i, 100000);
+            if (ssa_bench_dce(n) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bench-gvn") == 0) {
+            int n = (int)option_count(argc, argv, &i, 100000);
+            if (ssa_bench_gvn(n) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bench-loops") == 0) {
+            int n = (int)option_count(argc, argv, &i, 100000);
+            if (ssa_bench_loops(n) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bench-inline") == 0) {
+            int n = (int)option_count(argc, argv, &i, 100000);
+            if (ssa_bench_inline(n) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--inline-budget") == 0) {
+            // growth cap for later --native/--bench-* runs, in percent of module size
+            const char* arg = option_arg(argc, argv, &i);
+            long long budget;
+            if (!arg) {
+                free(source);
+                return 1;
+            }
+            if (parse_count(arg, &budget) != 0 || budget < 0 || budget > INT_MAX) {
+                printf("Invalid inline budget: %s (a growth percentage)\n", arg);
+                free(source);
+                return 1;
+            }
+            ssa_set_inline_budget((int)budget);
+        }
+        else if (strcmp(argv[i], "--vector-isa") == 0) {
+            // lane count for later --native/--bench-* runs
+            const char* isa = option_arg(argc, argv, &i);
+            if (!isa) {
+                free(source);
+                return 1;
+            }
+            if (ssa_set_vector_isa(isa) != 0) {
+                printf("Unknown vector ISA: %s (sse2, avx2, avx512)\n", isa);
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bench-vectorize") == 0) {
+            int n = (int)option_count(argc, argv, &i, 100000);
+            if (ssa_bench_vectorize(n) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strncmp(argv[i], "-O", 2) == 0) {
+            // pass pipeline for later --native/--native-arm64/--bench-* runs
+            if (ssa_set_opt_level(argv[i] + 2) != 0) {
+                printf("Unknown optimization level: %s (-O0, -O1, -O2, -O3, -Os)\n", argv[i]);
+                free(source);
+                return 1;
+            }
+            optimize_ir = 1;
+        }
+        else if (strcmp(argv[i], "--enable-pass") == 0 || strcmp(argv[i], "--disable-pass") == 0) {
+            int enable = argv[i][2] == 'e';
+            const char* pass = option_arg(argc, argv, &i);
+            if (!pass) {
+                free(source);
+                return 1;
+            }
+            if (ssa_set_pass_enabled(pass, enable) != 0) {
+                printf("Unknown pass: %s (see --list-passes)\n", pass);
+                free(source);
+                return 1;
+            }
+            optimize_ir = 1;
+        }
+        else if (strcmp(argv[i], "--time-passes") == 0) {
+            time_passes = 1;
+            ssa_set_time_passes(1);
+        }
+        else if (strcmp(argv[i], "--list-passes") == 0) {
+            ssa_list_passes(stdout);
+        }
+        else if (strcmp(argv[i], "--bench-passes") == 0) {
+            int n = (int)option_count(argc, argv, &i, 100000);
+            if (ssa_bench_passes(n) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--profile-generate") == 0) {
+            // where instrumented runs (--bench-pgo) write their block and edge counts; an IR program
+            // gets its training run in the SSA interpreter right away
+            const char* path = option_arg(argc, argv, &i);
+            if (!path) {
+                free(source);
+                return 1;
+            }
+            ssa_set_profile_generate(path);
+            if (vm_program && strcmp(strrchr(argv[1], '.'), ".bin") != 0 && ssa_profile_ir_file(argv[1]) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--profile-use") == 0) {
+            // profile applied before the pass pipeline of later --native/--bench-* runs
+            const char* path = option_arg(argc, argv, &i);
+            if (!path) {
+                free(source);
+                return 1;
+            }
+            ssa_set_profile_use(path);
+            optimize_ir = 1;
+        }
+        else if (strcmp(argv[i], "--bench-pgo") == 0) {
+            int n = (int)option_count(argc, argv, &i, 100000);
+            if (ssa_bench_pgo(n) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bench-tailcall") == 0) {
+            int n = (int)option_count(argc, argv, &i, 100000);
+            if (ssa_bench_tailcall(n) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bench-isel") == 0) {
+            int n = (int)option_count(argc, argv, &i, 100000000);
+            if (isel_bench(n) != 0) {
+                free(source);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--bench-itoa") == 0) {
+            long long n = option_count(argc, argv, &i, 100000000LL);
+            rlink_bench_int_to_str(n);
+        }
+        else if (strcmp(argv[i], "--bench-dtoa") == 0) {
+            long long n = option_count(argc, argv, &i, 1000000LL);
+            rlink_bench_float_to_str(n);
+        }
         else {
             printf("Unknown option: %s\n", argv[i]);
+            free(source);
+            return 1;
         }
     }
+    if (time_passes) ssa_report_pass_times(stdout);
 
     free(source);
     return 0;
@@ -869,11 +1234,17 @@ void emit_ir_header() {
     printf("[IR] entry main\n");
 }
 
+// Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
 void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
     if (arg2)
         printf("[IR] %s %s, %s\n", op, arg1, arg2);
-    else
+    else if (arg1)
         printf("[IR] %s %s\n", op, arg1);
+    else
+        printf("[IR] %s\n", op);
+    ir_record(op, arg1, arg2);
 }
 
 void expand_macro(const char* macro_name) {
@@ -1325,11 +1696,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -1343,60 +1718,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             emit_ir_operation("HALT", NULL, NULL);
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 20 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "section .text\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    mov rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 19\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-            );
-            fclose(f);
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -1434,11 +1760,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -1463,75 +1793,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             emit_ir_operation("HALT", NULL, NULL);
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 20 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "\n"
-                "    ; Floating point addition using x87\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    sub rsp, 8\n"
-                "    fstp qword [rsp]\n"
-                "    lea rdi, [rel fmt]\n"
-                "    mov rax, 1\n"
-                "    call printf\n"
-                "    add rsp, 8\n"
-                "\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 19\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-            );
-            fclose(f);
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -1569,11 +1835,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -1598,80 +1868,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             emit_ir_operation("HALT", NULL, NULL);
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 20 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "fltstr db 20 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    fstp qword [fltstr]\n"
-                "\n"
-                "    ; Optional printf output\n"
-                "    lea rdi, [rel fmt]\n"
-                "    movq xmm0, [fltstr]\n"
-                "    mov rax, 1\n"
-                "    call printf\n"
-                "\n"
-                "    ; OR: syscall-style float-to-string output\n"
-                "    ; This version assumes float already stored\n"
-                "    ; Convert float manually if needed (not trivial in asm)\n"
-                "\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 19\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-            );
-            fclose(f);
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -1712,11 +1913,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -1741,96 +1946,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             emit_ir_operation("HALT", NULL, NULL);
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 64 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "fltstr db 64 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    fstp qword [fltstr]\n"
-                "\n"
-                "    ; Optional printf output\n"
-                "    %s\n"
-                "\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 63\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-                "\n"
-                "float_to_str:\n"
-                "    ; extract int and frac parts\n"
-                "    fld qword [fltstr]\n"
-                "    fld st0\n"
-                "    frndint\n"
-                "    fsub st1, st0\n"
-                "    fxch\n"
-                "    fistp qword [buffer + 32]\n"
-                "    fld st0\n"
-                "    fmul qword [ten]\n"
-                "    frndint\n"
-                "    fistp qword [buffer + 40]\n"
-                "    mov rdi, [buffer + 32]\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdi, buffer\n"
-                "    call strlen\n"
-                "    mov byte [buffer + rax], '.'\n"
-                "    mov rdi, [buffer + 40]\n"
-                "    mov rsi, buffer + rax + 1\n"
-                "    call int_to_str\n"
-                "    ret\n"
-                , USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
-            fclose(f);
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -1871,11 +1991,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -1900,96 +2024,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             emit_ir_operation("HALT", NULL, NULL);
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 64 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "fltstr db 64 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    fstp qword [fltstr]\n"
-                "\n"
-                "    ; Optional printf output\n"
-                "    %s\n"
-                "\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 63\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-                "\n"
-                "float_to_str:\n"
-                "    ; extract int and frac parts\n"
-                "    fld qword [fltstr]\n"
-                "    fld st0\n"
-                "    frndint\n"
-                "    fsub st1, st0\n"
-                "    fxch\n"
-                "    fistp qword [buffer + 32]\n"
-                "    fld st0\n"
-                "    fmul qword [ten]\n"
-                "    frndint\n"
-                "    fistp qword [buffer + 40]\n"
-                "    mov rdi, [buffer + 32]\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdi, buffer\n"
-                "    call strlen\n"
-                "    mov byte [buffer + rax], '.'\n"
-                "    mov rdi, [buffer + 40]\n"
-                "    mov rsi, buffer + rax + 1\n"
-                "    call int_to_str\n"
-                "    ret\n"
-                , USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
-            fclose(f);
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -2030,11 +2069,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -2059,96 +2102,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             emit_ir_operation("HALT", NULL, NULL);
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 64 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "fltstr db 64 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    fstp qword [fltstr]\n"
-                "\n"
-                "    ; Optional printf output\n"
-                "    %s\n"
-                "\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 63\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-                "\n"
-                "float_to_str:\n"
-                "    ; extract int and frac parts\n"
-                "    fld qword [fltstr]\n"
-                "    fld st0\n"
-                "    frndint\n"
-                "    fsub st1, st0\n"
-                "    fxch\n"
-                "    fistp qword [buffer + 32]\n"
-                "    fld st0\n"
-                "    fmul qword [ten]\n"
-                "    frndint\n"
-                "    fistp qword [buffer + 40]\n"
-                "    mov rdi, [buffer + 32]\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdi, buffer\n"
-                "    call strlen\n"
-                "    mov byte [buffer + rax], '.'\n"
-                "    mov rdi, [buffer + 40]\n"
-                "    mov rsi, buffer + rax + 1\n"
-                "    call int_to_str\n"
-                "    ret\n"
-                , USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
-            fclose(f);
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -2189,11 +2147,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -2218,96 +2180,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             emit_ir_operation("HALT", NULL, NULL);
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 64 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "fltstr db 64 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    fstp qword [fltstr]\n"
-                "\n"
-                "    ; Optional printf output\n"
-                "    %s\n"
-                "\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 63\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-                "\n"
-                "float_to_str:\n"
-                "    ; extract int and frac parts\n"
-                "    fld qword [fltstr]\n"
-                "    fld st0\n"
-                "    frndint\n"
-                "    fsub st1, st0\n"
-                "    fxch\n"
-                "    fistp qword [buffer + 32]\n"
-                "    fld st0\n"
-                "    fmul qword [ten]\n"
-                "    frndint\n"
-                "    fistp qword [buffer + 40]\n"
-                "    mov rdi, [buffer + 32]\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdi, buffer\n"
-                "    call strlen\n"
-                "    mov byte [buffer + rax], '.'\n"
-                "    mov rdi, [buffer + 40]\n"
-                "    mov rsi, buffer + rax + 1\n"
-                "    call int_to_str\n"
-                "    ret\n"
-                , USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
-            fclose(f);
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -2347,11 +2224,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -2392,94 +2273,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("\n=======================\n");
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 64 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "fltstr db 64 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    fstp qword [fltstr]\n"
-                "\n"
-                "    %s\n"
-                "\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 63\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-                "\n"
-                "float_to_str:\n"
-                "    fld qword [fltstr]\n"
-                "    fld st0\n"
-                "    frndint\n"
-                "    fsub st1, st0\n"
-                "    fxch\n"
-                "    fistp qword [buffer + 32]\n"
-                "    fld st0\n"
-                "    fmul qword [ten]\n"
-                "    frndint\n"
-                "    fistp qword [buffer + 40]\n"
-                "    mov rdi, [buffer + 32]\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdi, buffer\n"
-                "    call strlen\n"
-                "    mov byte [buffer + rax], '.'\n"
-                "    mov rdi, [buffer + 40]\n"
-                "    mov rsi, buffer + rax + 1\n"
-                "    call int_to_str\n"
-                "    ret\n",
-                USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
-            fclose(f);
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -2639,11 +2437,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void expand_macro_to_ir(const char* macro_name, FILE* output) {
@@ -2791,11 +2593,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -2820,96 +2626,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             emit_ir_operation("HALT", NULL, NULL);
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 64 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "fltstr db 64 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    fstp qword [fltstr]\n"
-                "\n"
-                "    ; Optional printf output\n"
-                "    %s\n"
-                "\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 63\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-                "\n"
-                "float_to_str:\n"
-                "    ; extract int and frac parts\n"
-                "    fld qword [fltstr]\n"
-                "    fld st0\n"
-                "    frndint\n"
-                "    fsub st1, st0\n"
-                "    fxch\n"
-                "    fistp qword [buffer + 32]\n"
-                "    fld st0\n"
-                "    fmul qword [ten]\n"
-                "    frndint\n"
-                "    fistp qword [buffer + 40]\n"
-                "    mov rdi, [buffer + 32]\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdi, buffer\n"
-                "    call strlen\n"
-                "    mov byte [buffer + rax], '.'\n"
-                "    mov rdi, [buffer + 40]\n"
-                "    mov rsi, buffer + rax + 1\n"
-                "    call int_to_str\n"
-                "    ret\n"
-                , USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
-            fclose(f);
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -2949,11 +2670,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -2978,95 +2703,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             emit_ir_operation("HALT", NULL, NULL);
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 64 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "fltstr db 64 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    fstp qword [fltstr]\n"
-                "\n"
-                "    ; Optional printf output\n"
-                "    %s\n"
-                "\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 63\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-                "\n"
-                "float_to_str:\n"
-                "    fld qword [fltstr]\n"
-                "    fld st0\n"
-                "    frndint\n"
-                "    fsub st1, st0\n"
-                "    fxch\n"
-                "    fistp qword [buffer + 32]\n"
-                "    fld st0\n"
-                "    fmul qword [ten]\n"
-                "    frndint\n"
-                "    fistp qword [buffer + 40]\n"
-                "    mov rdi, [buffer + 32]\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdi, buffer\n"
-                "    call strlen\n"
-                "    mov byte [buffer + rax], '.'\n"
-                "    mov rdi, [buffer + 40]\n"
-                "    mov rsi, buffer + rax + 1\n"
-                "    call int_to_str\n"
-                "    ret\n"
-                , USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
-            fclose(f);
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -3134,11 +2775,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -3163,96 +2808,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             emit_ir_operation("HALT", NULL, NULL);
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 64 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "fltstr db 64 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    fstp qword [fltstr]\n"
-                "\n"
-                "    ; Optional printf output\n"
-                "    %s\n"
-                "\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 63\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-                "\n"
-                "float_to_str:\n"
-                "    ; extract int and frac parts\n"
-                "    fld qword [fltstr]\n"
-                "    fld st0\n"
-                "    frndint\n"
-                "    fsub st1, st0\n"
-                "    fxch\n"
-                "    fistp qword [buffer + 32]\n"
-                "    fld st0\n"
-                "    fmul qword [ten]\n"
-                "    frndint\n"
-                "    fistp qword [buffer + 40]\n"
-                "    mov rdi, [buffer + 32]\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdi, buffer\n"
-                "    call strlen\n"
-                "    mov byte [buffer + rax], '.'\n"
-                "    mov rdi, [buffer + 40]\n"
-                "    mov rsi, buffer + rax + 1\n"
-                "    call int_to_str\n"
-                "    ret\n"
-                , USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
-            fclose(f);
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -3299,11 +2859,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -3362,89 +2926,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             pthread_detach(thread_id);
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 64 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "fltstr db 64 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    fstp qword [fltstr]\n"
-                "    %s\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 63\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-                "float_to_str:\n"
-                "    fld qword [fltstr]\n"
-                "    fld st0\n"
-                "    frndint\n"
-                "    fsub st1, st0\n"
-                "    fxch\n"
-                "    fistp qword [buffer + 32]\n"
-                "    fld st0\n"
-                "    fmul qword [ten]\n"
-                "    frndint\n"
-                "    fistp qword [buffer + 40]\n"
-                "    mov rdi, [buffer + 32]\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdi, buffer\n"
-                "    call strlen\n"
-                "    mov byte [buffer + rax], '.'\n"
-                "    mov rdi, [buffer + 40]\n"
-                "    mov rsi, buffer + rax + 1\n"
-                "    call int_to_str\n"
-                "    ret\n",
-                USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
-            fclose(f);
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -3487,11 +2973,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -3522,96 +3012,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             emit_ir_operation("HALT", NULL, NULL);
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 64 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "fltstr db 64 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    fstp qword [fltstr]\n"
-                "\n"
-                "    ; Optional printf output\n"
-                "    %s\n"
-                "\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 63\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-                "\n"
-                "float_to_str:\n"
-                "    ; extract int and frac parts\n"
-                "    fld qword [fltstr]\n"
-                "    fld st0\n"
-                "    frndint\n"
-                "    fsub st1, st0\n"
-                "    fxch\n"
-                "    fistp qword [buffer + 32]\n"
-                "    fld st0\n"
-                "    fmul qword [ten]\n"
-                "    frndint\n"
-                "    fistp qword [buffer + 40]\n"
-                "    mov rdi, [buffer + 32]\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdi, buffer\n"
-                "    call strlen\n"
-                "    mov byte [buffer + rax], '.'\n"
-                "    mov rdi, [buffer + 40]\n"
-                "    mov rsi, buffer + rax + 1\n"
-                "    call int_to_str\n"
-                "    ret\n"
-                , USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
-            fclose(f);
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -3653,11 +3058,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             printf("[IR] entry main\n");
         }
 
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         void generate_intermediate_code() {
@@ -3682,96 +3091,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             emit_ir_operation("HALT", NULL, NULL);
         }
 
-        void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 64 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "fltstr db 64 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    fstp qword [fltstr]\n"
-                "\n"
-                "    ; Optional printf output\n"
-                "    %s\n"
-                "\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 63\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-                "\n"
-                "float_to_str:\n"
-                "    ; extract int and frac parts\n"
-                "    fld qword [fltstr]\n"
-                "    fld st0\n"
-                "    frndint\n"
-                "    fsub st1, st0\n"
-                "    fxch\n"
-                "    fistp qword [buffer + 32]\n"
-                "    fld st0\n"
-                "    fmul qword [ten]\n"
-                "    frndint\n"
-                "    fistp qword [buffer + 40]\n"
-                "    mov rdi, [buffer + 32]\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdi, buffer\n"
-                "    call strlen\n"
-                "    mov byte [buffer + rax], '.'\n"
-                "    mov rdi, [buffer + 40]\n"
-                "    mov rsi, buffer + rax + 1\n"
-                "    call int_to_str\n"
-                "    ret\n"
-                , USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
 
-            fclose(f);
+        void generate_asm_from_ir() {
+            if (isel_write_asm("rexion.asm") != 0) return;
             printf("[ASM] rexion.asm generated from IR\n");
         }
 
@@ -3819,11 +3143,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
         }
 
         // DOC: Emits one IR instruction with optional arguments
+        // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+        extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
         void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
             if (arg2)
                 printf("[IR] %s %s, %s\n", op, arg1, arg2);
             else
                 printf("[IR] %s %s\n", op, arg1);
+            ir_record(op, arg1, arg2);
         }
 
         // DOC: Generate IR from parsed logic and macro traceable actions
@@ -3850,79 +3178,13 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             emit_ir_operation("HALT", NULL, NULL);
         }
 
-        // DOC: Assembler emitter from IR and macro trace rewrite layer
+        // Lowers the IR buffer to rexion.asm through rexion_isel.c
+        extern int isel_write_asm(const char* path);
+
         void generate_asm_from_ir() {
-            FILE* f = fopen("rexion.asm", "w");
-            if (!f) { perror("Failed to write ASM"); return; }
-
-            // DOC: .data and .text sections, float/print handlers, int_to_str impl
-            fprintf(f,
-                "section .data\n"
-                "result dq 0\n"
-                "buffer db 64 dup(0)\n"
-                "fltval dq 3.14\n"
-                "fltval2 dq 2.71\n"
-                "fltstr db 64 dup(0)\n"
-                "newline db 0xA, 0\n"
-                "fmt db '%%f', 10, 0\n"
-                "section .text\n"
-                "extern printf\n"
-                "global _start\n"
-                "_start:\n"
-                "    mov rax, 5\n"
-                "    mov rbx, 3\n"
-                "    add rcx, rax\n"
-                "    add rcx, rbx\n"
-                "    mov [result], rcx\n"
-                "\n"
-                "    fld qword [fltval]\n"
-                "    fadd qword [fltval2]\n"
-                "    fstp qword [fltstr]\n"
-                "\n"
-                "    ; Optional printf output\n"
-                "    %s\n"
-                "\n"
-                "    mov rdi, rcx\n"
-                "    mov rsi, buffer\n"
-                "    call int_to_str\n"
-                "    mov rdx, rax\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, buffer\n"
-                "    syscall\n"
-                "    mov rax, 1\n"
-                "    mov rdi, 1\n"
-                "    mov rsi, newline\n"
-                "    mov rdx, 1\n"
-                "    syscall\n"
-                "    mov eax, 60\n"
-                "    xor edi, edi\n"
-                "    syscall\n"
-                "\n"
-                "int_to_str:\n"
-                "    mov rbx, 10\n"
-                "    mov rax, rdi\n"
-                "    xor rcx, rcx\n"
-                "    add rsi, 63\n"
-                "    mov byte [rsi], 0\n"
-                "convert_loop:\n"
-                "    xor rdx, rdx\n"
-                "    div rbx\n"
-                "    add dl, '0'\n"
-                "    dec rsi\n"
-                "    mov [rsi], dl\n"
-                "    inc rcx\n"
-                "    test rax, rax\n"
-                "    jnz convert_loop\n"
-                "    mov rax, rcx\n"
-                "    ret\n"
-                "\n"
-                "float_to_str:\n"
-                "    ; extract int and frac parts\n"
-                "    fld qword [fltstr]\n"
-                "    fld st0\n"
-                "    frndint\n"
-                "    fsub st1, st0\n
+            if (isel_write_asm("rexion.asm") != 0) return;
+            printf("[ASM] rexion.asm generated from IR\n");
+        }
 
 
 #include <stdio.h>
@@ -3967,11 +3229,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
             }
 
             // DOC: Emit single IR instruction
+            // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+            extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
             void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
                 if (arg2)
                     printf("[IR] %s %s, %s\n", op, arg1, arg2);
                 else
                     printf("[IR] %s %s\n", op, arg1);
+                ir_record(op, arg1, arg2);
             }
 
             // DOC: Generate example IR sequence with macro trigger
@@ -3998,97 +3264,12 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
                 emit_ir_operation("HALT", NULL, NULL);
             }
 
-            // DOC: Generate .asm output from IR and macros
-            void generate_asm_from_ir() {
-                FILE* f = fopen("rexion.asm", "w");
-                if (!f) { perror("Failed to write ASM"); return; }
-
-                fprintf(f,
-                    "section .data\n"
-                    "result dq 0\n"
-                    "buffer db 64 dup(0)\n"
-                    "fltval dq 3.14\n"
-                    "fltval2 dq 2.71\n"
-                    "fltstr db 64 dup(0)\n"
-                    "newline db 0xA, 0\n"
-                    "fmt db '%%f', 10, 0\n"
-                    "section .text\n"
-                    "extern printf\n"
-                    "global _start\n"
-                    "_start:\n"
-                    "    mov rax, 5\n"
-                    "    mov rbx, 3\n"
-                    "    add rcx, rax\n"
-                    "    add rcx, rbx\n"
-                    "    mov [result], rcx\n"
-                    "\n"
-                    "    fld qword [fltval]\n"
-                    "    fadd qword [fltval2]\n"
-                    "    fstp qword [fltstr]\n"
-                    "\n"
-                    "    %s\n"
-                    "\n"
-                    "    mov rdi, rcx\n"
-                    "    mov rsi, buffer\n"
-                    "    call int_to_str\n"
-                    "    mov rdx, rax\n"
-                    "    mov rax, 1\n"
-                    "    mov rdi, 1\n"
-                    "    mov rsi, buffer\n"
-                    "    syscall\n"
-                    "    mov rax, 1\n"
-                    "    mov rdi, 1\n"
-                    "    mov rsi, newline\n"
-                    "    mov rdx, 1\n"
-                    "    syscall\n"
-                    "    mov eax, 60\n"
-                    "    xor edi, edi\n"
-                    "    syscall\n"
-                    "\n"
-                    "int_to_str:\n"
-                    "    mov rbx, 10\n"
-                    "    mov rax, rdi\n"
-                    "    xor rcx, rcx\n"
-                    "    add rsi, 63\n"
-                    "    mov byte [rsi], 0\n"
-                    "convert_loop:\n"
-                    "    xor rdx, rdx\n"
-                    "    div rbx\n"
-                    "    add dl, '0'\n"
-                    "    dec rsi\n"
-                    "    mov [rsi], dl\n"
-                    "    inc rcx\n"
-                    "    test rax, rax\n"
-                    "    jnz convert_loop\n"
-                    "    mov rax, rcx\n"
-                    "    ret\n"
-                    "\n"
-                    "float_to_str:\n"
-                    "    fld qword [fltstr]\n"
-                    "    fld st0\n"
-                    "    frndint\n"
-                    "    fsub st1, st0\n"
-                    "    fxch\n"
-                    "    fistp qword [buffer + 32]\n"
-                    "    fld st0\n"
-                    "    fmul qword [ten]\n"
-                    "    frndint\n"
-                    "    fistp qword [buffer + 40]\n"
-                    "    mov rdi, [buffer + 32]\n"
-                    "    mov rsi, buffer\n"
-                    "    call int_to_str\n"
-                    "    mov rdi, buffer\n"
-                    "    call strlen\n"
-                    "    mov byte [buffer + rax], '.'\n"
-                    "    mov rdi, [buffer + 40]\n"
-                    "    mov rsi, buffer + rax + 1\n"
-                    "    call int_to_str\n"
-                    "    ret\n",
-                    USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+            // Lowers the IR buffer to rexion.asm through rexion_isel.c
+            extern int isel_write_asm(const char* path);
 
-                fclose(f);
+            void generate_asm_from_ir() {
+                if (isel_write_asm("rexion.asm") != 0) return;
                 printf("[ASM] rexion.asm generated from IR\n");
-                tui_notify_macro_reload("⚡ Macro reloaded! (via IR codegen)");
             }
 
             // DOC: Triggered by main.c to start codegen pipeline
@@ -4264,11 +3445,15 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
                 printf("[IR] entry main\n");
             }
 
+            // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+            extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
             void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
                 if (arg2)
                     printf("[IR] %s %s, %s\n", op, arg1, arg2);
                 else
                     printf("[IR] %s %s\n", op, arg1);
+                ir_record(op, arg1, arg2);
             }
 
             void generate_intermediate_code() {
@@ -4336,72 +3521,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
                 pthread_create(&macro_watcher_thread, NULL, watch_macros, NULL);
             }
 
-            void generate_asm_from_ir() {
-                FILE* f = fopen("rexion.asm", "w");
-                if (!f) { perror("Failed to write ASM"); return; }
-
-                fprintf(f,
-                    "section .data\n"
-                    "result dq 0\n"
-                    "buffer db 64 dup(0)\n"
-                    "fltval dq 3.14\n"
-                    "fltval2 dq 2.71\n"
-                    "fltstr db 64 dup(0)\n"
-                    "newline db 0xA, 0\n"
-                    "fmt db '%%f', 10, 0\n"
-                    "section .text\n"
-                    "extern printf\n"
-                    "global _start\n"
-                    "_start:\n"
-                    "    mov rax, 5\n"
-                    "    mov rbx, 3\n"
-                    "    add rcx, rax\n"
-                    "    add rcx, rbx\n"
-                    "    mov [result], rcx\n"
-                    "\n"
-                    "    fld qword [fltval]\n"
-                    "    fadd qword [fltval2]\n"
-                    "    fstp qword [fltstr]\n"
-                    "\n"
-                    "    %s\n"
-                    "\n"
-                    "    mov rdi, rcx\n"
-                    "    mov rsi, buffer\n"
-                    "    call int_to_str\n"
-                    "    mov rdx, rax\n"
-                    "    mov rax, 1\n"
-                    "    mov rdi, 1\n"
-                    "    mov rsi, buffer\n"
-                    "    syscall\n"
-                    "    mov rax, 1\n"
-                    "    mov rdi, 1\n"
-                    "    mov rsi, newline\n"
-                    "    mov rdx, 1\n"
-                    "    syscall\n"
-                    "    mov eax, 60\n"
-                    "    xor edi, edi\n"
-                    "    syscall\n"
-                    "\n"
-                    "int_to_str:\n"
-                    "    mov rbx, 10\n"
-                    "    mov rax, rdi\n"
-                    "    xor rcx, rcx\n"
-                    "    add rsi, 63\n"
-                    "    mov byte [rsi], 0\n"
-                    "convert_loop:\n"
-                    "    xor rdx, rdx\n"
-                    "    div rbx\n"
-                    "    add dl, '0'\n"
-                    "    dec rsi\n"
-                    "    mov [rsi], dl\n"
-                    "    inc rcx\n"
-                    "    test rax, rax\n"
-                    "    jnz convert_loop\n"
-                    "    mov rax, rcx\n"
-                    "    ret\n"
-                    , USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+            // Lowers the IR buffer to rexion.asm through rexion_isel.c
+            extern int isel_write_asm(const char* path);
 
-                fclose(f);
+            void generate_asm_from_ir() {
+                if (isel_write_asm("rexion.asm") != 0) return;
                 printf("[ASM] rexion.asm generated from IR\n");
             }
 
@@ -4444,12 +3568,16 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
                 printf("[IR] entry main\n");
             }
 
+            // Also records the op in the IR buffer (rexion_ir.c) for generate_asm_from_ir()
+            extern void ir_record(const char* op, const char* arg1, const char* arg2);
+
             void emit_ir_operation(const char* op, const char* arg1, const char* arg2) {
                 if (arg2)
                     printf("[IR] %s %s, %s\n", op, arg1, arg2);
                 else
                     printf("[IR] %s %s\n", op, arg1);
                 log_macro_trace(op, arg1, arg2);  // Trace each macro usage into TUI buffer
+                ir_record(op, arg1, arg2);
             }
 
             void generate_intermediate_code() {
@@ -4492,95 +3620,11 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
                 generate_asm_from_ir();
             }
 
-            // DOC: Start of IR → ASM generation and embedded float string conversion
-            void generate_asm_from_ir() {
-                FILE* f = fopen("rexion.asm", "w");
-                if (!f) { perror("Failed to write ASM"); return; }
-
-                fprintf(f,
-                    "section .data\n"
-                    "result dq 0\n"
-                    "buffer db 64 dup(0)\n"
-                    "fltval dq 3.14\n"
-                    "fltval2 dq 2.71\n"
-                    "fltstr db 64 dup(0)\n"
-                    "newline db 0xA, 0\n"
-                    "fmt db '%%f', 10, 0\n"
-                    "section .text\n"
-                    "extern printf\n"
-                    "global _start\n"
-                    "_start:\n"
-                    "    mov rax, 5\n"
-                    "    mov rbx, 3\n"
-                    "    add rcx, rax\n"
-                    "    add rcx, rbx\n"
-                    "    mov [result], rcx\n"
-                    "\n"
-                    "    fld qword [fltval]\n"
-                    "    fadd qword [fltval2]\n"
-                    "    fstp qword [fltstr]\n"
-                    "\n"
-                    "    %s\n"
-                    "\n"
-                    "    mov rdi, rcx\n"
-                    "    mov rsi, buffer\n"
-                    "    call int_to_str\n"
-                    "    mov rdx, rax\n"
-                    "    mov rax, 1\n"
-                    "    mov rdi, 1\n"
-                    "    mov rsi, buffer\n"
-                    "    syscall\n"
-                    "    mov rax, 1\n"
-                    "    mov rdi, 1\n"
-                    "    mov rsi, newline\n"
-                    "    mov rdx, 1\n"
-                    "    syscall\n"
-                    "    mov eax, 60\n"
-                    "    xor edi, edi\n"
-                    "    syscall\n"
-                    "\n"
-                    "int_to_str:\n"
-                    "    mov rbx, 10\n"
-                    "    mov rax, rdi\n"
-                    "    xor rcx, rcx\n"
-                    "    add rsi, 63\n"
-                    "    mov byte [rsi], 0\n"
-                    "convert_loop:\n"
-                    "    xor rdx, rdx\n"
-                    "    div rbx\n"
-                    "    add dl, '0'\n"
-                    "    dec rsi\n"
-                    "    mov [rsi], dl\n"
-                    "    inc rcx\n"
-                    "    test rax, rax\n"
-                    "    jnz convert_loop\n"
-                    "    mov rax, rcx\n"
-                    "    ret\n"
-                    "\n"
-                    "float_to_str:\n"
-                    "    fld qword [fltstr]\n"
-                    "    fld st0\n"
-                    "    frndint\n"
-                    "    fsub st1, st0\n"
-                    "    fxch\n"
-                    "    fistp qword [buffer + 32]\n"
-                    "    fld st0\n"
-                    "    fmul qword [ten]\n"
-                    "    frndint\n"
-                    "    fistp qword [buffer + 40]\n"
-                    "    mov rdi, [buffer + 32]\n"
-                    "    mov rsi, buffer\n"
-                    "    call int_to_str\n"
-                    "    mov rdi, buffer\n"
-                    "    call strlen\n"
-                    "    mov byte [buffer + rax], '.'\n"
-                    "    mov rdi, [buffer + 40]\n"
-                    "    mov rsi, buffer + rax + 1\n"
-                    "    call int_to_str\n"
-                    "    ret\n"
-                    , USE_PRINTF ? "lea rdi, [rel fmt]\n    movq xmm0, [fltstr]\n    mov rax, 1\n    call printf" : "call float_to_str\n    mov rdx, rax\n    mov rax, 1\n    mov rdi, 1\n    mov rsi, buffer\n    syscall");
+            // Lowers the IR buffer to rexion.asm through rexion_isel.c
+            extern int isel_write_asm(const char* path);
 
-                fclose(f);
+            void generate_asm_from_ir() {
+                if (isel_write_asm("rexion.asm") != 0) return;
                 printf("[ASM] rexion.asm generated from IR\n");
             }
 
@@ -5119,245 +4163,1483 @@ else if (strcmp(argv[i], "--rexasm") == 0) {
                 return 0;
             }
 
-// peephole_optimizer.c – Rexion Peephole Optimizer
+// rexion_ir.c – Rexion IR core (interned string table, packed records, .rirb container)
+// DOC: One IR instruction is a fixed 20-byte record: opcode, operand count and string-table ids
+// DOC: Operand/mnemonic strings are interned, so equal strings share one id and compare as integers
+// DOC: .rirb = versioned header + packed records + string table; loaded by mmap and used in place
+// DOC: Text ("OP a, b", optional "[IR]" prefix) and JSON (r4.ir.json) forms round-trip losslessly
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <math.h>
 
-#define MAX_IR 1024
-#define MAX_LEN 128
+#define IR_MAX_ARGS 3
+
+typedef enum {
+    IR_OP_UNKNOWN = 0,
+    IR_OP_NOP, IR_OP_LOAD, IR_OP_STORE, IR_OP_MOV, IR_OP_LOAD_STR,
+    IR_OP_ADD, IR_OP_SUB, IR_OP_MUL, IR_OP_DIV, IR_OP_MOD,
+    IR_OP_FLOAT_LOAD, IR_OP_FLOAT_ADD, IR_OP_FLOAT_SUB, IR_OP_FLOAT_MUL, IR_OP_FLOAT_DIV,
+    IR_OP_CMP_EQ, IR_OP_CMP_NE, IR_OP_CMP_LT, IR_OP_CMP_LE, IR_OP_CMP_GT, IR_OP_CMP_GE,
+    IR_OP_LABEL, IR_OP_JMP, IR_OP_IFZ, IR_OP_FUNC, IR_OP_PARAM, IR_OP_ARG, IR_OP_CALL, IR_OP_RET,
+    IR_OP_PRINT, IR_OP_PRINT_FLOAT_SYSCALL, IR_OP_PRINT_FLOAT_PRINTF,
+    IR_OP_IMPORT, IR_OP_DECLARE, IR_OP_SECTION, IR_OP_ENTRY, IR_OP_HALT,
+    IR_OP_IF, IR_OP_ELSE, IR_OP_END_IF, IR_OP_WHILE, IR_OP_END_WHILE,
+    IR_OP_COUNT
+} IROpcode;
+
+const char* ir_opcode_names[IR_OP_COUNT] = {
+    "",
+    "NOP", "LOAD", "STORE", "MOV", "LOAD_STR",
+    "ADD", "SUB", "MUL", "DIV", "MOD",
+    "FLOAT_LOAD", "FLOAT_ADD", "FLOAT_SUB", "FLOAT_MUL", "FLOAT_DIV",
+    "CMP_EQ", "CMP_NE", "CMP_LT", "CMP_LE", "CMP_GT", "CMP_GE",
+    "LABEL", "JMP", "IFZ", "FUNC", "PARAM", "ARG", "CALL", "RET",
+    "PRINT", "PRINT_FLOAT_SYSCALL", "PRINT_FLOAT_PRINTF",
+    "IMPORT", "DECLARE", "section", "entry", "HALT",
+    "IF", "ELSE", "END_IF", "WHILE", "END_WHILE"
+};
 
 typedef struct {
-    char op[MAX_LEN];
-    char arg1[MAX_LEN];
-    char arg2[MAX_LEN];
+    uint16_t opcode;            // IROpcode, IR_OP_UNKNOWN for mnemonics outside the table
+    uint16_t nargs;             // operands actually present (0..IR_MAX_ARGS)
+    uint32_t op;                // string-table id of the mnemonic
+    uint32_t arg[IR_MAX_ARGS];  // string-table ids, 0 = ""
 } IRInstruction;
 
-IRInstruction ir[MAX_IR];
+// Growable instruction buffer. ir_cap == 0 with ir != NULL means the records are
+// borrowed from a .rirb mapping; the first append copies them to the heap.
+IRInstruction* ir = NULL;
 int ir_count = 0;
+static int ir_cap = 0;
+
+// String table: NUL-terminated strings back to back, id = byte offset, id 0 = "".
+char* ir_strtab = NULL;
+uint32_t ir_strtab_len = 0;
+static uint32_t ir_strtab_cap = 0;      // 0 while borrowed from a mapping
+// Open-addressing hash of ids (id 0 = empty slot). Each slot keeps the string's hash, so a probe
+// only reads the string table on a full hash match.
+typedef struct { uint32_t id, hash; } IRStrSlot;
+static IRStrSlot* ir_str_index = NULL;
+static uint32_t ir_str_index_cap = 0;
+static uint32_t ir_str_index_used = 0;
+
+static void* ir_map_base = NULL;        // live .rirb mapping, if any
+static size_t ir_map_size = 0;
+
+long long ir_bytes_read = 0;            // input consumed by the last load; stdin has no size to stat
+
+static void* ir_xrealloc(void* p, size_t size) {
+    void* q = realloc(p, size ? size : 1);
+    if (!q) { perror("ir_xrealloc"); exit(1); }
+    return q;
+}
 
-void load_ir_from_file(const char* filename) {
-    FILE* f = fopen(filename, "r");
-    if (!f) { perror("load_ir_from_file"); return; }
-    while (fscanf(f, "%s %s %s", ir[ir_count].op, ir[ir_count].arg1, ir[ir_count].arg2) != EOF) {
-        ir_count++;
-    }
-    fclose(f);
+static uint32_t ir_hash(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
 }
 
-void save_ir_to_file(const char* filename) {
-    FILE* f = fopen(filename, "w");
-    if (!f) { perror("save_ir_to_file"); return; }
-    for (int i = 0; i < ir_count; i++) {
-        fprintf(f, "%s %s %s\n", ir[i].op, ir[i].arg1, ir[i].arg2);
-    }
-    fclose(f);
+const char* ir_str(uint32_t id) {
+    return (ir_strtab && id < ir_strtab_len) ? ir_strtab + id : "";
 }
 
-// Optimization Passes
+// PRINT of a float, as every backend writes it: the shortest digits that read back as `v`, in
+// fixed form for decimal exponents -4..15 and d.ddde+XX otherwise (the native float_to_str layout).
+int ir_format_float(char* buf, size_t cap, double v) {
+    if (isnan(v)) return snprintf(buf, cap, "%s", signbit(v) ? "-nan" : "nan");
+    if (isinf(v)) return snprintf(buf, cap, "%s", v < 0 ? "-inf" : "inf");
+    char e[32];
+    int digits = 1;
+    while (snprintf(e, sizeof(e), "%.*e", digits - 1, v), digits < 17 && strtod(e, NULL) != v) digits++;
+    int exp10 = atoi(strchr(e, 'e') + 1);
+    if (exp10 < -4 || exp10 >= 16) return snprintf(buf, cap, "%s", e);
+    return snprintf(buf, cap, "%.*f", digits - 1 - exp10 > 0 ? digits - 1 - exp10 : 0, v);
+}
 
-void optimize_redundant_loads() {
-    for (int i = 1; i < ir_count; i++) {
-        if (strcmp(ir[i].op, "LOAD") == 0 && strcmp(ir[i-1].op, "LOAD") == 0) {
-            if (strcmp(ir[i].arg1, ir[i-1].arg1) == 0 && strcmp(ir[i].arg2, ir[i-1].arg2) == 0) {
-                for (int j = i; j < ir_count - 1; j++) ir[j] = ir[j+1];
-                ir_count--;
-                i--;
-            }
-        }
-    }
+static void ir_str_index_insert(uint32_t id) {
+    const char* s = ir_strtab + id;
+    uint32_t mask = ir_str_index_cap - 1;
+    uint32_t h = ir_hash(s, strlen(s));
+    uint32_t slot = h & mask;
+    while (ir_str_index[slot].id) slot = (slot + 1) & mask;
+    ir_str_index[slot].id = id;
+    ir_str_index[slot].hash = h;
+    ir_str_index_used++;
 }
 
-void optimize_useless_add_zero() {
-    for (int i = 0; i < ir_count; i++) {
-        if (strcmp(ir[i].op, "ADD") == 0 && strcmp(ir[i].arg2, "0") == 0) {
-            strcpy(ir[i].op, "NOP");
-            ir[i].arg1[0] = '\0';
-            ir[i].arg2[0] = '\0';
+static void ir_str_index_rebuild(uint32_t min_entries) {
+    uint32_t n = 0;
+    for (uint32_t id = 1; id < ir_strtab_len; id += (uint32_t)strlen(ir_strtab + id) + 1) n++;
+    if (n + 1 > min_entries) min_entries = n + 1;
+    uint32_t cap = 64;
+    while (cap < min_entries * 2) cap <<= 1;
+    free(ir_str_index);
+    ir_str_index = calloc(cap, sizeof(IRStrSlot));
+    if (!ir_str_index) { perror("ir_str_index"); exit(1); }
+    ir_str_index_cap = cap;
+    ir_str_index_used = 0;
+    for (uint32_t id = 1; id < ir_strtab_len; id += (uint32_t)strlen(ir_strtab + id) + 1)
+        ir_str_index_insert(id);
+}
+
+uint32_t ir_intern(const char* s, size_t len) {
+    if (len == 0) return 0;
+    if (!ir_strtab) {
+        ir_strtab_cap = 4096;
+        ir_strtab = ir_xrealloc(NULL, ir_strtab_cap);
+        ir_strtab[0] = '\0';
+        ir_strtab_len = 1;
+    }
+    if (!ir_str_index || (ir_str_index_used + 1) * 2 > ir_str_index_cap)
+        ir_str_index_rebuild(ir_str_index_used * 2 + 1);
+
+    uint32_t mask = ir_str_index_cap - 1;
+    uint32_t h = ir_hash(s, len);
+    uint32_t slot = h & mask;
+    for (uint32_t id; (id = ir_str_index[slot].id); slot = (slot + 1) & mask) {
+        if (ir_str_index[slot].hash == h && memcmp(ir_strtab + id, s, len) == 0 && ir_strtab[id + len] == '\0')
+            return id;
+    }
+
+    if (ir_strtab_len + len + 1 > ir_strtab_cap) {
+        uint32_t cap = ir_strtab_cap ? ir_strtab_cap : ir_strtab_len;
+        while (ir_strtab_len + len + 1 > cap) cap *= 2;
+        if (ir_strtab_cap == 0) {
+            // borrowed from a mapping: take a private heap copy before growing
+            char* owned = ir_xrealloc(NULL, cap);
+            memcpy(owned, ir_strtab, ir_strtab_len);
+            ir_strtab = owned;
+        } else {
+            ir_strtab = ir_xrealloc(ir_strtab, cap);
         }
+        ir_strtab_cap = cap;
     }
+    uint32_t id = ir_strtab_len;
+    memcpy(ir_strtab + id, s, len);
+    ir_strtab[id + len] = '\0';
+    ir_strtab_len += (uint32_t)len + 1;
+    ir_str_index[slot].id = id;
+    ir_str_index[slot].hash = h;
+    ir_str_index_used++;
+    return id;
 }
 
-void optimize_mov_to_same_register() {
-    for (int i = 0; i < ir_count; i++) {
-        if (strcmp(ir[i].op, "MOV") == 0 && strcmp(ir[i].arg1, ir[i].arg2) == 0) {
-            strcpy(ir[i].op, "NOP");
-            ir[i].arg1[0] = '\0';
-            ir[i].arg2[0] = '\0';
-        }
+IROpcode ir_opcode_of(const char* s, size_t len) {
+    for (int i = 1; i < IR_OP_COUNT; i++) {
+        if (strncmp(ir_opcode_names[i], s, len) == 0 && ir_opcode_names[i][len] == '\0')
+            return (IROpcode)i;
     }
+    return IR_OP_UNKNOWN;
 }
 
-void fold_constant_adds() {
-    for (int i = 0; i < ir_count - 2; i++) {
-        if (strcmp(ir[i].op, "LOAD") == 0 && strcmp(ir[i+1].op, "LOAD") == 0 && strcmp(ir[i+2].op, "ADD") == 0) {
-            int val1, val2;
-            if (sscanf(ir[i].arg2, "%d", &val1) == 1 &&
-                sscanf(ir[i+1].arg2, "%d", &val2) == 1 &&
-                strcmp(ir[i].arg1, ir[i+2].arg1) != 0 &&
-                strcmp(ir[i+1].arg1, ir[i+2].arg1) != 0) {
+// Mnemonic id -> opcode memo; a program uses a handful of mnemonics, so this
+// turns the name-table scan into one compare per instruction.
+static struct { uint32_t id; uint16_t opcode; } ir_opcode_memo[64];
 
-                int result = val1 + val2;
-                snprintf(ir[i].arg2, MAX_LEN, "%d", result);
-                strcpy(ir[i].arg1, ir[i+2].arg1);
-                for (int j = i+1; j < ir_count - 2; j++) ir[j] = ir[j+2];
-                ir_count -= 2;
-                i--;
-            }
-        }
+static uint16_t ir_opcode_cached(uint32_t id, const char* op, size_t op_len) {
+    unsigned slot = (id * 2654435761u) >> 26;
+    if (ir_opcode_memo[slot].id != id || id == 0) {
+        ir_opcode_memo[slot].id = id;
+        ir_opcode_memo[slot].opcode = (uint16_t)ir_opcode_of(op, op_len);
     }
+    return ir_opcode_memo[slot].opcode;
 }
 
-void run_all_peephole_passes() {
-    optimize_redundant_loads();
-    optimize_useless_add_zero();
-    optimize_mov_to_same_register();
-    fold_constant_adds();
+void ir_reserve(int count) {
+    if (count <= ir_cap) return;
+    int cap = ir_cap ? ir_cap : 1024;
+    while (cap < count) cap *= 2;
+    if (ir_cap == 0 && ir) {
+        IRInstruction* owned = ir_xrealloc(NULL, (size_t)cap * sizeof(IRInstruction));
+        memcpy(owned, ir, (size_t)ir_count * sizeof(IRInstruction));
+        ir = owned;
+    } else {
+        ir = ir_xrealloc(ir, (size_t)cap * sizeof(IRInstruction));
+    }
+    ir_cap = cap;
 }
 
-int main(int argc, char** argv) {
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <input.ir> <output.ir>\n", argv[0]);
-        return 1;
-    }
+// Appends one instruction; operand pointers/lengths come straight from the caller's buffer.
+IRInstruction* ir_append(const char* op, size_t op_len, const char** args, const size_t* arg_lens, int nargs) {
+    if (ir_count == ir_cap) ir_reserve(ir_count + 1);
+    IRInstruction* in = &ir[ir_count++];
+    memset(in, 0, sizeof(*in));
+    in->op = ir_intern(op, op_len);
+    in->opcode = ir_opcode_cached(in->op, op, op_len);
+    in->nargs = (uint16_t)(nargs > IR_MAX_ARGS ? IR_MAX_ARGS : nargs);
+    for (int i = 0; i < in->nargs; i++) in->arg[i] = ir_intern(args[i], arg_lens[i]);
+    return in;
+}
+
+IRInstruction* ir_emit(const char* op, const char* arg1, const char* arg2) {
+    const char* args[2] = { arg1, arg2 };
+    size_t lens[2] = { arg1 ? strlen(arg1) : 0, arg2 ? strlen(arg2) : 0 };
+    int nargs = arg2 ? 2 : (arg1 ? 1 : 0);
+    return ir_append(op, strlen(op), args, lens, nargs);
+}
 
-    load_ir_from_file(argv[1]);
-    run_all_peephole_passes();
-    save_ir_to_file(argv[2]);
+// ir_emit for front ends that do not see IRInstruction (emit_ir_operation)
+void ir_record(const char* op, const char* arg1, const char* arg2) {
+    ir_emit(op, arg1, arg2);
+}
 
-    printf("[✔] Peephole optimization complete. Output saved to %s\n", argv[2]);
+void ir_set_nop(IRInstruction* in) {
+    static uint32_t nop_id = 0;
+    if (!nop_id || strcmp(ir_str(nop_id), "NOP") != 0) nop_id = ir_intern("NOP", 3);
+    memset(in, 0, sizeof(*in));
+    in->op = nop_id;
+    in->opcode = IR_OP_NOP;
+}
+
+void ir_reset(void) {
+    if (ir_cap) free(ir);
+    if (ir_strtab_cap) free(ir_strtab);
+    if (ir_map_base) munmap(ir_map_base, ir_map_size);
+    free(ir_str_index);
+    ir = NULL; ir_count = 0; ir_cap = 0;
+    ir_strtab = NULL; ir_strtab_len = 0; ir_strtab_cap = 0;
+    ir_str_index = NULL; ir_str_index_cap = 0; ir_str_index_used = 0;
+    ir_map_base = NULL; ir_map_size = 0;
+    memset(ir_opcode_memo, 0, sizeof(ir_opcode_memo));
+}
+
+// === Text form ===
+
+// An operand is written bare unless it would not survive re-tokenizing.
+static int ir_needs_quotes(const char* s) {
+    if (!*s) return 1;
+    for (const char* p = s; *p; p++) {
+        if (*p == ',' || *p == ';' || *p == '#' || *p == '"' || *p == '\\' || isspace((unsigned char)*p))
+            return 1;
+    }
     return 0;
 }
 
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-#include <ctype.h>
+static void ir_write_quoted(FILE* f, const char* s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') { fputc('\\', f); fputc(*s, f); }
+        else if (*s == '\n') fputs("\\n", f);
+        else if (*s == '\t') fputs("\\t", f);
+        else fputc(*s, f);
+    }
+    fputc('"', f);
+}
 
-typedef struct {
-    const char* symbol;
-    const char* asm_op;
-    const char* hex;
-    const char* bin;
-} SymbolMap;
+// Byte classes for the text reader: a table lookup instead of isspace()/strchr() per byte.
+#define IR_CH_BLANK 1   // ' ' \t \r \v \f
+#define IR_CH_STOP  2   // ',' ';' '#' end an unquoted operand
+#define IR_CH_NOTE  4   // ';' '#' start a comment
 
-SymbolMap intrinsic_map[] = {
-    { "and", "AND", "0x1D2", "111010010" },
-    { "or", "OR", "0x1D3", "111010011" },
-    { "xor", "XOR", "0x1D4", "111010100" },
-    { "not", "NOT", "0x1D5", "111010101" },
-    { "and_eq", "AND [mem], reg", "0x1D6", "111010110" },
-    { "or_eq", "OR [mem], reg", "0x1D7", "111010111" },
-    { "xor_eq", "XOR [mem], reg", "0x1D8", "111011000" },
-    { "not_eq", "CMP + JNE", "0x1D9", "111011001" },
-    { "reinterpret_cast", "; reinterpret context", "0x1DA", "111011010" },
-    { "dynamic_cast", "; RTTI check", "0x1DB", "111011011" },
-    { "static_cast", "; compile reinterpret", "0x1DC", "111011100" },
-    { "const_cast", "; remove const", "0x1DD", "111011101" },
-    { "is_base_of", "; trait check", "0x1DE", "111011110" },
-    { "nullptr", "XOR reg, reg", "0x1E0", "111100000" },
-    { "throw", "JMP throw_handler", "0x1E1", "111100001" },
-    { "try", "; try label", "0x1E2", "111100010" },
-    { "catch", "; catch label", "0x1E3", "111100011" },
-    { "if", "CMP + conditional jump", "0x205", "1000000101" },
-    { "for", "LOOP label", "0x20B", "1000001011" },
-    { "new", "CALL malloc", "0x201", "1000000001" },
-    { "delete", "CALL free", "0x202", "1000000010" },
-    { "+", "ADD", "0x01", "00000001" },
-    { "-", "SUB", "0x29", "00101001" },
-    { "*", "MUL", "0xF7", "11110111" },
-    { "/", "DIV", "0xF7", "11110111" }, // same opcode family
-    { "%", "MOD", "0xF7", "11110111" },
-    { NULL, NULL, NULL, NULL }
+static const unsigned char ir_char_class[256] = {
+    ['\t'] = IR_CH_BLANK, ['\r'] = IR_CH_BLANK, ['\v'] = IR_CH_BLANK, ['\f'] = IR_CH_BLANK, [' '] = IR_CH_BLANK,
+    [','] = IR_CH_STOP, [';'] = IR_CH_STOP | IR_CH_NOTE, ['#'] = IR_CH_STOP | IR_CH_NOTE,
 };
 
-void explain_symbol(const char* input) {
-    for (int i = 0; intrinsic_map[i].symbol; i++) {
-        if (strcmp(intrinsic_map[i].symbol, input) == 0) {
-            printf("Symbol: %s\nASM: %s\nHex: %s\nBin: %s\n",
-                intrinsic_map[i].symbol,
-                intrinsic_map[i].asm_op,
-                intrinsic_map[i].hex,
-                intrinsic_map[i].bin);
-            return;
+#define IR_CLASS(c) ir_char_class[(unsigned char)(c)]
+
+// Unescapes a "quoted" operand in place; returns its length and moves *pp past the closing quote.
+static size_t ir_unquote(char** pp, char* end) {
+    char* p = *pp + 1;
+    char* out = p;
+    char* start = p;
+    while (p < end && *p != '"') {
+        char c = *p++;
+        if (c == '\\' && p < end) {
+            c = *p++;
+            if (c == 'n') c = '\n';
+            else if (c == 't') c = '\t';
         }
+        *out++ = c;
     }
-    printf("Unknown symbol: %s\n", input);
+    *pp = p < end ? p + 1 : p;
+    return (size_t)(out - start);
 }
 
-void intrinsic_parse_line(char* line) {
-    if (strstr(line, "#")) {
-        printf("[Comment] Line skipped\n");
-        return;
-    }
-    if (strstr(line, "**")) {
-        printf("[Multiline Comment Block]\n");
-        return;
-    }
-    if (strstr(line, "Let")) {
-        printf("[Variable Declaration Detected] %s\n", line);
-    }
-    if (strstr(line, "==")) {
-        printf("[Immutable Declaration Detected]\n");
-    }
-    if (strstr(line, "Start")) {
-        printf("[Command Entry Point]\n");
+// Parses one line: optional "[IR]" prefix, mnemonic, comma-separated operands,
+// "quoted, operands", and ';' / '#' comments. Quoted operands are unescaped in
+// place, so the line buffer must be writable. Returns 1 if an instruction was added.
+int ir_parse_line(char* line, size_t len) {
+    char* p = line;
+    char* end = line + len;
+    const char* args[IR_MAX_ARGS];
+    size_t lens[IR_MAX_ARGS];
+    int nargs = 0;
+
+    while (p < end && (IR_CLASS(*p) & IR_CH_BLANK)) p++;
+    if (end - p >= 4 && memcmp(p, "[IR]", 4) == 0) {
+        p += 4;
+        while (p < end && (IR_CLASS(*p) & IR_CH_BLANK)) p++;
     }
-    if (strstr(line, "Return")) {
-        printf("[Command Exit Detected]\n");
-    }
-    if (strstr(line, "|")) {
-        printf("[C.I.A.M.S. Macro or Definition] %s\n", line);
+    if (p == end || (IR_CLASS(*p) & IR_CH_NOTE)) return 0;
+
+    const char* op = p;
+    while (p < end && !(IR_CLASS(*p) & (IR_CH_BLANK | IR_CH_NOTE))) p++;
+    size_t op_len = (size_t)(p - op);
+
+    while (p < end) {
+        while (p < end && (IR_CLASS(*p) & IR_CH_BLANK)) p++;
+        if (p == end || (IR_CLASS(*p) & IR_CH_NOTE)) break;
+        if (nargs == IR_MAX_ARGS) {
+            fprintf(stderr, "[IR] too many operands (max %d): %.*s\n", IR_MAX_ARGS, (int)len, line);
+            break;
+        }
+        if (*p == '"') {
+            args[nargs] = p + 1;
+            lens[nargs] = ir_unquote(&p, end);
+        } else {
+            const char* a = p;
+            while (p < end && !(IR_CLASS(*p) & IR_CH_STOP)) p++;
+            const char* b = p;
+            while (b > a && (IR_CLASS(b[-1]) & IR_CH_BLANK)) b--;
+            args[nargs] = a;
+            lens[nargs] = (size_t)(b - a);
+        }
+        nargs++;
+        while (p < end && (IR_CLASS(*p) & IR_CH_BLANK)) p++;
+        if (p < end && *p == ',') p++;
     }
-    if (strstr(line, ";")) {
-        printf("[Line Termination Detected]\n");
+
+    ir_append(op, op_len, args, lens, nargs);
+    return 1;
+}
+
+// Streaming text reader: fixed read() window, lines are parsed in place and
+// interned straight into the IR buffer, so no per-line or per-operand allocation.
+// A partial line at the end of a chunk is slid to the front and completed by the next read.
+#define IR_READ_CHUNK (1 << 20)
+static char ir_read_buf[IR_READ_CHUNK];
+
+long long load_ir_from_fd(int fd, const char* name) {
+    size_t have = 0;
+    long long total = 0;
+    int line_no = 1, skipping = 0;
+    for (;;) {
+        ssize_t got = read(fd, ir_read_buf + have, sizeof(ir_read_buf) - have);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            perror("load_ir_from_file");
+            break;
+        }
+        total += got;
+        have += (size_t)got;
+        char* p = ir_read_buf;
+        char* end = ir_read_buf + have;
+        char* nl;
+        while ((nl = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+            if (!skipping) ir_parse_line(p, (size_t)(nl - p));
+            skipping = 0;
+            line_no++;
+            p = nl + 1;
+        }
+        if (got == 0) {
+            if (p < end && !skipping) ir_parse_line(p, (size_t)(end - p));
+            break;
+        }
+        if (p == ir_read_buf && have == sizeof(ir_read_buf)) {
+            // a single line longer than the window: drop it rather than split it
+            if (!skipping)
+                fprintf(stderr, "[ERROR] %s:%d: IR line longer than %d bytes skipped\n", name, line_no, IR_READ_CHUNK);
+            skipping = 1;
+            have = 0;
+            continue;
+        }
+        have = (size_t)(end - p);
+        memmove(ir_read_buf, p, have);
     }
-    if (strstr(line, ":")) {
-        printf("[Fallback Instruction Separator]\n");
+    return total;
+}
+
+void load_ir_from_file(const char* filename) {
+    int fd = strcmp(filename, "-") == 0 ? STDIN_FILENO : open(filename, O_RDONLY);
+    ir_bytes_read = 0;
+    if (fd < 0) { perror("load_ir_from_file"); return; }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        ir_reserve(ir_count + (int)(st.st_size / 16));  // ~16 bytes per text instruction
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    ir_bytes_read = load_ir_from_fd(fd, filename);
+    if (fd != STDIN_FILENO) close(fd);
+}
+
+void ir_write_text(FILE* f, const IRInstruction* in) {
+    fputs(ir_str(in->op), f);
+    for (int a = 0; a < in->nargs; a++) {
+        const char* s = ir_str(in->arg[a]);
+        fputs(a ? ", " : " ", f);
+        if (ir_needs_quotes(s)) ir_write_quoted(f, s);
+        else fputs(s, f);
     }
-    if (strstr(line, "->")) {
-        printf("[Progression Symbol Detected]\n");
+    fputc('\n', f);
+}
+
+void save_ir_to_file(const char* filename) {
+    FILE* f = fopen(filename, "w");
+    if (!f) { perror("save_ir_to_file"); return; }
+    for (int i = 0; i < ir_count; i++) ir_write_text(f, &ir[i]);
+    fclose(f);
+}
+
+// === JSON form (r4.ir.json) ===
+
+static void ir_json_string(FILE* f, const char* s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') { fputc('\\', f); fputc(c, f); }
+        else if (c == '\n') fputs("\\n", f);
+        else if (c == '\t') fputs("\\t", f);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
     }
-    if (strstr(line, "~>")) {
-        printf("[Raise Expression Detected]\n");
+    fputc('"', f);
+}
+
+void save_ir_to_json(const char* filename) {
+    FILE* f = fopen(filename, "w");
+    if (!f) { perror("save_ir_to_json"); return; }
+    fprintf(f, "[\n");
+    for (int i = 0; i < ir_count; i++) {
+        fprintf(f, "    { \"op\": ");
+        ir_json_string(f, ir_str(ir[i].op));
+        if (ir[i].nargs) {
+            fprintf(f, ", \"args\": [");
+            for (int a = 0; a < ir[i].nargs; a++) {
+                if (a) fprintf(f, ", ");
+                ir_json_string(f, ir_str(ir[i].arg[a]));
+            }
+            fprintf(f, "]");
+        }
+        fprintf(f, " }%s\n", i + 1 < ir_count ? "," : "");
     }
-    if (strstr(line, "<~")) {
-        printf("[Flag Expression Detected]\n");
+    fprintf(f, "]\n");
+    fclose(f);
+}
+
+// Unescapes the JSON string literal at *pp in place (\uXXXX up to the BMP becomes UTF-8,
+// never longer than its escape). Returns the start; *len gets the length.
+static char* ir_json_string_at(char** pp, char* end, size_t* len) {
+    char* p = *pp + 1;
+    char* start = p;
+    char* out = p;
+    while (p < end && *p != '"') {
+        unsigned c = (unsigned char)*p++;
+        if (c == '\\' && p < end) {
+            c = (unsigned char)*p++;
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'u':
+                    c = 0;
+                    for (int k = 0; k < 4 && p < end && isxdigit((unsigned char)*p); k++, p++)
+                        c = c * 16 + (unsigned)(isdigit((unsigned char)*p) ? *p - '0' : tolower((unsigned char)*p) - 'a' + 10);
+                    if (c >= 0x800) {
+                        *out++ = (char)(0xE0 | (c >> 12));
+                        *out++ = (char)(0x80 | ((c >> 6) & 0x3F));
+                        c = 0x80 | (c & 0x3F);
+                    } else if (c >= 0x80) {
+                        *out++ = (char)(0xC0 | (c >> 6));
+                        c = 0x80 | (c & 0x3F);
+                    }
+                    break;
+            }
+        }
+        *out++ = (char)c;
     }
-    if (strstr(line, "<-")) {
-        printf("[Throw Command Detected]\n");
+    *pp = p < end ? p + 1 : p;
+    *len = (size_t)(out - start);
+    return start;
+}
+
+// Legacy r4.ir.json objects name their operands; they map to positional operands in this order.
+static const char* ir_json_legacy_keys[] = { "dest", "name", "target", "src", "value", "type" };
+#define IR_JSON_LEGACY_KEYS 6
+
+void load_ir_from_json(const char* filename) {
+    FILE* f = fopen(filename, "rb");
+    ir_bytes_read = 0;
+    if (!f) { perror("load_ir_from_json"); return; }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* text = ir_xrealloc(NULL, (size_t)size + 1);
+    size_t got = fread(text, 1, (size_t)size, f);
+    fclose(f);
+    ir_bytes_read = (long long)got;
+    char* p = text;
+    char* end = text + got;
+
+    while (p < end) {
+        while (p < end && *p != '{') p++;
+        if (p == end) break;
+        p++;
+        const char* op = NULL;
+        const char* args[IR_MAX_ARGS];
+        size_t op_len = 0, lens[IR_MAX_ARGS];
+        const char* legacy[IR_JSON_LEGACY_KEYS] = { 0 };
+        size_t legacy_lens[IR_JSON_LEGACY_KEYS];
+        int nargs = 0, has_args = 0;
+
+        while (p < end && *p != '}') {
+            if (*p != '"') { p++; continue; }
+            size_t klen;
+            const char* key = ir_json_string_at(&p, end, &klen);
+            while (p < end && (isspace((unsigned char)*p) || *p == ':')) p++;
+            if (klen == 4 && strncmp(key, "args", 4) == 0 && p < end && *p == '[') {
+                has_args = 1;
+                for (p++; p < end && *p != ']'; ) {
+                    if (*p != '"') { p++; continue; }
+                    size_t n;
+                    const char* v = ir_json_string_at(&p, end, &n);
+                    if (nargs < IR_MAX_ARGS) { args[nargs] = v; lens[nargs++] = n; }
+                }
+                if (p < end) p++;
+            } else if (p < end && *p == '"') {
+                size_t n;
+                const char* v = ir_json_string_at(&p, end, &n);
+                if (klen == 2 && strncmp(key, "op", 2) == 0) { op = v; op_len = n; continue; }
+                for (int k = 0; k < IR_JSON_LEGACY_KEYS; k++) {
+                    if (strlen(ir_json_legacy_keys[k]) == klen && strncmp(ir_json_legacy_keys[k], key, klen) == 0) {
+                        legacy[k] = v;
+                        legacy_lens[k] = n;
+                    }
+                }
+            } else {
+                p++;
+            }
+        }
+        if (p < end) p++;
+        if (!op) continue;
+
+        if (!has_args) {
+            for (int k = 0; k < IR_JSON_LEGACY_KEYS && nargs < IR_MAX_ARGS; k++) {
+                if (!legacy[k]) continue;
+                args[nargs] = legacy[k];
+                lens[nargs++] = legacy_lens[k];
+            }
+        }
+        ir_append(op, op_len, args, lens, nargs);
     }
+    free(text);
 }
 
-int main(int argc, char** argv) {
-    if (argc > 1) {
-        for (int i = 1; i < argc; ++i) {
-            explain_symbol(argv[i]);
+// === Binary form (.rirb) ===
+
+#define RIRB_MAGIC "RIRB"
+#define RIRB_VERSION_MAJOR 1
+#define RIRB_VERSION_MINOR 1
+#define RIRB_BYTE_ORDER 0x01020304u
+
+typedef struct {
+    char magic[4];              // "RIRB"
+    uint16_t version_major;     // incompatible layout changes
+    uint16_t version_minor;     // opcode table additions (opcodes re-derived on mismatch)
+    uint32_t byte_order;        // RIRB_BYTE_ORDER as written by the producer
+    uint32_t record_size;       // sizeof(IRInstruction)
+    uint32_t ir_count;
+    uint32_t strtab_size;       // bytes, includes the leading "" at id 0
+    uint64_t records_offset;    // 8-byte aligned
+    uint64_t strtab_offset;
+    uint64_t reserved;
+} RirbHeader;                   // 48 bytes
+
+int save_ir_to_rirb(const char* filename) {
+    FILE* f = fopen(filename, "wb");
+    if (!f) { perror("save_ir_to_rirb"); return -1; }
+    static const char empty[1] = { 0 };
+    RirbHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, RIRB_MAGIC, 4);
+    h.version_major = RIRB_VERSION_MAJOR;
+    h.version_minor = RIRB_VERSION_MINOR;
+    h.byte_order = RIRB_BYTE_ORDER;
+    h.record_size = sizeof(IRInstruction);
+    h.ir_count = (uint32_t)ir_count;
+    h.strtab_size = ir_strtab ? ir_strtab_len : 1;
+    h.records_offset = sizeof(RirbHeader);
+    h.strtab_offset = h.records_offset + (uint64_t)ir_count * sizeof(IRInstruction);
+
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    if (ir_count) ok = ok && fwrite(ir, sizeof(IRInstruction), (size_t)ir_count, f) == (size_t)ir_count;
+    ok = ok && fwrite(ir_strtab ? ir_strtab : empty, 1, h.strtab_size, f) == h.strtab_size;
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) { fprintf(stderr, "[ERROR] short write on %s\n", filename); return -1; }
+    return 0;
+}
+
+static int rirb_fail(const char* filename, const char* why, void* base, size_t size) {
+    fprintf(stderr, "[ERROR] %s: %s\n", filename, why);
+    if (base) munmap(base, size);
+    return -1;
+}
+
+// Maps the file copy-on-write and points ir/ir_strtab into it; nothing is copied
+// until a pass appends instructions or interns a new string.
+int load_ir_from_rirb(const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    ir_bytes_read = 0;
+    if (fd < 0) { perror("load_ir_from_rirb"); return -1; }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { perror("load_ir_from_rirb"); close(fd); return -1; }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(RirbHeader)) { close(fd); return rirb_fail(filename, "truncated header", NULL, 0); }
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) { perror("load_ir_from_rirb"); return -1; }
+
+    const RirbHeader* h = (const RirbHeader*)base;
+    if (memcmp(h->magic, RIRB_MAGIC, 4) != 0) return rirb_fail(filename, "not a .rirb file", base, size);
+    if (h->byte_order != RIRB_BYTE_ORDER) return rirb_fail(filename, "byte order mismatch", base, size);
+    if (h->version_major != RIRB_VERSION_MAJOR) return rirb_fail(filename, "unsupported version", base, size);
+    if (h->record_size != sizeof(IRInstruction)) return rirb_fail(filename, "record size mismatch", base, size);
+    if (h->records_offset % 8 || h->records_offset > size ||
+        (uint64_t)h->ir_count * sizeof(IRInstruction) > size - h->records_offset ||
+        h->strtab_offset > size || h->strtab_size == 0 || h->strtab_size > size - h->strtab_offset)
+        return rirb_fail(filename, "section out of bounds", base, size);
+
+    IRInstruction* records = (IRInstruction*)((char*)base + h->records_offset);
+    char* strtab = (char*)base + h->strtab_offset;
+    uint32_t strtab_size = h->strtab_size;
+    if (strtab[0] != '\0' || strtab[strtab_size - 1] != '\0')
+        return rirb_fail(filename, "malformed string table", base, size);
+
+    int reopcode = h->version_minor != RIRB_VERSION_MINOR;
+    for (uint32_t i = 0; i < h->ir_count; i++) {
+        IRInstruction* in = &records[i];
+        if (in->nargs > IR_MAX_ARGS || in->opcode >= IR_OP_COUNT)
+            return rirb_fail(filename, "corrupt instruction record", base, size);
+        for (int a = -1; a < IR_MAX_ARGS; a++) {
+            uint32_t id = a < 0 ? in->op : in->arg[a];
+            if (id >= strtab_size || (id && strtab[id - 1] != '\0'))
+                return rirb_fail(filename, "string id out of range", base, size);
         }
-    } else {
-        char line[256];
-        printf("Enter code lines for intrinsic analysis (Ctrl+D to end):\n");
-        while (fgets(line, sizeof(line), stdin)) {
-            intrinsic_parse_line(line);
+        if (reopcode) {
+            const char* m = strtab + in->op;
+            in->opcode = (uint16_t)ir_opcode_of(m, strlen(m));
         }
     }
+
+    ir_reset();
+    ir_map_base = base;
+    ir_map_size = size;
+    ir = records;
+    ir_count = (int)h->ir_count;
+    ir_strtab = strtab;
+    ir_strtab_len = strtab_size;
+    ir_bytes_read = (long long)size;
+    return 0;
+}
+
+// Picks the form from the file extension: .rirb binary, .json JSON, anything else text.
+static const char* ir_file_ext(const char* filename) {
+    const char* dot = strrchr(filename, '.');
+    return dot ? dot : "";
+}
+
+int ir_load_any(const char* filename) {
+    const char* ext = ir_file_ext(filename);
+    if (strcmp(ext, ".rirb") == 0) return load_ir_from_rirb(filename);
+    if (strcmp(ext, ".json") == 0) load_ir_from_json(filename);
+    else load_ir_from_file(filename);
+    return 0;
+}
+
+int ir_save_any(const char* filename) {
+    const char* ext = ir_file_ext(filename);
+    if (strcmp(ext, ".rirb") == 0) return save_ir_to_rirb(filename);
+    if (strcmp(ext, ".json") == 0) save_ir_to_json(filename);
+    else save_ir_to_file(filename);
     return 0;
 }
 
+// peephole_optimizer.c – Rexion Peephole Optimizer
+// DOC: Rewrites are driven by a worklist over a doubly-linked view of ir[]; deleted instructions
+// DOC: become tombstones and ir[] is compacted once per round, so a round is O(n) however much it removes
+// DOC: A rewrite re-queues its neighbours (patterns span up to 4 instructions); rounds repeat to a fixpoint
+// DOC: Patterns are declared in .r4rules files and compiled at load time into a trie keyed on the
+// DOC: opcode sequence, so matching costs one walk per instruction however many rules are loaded
 #include <stdio.h>
-#include <string.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <ctype.h>
+#include <errno.h>
+#include <time.h>
+
+extern int vm_run_ir(FILE* out);     // rexion_vm.c
+
+#define PEEP_QUEUED 1
+#define PEEP_DEAD 2
 
 typedef struct {
-    const char* symbol;
-    const char* asm_op;
-    const char* hex;
-    const char* bin;
-} SymbolMap;
+    int* prev;              // previous live instruction, -1 at the start
+    int* next;              // next live instruction, ir_count at the end
+    uint8_t* flags;         // PEEP_QUEUED / PEEP_DEAD
+    int* work;              // LIFO worklist of instruction indices
+    int nwork;
+    long long rewrites;
+} PeepState;
+
+static void peep_push(PeepState* P, int i) {
+    if (i < 0 || i >= ir_count || (P->flags[i] & (PEEP_QUEUED | PEEP_DEAD))) return;
+    P->flags[i] |= PEEP_QUEUED;
+    P->work[P->nwork++] = i;
+}
 
-SymbolMap intrinsic_map[] = {
-    { "and", "AND", "0x1D2", "111010010" },
-    { "or", "OR", "0x1D3", "111010011" },
+// Re-queues every window that can see instruction i: the three before it, itself and the next one.
+static void peep_touch(PeepState* P, int i) {
+    int p = i;
+    for (int k = 0; k < 3 && p >= 0; k++) {
+        p = P->prev[p];
+        peep_push(P, p);
+    }
+    peep_push(P, i);
+    peep_push(P, P->next[i]);
+}
+
+// Tombstones instruction i and unlinks it; ir[] itself is left alone until peep_compact().
+static void peep_kill(PeepState* P, int i) {
+    int p = P->prev[i], n = P->next[i];
+    if (p >= 0) P->next[p] = n;
+    if (n < ir_count) P->prev[n] = p;
+    P->flags[i] |= PEEP_DEAD;
+    if (n < ir_count) peep_touch(P, n);
+    else if (p >= 0) peep_touch(P, p);
+}
+
+// Whole-operand integer literal (the old sscanf("%d") also accepted "5abc"); out-of-range is not one.
+static int peep_int(uint32_t id, long long* v) {
+    const char* s = ir_str(id);
+    char* end;
+    if (!*s) return 0;
+    errno = 0;
+    *v = strtoll(s, &end, 10);
+    return *end == '\0' && errno != ERANGE;
+}
+
+// === Rule files ===
+// Rules come from a .r4rules file (official/peephole.r4rules; built-in copy below):
+//   name: PATTERN -> REPLACEMENT [where CONDITION, ...]
+// and are compiled into a trie keyed on the opcode sequence of the pattern.
+
+#define PEEP_MAX_WINDOW 4
+#define PEEP_MAX_VARS 8
+#define PEEP_MAX_CONDS 8
+#define PEEP_MAX_EXPR 16
+#define PEEP_UNBOUND 0xFFFFFFFFu
+
+typedef enum { PEEP_ARG_ANY, PEEP_ARG_VAR, PEEP_ARG_LIT, PEEP_ARG_EXPR } PeepArgKind;
+typedef enum { PEEP_X_VAR, PEEP_X_INT, PEEP_X_ADD, PEEP_X_SUB, PEEP_X_MUL } PeepExprOp;
+typedef enum { PEEP_C_INT, PEEP_C_EQ, PEEP_C_NE } PeepCondKind;
+
+typedef struct {
+    uint8_t kind;               // PeepArgKind
+    uint8_t var;
+    uint8_t nexpr;              // EXPR: postfix program length
+    char text[32];              // LIT: operand text, interned by peep_bind_rules()
+    uint32_t lit;
+    struct { uint8_t op, var; long long k; } expr[PEEP_MAX_EXPR];
+} PeepArg;
+
+typedef struct {
+    uint8_t kind, a, b;         // PeepCondKind, variables
+} PeepCond;
+
+typedef struct {
+    uint16_t opcode;
+    uint16_t nargs;
+    uint32_t op;                // interned mnemonic (replacements)
+    PeepArg arg[IR_MAX_ARGS];
+} PeepInst;
+
+typedef struct {
+    char name[48];
+    int npat, nrep;
+    PeepInst pat[PEEP_MAX_WINDOW], rep[PEEP_MAX_WINDOW];
+    int nvars;
+    char vars[PEEP_MAX_VARS][16];
+    int nconds;
+    PeepCond cond[PEEP_MAX_CONDS];
+    int next;                   // next rule ending at the same trie node
+} PeepRule;
+
+typedef struct {
+    uint16_t opcode;
+    int child, sibling;         // first child / next sibling, -1 = none
+    int rules, last_rule;       // rules whose pattern ends here, in file order
+} PeepNode;
+
+static PeepRule* peep_rules = NULL;
+static int peep_nrules = 0, peep_rule_cap = 0;
+static PeepNode* peep_nodes = NULL;     // node 0 = root
+static int peep_nnodes = 0, peep_node_cap = 0;
+static int peep_root[IR_OP_COUNT];      // root's children indexed directly by opcode
+
+static const char* peep_default_rules =
+    "redundant-load: LOAD $r, $x; LOAD $r, $x -> LOAD $r, $x\n"
+    "add-zero:       ADD $r, 0 -> NOP\n"
+    "self-move:      MOV $a, $a -> NOP\n"
+    "fold-add:       LOAD $a, $c1; ADD $a, $c2 -> LOAD $a, {$c1 + $c2} where int($c1), int($c2)\n"
+    "sub-zero:       SUB $r, 0 -> NOP\n"
+    "mul-one:        MUL $r, 1 -> NOP\n"
+    "div-one:        DIV $r, 1 -> NOP\n"
+    "jump-to-next:   JMP $l; LABEL $l -> LABEL $l\n";
+
+static void peep_rule_error(const char* file, int line, const char* what, const char* at) {
+    if (at) fprintf(stderr, "%s:%d: error: %s near `%.*s'\n", file, line, what, (int)strcspn(at, "\n#"), at);
+    else fprintf(stderr, "%s:%d: error: %s\n", file, line, what);
+}
+
+static const char* peep_skip(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    return p;
+}
+
+static int peep_var(PeepRule* r, const char* p, size_t len, int create) {
+    for (int v = 0; v < r->nvars; v++)
+        if (strlen(r->vars[v]) == len && strncmp(r->vars[v], p, len) == 0) return v;
+    if (!create || r->nvars == PEEP_MAX_VARS || len >= sizeof(r->vars[0])) return -1;
+    memcpy(r->vars[r->nvars], p, len);
+    r->vars[r->nvars][len] = '\0';
+    return r->nvars++;
+}
+
+static size_t peep_ident(const char* p, const char* end) {
+    size_t n = 0;
+    while (p + n < end && (isalnum((unsigned char)p[n]) || p[n] == '_')) n++;
+    return n;
+}
+
+// {$a + 2 * $b}: sum of products, compiled to a postfix program
+static int peep_expr(PeepRule* r, PeepArg* a, const char* p, const char* end) {
+    int pending_add = -1, pending_mul = 0;
+    a->kind = PEEP_ARG_EXPR;
+    a->nexpr = 0;
+    while (1) {
+        p = peep_skip(p, end);
+        if (a->nexpr + 3 > PEEP_MAX_EXPR) return -1;
+        if (p < end && *p == '$') {
+            size_t n = peep_ident(p + 1, end);
+            int v = peep_var(r, p + 1, n, 0);
+            if (!n || v < 0) return -1;
+            a->expr[a->nexpr].op = PEEP_X_VAR;
+            a->expr[a->nexpr++].var = (uint8_t)v;
+            p += 1 + n;
+        } else {
+            char* num_end;
+            errno = 0;
+            long long k = strtoll(p, &num_end, 10);
+            if (num_end == p || num_end > end || errno == ERANGE) return -1;
+            a->expr[a->nexpr].op = PEEP_X_INT;
+            a->expr[a->nexpr++].k = k;
+            p = num_end;
+        }
+        if (pending_mul) { a->expr[a->nexpr++].op = PEEP_X_MUL; pending_mul = 0; }
+        p = peep_skip(p, end);
+        if (p < end && *p == '*') { pending_mul = 1; p++; continue; }
+        if (pending_add >= 0) { a->expr[a->nexpr++].op = (uint8_t)pending_add; pending_add = -1; }
+        if (p >= end) return 0;
+        if (*p == '+' || *p == '-') { pending_add = *p == '+' ? PEEP_X_ADD : PEEP_X_SUB; p++; continue; }
+        return -1;
+    }
+}
+
+// One operand of a pattern (bind) or replacement (use).
+static int peep_arg(PeepRule* r, PeepArg* a, const char* p, const char* end, int pattern) {
+    p = peep_skip(p, end);
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    if (p == end) return -1;
+    memset(a, 0, sizeof(*a));
+    if (*p == '$') {
+        size_t n = peep_ident(p + 1, end);
+        if (!n || p + 1 + n != end) return -1;
+        int v = peep_var(r, p + 1, n, pattern);
+        if (v < 0) return -1;
+        a->kind = PEEP_ARG_VAR;
+        a->var = (uint8_t)v;
+    } else if (*p == '*' && end - p == 1 && pattern) {
+        a->kind = PEEP_ARG_ANY;
+    } else if (*p == '{' && end[-1] == '}' && !pattern) {
+        return peep_expr(r, a, p + 1, end - 1);
+    } else {
+        if ((size_t)(end - p) >= sizeof(a->text)) return -1;
+        a->kind = PEEP_ARG_LIT;
+        memcpy(a->text, p, (size_t)(end - p));
+    }
+    return 0;
+}
+
+// "OP a, b; OP c" -> instructions; returns the count, -1 on a syntax error.
+static int peep_insts(PeepRule* r, PeepInst* out, const char* p, const char* end, int pattern) {
+    int n = 0;
+    while (p < end) {
+        const char* semi = memchr(p, ';', (size_t)(end - p));
+        const char* e = semi ? semi : end;
+        p = peep_skip(p, e);
+        size_t len = 0;
+        while (p + len < e && !isspace((unsigned char)p[len])) len++;
+        if (!len || n == PEEP_MAX_WINDOW) return -1;
+        PeepInst* in = &out[n++];
+        memset(in, 0, sizeof(*in));
+        in->opcode = (uint16_t)ir_opcode_of(p, len);
+        if (in->opcode == IR_OP_UNKNOWN) return -1;
+        for (const char* a = peep_skip(p + len, e); a < e; ) {
+            const char* comma = memchr(a, ',', (size_t)(e - a));
+            const char* ae = comma ? comma : e;
+            if (in->nargs == IR_MAX_ARGS || peep_arg(r, &in->arg[in->nargs++], a, ae, pattern) != 0) return -1;
+            a = comma ? comma + 1 : e;
+        }
+        p = semi ? semi + 1 : end;
+    }
+    return n;
+}
+
+static int peep_node(uint16_t opcode) {
+    if (peep_nnodes == peep_node_cap) {
+        peep_node_cap = peep_node_cap ? peep_node_cap * 2 : 64;
+        peep_nodes = realloc(peep_nodes, (size_t)peep_node_cap * sizeof(PeepNode));
+        if (!peep_nodes) { perror("peep_node"); exit(1); }
+    }
+    PeepNode* n = &peep_nodes[peep_nnodes];
+    n->opcode = opcode;
+    n->child = n->sibling = n->rules = n->last_rule = -1;
+    return peep_nnodes++;
+}
+
+// Inserts rule r under the opcode path of its pattern.
+static void peep_insert(int r) {
+    PeepRule* rule = &peep_rules[r];
+    int node = peep_root[rule->pat[0].opcode];
+    if (node < 0) node = peep_root[rule->pat[0].opcode] = peep_node(rule->pat[0].opcode);
+    for (int d = 1; d < rule->npat; d++) {
+        int c = peep_nodes[node].child;
+        while (c >= 0 && peep_nodes[c].opcode != rule->pat[d].opcode) c = peep_nodes[c].sibling;
+        if (c < 0) {
+            c = peep_node(rule->pat[d].opcode);
+            peep_nodes[c].sibling = peep_nodes[node].child;
+            peep_nodes[node].child = c;
+        }
+        node = c;
+    }
+    rule->next = -1;
+    if (peep_nodes[node].last_rule >= 0) peep_rules[peep_nodes[node].last_rule].next = r;
+    else peep_nodes[node].rules = r;
+    peep_nodes[node].last_rule = r;
+}
+
+static void peep_clear_rules(void) {
+    free(peep_rules);
+    free(peep_nodes);
+    peep_rules = NULL; peep_nrules = peep_rule_cap = 0;
+    peep_nodes = NULL; peep_nnodes = peep_node_cap = 0;
+    for (int i = 0; i < IR_OP_COUNT; i++) peep_root[i] = -1;
+}
+
+// Parses rule text; `file` names it in diagnostics. Replaces any previously loaded rules.
+int peep_parse_rules(const char* text, const char* file) {
+    peep_clear_rules();
+    int line = 0, errors = 0;
+    for (const char* p = text; *p; ) {
+        const char* nl = strchr(p, '\n');
+        const char* end = nl ? nl : p + strlen(p);
+        const char* hash = memchr(p, '#', (size_t)(end - p));
+        const char* stop = hash ? hash : end;
+        line++;
+        const char* s = peep_skip(p, stop);
+        p = nl ? nl + 1 : end;
+        while (stop > s && isspace((unsigned char)stop[-1])) stop--;
+        if (s == stop) continue;
+
+        if (peep_nrules == peep_rule_cap) {
+            peep_rule_cap = peep_rule_cap ? peep_rule_cap * 2 : 16;
+            peep_rules = realloc(peep_rules, (size_t)peep_rule_cap * sizeof(PeepRule));
+            if (!peep_rules) { perror("peep_parse_rules"); exit(1); }
+        }
+        PeepRule* r = &peep_rules[peep_nrules];
+        memset(r, 0, sizeof(*r));
+        const char* colon = memchr(s, ':', (size_t)(stop - s));
+        const char* arrow = NULL;
+        for (const char* q = s; q + 1 < stop && !arrow; q++) if (q[0] == '-' && q[1] == '>') arrow = q;
+        if (!colon || !arrow || colon > arrow) { peep_rule_error(file, line, "expected `name: PATTERN -> REPLACEMENT'", s); errors++; continue; }
+        snprintf(r->name, sizeof(r->name), "%.*s", (int)(colon - s), s);
+        const char* where = NULL;
+        for (const char* q = arrow; q + 7 <= stop && !where; q++)
+            if (strncmp(q, " where ", 7) == 0) where = q;
+        const char* rep_end = where ? where : stop;
+
+        r->npat = peep_insts(r, r->pat, colon + 1, arrow, 1);
+        if (r->npat <= 0) { peep_rule_error(file, line, "bad pattern", colon + 1); errors++; continue; }
+        const char* rs = peep_skip(arrow + 2, rep_end);
+        size_t rlen = (size_t)(rep_end - rs);
+        while (rlen && isspace((unsigned char)rs[rlen - 1])) rlen--;
+        if (!rlen) { peep_rule_error(file, line, "empty replacement (write NOP to delete the match)", arrow); errors++; continue; }
+        if (rlen == 3 && strncmp(rs, "NOP", 3) == 0) r->nrep = 0;       // delete the match
+        else r->nrep = peep_insts(r, r->rep, rs, rs + rlen, 0);
+        if (r->nrep < 0) { peep_rule_error(file, line, "bad replacement (unknown opcode, unbound $name or bad {expr})", rs); errors++; continue; }
+        if (r->nrep > r->npat) { peep_rule_error(file, line, "replacement is longer than the pattern", rs); errors++; continue; }
+
+        int bad = 0;
+        for (const char* c = where ? where + 7 : stop; c < stop && !bad; ) {
+            const char* comma = memchr(c, ',', (size_t)(stop - c));
+            const char* ce = comma ? comma : stop;
+            c = peep_skip(c, ce);
+            if (r->nconds == PEEP_MAX_CONDS) { bad = 1; break; }
+            int v1, v2;
+            size_t n1;
+            if (strncmp(c, "int($", 5) == 0) {
+                n1 = peep_ident(c + 5, ce);
+                v1 = peep_var(r, c + 5, n1, 0);
+                if (v1 < 0 || c + 5 + n1 >= ce || c[5 + n1] != ')') bad = 1;
+                else { PeepCond k = { PEEP_C_INT, (uint8_t)v1, 0 }; r->cond[r->nconds++] = k; }
+            } else if (*c == '$') {
+                n1 = peep_ident(c + 1, ce);
+                v1 = peep_var(r, c + 1, n1, 0);
+                const char* o = peep_skip(c + 1 + n1, ce);
+                int kind = (o + 1 < ce && o[0] == '=' && o[1] == '=') ? PEEP_C_EQ :
+                           (o + 1 < ce && o[0] == '!' && o[1] == '=') ? PEEP_C_NE : -1;
+                const char* b = peep_skip(o + 2, ce);
+                size_t n2 = b < ce && *b == '$' ? peep_ident(b + 1, ce) : 0;
+                v2 = n2 ? peep_var(r, b + 1, n2, 0) : -1;
+                if (v1 < 0 || v2 < 0 || kind < 0) bad = 1;
+                else { PeepCond k = { (uint8_t)kind, (uint8_t)v1, (uint8_t)v2 }; r->cond[r->nconds++] = k; }
+            } else {
+                bad = 1;
+            }
+            c = comma ? comma + 1 : stop;
+        }
+        if (bad) { peep_rule_error(file, line, "bad condition (int($x), $a == $b, $a != $b)", where); errors++; continue; }
+        peep_insert(peep_nrules++);
+    }
+    return errors ? -1 : 0;
+}
+
+int peep_load_rules(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) { perror(path); return -1; }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* text = malloc((size_t)size + 1);
+    if (!text) { fclose(f); perror("peep_load_rules"); return -1; }
+    size_t n = fread(text, 1, (size_t)size, f);
+    text[n] = '\0';
+    fclose(f);
+    int rc = peep_parse_rules(text, path);
+    free(text);
+    return rc;
+}
+
+// Interns rule literals and mnemonics into the current IR string table.
+static void peep_bind_rules(void) {
+    if (!peep_rules) peep_parse_rules(peep_default_rules, "<built-in rules>");
+    for (int r = 0; r < peep_nrules; r++) {
+        PeepRule* rule = &peep_rules[r];
+        for (int side = 0; side < 2; side++) {
+            PeepInst* insts = side ? rule->rep : rule->pat;
+            int n = side ? rule->nrep : rule->npat;
+            for (int i = 0; i < n; i++) {
+                const char* name = ir_opcode_names[insts[i].opcode];
+                insts[i].op = ir_intern(name, strlen(name));
+                for (int a = 0; a < insts[i].nargs; a++)
+                    if (insts[i].arg[a].kind == PEEP_ARG_LIT)
+                        insts[i].arg[a].lit = ir_intern(insts[i].arg[a].text, strlen(insts[i].arg[a].text));
+            }
+        }
+    }
+}
+
+// Evaluates an {expr}; 0 when an operand is not an integer or the value overflows (no rewrite).
+static int peep_eval(const PeepArg* a, const uint32_t* bound, long long* out) {
+    long long stack[PEEP_MAX_EXPR];
+    int sp = 0, ovf = 0;
+    for (int i = 0; i < a->nexpr && !ovf; i++) {
+        switch (a->expr[i].op) {
+            case PEEP_X_VAR: if (!peep_int(bound[a->expr[i].var], &stack[sp++])) return 0; break;
+            case PEEP_X_INT: stack[sp++] = a->expr[i].k; break;
+            case PEEP_X_ADD: sp--; ovf = __builtin_add_overflow(stack[sp - 1], stack[sp], &stack[sp - 1]); break;
+            case PEEP_X_SUB: sp--; ovf = __builtin_sub_overflow(stack[sp - 1], stack[sp], &stack[sp - 1]); break;
+            case PEEP_X_MUL: sp--; ovf = __builtin_mul_overflow(stack[sp - 1], stack[sp], &stack[sp - 1]); break;
+        }
+    }
+    if (ovf) return 0;
+    *out = stack[0];
+    return 1;
+}
+
+// Binds rule r against the window w[]; on success applies the replacement.
+static int peep_apply(PeepState* P, const PeepRule* r, const int* w) {
+    uint32_t bound[PEEP_MAX_VARS];
+    for (int v = 0; v < PEEP_MAX_VARS; v++) bound[v] = PEEP_UNBOUND;
+    for (int i = 0; i < r->npat; i++) {
+        const IRInstruction* in = &ir[w[i]];
+        if (in->nargs != r->pat[i].nargs) return 0;
+        for (int a = 0; a < in->nargs; a++) {
+            const PeepArg* pa = &r->pat[i].arg[a];
+            if (pa->kind == PEEP_ARG_LIT && in->arg[a] != pa->lit) return 0;
+            if (pa->kind == PEEP_ARG_VAR) {
+                if (bound[pa->var] == PEEP_UNBOUND) bound[pa->var] = in->arg[a];
+                else if (bound[pa->var] != in->arg[a]) return 0;
+            }
+        }
+    }
+    for (int c = 0; c < r->nconds; c++) {
+        long long v;
+        uint32_t a = bound[r->cond[c].a], b = bound[r->cond[c].b];
+        if (r->cond[c].kind == PEEP_C_INT ? !peep_int(a, &v) :
+            r->cond[c].kind == PEEP_C_EQ ? a != b : a == b) return 0;
+    }
+
+    IRInstruction out[PEEP_MAX_WINDOW];
+    for (int i = 0; i < r->nrep; i++) {
+        const PeepInst* ri = &r->rep[i];
+        memset(&out[i], 0, sizeof(out[i]));
+        out[i].op = ri->op;
+        out[i].opcode = ri->opcode;
+        out[i].nargs = ri->nargs;
+        for (int a = 0; a < ri->nargs; a++) {
+            const PeepArg* ra = &ri->arg[a];
+            if (ra->kind == PEEP_ARG_VAR) out[i].arg[a] = bound[ra->var];
+            else if (ra->kind == PEEP_ARG_LIT) out[i].arg[a] = ra->lit;
+            else {
+                long long v;
+                char text[24];
+                if (!peep_eval(ra, bound, &v)) return 0;
+                out[i].arg[a] = ir_intern(text, (size_t)snprintf(text, sizeof(text), "%lld", v));
+            }
+        }
+    }
+    if (r->nrep == r->npat) {
+        int same = 1;
+        for (int i = 0; i < r->nrep && same; i++) same = memcmp(&out[i], &ir[w[i]], sizeof(out[i])) == 0;
+        if (same) return 0;     // rewriting to itself would never reach a fixpoint
+    }
+    for (int i = 0; i < r->nrep; i++) ir[w[i]] = out[i];
+    for (int i = r->npat - 1; i >= r->nrep; i--) peep_kill(P, w[i]);
+    for (int i = 0; i < r->nrep; i++) peep_touch(P, w[i]);
+    return 1;
+}
+
+// Walks the opcode trie along the window at i and applies the first rule (file order) that matches.
+static int peep_match(PeepState* P, int i) {
+    int w[PEEP_MAX_WINDOW], cand[64], ncand = 0;
+    int node = peep_root[ir[i].opcode];
+    w[0] = i;
+    for (int d = 0; node >= 0; d++) {
+        for (int r = peep_nodes[node].rules; r >= 0 && ncand < 64; r = peep_rules[r].next) {
+            int k = ncand++;
+            while (k > 0 && cand[k - 1] > r) { cand[k] = cand[k - 1]; k--; }
+            cand[k] = r;
+        }
+        if (d + 1 == PEEP_MAX_WINDOW || (w[d + 1] = P->next[w[d]]) >= ir_count) break;
+        int c = peep_nodes[node].child;
+        while (c >= 0 && peep_nodes[c].opcode != ir[w[d + 1]].opcode) c = peep_nodes[c].sibling;
+        node = c;
+    }
+    for (int k = 0; k < ncand; k++)
+        if (peep_apply(P, &peep_rules[cand[k]], w)) return 1;
+    return 0;
+}
+
+// Drops tombstones in one pass over ir[].
+static void peep_compact(PeepState* P) {
+    int out = 0;
+    for (int i = 0; i < ir_count; i++)
+        if (!(P->flags[i] & PEEP_DEAD)) ir[out++] = ir[i];
+    ir_count = out;
+}
+
+// One round: every live instruction starts on the worklist; rewrites re-queue their neighbours.
+static long long peep_round(PeepState* P) {
+    for (int i = 0; i < ir_count; i++) {
+        P->prev[i] = i - 1;
+        P->next[i] = i + 1;
+        P->flags[i] = 0;
+    }
+    P->nwork = 0;
+    for (int i = ir_count - 1; i >= 0; i--) peep_push(P, i);
+    long long before = P->rewrites;
+    while (P->nwork) {
+        int i = P->work[--P->nwork];
+        P->flags[i] &= (uint8_t)~PEEP_QUEUED;
+        if (P->flags[i] & PEEP_DEAD) continue;
+        if (peep_match(P, i)) P->rewrites++;
+    }
+    peep_compact(P);
+    return P->rewrites - before;
+}
+
+// Runs the peephole rules to a fixpoint; returns the number of rewrites applied.
+long long run_all_peephole_passes() {
+    if (ir_count == 0) return 0;
+    if (ir_cap == 0) ir_reserve(ir_count);     // borrowed .rirb records: rewrite a private copy
+    peep_bind_rules();
+    PeepState P;
+    memset(&P, 0, sizeof(P));
+    P.prev = malloc((size_t)ir_count * sizeof(int));
+    P.next = malloc((size_t)ir_count * sizeof(int));
+    P.work = malloc((size_t)ir_count * sizeof(int));
+    P.flags = malloc((size_t)ir_count);
+    if (!P.prev || !P.next || !P.work || !P.flags) { perror("run_all_peephole_passes"); exit(1); }
+    while (peep_round(&P) > 0) {}
+    free(P.prev); free(P.next); free(P.work); free(P.flags);
+    return P.rewrites;
+}
+
+// Times the engine on synthetic programs of doubling size; flat ns/instruction means linear.
+void peephole_bench(int max_count) {
+    static const char* body[][3] = {
+        { "LOAD", "R1", "x" }, { "LOAD", "R1", "x" },             // redundant load
+        { "ADD", "R1", "0" },                                     // add zero
+        { "LOAD", "R4", "5" }, { "ADD", "R4", "7" },              // constant fold
+        { "MOV", "R5", "R5" },                                    // self move
+        { "STORE", "R4", "y" }, { "PRINT", "y", NULL },
+    };
+    const int group = (int)(sizeof(body) / sizeof(body[0]));
+    int start = max_count / 8 > group ? max_count / 8 : group;
+    printf("[PEEP] %10s %10s %10s %12s %10s\n", "input", "output", "rewrites", "time (ms)", "ns/instr");
+    for (int n = start; n <= max_count; n *= 2) {
+        ir_reset();
+        ir_reserve(n);
+        for (int i = 0; i < n; i++) ir_emit(body[i % group][0], body[i % group][1], body[i % group][2]);
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        long long rewrites = run_all_peephole_passes();
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+        printf("[PEEP] %10d %10d %10lld %12.3f %10.1f\n", n, ir_count, rewrites, ms, ms * 1e6 / n);
+    }
+    ir_reset();
+}
+
+// Runs ir[] on the VM into a temporary file, rewound for reading; NULL if the run faulted.
+static FILE* peep_vm_output(void) {
+    FILE* f = tmpfile();
+    if (!f) { perror("tmpfile"); return NULL; }
+    if (vm_run_ir(f) != 0) { fclose(f); return NULL; }
+    rewind(f);
+    return f;
+}
+
+// Compares two VM transcripts; returns 0 if equal, else the 1-based line of the first difference.
+static int peep_vm_diff(FILE* a, FILE* b) {
+    int line = 1, ca, cb;
+    do {
+        ca = fgetc(a);
+        cb = fgetc(b);
+        if (ca != cb) return line;
+        if (ca == '\n') line++;
+    } while (ca != EOF);
+    return 0;
+}
+
+// Input/output form follows the extension: .rirb (binary, mmap'd), .json, or text IR.
+// --verify runs the program on the VM before and after the rewrite and fails if the output differs.
+int main(int argc, char** argv) {
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0) {
+        peephole_bench(argc > 2 ? atoi(argv[2]) : 800000);
+        return 0;
+    }
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <input.ir|.rirb|.json> <output.ir|.rirb|.json> [--stats] [--verify] [--rules file.r4rules]\n", argv[0]);
+        fprintf(stderr, "       %s --bench [max-instructions]\n", argv[0]);
+        return 1;
+    }
+
+    int stats = 0, verify = 0;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--stats") == 0) stats = 1;
+        else if (strcmp(argv[i], "--verify") == 0) verify = 1;
+        else if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) {
+            if (peep_load_rules(argv[++i]) != 0) return 1;
+        }
+        else { fprintf(stderr, "Unknown option: %s\n", argv[i]); return 1; }
+    }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (ir_load_any(argv[1]) != 0) return 1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (stats) {
+        double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+        double mb = ir_bytes_read / 1e6;
+        printf("[IR] read %d instructions (%.1f MB) in %.3f ms (%.0f MB/s)\n",
+            ir_count, mb, ms, ms > 0 ? mb / (ms / 1e3) : 0.0);
+    }
+    FILE* expected = NULL;
+    if (verify && !(expected = peep_vm_output())) {
+        fprintf(stderr, "[PEEP] --verify: %s does not run on the VM\n", argv[1]);
+        return 1;
+    }
+    int before = ir_count;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    long long rewrites = run_all_peephole_passes();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (stats) {
+        double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+        printf("[PEEP] %d -> %d instructions, %lld rewrites in %.3f ms\n", before, ir_count, rewrites, ms);
+    }
+    if (verify) {
+        FILE* got = peep_vm_output();
+        int line = got ? peep_vm_diff(expected, got) : -1;
+        fclose(expected);
+        if (got) fclose(got);
+        if (line) {
+            if (line < 0) fprintf(stderr, "[PEEP] --verify: rewritten program faults on the VM\n");
+            else fprintf(stderr, "[PEEP] --verify: VM output differs from the input program at line %d\n", line);
+            return 1;
+        }
+        if (stats) printf("[PEEP] verified: VM output unchanged\n");
+    }
+    if (ir_save_any(argv[2]) != 0) return 1;
+    ir_reset();
+
+    printf("[✔] Peephole optimization complete. Output saved to %s\n", argv[2]);
+    return 0;
+}
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+typedef struct {
+    const char* symbol;
+    const char* asm_op;
+    const char* hex;
+    const char* bin;
+} SymbolMap;
+
+SymbolMap intrinsic_map[] = {
+    { "and", "AND", "0x1D2", "111010010" },
+    { "or", "OR", "0x1D3", "111010011" },
+    { "xor", "XOR", "0x1D4", "111010100" },
+    { "not", "NOT", "0x1D5", "111010101" },
+    { "and_eq", "AND [mem], reg", "0x1D6", "111010110" },
+    { "or_eq", "OR [mem], reg", "0x1D7", "111010111" },
+    { "xor_eq", "XOR [mem], reg", "0x1D8", "111011000" },
+    { "not_eq", "CMP + JNE", "0x1D9", "111011001" },
+    { "reinterpret_cast", "; reinterpret context", "0x1DA", "111011010" },
+    { "dynamic_cast", "; RTTI check", "0x1DB", "111011011" },
+    { "static_cast", "; compile reinterpret", "0x1DC", "111011100" },
+    { "const_cast", "; remove const", "0x1DD", "111011101" },
+    { "is_base_of", "; trait check", "0x1DE", "111011110" },
+    { "nullptr", "XOR reg, reg", "0x1E0", "111100000" },
+    { "throw", "JMP throw_handler", "0x1E1", "111100001" },
+    { "try", "; try label", "0x1E2", "111100010" },
+    { "catch", "; catch label", "0x1E3", "111100011" },
+    { "if", "CMP + conditional jump", "0x205", "1000000101" },
+    { "for", "LOOP label", "0x20B", "1000001011" },
+    { "new", "CALL malloc", "0x201", "1000000001" },
+    { "delete", "CALL free", "0x202", "1000000010" },
+    { "+", "ADD", "0x01", "00000001" },
+    { "-", "SUB", "0x29", "00101001" },
+    { "*", "MUL", "0xF7", "11110111" },
+    { "/", "DIV", "0xF7", "11110111" }, // same opcode family
+    { "%", "MOD", "0xF7", "11110111" },
+    { NULL, NULL, NULL, NULL }
+};
+
+void explain_symbol(const char* input) {
+    for (int i = 0; intrinsic_map[i].symbol; i++) {
+        if (strcmp(intrinsic_map[i].symbol, input) == 0) {
+            printf("Symbol: %s\nASM: %s\nHex: %s\nBin: %s\n",
+                intrinsic_map[i].symbol,
+                intrinsic_map[i].asm_op,
+                intrinsic_map[i].hex,
+                intrinsic_map[i].bin);
+            return;
+        }
+    }
+    printf("Unknown symbol: %s\n", input);
+}
+
+void intrinsic_parse_line(char* line) {
+    if (strstr(line, "#")) {
+        printf("[Comment] Line skipped\n");
+        return;
+    }
+    if (strstr(line, "**")) {
+        printf("[Multiline Comment Block]\n");
+        return;
+    }
+    if (strstr(line, "Let")) {
+        printf("[Variable Declaration Detected] %s\n", line);
+    }
+    if (strstr(line, "==")) {
+        printf("[Immutable Declaration Detected]\n");
+    }
+    if (strstr(line, "Start")) {
+        printf("[Command Entry Point]\n");
+    }
+    if (strstr(line, "Return")) {
+        printf("[Command Exit Detected]\n");
+    }
+    if (strstr(line, "|")) {
+        printf("[C.I.A.M.S. Macro or Definition] %s\n", line);
+    }
+    if (strstr(line, ";")) {
+        printf("[Line Termination Detected]\n");
+    }
+    if (strstr(line, ":")) {
+        printf("[Fallback Instruction Separator]\n");
+    }
+    if (strstr(line, "->")) {
+        printf("[Progression Symbol Detected]\n");
+    }
+    if (strstr(line, "~>")) {
+        printf("[Raise Expression Detected]\n");
+    }
+    if (strstr(line, "<~")) {
+        printf("[Flag Expression Detected]\n");
+    }
+    if (strstr(line, "<-")) {
+        printf("[Throw Command Detected]\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            explain_symbol(argv[i]);
+        }
+    } else {
+        char line[256];
+        printf("Enter code lines for intrinsic analysis (Ctrl+D to end):\n");
+        while (fgets(line, sizeof(line), stdin)) {
+            intrinsic_parse_line(line);
+        }
+    }
+    return 0;
+}
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+typedef struct {
+    const char* symbol;
+    const char* asm_op;
+    const char* hex;
+    const char* bin;
+} SymbolMap;
+
+SymbolMap intrinsic_map[] = {
+    { "and", "AND", "0x1D2", "111010010" },
+    { "or", "OR", "0x1D3", "111010011" },
     { "xor", "XOR", "0x1D4", "111010100" },
     { "not", "NOT", "0x1D5", "111010101" },
     { "and_eq", "AND [mem], reg", "0x1D6", "111010110" },
@@ -5797,10 +6079,17 @@ void generate_asm(IRNode* ir, const char* target_name) {
                 printf("; X86-64 Assembly Code\n");
                 for (int i = 0; i < ir->count; i++) {
                     IRInstruction* inst = &ir->instructions[i];
-                    printf("%s %s, %s\n", inst->op, inst->arg1, inst->arg2);
+                    printf("%s %s, %s\n", ir_str(inst->op), ir_str(inst->arg[0]), ir_str(inst->arg[1]));
                 }
 			}
 
+            // ARCH_ARM64: the IR buffer through rexion_isel_arm64.c
+            extern int a64_write_asm(const char* path);
+            void generate_arm64_asm(IRNode* ir) {
+                (void)ir;
+                a64_write_asm("rexion_arm64.s");
+            }
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6164,3 +6453,14228 @@ void generate_asm(IRNode* ir, const char* target_name) {
                 glfwTerminate();
                 return 0;
 			}
+
+
+
+// ssa_ir.c – Rexion SSA IR (basic blocks, phi nodes, CFG builder)
+// DOC: SSA IR with basic blocks, phi nodes and explicit predecessor/successor lists
+// DOC: The CFG is built straight from the AST (if/while/for/return) with on-the-fly SSA construction
+// DOC: ssa_destruct() leaves SSA (phi -> parallel copies on split edges) before register allocation
+// DOC: ssa_sccp() propagates constants through values and branches, pruning blocks that never run
+// DOC: ssa_dce_module() marks from observable effects and sweeps dead values, stores and functions
+// DOC: ssa_gvn() hash-conses expressions along the dominator tree and reuses the dominating copy
+// DOC: ssa_optimize_loops() hoists loop invariants to preheaders and strength-reduces i * k into adds
+// DOC: ssa_inline_module() inlines small, hot, non-recursive callees bottom-up within a growth budget
+// DOC: ssa_vectorize() runs `vectorize`-annotated AST loops on SSE2/AVX2/AVX-512 lanes with a scalar remainder loop
+// DOC: Vector ops run only in the SSA interpreter: they have no flat IR or x86 form, so ssa_optimize_ir() refuses them
+// DOC: ssa_optimize_module() runs the named passes of the -O0/-O1/-O2/-O3/-Os pipeline, optionally timed per pass
+// DOC: ssa_profile_instrument() adds block/edge counters; the profile they write drives inlining and block layout
+// DOC: ssa_profile_ir_file() is the training run for an IR program; counts come from the SSA interpreter, not native code
+// DOC: ssa_tailcall_module() turns self tail recursion into loops and flags other tail calls to run as jumps
+// DOC: ssa_build_from_ir() builds SSA from call-free flat IR; ssa_optimize_ir() lowers the optimized, out-of-SSA result back to IR
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+// === AST ===
+
+typedef enum {
+    AST_PROGRAM, AST_FUNC, AST_BLOCK,
+    AST_ASSIGN, AST_PRINT, AST_IF, AST_WHILE, AST_FOR, AST_RETURN, AST_EXPR,
+    AST_NUM, AST_FLOAT, AST_STRING, AST_VAR, AST_BINOP, AST_CALL
+} ASTKind;
+
+typedef struct ASTNode {
+    ASTKind kind;
+    char name[32];          // variable, function or callee name
+    char op[4];             // AST_BINOP operator: + - * / % == != < <= > >=
+    long long ival;
+    double fval;
+    char* str;              // AST_STRING payload
+    struct ASTNode* lhs;    // binop lhs, assigned value, condition, printed value, for bound
+    struct ASTNode* rhs;    // binop rhs, then-block, loop body
+    struct ASTNode* els;    // else-block
+    struct ASTNode** kids;  // block statements, call arguments, function params (AST_VAR)
+    int kid_count;
+    int kid_cap;
+    int vectorize;          // AST_FOR/AST_WHILE annotated with the vectorize keyword
+} ASTNode;
+
+static void* ssa_xrealloc(void* p, size_t size) {
+    void* q = realloc(p, size ? size : 1);
+    if (!q) { perror("ssa_xrealloc"); exit(1); }
+    return q;
+}
+
+ASTNode* ast_new(ASTKind kind) {
+    ASTNode* n = calloc(1, sizeof(ASTNode));
+    if (!n) { perror("ast_new"); exit(1); }
+    n->kind = kind;
+    return n;
+}
+
+void ast_add_kid(ASTNode* parent, ASTNode* kid) {
+    if (parent->kid_count == parent->kid_cap) {
+        parent->kid_cap = parent->kid_cap ? parent->kid_cap * 2 : 4;
+        parent->kids = ssa_xrealloc(parent->kids, parent->kid_cap * sizeof(ASTNode*));
+    }
+    parent->kids[parent->kid_count++] = kid;
+}
+
+ASTNode* ast_num(long long v) { ASTNode* n = ast_new(AST_NUM); n->ival = v; return n; }
+ASTNode* ast_float(double v) { ASTNode* n = ast_new(AST_FLOAT); n->fval = v; return n; }
+ASTNode* ast_string(const char* s) { ASTNode* n = ast_new(AST_STRING); n->str = strdup(s); return n; }
+
+ASTNode* ast_var(const char* name) {
+    ASTNode* n = ast_new(AST_VAR);
+    snprintf(n->name, sizeof(n->name), "%s", name);
+    return n;
+}
+
+ASTNode* ast_binop(const char* op, ASTNode* lhs, ASTNode* rhs) {
+    ASTNode* n = ast_new(AST_BINOP);
+    snprintf(n->op, sizeof(n->op), "%s", op);
+    n->lhs = lhs;
+    n->rhs = rhs;
+    return n;
+}
+
+ASTNode* ast_assign(const char* name, ASTNode* value) {
+    ASTNode* n = ast_new(AST_ASSIGN);
+    snprintf(n->name, sizeof(n->name), "%s", name);
+    n->lhs = value;
+    return n;
+}
+
+ASTNode* ast_print(ASTNode* value) { ASTNode* n = ast_new(AST_PRINT); n->lhs = value; return n; }
+ASTNode* ast_return(ASTNode* value) { ASTNode* n = ast_new(AST_RETURN); n->lhs = value; return n; }
+
+ASTNode* ast_if(ASTNode* cond, ASTNode* then_block, ASTNode* else_block) {
+    ASTNode* n = ast_new(AST_IF);
+    n->lhs = cond;
+    n->rhs = then_block;
+    n->els = else_block;
+    return n;
+}
+
+ASTNode* ast_while(ASTNode* cond, ASTNode* body) {
+    ASTNode* n = ast_new(AST_WHILE);
+    n->lhs = cond;
+    n->rhs = body;
+    return n;
+}
+
+// for <var> in <bound> { body }  iterates var = 0 .. bound-1
+ASTNode* ast_for(const char* var, ASTNode* bound, ASTNode* body) {
+    ASTNode* n = ast_new(AST_FOR);
+    snprintf(n->name, sizeof(n->name), "%s", var);
+    n->lhs = bound;
+    n->rhs = body;
+    return n;
+}
+
+// vectorize <loop>: asks the optimizer to run the loop on vector lanes (see ssa_vectorize)
+ASTNode* ast_vectorize(ASTNode* loop) {
+    if (loop->kind == AST_FOR || loop->kind == AST_WHILE) loop->vectorize = 1;
+    else fprintf(stderr, "[VECTORIZE] Annotation ignored: not followed by a loop\n");
+    return loop;
+}
+
+ASTNode* ast_call(const char* callee) {
+    ASTNode* n = ast_new(AST_CALL);
+    snprintf(n->name, sizeof(n->name), "%s", callee);
+    return n;
+}
+
+ASTNode* ast_func(const char* name) {
+    ASTNode* n = ast_new(AST_FUNC);
+    snprintf(n->name, sizeof(n->name), "%s", name);
+    n->rhs = ast_new(AST_BLOCK);
+    return n;
+}
+
+void ast_free(ASTNode* n) {
+    if (!n) return;
+    ast_free(n->lhs);
+    ast_free(n->rhs);
+    ast_free(n->els);
+    for (int i = 0; i < n->kid_count; i++) ast_free(n->kids[i]);
+    free(n->kids);
+    free(n->str);
+    free(n);
+}
+
+// === SSA IR ===
+
+typedef enum {
+    SSA_CONST, SSA_FCONST, SSA_SCONST, SSA_PARAM, SSA_UNDEF,
+    SSA_ADD, SSA_SUB, SSA_MUL, SSA_DIV, SSA_MOD,
+    SSA_FADD, SSA_FSUB, SSA_FMUL, SSA_FDIV,
+    SSA_EQ, SSA_NE, SSA_LT, SSA_LE, SSA_GT, SSA_GE,
+    SSA_LOAD, SSA_STORE, SSA_CALL, SSA_PRINT, SSA_COUNT,
+    SSA_PHI, SSA_COPY,
+    SSA_VSPLAT, SSA_VIOTA, SSA_VOP, SSA_VREDUCE, SSA_VEXTRACT,
+    SSA_JMP, SSA_BR, SSA_RET, SSA_HALT
+} SSAOp;
+
+static const char* ssa_op_names[] = {
+    "const", "fconst", "sconst", "param", "undef",
+    "add", "sub", "mul", "div", "mod",
+    "fadd", "fsub", "fmul", "fdiv",
+    "eq", "ne", "lt", "le", "gt", "ge",
+    "load", "store", "call", "print", "count",
+    "phi", "copy",
+    "vsplat", "viota", "vop", "vreduce", "vextract",
+    "jmp", "br", "ret", "halt"
+};
+
+typedef struct {
+    SSAOp op;
+    int block;          // owning block id
+    int dst;            // destination vreg; equals the value id while in SSA
+    int is_float;
+    int dead;           // tombstone, swept by ssa_compact()
+    int replaced_by;    // forwarding for removed trivial phis, -1 if live
+    long long imm;      // SSA_CONST value, SSA_PARAM index, scalar op of SSA_VOP/SSA_VREDUCE, SSA_VEXTRACT lane, SSA_COUNT counter,
+                        // 1 on an SSA_CALL in tail position (the next instruction returns its value)
+    double fimm;
+    char name[32];      // global for LOAD/STORE, callee for CALL
+    char* str;          // SSA_SCONST payload
+    int* args;          // operand value ids; phi operands follow the block's pred order
+    int nargs;
+    int arg_cap;
+    int target[2];      // JMP: [0]; BR: [0] taken when true, [1] when false
+    int lanes;          // vector width of a vector value, 0 for scalars
+} SSAInstr;
+
+typedef struct {
+    int id;
+    char label[32];
+    int* instrs; int ninstrs; int instr_cap;        // phis first, terminator last
+    int* preds; int npreds; int pred_cap;
+    int* succs; int nsuccs; int succ_cap;
+    int* incomplete; int nincomplete; int incomplete_cap;  // (var, phi) pairs awaiting sealing
+    int sealed;
+    int vectorize;      // header of a loop annotated with the vectorize keyword
+    long long count;    // profile: times the block ran, -1 when unknown
+    long long taken[2]; // profile: times a BR left through target[0] / target[1], -1 when unknown
+} SSABlock;
+
+typedef struct {
+    long long* keys;
+    int* vals;
+    int cap;
+    int count;
+} SSADefMap;
+
+typedef struct {
+    char name[32];
+    int param_count;
+    SSAInstr* instrs; int ninstrs; int instr_cap;
+    SSABlock* blocks; int nblocks; int block_cap;
+    int entry;
+    int in_ssa;
+    int profiled;       // block counts come from a profile (ssa_profile_read)
+    // construction state
+    char (*vars)[32]; int nvars; int var_cap;
+    SSADefMap defs;
+} SSAFunction;
+
+typedef struct {
+    SSAFunction** funcs; int nfuncs; int func_cap;
+    char (*globals)[32]; int nglobals; int global_cap;
+    long long* counters; int ncounters;     // SSA_COUNT slots of an instrumented module
+} SSAModule;
+
+static void ssa_push(int** arr, int* n, int* cap, int v) {
+    if (*n == *cap) {
+        *cap = *cap ? *cap * 2 : 4;
+        *arr = ssa_xrealloc(*arr, *cap * sizeof(int));
+    }
+    (*arr)[(*n)++] = v;
+}
+
+SSAFunction* ssa_new_function(const char* name) {
+    SSAFunction* f = calloc(1, sizeof(SSAFunction));
+    if (!f) { perror("ssa_new_function"); exit(1); }
+    snprintf(f->name, sizeof(f->name), "%s", name);
+    f->in_ssa = 1;
+    f->entry = -1;
+    return f;
+}
+
+int ssa_new_block(SSAFunction* f, const char* label) {
+    if (f->nblocks == f->block_cap) {
+        f->block_cap = f->block_cap ? f->block_cap * 2 : 16;
+        f->blocks = ssa_xrealloc(f->blocks, f->block_cap * sizeof(SSABlock));
+    }
+    SSABlock* b = &f->blocks[f->nblocks];
+    memset(b, 0, sizeof(*b));
+    b->id = f->nblocks;
+    b->count = b->taken[0] = b->taken[1] = -1;
+    snprintf(b->label, sizeof(b->label), "%s%d", label ? label : "bb", b->id);
+    return f->nblocks++;
+}
+
+// Allocates a detached instruction; callers place it with ssa_append/ssa_insert_at.
+int ssa_new_instr(SSAFunction* f, SSAOp op, int block) {
+    if (f->ninstrs == f->instr_cap) {
+        f->instr_cap = f->instr_cap ? f->instr_cap * 2 : 64;
+        f->instrs = ssa_xrealloc(f->instrs, f->instr_cap * sizeof(SSAInstr));
+    }
+    SSAInstr* in = &f->instrs[f->ninstrs];
+    memset(in, 0, sizeof(*in));
+    in->op = op;
+    in->block = block;
+    in->dst = f->ninstrs;
+    in->replaced_by = -1;
+    in->target[0] = in->target[1] = -1;
+    return f->ninstrs++;
+}
+
+void ssa_add_arg(SSAFunction* f, int instr, int value) {
+    SSAInstr* in = &f->instrs[instr];
+    ssa_push(&in->args, &in->nargs, &in->arg_cap, value);
+}
+
+void ssa_insert_at(SSAFunction* f, int block, int pos, int instr) {
+    SSABlock* b = &f->blocks[block];
+    ssa_push(&b->instrs, &b->ninstrs, &b->instr_cap, instr);
+    memmove(&b->instrs[pos + 1], &b->instrs[pos], (b->ninstrs - 1 - pos) * sizeof(int));
+    b->instrs[pos] = instr;
+    f->instrs[instr].block = block;
+}
+
+void ssa_append(SSAFunction* f, int block, int instr) {
+    SSABlock* b = &f->blocks[block];
+    ssa_push(&b->instrs, &b->ninstrs, &b->instr_cap, instr);
+    f->instrs[instr].block = block;
+}
+
+int ssa_is_terminator(SSAOp op) {
+    return op == SSA_JMP || op == SSA_BR || op == SSA_RET || op == SSA_HALT;
+}
+
+// Value-producing instructions; STORE/PRINT/COUNT/terminators only have effects.
+int ssa_has_value(SSAOp op) {
+    return !(op == SSA_STORE || op == SSA_PRINT || op == SSA_COUNT || ssa_is_terminator(op));
+}
+
+int ssa_terminator(SSAFunction* f, int block) {
+    SSABlock* b = &f->blocks[block];
+    if (b->ninstrs == 0) return -1;
+    int t = b->instrs[b->ninstrs - 1];
+    return ssa_is_terminator(f->instrs[t].op) ? t : -1;
+}
+
+void ssa_add_edge(SSAFunction* f, int from, int to) {
+    ssa_push(&f->blocks[from].succs, &f->blocks[from].nsuccs, &f->blocks[from].succ_cap, to);
+    ssa_push(&f->blocks[to].preds, &f->blocks[to].npreds, &f->blocks[to].pred_cap, from);
+}
+
+int ssa_pred_index(SSAFunction* f, int block, int pred) {
+    SSABlock* b = &f->blocks[block];
+    for (int i = 0; i < b->npreds; i++)
+        if (b->preds[i] == pred) return i;
+    return -1;
+}
+
+// Drops predecessor slot `index` from `block`, together with the matching phi operand.
+void ssa_remove_pred(SSAFunction* f, int block, int index) {
+    SSABlock* b = &f->blocks[block];
+    for (int i = 0; i < b->ninstrs; i++) {
+        SSAInstr* in = &f->instrs[b->instrs[i]];
+        if (in->op != SSA_PHI) break;
+        if (index < in->nargs) {
+            memmove(&in->args[index], &in->args[index + 1], (in->nargs - index - 1) * sizeof(int));
+            in->nargs--;
+        }
+    }
+    memmove(&b->preds[index], &b->preds[index + 1], (b->npreds - index - 1) * sizeof(int));
+    b->npreds--;
+}
+
+void ssa_remove_succ(SSAFunction* f, int block, int succ) {
+    SSABlock* b = &f->blocks[block];
+    for (int i = 0; i < b->nsuccs; i++) {
+        if (b->succs[i] == succ) {
+            memmove(&b->succs[i], &b->succs[i + 1], (b->nsuccs - i - 1) * sizeof(int));
+            b->nsuccs--;
+            return;
+        }
+    }
+}
+
+int ssa_resolve(SSAFunction* f, int v) {
+    int root = v;
+    while (root >= 0 && f->instrs[root].replaced_by >= 0) root = f->instrs[root].replaced_by;
+    while (v >= 0 && f->instrs[v].replaced_by >= 0) {
+        int next = f->instrs[v].replaced_by;
+        f->instrs[v].replaced_by = root;
+        v = next;
+    }
+    return root;
+}
+
+// Marks `v` dead and forwards every use of it to `with`.
+void ssa_replace_all_uses(SSAFunction* f, int v, int with) {
+    f->instrs[v].replaced_by = with;
+    f->instrs[v].dead = 1;
+}
+
+// === Variable definitions (block, var) -> value ===
+
+static long long ssa_def_key(int block, int var) { return ((long long)block << 32) | (unsigned)var; }
+
+static void ssa_defmap_put(SSADefMap* m, long long key, int val);
+
+static void ssa_defmap_grow(SSADefMap* m) {
+    SSADefMap old = *m;
+    m->cap = old.cap ? old.cap * 2 : 256;
+    m->count = 0;
+    m->keys = malloc(m->cap * sizeof(long long));
+    m->vals = malloc(m->cap * sizeof(int));
+    if (!m->keys || !m->vals) { perror("ssa_defmap_grow"); exit(1); }
+    for (int i = 0; i < m->cap; i++) m->keys[i] = -1;
+    for (int i = 0; i < old.cap; i++)
+        if (old.keys[i] != -1) ssa_defmap_put(m, old.keys[i], old.vals[i]);
+    free(old.keys);
+    free(old.vals);
+}
+
+static unsigned ssa_defmap_slot(const SSADefMap* m, long long key) {
+    unsigned long long h = (unsigned long long)key * 0x9E3779B97F4A7C15ULL;
+    return (unsigned)(h >> 32) & (m->cap - 1);
+}
+
+static void ssa_defmap_put(SSADefMap* m, long long key, int val) {
+    if ((m->count + 1) * 4 >= m->cap * 3) ssa_defmap_grow(m);
+    unsigned i = ssa_defmap_slot(m, key);
+    while (m->keys[i] != -1 && m->keys[i] != key) i = (i + 1) & (m->cap - 1);
+    if (m->keys[i] == -1) m->count++;
+    m->keys[i] = key;
+    m->vals[i] = val;
+}
+
+static int ssa_defmap_get(const SSADefMap* m, long long key) {
+    if (!m->cap) return -1;
+    unsigned i = ssa_defmap_slot(m, key);
+    while (m->keys[i] != -1) {
+        if (m->keys[i] == key) return m->vals[i];
+        i = (i + 1) & (m->cap - 1);
+    }
+    return -1;
+}
+
+static int ssa_var_index(SSAFunction* f, const char* name) {
+    for (int i = 0; i < f->nvars; i++)
+        if (strcmp(f->vars[i], name) == 0) return i;
+    if (f->nvars == f->var_cap) {
+        f->var_cap = f->var_cap ? f->var_cap * 2 : 16;
+        f->vars = ssa_xrealloc(f->vars, f->var_cap * sizeof(*f->vars));
+    }
+    snprintf(f->vars[f->nvars], sizeof(f->vars[0]), "%s", name);
+    return f->nvars++;
+}
+
+static void ssa_write_var(SSAFunction* f, int var, int block, int value) {
+    ssa_defmap_put(&f->defs, ssa_def_key(block, var), value);
+}
+
+static int ssa_read_var(SSAFunction* f, int var, int block);
+
+static int ssa_new_phi(SSAFunction* f, int block) {
+    int phi = ssa_new_instr(f, SSA_PHI, block);
+    SSABlock* b = &f->blocks[block];
+    int pos = 0;
+    while (pos < b->ninstrs && f->instrs[b->instrs[pos]].op == SSA_PHI) pos++;
+    ssa_insert_at(f, block, pos, phi);
+    return phi;
+}
+
+static int ssa_new_undef(SSAFunction* f) {
+    int u = ssa_new_instr(f, SSA_UNDEF, f->entry);
+    ssa_insert_at(f, f->entry, 0, u);
+    return u;
+}
+
+static int ssa_try_remove_trivial_phi(SSAFunction* f, int phi) {
+    int same = -1;
+    SSAInstr* in = &f->instrs[phi];
+    for (int i = 0; i < in->nargs; i++) {
+        int op = ssa_resolve(f, in->args[i]);
+        if (op == same || op == phi) continue;
+        if (same != -1) return phi;
+        same = op;
+    }
+    if (same == -1) same = ssa_new_undef(f);
+    ssa_replace_all_uses(f, phi, same);
+    return same;
+}
+
+static int ssa_add_phi_operands(SSAFunction* f, int var, int phi) {
+    int block = f->instrs[phi].block;
+    int npreds = f->blocks[block].npreds;
+    for (int i = 0; i < npreds; i++) {
+        int v = ssa_read_var(f, var, f->blocks[block].preds[i]);
+        ssa_add_arg(f, phi, v);
+        if (f->instrs[v].is_float) f->instrs[phi].is_float = 1;
+    }
+    return ssa_try_remove_trivial_phi(f, phi);
+}
+
+static int ssa_read_var(SSAFunction* f, int var, int block) {
+    int v = ssa_defmap_get(&f->defs, ssa_def_key(block, var));
+    if (v >= 0) return ssa_resolve(f, v);
+
+    SSABlock* b = &f->blocks[block];
+    if (!b->sealed) {
+        v = ssa_new_phi(f, block);
+        b = &f->blocks[block];
+        ssa_push(&b->incomplete, &b->nincomplete, &b->incomplete_cap, var);
+        ssa_push(&b->incomplete, &b->nincomplete, &b->incomplete_cap, v);
+    }
+    else if (b->npreds == 1) {
+        v = ssa_read_var(f, var, b->preds[0]);
+    }
+    else {
+        v = ssa_new_phi(f, block);
+        ssa_write_var(f, var, block, v);
+        v = ssa_add_phi_operands(f, var, v);
+    }
+    ssa_write_var(f, var, block, v);
+    return v;
+}
+
+void ssa_seal_block(SSAFunction* f, int block) {
+    SSABlock* b = &f->blocks[block];
+    for (int i = 0; i < b->nincomplete; i += 2) {
+        int var = f->blocks[block].incomplete[i];
+        int phi = f->blocks[block].incomplete[i + 1];
+        ssa_add_phi_operands(f, var, phi);
+    }
+    b = &f->blocks[block];
+    free(b->incomplete);
+    b->incomplete = NULL;
+    b->nincomplete = b->incomplete_cap = 0;
+    b->sealed = 1;
+}
+
+// === CFG construction from the AST ===
+
+typedef struct {
+    SSAFunction* f;
+    SSAModule* m;
+    int cur;
+} SSABuilder;
+
+static int ssa_is_global(SSAModule* m, const char* name) {
+    for (int i = 0; i < m->nglobals; i++)
+        if (strcmp(m->globals[i], name) == 0) return 1;
+    return 0;
+}
+
+static int ssa_emit(SSABuilder* sb, SSAOp op) {
+    int in = ssa_new_instr(sb->f, op, sb->cur);
+    ssa_append(sb->f, sb->cur, in);
+    return in;
+}
+
+static void ssa_emit_jmp(SSABuilder* sb, int target) {
+    int j = ssa_emit(sb, SSA_JMP);
+    sb->f->instrs[j].target[0] = target;
+    ssa_add_edge(sb->f, sb->cur, target);
+}
+
+static void ssa_emit_br(SSABuilder* sb, int cond, int if_true, int if_false) {
+    int br = ssa_emit(sb, SSA_BR);
+    ssa_add_arg(sb->f, br, cond);
+    sb->f->instrs[br].target[0] = if_true;
+    sb->f->instrs[br].target[1] = if_false;
+    ssa_add_edge(sb->f, sb->cur, if_true);
+    ssa_add_edge(sb->f, sb->cur, if_false);
+}
+
+// Code after return lands in a fresh block without predecessors; it is dropped later.
+static void ssa_start_dead_block(SSABuilder* sb) {
+    sb->cur = ssa_new_block(sb->f, "dead");
+    sb->f->blocks[sb->cur].sealed = 1;
+}
+
+static SSAOp ssa_binop_for(const char* op, int is_float) {
+    if (strcmp(op, "+") == 0) return is_float ? SSA_FADD : SSA_ADD;
+    if (strcmp(op, "-") == 0) return is_float ? SSA_FSUB : SSA_SUB;
+    if (strcmp(op, "*") == 0) return is_float ? SSA_FMUL : SSA_MUL;
+    if (strcmp(op, "/") == 0) return is_float ? SSA_FDIV : SSA_DIV;
+    if (strcmp(op, "%") == 0) return SSA_MOD;
+    if (strcmp(op, "==") == 0) return SSA_EQ;
+    if (strcmp(op, "!=") == 0) return SSA_NE;
+    if (strcmp(op, "<") == 0) return SSA_LT;
+    if (strcmp(op, "<=") == 0) return SSA_LE;
+    if (strcmp(op, ">") == 0) return SSA_GT;
+    if (strcmp(op, ">=") == 0) return SSA_GE;
+    fprintf(stderr, "[SSA] Unknown operator '%s', treating as +\n", op);
+    return SSA_ADD;
+}
+
+static int ssa_build_expr(SSABuilder* sb, ASTNode* e) {
+    SSAFunction* f = sb->f;
+    int v;
+    switch (e->kind) {
+    case AST_NUM:
+        v = ssa_emit(sb, SSA_CONST);
+        f->instrs[v].imm = e->ival;
+        return v;
+    case AST_FLOAT:
+        v = ssa_emit(sb, SSA_FCONST);
+        f->instrs[v].fimm = e->fval;
+        f->instrs[v].is_float = 1;
+        return v;
+    case AST_STRING:
+        v = ssa_emit(sb, SSA_SCONST);
+        f->instrs[v].str = strdup(e->str ? e->str : "");
+        return v;
+    case AST_VAR:
+        if (ssa_is_global(sb->m, e->name)) {
+            v = ssa_emit(sb, SSA_LOAD);
+            snprintf(f->instrs[v].name, sizeof(f->instrs[v].name), "%s", e->name);
+            return v;
+        }
+        return ssa_read_var(f, ssa_var_index(f, e->name), sb->cur);
+    case AST_BINOP: {
+        int a = ssa_build_expr(sb, e->lhs);
+        int b = ssa_build_expr(sb, e->rhs);
+        int is_float = f->instrs[a].is_float || f->instrs[b].is_float;
+        SSAOp op = ssa_binop_for(e->op, is_float);
+        v = ssa_emit(sb, op);
+        ssa_add_arg(f, v, a);
+        ssa_add_arg(f, v, b);
+        // comparisons yield an integer truth value; their operands say how to compare
+        f->instrs[v].is_float = is_float && !(op >= SSA_EQ && op <= SSA_GE);
+        return v;
+    }
+    case AST_CALL: {
+        int args[16];
+        int n = e->kid_count < 16 ? e->kid_count : 16;
+        for (int i = 0; i < n; i++) args[i] = ssa_build_expr(sb, e->kids[i]);
+        v = ssa_emit(sb, SSA_CALL);
+        snprintf(f->instrs[v].name, sizeof(f->instrs[v].name), "%s", e->name);
+        for (int i = 0; i < n; i++) ssa_add_arg(f, v, args[i]);
+        return v;
+    }
+    default:
+        fprintf(stderr, "[SSA] Unexpected AST node %d in expression\n", e->kind);
+        v = ssa_emit(sb, SSA_CONST);
+        return v;
+    }
+}
+
+static void ssa_build_stmt(SSABuilder* sb, ASTNode* s);
+
+static void ssa_build_block(SSABuilder* sb, ASTNode* block) {
+    if (!block) return;
+    if (block->kind != AST_BLOCK) { ssa_build_stmt(sb, block); return; }
+    for (int i = 0; i < block->kid_count; i++) ssa_build_stmt(sb, block->kids[i]);
+}
+
+static void ssa_build_stmt(SSABuilder* sb, ASTNode* s) {
+    SSAFunction* f = sb->f;
+    switch (s->kind) {
+    case AST_BLOCK:
+        ssa_build_block(sb, s);
+        break;
+    case AST_ASSIGN: {
+        int v = ssa_build_expr(sb, s->lhs);
+        if (ssa_is_global(sb->m, s->name)) {
+            int st = ssa_emit(sb, SSA_STORE);
+            snprintf(f->instrs[st].name, sizeof(f->instrs[st].name), "%s", s->name);
+            ssa_add_arg(f, st, v);
+        }
+        else {
+            ssa_write_var(f, ssa_var_index(f, s->name), sb->cur, v);
+        }
+        break;
+    }
+    case AST_PRINT: {
+        int v = ssa_build_expr(sb, s->lhs);
+        int p = ssa_emit(sb, SSA_PRINT);
+        ssa_add_arg(f, p, v);
+        break;
+    }
+    case AST_EXPR:
+        ssa_build_expr(sb, s->lhs);
+        break;
+    case AST_IF: {
+        int c = ssa_build_expr(sb, s->lhs);
+        int then_b = ssa_new_block(f, "then");
+        int else_b = s->els ? ssa_new_block(f, "else") : -1;
+        int join_b = ssa_new_block(f, "endif");
+        ssa_emit_br(sb, c, then_b, else_b >= 0 ? else_b : join_b);
+        ssa_seal_block(f, then_b);
+        sb->cur = then_b;
+        ssa_build_block(sb, s->rhs);
+        ssa_emit_jmp(sb, join_b);
+        if (else_b >= 0) {
+            ssa_seal_block(f, else_b);
+            sb->cur = else_b;
+            ssa_build_block(sb, s->els);
+            ssa_emit_jmp(sb, join_b);
+        }
+        ssa_seal_block(f, join_b);
+        sb->cur = join_b;
+        break;
+    }
+    case AST_WHILE: {
+        int head = ssa_new_block(f, "while");
+        int body = ssa_new_block(f, "body");
+        int exit_b = ssa_new_block(f, "wend");
+        f->blocks[head].vectorize = s->vectorize;
+        ssa_emit_jmp(sb, head);
+        sb->cur = head;
+        int c = ssa_build_expr(sb, s->lhs);
+        ssa_emit_br(sb, c, body, exit_b);
+        ssa_seal_block(f, body);
+        sb->cur = body;
+        ssa_build_block(sb, s->rhs);
+        ssa_emit_jmp(sb, head);
+        ssa_seal_block(f, head);
+        ssa_seal_block(f, exit_b);
+        sb->cur = exit_b;
+        break;
+    }
+    case AST_FOR: {
+        int var = ssa_var_index(f, s->name);
+        int bound = ssa_build_expr(sb, s->lhs);
+        int zero = ssa_emit(sb, SSA_CONST);
+        ssa_write_var(f, var, sb->cur, zero);
+        int head = ssa_new_block(f, "for");
+        int body = ssa_new_block(f, "body");
+        int exit_b = ssa_new_block(f, "fend");
+        f->blocks[head].vectorize = s->vectorize;
+        ssa_emit_jmp(sb, head);
+        sb->cur = head;
+        int lt = ssa_emit(sb, SSA_LT);
+        ssa_add_arg(f, lt, ssa_read_var(f, var, head));
+        ssa_add_arg(f, lt, bound);
+        ssa_emit_br(sb, lt, body, exit_b);
+        ssa_seal_block(f, body);
+        sb->cur = body;
+        ssa_build_block(sb, s->rhs);
+        int one = ssa_emit(sb, SSA_CONST);
+        f->instrs[one].imm = 1;
+        int next = ssa_emit(sb, SSA_ADD);
+        ssa_add_arg(f, next, ssa_read_var(f, var, sb->cur));
+        ssa_add_arg(f, next, one);
+        ssa_write_var(f, var, sb->cur, next);
+        ssa_emit_jmp(sb, head);
+        ssa_seal_block(f, head);
+        ssa_seal_block(f, exit_b);
+        sb->cur = exit_b;
+        break;
+    }
+    case AST_RETURN: {
+        int v = s->lhs ? ssa_build_expr(sb, s->lhs) : -1;
+        int r = ssa_emit(sb, SSA_RET);
+        if (v >= 0) ssa_add_arg(f, r, v);
+        ssa_start_dead_block(sb);
+        break;
+    }
+    default:
+        ssa_build_expr(sb, s);
+        break;
+    }
+}
+
+// Removes blocks not reachable from the entry and renumbers the rest densely.
+int ssa_remove_unreachable(SSAFunction* f) {
+    int* reach = calloc(f->nblocks, sizeof(int));
+    int* stack = malloc(f->nblocks * sizeof(int));
+    int sp = 0, removed = 0;
+    reach[f->entry] = 1;
+    stack[sp++] = f->entry;
+    while (sp) {
+        int b = stack[--sp];
+        for (int i = 0; i < f->blocks[b].nsuccs; i++) {
+            int s = f->blocks[b].succs[i];
+            if (!reach[s]) { reach[s] = 1; stack[sp++] = s; }
+        }
+    }
+    for (int b = 0; b < f->nblocks; b++) {
+        if (reach[b]) continue;
+        SSABlock* blk = &f->blocks[b];
+        for (int i = 0; i < blk->nsuccs; i++) {
+            int s = blk->succs[i];
+            if (!reach[s]) continue;
+            int idx = ssa_pred_index(f, s, b);
+            while (idx >= 0) {
+                ssa_remove_pred(f, s, idx);
+                idx = ssa_pred_index(f, s, b);
+            }
+        }
+        for (int i = 0; i < blk->ninstrs; i++) f->instrs[blk->instrs[i]].dead = 1;
+        removed++;
+    }
+    if (removed) {
+        int* remap = malloc(f->nblocks * sizeof(int));
+        int n = 0;
+        for (int b = 0; b < f->nblocks; b++) {
+            if (reach[b]) {
+                remap[b] = n;
+                if (n != b) f->blocks[n] = f->blocks[b];
+                f->blocks[n].id = n;
+                n++;
+            }
+            else {
+                remap[b] = -1;
+                free(f->blocks[b].instrs);
+                free(f->blocks[b].preds);
+                free(f->blocks[b].succs);
+                free(f->blocks[b].incomplete);
+            }
+        }
+        f->nblocks = n;
+        for (int b = 0; b < n; b++) {
+            SSABlock* blk = &f->blocks[b];
+            for (int i = 0; i < blk->npreds; i++) blk->preds[i] = remap[blk->preds[i]];
+            for (int i = 0; i < blk->nsuccs; i++) blk->succs[i] = remap[blk->succs[i]];
+            for (int i = 0; i < blk->ninstrs; i++) {
+                SSAInstr* in = &f->instrs[blk->instrs[i]];
+                in->block = b;
+                if (in->target[0] >= 0) in->target[0] = remap[in->target[0]];
+                if (in->target[1] >= 0) in->target[1] = remap[in->target[1]];
+            }
+        }
+        f->entry = remap[f->entry];
+        free(remap);
+    }
+    free(reach);
+    free(stack);
+    return removed;
+}
+
+// Sweeps tombstoned instructions out of the block lists and resolves forwarded operands.
+void ssa_compact(SSAFunction* f) {
+    for (int b = 0; b < f->nblocks; b++) {
+        SSABlock* blk = &f->blocks[b];
+        int n = 0;
+        for (int i = 0; i < blk->ninstrs; i++) {
+            int id = blk->instrs[i];
+            if (f->instrs[id].dead) continue;
+            SSAInstr* in = &f->instrs[id];
+            for (int a = 0; a < in->nargs; a++) in->args[a] = ssa_resolve(f, in->args[a]);
+            blk->instrs[n++] = id;
+        }
+        blk->ninstrs = n;
+    }
+}
+
+// Phis can become trivial once their operands are forwarded; iterate to a fixpoint.
+static void ssa_remove_trivial_phis(SSAFunction* f) {
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int b = 0; b < f->nblocks; b++) {
+            SSABlock* blk = &f->blocks[b];
+            for (int i = 0; i < blk->ninstrs; i++) {
+                int id = blk->instrs[i];
+                if (f->instrs[id].op != SSA_PHI) break;
+                if (f->instrs[id].dead) continue;
+                if (ssa_try_remove_trivial_phi(f, id) != id) changed = 1;
+            }
+        }
+    }
+}
+
+typedef struct {
+    char (*names)[32];
+    int* owner;     // first function mentioning the name
+    int* shared;    // mentioned by more than one function
+    int count;
+    int cap;
+} SSANameSet;
+
+static void ssa_note_name(SSANameSet* set, const char* name, int owner) {
+    for (int i = 0; i < set->count; i++) {
+        if (strcmp(set->names[i], name) == 0) {
+            if (set->owner[i] != owner) set->shared[i] = 1;
+            return;
+        }
+    }
+    if (set->count == set->cap) {
+        set->cap = set->cap ? set->cap * 2 : 32;
+        set->names = ssa_xrealloc(set->names, set->cap * sizeof(*set->names));
+        set->owner = ssa_xrealloc(set->owner, set->cap * sizeof(int));
+        set->shared = ssa_xrealloc(set->shared, set->cap * sizeof(int));
+    }
+    snprintf(set->names[set->count], 32, "%s", name);
+    set->owner[set->count] = owner;
+    set->shared[set->count] = 0;
+    set->count++;
+}
+
+static int ssa_is_param(ASTNode* func, const char* name) {
+    for (int i = 0; i < func->kid_count; i++)
+        if (strcmp(func->kids[i]->name, name) == 0) return 1;
+    return 0;
+}
+
+static void ssa_collect_names(SSANameSet* set, ASTNode* func, ASTNode* n, int owner) {
+    if (!n) return;
+    // parameters shadow globals inside their function
+    if ((n->kind == AST_VAR || n->kind == AST_ASSIGN || n->kind == AST_FOR) && !ssa_is_param(func, n->name))
+        ssa_note_name(set, n->name, owner);
+    ssa_collect_names(set, func, n->lhs, owner);
+    ssa_collect_names(set, func, n->rhs, owner);
+    ssa_collect_names(set, func, n->els, owner);
+    for (int i = 0; i < n->kid_count; i++) ssa_collect_names(set, func, n->kids[i], owner);
+}
+
+SSAFunction* ssa_build_function(SSAModule* m, ASTNode* func) {
+    SSABuilder sb;
+    sb.m = m;
+    sb.f = ssa_new_function(func->name);
+    SSAFunction* f = sb.f;
+    f->entry = ssa_new_block(f, "entry");
+    f->blocks[f->entry].sealed = 1;
+    sb.cur = f->entry;
+
+    f->param_count = func->kid_count;
+    for (int i = 0; i < func->kid_count; i++) {
+        int p = ssa_emit(&sb, SSA_PARAM);
+        f->instrs[p].imm = i;
+        ssa_write_var(f, ssa_var_index(f, func->kids[i]->name), f->entry, p);
+    }
+
+    ssa_build_block(&sb, func->rhs);
+    if (ssa_terminator(f, sb.cur) < 0)
+        ssa_emit(&sb, strcmp(f->name, "main") == 0 ? SSA_HALT : SSA_RET);
+    for (int b = 0; b < f->nblocks; b++)
+        if (ssa_terminator(f, b) < 0) {
+            sb.cur = b;
+            ssa_emit(&sb, SSA_RET);
+        }
+
+    ssa_remove_trivial_phis(f);
+    ssa_remove_unreachable(f);
+    ssa_compact(f);
+
+    free(f->defs.keys);
+    free(f->defs.vals);
+    memset(&f->defs, 0, sizeof(f->defs));
+    return f;
+}
+
+// Top-level statements become `main`; names shared between functions live in memory.
+SSAModule* ssa_build_module(ASTNode* program) {
+    SSAModule* m = calloc(1, sizeof(SSAModule));
+    ASTNode* main_fn = ast_func("main");
+    int nfuncs = 0;
+    ASTNode** funcs = malloc((program->kid_count + 1) * sizeof(ASTNode*));
+
+    for (int i = 0; i < program->kid_count; i++) {
+        ASTNode* s = program->kids[i];
+        if (s->kind == AST_FUNC) funcs[nfuncs++] = s;
+        else ast_add_kid(main_fn->rhs, s);
+    }
+    funcs[nfuncs++] = main_fn;
+
+    // a name is global when more than one function mentions it
+    SSANameSet set;
+    memset(&set, 0, sizeof(set));
+    for (int i = 0; i < nfuncs; i++) ssa_collect_names(&set, funcs[i], funcs[i]->rhs, i);
+    for (int g = 0; g < set.count; g++) {
+        if (!set.shared[g]) continue;
+        if (m->nglobals == m->global_cap) {
+            m->global_cap = m->global_cap ? m->global_cap * 2 : 8;
+            m->globals = ssa_xrealloc(m->globals, m->global_cap * sizeof(*m->globals));
+        }
+        snprintf(m->globals[m->nglobals++], 32, "%s", set.names[g]);
+    }
+    free(set.names);
+    free(set.owner);
+    free(set.shared);
+
+    for (int i = 0; i < nfuncs; i++) {
+        if (m->nfuncs == m->func_cap) {
+            m->func_cap = m->func_cap ? m->func_cap * 2 : 8;
+            m->funcs = ssa_xrealloc(m->funcs, m->func_cap * sizeof(SSAFunction*));
+        }
+        m->funcs[m->nfuncs++] = ssa_build_function(m, funcs[i]);
+    }
+
+    // main_fn only borrowed the top-level statements
+    main_fn->rhs->kid_count = 0;
+    ast_free(main_fn);
+    free(funcs);
+    return m;
+}
+
+// === Out of SSA ===
+
+static int ssa_new_copy(SSAFunction* f, int block, int dst, int src) {
+    int c = ssa_new_instr(f, SSA_COPY, block);
+    f->instrs[c].dst = dst < 0 ? c : dst;
+    f->instrs[c].is_float = f->instrs[src].is_float;
+    f->instrs[c].lanes = f->instrs[src].lanes;
+    ssa_add_arg(f, c, src);
+    return c;
+}
+
+typedef struct {
+    int* keys;      // vreg ids
+    int* loc;       // where the value originally held by keys[i] lives now, -1 if unneeded
+    int* pred;      // source vreg copied into keys[i], -1 if keys[i] is not a destination
+    int n;
+} SSACopyMap;
+
+static int ssa_copy_slot(SSACopyMap* m, int v) {
+    for (int i = 0; i < m->n; i++)
+        if (m->keys[i] == v) return i;
+    m->keys[m->n] = v;
+    m->loc[m->n] = -1;
+    m->pred[m->n] = -1;
+    return m->n++;
+}
+
+// Inserts `dst[i] <- src[i]` (all reads before any write) before the terminator of `block`.
+// Boissinot et al.: emit copies whose destination is no longer needed as a source first,
+// then break each remaining cycle with a single temporary.
+static void ssa_sequentialize_copies(SSAFunction* f, int block, int* dst, int* src, int n) {
+    SSACopyMap m;
+    m.keys = malloc(n * 2 * sizeof(int));
+    m.loc = malloc(n * 2 * sizeof(int));
+    m.pred = malloc(n * 2 * sizeof(int));
+    m.n = 0;
+    int* ready = malloc(n * sizeof(int));
+    int* todo = malloc(n * sizeof(int));
+    int nready = 0, ntodo = 0;
+    int pos = f->blocks[block].ninstrs - (ssa_terminator(f, block) >= 0 ? 1 : 0);
+
+    for (int i = 0; i < n; i++) {
+        if (dst[i] == src[i]) continue;
+        ssa_copy_slot(&m, dst[i]);
+        ssa_copy_slot(&m, src[i]);
+    }
+    for (int i = 0; i < n; i++) {
+        if (dst[i] == src[i]) continue;
+        m.loc[ssa_copy_slot(&m, src[i])] = src[i];
+        m.pred[ssa_copy_slot(&m, dst[i])] = src[i];
+        todo[ntodo++] = dst[i];
+    }
+    for (int i = 0; i < ntodo; i++)
+        if (m.loc[ssa_copy_slot(&m, todo[i])] < 0) ready[nready++] = todo[i];
+
+    while (ntodo) {
+        while (nready) {
+            int b = ready[--nready];
+            int a = m.pred[ssa_copy_slot(&m, b)];
+            int c = m.loc[ssa_copy_slot(&m, a)];
+            ssa_insert_at(f, block, pos++, ssa_new_copy(f, block, b, c));
+            m.loc[ssa_copy_slot(&m, a)] = b;
+            if (a == c && m.pred[ssa_copy_slot(&m, a)] >= 0) ready[nready++] = a;
+        }
+        int b = todo[--ntodo];
+        int slot = ssa_copy_slot(&m, b);
+        if (m.loc[slot] == b) {
+            int tmp = ssa_new_copy(f, block, -1, b);
+            ssa_insert_at(f, block, pos++, tmp);
+            m.loc[slot] = tmp;
+            ready[nready++] = b;
+        }
+    }
+    free(m.keys); free(m.loc); free(m.pred); free(ready); free(todo);
+}
+
+static void ssa_split_critical_edges(SSAFunction* f) {
+    int nblocks = f->nblocks;
+    for (int b = 0; b < nblocks; b++) {
+        if (f->blocks[b].npreds < 2) continue;
+        if (f->blocks[b].ninstrs == 0 || f->instrs[f->blocks[b].instrs[0]].op != SSA_PHI) continue;
+        for (int k = 0; k < f->blocks[b].npreds; k++) {
+            int p = f->blocks[b].preds[k];
+            if (f->blocks[p].nsuccs < 2) continue;
+            int mid = ssa_new_block(f, "split");
+            f->blocks[mid].sealed = 1;
+            int j = ssa_new_instr(f, SSA_JMP, mid);
+            f->instrs[j].target[0] = b;
+            ssa_append(f, mid, j);
+            int t = ssa_terminator(f, p);
+            for (int s = 0; s < 2; s++)
+                if (f->instrs[t].target[s] == b) { f->instrs[t].target[s] = mid; break; }
+            for (int s = 0; s < f->blocks[p].nsuccs; s++)
+                if (f->blocks[p].succs[s] == b) { f->blocks[p].succs[s] = mid; break; }
+            f->blocks[b].preds[k] = mid;
+            ssa_push(&f->blocks[mid].preds, &f->blocks[mid].npreds, &f->blocks[mid].pred_cap, p);
+            ssa_push(&f->blocks[mid].succs, &f->blocks[mid].nsuccs, &f->blocks[mid].succ_cap, b);
+        }
+    }
+}
+
+// Replaces every phi by copies at the end of its predecessors; vregs are then instr dsts.
+void ssa_destruct(SSAFunction* f) {
+    if (!f->in_ssa) return;
+    ssa_split_critical_edges(f);
+    for (int b = 0; b < f->nblocks; b++) {
+        SSABlock* blk = &f->blocks[b];
+        int nphi = 0;
+        while (nphi < blk->ninstrs && f->instrs[blk->instrs[nphi]].op == SSA_PHI) nphi++;
+        if (!nphi) continue;
+        int* dst = malloc(nphi * sizeof(int));
+        int* src = malloc(nphi * sizeof(int));
+        for (int k = 0; k < f->blocks[b].npreds; k++) {
+            for (int i = 0; i < nphi; i++) {
+                SSAInstr* phi = &f->instrs[f->blocks[b].instrs[i]];
+                dst[i] = phi->dst;
+                src[i] = phi->args[k];
+            }
+            ssa_sequentialize_copies(f, f->blocks[b].preds[k], dst, src, nphi);
+        }
+        for (int i = 0; i < nphi; i++) f->instrs[f->blocks[b].instrs[i]].dead = 1;
+        free(dst);
+        free(src);
+    }
+    ssa_compact(f);
+    f->in_ssa = 0;
+}
+
+// === Dump ===
+
+void ssa_dump(FILE* out, SSAFunction* f) {
+    fprintf(out, "func %s(%d params)%s\n", f->name, f->param_count, f->in_ssa ? " [ssa]" : "");
+    for (int b = 0; b < f->nblocks; b++) {
+        SSABlock* blk = &f->blocks[b];
+        fprintf(out, "%s:   ; preds:", blk->label);
+        for (int i = 0; i < blk->npreds; i++) fprintf(out, " %s", f->blocks[blk->preds[i]].label);
+        fprintf(out, "  succs:");
+        for (int i = 0; i < blk->nsuccs; i++) fprintf(out, " %s", f->blocks[blk->succs[i]].label);
+        if (f->profiled && blk->count >= 0) fprintf(out, "  count: %lld%s", blk->count, blk->count ? "" : " (cold)");
+        fprintf(out, "\n");
+        for (int i = 0; i < blk->ninstrs; i++) {
+            SSAInstr* in = &f->instrs[blk->instrs[i]];
+            fprintf(out, "    ");
+            if (ssa_has_value(in->op)) fprintf(out, "v%d = ", in->dst);
+            fprintf(out, "%s", ssa_op_names[in->op]);
+            if (in->lanes) fprintf(out, ".%d", in->lanes);
+            if (in->op == SSA_VOP || in->op == SSA_VREDUCE) fprintf(out, " %s", ssa_op_names[in->imm]);
+            if (in->op == SSA_CONST || in->op == SSA_PARAM || in->op == SSA_VEXTRACT || in->op == SSA_COUNT) fprintf(out, " %lld", in->imm);
+            if (in->op == SSA_FCONST) fprintf(out, " %g", in->fimm);
+            if (in->op == SSA_CALL && in->imm) fprintf(out, " tail");
+            if (in->op == SSA_SCONST) fprintf(out, " \"%s\"", in->str);
+            if (in->name[0]) fprintf(out, " @%s", in->name);
+            for (int a = 0; a < in->nargs; a++) {
+                fprintf(out, "%s v%d", a ? "," : "", in->args[a]);
+                if (in->op == SSA_PHI) fprintf(out, " [%s]", f->blocks[blk->preds[a]].label);
+            }
+            if (in->op == SSA_JMP) fprintf(out, " %s", f->blocks[in->target[0]].label);
+            if (in->op == SSA_BR) fprintf(out, ", %s, %s", f->blocks[in->target[0]].label, f->blocks[in->target[1]].label);
+            fprintf(out, "\n");
+        }
+    }
+}
+
+void ssa_free_function(SSAFunction* f) {
+    for (int i = 0; i < f->ninstrs; i++) {
+        free(f->instrs[i].args);
+        free(f->instrs[i].str);
+    }
+    for (int b = 0; b < f->nblocks; b++) {
+        free(f->blocks[b].instrs);
+        free(f->blocks[b].preds);
+        free(f->blocks[b].succs);
+        free(f->blocks[b].incomplete);
+    }
+    free(f->instrs);
+    free(f->blocks);
+    free(f->vars);
+    free(f->defs.keys);
+    free(f->defs.vals);
+    free(f);
+}
+
+void ssa_free_module(SSAModule* m) {
+    for (int i = 0; i < m->nfuncs; i++) ssa_free_function(m->funcs[i]);
+    free(m->funcs);
+    free(m->globals);
+    free(m->counters);
+    free(m);
+}
+
+// === Construction benchmark ===
+
+static double ssa_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Synthetic function body: assignment chains over 16 variables with nested if/while/for.
+static ASTNode* ssa_bench_body(int statements, int depth, unsigned* seed) {
+    ASTNode* block = ast_new(AST_BLOCK);
+    char a[8], b[8], c[8];
+    for (int i = 0; i < statements; i++) {
+        *seed = *seed * 1103515245u + 12345u;
+        unsigned r = *seed >> 16;
+        snprintf(a, sizeof(a), "v%u", r % 16);
+        snprintf(b, sizeof(b), "v%u", (r / 16) % 16);
+        snprintf(c, sizeof(c), "v%u", (r / 256) % 16);
+        if (depth < 4 && r % 23 == 0) {
+            int inner = 8 + r % 24;
+            ASTNode* cond = ast_binop("<", ast_var(a), ast_var(b));
+            ASTNode* els = r % 2 ? ssa_bench_body(inner / 2, depth + 1, seed) : NULL;
+            ast_add_kid(block, ast_if(cond, ssa_bench_body(inner, depth + 1, seed), els));
+            i += inner;
+        }
+        else if (depth < 4 && r % 37 == 0) {
+            int inner = 8 + r % 16;
+            ast_add_kid(block, ast_while(ast_binop("<", ast_var(a), ast_num(100)), ssa_bench_body(inner, depth + 1, seed)));
+            i += inner;
+        }
+        else if (depth < 4 && r % 41 == 0) {
+            int inner = 8 + r % 16;
+            ast_add_kid(block, ast_for("i", ast_var(b), ssa_bench_body(inner, depth + 1, seed)));
+            i += inner;
+        }
+        else {
+            ast_add_kid(block, ast_assign(a, ast_binop(r % 3 ? "+" : "*", ast_var(b), ast_var(c))));
+        }
+    }
+    return block;
+}
+
+void ssa_bench_construction(int statements) {
+    unsigned seed = 42;
+    ASTNode* program = ast_new(AST_PROGRAM);
+    ASTNode* fn = ast_func("bench");
+    char name[8];
+    for (int v = 0; v < 16; v++) {
+        snprintf(name, sizeof(name), "v%d", v);
+        ast_add_kid(fn, ast_var(name));
+    }
+    ast_free(fn->rhs);
+    fn->rhs = ssa_bench_body(statements, 0, &seed);
+    ast_add_kid(fn->rhs, ast_return(ast_var("v0")));
+    ast_add_kid(program, fn);
+
+    double t0 = ssa_now_ms();
+    SSAModule* m = ssa_build_module(program);
+    double t1 = ssa_now_ms();
+    SSAFunction* f = m->funcs[0];
+    int phis = 0, instrs = 0;
+    for (int b = 0; b < f->nblocks; b++) {
+        instrs += f->blocks[b].ninstrs;
+        for (int i = 0; i < f->blocks[b].ninstrs; i++)
+            if (f->instrs[f->blocks[b].instrs[i]].op == SSA_PHI) phis++;
+    }
+    int nblocks = f->nblocks;
+    double t2 = ssa_now_ms();
+    ssa_destruct(f);
+    double t3 = ssa_now_ms();
+
+    printf("[SSA-BENCH] %d statements -> %d blocks, %d instrs, %d phis\n", statements, nblocks, instrs, phis);
+    printf("[SSA-BENCH] construction %.3f ms (%.2f M instr/s), out-of-SSA %.3f ms\n",
+        t1 - t0, (t1 - t0) > 0 ? instrs / ((t1 - t0) * 1e3) : 0.0, t3 - t2);
+
+    ssa_free_module(m);
+    ast_free(program);
+}
+
+// === Constant folding ===
+
+// Values carry their own kind: is_float on a phi only reflects the operands seen when it was sealed.
+typedef struct {
+    long long i;
+    double f;
+    int is_float;
+    const char* s;      // SSA_SCONST payload when printed
+} SSAValue;
+
+static double ssa_as_double(SSAValue v) { return v.is_float ? v.f : (double)v.i; }
+
+static long long ssa_as_int(SSAValue v) {
+    if (!v.is_float) return v.i;
+    return v.f > -9.2e18 && v.f < 9.2e18 ? (long long)v.f : 0;
+}
+
+int ssa_is_foldable(SSAOp op) {
+    return op >= SSA_ADD && op <= SSA_GE;
+}
+
+// Evaluates a binary arithmetic or compare op; 0 when it is not one. Integer arithmetic wraps
+// and division follows the VM: x / 0 and x % 0 are 0, x / -1 negates, x % -1 is 0.
+static int ssa_fold_binop(SSAOp op, SSAValue a, SSAValue b, SSAValue* out) {
+    long long x = ssa_as_int(a), y = ssa_as_int(b);
+    double fx = ssa_as_double(a), fy = ssa_as_double(b);
+    int fcmp = a.is_float || b.is_float;
+    memset(out, 0, sizeof(*out));
+    switch (op) {
+    case SSA_ADD: out->i = (long long)((unsigned long long)x + (unsigned long long)y); return 1;
+    case SSA_SUB: out->i = (long long)((unsigned long long)x - (unsigned long long)y); return 1;
+    case SSA_MUL: out->i = (long long)((unsigned long long)x * (unsigned long long)y); return 1;
+    case SSA_DIV:
+        out->i = y == -1 ? (long long)(0 - (unsigned long long)x) : y ? x / y : 0;
+        return 1;
+    case SSA_MOD:
+        out->i = y && y != -1 ? x % y : 0;
+        return 1;
+    case SSA_FADD: out->f = fx + fy; break;
+    case SSA_FSUB: out->f = fx - fy; break;
+    case SSA_FMUL: out->f = fx * fy; break;
+    case SSA_FDIV: out->f = fx / fy; break;
+    case SSA_EQ: out->i = fcmp ? fx == fy : x == y; return 1;
+    case SSA_NE: out->i = fcmp ? fx != fy : x != y; return 1;
+    case SSA_LT: out->i = fcmp ? fx < fy : x < y; return 1;
+    case SSA_LE: out->i = fcmp ? fx <= fy : x <= y; return 1;
+    case SSA_GT: out->i = fcmp ? fx > fy : x > y; return 1;
+    case SSA_GE: out->i = fcmp ? fx >= fy : x >= y; return 1;
+    default: return 0;
+    }
+    out->is_float = 1;
+    return 1;
+}
+
+static int ssa_truthy(SSAValue v) { return v.is_float ? v.f != 0.0 : v.i != 0; }
+
+// === Sparse conditional constant propagation ===
+
+enum { SSA_LAT_TOP, SSA_LAT_CONST, SSA_LAT_BOTTOM };
+
+typedef struct {
+    int folded;             // values rewritten to constants
+    int branches;           // conditional branches turned into jumps
+    int blocks_removed;     // blocks proven unreachable
+    int swept;              // constants left without uses
+} SSASccpStats;
+
+typedef struct {
+    SSAFunction* f;
+    unsigned char* lat;
+    SSAValue* val;
+    int* use_start;             // users of value v: uses[use_start[v] .. use_start[v + 1])
+    int* uses;
+    unsigned char* block_exec;
+    int* edge_start;            // executable flag of pred slot k of block b: edge_exec[edge_start[b] + k]
+    unsigned char* edge_exec;
+    int* flow; int nflow; int flow_cap;     // (from, to) block pairs
+    int* work; int nwork; int work_cap;     // values whose lattice cell dropped
+} SSASccp;
+
+static int ssa_same_value(SSAValue a, SSAValue b) {
+    if (a.is_float != b.is_float) return 0;
+    return a.is_float ? memcmp(&a.f, &b.f, sizeof(double)) == 0 : a.i == b.i;
+}
+
+static void ssa_sccp_set(SSASccp* s, int v, int lat, SSAValue val) {
+    if (lat == SSA_LAT_CONST && s->lat[v] == SSA_LAT_CONST && !ssa_same_value(val, s->val[v]))
+        lat = SSA_LAT_BOTTOM;
+    if (lat <= s->lat[v]) return;
+    s->lat[v] = (unsigned char)lat;
+    s->val[v] = val;
+    ssa_push(&s->work, &s->nwork, &s->work_cap, v);
+}
+
+static void ssa_sccp_edge(SSASccp* s, int from, int to) {
+    ssa_push(&s->flow, &s->nflow, &s->flow_cap, from);
+    ssa_push(&s->flow, &s->nflow, &s->flow_cap, to);
+}
+
+static void ssa_sccp_visit(SSASccp* s, int id) {
+    SSAFunction* f = s->f;
+    SSAInstr* in = &f->instrs[id];
+    if (!s->block_exec[in->block]) return;
+    SSAValue r;
+    memset(&r, 0, sizeof(r));
+    int lat = SSA_LAT_BOTTOM;
+
+    switch (in->op) {
+    case SSA_CONST:
+        lat = SSA_LAT_CONST;
+        r.i = in->imm;
+        break;
+    case SSA_FCONST:
+        lat = SSA_LAT_CONST;
+        r.f = in->fimm;
+        r.is_float = 1;
+        break;
+    case SSA_COPY:
+        lat = s->lat[in->args[0]];
+        r = s->val[in->args[0]];
+        break;
+    case SSA_PHI: {
+        // meet over the operands whose incoming edge is known to execute
+        lat = SSA_LAT_TOP;
+        for (int k = 0; k < in->nargs && lat != SSA_LAT_BOTTOM; k++) {
+            int a = in->args[k];
+            if (!s->edge_exec[s->edge_start[in->block] + k] || s->lat[a] == SSA_LAT_TOP) continue;
+            if (s->lat[a] == SSA_LAT_BOTTOM) lat = SSA_LAT_BOTTOM;
+            else if (lat == SSA_LAT_TOP) { lat = SSA_LAT_CONST; r = s->val[a]; }
+            else if (!ssa_same_value(r, s->val[a])) lat = SSA_LAT_BOTTOM;
+        }
+        break;
+    }
+    case SSA_JMP:
+        ssa_sccp_edge(s, in->block, in->target[0]);
+        return;
+    case SSA_BR: {
+        int c = in->args[0];
+        if (s->lat[c] == SSA_LAT_TOP) return;
+        if (s->lat[c] == SSA_LAT_CONST) {
+            ssa_sccp_edge(s, in->block, in->target[ssa_truthy(s->val[c]) ? 0 : 1]);
+        }
+        else {
+            ssa_sccp_edge(s, in->block, in->target[0]);
+            ssa_sccp_edge(s, in->block, in->target[1]);
+        }
+        return;
+    }
+    case SSA_STORE: case SSA_PRINT: case SSA_COUNT: case SSA_RET: case SSA_HALT:
+        return;
+    default:
+        if (ssa_is_foldable(in->op)) {
+            int a = in->args[0], b = in->args[1];
+            int la = s->lat[a], lb = s->lat[b];
+            if (in->op == SSA_MUL && ((la == SSA_LAT_CONST && !s->val[a].is_float && s->val[a].i == 0) ||
+                                      (lb == SSA_LAT_CONST && !s->val[b].is_float && s->val[b].i == 0)))
+                lat = SSA_LAT_CONST;        // x * 0 whatever x is
+            else if (la == SSA_LAT_BOTTOM || lb == SSA_LAT_BOTTOM) lat = SSA_LAT_BOTTOM;
+            else if (la == SSA_LAT_TOP || lb == SSA_LAT_TOP) lat = SSA_LAT_TOP;
+            else lat = ssa_fold_binop(in->op, s->val[a], s->val[b], &r) ? SSA_LAT_CONST : SSA_LAT_BOTTOM;
+        }
+        break;
+    }
+    ssa_sccp_set(s, id, lat, r);
+}
+
+static void ssa_sccp_solve(SSASccp* s) {
+    SSAFunction* f = s->f;
+    s->block_exec[f->entry] = 1;
+    for (int i = 0; i < f->blocks[f->entry].ninstrs; i++) ssa_sccp_visit(s, f->blocks[f->entry].instrs[i]);
+
+    while (s->nflow || s->nwork) {
+        while (s->nflow) {
+            int to = s->flow[--s->nflow];
+            int from = s->flow[--s->nflow];
+            SSABlock* blk = &f->blocks[to];
+            int marked = 0;
+            for (int k = 0; k < blk->npreds; k++) {
+                if (blk->preds[k] != from || s->edge_exec[s->edge_start[to] + k]) continue;
+                s->edge_exec[s->edge_start[to] + k] = 1;
+                marked = 1;
+            }
+            if (!marked) continue;
+            int first_visit = !s->block_exec[to];
+            s->block_exec[to] = 1;
+            // a new edge only changes phis, unless the whole block just became live
+            for (int i = 0; i < blk->ninstrs; i++) {
+                int id = blk->instrs[i];
+                if (!first_visit && f->instrs[id].op != SSA_PHI) break;
+                ssa_sccp_visit(s, id);
+            }
+        }
+        while (s->nwork) {
+            int v = s->work[--s->nwork];
+            for (int u = s->use_start[v]; u < s->use_start[v + 1]; u++) ssa_sccp_visit(s, s->uses[u]);
+        }
+    }
+}
+
+// Rewrites values the solver proved constant, resolves branches on constant conditions,
+// then drops the blocks that became unreachable and the constants nothing uses any more.
+int ssa_sccp(SSAFunction* f, SSASccpStats* st) {
+    SSASccpStats local;
+    if (!st) st = &local;
+    memset(st, 0, sizeof(*st));
+    if (!f->in_ssa || f->entry < 0) return 0;
+    ssa_compact(f);
+
+    int n = f->ninstrs;
+    SSASccp s;
+    memset(&s, 0, sizeof(s));
+    s.f = f;
+    s.lat = calloc(n + 1, 1);
+    s.val = calloc(n + 1, sizeof(SSAValue));
+    s.use_start = calloc(n + 2, sizeof(int));
+    s.block_exec = calloc(f->nblocks, 1);
+    s.edge_start = malloc((f->nblocks + 1) * sizeof(int));
+    if (!s.lat || !s.val || !s.use_start || !s.block_exec || !s.edge_start) { perror("ssa_sccp"); exit(1); }
+
+    int nedges = 0;
+    for (int b = 0; b < f->nblocks; b++) { s.edge_start[b] = nedges; nedges += f->blocks[b].npreds; }
+    s.edge_start[f->nblocks] = nedges;
+    s.edge_exec = calloc(nedges + 1, 1);
+
+    // users of each value, counted then filled
+    int nuses = 0;
+    for (int b = 0; b < f->nblocks; b++)
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            SSAInstr* in = &f->instrs[f->blocks[b].instrs[i]];
+            for (int a = 0; a < in->nargs; a++) { s.use_start[in->args[a] + 1]++; nuses++; }
+        }
+    for (int v = 0; v < n; v++) s.use_start[v + 1] += s.use_start[v];
+    s.uses = malloc((nuses + 1) * sizeof(int));
+    int* fill = malloc((n + 1) * sizeof(int));
+    memcpy(fill, s.use_start, n * sizeof(int));
+    for (int b = 0; b < f->nblocks; b++)
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            int id = f->blocks[b].instrs[i];
+            SSAInstr* in = &f->instrs[id];
+            for (int a = 0; a < in->nargs; a++) s.uses[fill[in->args[a]]++] = id;
+        }
+    free(fill);
+
+    ssa_sccp_solve(&s);
+
+    int nblocks = f->nblocks;
+    for (int b = 0; b < nblocks; b++) {
+        if (!s.block_exec[b]) continue;
+        int nphi = 0;
+        while (nphi < f->blocks[b].ninstrs && f->instrs[f->blocks[b].instrs[nphi]].op == SSA_PHI) nphi++;
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            int id = f->blocks[b].instrs[i];
+            SSAInstr* in = &f->instrs[id];
+            if (id >= n || s.lat[id] != SSA_LAT_CONST || in->dead || in->op == SSA_CONST || in->op == SSA_FCONST) continue;
+            SSAOp op = s.val[id].is_float ? SSA_FCONST : SSA_CONST;
+            if (in->op == SSA_PHI) {
+                // phis stay at the head of the block, so the constant goes after them
+                int c = ssa_new_instr(f, op, b);
+                f->instrs[c].imm = s.val[id].i;
+                f->instrs[c].fimm = s.val[id].f;
+                f->instrs[c].is_float = s.val[id].is_float;
+                ssa_insert_at(f, b, nphi, c);
+                ssa_replace_all_uses(f, id, c);
+            }
+            else {
+                in->op = op;
+                in->imm = s.val[id].i;
+                in->fimm = s.val[id].f;
+                in->nargs = 0;
+                in->name[0] = '\0';
+            }
+            st->folded++;
+        }
+        int t = ssa_terminator(f, b);
+        if (t < 0 || f->instrs[t].op != SSA_BR || s.lat[f->instrs[t].args[0]] != SSA_LAT_CONST) continue;
+        SSAInstr* br = &f->instrs[t];
+        int taken = ssa_truthy(s.val[br->args[0]]) ? 0 : 1;
+        int keep = br->target[taken], drop = br->target[!taken];
+        br->op = SSA_JMP;
+        br->target[0] = keep;
+        br->target[1] = -1;
+        br->nargs = 0;
+        ssa_remove_succ(f, b, drop);
+        ssa_remove_pred(f, drop, ssa_pred_index(f, drop, b));
+        st->branches++;
+    }
+    free(s.lat); free(s.val); free(s.use_start); free(s.uses);
+    free(s.block_exec); free(s.edge_start); free(s.edge_exec);
+    free(s.flow); free(s.work);
+
+    st->blocks_removed = ssa_remove_unreachable(f);
+    ssa_remove_trivial_phis(f);
+    ssa_compact(f);
+
+    // folding leaves the original operands behind; constants have no operands, so one sweep suffices
+    int* used = calloc(f->ninstrs, sizeof(int));
+    for (int b = 0; b < f->nblocks; b++)
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            SSAInstr* in = &f->instrs[f->blocks[b].instrs[i]];
+            for (int a = 0; a < in->nargs; a++) used[in->args[a]] = 1;
+        }
+    for (int b = 0; b < f->nblocks; b++)
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            int id = f->blocks[b].instrs[i];
+            SSAOp op = f->instrs[id].op;
+            if (used[id] || (op != SSA_CONST && op != SSA_FCONST && op != SSA_SCONST && op != SSA_UNDEF)) continue;
+            f->instrs[id].dead = 1;
+            st->swept++;
+        }
+    free(used);
+    ssa_compact(f);
+    return st->folded + st->branches + st->blocks_removed + st->swept;
+}
+
+int ssa_sccp_module(SSAModule* m, SSASccpStats* st) {
+    SSASccpStats total, one;
+    memset(&total, 0, sizeof(total));
+    int changes = 0;
+    for (int i = 0; i < m->nfuncs; i++) {
+        changes += ssa_sccp(m->funcs[i], &one);
+        total.folded += one.folded;
+        total.branches += one.branches;
+        total.blocks_removed += one.blocks_removed;
+        total.swept += one.swept;
+    }
+    if (st) *st = total;
+    return changes;
+}
+
+// === Dominators ===
+
+// Reverse postorder of the blocks reachable from the entry; returns how many were numbered.
+int ssa_reverse_postorder(SSAFunction* f, int* order) {
+    int nb = f->nblocks;
+    unsigned char* seen = calloc(nb, 1);
+    int* stack = malloc(nb * sizeof(int));
+    int* next = malloc(nb * sizeof(int));
+    int sp = 0, n = nb;
+    seen[f->entry] = 1;
+    stack[sp] = f->entry;
+    next[sp++] = 0;
+    while (sp) {
+        int b = stack[sp - 1];
+        if (next[sp - 1] < f->blocks[b].nsuccs) {
+            int s = f->blocks[b].succs[next[sp - 1]++];
+            if (!seen[s]) { seen[s] = 1; stack[sp] = s; next[sp++] = 0; }
+        }
+        else {
+            order[--n] = b;         // postorder, filled from the back
+            sp--;
+        }
+    }
+    memmove(order, order + n, (nb - n) * sizeof(int));
+    free(seen);
+    free(stack);
+    free(next);
+    return nb - n;
+}
+
+// Cooper, Harvey & Kennedy's iterative algorithm: idom[entry] = entry, -1 for unreachable blocks.
+void ssa_dominators(SSAFunction* f, int* idom) {
+    int nb = f->nblocks;
+    int* order = malloc(nb * sizeof(int));
+    int* rpo = malloc(nb * sizeof(int));
+    int n = ssa_reverse_postorder(f, order);
+    for (int b = 0; b < nb; b++) { idom[b] = -1; rpo[b] = -1; }
+    for (int i = 0; i < n; i++) rpo[order[i]] = i;
+    idom[f->entry] = f->entry;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 1; i < n; i++) {
+            int b = order[i], dom = -1;
+            for (int k = 0; k < f->blocks[b].npreds; k++) {
+                int p = f->blocks[b].preds[k];
+                if (idom[p] < 0) continue;
+                if (dom < 0) { dom = p; continue; }
+                int x = p, y = dom;
+                while (x != y) {
+                    while (rpo[x] > rpo[y]) x = idom[x];
+                    while (rpo[y] > rpo[x]) y = idom[y];
+                }
+                dom = x;
+            }
+            if (idom[b] != dom) { idom[b] = dom; changed = 1; }
+        }
+    }
+    free(order);
+    free(rpo);
+}
+
+int ssa_dominates(const int* idom, int a, int b) {
+    while (b >= 0 && b != a && idom[b] != b) b = idom[b];
+    return b == a;
+}
+
+// === Global value numbering ===
+
+typedef struct {
+    int arith;          // redundant arithmetic and compares
+    int loads;          // loads of a value already loaded or stored
+    int consts;         // duplicate constants
+    int phis;           // phis merging the same values in the same block
+} SSAGvnStats;
+
+typedef struct {
+    int key;            // instruction describing the expression (a STORE stands for the load it forwards)
+    int leader;         // value number: the dominating instruction computing it
+    int epoch;          // memory state for loads
+    unsigned hash;
+    int next;
+} SSAGvnEntry;
+
+typedef struct {
+    SSAFunction* f;
+    int* vn;
+    int* heads; unsigned mask;
+    SSAGvnEntry* entries; int nentries; int entry_cap;
+} SSAGvn;
+
+static int ssa_is_commutative(SSAOp op) {
+    return op == SSA_ADD || op == SSA_MUL || op == SSA_FADD || op == SSA_FMUL || op == SSA_EQ || op == SSA_NE;
+}
+
+static SSAOp ssa_gvn_op(SSAInstr* in) { return in->op == SSA_STORE ? SSA_LOAD : in->op; }
+
+static int ssa_gvn_arg(SSAGvn* g, SSAInstr* in, int a) {
+    if (in->op == SSA_STORE) return -1;
+    return g->vn[ssa_resolve(g->f, in->args[a])];
+}
+
+static unsigned ssa_gvn_hash(SSAGvn* g, int id, int epoch) {
+    SSAInstr* in = &g->f->instrs[id];
+    SSAOp op = ssa_gvn_op(in);
+    unsigned h = 2166136261u ^ (unsigned)op;
+    if (op == SSA_CONST) h = (h ^ (unsigned)in->imm ^ (unsigned)(in->imm >> 32)) * 16777619u;
+    if (op == SSA_FCONST) { unsigned long long bits; memcpy(&bits, &in->fimm, sizeof(bits)); h = (h ^ (unsigned)bits ^ (unsigned)(bits >> 32)) * 16777619u; }
+    if (op == SSA_LOAD) {
+        for (const char* p = in->name; *p; p++) h = (h ^ (unsigned char)*p) * 16777619u;
+        h = (h ^ (unsigned)epoch) * 16777619u;
+    }
+    if (op == SSA_PHI) h = (h ^ (unsigned)in->block) * 16777619u;
+    if (op != SSA_LOAD && in->nargs == 2 && ssa_is_commutative(op)) {
+        int a = ssa_gvn_arg(g, in, 0), b = ssa_gvn_arg(g, in, 1);
+        h = (h ^ (unsigned)(a < b ? a : b)) * 16777619u;
+        h = (h ^ (unsigned)(a < b ? b : a)) * 16777619u;
+    }
+    else if (op != SSA_LOAD) {
+        for (int a = 0; a < in->nargs; a++) h = (h ^ (unsigned)ssa_gvn_arg(g, in, a)) * 16777619u;
+    }
+    return h;
+}
+
+static int ssa_gvn_same(SSAGvn* g, int x, int ex, int y, int ey) {
+    SSAInstr* a = &g->f->instrs[x];
+    SSAInstr* b = &g->f->instrs[y];
+    SSAOp op = ssa_gvn_op(a);
+    if (op != ssa_gvn_op(b) || (op != SSA_LOAD && a->is_float != b->is_float) || a->lanes != b->lanes) return 0;
+    switch (op) {
+    case SSA_CONST: return a->imm == b->imm;
+    case SSA_FCONST: return memcmp(&a->fimm, &b->fimm, sizeof(double)) == 0;
+    case SSA_LOAD: return ex == ey && strcmp(a->name, b->name) == 0;
+    case SSA_PHI: if (a->block != b->block) return 0; break;
+    default: break;
+    }
+    if (a->nargs != b->nargs) return 0;
+    if (a->nargs == 2 && ssa_is_commutative(op)) {
+        int a0 = ssa_gvn_arg(g, a, 0), a1 = ssa_gvn_arg(g, a, 1);
+        int b0 = ssa_gvn_arg(g, b, 0), b1 = ssa_gvn_arg(g, b, 1);
+        return (a0 == b0 && a1 == b1) || (a0 == b1 && a1 == b0);
+    }
+    for (int i = 0; i < a->nargs; i++)
+        if (ssa_gvn_arg(g, a, i) != ssa_gvn_arg(g, b, i)) return 0;
+    return 1;
+}
+
+static int ssa_gvn_lookup(SSAGvn* g, int id, int epoch, unsigned h) {
+    for (int e = g->heads[h & g->mask]; e >= 0; e = g->entries[e].next)
+        if (g->entries[e].hash == h && ssa_gvn_same(g, g->entries[e].key, g->entries[e].epoch, id, epoch))
+            return g->entries[e].leader;
+    return -1;
+}
+
+static void ssa_gvn_insert(SSAGvn* g, int key, int leader, int epoch, unsigned h) {
+    if (g->nentries == g->entry_cap) {
+        g->entry_cap = g->entry_cap ? g->entry_cap * 2 : 256;
+        g->entries = ssa_xrealloc(g->entries, g->entry_cap * sizeof(SSAGvnEntry));
+    }
+    SSAGvnEntry* e = &g->entries[g->nentries];
+    e->key = key;
+    e->leader = leader;
+    e->epoch = epoch;
+    e->hash = h;
+    e->next = g->heads[h & g->mask];
+    g->heads[h & g->mask] = g->nentries++;
+}
+
+// Leaving a dominator subtree: its entries are always at the head of their bucket.
+static void ssa_gvn_pop(SSAGvn* g, int mark) {
+    while (g->nentries > mark) {
+        SSAGvnEntry* e = &g->entries[--g->nentries];
+        g->heads[e->hash & g->mask] = e->next;
+    }
+}
+
+static int ssa_gvn_candidate(SSAOp op) {
+    return op == SSA_CONST || op == SSA_FCONST || op == SSA_LOAD || op == SSA_PHI || ssa_is_foldable(op);
+}
+
+// Walks the dominator tree with a scoped table of available expressions, so a value is only
+// reused where its leader dominates it. Loads are keyed by a memory epoch that every store and
+// call advances; a block inherits its parent's epoch only when the parent is its sole predecessor.
+// With `rewrite` unset it only counts the redundancy.
+static void ssa_gvn_run(SSAFunction* f, int rewrite, SSAGvnStats* st) {
+    int nb = f->nblocks;
+    SSAGvn g;
+    memset(&g, 0, sizeof(g));
+    g.f = f;
+    g.vn = malloc((f->ninstrs + 1) * sizeof(int));
+    for (int i = 0; i < f->ninstrs; i++) g.vn[i] = i;
+    unsigned buckets = 64;
+    while (buckets < (unsigned)f->ninstrs) buckets <<= 1;
+    g.heads = malloc(buckets * sizeof(int));
+    for (unsigned i = 0; i < buckets; i++) g.heads[i] = -1;
+    g.mask = buckets - 1;
+
+    int* idom = malloc(nb * sizeof(int));
+    ssa_dominators(f, idom);
+    int* child_start = calloc(nb + 1, sizeof(int));
+    int* children = malloc(nb * sizeof(int));
+    for (int b = 0; b < nb; b++)
+        if (idom[b] >= 0 && b != f->entry) child_start[idom[b] + 1]++;
+    for (int b = 0; b < nb; b++) child_start[b + 1] += child_start[b];
+    int* fill = malloc((nb + 1) * sizeof(int));
+    memcpy(fill, child_start, nb * sizeof(int));
+    for (int b = 0; b < nb; b++)
+        if (idom[b] >= 0 && b != f->entry) children[fill[idom[b]]++] = b;
+    free(fill);
+
+    // explicit DFS over the dominator tree: (block, next child, table mark, epoch at block end)
+    int* stack = malloc(nb * 4 * sizeof(int));
+    int sp = 0, epochs = 0;
+    stack[0] = f->entry; stack[1] = -1; stack[2] = 0; stack[3] = 0;
+    sp = 1;
+    while (sp) {
+        int* top = &stack[(sp - 1) * 4];
+        int b = top[0];
+        if (top[1] < 0) {
+            int epoch = top[3];
+            SSABlock* blk = &f->blocks[b];
+            if (!(blk->npreds == 1 && blk->preds[0] == idom[b])) epoch = ++epochs;
+            for (int i = 0; i < blk->ninstrs; i++) {
+                int id = blk->instrs[i];
+                SSAInstr* in = &f->instrs[id];
+                if (in->dead) continue;
+                if (in->op == SSA_CALL) { epoch = ++epochs; continue; }
+                if (in->op == SSA_STORE) {
+                    epoch = ++epochs;
+                    ssa_gvn_insert(&g, id, g.vn[ssa_resolve(f, in->args[0])], epoch, ssa_gvn_hash(&g, id, epoch));
+                    continue;
+                }
+                if (!ssa_gvn_candidate(in->op)) continue;
+                unsigned h = ssa_gvn_hash(&g, id, epoch);
+                int leader = ssa_gvn_lookup(&g, id, epoch, h);
+                if (leader < 0) { ssa_gvn_insert(&g, id, id, epoch, h); continue; }
+                g.vn[id] = leader;
+                if (in->op == SSA_LOAD) st->loads++;
+                else if (in->op == SSA_PHI) st->phis++;
+                else if (in->op == SSA_CONST || in->op == SSA_FCONST) st->consts++;
+                else st->arith++;
+                if (rewrite) ssa_replace_all_uses(f, id, leader);
+            }
+            top[1] = child_start[b];
+            top[3] = epoch;
+        }
+        if (top[1] < child_start[b + 1]) {
+            int c = children[top[1]++];
+            int* next = &stack[sp * 4];
+            next[0] = c; next[1] = -1; next[2] = g.nentries; next[3] = top[3];
+            sp++;
+        }
+        else {
+            ssa_gvn_pop(&g, top[2]);
+            sp--;
+        }
+    }
+    free(stack); free(children); free(child_start); free(idom);
+    free(g.vn); free(g.heads); free(g.entries);
+    if (rewrite) {
+        ssa_remove_trivial_phis(f);
+        ssa_compact(f);
+    }
+}
+
+int ssa_gvn(SSAFunction* f, SSAGvnStats* st) {
+    SSAGvnStats local;
+    if (!st) st = &local;
+    memset(st, 0, sizeof(*st));
+    if (!f->in_ssa || f->entry < 0) return 0;
+    ssa_gvn_run(f, 1, st);
+    return st->arith + st->loads + st->consts + st->phis;
+}
+
+// Redundant arithmetic and loads GVN would remove, without touching the function.
+int ssa_count_redundant(SSAFunction* f) {
+    SSAGvnStats st;
+    memset(&st, 0, sizeof(st));
+    if (!f->in_ssa || f->entry < 0) return 0;
+    ssa_gvn_run(f, 0, &st);
+    return st.arith + st.loads;
+}
+
+int ssa_gvn_module(SSAModule* m, SSAGvnStats* st) {
+    SSAGvnStats total, one;
+    memset(&total, 0, sizeof(total));
+    int changes = 0;
+    for (int i = 0; i < m->nfuncs; i++) {
+        changes += ssa_gvn(m->funcs[i], &one);
+        total.arith += one.arith;
+        total.loads += one.loads;
+        total.consts += one.consts;
+        total.phis += one.phis;
+    }
+    if (st) *st = total;
+    return changes;
+}
+
+int ssa_count_redundant_module(SSAModule* m) {
+    int n = 0;
+    for (int i = 0; i < m->nfuncs; i++) n += ssa_count_redundant(m->funcs[i]);
+    return n;
+}
+
+// === Loops: LICM and induction-variable strength reduction ===
+
+typedef struct {
+    int header;
+    int preheader;
+    int latch;                  // the single back-edge source, -1 when there are several
+    unsigned char* in_loop;     // per block that existed when the loop was found
+    int nb;
+    int size;                   // blocks in the loop
+} SSALoop;
+
+typedef struct {
+    int loops;
+    int preheaders;             // preheader blocks created
+    int hoisted;                // invariant instructions moved to a preheader
+    int reduced;                // multiplies (and the adds fed by them) turned into induction variables
+} SSALoopStats;
+
+typedef struct {
+    int phi;                    // header phi carrying the value
+    int init;                   // value on entry from the preheader
+    int step;                   // loop-invariant increment per iteration
+    int derived;                // created by strength reduction
+} SSAIndVar;
+
+// Natural loops: one per header, the union of all back edges t -> h where h dominates t.
+static int ssa_find_loops(SSAFunction* f, const int* idom, SSALoop** out) {
+    int nb = f->nblocks, nloops = 0;
+    SSALoop* loops = NULL;
+    int* stack = malloc(nb * sizeof(int));
+    for (int h = 0; h < nb; h++) {
+        if (idom[h] < 0) continue;
+        SSALoop L;
+        memset(&L, 0, sizeof(L));
+        L.header = h;
+        L.preheader = -1;
+        L.latch = -1;
+        int latches = 0;
+        for (int k = 0; k < f->blocks[h].npreds; k++) {
+            int t = f->blocks[h].preds[k];
+            if (idom[t] < 0 || !ssa_dominates(idom, h, t)) continue;
+            if (!L.in_loop) {
+                L.in_loop = calloc(nb, 1);
+                L.nb = nb;
+                L.in_loop[h] = 1;
+                L.size = 1;
+            }
+            if (L.latch != t) latches++;
+            L.latch = t;
+            int sp = 0;
+            if (!L.in_loop[t]) { L.in_loop[t] = 1; L.size++; stack[sp++] = t; }
+            while (sp) {
+                int b = stack[--sp];
+                for (int q = 0; q < f->blocks[b].npreds; q++) {
+                    int p = f->blocks[b].preds[q];
+                    if (idom[p] < 0 || L.in_loop[p]) continue;
+                    L.in_loop[p] = 1;
+                    L.size++;
+                    stack[sp++] = p;
+                }
+            }
+        }
+        if (!L.in_loop) continue;
+        if (latches > 1) L.latch = -1;
+        loops = ssa_xrealloc(loops, (nloops + 1) * sizeof(SSALoop));
+        loops[nloops++] = L;
+    }
+    free(stack);
+    *out = loops;
+    return nloops;
+}
+
+// Blocks added after the loop was found (preheaders) are outside it.
+static int ssa_loop_has(const SSALoop* L, int block) {
+    return block < L->nb && L->in_loop[block];
+}
+
+static void ssa_free_loops(SSALoop* loops, int nloops) {
+    for (int i = 0; i < nloops; i++) free(loops[i].in_loop);
+    free(loops);
+}
+
+// Gives the loop a block that is the single entry edge into the header. Header phi operands
+// from outside the loop move there, merged by a new phi when there was more than one.
+static int ssa_make_preheader(SSAFunction* f, SSALoop* L) {
+    int h = L->header;
+    int outside = 0, only = -1;
+    for (int k = 0; k < f->blocks[h].npreds; k++)
+        if (!ssa_loop_has(L, f->blocks[h].preds[k])) { outside++; only = f->blocks[h].preds[k]; }
+    if (outside == 1 && f->blocks[only].nsuccs == 1) {
+        L->preheader = only;
+        return 0;
+    }
+
+    int pre = ssa_new_block(f, "preheader");
+    f->blocks[pre].sealed = 1;
+    int* slots = malloc(f->blocks[h].npreds * sizeof(int));
+    int nslots = 0;
+    for (int k = 0; k < f->blocks[h].npreds; k++)
+        if (!ssa_loop_has(L, f->blocks[h].preds[k])) slots[nslots++] = k;
+    for (int s = 0; s < nslots; s++) {
+        int p = f->blocks[h].preds[slots[s]];
+        ssa_push(&f->blocks[pre].preds, &f->blocks[pre].npreds, &f->blocks[pre].pred_cap, p);
+    }
+
+    // one incoming value per header phi, computed before the slots go away
+    int nphi = 0;
+    while (nphi < f->blocks[h].ninstrs && f->instrs[f->blocks[h].instrs[nphi]].op == SSA_PHI) nphi++;
+    int* incoming = malloc((nphi + 1) * sizeof(int));
+    for (int i = 0; i < nphi; i++) {
+        int phi = f->blocks[h].instrs[i];
+        int same = f->instrs[phi].args[slots[0]];
+        for (int s = 1; s < nslots; s++)
+            if (f->instrs[phi].args[slots[s]] != same) same = -1;
+        if (same >= 0) { incoming[i] = same; continue; }
+        int merge = ssa_new_phi(f, pre);
+        phi = f->blocks[h].instrs[i];
+        f->instrs[merge].is_float = f->instrs[phi].is_float;
+        for (int s = 0; s < nslots; s++) ssa_add_arg(f, merge, f->instrs[phi].args[slots[s]]);
+        incoming[i] = merge;
+    }
+    int j = ssa_new_instr(f, SSA_JMP, pre);
+    f->instrs[j].target[0] = h;
+    ssa_append(f, pre, j);
+
+    for (int s = nslots - 1; s >= 0; s--) {
+        int p = f->blocks[h].preds[slots[s]];
+        int t = ssa_terminator(f, p);
+        for (int x = 0; x < 2; x++)
+            if (t >= 0 && f->instrs[t].target[x] == h) f->instrs[t].target[x] = pre;
+        for (int x = 0; x < f->blocks[p].nsuccs; x++)
+            if (f->blocks[p].succs[x] == h) f->blocks[p].succs[x] = pre;
+        ssa_remove_pred(f, h, slots[s]);
+    }
+    ssa_push(&f->blocks[pre].succs, &f->blocks[pre].nsuccs, &f->blocks[pre].succ_cap, h);
+    ssa_push(&f->blocks[h].preds, &f->blocks[h].npreds, &f->blocks[h].pred_cap, pre);
+    for (int i = 0; i < nphi; i++) ssa_add_arg(f, f->blocks[h].instrs[i], incoming[i]);
+    free(incoming);
+    free(slots);
+    L->preheader = pre;
+    return 1;
+}
+
+static int ssa_in_loop(SSAFunction* f, const SSALoop* L, int value) {
+    return ssa_loop_has(L, f->instrs[value].block);
+}
+
+// Inserts `id` into `block` just before its terminator.
+static void ssa_insert_before_terminator(SSAFunction* f, int block, int id) {
+    int pos = f->blocks[block].ninstrs - (ssa_terminator(f, block) >= 0 ? 1 : 0);
+    ssa_insert_at(f, block, pos, id);
+}
+
+static int ssa_is_hoistable(SSAFunction* f, SSAInstr* in, int loop_calls, const SSALoop* L) {
+    if (in->op == SSA_CONST || in->op == SSA_FCONST || in->op == SSA_SCONST) return 1;
+    if (in->op == SSA_DIV || in->op == SSA_MOD) {
+        // hoisting must not create a division the loop would never have executed
+        SSAInstr* d = &f->instrs[in->args[1]];
+        return d->op == SSA_CONST && d->imm != 0 && d->imm != -1;
+    }
+    if (in->op == SSA_LOAD) {
+        if (loop_calls) return 0;
+        for (int b = 0; b < L->nb; b++) {
+            if (!ssa_loop_has(L, b)) continue;
+            for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+                SSAInstr* st = &f->instrs[f->blocks[b].instrs[i]];
+                if (st->op == SSA_STORE && strcmp(st->name, in->name) == 0) return 0;
+            }
+        }
+        return 1;
+    }
+    return ssa_is_foldable(in->op);
+}
+
+static void ssa_licm_loop(SSAFunction* f, SSALoop* L, const int* order, int norder, SSALoopStats* st) {
+    int calls = 0;
+    for (int b = 0; b < L->nb; b++) {
+        if (!ssa_loop_has(L, b)) continue;
+        for (int i = 0; i < f->blocks[b].ninstrs; i++)
+            if (f->instrs[f->blocks[b].instrs[i]].op == SSA_CALL) calls = 1;
+    }
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int o = 0; o < norder; o++) {
+            int b = order[o];
+            if (!ssa_loop_has(L, b)) continue;
+            for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+                int id = f->blocks[b].instrs[i];
+                SSAInstr* in = &f->instrs[id];
+                if (in->op == SSA_PHI || !ssa_is_hoistable(f, in, calls, L)) continue;
+                int invariant = 1;
+                for (int a = 0; a < in->nargs && invariant; a++)
+                    if (ssa_in_loop(f, L, in->args[a])) invariant = 0;
+                if (!invariant) continue;
+                SSABlock* blk = &f->blocks[b];
+                memmove(&blk->instrs[i], &blk->instrs[i + 1], (blk->ninstrs - i - 1) * sizeof(int));
+                blk->ninstrs--;
+                i--;
+                ssa_insert_before_terminator(f, L->preheader, id);
+                st->hoisted++;
+                changed = 1;
+            }
+        }
+    }
+}
+
+static int ssa_find_iv(SSAIndVar* ivs, int nivs, int value) {
+    for (int i = 0; i < nivs; i++)
+        if (ivs[i].phi == value) return i;
+    return -1;
+}
+
+// Adds a header phi running init, init + step, ... in lockstep with the loop's back edge.
+static int ssa_new_iv(SSAFunction* f, SSALoop* L, int init, int step) {
+    int h = L->header;
+    int phi = ssa_new_phi(f, h);
+    int next = ssa_new_instr(f, SSA_ADD, L->latch);
+    ssa_add_arg(f, next, phi);
+    ssa_add_arg(f, next, step);
+    ssa_insert_before_terminator(f, L->latch, next);
+    for (int k = 0; k < f->blocks[h].npreds; k++)
+        ssa_add_arg(f, phi, f->blocks[h].preds[k] == L->latch ? next : init);
+    return phi;
+}
+
+static int ssa_preheader_op(SSAFunction* f, SSALoop* L, SSAOp op, int a, int b) {
+    int v = ssa_new_instr(f, op, L->preheader);
+    ssa_add_arg(f, v, a);
+    ssa_add_arg(f, v, b);
+    ssa_insert_before_terminator(f, L->preheader, v);
+    return v;
+}
+
+// i = phi(init, i + step): i * k becomes its own induction variable stepping by step * k, and
+// base + (i * k) -- an array<T> element address -- a pointer bumped by the same stride.
+static void ssa_reduce_loop(SSAFunction* f, SSALoop* L, const int* order, int norder, SSALoopStats* st) {
+    int h = L->header;
+    if (L->latch < 0 || f->blocks[h].npreds != 2) return;
+    int pre_slot = f->blocks[h].preds[0] == L->preheader ? 0 : 1;
+    SSAIndVar* ivs = NULL;
+    int nivs = 0;
+    for (int i = 0; i < f->blocks[h].ninstrs; i++) {
+        SSAInstr* phi = &f->instrs[f->blocks[h].instrs[i]];
+        if (phi->op != SSA_PHI) break;
+        if (phi->is_float || phi->nargs != 2) continue;
+        SSAInstr* next = &f->instrs[phi->args[1 - pre_slot]];
+        if (next->op != SSA_ADD || next->is_float) continue;
+        int step = next->args[0] == f->blocks[h].instrs[i] ? next->args[1] : next->args[1] == f->blocks[h].instrs[i] ? next->args[0] : -1;
+        if (step < 0 || ssa_in_loop(f, L, step)) continue;
+        ivs = ssa_xrealloc(ivs, (nivs + 1) * sizeof(SSAIndVar));
+        ivs[nivs].phi = f->blocks[h].instrs[i];
+        ivs[nivs].init = phi->args[pre_slot];
+        ivs[nivs].step = step;
+        ivs[nivs].derived = 0;
+        nivs++;
+    }
+    if (!nivs) return;
+
+    // values read after the loop keep their last in-loop value, which a header phi does not hold
+    unsigned char* used_outside = calloc(f->ninstrs, 1);
+    for (int b = 0; b < f->nblocks; b++) {
+        if (ssa_loop_has(L, b)) continue;
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            SSAInstr* in = &f->instrs[f->blocks[b].instrs[i]];
+            for (int a = 0; a < in->nargs; a++) used_outside[in->args[a]] = 1;
+        }
+    }
+    int limit = f->ninstrs;
+    for (int o = 0; o < norder; o++) {
+        int b = order[o];
+        if (!ssa_loop_has(L, b)) continue;
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            int id = f->blocks[b].instrs[i];
+            if (id >= limit || used_outside[id]) continue;
+            SSAInstr* in = &f->instrs[id];
+            if (in->dead || in->is_float || (in->op != SSA_MUL && in->op != SSA_ADD)) continue;
+            int x = ssa_resolve(f, in->args[0]), y = ssa_resolve(f, in->args[1]);
+            int iv = ssa_find_iv(ivs, nivs, x);
+            int other = y;
+            if (iv < 0) { iv = ssa_find_iv(ivs, nivs, y); other = x; }
+            if (iv < 0 || ssa_in_loop(f, L, other)) continue;
+            SSAIndVar base = ivs[iv];
+            int init, step;
+            if (in->op == SSA_MUL) {
+                init = ssa_preheader_op(f, L, SSA_MUL, base.init, other);
+                step = ssa_preheader_op(f, L, SSA_MUL, base.step, other);
+            }
+            else {
+                // only addresses built on a reduced multiply; a plain i + x gains nothing
+                if (!base.derived) continue;
+                init = ssa_preheader_op(f, L, SSA_ADD, base.init, other);
+                step = base.step;
+            }
+            int phi = ssa_new_iv(f, L, init, step);
+            ssa_replace_all_uses(f, id, phi);
+            ivs = ssa_xrealloc(ivs, (nivs + 1) * sizeof(SSAIndVar));
+            ivs[nivs].phi = phi;
+            ivs[nivs].init = init;
+            ivs[nivs].step = step;
+            ivs[nivs].derived = 1;
+            nivs++;
+            st->reduced++;
+        }
+    }
+    free(used_outside);
+    free(ivs);
+    ssa_compact(f);
+}
+
+int ssa_optimize_loops(SSAFunction* f, SSALoopStats* st) {
+    SSALoopStats local;
+    if (!st) st = &local;
+    memset(st, 0, sizeof(*st));
+    if (!f->in_ssa || f->entry < 0) return 0;
+    ssa_compact(f);
+
+    // preheaders first: adding blocks invalidates the dominator tree
+    int* idom = malloc(f->nblocks * sizeof(int));
+    ssa_dominators(f, idom);
+    SSALoop* loops;
+    int nloops = ssa_find_loops(f, idom, &loops);
+    for (int i = 0; i < nloops; i++) st->preheaders += ssa_make_preheader(f, &loops[i]);
+    ssa_free_loops(loops, nloops);
+    free(idom);
+
+    idom = malloc(f->nblocks * sizeof(int));
+    int* order = malloc(f->nblocks * sizeof(int));
+    ssa_dominators(f, idom);
+    int norder = ssa_reverse_postorder(f, order);
+    nloops = ssa_find_loops(f, idom, &loops);
+    st->loops = nloops;
+    // innermost loops first, so invariants climb out one level at a time
+    for (int i = 1; i < nloops; i++)
+        for (int j = i; j > 0 && loops[j].size < loops[j - 1].size; j--) {
+            SSALoop t = loops[j]; loops[j] = loops[j - 1]; loops[j - 1] = t;
+        }
+    for (int i = 0; i < nloops; i++) {
+        ssa_make_preheader(f, &loops[i]);
+        ssa_licm_loop(f, &loops[i], order, norder, st);
+        ssa_reduce_loop(f, &loops[i], order, norder, st);
+    }
+    ssa_free_loops(loops, nloops);
+    free(idom);
+    free(order);
+    return st->preheaders + st->hoisted + st->reduced;
+}
+
+int ssa_optimize_loops_module(SSAModule* m, SSALoopStats* st) {
+    SSALoopStats total, one;
+    memset(&total, 0, sizeof(total));
+    int changes = 0;
+    for (int i = 0; i < m->nfuncs; i++) {
+        changes += ssa_optimize_loops(m->funcs[i], &one);
+        total.loops += one.loops;
+        total.preheaders += one.preheaders;
+        total.hoisted += one.hoisted;
+        total.reduced += one.reduced;
+    }
+    if (st) *st = total;
+    return changes;
+}
+
+// === Vectorization ===
+
+// Lanes of the 64-bit values the IR computes on per register: one xmm (SSE2), ymm (AVX2) or
+// zmm (AVX-512F/DQ/VL, which also has the packed 64-bit multiply the narrower ones emulate).
+typedef struct {
+    const char* name;
+    int lanes;
+} SSAVectorISA;
+
+static const SSAVectorISA ssa_vector_isas[] = {
+    { "sse2", 2 },
+    { "avx2", 4 },
+    { "avx512", 8 },
+};
+
+#define SSA_MAX_LANES 8
+
+// SSE2 is the x86-64 baseline; wider ISAs are opt-in (--vector-isa, or the widest --march has).
+const SSAVectorISA* ssa_vector_isa = &ssa_vector_isas[0];
+
+int ssa_set_vector_isa(const char* name) {
+    for (size_t i = 0; i < sizeof(ssa_vector_isas) / sizeof(ssa_vector_isas[0]); i++)
+        if (strcmp(ssa_vector_isas[i].name, name) == 0) { ssa_vector_isa = &ssa_vector_isas[i]; return 0; }
+    return -1;
+}
+
+typedef struct {
+    int annotated;          // loops carrying the vectorize keyword
+    int vectorized;
+    int refused;            // kept scalar, with a diagnostic saying why
+    int reductions;         // accumulators split across lanes
+} SSAVectorStats;
+
+enum { SSA_VEC_NONE, SSA_VEC_INDUCTION, SSA_VEC_REDUCTION, SSA_VEC_LAST, SSA_VEC_STEP, SSA_VEC_UPDATE };
+
+typedef struct {
+    SSAFunction* f;
+    SSALoop* L;
+    int body;               // the single body block, which is also the latch
+    int cmp;                // `iv < bound` in the header
+    int iv;
+    int bound;
+    int pre_slot;           // header predecessor slot of the preheader
+    int vbody;
+    int* role;              // SSA_VEC_* per instruction that existed when the plan was made
+    int* step;              // induction: step value; reduction: its update; last value: the value
+    int* uses;              // uses from inside the loop
+    int* vec;               // scalar value -> vector value, -1 until needed
+    int* vphi;              // induction -> its phi in the vector loop
+    char why[96];
+} SSAVecPlan;
+
+// Constants left in the body are as good as loop-invariant; ssa_vec_hoist() copies them out.
+static int ssa_vec_invariant(SSAFunction* f, const SSALoop* L, int v) {
+    return !ssa_in_loop(f, L, v) || f->instrs[v].op == SSA_CONST || f->instrs[v].op == SSA_FCONST;
+}
+
+// The shape the for-loop builder produces: a header holding phis, `iv < bound` and the branch,
+// one body block, and header phis that are inductions (p + invariant), reductions whose
+// accumulator feeds nothing but its own update, or values only read after the loop (the last
+// iteration's wins). Anything else is a loop-carried dependence.
+static int ssa_vector_legal(SSAVecPlan* p) {
+    SSAFunction* f = p->f;
+    SSALoop* L = p->L;
+    int h = L->header;
+    if (L->size != 2 || L->latch < 0 || L->latch == h) {
+        snprintf(p->why, sizeof(p->why), "control flow inside the loop body");
+        return 0;
+    }
+    p->body = L->latch;
+    if (f->blocks[h].npreds != 2) {
+        snprintf(p->why, sizeof(p->why), "more than one way into the loop");
+        return 0;
+    }
+    p->pre_slot = f->blocks[h].preds[0] == L->preheader ? 0 : 1;
+    int t = ssa_terminator(f, h);
+    if (t < 0 || f->instrs[t].op != SSA_BR || f->instrs[t].target[0] != p->body) {
+        snprintf(p->why, sizeof(p->why), "no exit test at the top of the loop");
+        return 0;
+    }
+    p->cmp = ssa_resolve(f, f->instrs[t].args[0]);
+    if (f->instrs[p->cmp].op != SSA_LT || f->instrs[p->cmp].block != h) {
+        snprintf(p->why, sizeof(p->why), "exit test is not `i < bound`, trip count unknown");
+        return 0;
+    }
+    p->iv = f->instrs[p->cmp].args[0];
+    p->bound = f->instrs[p->cmp].args[1];
+    if (!ssa_vec_invariant(f, L, p->bound)) {
+        snprintf(p->why, sizeof(p->why), "loop bound v%d changes inside the loop", p->bound);
+        return 0;
+    }
+    for (int i = 0; i < f->blocks[h].ninstrs; i++) {
+        int id = f->blocks[h].instrs[i];
+        if (f->instrs[id].op != SSA_PHI && id != p->cmp && id != t) {
+            snprintf(p->why, sizeof(p->why), "loop header computes v%d besides the exit test", id);
+            return 0;
+        }
+    }
+
+    for (int b = 0; b < L->nb; b++) {
+        if (!ssa_loop_has(L, b)) continue;
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            SSAInstr* in = &f->instrs[f->blocks[b].instrs[i]];
+            for (int a = 0; a < in->nargs; a++) p->uses[in->args[a]]++;
+        }
+    }
+
+    for (int i = 0; i < f->blocks[h].ninstrs; i++) {
+        int id = f->blocks[h].instrs[i];
+        SSAInstr* phi = &f->instrs[id];
+        if (phi->op != SSA_PHI) break;
+        int next = phi->args[1 - p->pre_slot];
+        SSAInstr* u = &f->instrs[next];
+        int own = u->nargs == 2 && (u->args[0] == id || u->args[1] == id);
+        int other = own ? u->args[u->args[0] == id ? 1 : 0] : -1;
+        if (u->block == p->body && u->op == SSA_ADD && own && other != id && ssa_vec_invariant(f, L, other)) {
+            p->role[id] = SSA_VEC_INDUCTION;
+            p->role[next] = SSA_VEC_STEP;
+            p->step[id] = other;
+        }
+        else if (u->block == p->body && own && p->uses[id] == 1 && p->uses[next] == 1 &&
+                 (u->op == SSA_ADD || u->op == SSA_MUL || (u->op == SSA_SUB && u->args[0] == id))) {
+            p->role[id] = SSA_VEC_REDUCTION;
+            p->role[next] = SSA_VEC_UPDATE;
+            p->step[id] = next;
+        }
+        else if (p->uses[id] == 0 && (u->block == p->body || ssa_vec_invariant(f, L, next))) {
+            p->role[id] = SSA_VEC_LAST;
+            p->step[id] = next;
+        }
+        else if (own && (u->op == SSA_FADD || u->op == SSA_FSUB || u->op == SSA_FMUL)) {
+            snprintf(p->why, sizeof(p->why), "float reduction through v%d would be reassociated", id);
+            return 0;
+        }
+        else {
+            snprintf(p->why, sizeof(p->why), "loop-carried dependence through v%d", id);
+            return 0;
+        }
+    }
+    if (p->role[p->iv] != SSA_VEC_INDUCTION || f->instrs[p->step[p->iv]].op != SSA_CONST || f->instrs[p->step[p->iv]].imm <= 0) {
+        snprintf(p->why, sizeof(p->why), "exit test is not on an induction variable with a positive constant step");
+        return 0;
+    }
+    int lanes = ssa_vector_isa->lanes;
+    SSAInstr* init = &f->instrs[f->instrs[p->iv].args[p->pre_slot]];
+    SSAInstr* bound = &f->instrs[p->bound];
+    if (init->op == SSA_CONST && bound->op == SSA_CONST) {
+        long long s = f->instrs[p->step[p->iv]].imm;
+        long long trips = bound->imm > init->imm ? (bound->imm - init->imm + s - 1) / s : 0;
+        if (trips < lanes) {
+            snprintf(p->why, sizeof(p->why), "trip count %lld is below the %d-lane vector width", trips, lanes);
+            return 0;
+        }
+    }
+
+    SSABlock* blk = &f->blocks[p->body];
+    for (int i = 0; i < blk->ninstrs - 1; i++) {
+        int id = blk->instrs[i];
+        SSAInstr* in = &f->instrs[id];
+        for (int a = 0; a < in->nargs; a++)
+            if (in->args[a] == p->cmp) {
+                snprintf(p->why, sizeof(p->why), "exit test v%d is used in the loop body", p->cmp);
+                return 0;
+            }
+        switch (in->op) {
+        case SSA_CONST: case SSA_FCONST: case SSA_COPY:
+            break;
+        case SSA_DIV: case SSA_MOD:
+            snprintf(p->why, sizeof(p->why), "integer %s has no packed %s form", ssa_op_names[in->op], ssa_vector_isa->name);
+            return 0;
+        case SSA_LOAD: case SSA_STORE:
+            snprintf(p->why, sizeof(p->why), "%s of @%s in the loop body", ssa_op_names[in->op], in->name);
+            return 0;
+        case SSA_CALL:
+            snprintf(p->why, sizeof(p->why), "call to %s in the loop body", in->name);
+            return 0;
+        default:
+            if (!ssa_is_foldable(in->op)) {
+                snprintf(p->why, sizeof(p->why), "%s in the loop body", ssa_op_names[in->op]);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static int ssa_vec_new(SSAFunction* f, SSAOp op, int block, int a, int b, int lanes) {
+    int v = ssa_new_instr(f, op, block);
+    ssa_add_arg(f, v, a);
+    if (b >= 0) ssa_add_arg(f, v, b);
+    f->instrs[v].lanes = lanes;
+    f->instrs[v].is_float = f->instrs[a].is_float;
+    return v;
+}
+
+static int ssa_vec_const(SSAFunction* f, int block, long long k) {
+    int c = ssa_new_instr(f, SSA_CONST, block);
+    f->instrs[c].imm = k;
+    ssa_insert_before_terminator(f, block, c);
+    return c;
+}
+
+// A loop-invariant value the vector loop can read: itself, or a preheader copy of a body constant.
+static int ssa_vec_hoist(SSAVecPlan* p, int v) {
+    SSAFunction* f = p->f;
+    int pre = p->L->preheader;
+    if (!ssa_in_loop(f, p->L, v)) return v;
+    int c = ssa_new_instr(f, f->instrs[v].op, pre);
+    f->instrs[c].imm = f->instrs[v].imm;
+    f->instrs[c].fimm = f->instrs[v].fimm;
+    f->instrs[c].is_float = f->instrs[v].is_float;
+    ssa_insert_before_terminator(f, pre, c);
+    return c;
+}
+
+// Vector form of a value read by the vector body: inductions become base + lane * step, anything
+// computed outside the loop (and constants inside it) is broadcast once in the preheader.
+static int ssa_vec_value(SSAVecPlan* p, int v) {
+    SSAFunction* f = p->f;
+    int pre = p->L->preheader, lanes = ssa_vector_isa->lanes;
+    if (p->vec[v] >= 0) return p->vec[v];
+    if (p->role[v] == SSA_VEC_INDUCTION) {
+        int r = ssa_vec_new(f, SSA_VIOTA, p->vbody, p->vphi[v], p->step[v], lanes);
+        ssa_append(f, p->vbody, r);
+        return p->vec[v] = r;
+    }
+    int r = ssa_vec_new(f, SSA_VSPLAT, pre, ssa_vec_hoist(p, v), -1, lanes);
+    ssa_insert_before_terminator(f, pre, r);
+    return p->vec[v] = r;
+}
+
+// Puts a vector copy of the loop in front of it:
+//   preheader -> vfor: last lane in range? -> vbody (lanes at once) -> vfor
+//                      else -> vend: fold the accumulators -> original loop (the remainder)
+static void ssa_vector_lower(SSAVecPlan* p, SSAVectorStats* st) {
+    SSAFunction* f = p->f;
+    SSALoop* L = p->L;
+    int h = L->header, pre = L->preheader, lanes = ssa_vector_isa->lanes;
+    int vhead = ssa_new_block(f, "vfor");
+    int vbody = ssa_new_block(f, "vbody");
+    int vexit = ssa_new_block(f, "vend");
+    f->blocks[vhead].sealed = f->blocks[vbody].sealed = f->blocks[vexit].sealed = 1;
+    p->vbody = vbody;
+
+    int t = ssa_terminator(f, pre);
+    f->instrs[t].target[0] = vhead;
+    for (int s = 0; s < f->blocks[pre].nsuccs; s++)
+        if (f->blocks[pre].succs[s] == h) f->blocks[pre].succs[s] = vhead;
+    ssa_push(&f->blocks[vhead].preds, &f->blocks[vhead].npreds, &f->blocks[vhead].pred_cap, pre);
+    f->blocks[h].preds[p->pre_slot] = vexit;
+    ssa_push(&f->blocks[vexit].succs, &f->blocks[vexit].nsuccs, &f->blocks[vexit].succ_cap, h);
+
+    int nphi = 0;
+    while (f->instrs[f->blocks[h].instrs[nphi]].op == SSA_PHI) nphi++;
+    int* phis = malloc((nphi + 1) * sizeof(int));
+    int* vacc = malloc((nphi + 1) * sizeof(int));
+    p->bound = ssa_vec_hoist(p, p->bound);
+    for (int i = 0; i < nphi; i++) {
+        int id = phis[i] = f->blocks[h].instrs[i];
+        if (p->role[id] == SSA_VEC_INDUCTION || p->role[id] == SSA_VEC_LAST) {
+            if (p->role[id] == SSA_VEC_INDUCTION) p->step[id] = ssa_vec_hoist(p, p->step[id]);
+            p->vphi[id] = ssa_new_phi(f, vhead);
+            f->instrs[p->vphi[id]].is_float = f->instrs[id].is_float;
+            ssa_add_arg(f, p->vphi[id], f->instrs[id].args[p->pre_slot]);
+        }
+        else {
+            // lanes start at the identity; the incoming value joins when the lanes are folded
+            SSAOp op = f->instrs[p->step[id]].op;
+            int identity = ssa_vec_new(f, SSA_VSPLAT, pre, ssa_vec_const(f, pre, op == SSA_MUL ? 1 : 0), -1, lanes);
+            ssa_insert_before_terminator(f, pre, identity);
+            vacc[i] = ssa_new_phi(f, vhead);
+            f->instrs[vacc[i]].lanes = lanes;
+            ssa_add_arg(f, vacc[i], identity);
+        }
+    }
+
+    // run the vector body only while its last lane is still below the bound
+    int span = ssa_vec_const(f, pre, (lanes - 1) * f->instrs[p->step[p->iv]].imm);
+    int last = ssa_vec_new(f, SSA_ADD, vhead, p->vphi[p->iv], span, 0);
+    ssa_append(f, vhead, last);
+    int test = ssa_vec_new(f, SSA_LT, vhead, last, p->bound, 0);
+    f->instrs[test].is_float = 0;
+    ssa_append(f, vhead, test);
+    int br = ssa_new_instr(f, SSA_BR, vhead);
+    ssa_add_arg(f, br, test);
+    f->instrs[br].target[0] = vbody;
+    f->instrs[br].target[1] = vexit;
+    ssa_append(f, vhead, br);
+    ssa_add_edge(f, vhead, vbody);
+    ssa_add_edge(f, vhead, vexit);
+
+    SSABlock* blk = &f->blocks[p->body];
+    for (int i = 0; i < blk->ninstrs - 1; i++) {
+        int id = blk->instrs[i];
+        SSAOp op = f->instrs[id].op;
+        if (p->role[id] == SSA_VEC_UPDATE || (p->role[id] == SSA_VEC_STEP && p->uses[id] == 1)) continue;
+        if (op == SSA_CONST || op == SSA_FCONST) continue;
+        if (op == SSA_COPY) { p->vec[id] = ssa_vec_value(p, f->instrs[id].args[0]); continue; }
+        int a = ssa_vec_value(p, f->instrs[id].args[0]);
+        int b = ssa_vec_value(p, f->instrs[id].args[1]);
+        int v = ssa_vec_new(f, SSA_VOP, vbody, a, b, lanes);
+        f->instrs[v].imm = op;
+        f->instrs[v].is_float = f->instrs[id].is_float;
+        ssa_append(f, vbody, v);
+        p->vec[id] = v;
+    }
+
+    int exit_jmp = ssa_new_instr(f, SSA_JMP, vexit);
+    f->instrs[exit_jmp].target[0] = h;
+    for (int i = 0; i < nphi; i++) {
+        int id = phis[i];
+        if (p->role[id] == SSA_VEC_INDUCTION) {
+            int stride = ssa_vec_new(f, SSA_MUL, pre, p->step[id], ssa_vec_const(f, pre, lanes), 0);
+            ssa_insert_before_terminator(f, pre, stride);
+            int next = ssa_vec_new(f, SSA_ADD, vbody, p->vphi[id], stride, 0);
+            ssa_append(f, vbody, next);
+            ssa_add_arg(f, p->vphi[id], next);
+            f->instrs[id].args[p->pre_slot] = p->vphi[id];
+            continue;
+        }
+        if (p->role[id] == SSA_VEC_LAST) {
+            int last_lane = p->step[id];
+            if (ssa_vec_invariant(f, L, last_lane)) {
+                last_lane = ssa_vec_hoist(p, last_lane);
+            }
+            else {
+                last_lane = ssa_vec_new(f, SSA_VEXTRACT, vbody, ssa_vec_value(p, last_lane), -1, 0);
+                f->instrs[last_lane].imm = lanes - 1;
+                ssa_append(f, vbody, last_lane);
+            }
+            ssa_add_arg(f, p->vphi[id], last_lane);
+            f->instrs[id].args[p->pre_slot] = p->vphi[id];
+            continue;
+        }
+        SSAInstr* u = &f->instrs[p->step[id]];
+        SSAOp op = u->op;
+        int x = u->args[u->args[0] == id ? 1 : 0];
+        int lane_op = op == SSA_MUL ? SSA_MUL : SSA_ADD;
+        int vx = ssa_vec_value(p, x);
+        int next = ssa_vec_new(f, SSA_VOP, vbody, vacc[i], vx, lanes);
+        f->instrs[next].imm = lane_op;
+        f->instrs[next].is_float = 0;
+        ssa_append(f, vbody, next);
+        ssa_add_arg(f, vacc[i], next);
+
+        // r - x0 - x1 ... == r - (x0 + x1 ...): wrapping integer arithmetic reassociates exactly
+        int folded = ssa_vec_new(f, SSA_VREDUCE, vexit, vacc[i], -1, 0);
+        f->instrs[folded].imm = lane_op;
+        f->instrs[folded].is_float = 0;
+        ssa_append(f, vexit, folded);
+        int entry = ssa_vec_new(f, op, vexit, f->instrs[id].args[p->pre_slot], folded, 0);
+        f->instrs[entry].is_float = 0;
+        ssa_append(f, vexit, entry);
+        f->instrs[id].args[p->pre_slot] = entry;
+        st->reductions++;
+    }
+    ssa_append(f, vexit, exit_jmp);
+
+    int back = ssa_new_instr(f, SSA_JMP, vbody);
+    f->instrs[back].target[0] = vhead;
+    ssa_append(f, vbody, back);
+    ssa_add_edge(f, vbody, vhead);
+
+    // profile: the vector loop takes the iterations `lanes` at a time, the original loop at most
+    // lanes - 1 per entry
+    if (f->profiled && f->blocks[h].count >= 0 && f->blocks[p->body].count >= 0) {
+        long long trips = f->blocks[p->body].count, entries = f->blocks[h].count - trips;
+        long long rest = trips < entries * (lanes - 1) ? trips : entries * (lanes - 1);
+        f->blocks[vbody].count = (trips - rest) / lanes;
+        f->blocks[vhead].count = f->blocks[vbody].count + entries;
+        f->blocks[vhead].taken[0] = f->blocks[vbody].count;
+        f->blocks[vhead].taken[1] = entries;
+        f->blocks[vexit].count = entries;
+        f->blocks[p->body].count = rest;
+        f->blocks[h].count = rest + entries;
+        int ht = ssa_terminator(f, h);
+        for (int k = 0; k < 2; k++) f->blocks[h].taken[k] = f->instrs[ht].target[k] == p->body ? rest : entries;
+    }
+    free(phis);
+    free(vacc);
+}
+
+// Rewrites each loop annotated with `vectorize` into a vector loop of ssa_vector_isa->lanes lanes
+// followed by the original loop for the remaining iterations. A loop that cannot be vectorized
+// stays as it is, and a diagnostic says why.
+int ssa_vectorize(SSAFunction* f, SSAVectorStats* st) {
+    SSAVectorStats local;
+    if (!st) st = &local;
+    memset(st, 0, sizeof(*st));
+    if (!f->in_ssa || f->entry < 0) return 0;
+    for (;;) {
+        // one loop per round: the rewrite adds blocks the loop forest does not know about
+        ssa_compact(f);
+        int* idom = malloc(f->nblocks * sizeof(int));
+        ssa_dominators(f, idom);
+        SSALoop* loops;
+        int nloops = ssa_find_loops(f, idom, &loops);
+        free(idom);
+        SSALoop* L = NULL;
+        for (int i = 0; i < nloops && !L; i++)
+            if (f->blocks[loops[i].header].vectorize) L = &loops[i];
+        if (!L) {
+            ssa_free_loops(loops, nloops);
+            break;
+        }
+        f->blocks[L->header].vectorize = 0;
+        st->annotated++;
+        ssa_make_preheader(f, L);
+
+        SSAVecPlan p;
+        memset(&p, 0, sizeof(p));
+        p.f = f;
+        p.L = L;
+        int n = f->ninstrs;
+        p.role = calloc(n, sizeof(int));
+        p.step = calloc(n, sizeof(int));
+        p.uses = calloc(n, sizeof(int));
+        p.vphi = calloc(n, sizeof(int));
+        p.vec = malloc(n * sizeof(int));
+        for (int i = 0; i < n; i++) p.vec[i] = -1;
+        if (ssa_vector_legal(&p)) {
+            ssa_vector_lower(&p, st);
+            st->vectorized++;
+        }
+        else {
+            fprintf(stderr, "[VECTORIZE] %s: loop %s kept scalar: %s\n", f->name, f->blocks[L->header].label, p.why);
+            st->refused++;
+        }
+        free(p.role);
+        free(p.step);
+        free(p.uses);
+        free(p.vphi);
+        free(p.vec);
+        ssa_free_loops(loops, nloops);
+    }
+    return st->vectorized;
+}
+
+int ssa_vectorize_module(SSAModule* m, SSAVectorStats* st) {
+    SSAVectorStats total, one;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < m->nfuncs; i++) {
+        ssa_vectorize(m->funcs[i], &one);
+        total.annotated += one.annotated;
+        total.vectorized += one.vectorized;
+        total.refused += one.refused;
+        total.reductions += one.reductions;
+    }
+    if (st) *st = total;
+    return total.vectorized;
+}
+
+// === Profile-guided optimization ===
+
+// An instrumented module counts every block and every BR's true edge in two counter slots per
+// block, numbered in function and block order; the false edge is the block count minus the true
+// one. The profile names each function with a hash of its CFG, so counts only land on the code
+// they were measured on: instrument and apply on freshly built, unoptimized modules.
+static const char* ssa_profile_out = "rexion.profile";     // written when an instrumented run ends
+static const char* ssa_profile_in;                          // applied by ssa_optimize_module
+
+void ssa_set_profile_generate(const char* path) {
+    ssa_profile_out = path;
+}
+
+void ssa_set_profile_use(const char* path) {
+    ssa_profile_in = path;
+}
+
+static unsigned ssa_profile_hash(SSAFunction* f) {
+    unsigned h = 2166136261u ^ (unsigned)f->nblocks;
+    for (int b = 0; b < f->nblocks; b++) {
+        h = (h ^ 0xFFu) * 16777619u;
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            SSAOp op = f->instrs[f->blocks[b].instrs[i]].op;
+            if (op != SSA_COUNT) h = (h ^ (unsigned)op) * 16777619u;
+        }
+    }
+    return h;
+}
+
+// Inserts a counter at the top of every block and a conditional one (adds the branch condition)
+// before every BR; returns the number of counters inserted.
+int ssa_profile_instrument(SSAModule* m) {
+    if (m->counters) return 0;
+    int slots = 0;
+    for (int i = 0; i < m->nfuncs; i++) slots += 2 * m->funcs[i]->nblocks;
+    m->counters = calloc(slots + 1, sizeof(long long));
+    if (!m->counters) { perror("ssa_profile_instrument"); exit(1); }
+    m->ncounters = slots;
+    int base = 0, added = 0;
+    for (int i = 0; i < m->nfuncs; i++) {
+        SSAFunction* f = m->funcs[i];
+        for (int b = 0; b < f->nblocks; b++) {
+            int nphi = 0;
+            while (nphi < f->blocks[b].ninstrs && f->instrs[f->blocks[b].instrs[nphi]].op == SSA_PHI) nphi++;
+            int c = ssa_new_instr(f, SSA_COUNT, b);
+            f->instrs[c].imm = base + 2 * b;
+            ssa_insert_at(f, b, nphi, c);
+            added++;
+            int t = ssa_terminator(f, b);
+            if (t < 0 || f->instrs[t].op != SSA_BR) continue;
+            c = ssa_new_instr(f, SSA_COUNT, b);
+            f->instrs[c].imm = base + 2 * b + 1;
+            ssa_add_arg(f, c, f->instrs[t].args[0]);
+            ssa_insert_before_terminator(f, b, c);
+            added++;
+        }
+        base += 2 * f->nblocks;
+    }
+    return added;
+}
+
+int ssa_profile_write(SSAModule* m, const char* path) {
+    FILE* out = fopen(path, "w");
+    if (!out) { perror(path); return -1; }
+    fprintf(out, "# rexion profile: function <name> <blocks> <cfg hash>, then <count> <true> <false> per block\n");
+    int base = 0;
+    for (int i = 0; i < m->nfuncs; i++) {
+        SSAFunction* f = m->funcs[i];
+        fprintf(out, "function %s %d %08x\n", f->name, f->nblocks, ssa_profile_hash(f));
+        for (int b = 0; b < f->nblocks; b++) {
+            long long n = m->counters[base + 2 * b], t = m->counters[base + 2 * b + 1];
+            int br = ssa_terminator(f, b) >= 0 && f->instrs[ssa_terminator(f, b)].op == SSA_BR;
+            fprintf(out, "%lld %lld %lld\n", n, br ? t : 0, br ? n - t : 0);
+        }
+        base += 2 * f->nblocks;
+    }
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+// Applies the counts in `path` to the functions whose CFG still matches; returns how many were
+// applied, or -1 when the file cannot be read.
+int ssa_profile_read(SSAModule* m, const char* path) {
+    FILE* in = fopen(path, "r");
+    if (!in) { perror(path); return -1; }
+    char line[256], name[64];
+    SSAFunction* f = NULL;
+    int b = 0, applied = 0;
+    while (fgets(line, sizeof(line), in)) {
+        int nblocks;
+        unsigned hash;
+        long long n, t0, t1;
+        if (line[0] == '#') continue;
+        if (sscanf(line, "function %63s %d %x", name, &nblocks, &hash) == 3) {
+            f = NULL;
+            b = 0;
+            for (int i = 0; i < m->nfuncs; i++)
+                if (strcmp(m->funcs[i]->name, name) == 0) f = m->funcs[i];
+            if (f && (f->nblocks != nblocks || ssa_profile_hash(f) != hash)) {
+                fprintf(stderr, "[PGO] %s: profile was recorded for a different CFG, ignored\n", name);
+                f = NULL;
+            }
+            if (f) { f->profiled = 1; applied++; }
+        }
+        else if (f && b < f->nblocks && sscanf(line, "%lld %lld %lld", &n, &t0, &t1) == 3) {
+            SSABlock* blk = &f->blocks[b];
+            int t = ssa_terminator(f, b);
+            blk->count = n;
+            blk->taken[0] = t >= 0 && f->instrs[t].op == SSA_BR ? t0 : -1;
+            blk->taken[1] = t >= 0 && f->instrs[t].op == SSA_BR ? t1 : -1;
+            b++;
+        }
+    }
+    fclose(in);
+    return applied;
+}
+
+// Profile weight of the edge from -> to; -1 when `from` has no count.
+static long long ssa_edge_count(SSAFunction* f, int from, int to) {
+    SSABlock* blk = &f->blocks[from];
+    int t = ssa_terminator(f, from);
+    if (blk->count < 0 || t < 0) return -1;
+    SSAInstr* term = &f->instrs[t];
+    if (term->op == SSA_JMP) return term->target[0] == to ? blk->count : 0;
+    if (term->op != SSA_BR) return 0;
+    long long n = 0;
+    for (int k = 0; k < 2; k++)
+        if (term->target[k] == to) n += blk->taken[k] >= 0 ? blk->taken[k] : blk->count / 2;
+    return n;
+}
+
+// Blocks made after the profile was read (preheaders, split edges, vector loops) get the sum of
+// their counted incoming edges. Reverse postorder reaches a new loop before its back edge, so
+// such a loop is credited with its entries only.
+static void ssa_estimate_counts(SSAFunction* f) {
+    int* order = malloc(f->nblocks * sizeof(int));
+    int n = ssa_reverse_postorder(f, order);
+    for (int o = 0; o < n; o++) {
+        SSABlock* blk = &f->blocks[order[o]];
+        if (blk->count >= 0) continue;
+        long long sum = 0;
+        for (int k = 0; k < blk->npreds; k++) {
+            int p = blk->preds[k], seen = 0;
+            for (int j = 0; j < k; j++) seen |= blk->preds[j] == p;
+            long long e = seen ? 0 : ssa_edge_count(f, p, order[o]);
+            if (e > 0) sum += e;
+        }
+        blk->count = sum;
+    }
+    free(order);
+}
+
+typedef struct {
+    int functions;              // functions laid out from a profile
+    int cold;                   // blocks that never ran, moved behind the hot code
+    long long taken_before;     // profiled transfers that do not fall through to the next block
+    long long taken_after;
+} SSALayoutStats;
+
+static long long ssa_layout_taken(SSAFunction* f) {
+    long long n = 0;
+    for (int b = 0; b < f->nblocks; b++)
+        for (int k = 0; k < f->blocks[b].nsuccs; k++) {
+            int s = f->blocks[b].succs[k], seen = 0;
+            for (int j = 0; j < k; j++) seen |= f->blocks[b].succs[j] == s;
+            long long e = seen || s == b + 1 ? 0 : ssa_edge_count(f, b, s);
+            if (e > 0) n += e;
+        }
+    return n;
+}
+
+// Renumbers the blocks so that block order[i] becomes block i.
+static void ssa_permute_blocks(SSAFunction* f, const int* order) {
+    int nb = f->nblocks;
+    int* remap = malloc(nb * sizeof(int));
+    SSABlock* blocks = malloc(f->block_cap * sizeof(SSABlock));
+    for (int i = 0; i < nb; i++) {
+        remap[order[i]] = i;
+        blocks[i] = f->blocks[order[i]];
+        blocks[i].id = i;
+    }
+    free(f->blocks);
+    f->blocks = blocks;
+    for (int b = 0; b < nb; b++) {
+        SSABlock* blk = &f->blocks[b];
+        for (int i = 0; i < blk->npreds; i++) blk->preds[i] = remap[blk->preds[i]];
+        for (int i = 0; i < blk->nsuccs; i++) blk->succs[i] = remap[blk->succs[i]];
+        for (int i = 0; i < blk->ninstrs; i++) {
+            SSAInstr* in = &f->instrs[blk->instrs[i]];
+            in->block = b;
+            if (in->target[0] >= 0) in->target[0] = remap[in->target[0]];
+            if (in->target[1] >= 0) in->target[1] = remap[in->target[1]];
+        }
+    }
+    f->entry = remap[f->entry];
+    free(remap);
+}
+
+typedef struct {
+    int from, to;
+    long long weight;
+} SSALayoutEdge;
+
+static int ssa_layout_edge_cmp(const void* a, const void* b) {
+    const SSALayoutEdge* x = a;
+    const SSALayoutEdge* y = b;
+    if (x->weight != y->weight) return x->weight > y->weight ? -1 : 1;
+    return x->from != y->from ? x->from - y->from : x->to - y->to;
+}
+
+typedef struct {
+    int head;
+    long long weight;           // hottest block in the chain
+} SSALayoutChain;
+
+static int ssa_layout_chain_cmp(const void* a, const void* b) {
+    const SSALayoutChain* x = a;
+    const SSALayoutChain* y = b;
+    if (x->weight != y->weight) return x->weight > y->weight ? -1 : 1;
+    return x->head - y->head;
+}
+
+// Pettis-Hansen chaining: taking edges hottest first, the chain ending at an edge's source is
+// glued to the chain starting at its target, so the hot path falls through. The entry chain
+// goes first, the other chains by their hottest block, and chains that never ran go last
+// (hot/cold splitting within the function).
+int ssa_layout_function(SSAFunction* f, SSALayoutStats* st) {
+    if (!f->profiled || f->entry < 0 || f->nblocks < 2) return 0;
+    ssa_estimate_counts(f);
+    int nb = f->nblocks;
+    long long before = ssa_layout_taken(f);
+
+    SSALayoutEdge* edges = malloc((2 * nb + 1) * sizeof(SSALayoutEdge));
+    int nedges = 0;
+    for (int b = 0; b < nb; b++)
+        for (int k = 0; k < f->blocks[b].nsuccs; k++) {
+            int s = f->blocks[b].succs[k];
+            long long w = ssa_edge_count(f, b, s);
+            edges[nedges].from = b;
+            edges[nedges].to = s;
+            edges[nedges].weight = w > 0 ? w : 0;
+            nedges++;
+        }
+    qsort(edges, nedges, sizeof(SSALayoutEdge), ssa_layout_edge_cmp);
+
+    int* next = malloc(nb * sizeof(int));
+    int* prev = malloc(nb * sizeof(int));
+    int* head = malloc(nb * sizeof(int));
+    for (int b = 0; b < nb; b++) { next[b] = prev[b] = -1; head[b] = b; }
+    for (int e = 0; e < nedges; e++) {
+        int a = edges[e].from, c = edges[e].to;
+        if (next[a] >= 0 || prev[c] >= 0 || c == f->entry || head[a] == head[c]) continue;
+        // a never-run block only joins another never-run block
+        if (edges[e].weight == 0 && (f->blocks[a].count > 0 || f->blocks[c].count > 0)) continue;
+        next[a] = c;
+        prev[c] = a;
+        for (int x = c; x >= 0; x = next[x]) head[x] = head[a];
+    }
+
+    SSALayoutChain* chains = malloc(nb * sizeof(SSALayoutChain));
+    int nchains = 0;
+    for (int b = 0; b < nb; b++) {
+        if (prev[b] >= 0 || b == f->entry) continue;
+        long long w = 0;
+        for (int x = b; x >= 0; x = next[x])
+            if (f->blocks[x].count > w) w = f->blocks[x].count;
+        chains[nchains].head = b;
+        chains[nchains].weight = w;
+        nchains++;
+    }
+    qsort(chains, nchains, sizeof(SSALayoutChain), ssa_layout_chain_cmp);
+
+    int* order = malloc(nb * sizeof(int));
+    int n = 0, cold = 0, moved = 0;
+    for (int x = f->entry; x >= 0; x = next[x]) order[n++] = x;
+    for (int c = 0; c < nchains; c++)
+        for (int x = chains[c].head; x >= 0; x = next[x]) {
+            if (chains[c].weight == 0) cold++;
+            order[n++] = x;
+        }
+    for (int i = 0; i < nb; i++) moved |= order[i] != i;
+    if (moved) ssa_permute_blocks(f, order);
+
+    st->functions++;
+    st->cold += cold;
+    st->taken_before += before;
+    st->taken_after += ssa_layout_taken(f);
+    free(edges); free(next); free(prev); free(head); free(chains); free(order);
+    return moved;
+}
+
+int ssa_layout_module(SSAModule* m, SSALayoutStats* st) {
+    SSALayoutStats local;
+    if (!st) st = &local;
+    memset(st, 0, sizeof(*st));
+    int changed = 0;
+    for (int i = 0; i < m->nfuncs; i++) changed += ssa_layout_function(m->funcs[i], st);
+    return changed;
+}
+
+// === Reference interpreter ===
+
+typedef struct {
+    SSAModule* m;
+    SSAValue* globals;
+    FILE* out;                  // NULL runs silently; output still feeds the checksum
+    long long steps;            // instructions executed, phis included
+    long long taken;            // control transfers that do not fall through to the next block
+    long long max_steps;        // 0 = unlimited
+    unsigned long long checksum;    // FNV-1a over everything printed
+    int depth;
+    int max_depth;              // deepest call nesting reached; tail calls do not nest
+    int halted;
+    int trapped;                // step limit or call depth exceeded
+} SSAExec;
+
+static int ssa_global_slot(SSAModule* m, const char* name) {
+    for (int g = 0; g < m->nglobals; g++)
+        if (strcmp(m->globals[g], name) == 0) return g;
+    return -1;
+}
+
+static SSAFunction* ssa_find_function(SSAModule* m, const char* name) {
+    for (int i = 0; i < m->nfuncs; i++)
+        if (strcmp(m->funcs[i]->name, name) == 0) return m->funcs[i];
+    return NULL;
+}
+
+static void ssa_exec_print(SSAExec* x, SSAValue v) {
+    char buf[64];
+    const char* text = buf;
+    if (v.s) text = v.s;
+    else if (v.is_float) ir_format_float(buf, sizeof(buf), v.f);
+    else snprintf(buf, sizeof(buf), "%lld", v.i);
+    for (const char* p = text; *p; p++) x->checksum = (x->checksum ^ (unsigned char)*p) * 0x100000001B3ULL;
+    x->checksum = (x->checksum ^ '\n') * 0x100000001B3ULL;
+    if (x->out) fprintf(x->out, "%s\n", text);
+}
+
+// Lanes of vector value `v`; allocated the first time a function touches a vector.
+static SSAValue* ssa_exec_lanes(SSAValue** lanes, SSAFunction* f, int v) {
+    if (!*lanes) *lanes = calloc((size_t)(f->ninstrs + 1) * SSA_MAX_LANES, sizeof(SSAValue));
+    return &(*lanes)[(size_t)v * SSA_MAX_LANES];
+}
+
+// Walks the CFG; values live in a per-call array indexed by vreg, so it runs both SSA and out-of-SSA code.
+// A vector instruction counts as one step whatever its width. A call flagged as a tail call
+// replaces the running function instead of nesting, the way a jump to the callee would.
+static SSAValue ssa_exec_function(SSAExec* x, SSAFunction* f, const SSAValue* args, int nargs) {
+    SSAValue ret;
+    memset(&ret, 0, sizeof(ret));
+    if (++x->depth > 4096) { x->trapped = 1; x->depth--; return ret; }
+    if (x->depth > x->max_depth) x->max_depth = x->depth;
+    SSAValue tail_args[16];
+    SSAValue* vals = calloc(f->ninstrs + 1, sizeof(SSAValue));
+    SSAValue* lanes = NULL;
+    SSAValue* incoming = NULL;
+    int incoming_cap = 0;
+    int b = f->entry, from = -1;
+
+    while (b >= 0 && !x->halted && !x->trapped) {
+        SSABlock* blk = &f->blocks[b];
+        SSAFunction* tail = NULL;
+        int i = 0, next = -1;
+        if (from >= 0) {
+            // phis read their operands for this edge before any of them is written
+            int k = ssa_pred_index(f, b, from);
+            int nphi = 0;
+            while (nphi < blk->ninstrs && f->instrs[blk->instrs[nphi]].op == SSA_PHI) nphi++;
+            if (nphi * (1 + SSA_MAX_LANES) > incoming_cap) {
+                incoming_cap = nphi * (1 + SSA_MAX_LANES);
+                incoming = ssa_xrealloc(incoming, incoming_cap * sizeof(SSAValue));
+            }
+            for (int p = 0; p < nphi; p++) {
+                SSAInstr* phi = &f->instrs[blk->instrs[p]];
+                incoming[p] = vals[phi->args[k]];
+                if (phi->lanes)
+                    memcpy(&incoming[nphi + p * SSA_MAX_LANES], ssa_exec_lanes(&lanes, f, phi->args[k]), SSA_MAX_LANES * sizeof(SSAValue));
+            }
+            for (int p = 0; p < nphi; p++) {
+                SSAInstr* phi = &f->instrs[blk->instrs[p]];
+                vals[phi->dst] = incoming[p];
+                if (phi->lanes)
+                    memcpy(ssa_exec_lanes(&lanes, f, phi->dst), &incoming[nphi + p * SSA_MAX_LANES], SSA_MAX_LANES * sizeof(SSAValue));
+            }
+            x->steps += nphi;
+            i = nphi;
+        }
+        for (; i < blk->ninstrs && next < 0; i++) {
+            SSAInstr* in = &f->instrs[blk->instrs[i]];
+            SSAValue r;
+            memset(&r, 0, sizeof(r));
+            x->steps++;
+            switch (in->op) {
+            case SSA_CONST: r.i = in->imm; break;
+            case SSA_FCONST: r.f = in->fimm; r.is_float = 1; break;
+            case SSA_SCONST: r.s = in->str; break;
+            case SSA_PARAM: if (in->imm < nargs) r = args[in->imm]; break;
+            case SSA_UNDEF: case SSA_PHI: break;
+            case SSA_COPY:
+                r = vals[in->args[0]];
+                if (in->lanes)
+                    memcpy(ssa_exec_lanes(&lanes, f, in->dst), ssa_exec_lanes(&lanes, f, in->args[0]), SSA_MAX_LANES * sizeof(SSAValue));
+                break;
+            case SSA_VSPLAT: {
+                SSAValue* d = ssa_exec_lanes(&lanes, f, in->dst);
+                for (int k = 0; k < in->lanes; k++) d[k] = vals[in->args[0]];
+                break;
+            }
+            case SSA_VIOTA: {
+                SSAValue* d = ssa_exec_lanes(&lanes, f, in->dst);
+                long long base = ssa_as_int(vals[in->args[0]]), step = ssa_as_int(vals[in->args[1]]);
+                for (int k = 0; k < in->lanes; k++) {
+                    memset(&d[k], 0, sizeof(SSAValue));
+                    d[k].i = (long long)((unsigned long long)base + (unsigned long long)k * (unsigned long long)step);
+                }
+                break;
+            }
+            case SSA_VOP: {
+                SSAValue* a = ssa_exec_lanes(&lanes, f, in->args[0]);
+                SSAValue* b = ssa_exec_lanes(&lanes, f, in->args[1]);
+                SSAValue* d = ssa_exec_lanes(&lanes, f, in->dst);
+                for (int k = 0; k < in->lanes; k++) ssa_fold_binop((SSAOp)in->imm, a[k], b[k], &d[k]);
+                break;
+            }
+            case SSA_VREDUCE: {
+                SSAValue* a = ssa_exec_lanes(&lanes, f, in->args[0]);
+                r = a[0];
+                for (int k = 1; k < f->instrs[in->args[0]].lanes; k++) ssa_fold_binop((SSAOp)in->imm, r, a[k], &r);
+                break;
+            }
+            case SSA_VEXTRACT: r = ssa_exec_lanes(&lanes, f, in->args[0])[in->imm]; break;
+            case SSA_LOAD: {
+                int g = ssa_global_slot(x->m, in->name);
+                if (g >= 0) r = x->globals[g];
+                break;
+            }
+            case SSA_STORE: {
+                int g = ssa_global_slot(x->m, in->name);
+                if (g >= 0) x->globals[g] = vals[in->args[0]];
+                break;
+            }
+            case SSA_CALL: {
+                SSAFunction* callee = ssa_find_function(x->m, in->name);
+                if (!callee) break;
+                SSAValue cargs[16];
+                int n = in->nargs < 16 ? in->nargs : 16;
+                for (int a = 0; a < n; a++) cargs[a] = vals[in->args[a]];
+                if (in->imm) {
+                    memcpy(tail_args, cargs, n * sizeof(SSAValue));
+                    nargs = n;
+                    tail = callee;
+                    next = -2;
+                    break;
+                }
+                r = ssa_exec_function(x, callee, cargs, n);
+                break;
+            }
+            case SSA_PRINT: ssa_exec_print(x, vals[in->args[0]]); break;
+            case SSA_COUNT:
+                if (in->imm < x->m->ncounters) x->m->counters[in->imm] += in->nargs ? ssa_truthy(vals[in->args[0]]) : 1;
+                break;
+            case SSA_JMP: next = in->target[0]; break;
+            case SSA_BR: next = in->target[ssa_truthy(vals[in->args[0]]) ? 0 : 1]; break;
+            case SSA_RET:
+                if (in->nargs) ret = vals[in->args[0]];
+                next = -2;
+                break;
+            case SSA_HALT: x->halted = 1; next = -2; break;
+            default:
+                ssa_fold_binop(in->op, vals[in->args[0]], vals[in->args[1]], &r);
+                break;
+            }
+            if (ssa_has_value(in->op)) vals[in->dst] = r;
+        }
+        if (x->max_steps && x->steps > x->max_steps) x->trapped = 1;
+        if (next >= 0 && next != b + 1) x->taken++;
+        from = b;
+        b = next;
+        if (tail) {
+            x->taken++;
+            f = tail;
+            args = tail_args;
+            vals = ssa_xrealloc(vals, (f->ninstrs + 1) * sizeof(SSAValue));
+            memset(vals, 0, (f->ninstrs + 1) * sizeof(SSAValue));
+            free(lanes);
+            lanes = NULL;
+            b = f->entry;
+            from = -1;
+        }
+    }
+    free(vals);
+    free(lanes);
+    free(incoming);
+    x->depth--;
+    return ret;
+}
+
+// Runs `main` (falling back to the last function); an instrumented module writes its profile
+// once the program halts or `main` returns.
+static int ssa_exec_run(SSAModule* m, FILE* out, long long max_steps, SSAExec* x) {
+    memset(x, 0, sizeof(*x));
+    x->m = m;
+    x->out = out;
+    x->max_steps = max_steps;
+    x->checksum = 0xCBF29CE484222325ULL;
+    x->globals = calloc(m->nglobals + 1, sizeof(SSAValue));
+    SSAFunction* main_fn = ssa_find_function(m, "main");
+    if (!main_fn && m->nfuncs) main_fn = m->funcs[m->nfuncs - 1];
+    if (main_fn) ssa_exec_function(x, main_fn, NULL, 0);
+    free(x->globals);
+    x->globals = NULL;
+    if (m->counters && !x->trapped && ssa_profile_out) ssa_profile_write(m, ssa_profile_out);
+    return x->trapped ? -1 : 0;
+}
+
+// Reports executed instructions and the output checksum of a run.
+int ssa_exec_module(SSAModule* m, FILE* out, long long max_steps, long long* steps, unsigned long long* checksum) {
+    SSAExec x;
+    int rc = ssa_exec_run(m, out, max_steps, &x);
+    if (steps) *steps = x.steps;
+    if (checksum) *checksum = x.checksum;
+    return rc;
+}
+
+// === Dead code elimination ===
+
+typedef struct {
+    int values;         // unused value instructions deleted
+    int stores;         // dead global stores deleted
+    int functions;      // unreferenced functions deleted
+} SSADceStats;
+
+// Observable effects; every other instruction lives only if one of these (transitively) uses it.
+static int ssa_is_root(SSAOp op) {
+    return op == SSA_PRINT || op == SSA_STORE || op == SSA_CALL || op == SSA_COUNT || ssa_is_terminator(op);
+}
+
+// Drops functions that `main` cannot reach through calls.
+static int ssa_remove_unreferenced(SSAModule* m) {
+    SSAFunction* main_fn = ssa_find_function(m, "main");
+    if (!main_fn && m->nfuncs) main_fn = m->funcs[m->nfuncs - 1];
+    if (!main_fn) return 0;
+    unsigned char* reach = calloc(m->nfuncs, 1);
+    int* stack = malloc(m->nfuncs * sizeof(int));
+    int sp = 0;
+    for (int i = 0; i < m->nfuncs; i++)
+        if (m->funcs[i] == main_fn) { reach[i] = 1; stack[sp++] = i; }
+    while (sp) {
+        SSAFunction* f = m->funcs[stack[--sp]];
+        for (int b = 0; b < f->nblocks; b++)
+            for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+                SSAInstr* in = &f->instrs[f->blocks[b].instrs[i]];
+                if (in->op != SSA_CALL) continue;
+                for (int c = 0; c < m->nfuncs; c++)
+                    if (!reach[c] && strcmp(m->funcs[c]->name, in->name) == 0) { reach[c] = 1; stack[sp++] = c; }
+            }
+    }
+    int n = 0, removed = 0;
+    for (int i = 0; i < m->nfuncs; i++) {
+        if (reach[i]) m->funcs[n++] = m->funcs[i];
+        else { ssa_free_function(m->funcs[i]); removed++; }
+    }
+    m->nfuncs = n;
+    free(reach);
+    free(stack);
+    return removed;
+}
+
+// A store is dead when no function ever loads the global, or when a later store in the
+// same block overwrites it with no load or call in between.
+static void ssa_mark_dead_stores(SSAModule* m, SSAFunction* f, const unsigned char* loaded, SSADceStats* st) {
+    unsigned char* overwritten = calloc(m->nglobals + 1, 1);
+    for (int b = 0; b < f->nblocks; b++) {
+        SSABlock* blk = &f->blocks[b];
+        memset(overwritten, 0, m->nglobals + 1);
+        for (int i = blk->ninstrs - 1; i >= 0; i--) {
+            SSAInstr* in = &f->instrs[blk->instrs[i]];
+            if (in->op == SSA_CALL) { memset(overwritten, 0, m->nglobals + 1); continue; }
+            if (in->op != SSA_LOAD && in->op != SSA_STORE) continue;
+            int g = ssa_global_slot(m, in->name);
+            if (g < 0) continue;
+            if (in->op == SSA_LOAD) { overwritten[g] = 0; continue; }
+            if (!loaded[g] || overwritten[g]) {
+                in->dead = 1;
+                st->stores++;
+            }
+            overwritten[g] = 1;
+        }
+    }
+    free(overwritten);
+}
+
+static void ssa_dce_function(SSAModule* m, SSAFunction* f, const unsigned char* loaded, SSADceStats* st) {
+    ssa_mark_dead_stores(m, f, loaded, st);
+    ssa_compact(f);
+
+    unsigned char* live = calloc(f->ninstrs, 1);
+    int* work = NULL;
+    int nwork = 0, work_cap = 0;
+    for (int b = 0; b < f->nblocks; b++)
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            int id = f->blocks[b].instrs[i];
+            if (!ssa_is_root(f->instrs[id].op)) continue;
+            live[id] = 1;
+            ssa_push(&work, &nwork, &work_cap, id);
+        }
+    while (nwork) {
+        SSAInstr* in = &f->instrs[work[--nwork]];
+        for (int a = 0; a < in->nargs; a++) {
+            if (live[in->args[a]]) continue;
+            live[in->args[a]] = 1;
+            ssa_push(&work, &nwork, &work_cap, in->args[a]);
+        }
+    }
+    for (int b = 0; b < f->nblocks; b++)
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            int id = f->blocks[b].instrs[i];
+            if (live[id]) continue;
+            f->instrs[id].dead = 1;
+            st->values++;
+        }
+    free(live);
+    free(work);
+    ssa_compact(f);
+}
+
+int ssa_dce_module(SSAModule* m, SSADceStats* st) {
+    SSADceStats local;
+    if (!st) st = &local;
+    memset(st, 0, sizeof(*st));
+    st->functions = ssa_remove_unreferenced(m);
+
+    unsigned char* loaded = calloc(m->nglobals + 1, 1);
+    for (int k = 0; k < m->nfuncs; k++) {
+        SSAFunction* f = m->funcs[k];
+        for (int b = 0; b < f->nblocks; b++)
+            for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+                SSAInstr* in = &f->instrs[f->blocks[b].instrs[i]];
+                int g = in->op == SSA_LOAD ? ssa_global_slot(m, in->name) : -1;
+                if (g >= 0) loaded[g] = 1;
+            }
+    }
+    for (int k = 0; k < m->nfuncs; k++) ssa_dce_function(m, m->funcs[k], loaded, st);
+    free(loaded);
+    return st->values + st->stores + st->functions;
+}
+
+// === Inlining ===
+
+typedef struct {
+    int threshold;          // inline when callee size - weighted benefit stays at or below this
+    int growth_percent;     // total growth cap, as a percentage of the module's size before inlining
+} SSAInlineParams;
+
+SSAInlineParams ssa_inline_params = { 8, 50 };
+
+void ssa_set_inline_budget(int growth_percent) {
+    ssa_inline_params.growth_percent = growth_percent < 0 ? 0 : growth_percent;
+}
+
+typedef struct {
+    int inlined;
+    int recursive;          // call sites skipped because the callee is on a call-graph cycle
+    int too_costly;
+    int over_budget;
+    int cold;               // call sites the profile never saw run
+    int growth;             // instructions added
+} SSAInlineStats;
+
+#define SSA_CALL_OVERHEAD 4     // call, ret, frame setup and teardown
+
+static int ssa_function_index(SSAModule* m, const char* name) {
+    for (int i = 0; i < m->nfuncs; i++)
+        if (strcmp(m->funcs[i]->name, name) == 0) return i;
+    return -1;
+}
+
+int ssa_module_size(SSAModule* m) {
+    int n = 0;
+    for (int i = 0; i < m->nfuncs; i++)
+        for (int b = 0; b < m->funcs[i]->nblocks; b++) n += m->funcs[i]->blocks[b].ninstrs;
+    return n;
+}
+
+static int ssa_function_size(SSAFunction* f) {
+    int n = 0;
+    for (int b = 0; b < f->nblocks; b++)
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            SSAOp op = f->instrs[f->blocks[b].instrs[i]].op;
+            if (op != SSA_PARAM && op != SSA_RET) n++;
+        }
+    return n;
+}
+
+typedef struct {
+    SSAModule* m;
+    int* index; int* low; int* stack; int sp; int counter;
+    unsigned char* on_stack;
+    unsigned char* recursive;
+    int* order; int norder;     // callees before callers
+} SSACallGraph;
+
+// Tarjan's SCC walk; functions are emitted in post-order, so every callee precedes its callers.
+static void ssa_callgraph_visit(SSACallGraph* g, int v) {
+    SSAFunction* f = g->m->funcs[v];
+    g->index[v] = g->low[v] = g->counter++;
+    g->stack[g->sp++] = v;
+    g->on_stack[v] = 1;
+    for (int b = 0; b < f->nblocks; b++)
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            SSAInstr* in = &f->instrs[f->blocks[b].instrs[i]];
+            if (in->op != SSA_CALL) continue;
+            int w = ssa_function_index(g->m, in->name);
+            if (w < 0) continue;
+            if (w == v) g->recursive[v] = 1;
+            if (g->index[w] < 0) {
+                ssa_callgraph_visit(g, w);
+                if (g->low[w] < g->low[v]) g->low[v] = g->low[w];
+            }
+            else if (g->on_stack[w] && g->index[w] < g->low[v]) g->low[v] = g->index[w];
+        }
+    if (g->low[v] != g->index[v]) return;
+    int first = g->sp;
+    while (g->stack[first - 1] != v) first--;
+    first--;
+    for (int k = first; k < g->sp; k++) {
+        int w = g->stack[k];
+        g->on_stack[w] = 0;
+        if (g->sp - first > 1) g->recursive[w] = 1;
+        g->order[g->norder++] = w;
+    }
+    g->sp = first;
+}
+
+// Copies `callee`'s body into `f` in place of the call `call`; its block is split at the call
+// and every return jumps to the continuation, where a phi collects the return values.
+static void ssa_inline_call(SSAFunction* f, int call, SSAFunction* callee) {
+    int b = f->instrs[call].block;
+    int pos = 0;
+    while (f->blocks[b].instrs[pos] != call) pos++;
+
+    // continuation: everything after the call, plus the block's successors
+    int cont = ssa_new_block(f, "cont");
+    f->blocks[cont].sealed = 1;
+    f->blocks[cont].count = f->blocks[b].count;
+    f->blocks[cont].taken[0] = f->blocks[b].taken[0];
+    f->blocks[cont].taken[1] = f->blocks[b].taken[1];
+    for (int i = pos + 1; i < f->blocks[b].ninstrs; i++) ssa_append(f, cont, f->blocks[b].instrs[i]);
+    f->blocks[b].ninstrs = pos + 1;
+    for (int s = 0; s < f->blocks[b].nsuccs; s++) {
+        int succ = f->blocks[b].succs[s];
+        ssa_push(&f->blocks[cont].succs, &f->blocks[cont].nsuccs, &f->blocks[cont].succ_cap, succ);
+        for (int k = 0; k < f->blocks[succ].npreds; k++)
+            if (f->blocks[succ].preds[k] == b) f->blocks[succ].preds[k] = cont;
+    }
+    f->blocks[b].nsuccs = 0;
+
+    int* bmap = malloc((callee->nblocks + 1) * sizeof(int));
+    int* vmap = malloc((callee->ninstrs + 1) * sizeof(int));
+    for (int i = 0; i < callee->ninstrs; i++) vmap[i] = -1;
+    // profiled callee: its counts scaled to the share of its calls made from this site
+    long long site = f->blocks[b].count, calls = callee->entry >= 0 ? callee->blocks[callee->entry].count : -1;
+    double scale = f->profiled && callee->profiled && site >= 0 && calls > 0 ? (double)site / (double)calls : -1.0;
+    for (int cb = 0; cb < callee->nblocks; cb++) {
+        bmap[cb] = ssa_new_block(f, "inl");
+        SSABlock* nb = &f->blocks[bmap[cb]];
+        nb->sealed = 1;
+        nb->vectorize = callee->blocks[cb].vectorize;
+        if (scale < 0) continue;
+        nb->count = (long long)(callee->blocks[cb].count * scale);
+        for (int k = 0; k < 2; k++)
+            nb->taken[k] = callee->blocks[cb].taken[k] >= 0 ? (long long)(callee->blocks[cb].taken[k] * scale) : -1;
+    }
+    int nargs = f->instrs[call].nargs;
+    for (int cb = 0; cb < callee->nblocks; cb++)
+        for (int i = 0; i < callee->blocks[cb].ninstrs; i++) {
+            int id = callee->blocks[cb].instrs[i];
+            SSAInstr* src = &callee->instrs[id];
+            if (src->op == SSA_PARAM && src->imm < nargs) {
+                vmap[id] = f->instrs[call].args[src->imm];
+                continue;
+            }
+            int c = ssa_new_instr(f, src->op == SSA_PARAM ? SSA_CONST : src->op, bmap[cb]);
+            SSAInstr* dst = &f->instrs[c];
+            dst->is_float = src->is_float;
+            dst->lanes = src->lanes;
+            dst->imm = src->op == SSA_PARAM || src->op == SSA_CALL ? 0 : src->imm;     // inlined returns are jumps: no tail calls
+            dst->fimm = src->fimm;
+            memcpy(dst->name, src->name, sizeof(dst->name));
+            dst->str = src->str ? strdup(src->str) : NULL;
+            dst->target[0] = src->target[0] >= 0 ? bmap[src->target[0]] : -1;
+            dst->target[1] = src->target[1] >= 0 ? bmap[src->target[1]] : -1;
+            ssa_append(f, bmap[cb], c);
+            vmap[id] = c;
+        }
+    for (int cb = 0; cb < callee->nblocks; cb++) {
+        SSABlock* from = &callee->blocks[cb];
+        int nb = bmap[cb];
+        for (int k = 0; k < from->npreds; k++)
+            ssa_push(&f->blocks[nb].preds, &f->blocks[nb].npreds, &f->blocks[nb].pred_cap, bmap[from->preds[k]]);
+        for (int k = 0; k < from->nsuccs; k++)
+            ssa_push(&f->blocks[nb].succs, &f->blocks[nb].nsuccs, &f->blocks[nb].succ_cap, bmap[from->succs[k]]);
+        for (int i = 0; i < from->ninstrs; i++) {
+            int id = from->instrs[i];
+            SSAInstr* src = &callee->instrs[id];
+            if (src->op == SSA_PARAM) continue;
+            for (int a = 0; a < src->nargs; a++) ssa_add_arg(f, vmap[id], vmap[ssa_resolve(callee, src->args[a])]);
+        }
+    }
+
+    // the call's block now falls into the inlined entry
+    int jmp = ssa_new_instr(f, SSA_JMP, b);
+    f->instrs[jmp].target[0] = bmap[callee->entry];
+    ssa_append(f, b, jmp);
+    ssa_add_edge(f, b, bmap[callee->entry]);
+
+    // returns become jumps to the continuation
+    int* rets = malloc((callee->nblocks + 1) * sizeof(int));
+    int nrets = 0;
+    for (int cb = 0; cb < callee->nblocks; cb++) {
+        int nb = bmap[cb];
+        int t = ssa_terminator(f, nb);
+        if (t < 0 || f->instrs[t].op != SSA_RET) continue;
+        int v;
+        if (f->instrs[t].nargs) {
+            v = f->instrs[t].args[0];
+        }
+        else {
+            v = ssa_new_instr(f, SSA_CONST, nb);
+            ssa_insert_at(f, nb, f->blocks[nb].ninstrs - 1, v);
+        }
+        f->instrs[t].op = SSA_JMP;
+        f->instrs[t].nargs = 0;
+        f->instrs[t].target[0] = cont;
+        ssa_add_edge(f, nb, cont);
+        rets[nrets++] = v;
+    }
+    int result;
+    if (nrets == 1) {
+        result = rets[0];
+    }
+    else if (nrets == 0) {
+        result = ssa_new_instr(f, SSA_UNDEF, cont);      // the callee never returns here
+        ssa_insert_at(f, cont, 0, result);
+    }
+    else {
+        result = ssa_new_phi(f, cont);
+        for (int r = 0; r < nrets; r++) {
+            ssa_add_arg(f, result, rets[r]);
+            if (f->instrs[rets[r]].is_float) f->instrs[result].is_float = 1;
+        }
+    }
+    ssa_replace_all_uses(f, call, result);
+    free(rets);
+    free(bmap);
+    free(vmap);
+}
+
+// Benefit of removing one call, weighted by how deep in loops the call sits.
+static int ssa_inline_benefit(SSAFunction* f, SSAInstr* call, int depth) {
+    int benefit = SSA_CALL_OVERHEAD + call->nargs;
+    for (int a = 0; a < call->nargs; a++) {
+        SSAOp op = f->instrs[call->args[a]].op;
+        if (op == SSA_CONST || op == SSA_FCONST) benefit += 2;      // the callee body can fold
+    }
+    return benefit * (1 + 3 * (depth < 3 ? depth : 3));
+}
+
+// Measured stand-in for a call site's loop depth: how many times more often than its function's
+// entry the site ran, in powers of 8, capped at 3 like the static depth; -1 if it never ran.
+static int ssa_profile_depth(SSAFunction* f, int block) {
+    long long n = f->blocks[block].count, entry = f->blocks[f->entry].count;
+    if (n == 0) return -1;
+    if (entry < 1) entry = 1;
+    int d = 0;
+    while (d < 3 && n >= entry * 8) { d++; entry *= 8; }
+    return d;
+}
+
+// Bottom-up over the call graph: callees are finished before their callers are considered,
+// so a small function that itself inlined its helpers is judged on its final size.
+int ssa_inline_module(SSAModule* m, const SSAInlineParams* params, SSAInlineStats* st) {
+    SSAInlineStats local;
+    if (!st) st = &local;
+    memset(st, 0, sizeof(*st));
+    if (!params) params = &ssa_inline_params;
+    int n = m->nfuncs;
+    if (!n) return 0;
+
+    SSACallGraph g;
+    memset(&g, 0, sizeof(g));
+    g.m = m;
+    g.index = malloc(n * sizeof(int));
+    g.low = malloc(n * sizeof(int));
+    g.stack = malloc(n * sizeof(int));
+    g.order = malloc(n * sizeof(int));
+    g.on_stack = calloc(n, 1);
+    g.recursive = calloc(n, 1);
+    for (int i = 0; i < n; i++) g.index[i] = -1;
+    for (int i = 0; i < n; i++)
+        if (g.index[i] < 0) ssa_callgraph_visit(&g, i);
+
+    int budget = ssa_module_size(m) * params->growth_percent / 100;
+    for (int o = 0; o < g.norder; o++) {
+        SSAFunction* f = m->funcs[g.order[o]];
+        if (!f->in_ssa || f->entry < 0) continue;
+        ssa_compact(f);
+
+        // call sites and their loop depth, fixed before the CFG starts changing
+        int* idom = malloc(f->nblocks * sizeof(int));
+        ssa_dominators(f, idom);
+        SSALoop* loops;
+        int nloops = ssa_find_loops(f, idom, &loops);
+        int* sites = NULL; int* depth = NULL;
+        int nsites = 0, cap = 0, dcap = 0, dn = 0;
+        for (int b = 0; b < f->nblocks; b++)
+            for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+                int id = f->blocks[b].instrs[i];
+                if (f->instrs[id].op != SSA_CALL) continue;
+                int d = 0;
+                for (int l = 0; l < nloops; l++) d += ssa_loop_has(&loops[l], b);
+                if (f->profiled && f->blocks[b].count >= 0) d = ssa_profile_depth(f, b);
+                ssa_push(&sites, &nsites, &cap, id);
+                ssa_push(&depth, &dn, &dcap, d);
+            }
+        ssa_free_loops(loops, nloops);
+        free(idom);
+
+        for (int s = 0; s < nsites; s++) {
+            SSAInstr* call = &f->instrs[sites[s]];
+            int c = ssa_function_index(m, call->name);
+            if (c < 0) continue;
+            SSAFunction* callee = m->funcs[c];
+            if (callee == f || g.recursive[c]) { st->recursive++; continue; }
+            if (!callee->in_ssa || callee->entry < 0) continue;
+            if (depth[s] < 0) { st->cold++; continue; }
+            int size = ssa_function_size(callee);
+            int benefit = ssa_inline_benefit(f, call, depth[s]);
+            if (size - benefit > params->threshold) { st->too_costly++; continue; }
+            int growth = size - 1;
+            if (growth > 0 && st->growth + growth > budget) { st->over_budget++; continue; }
+            ssa_inline_call(f, sites[s], callee);
+            st->growth += growth;
+            st->inlined++;
+        }
+        free(sites);
+        free(depth);
+        ssa_remove_trivial_phis(f);
+        ssa_compact(f);
+    }
+    free(g.index); free(g.low); free(g.stack); free(g.order);
+    free(g.on_stack); free(g.recursive);
+    return st->inlined;
+}
+
+// === Tail calls ===
+
+typedef struct {
+    int functions;      // self-recursive functions turned into loops
+    int loops;          // self tail calls that became back edges
+    int marked;         // other calls in tail position, flagged to run in the caller's frame
+} SSATailStats;
+
+// The call at `pos` is in tail position when the block ends right after it by returning its value.
+static int ssa_tail_call_at(SSAFunction* f, int block, int pos) {
+    SSABlock* blk = &f->blocks[block];
+    if (pos < 0 || pos + 2 != blk->ninstrs) return 0;
+    SSAInstr* ret = &f->instrs[blk->instrs[pos + 1]];
+    if (f->instrs[blk->instrs[pos]].op != SSA_CALL || ret->op != SSA_RET || !ret->nargs) return 0;
+    return ssa_resolve(f, ret->args[0]) == blk->instrs[pos];
+}
+
+// Self tail calls become jumps back to the body: a new entry block holds the parameters, and the
+// old parameters turn into phis in the old entry fed by it and by each tail call's arguments.
+static int ssa_tail_recursion(SSAFunction* f) {
+    if (f->entry < 0 || f->blocks[f->entry].npreds) return 0;
+    int* sites = NULL;
+    int nsites = 0, cap = 0;
+    for (int b = 0; b < f->nblocks; b++) {
+        int pos = f->blocks[b].ninstrs - 2;
+        if (ssa_tail_call_at(f, b, pos) && strcmp(f->instrs[f->blocks[b].instrs[pos]].name, f->name) == 0)
+            ssa_push(&sites, &nsites, &cap, b);
+    }
+    if (!nsites) return 0;
+
+    int body = f->entry;
+    int entry = ssa_new_block(f, "tre");
+    f->blocks[entry].sealed = 1;
+    long long inner = 0;
+    for (int s = 0; s < nsites && inner >= 0; s++) inner = f->blocks[sites[s]].count < 0 ? -1 : inner + f->blocks[sites[s]].count;
+    if (f->blocks[body].count >= 0 && inner >= 0) f->blocks[entry].count = f->blocks[body].count - inner;
+
+    // parameters move to the new entry; the values the body saw become phis, placed first
+    SSABlock* blk = &f->blocks[body];
+    int* phis = malloc((blk->ninstrs + 1) * sizeof(int));     // the parameters, then the rest of the block
+    int* index = malloc((blk->ninstrs + 1) * sizeof(int));
+    int n = 0;
+    for (int i = 0; i < blk->ninstrs; i++)
+        if (f->instrs[blk->instrs[i]].op == SSA_PARAM) phis[n++] = blk->instrs[i];
+    int nphis = n;
+    for (int i = 0; i < blk->ninstrs; i++)
+        if (f->instrs[blk->instrs[i]].op != SSA_PARAM) phis[n++] = blk->instrs[i];
+    memcpy(blk->instrs, phis, n * sizeof(int));
+    for (int p = 0; p < nphis; p++) {
+        SSAInstr* phi = &f->instrs[phis[p]];
+        index[p] = (int)phi->imm;
+        phi->op = SSA_PHI;
+        phi->imm = 0;
+        int param = ssa_new_instr(f, SSA_PARAM, entry);
+        f->instrs[param].imm = index[p];
+        ssa_append(f, entry, param);
+        ssa_add_arg(f, phis[p], param);
+    }
+    int jmp = ssa_new_instr(f, SSA_JMP, entry);
+    f->instrs[jmp].target[0] = body;
+    ssa_append(f, entry, jmp);
+    ssa_add_edge(f, entry, body);
+    f->entry = entry;
+
+    for (int s = 0; s < nsites; s++) {
+        int b = sites[s];
+        int call = f->blocks[b].instrs[f->blocks[b].ninstrs - 2];
+        int ret = f->blocks[b].instrs[f->blocks[b].ninstrs - 1];
+        for (int p = 0; p < nphis; p++) {
+            int v;
+            if (index[p] < f->instrs[call].nargs) {
+                v = ssa_resolve(f, f->instrs[call].args[index[p]]);
+            }
+            else {
+                v = ssa_new_instr(f, SSA_CONST, b);     // a missing argument reads as 0
+                ssa_insert_at(f, b, f->blocks[b].ninstrs - 1, v);
+            }
+            ssa_add_arg(f, phis[p], v);
+        }
+        f->instrs[call].dead = 1;
+        f->instrs[ret].op = SSA_JMP;
+        f->instrs[ret].nargs = 0;
+        f->instrs[ret].target[0] = body;
+        ssa_add_edge(f, b, body);
+    }
+    free(phis);
+    free(index);
+    free(sites);
+    ssa_compact(f);
+    ssa_remove_trivial_phis(f);
+    ssa_compact(f);
+    return nsites;
+}
+
+// Self-recursion in tail position becomes a loop, so it runs in constant stack and the inliner no
+// longer sees the function as recursive; every other tail call is flagged for the backends to
+// emit as a jump.
+int ssa_tailcall_module(SSAModule* m, SSATailStats* st) {
+    SSATailStats local;
+    if (!st) st = &local;
+    memset(st, 0, sizeof(*st));
+    for (int i = 0; i < m->nfuncs; i++) {
+        SSAFunction* f = m->funcs[i];
+        if (!f->in_ssa || f->entry < 0) continue;
+        int loops = ssa_tail_recursion(f);
+        if (loops) st->functions++;
+        st->loops += loops;
+        for (int b = 0; b < f->nblocks; b++) {
+            int pos = f->blocks[b].ninstrs - 2;
+            if (!ssa_tail_call_at(f, b, pos) || f->instrs[f->blocks[b].instrs[pos]].imm) continue;
+            f->instrs[f->blocks[b].instrs[pos]].imm = 1;
+            st->marked++;
+        }
+    }
+    return st->loops + st->marked;
+}
+
+// === Optimization pipeline ===
+
+// Each pass runs over the whole module, returns its change count and, given a report stream,
+// prints one [OPT] line with its statistics.
+static int ssa_run_tailcall(SSAModule* m, FILE* report) {
+    SSATailStats s;
+    int changes = ssa_tailcall_module(m, &s);
+    if (report)
+        fprintf(report, "[OPT] tailcall: %d self tail calls turned into loops in %d functions, %d other tail calls marked\n",
+            s.loops, s.functions, s.marked);
+    return changes;
+}
+
+static int ssa_run_inline(SSAModule* m, FILE* report) {
+    SSAInlineStats s;
+    int changes = ssa_inline_module(m, NULL, &s);
+    if (report)
+        fprintf(report, "[OPT] inline: %d calls inlined (+%d instrs), %d recursive, %d too costly, %d over budget, %d cold\n",
+            s.inlined, s.growth, s.recursive, s.too_costly, s.over_budget, s.cold);
+    return changes;
+}
+
+static int ssa_run_sccp(SSAModule* m, FILE* report) {
+    SSASccpStats s;
+    int changes = ssa_sccp_module(m, &s);
+    if (report)
+        fprintf(report, "[OPT] sccp: %d values folded, %d branches resolved, %d blocks removed, %d constants swept\n",
+            s.folded, s.branches, s.blocks_removed, s.swept);
+    return changes;
+}
+
+static int ssa_run_gvn(SSAModule* m, FILE* report) {
+    SSAGvnStats s;
+    int changes = ssa_gvn_module(m, &s);
+    if (report) fprintf(report, "[OPT] gvn: %d arithmetic, %d loads, %d constants, %d phis merged\n", s.arith, s.loads, s.consts, s.phis);
+    return changes;
+}
+
+static int ssa_run_loops(SSAModule* m, FILE* report) {
+    SSALoopStats s;
+    int changes = ssa_optimize_loops_module(m, &s);
+    if (report)
+        fprintf(report, "[OPT] loops: %d loops, %d preheaders added, %d instructions hoisted, %d multiplies strength-reduced\n",
+            s.loops, s.preheaders, s.hoisted, s.reduced);
+    return changes;
+}
+
+static int ssa_run_vectorize(SSAModule* m, FILE* report) {
+    SSAVectorStats s;
+    int changes = ssa_vectorize_module(m, &s);
+    if (report)
+        fprintf(report, "[OPT] vectorize: %d of %d annotated loops vectorized (%s, %d lanes), %d reductions, %d refused\n",
+            s.vectorized, s.annotated, ssa_vector_isa->name, ssa_vector_isa->lanes, s.reductions, s.refused);
+    return changes;
+}
+
+static int ssa_run_dce(SSAModule* m, FILE* report) {
+    SSADceStats s;
+    int changes = ssa_dce_module(m, &s);
+    if (report) fprintf(report, "[OPT] dce: %d values, %d stores, %d functions eliminated\n", s.values, s.stores, s.functions);
+    return changes;
+}
+
+static int ssa_run_layout(SSAModule* m, FILE* report) {
+    SSALayoutStats s;
+    int changes = ssa_layout_module(m, &s);
+    if (report)
+        fprintf(report, "[OPT] layout: %d profiled functions, %d cold blocks moved last, taken jumps %lld -> %lld\n",
+            s.functions, s.cold, s.taken_before, s.taken_after);
+    return changes;
+}
+
+typedef struct {
+    const char* name;
+    int (*run)(SSAModule* m, FILE* report);
+    const char* desc;
+} SSAPass;
+
+// --time-passes totals over every pipeline run since the last report.
+typedef struct {
+    int runs;
+    double ms;
+    long long instrs_in, instrs_out;
+    long long bytes_in, bytes_out;
+} SSAPassTimes;
+
+// Registry order is the canonical order: a pass enabled outside its level's pipeline runs here.
+static const SSAPass ssa_passes[] = {
+    { "tailcall", ssa_run_tailcall, "self tail recursion to loops, other tail calls marked as jumps" },
+    { "inline", ssa_run_inline, "inline small non-recursive callees within the growth budget" },
+    { "sccp", ssa_run_sccp, "sparse conditional constant propagation" },
+    { "gvn", ssa_run_gvn, "dominator-based global value numbering" },
+    { "loops", ssa_run_loops, "loop-invariant code motion and induction-variable strength reduction" },
+    { "vectorize", ssa_run_vectorize, "vector lanes for loops annotated with vectorize" },
+    { "dce", ssa_run_dce, "mark-and-sweep dead code, store and function elimination" },
+    { "layout", ssa_run_layout, "profile-guided block layout and hot/cold splitting (needs --profile-use)" },
+};
+
+#define SSA_NPASSES ((int)(sizeof(ssa_passes) / sizeof(ssa_passes[0])))
+
+static int ssa_pass_forced[SSA_NPASSES];        // 1 --enable-pass, -1 --disable-pass, 0 as the -O level says
+static SSAPassTimes ssa_pass_times[SSA_NPASSES];
+
+// Tail recursion becomes loops first, which leaves those functions non-recursive and open to
+// inlining. Inlining goes next so constant arguments reach the callee bodies. Constant propagation then
+// exposes dead values and branches, value numbering merges what is computed twice, loop
+// optimization moves what is left out of loops, annotated loops are vectorized once their bodies
+// are as small as they get, and DCE sweeps the induction variables strength reduction replaced
+// and the functions nobody calls any more. With a profile, layout then orders the surviving blocks
+// hot path first. -O3 cleans up after the loop passes with a second sccp/gvn round; -Os leaves
+// out the passes that grow code.
+typedef struct {
+    const char* level;
+    const char* passes;
+} SSAOptLevel;
+
+static const SSAOptLevel ssa_opt_levels[] = {
+    { "0", "" },
+    { "1", "tailcall sccp dce" },
+    { "2", "tailcall inline sccp gvn loops vectorize dce layout" },
+    { "3", "tailcall inline sccp gvn loops vectorize sccp gvn dce layout" },
+    { "s", "tailcall sccp gvn dce layout" },
+};
+
+static const SSAOptLevel* ssa_opt_level = &ssa_opt_levels[2];
+static int ssa_time_passes;
+
+int ssa_set_opt_level(const char* level) {
+    for (size_t i = 0; i < sizeof(ssa_opt_levels) / sizeof(ssa_opt_levels[0]); i++)
+        if (strcmp(ssa_opt_levels[i].level, level) == 0) { ssa_opt_level = &ssa_opt_levels[i]; return 0; }
+    return -1;
+}
+
+static int ssa_pass_index(const char* name, size_t len) {
+    for (int p = 0; p < SSA_NPASSES; p++)
+        if (strlen(ssa_passes[p].name) == len && strncmp(ssa_passes[p].name, name, len) == 0) return p;
+    return -1;
+}
+
+int ssa_set_pass_enabled(const char* name, int enabled) {
+    int p = ssa_pass_index(name, strlen(name));
+    if (p < 0) return -1;
+    ssa_pass_forced[p] = enabled ? 1 : -1;
+    return 0;
+}
+
+void ssa_set_time_passes(int on) {
+    ssa_time_passes = on;
+}
+
+// The level's pass list, minus disabled passes, plus enabled ones at their canonical position.
+static int ssa_build_pipeline(int* order) {
+    int n = 0;
+    unsigned char listed[SSA_NPASSES] = { 0 };
+    for (const char* s = ssa_opt_level->passes; *s; ) {
+        while (*s == ' ') s++;
+        const char* e = s;
+        while (*e && *e != ' ') e++;
+        int p = ssa_pass_index(s, (size_t)(e - s));
+        if (p >= 0) {
+            listed[p] = 1;
+            if (ssa_pass_forced[p] >= 0) order[n++] = p;
+        }
+        s = e;
+    }
+    for (int p = 0; p < SSA_NPASSES; p++) {
+        if (listed[p] || ssa_pass_forced[p] <= 0) continue;
+        int at = 0;
+        while (at < n && order[at] < p) at++;
+        memmove(&order[at + 1], &order[at], (n - at) * sizeof(int));
+        order[at] = p;
+        n++;
+    }
+    return n;
+}
+
+// Bytes the module's IR holds (allocated capacity), the memory figure --time-passes reports.
+static long long ssa_module_bytes(SSAModule* m) {
+    long long n = sizeof(SSAModule) + (long long)m->func_cap * sizeof(SSAFunction*) + (long long)m->global_cap * 32;
+    for (int i = 0; i < m->nfuncs; i++) {
+        SSAFunction* f = m->funcs[i];
+        n += sizeof(SSAFunction) + (long long)f->instr_cap * sizeof(SSAInstr) + (long long)f->block_cap * sizeof(SSABlock);
+        n += (long long)f->var_cap * 32 + (long long)f->defs.cap * (sizeof(long long) + sizeof(int));
+        for (int k = 0; k < f->ninstrs; k++) n += (long long)f->instrs[k].arg_cap * sizeof(int);
+        for (int b = 0; b < f->nblocks; b++) {
+            SSABlock* blk = &f->blocks[b];
+            n += (long long)(blk->instr_cap + blk->pred_cap + blk->succ_cap + blk->incomplete_cap) * sizeof(int);
+        }
+    }
+    return n;
+}
+
+// Runs the pipeline of the current -O level over `m`, after applying the --profile-use profile.
+int ssa_optimize_module(SSAModule* m, FILE* report) {
+    int order[2 * SSA_NPASSES + 8];
+    int n = ssa_build_pipeline(order);
+    int profiled = 0;
+    for (int i = 0; i < m->nfuncs; i++) profiled |= m->funcs[i]->profiled;
+    if (ssa_profile_in && !profiled && !m->counters) ssa_profile_read(m, ssa_profile_in);
+    int before = ssa_module_size(m);
+    int changes = 0;
+    for (int k = 0; k < n; k++) {
+        const SSAPass* pass = &ssa_passes[order[k]];
+        if (!ssa_time_passes) {
+            changes += pass->run(m, report);
+            continue;
+        }
+        SSAPassTimes* t = &ssa_pass_times[order[k]];
+        long long instrs_in = ssa_module_size(m), bytes_in = ssa_module_bytes(m);
+        double t0 = ssa_now_ms();
+        changes += pass->run(m, report);
+        t->ms += ssa_now_ms() - t0;
+        t->runs++;
+        t->instrs_in += instrs_in;
+        t->instrs_out += ssa_module_size(m);
+        t->bytes_in += bytes_in;
+        t->bytes_out += ssa_module_bytes(m);
+    }
+    if (report) fprintf(report, "[OPT] -O%s: %d -> %d instructions\n", ssa_opt_level->level, before, ssa_module_size(m));
+    return changes;
+}
+
+// --time-passes: per-pass totals since the last report, slowest first.
+void ssa_report_pass_times(FILE* out) {
+    int idx[SSA_NPASSES];
+    double total = 0;
+    for (int p = 0; p < SSA_NPASSES; p++) {
+        idx[p] = p;
+        total += ssa_pass_times[p].ms;
+    }
+    for (int i = 1; i < SSA_NPASSES; i++)
+        for (int j = i; j > 0 && ssa_pass_times[idx[j]].ms > ssa_pass_times[idx[j - 1]].ms; j--) {
+            int t = idx[j]; idx[j] = idx[j - 1]; idx[j - 1] = t;
+        }
+    fprintf(out, "[TIME] %-10s %6s %10s %6s %12s %12s %12s %12s\n",
+        "pass", "runs", "wall ms", "%", "instrs in", "instrs out", "IR KB in", "IR KB out");
+    for (int i = 0; i < SSA_NPASSES; i++) {
+        SSAPassTimes* t = &ssa_pass_times[idx[i]];
+        if (!t->runs) continue;
+        fprintf(out, "[TIME] %-10s %6d %10.3f %6.1f %12lld %12lld %12.1f %12.1f\n",
+            ssa_passes[idx[i]].name, t->runs, t->ms, total > 0 ? 100.0 * t->ms / total : 0.0,
+            t->instrs_in, t->instrs_out, t->bytes_in / 1024.0, t->bytes_out / 1024.0);
+    }
+    memset(ssa_pass_times, 0, sizeof(ssa_pass_times));
+    fprintf(out, "[TIME] %-10s %6s %10.3f\n", "total", "", total);
+}
+
+void ssa_list_passes(FILE* out) {
+    for (int p = 0; p < SSA_NPASSES; p++) {
+        fprintf(out, "%-10s %s  [", ssa_passes[p].name, ssa_passes[p].desc);
+        int first = 1;
+        for (size_t l = 0; l < sizeof(ssa_opt_levels) / sizeof(ssa_opt_levels[0]); l++) {
+            const char* s = strstr(ssa_opt_levels[l].passes, ssa_passes[p].name);
+            if (!s) continue;
+            fprintf(out, "%s-O%s", first ? "" : " ", ssa_opt_levels[l].level);
+            first = 0;
+        }
+        fprintf(out, "]\n");
+    }
+}
+
+// === Flat IR bridge ===
+
+// A flat IR program (LOAD/ADD/PRINT, IF/WHILE nesting, LABEL/JMP/IFZ) becomes one `main` whose
+// variables are the program's names. Names are registers that start at 0, and the backends give
+// ops the VM's semantics: integer ops read a float register's bits, and PRINT picks int, float or
+// string by what defines the name. The builder only takes programs where that cannot show: each
+// name holds one kind of value and every op reads the kind it expects. CALL/RET subroutines share
+// their caller's registers, which one SSA function per FUNC cannot express, so programs with calls
+// are left as they are too.
+
+#define SSA_IR_NEST_DEPTH 256
+
+enum { SSA_KIND_NONE, SSA_KIND_INT, SSA_KIND_FLOAT, SSA_KIND_STRING };
+
+static const char* ssa_kind_names[] = { "no", "int", "float", "string" };
+
+typedef struct {
+    SSABuilder sb;
+    int* var_of;            // IR string id -> variable + 1, 0 until the name is first mentioned
+    int* label_of;          // IR string id -> block + 1 of a LABEL/FUNC name
+    unsigned char* label_defined;
+    unsigned char* kind;    // SSA_KIND_* per variable
+    int* seed;              // per variable: the 0 it holds on entry
+    int nvars, var_cap;
+    int* order;             // blocks in the order the program text reaches them
+    int norder;
+    int dead;               // block opened after the last JMP/HALT
+    int nest_kind[SSA_IR_NEST_DEPTH];
+    int nest_a[SSA_IR_NEST_DEPTH];      // IF: false block; WHILE: body
+    int nest_b[SSA_IR_NEST_DEPTH];      // ELSE: join block; WHILE: exit
+    uint32_t nest_cond[SSA_IR_NEST_DEPTH];  // WHILE: the name END_WHILE tests again
+    int depth;
+    char* why;
+    size_t why_len;
+} SSAIRBuilder;
+
+// Literals as the VM reads them: decimal, the whole operand, within int64 (else a float literal).
+static int ssa_ir_int_literal(const char* s, long long* out) {
+    char* e;
+    if (!*s) return 0;
+    errno = 0;
+    long long v = strtoll(s, &e, 10);
+    if (*e || errno == ERANGE) return 0;
+    *out = v;
+    return 1;
+}
+
+static int ssa_ir_float_literal(const char* s, double* out) {
+    char* e;
+    if (!*s || strpbrk(s, "xX")) return 0;
+    double v = strtod(s, &e);
+    if (*e) return 0;
+    *out = v;
+    return 1;
+}
+
+static void ssa_ir_enter(SSAIRBuilder* B, int block) {
+    B->sb.cur = block;
+    B->order[B->norder++] = block;
+}
+
+static int ssa_ir_block(SSAIRBuilder* B, const char* label) {
+    int b = ssa_new_block(B->sb.f, label);
+    B->order = ssa_xrealloc(B->order, (size_t)B->sb.f->block_cap * sizeof(int));
+    return b;
+}
+
+static int ssa_ir_label(SSAIRBuilder* B, uint32_t id) {
+    if (!B->label_of[id]) B->label_of[id] = ssa_ir_block(B, "L") + 1;
+    return B->label_of[id] - 1;
+}
+
+// After a jump or HALT: code up to the next label is unreachable.
+static void ssa_ir_dead(SSAIRBuilder* B) {
+    int b = ssa_ir_block(B, "dead");
+    B->sb.f->blocks[b].sealed = 1;
+    B->dead = b;
+    ssa_ir_enter(B, b);
+}
+
+// Variable of name `id`; a new one starts as a 0 in the entry block, typed once its kind is known.
+static int ssa_ir_var(SSAIRBuilder* B, uint32_t id) {
+    SSAFunction* f = B->sb.f;
+    if (B->var_of[id]) return B->var_of[id] - 1;
+    if (B->nvars == B->var_cap) {
+        B->var_cap = B->var_cap ? B->var_cap * 2 : 64;
+        B->kind = ssa_xrealloc(B->kind, (size_t)B->var_cap);
+        B->seed = ssa_xrealloc(B->seed, (size_t)B->var_cap * sizeof(int));
+    }
+    int var = B->nvars++;
+    int z = ssa_new_instr(f, SSA_CONST, f->entry);
+    ssa_insert_before_terminator(f, f->entry, z);
+    ssa_write_var(f, var, f->entry, z);
+    B->kind[var] = SSA_KIND_NONE;
+    B->seed[var] = z;
+    B->var_of[id] = var + 1;
+    return var;
+}
+
+static int ssa_ir_fail(SSAIRBuilder* B, const char* what, const char* name) {
+    snprintf(B->why, B->why_len, "%s%s%s", what, name ? " " : "", name ? name : "");
+    return -1;
+}
+
+// Records that `var` holds values of `kind`; a name holding two kinds is not taken.
+static int ssa_ir_kind(SSAIRBuilder* B, int var, int kind, uint32_t id) {
+    if (B->kind[var] == SSA_KIND_NONE) B->kind[var] = (unsigned char)kind;
+    if (B->kind[var] == kind) return 0;
+    snprintf(B->why, B->why_len, "%s holds both %s and %s values", ir_str(id), ssa_kind_names[B->kind[var]], ssa_kind_names[kind]);
+    return -1;
+}
+
+// Value of operand `id`: a literal or the name's current definition. `want` is the kind the op
+// reads (SSA_KIND_NONE for any); *kind gets the operand's. A name read before anything in the
+// program text defines it is an int 0. Returns -1 on a kind mismatch.
+static int ssa_ir_operand(SSAIRBuilder* B, uint32_t id, int want, int* kind) {
+    SSAFunction* f = B->sb.f;
+    const char* s = ir_str(id);
+    long long k;
+    double d;
+    int v, got;
+    if (want != SSA_KIND_FLOAT && ssa_ir_int_literal(s, &k)) {
+        v = ssa_emit(&B->sb, SSA_CONST);
+        f->instrs[v].imm = k;
+        got = SSA_KIND_INT;
+    }
+    else if (ssa_ir_float_literal(s, &d)) {
+        v = ssa_emit(&B->sb, SSA_FCONST);
+        f->instrs[v].fimm = d;
+        f->instrs[v].is_float = 1;
+        got = SSA_KIND_FLOAT;
+    }
+    else {
+        int var = ssa_ir_var(B, id);
+        if (B->kind[var] == SSA_KIND_NONE) B->kind[var] = SSA_KIND_INT;
+        got = B->kind[var];
+        v = ssa_read_var(f, var, B->sb.cur);
+    }
+    if (want != SSA_KIND_NONE && got != want) {
+        snprintf(B->why, B->why_len, "%s is read as %s but holds %s values", s, ssa_kind_names[want], ssa_kind_names[got]);
+        return -1;
+    }
+    if (kind) *kind = got;
+    return v;
+}
+
+static int ssa_ir_define(SSAIRBuilder* B, uint32_t id, int value, int kind) {
+    long long k;
+    double d;
+    if (ssa_ir_int_literal(ir_str(id), &k) || ssa_ir_float_literal(ir_str(id), &d))
+        return ssa_ir_fail(B, "literal used as a destination:", ir_str(id));
+    int var = ssa_ir_var(B, id);
+    if (ssa_ir_kind(B, var, kind, id) != 0) return -1;
+    ssa_write_var(B->sb.f, var, B->sb.cur, value);
+    return 0;
+}
+
+// "OP d, s" is d = d OP s, "OP d, a, b" is d = a OP b.
+static int ssa_ir_binop(SSAIRBuilder* B, const IRInstruction* in, SSAOp op) {
+    SSAFunction* f = B->sb.f;
+    int fop = op >= SSA_FADD && op <= SSA_FDIV;
+    int want = fop ? SSA_KIND_FLOAT : SSA_KIND_INT;
+    if (in->nargs < 2) return ssa_ir_fail(B, "missing operand of", ir_str(in->op));
+    int a = ssa_ir_operand(B, in->arg[in->nargs == 2 ? 0 : 1], want, NULL);
+    if (a < 0) return -1;
+    int b = ssa_ir_operand(B, in->arg[in->nargs == 2 ? 1 : 2], want, NULL);
+    if (b < 0) return -1;
+    int v = ssa_emit(&B->sb, op);
+    ssa_add_arg(f, v, a);
+    ssa_add_arg(f, v, b);
+    f->instrs[v].is_float = fop;
+    return ssa_ir_define(B, in->arg[0], v, want);
+}
+
+static int ssa_ir_cond(SSAIRBuilder* B, uint32_t id) {
+    return ssa_ir_operand(B, id, SSA_KIND_INT, NULL);
+}
+
+static int ssa_ir_stmt(SSAIRBuilder* B, const IRInstruction* in) {
+    SSABuilder* sb = &B->sb;
+    SSAFunction* f = sb->f;
+    int v, kind;
+    switch ((IROpcode)in->opcode) {
+    case IR_OP_NOP: case IR_OP_SECTION: case IR_OP_ENTRY: case IR_OP_IMPORT: case IR_OP_DECLARE:
+        return 0;
+    case IR_OP_LOAD: case IR_OP_MOV: case IR_OP_STORE: case IR_OP_FLOAT_LOAD:
+        if (in->nargs < 2) return ssa_ir_fail(B, "missing operand of", ir_str(in->op));
+        v = ssa_ir_operand(B, in->arg[1], in->opcode == IR_OP_FLOAT_LOAD ? SSA_KIND_FLOAT : SSA_KIND_NONE, &kind);
+        return v < 0 ? -1 : ssa_ir_define(B, in->arg[0], v, kind);
+    case IR_OP_LOAD_STR:
+        if (in->nargs < 2) return ssa_ir_fail(B, "missing operand of", ir_str(in->op));
+        v = ssa_emit(sb, SSA_SCONST);
+        f->instrs[v].str = strdup(ir_str(in->arg[1]));
+        return ssa_ir_define(B, in->arg[0], v, SSA_KIND_STRING);
+    case IR_OP_ADD: return ssa_ir_binop(B, in, SSA_ADD);
+    case IR_OP_SUB: return ssa_ir_binop(B, in, SSA_SUB);
+    case IR_OP_MUL: return ssa_ir_binop(B, in, SSA_MUL);
+    case IR_OP_DIV: return ssa_ir_binop(B, in, SSA_DIV);
+    case IR_OP_MOD: return ssa_ir_binop(B, in, SSA_MOD);
+    case IR_OP_FLOAT_ADD: return ssa_ir_binop(B, in, SSA_FADD);
+    case IR_OP_FLOAT_SUB: return ssa_ir_binop(B, in, SSA_FSUB);
+    case IR_OP_FLOAT_MUL: return ssa_ir_binop(B, in, SSA_FMUL);
+    case IR_OP_FLOAT_DIV: return ssa_ir_binop(B, in, SSA_FDIV);
+    case IR_OP_CMP_EQ: return ssa_ir_binop(B, in, SSA_EQ);
+    case IR_OP_CMP_NE: return ssa_ir_binop(B, in, SSA_NE);
+    case IR_OP_CMP_LT: return ssa_ir_binop(B, in, SSA_LT);
+    case IR_OP_CMP_LE: return ssa_ir_binop(B, in, SSA_LE);
+    case IR_OP_CMP_GT: return ssa_ir_binop(B, in, SSA_GT);
+    case IR_OP_CMP_GE: return ssa_ir_binop(B, in, SSA_GE);
+    case IR_OP_PRINT: case IR_OP_PRINT_FLOAT_SYSCALL: case IR_OP_PRINT_FLOAT_PRINTF:
+        if (in->nargs < 1) return ssa_ir_fail(B, "missing operand of", ir_str(in->op));
+        v = ssa_ir_operand(B, in->arg[0], in->opcode == IR_OP_PRINT ? SSA_KIND_NONE : SSA_KIND_FLOAT, NULL);
+        if (v < 0) return -1;
+        ssa_add_arg(f, ssa_emit(sb, SSA_PRINT), v);
+        return 0;
+    case IR_OP_LABEL: case IR_OP_FUNC: {
+        if (in->nargs < 1) return ssa_ir_fail(B, "missing operand of", ir_str(in->op));
+        if (B->label_defined[in->arg[0]]) return ssa_ir_fail(B, "label defined twice:", ir_str(in->arg[0]));
+        B->label_defined[in->arg[0]] = 1;
+        int b = ssa_ir_label(B, in->arg[0]);
+        int empty_dead = sb->cur == B->dead && f->blocks[sb->cur].ninstrs == 0;
+        if (ssa_terminator(f, sb->cur) < 0 && !empty_dead) ssa_emit_jmp(sb, b);
+        ssa_ir_enter(B, b);
+        return 0;
+    }
+    case IR_OP_JMP:
+        if (in->nargs < 1) return ssa_ir_fail(B, "missing operand of", ir_str(in->op));
+        ssa_emit_jmp(sb, ssa_ir_label(B, in->arg[0]));
+        ssa_ir_dead(B);
+        return 0;
+    case IR_OP_IFZ: {
+        if (in->nargs < 2) return ssa_ir_fail(B, "missing operand of", ir_str(in->op));
+        int c = ssa_ir_cond(B, in->arg[0]);
+        if (c < 0) return -1;
+        int next = ssa_ir_block(B, "bb");
+        ssa_emit_br(sb, c, next, ssa_ir_label(B, in->arg[1]));
+        ssa_ir_enter(B, next);
+        return 0;
+    }
+    case IR_OP_IF: {
+        if (in->nargs < 1) return ssa_ir_fail(B, "missing operand of", ir_str(in->op));
+        if (B->depth == SSA_IR_NEST_DEPTH) return ssa_ir_fail(B, "IF/WHILE nested too deep", NULL);
+        int c = ssa_ir_cond(B, in->arg[0]);
+        if (c < 0) return -1;
+        int then_b = ssa_ir_block(B, "then");
+        int else_b = ssa_ir_block(B, "else");
+        ssa_emit_br(sb, c, then_b, else_b);
+        B->nest_kind[B->depth] = IR_OP_IF;
+        B->nest_a[B->depth++] = else_b;
+        ssa_ir_enter(B, then_b);
+        return 0;
+    }
+    case IR_OP_ELSE: {
+        if (!B->depth || B->nest_kind[B->depth - 1] != IR_OP_IF) return ssa_ir_fail(B, "ELSE without IF", NULL);
+        int join = ssa_ir_block(B, "endif");
+        ssa_emit_jmp(sb, join);
+        B->nest_kind[B->depth - 1] = IR_OP_ELSE;
+        B->nest_b[B->depth - 1] = join;
+        ssa_ir_enter(B, B->nest_a[B->depth - 1]);
+        return 0;
+    }
+    case IR_OP_END_IF: {
+        if (!B->depth || B->nest_kind[B->depth - 1] == IR_OP_WHILE) return ssa_ir_fail(B, "END_IF without IF", NULL);
+        B->depth--;
+        // without ELSE the false block is the join
+        int join = B->nest_kind[B->depth] == IR_OP_ELSE ? B->nest_b[B->depth] : B->nest_a[B->depth];
+        ssa_emit_jmp(sb, join);
+        ssa_ir_enter(B, join);
+        return 0;
+    }
+    case IR_OP_WHILE: {
+        // WHILE r tests r at the top and END_WHILE tests r again at the bottom
+        if (in->nargs < 1) return ssa_ir_fail(B, "missing operand of", ir_str(in->op));
+        if (B->depth == SSA_IR_NEST_DEPTH) return ssa_ir_fail(B, "IF/WHILE nested too deep", NULL);
+        long long k;
+        double d;
+        if (ssa_ir_int_literal(ir_str(in->arg[0]), &k) || ssa_ir_float_literal(ir_str(in->arg[0]), &d))
+            return ssa_ir_fail(B, "WHILE on a literal:", ir_str(in->arg[0]));
+        int c = ssa_ir_cond(B, in->arg[0]);
+        if (c < 0) return -1;
+        int body = ssa_ir_block(B, "while");
+        int exit_b = ssa_ir_block(B, "wend");
+        ssa_emit_br(sb, c, body, exit_b);
+        B->nest_kind[B->depth] = IR_OP_WHILE;
+        B->nest_a[B->depth] = body;
+        B->nest_b[B->depth] = exit_b;
+        B->nest_cond[B->depth++] = in->arg[0];
+        ssa_ir_enter(B, body);
+        return 0;
+    }
+    case IR_OP_END_WHILE: {
+        if (!B->depth || B->nest_kind[B->depth - 1] != IR_OP_WHILE) return ssa_ir_fail(B, "END_WHILE without WHILE", NULL);
+        B->depth--;
+        int c = ssa_ir_cond(B, B->nest_cond[B->depth]);
+        if (c < 0) return -1;
+        ssa_emit_br(sb, c, B->nest_a[B->depth], B->nest_b[B->depth]);
+        ssa_ir_enter(B, B->nest_b[B->depth]);
+        return 0;
+    }
+    case IR_OP_HALT: case IR_OP_RET:
+        // without calls, RET leaves the program like HALT
+        ssa_emit(sb, SSA_HALT);
+        ssa_ir_dead(B);
+        return 0;
+    case IR_OP_CALL: case IR_OP_PARAM: case IR_OP_ARG:
+        return ssa_ir_fail(B, "calls share registers with their caller", NULL);
+    default:
+        return ssa_ir_fail(B, "unsupported op", ir_str(in->op));
+    }
+}
+
+// Builds `main` from ir[0..ir_count); NULL, with the reason in `why`, for a program outside
+// what the bridge takes.
+SSAModule* ssa_build_from_ir(char* why, size_t why_len) {
+    SSAIRBuilder B;
+    memset(&B, 0, sizeof(B));
+    B.why = why;
+    B.why_len = why_len;
+    B.dead = -1;
+    B.sb.f = ssa_new_function("main");
+    SSAFunction* f = B.sb.f;
+    size_t names = (size_t)ir_strtab_len + 1;
+    B.var_of = calloc(names, sizeof(int));
+    B.label_of = calloc(names, sizeof(int));
+    B.label_defined = calloc(names, 1);
+    if (!B.var_of || !B.label_of || !B.label_defined) { perror("ssa_build_from_ir"); exit(1); }
+
+    // the entry only holds the names' initial zeros, so a jump back to the first op re-runs none
+    f->entry = ssa_ir_block(&B, "entry");
+    f->blocks[f->entry].sealed = 1;
+    ssa_ir_enter(&B, f->entry);
+    int first = ssa_ir_block(&B, "bb");
+    ssa_emit_jmp(&B.sb, first);
+    ssa_ir_enter(&B, first);
+
+    int rc = 0;
+    for (int i = 0; i < ir_count && rc == 0; i++) rc = ssa_ir_stmt(&B, &ir[i]);
+    if (rc == 0 && B.depth) rc = ssa_ir_fail(&B, "unterminated IF/WHILE block", NULL);
+    if (rc == 0 && B.norder != f->nblocks) rc = ssa_ir_fail(&B, "block left unreached by the program text", NULL);
+    for (uint32_t id = 0; id < names && rc == 0; id++)
+        if (B.label_of[id] && !B.label_defined[id]) rc = ssa_ir_fail(&B, "undefined label", ir_str(id));
+
+    SSAModule* m = NULL;
+    if (rc == 0) {
+        if (ssa_terminator(f, B.sb.cur) < 0) ssa_emit(&B.sb, SSA_HALT);
+        for (int b = 0; b < f->nblocks; b++)
+            if (!f->blocks[b].sealed) ssa_seal_block(f, b);
+        for (int var = 0; var < B.nvars; var++) {
+            SSAInstr* z = &f->instrs[B.seed[var]];
+            if (B.kind[var] == SSA_KIND_FLOAT) { z->op = SSA_FCONST; z->is_float = 1; }
+            if (B.kind[var] == SSA_KIND_STRING) { z->op = SSA_SCONST; z->str = strdup(""); }
+        }
+        ssa_permute_blocks(f, B.order);
+        ssa_remove_trivial_phis(f);
+        ssa_remove_unreachable(f);
+        ssa_compact(f);
+        m = calloc(1, sizeof(SSAModule));
+        if (!m) { perror("ssa_build_from_ir"); exit(1); }
+        m->func_cap = 1;
+        m->funcs = ssa_xrealloc(NULL, sizeof(SSAFunction*));
+        m->funcs[m->nfuncs++] = f;
+        free(f->defs.keys);
+        free(f->defs.vals);
+        memset(&f->defs, 0, sizeof(f->defs));
+    }
+    else {
+        ssa_free_function(f);
+    }
+    free(B.var_of); free(B.label_of); free(B.label_defined);
+    free(B.kind); free(B.seed); free(B.order);
+    return m;
+}
+
+// Vector ops and calls have no flat IR form.
+static int ssa_ir_lowerable(SSAModule* m, char* why, size_t why_len) {
+    if (m->nfuncs != 1 || m->nglobals) {
+        snprintf(why, why_len, "the pipeline left %d functions", m->nfuncs);
+        return 0;
+    }
+    SSAFunction* f = m->funcs[0];
+    for (int b = 0; b < f->nblocks; b++)
+        for (int i = 0; i < f->blocks[b].ninstrs; i++) {
+            SSAOp op = f->instrs[f->blocks[b].instrs[i]].op;
+            if (op == SSA_PARAM || op == SSA_LOAD || op == SSA_STORE || op == SSA_CALL || op == SSA_COUNT ||
+                (op >= SSA_VSPLAT && op <= SSA_VEXTRACT)) {
+                snprintf(why, why_len, "%s has no flat IR form", ssa_op_names[op]);
+                return 0;
+            }
+        }
+    return 1;
+}
+
+static void ssa_ir_emit(const char* op, const char* d, const char* a, const char* b) {
+    const char* args[3] = { d, a, b };
+    size_t lens[3] = { d ? strlen(d) : 0, a ? strlen(a) : 0, b ? strlen(b) : 0 };
+    ir_append(op, strlen(op), args, lens, b ? 3 : a ? 2 : d ? 1 : 0);
+}
+
+// Name of value `v` in the lowered IR: constants are written in place, floats so that they do not
+// read back as integers.
+static const char* ssa_ir_name(SSAFunction* f, int v, char* buf, size_t len) {
+    SSAInstr* in = &f->instrs[v];
+    if (in->op == SSA_CONST && in->dst == v) {
+        snprintf(buf, len, "%lld", in->imm);
+    }
+    else if (in->op == SSA_FCONST && in->dst == v) {
+        snprintf(buf, len, "%.17g", in->fimm);
+        if (!strpbrk(buf, ".eEn")) strncat(buf, ".0", len - strlen(buf) - 1);
+    }
+    else {
+        snprintf(buf, len, "v%d", v);
+    }
+    return buf;
+}
+
+static const char* ssa_ir_opname(SSAOp op) {
+    static const char* const names[] = {
+        "ADD", "SUB", "MUL", "DIV", "MOD",
+        "FLOAT_ADD", "FLOAT_SUB", "FLOAT_MUL", "FLOAT_DIV",
+        "CMP_EQ", "CMP_NE", "CMP_LT", "CMP_LE", "CMP_GT", "CMP_GE",
+    };
+    return names[op - SSA_ADD];
+}
+
+// The branch of `term` once its condition is a constant, -1 while it is not.
+static int ssa_ir_static_target(SSAFunction* f, SSAInstr* term) {
+    if (term->op == SSA_JMP) return term->target[0];
+    SSAInstr* c = &f->instrs[term->args[0]];
+    if (term->target[0] == term->target[1]) return term->target[0];
+    if (c->op == SSA_CONST && c->dst == term->args[0]) return term->target[c->imm ? 0 : 1];
+    return -1;
+}
+
+// Profile count of each ir[0..ssa_ir_ncounts) instruction when ssa_optimize_ir() lowered a profiled
+// program, NULL otherwise; the backends rank register homes by it instead of loop depth.
+long long* ssa_ir_counts = NULL;
+int ssa_ir_ncounts = 0;
+
+// Replaces the IR buffer with out-of-SSA `main`, blocks in their current order: a LABEL on each
+// jump target, values named v<id>, and a BR becomes IFZ to its false side plus a JMP unless the
+// true side comes next. A block without a count (split by out-of-SSA) takes the previous one's.
+static void ssa_lower_to_ir(SSAModule* m) {
+    SSAFunction* f = m->funcs[0];
+    char d[32], a[32], b[32];
+    ssa_destruct(f);
+    unsigned char* target = calloc(f->nblocks + 1, 1);
+    for (int blk = 0; blk < f->nblocks; blk++) {
+        int t = ssa_terminator(f, blk);
+        if (t < 0 || (f->instrs[t].op != SSA_JMP && f->instrs[t].op != SSA_BR)) continue;
+        SSAInstr* term = &f->instrs[t];
+        int to = ssa_ir_static_target(f, term);
+        if (to >= 0) { if (to != blk + 1) target[to] = 1; continue; }
+        target[term->target[1]] = 1;
+        if (term->target[0] != blk + 1) target[term->target[0]] = 1;
+    }
+
+    ir_reset();
+    long long count = 0;
+    for (int blk = 0; blk < f->nblocks; blk++) {
+        SSABlock* bb = &f->blocks[blk];
+        int start = ir_count;
+        if (target[blk]) ssa_ir_emit("LABEL", bb->label, NULL, NULL);
+        for (int i = 0; i < bb->ninstrs; i++) {
+            int id = bb->instrs[i];
+            SSAInstr* in = &f->instrs[id];
+            snprintf(d, sizeof(d), "v%d", in->dst);
+            switch (in->op) {
+            case SSA_CONST: case SSA_FCONST:
+                break;
+            case SSA_SCONST:
+                ssa_ir_emit("LOAD_STR", d, in->str ? in->str : "", NULL);
+                break;
+            case SSA_UNDEF:
+                ssa_ir_emit(in->is_float ? "FLOAT_LOAD" : "LOAD", d, in->is_float ? "0.0" : "0", NULL);
+                break;
+            case SSA_COPY:
+                // a float copy says so, so the backends type the destination without following moves
+                ssa_ir_emit(in->is_float ? "FLOAT_LOAD" : "MOV", d, ssa_ir_name(f, in->args[0], a, sizeof(a)), NULL);
+                break;
+            case SSA_PRINT:
+                ssa_ir_emit("PRINT", ssa_ir_name(f, in->args[0], a, sizeof(a)), NULL, NULL);
+                break;
+            case SSA_JMP: case SSA_BR: {
+                int to = ssa_ir_static_target(f, in);
+                if (to >= 0) {
+                    if (to != blk + 1) ssa_ir_emit("JMP", f->blocks[to].label, NULL, NULL);
+                    break;
+                }
+                ssa_ir_emit("IFZ", ssa_ir_name(f, in->args[0], a, sizeof(a)), f->blocks[in->target[1]].label, NULL);
+                if (in->target[0] != blk + 1) ssa_ir_emit("JMP", f->blocks[in->target[0]].label, NULL, NULL);
+                break;
+            }
+            case SSA_RET: case SSA_HALT:
+                ssa_ir_emit("HALT", NULL, NULL, NULL);
+                break;
+            default:
+                ssa_ir_emit(ssa_ir_opname(in->op), d, ssa_ir_name(f, in->args[0], a, sizeof(a)),
+                    ssa_ir_name(f, in->args[1], b, sizeof(b)));
+                break;
+            }
+        }
+        if (!f->profiled || ir_count == start) continue;
+        if (bb->count >= 0) count = bb->count;
+        ssa_ir_counts = realloc(ssa_ir_counts, (size_t)ir_count * sizeof(long long));
+        if (!ssa_ir_counts) { perror("ssa_lower_to_ir"); exit(1); }
+        for (int i = start; i < ir_count; i++) ssa_ir_counts[i] = count;
+        ssa_ir_ncounts = ir_count;
+    }
+    free(target);
+}
+
+// Runs the IR buffer through the SSA pipeline of the current -O level (with --profile-use, if
+// given) and puts the result back. A program the bridge does not take, or the -O0 pipeline,
+// leaves the buffer as it is. Returns 1 when the buffer was rewritten.
+int ssa_optimize_ir(FILE* report) {
+    int order[2 * SSA_NPASSES + 8];
+    free(ssa_ir_counts);
+    ssa_ir_counts = NULL;
+    ssa_ir_ncounts = 0;
+    if (ssa_build_pipeline(order) == 0) return 0;
+    char why[128];
+    SSAModule* m = ssa_build_from_ir(why, sizeof(why));
+    if (!m) {
+        if (report) fprintf(report, "[OPT] IR left unoptimized: %s\n", why);
+        return 0;
+    }
+    int before = ir_count;
+    ssa_optimize_module(m, report);
+    int ok = ssa_ir_lowerable(m, why, sizeof(why));
+    if (ok) ssa_lower_to_ir(m);
+    if (report && ok) fprintf(report, "[OPT] IR %d -> %d ops\n", before, ir_count);
+    if (report && !ok) fprintf(report, "[OPT] IR left unoptimized: %s\n", why);
+    ssa_free_module(m);
+    return ok;
+}
+
+// Training run for --profile-use: builds the IR program at `ir_path` the way ssa_optimize_ir()
+// will, instruments it and runs it silently in the SSA interpreter, which writes the profile.
+// Native code is never instrumented. Returns nonzero if the program cannot be profiled.
+int ssa_profile_ir_file(const char* ir_path) {
+    char why[128];
+    ir_reset();
+    if (ir_load_any(ir_path) != 0) return -1;
+    SSAModule* m = ssa_build_from_ir(why, sizeof(why));
+    ir_reset();
+    if (!m) {
+        fprintf(stderr, "[PGO] %s cannot be profiled: %s\n", ir_path, why);
+        return -1;
+    }
+    int counters = ssa_profile_instrument(m);
+    SSAExec x;
+    int rc = ssa_exec_run(m, NULL, 0, &x);
+    if (rc == 0)
+        fprintf(stderr, "[PGO] %s: %d counters, %lld instructions executed -> %s\n", ir_path, counters, x.steps, ssa_profile_out);
+    else
+        fprintf(stderr, "[PGO] %s trapped in the training run; no profile written\n", ir_path);
+    ssa_free_module(m);
+    return rc;
+}
+
+// Structured loop and branch, float and string values, and a hand-written label loop.
+static const char* ssa_ir_sample[] = {
+    "LOAD i, 0", "LOAD sum, 0", "LOAD n, 10", "CMP_LT c, i, n", "WHILE c",
+    "MOD r, i, 3", "CMP_EQ z, r, 0", "IF z", "ADD sum, sum, i", "ELSE", "SUB sum, sum, 1", "END_IF",
+    "ADD i, i, 1", "CMP_LT c, i, n", "END_WHILE", "PRINT sum",
+    "FLOAT_LOAD f, 1.5", "FLOAT_MUL f, 2.0", "PRINT f", "LOAD_STR s, done", "PRINT s",
+    "LOAD k, 3", "LABEL top", "SUB k, k, 1", "PRINT k", "IFZ k, out", "JMP top", "LABEL out", "HALT",
+};
+static const char ssa_ir_sample_output[] = "12\n3\ndone\n2\n1\n0\n";
+
+static void ssa_ir_load_sample(void) {
+    char line[64];
+    ir_reset();
+    for (size_t i = 0; i < sizeof(ssa_ir_sample) / sizeof(ssa_ir_sample[0]); i++) {
+        size_t len = strlen(ssa_ir_sample[i]);
+        memcpy(line, ssa_ir_sample[i], len + 1);
+        ir_parse_line(line, len);
+    }
+}
+
+// Builds the sample program from flat IR, lowers it back at every -O level and builds the
+// result again; both SSA runs must print the expected text. Returns nonzero on a mismatch.
+int ssa_bench_ir_roundtrip(void) {
+    const SSAOptLevel* saved = ssa_opt_level;
+    int nlevels = (int)(sizeof(ssa_opt_levels) / sizeof(ssa_opt_levels[0]));
+    unsigned long long expect = 0xCBF29CE484222325ULL;
+    for (const char* p = ssa_ir_sample_output; *p; p++) expect = (expect ^ (unsigned char)*p) * 0x100000001B3ULL;
+    int failed = 0;
+    for (int l = 0; l < nlevels; l++) {
+        ssa_opt_level = &ssa_opt_levels[l];
+        char why[128] = "";
+        SSAExec before, after;
+        ssa_ir_load_sample();
+        int ops0 = ir_count;
+        SSAModule* m = ssa_build_from_ir(why, sizeof(why));
+        int rc = m ? ssa_exec_run(m, NULL, 0, &before) : -1;
+        if (m) ssa_free_module(m);
+        ssa_optimize_ir(NULL);
+        int ops1 = ir_count;
+        m = rc == 0 ? ssa_build_from_ir(why, sizeof(why)) : NULL;
+        if (m && ssa_exec_run(m, NULL, 0, &after) != 0) rc = -1;
+        if (m) ssa_free_module(m);
+        int ok = m && rc == 0 && before.checksum == expect && after.checksum == expect;
+        printf("[SSA-BENCH] IR round trip -O%s: %d -> %d ops%s\n", ssa_opt_level->level, ops0, ops1,
+            ok ? "" : "  OUTPUT MISMATCH");
+        if (!ok && why[0]) printf("[SSA-BENCH] IR round trip: %s\n", why);
+        failed |= !ok;
+    }
+    ir_reset();
+    ssa_opt_level = saved;
+    return failed;
+}
+
+// === Optimization benchmarks ===
+
+// Constant configuration values feeding a hot loop, including a debug branch that never runs.
+static ASTNode* ssa_prog_consts(int n) {
+    ASTNode* p = ast_new(AST_PROGRAM);
+    ast_add_kid(p, ast_assign("debug", ast_num(0)));
+    ast_add_kid(p, ast_assign("width", ast_num(16)));
+    ast_add_kid(p, ast_assign("height", ast_num(9)));
+    ast_add_kid(p, ast_assign("scale", ast_num(3)));
+    ast_add_kid(p, ast_assign("total", ast_num(0)));
+    ASTNode* body = ast_new(AST_BLOCK);
+    ast_add_kid(body, ast_assign("area", ast_binop("*", ast_binop("*", ast_var("width"), ast_var("height")), ast_var("scale"))));
+    ASTNode* dbg = ast_new(AST_BLOCK);
+    ast_add_kid(dbg, ast_print(ast_var("area")));
+    ast_add_kid(body, ast_if(ast_binop("==", ast_var("debug"), ast_num(1)), dbg, NULL));
+    ast_add_kid(body, ast_assign("half", ast_binop("-", ast_binop("/", ast_var("area"), ast_num(2)), ast_num(1))));
+    ast_add_kid(body, ast_assign("total", ast_binop("+", ast_binop("+", ast_var("total"), ast_binop("%", ast_var("i"), ast_num(7))), ast_var("half"))));
+    ast_add_kid(p, ast_for("i", ast_num(n), body));
+    ast_add_kid(p, ast_print(ast_var("total")));
+    return p;
+}
+
+// Float constants and a float compare whose outcome is fixed.
+static ASTNode* ssa_prog_float(int n) {
+    ASTNode* p = ast_new(AST_PROGRAM);
+    ast_add_kid(p, ast_assign("pi", ast_float(3.14159)));
+    ast_add_kid(p, ast_assign("r", ast_float(2.0)));
+    ast_add_kid(p, ast_assign("unit", ast_float(1.0)));
+    ast_add_kid(p, ast_assign("acc", ast_float(0.0)));
+    ASTNode* body = ast_new(AST_BLOCK);
+    ast_add_kid(body, ast_assign("circle", ast_binop("*", ast_binop("*", ast_var("pi"), ast_var("r")), ast_var("r"))));
+    ast_add_kid(body, ast_assign("ratio", ast_binop("/", ast_var("circle"), ast_binop("+", ast_var("unit"), ast_var("unit")))));
+    ASTNode* big = ast_new(AST_BLOCK);
+    ast_add_kid(big, ast_assign("acc", ast_binop("-", ast_var("acc"), ast_var("ratio"))));
+    ASTNode* small = ast_new(AST_BLOCK);
+    ast_add_kid(small, ast_assign("acc", ast_binop("+", ast_var("acc"), ast_var("ratio"))));
+    ast_add_kid(body, ast_if(ast_binop(">", ast_var("ratio"), ast_float(100.0)), big, small));
+    ast_add_kid(p, ast_for("i", ast_num(n), body));
+    ast_add_kid(p, ast_print(ast_var("acc")));
+    return p;
+}
+
+// Mode flags selecting one arm of nested ifs, plus a verbose print that is compiled out.
+static ASTNode* ssa_prog_branches(int n) {
+    ASTNode* p = ast_new(AST_PROGRAM);
+    ast_add_kid(p, ast_assign("mode", ast_num(2)));
+    ast_add_kid(p, ast_assign("verbose", ast_num(0)));
+    ast_add_kid(p, ast_assign("x", ast_num(0)));
+    ASTNode* body = ast_new(AST_BLOCK);
+    ASTNode* m1 = ast_new(AST_BLOCK);
+    ast_add_kid(m1, ast_assign("x", ast_binop("+", ast_var("x"), ast_var("i"))));
+    ASTNode* m2 = ast_new(AST_BLOCK);
+    ast_add_kid(m2, ast_assign("x", ast_binop("+", ast_var("x"), ast_binop("*", ast_num(2), ast_var("i")))));
+    ASTNode* m3 = ast_new(AST_BLOCK);
+    ast_add_kid(m3, ast_assign("x", ast_binop("-", ast_var("x"), ast_var("i"))));
+    ASTNode* inner = ast_new(AST_BLOCK);
+    ast_add_kid(inner, ast_if(ast_binop("==", ast_var("mode"), ast_num(2)), m2, m3));
+    ast_add_kid(body, ast_if(ast_binop("==", ast_var("mode"), ast_num(1)), m1, inner));
+    ASTNode* trace = ast_new(AST_BLOCK);
+    ast_add_kid(trace, ast_print(ast_var("x")));
+    ast_add_kid(body, ast_if(ast_binop("!=", ast_var("verbose"), ast_num(0)), trace, NULL));
+    ast_add_kid(p, ast_for("i", ast_num(n), body));
+    ast_add_kid(p, ast_print(ast_var("x")));
+    return p;
+}
+
+// Temporaries nobody reads, a global that is only ever written and a helper nobody calls.
+static ASTNode* ssa_prog_deadcode(int n) {
+    ASTNode* p = ast_new(AST_PROGRAM);
+    ASTNode* helper = ast_func("unused_helper");
+    ast_add_kid(helper, ast_var("a"));
+    ast_add_kid(helper->rhs, ast_assign("trace", ast_var("a")));
+    ast_add_kid(helper->rhs, ast_return(ast_binop("*", ast_var("a"), ast_num(2))));
+    ast_add_kid(p, helper);
+    ASTNode* bump = ast_func("bump");
+    ast_add_kid(bump, ast_var("x"));
+    ast_add_kid(bump->rhs, ast_assign("scratch", ast_binop("*", ast_var("x"), ast_var("x"))));
+    ast_add_kid(bump->rhs, ast_return(ast_binop("+", ast_var("x"), ast_num(1))));
+    ast_add_kid(p, bump);
+    ast_add_kid(p, ast_assign("sum", ast_num(0)));
+    ast_add_kid(p, ast_assign("trace", ast_num(0)));
+    ASTNode* body = ast_new(AST_BLOCK);
+    ast_add_kid(body, ast_assign("tmp", ast_binop("*", ast_var("i"), ast_num(3))));
+    ast_add_kid(body, ast_assign("sq", ast_binop("+", ast_binop("*", ast_var("i"), ast_var("i")), ast_var("tmp"))));
+    ast_add_kid(body, ast_assign("trace", ast_var("i")));
+    ast_add_kid(body, ast_assign("trace", ast_var("sum")));
+    ASTNode* call = ast_call("bump");
+    ast_add_kid(call, ast_var("sum"));
+    ast_add_kid(body, ast_assign("sum", ast_binop("+", call, ast_binop("%", ast_var("i"), ast_num(3)))));
+    ast_add_kid(p, ast_for("i", ast_num(n), body));
+    ast_add_kid(p, ast_print(ast_var("sum")));
+    return p;
+}
+
+// ADDXY-style macro bodies expanded inline: every expansion reloads the globals x and y.
+static ASTNode* ssa_prog_macros(int n) {
+    ASTNode* p = ast_new(AST_PROGRAM);
+    ASTNode* setup = ast_func("setup");
+    ast_add_kid(setup->rhs, ast_assign("x", ast_num(3)));
+    ast_add_kid(setup->rhs, ast_assign("y", ast_num(4)));
+    ast_add_kid(p, setup);
+    ast_add_kid(p, ast_call("setup"));
+    ast_add_kid(p, ast_assign("total", ast_num(0)));
+    ASTNode* body = ast_new(AST_BLOCK);
+    ast_add_kid(body, ast_assign("a", ast_binop("+", ast_var("x"), ast_var("y"))));
+    ast_add_kid(body, ast_assign("b", ast_binop("+", ast_var("x"), ast_var("y"))));
+    ast_add_kid(body, ast_assign("c", ast_binop("+", ast_binop("*", ast_var("a"), ast_var("i")), ast_binop("*", ast_var("i"), ast_var("b")))));
+    ast_add_kid(body, ast_assign("d", ast_binop("*", ast_binop("+", ast_var("y"), ast_var("x")), ast_var("i"))));
+    ast_add_kid(body, ast_assign("total", ast_binop("+", ast_var("total"), ast_binop("-", ast_var("c"), ast_var("d")))));
+    ast_add_kid(p, ast_for("i", ast_num(n), body));
+    ast_add_kid(p, ast_print(ast_var("total")));
+    return p;
+}
+
+// Row-major array<int> walk: element addresses are base + r * rowbytes + c * stride, with the
+// layout in globals so every access reloads it.
+static ASTNode* ssa_prog_loops(int n) {
+    ASTNode* p = ast_new(AST_PROGRAM);
+    ASTNode* layout = ast_func("layout");
+    ast_add_kid(layout->rhs, ast_assign("base", ast_num(4096)));
+    ast_add_kid(layout->rhs, ast_assign("stride", ast_num(8)));
+    ast_add_kid(layout->rhs, ast_assign("rowbytes", ast_num(512)));
+    ast_add_kid(p, layout);
+    ast_add_kid(p, ast_call("layout"));
+    ast_add_kid(p, ast_assign("sum", ast_num(0)));
+    ASTNode* inner = ast_new(AST_BLOCK);
+    ast_add_kid(inner, ast_assign("addr", ast_binop("+", ast_binop("+", ast_var("base"), ast_binop("*", ast_var("r"), ast_var("rowbytes"))),
+        ast_binop("*", ast_var("c"), ast_var("stride")))));
+    ast_add_kid(inner, ast_assign("bias", ast_binop("+", ast_binop("*", ast_var("stride"), ast_num(2)), ast_binop("/", ast_var("base"), ast_num(64)))));
+    ast_add_kid(inner, ast_assign("sum", ast_binop("+", ast_var("sum"), ast_binop("+", ast_binop("%", ast_var("addr"), ast_num(97)), ast_var("bias")))));
+    ASTNode* outer = ast_new(AST_BLOCK);
+    ast_add_kid(outer, ast_for("c", ast_num(64), inner));
+    ast_add_kid(p, ast_for("r", ast_num(n / 64 > 0 ? n / 64 : 1), outer));
+    ast_add_kid(p, ast_print(ast_var("sum")));
+    return p;
+}
+
+// greet(name)-style helpers called from a hot loop, one of them recursive.
+static ASTNode* ssa_prog_calls(int n) {
+    ASTNode* p = ast_new(AST_PROGRAM);
+    ASTNode* square = ast_func("square");
+    ast_add_kid(square, ast_var("x"));
+    ast_add_kid(square->rhs, ast_return(ast_binop("*", ast_var("x"), ast_var("x"))));
+    ast_add_kid(p, square);
+    ASTNode* scale = ast_func("scale");
+    ast_add_kid(scale, ast_var("v"));
+    ast_add_kid(scale, ast_var("k"));
+    ast_add_kid(scale->rhs, ast_return(ast_binop("+", ast_binop("*", ast_var("v"), ast_var("k")), ast_num(1))));
+    ast_add_kid(p, scale);
+    ASTNode* clamp = ast_func("clamp");
+    ast_add_kid(clamp, ast_var("v"));
+    ASTNode* cap = ast_new(AST_BLOCK);
+    ast_add_kid(cap, ast_return(ast_num(1000)));
+    ast_add_kid(clamp->rhs, ast_if(ast_binop(">", ast_var("v"), ast_num(1000)), cap, NULL));
+    ast_add_kid(clamp->rhs, ast_return(ast_var("v")));
+    ast_add_kid(p, clamp);
+    ASTNode* fact = ast_func("fact");
+    ast_add_kid(fact, ast_var("k"));
+    ASTNode* one = ast_new(AST_BLOCK);
+    ast_add_kid(one, ast_return(ast_num(1)));
+    ast_add_kid(fact->rhs, ast_if(ast_binop("<=", ast_var("k"), ast_num(1)), one, NULL));
+    ASTNode* rec = ast_call("fact");
+    ast_add_kid(rec, ast_binop("-", ast_var("k"), ast_num(1)));
+    ast_add_kid(fact->rhs, ast_return(ast_binop("*", ast_var("k"), rec)));
+    ast_add_kid(p, fact);
+
+    ast_add_kid(p, ast_assign("total", ast_num(0)));
+    ASTNode* body = ast_new(AST_BLOCK);
+    ASTNode* sq = ast_call("square");
+    ast_add_kid(sq, ast_binop("%", ast_var("i"), ast_num(16)));
+    ASTNode* sc = ast_call("scale");
+    ast_add_kid(sc, ast_var("i"));
+    ast_add_kid(sc, ast_num(3));
+    ASTNode* cl = ast_call("clamp");
+    ast_add_kid(cl, ast_var("i"));
+    ASTNode* fa = ast_call("fact");
+    ast_add_kid(fa, ast_num(3));
+    ast_add_kid(body, ast_assign("total", ast_binop("+", ast_var("total"), ast_binop("+", ast_binop("+", sq, sc), ast_binop("-", cl, fa)))));
+    ast_add_kid(p, ast_for("i", ast_num(n), body));
+    ast_add_kid(p, ast_print(ast_var("total")));
+    return p;
+}
+
+// Per-element arithmetic folded into reductions under `vectorize`; the second loop's accumulator
+// feeds itself through a multiply, so it is refused and stays scalar.
+static ASTNode* ssa_prog_vector(int n) {
+    ASTNode* p = ast_new(AST_PROGRAM);
+    ast_add_kid(p, ast_assign("sum", ast_num(0)));
+    ast_add_kid(p, ast_assign("energy", ast_num(0)));
+    ast_add_kid(p, ast_assign("hits", ast_num(0)));
+    ASTNode* body = ast_new(AST_BLOCK);
+    ast_add_kid(body, ast_assign("x", ast_binop("+", ast_binop("*", ast_var("i"), ast_num(3)), ast_num(7))));
+    ast_add_kid(body, ast_assign("sum", ast_binop("+", ast_var("sum"), ast_var("x"))));
+    ast_add_kid(body, ast_assign("energy", ast_binop("+", ast_var("energy"), ast_binop("-", ast_binop("*", ast_var("x"), ast_var("x")), ast_var("i")))));
+    ast_add_kid(body, ast_assign("hits", ast_binop("+", ast_var("hits"), ast_binop(">", ast_binop("*", ast_var("i"), ast_float(0.5)), ast_float(100.0)))));
+    ast_add_kid(p, ast_vectorize(ast_for("i", ast_num(n), body)));
+    ast_add_kid(p, ast_assign("hash", ast_num(7)));
+    ASTNode* mix = ast_new(AST_BLOCK);
+    ast_add_kid(mix, ast_assign("hash", ast_binop("+", ast_binop("*", ast_var("hash"), ast_num(31)), ast_var("j"))));
+    ast_add_kid(p, ast_vectorize(ast_for("j", ast_num(16), mix)));
+    ast_add_kid(p, ast_print(ast_var("sum")));
+    ast_add_kid(p, ast_print(ast_var("energy")));
+    ast_add_kid(p, ast_print(ast_var("hits")));
+    ast_add_kid(p, ast_print(ast_var("hash")));
+    return p;
+}
+
+// A hot helper too big for the static inliner, a cold one it would inline anyway, and branches
+// whose common side is not the one the builder places next.
+static ASTNode* ssa_prog_profile(int n) {
+    ASTNode* p = ast_new(AST_PROGRAM);
+    ASTNode* mix = ast_func("mix");
+    ast_add_kid(mix, ast_var("x"));
+    ast_add_kid(mix->rhs, ast_assign("a", ast_binop("%", ast_binop("+", ast_binop("*", ast_var("x"), ast_num(31)), ast_num(7)), ast_num(1009))));
+    ast_add_kid(mix->rhs, ast_assign("b", ast_binop("%", ast_binop("+", ast_binop("*", ast_var("a"), ast_var("a")), ast_var("x")), ast_num(4093))));
+    ast_add_kid(mix->rhs, ast_assign("c", ast_binop("%", ast_binop("+", ast_binop("*", ast_var("b"), ast_num(13)), ast_var("a")), ast_num(8191))));
+    ast_add_kid(mix->rhs, ast_assign("d", ast_binop("+", ast_binop("*", ast_var("c"), ast_var("b")), ast_binop("/", ast_var("a"), ast_num(3)))));
+    ast_add_kid(mix->rhs, ast_assign("e", ast_binop("%", ast_binop("+", ast_binop("*", ast_var("d"), ast_num(7)), ast_var("c")), ast_num(32749))));
+    ast_add_kid(mix->rhs, ast_assign("g", ast_binop("*", ast_binop("+", ast_binop("%", ast_binop("+", ast_binop("*", ast_var("e"), ast_num(11)), ast_var("b")), ast_num(127)), ast_var("c")), ast_num(5))));
+    ast_add_kid(mix->rhs, ast_return(ast_binop("%", ast_binop("+", ast_binop("*", ast_var("g"), ast_var("e")), ast_var("d")), ast_num(65521))));
+    ast_add_kid(p, mix);
+    ASTNode* report = ast_func("report");
+    ast_add_kid(report, ast_var("v"));
+    ast_add_kid(report->rhs, ast_print(ast_var("v")));
+    ast_add_kid(report->rhs, ast_return(ast_binop("*", ast_var("v"), ast_num(2))));
+    ast_add_kid(p, report);
+
+    ast_add_kid(p, ast_assign("total", ast_num(0)));
+    ast_add_kid(p, ast_assign("bonus", ast_num(0)));
+    ASTNode* body = ast_new(AST_BLOCK);
+    ASTNode* call = ast_call("mix");
+    ast_add_kid(call, ast_binop("+", ast_var("total"), ast_var("i")));
+    ast_add_kid(body, ast_assign("total", call));
+    ASTNode* rare = ast_new(AST_BLOCK);
+    ast_add_kid(rare, ast_assign("bonus", ast_binop("+", ast_var("bonus"), ast_var("total"))));
+    ast_add_kid(body, ast_if(ast_binop("==", ast_binop("%", ast_var("i"), ast_num(64)), ast_num(0)), rare, NULL));
+    ASTNode* never = ast_new(AST_BLOCK);
+    ASTNode* rep = ast_call("report");
+    ast_add_kid(rep, ast_var("total"));
+    ast_add_kid(never, ast_assign("bonus", rep));
+    ast_add_kid(body, ast_if(ast_binop(">", ast_var("total"), ast_num(1000000)), never, NULL));
+    ast_add_kid(p, ast_for("i", ast_num(n), body));
+    ast_add_kid(p, ast_print(ast_var("total")));
+    ast_add_kid(p, ast_print(ast_var("bonus")));
+    return p;
+}
+
+// Accumulator recursion `n` calls deep, and two functions returning each other's result. Kept out
+// of the shared table: unoptimized, it overflows the interpreter's call depth.
+static ASTNode* ssa_prog_tailcall(int n) {
+    ASTNode* p = ast_new(AST_PROGRAM);
+    ASTNode* sum = ast_func("sum");
+    ast_add_kid(sum, ast_var("k"));
+    ast_add_kid(sum, ast_var("acc"));
+    ASTNode* done = ast_new(AST_BLOCK);
+    ast_add_kid(done, ast_return(ast_var("acc")));
+    ast_add_kid(sum->rhs, ast_if(ast_binop("<=", ast_var("k"), ast_num(0)), done, NULL));
+    ASTNode* rec = ast_call("sum");
+    ast_add_kid(rec, ast_binop("-", ast_var("k"), ast_num(1)));
+    ast_add_kid(rec, ast_binop("+", ast_var("acc"), ast_var("k")));
+    ast_add_kid(sum->rhs, ast_return(rec));
+    ast_add_kid(p, sum);
+    static const char* const names[2] = { "even", "odd" };
+    for (int e = 0; e < 2; e++) {
+        ASTNode* fn = ast_func(names[e]);
+        ast_add_kid(fn, ast_var("k"));
+        ASTNode* base = ast_new(AST_BLOCK);
+        ast_add_kid(base, ast_return(ast_num(e == 0)));
+        ast_add_kid(fn->rhs, ast_if(ast_binop("==", ast_var("k"), ast_num(0)), base, NULL));
+        ASTNode* other = ast_call(names[1 - e]);
+        ast_add_kid(other, ast_binop("-", ast_var("k"), ast_num(1)));
+        ast_add_kid(fn->rhs, ast_return(other));
+        ast_add_kid(p, fn);
+    }
+    ASTNode* top = ast_call("sum");
+    ast_add_kid(top, ast_num(n));
+    ast_add_kid(top, ast_num(0));
+    ast_add_kid(p, ast_print(top));
+    ASTNode* parity = ast_call("even");
+    ast_add_kid(parity, ast_num(n));
+    ast_add_kid(p, ast_print(parity));
+    return p;
+}
+
+typedef struct {
+    const char* name;
+    ASTNode* (*build)(int n);
+} SSABenchProgram;
+
+static const SSABenchProgram ssa_bench_programs[] = {
+    { "consts", ssa_prog_consts },
+    { "float", ssa_prog_float },
+    { "branches", ssa_prog_branches },
+    { "deadcode", ssa_prog_deadcode },
+    { "macros", ssa_prog_macros },
+    { "loops", ssa_prog_loops },
+    { "calls", ssa_prog_calls },
+    { "vector", ssa_prog_vector },
+    { "profile", ssa_prog_profile },
+};
+
+// Counts `op` instructions in function `name` (every function when NULL), only those in loop
+// blocks when `in_loops` is set.
+static int ssa_bench_count(SSAModule* m, const char* name, SSAOp op, int in_loops) {
+    int count = 0;
+    for (int i = 0; i < m->nfuncs; i++) {
+        SSAFunction* f = m->funcs[i];
+        if (name && strcmp(f->name, name) != 0) continue;
+        unsigned char* looped = calloc(f->nblocks + 1, 1);
+        if (in_loops && f->in_ssa && f->entry >= 0) {
+            int* idom = malloc(f->nblocks * sizeof(int));
+            ssa_dominators(f, idom);
+            SSALoop* loops;
+            int nloops = ssa_find_loops(f, idom, &loops);
+            for (int l = 0; l < nloops; l++)
+                for (int b = 0; b < loops[l].nb; b++) looped[b] |= loops[l].in_loop[b];
+            ssa_free_loops(loops, nloops);
+            free(idom);
+        }
+        for (int b = 0; b < f->nblocks; b++) {
+            if (in_loops && !looped[b]) continue;
+            for (int k = 0; k < f->blocks[b].ninstrs; k++)
+                if (f->instrs[f->blocks[b].instrs[k]].op == op) count++;
+        }
+        free(looped);
+    }
+    return count;
+}
+
+// Runs `pass` over every benchmark program and compares static size, executed instructions
+// and interpreter time with the unoptimized module; printed output must not change, and `check`
+// (when given) names what the pass should have done to a program but did not. Returns nonzero
+// on either failure.
+int ssa_bench_pass(const char* label, int (*pass)(SSAModule*), const char* (*check)(const char* program, SSAModule* m), int n) {
+    int count = (int)(sizeof(ssa_bench_programs) / sizeof(ssa_bench_programs[0]));
+    int failed = 0;
+    for (int p = 0; p < count; p++) {
+        ASTNode* program = ssa_bench_programs[p].build(n);
+        SSAModule* base = ssa_build_module(program);
+        SSAModule* opt = ssa_build_module(program);
+        int changes = pass(opt);
+
+        long long steps0, steps1;
+        unsigned long long sum0, sum1;
+        double t0 = ssa_now_ms();
+        ssa_exec_module(base, NULL, 0, &steps0, &sum0);
+        double t1 = ssa_now_ms();
+        ssa_exec_module(opt, NULL, 0, &steps1, &sum1);
+        double t2 = ssa_now_ms();
+
+        int size0 = ssa_module_size(base), size1 = ssa_module_size(opt);
+        printf("[OPT-BENCH] %-8s %-10s %d changes, instrs %d -> %d (%.1f%%), executed %lld -> %lld (%.1f%%), %.2f -> %.2f ms%s\n",
+            label, ssa_bench_programs[p].name, changes, size0, size1,
+            size0 ? 100.0 * (size1 - size0) / size0 : 0.0, steps0, steps1,
+            steps0 ? 100.0 * (double)(steps1 - steps0) / (double)steps0 : 0.0,
+            t1 - t0, t2 - t1, sum0 == sum1 ? "" : "  OUTPUT MISMATCH");
+        failed |= sum0 != sum1;
+        const char* wrong = check ? check(ssa_bench_programs[p].name, opt) : NULL;
+        if (wrong) printf("[OPT-BENCH] %-8s %-10s WRONG SHAPE: %s\n", label, ssa_bench_programs[p].name, wrong);
+        failed |= wrong != NULL;
+        ssa_free_module(base);
+        ssa_free_module(opt);
+        ast_free(program);
+    }
+    return failed;
+}
+
+static int ssa_sccp_pass(SSAModule* m) {
+    return ssa_sccp_module(m, NULL);
+}
+
+// The constant flags leave only the loop exit branch, and the debug and verbose prints go with
+// their branches.
+static const char* ssa_sccp_check(const char* program, SSAModule* m) {
+    int fixed = strcmp(program, "consts") == 0 || strcmp(program, "float") == 0 || strcmp(program, "branches") == 0;
+    if (fixed && ssa_bench_count(m, "main", SSA_BR, 0) != 1) return "a branch on a constant is left";
+    if (fixed && ssa_bench_count(m, "main", SSA_PRINT, 0) != 1) return "a print that never runs is left";
+    return NULL;
+}
+
+int ssa_bench_sccp(int n) {
+    return ssa_bench_pass("sccp", ssa_sccp_pass, ssa_sccp_check, n);
+}
+
+static int ssa_dce_pass(SSAModule* m) {
+    return ssa_dce_module(m, NULL);
+}
+
+static int ssa_pipeline_pass(SSAModule* m) {
+    return ssa_optimize_module(m, NULL);
+}
+
+// deadcode loses its uncalled helper, its write-only global and every multiply, all of which
+// only feed values nobody reads.
+static const char* ssa_dce_check(const char* program, SSAModule* m) {
+    if (strcmp(program, "deadcode") != 0) return NULL;
+    if (ssa_find_function(m, "unused_helper")) return "unused_helper is still there";
+    if (ssa_bench_count(m, NULL, SSA_STORE, 0)) return "a store to a global nobody reads is left";
+    if (ssa_bench_count(m, NULL, SSA_MUL, 0)) return "an unused multiply is left";
+    return NULL;
+}
+
+int ssa_bench_dce(int n) {
+    return ssa_bench_pass("dce", ssa_dce_pass, ssa_dce_check, n) | ssa_bench_pass("pipeline", ssa_pipeline_pass, NULL, n);
+}
+
+static int ssa_gvn_pass(SSAModule* m) {
+    return ssa_gvn_module(m, NULL);
+}
+
+// No program keeps a redundant op, and the macro expansions load x and y once per iteration.
+static const char* ssa_gvn_check(const char* program, SSAModule* m) {
+    if (ssa_count_redundant_module(m)) return "a redundant op is left";
+    if (strcmp(program, "macros") == 0 && ssa_bench_count(m, "main", SSA_LOAD, 1) > 2) return "x or y is reloaded within an iteration";
+    return NULL;
+}
+
+int ssa_bench_gvn(int n) {
+    int count = (int)(sizeof(ssa_bench_programs) / sizeof(ssa_bench_programs[0]));
+    for (int p = 0; p < count; p++) {
+        ASTNode* program = ssa_bench_programs[p].build(n);
+        SSAModule* m = ssa_build_module(program);
+        int before = ssa_count_redundant_module(m);
+        ssa_gvn_module(m, NULL);
+        printf("[OPT-BENCH] gvn      %-10s redundant ops %d -> %d\n", ssa_bench_programs[p].name, before, ssa_count_redundant_module(m));
+        ssa_free_module(m);
+        ast_free(program);
+    }
+    return ssa_bench_pass("gvn", ssa_gvn_pass, ssa_gvn_check, n);
+}
+
+static int ssa_loops_pass(SSAModule* m) {
+    return ssa_optimize_loops_module(m, NULL);
+}
+
+// In consts, macros and loops every multiply and divide inside a loop is invariant or i * k, and
+// the globals are never stored in the loop: nothing of the kind may stay in a loop block.
+static const char* ssa_loops_check(const char* program, SSAModule* m) {
+    if (strcmp(program, "consts") != 0 && strcmp(program, "macros") != 0 && strcmp(program, "loops") != 0) return NULL;
+    if (ssa_bench_count(m, "main", SSA_MUL, 1)) return "a multiply is left in a loop";
+    if (ssa_bench_count(m, "main", SSA_DIV, 1)) return "an invariant divide is left in a loop";
+    if (ssa_bench_count(m, "main", SSA_LOAD, 1)) return "an invariant global load is left in a loop";
+    return NULL;
+}
+
+int ssa_bench_loops(int n) {
+    return ssa_bench_pass("loops", ssa_loops_pass, ssa_loops_check, n) | ssa_bench_pass("pipeline", ssa_pipeline_pass, NULL, n);
+}
+
+static int ssa_inline_pass(SSAModule* m) {
+    return ssa_inline_module(m, NULL, NULL);
+}
+
+// At the default budget or above, main keeps no call to a small helper; the recursive fact in
+// calls stays a call. A smaller --inline-budget may legitimately leave calls, so it is not checked.
+static const char* ssa_inline_check(const char* program, SSAModule* m) {
+    SSAFunction* f = ssa_find_function(m, "main");
+    int small = strcmp(program, "calls") == 0 || strcmp(program, "deadcode") == 0 ||
+        strcmp(program, "macros") == 0 || strcmp(program, "loops") == 0;
+    if (!f || !small || ssa_inline_params.growth_percent < 50) return NULL;
+    int fact = 0;
+    for (int b = 0; b < f->nblocks; b++)
+        for (int k = 0; k < f->blocks[b].ninstrs; k++) {
+            SSAInstr* in = &f->instrs[f->blocks[b].instrs[k]];
+            if (in->op != SSA_CALL) continue;
+            if (strcmp(in->name, "fact") != 0) return "a call to a small helper is left in main";
+            fact++;
+        }
+    if (strcmp(program, "calls") == 0 && fact != 1) return "the recursive fact was inlined";
+    return NULL;
+}
+
+int ssa_bench_inline(int n) {
+    printf("[OPT-BENCH] inline threshold %d, growth budget %d%%\n", ssa_inline_params.threshold, ssa_inline_params.growth_percent);
+    return ssa_bench_pass("inline", ssa_inline_pass, ssa_inline_check, n) | ssa_bench_pass("pipeline", ssa_pipeline_pass, NULL, n);
+}
+
+static int ssa_vectorize_pass(SSAModule* m) {
+    return ssa_vectorize_module(m, NULL);
+}
+
+static int ssa_vector_bench_trips;     // n of the running --bench-vectorize
+
+// vector gets one vector loop (in front of its scalar remainder) for the reductions, while the
+// hash loop, which feeds itself through a multiply, stays a single scalar loop. Fewer trips than
+// lanes leave both loops scalar.
+static const char* ssa_vectorize_check(const char* program, SSAModule* m) {
+    if (strcmp(program, "vector") != 0) return NULL;
+    int vectorized = ssa_vector_bench_trips >= ssa_vector_isa->lanes;
+    if (vectorized && ssa_bench_count(m, "main", SSA_VOP, 0) == 0) return "the reduction loop was not vectorized";
+    if (ssa_bench_count(m, "main", SSA_BR, 0) != 2 + vectorized) return "the hash loop was vectorized";
+    return NULL;
+}
+
+int ssa_bench_vectorize(int n) {
+    printf("[OPT-BENCH] vectorize for %s, %d lanes\n", ssa_vector_isa->name, ssa_vector_isa->lanes);
+    ssa_vector_bench_trips = n;
+    return ssa_bench_pass("vector", ssa_vectorize_pass, ssa_vectorize_check, n) | ssa_bench_pass("pipeline", ssa_pipeline_pass, NULL, n);
+}
+
+static int ssa_tailcall_pass(SSAModule* m) {
+    return ssa_tailcall_module(m, NULL);
+}
+
+static const char* ssa_tailcall_check(const char* program, SSAModule* m) {
+    if (strcmp(program, "calls") == 0 && ssa_bench_count(m, "fact", SSA_CALL, 0) != 1) return "fact's non-tail call was rewritten";
+    return NULL;
+}
+
+// Runs the tail-call program `n` calls deep unoptimized, after the tailcall pass alone and after
+// the pipeline: deepest call nesting, executed instructions, and whether the run fit in the
+// interpreter's 4096 frames. Both optimized runs must fit in two frames and print what the first
+// run that fit printed, and the pass must not change what the other programs print or touch
+// fact's call, which is not in tail position. Returns nonzero otherwise.
+int ssa_bench_tailcall(int n) {
+    static const char* const modes[] = { "none", "tailcall", "pipeline" };
+    ASTNode* program = ssa_prog_tailcall(n);
+    unsigned long long sum0 = 0;
+    int ok0 = 0, failed = 0;
+    for (int k = 0; k < 3; k++) {
+        SSAModule* m = ssa_build_module(program);
+        int size0 = ssa_module_size(m);
+        if (k == 1) ssa_tailcall_module(m, NULL);
+        if (k == 2) ssa_optimize_module(m, NULL);
+        SSAExec x;
+        double t0 = ssa_now_ms();
+        int rc = ssa_exec_run(m, NULL, 0, &x);
+        double t1 = ssa_now_ms();
+        if (rc == 0 && !ok0) { sum0 = x.checksum; ok0 = 1; }
+        printf("[OPT-BENCH] %-8s tailcall   depth %d: instrs %d -> %d, max call depth %d, executed %lld, %.2f ms%s\n",
+            modes[k], n, size0, ssa_module_size(m), x.max_depth, x.steps, t1 - t0,
+            rc ? "  TRAPPED" : x.checksum != sum0 ? "  OUTPUT MISMATCH" : "");
+        failed |= rc ? k > 0 : x.checksum != sum0;
+        if (k > 0 && rc == 0 && x.max_depth > 2) {
+            printf("[OPT-BENCH] %-8s tailcall   WRONG SHAPE: tail calls still nest %d deep\n", modes[k], x.max_depth);
+            failed = 1;
+        }
+        ssa_free_module(m);
+    }
+    ast_free(program);
+    return ssa_bench_pass("tailcall", ssa_tailcall_pass, ssa_tailcall_check, n) | failed;
+}
+
+// Whether the pipeline of the current level (with --enable/--disable-pass) runs pass `name`.
+static int ssa_pipeline_runs(const char* name) {
+    int order[2 * SSA_NPASSES + 8];
+    int n = ssa_build_pipeline(order), p = ssa_pass_index(name, strlen(name));
+    for (int k = 0; k < n; k++)
+        if (order[k] == p) return 1;
+    return 0;
+}
+
+// What a level must have done to a program: nothing at all with an empty pipeline, otherwise the
+// work of each sccp, dce and inline it runs (the per-pass checks; the others interact too much).
+static const char* ssa_level_check(const char* program, SSAModule* m, int size0) {
+    const char* wrong = NULL;
+    int order[2 * SSA_NPASSES + 8];
+    if (ssa_build_pipeline(order) == 0) return ssa_module_size(m) != size0 ? "an empty pipeline changed the module" : NULL;
+    if (!wrong && ssa_pipeline_runs("sccp")) wrong = ssa_sccp_check(program, m);
+    if (!wrong && ssa_pipeline_runs("dce")) wrong = ssa_dce_check(program, m);
+    if (!wrong && ssa_pipeline_runs("inline")) wrong = ssa_inline_check(program, m);
+    return wrong;
+}
+
+// Compares the -O levels on every benchmark program: compile time, static size, executed
+// instructions and interpreter time. Each level must print what -O0 prints, execute no more
+// instructions and pass ssa_level_check() (nonzero return otherwise).
+int ssa_bench_passes(int n) {
+    const SSAOptLevel* saved = ssa_opt_level;
+    int failed = 0;
+    int count = (int)(sizeof(ssa_bench_programs) / sizeof(ssa_bench_programs[0]));
+    int nlevels = (int)(sizeof(ssa_opt_levels) / sizeof(ssa_opt_levels[0]));
+    for (int p = 0; p < count; p++) {
+        ASTNode* program = ssa_bench_programs[p].build(n);
+        unsigned long long sum0 = 0;
+        long long steps0 = 0;
+        for (int l = 0; l < nlevels; l++) {
+            ssa_opt_level = &ssa_opt_levels[l];
+            SSAModule* m = ssa_build_module(program);
+            int size0 = ssa_module_size(m);
+            double t0 = ssa_now_ms();
+            ssa_optimize_module(m, NULL);
+            double t1 = ssa_now_ms();
+            long long steps;
+            unsigned long long sum;
+            ssa_exec_module(m, NULL, 0, &steps, &sum);
+            double t2 = ssa_now_ms();
+            if (l == 0) { sum0 = sum; steps0 = steps; }
+            printf("[OPT-BENCH] -O%-6s %-10s compile %.3f ms, instrs %d, executed %lld, %.2f ms%s\n",
+                ssa_opt_level->level, ssa_bench_programs[p].name, t1 - t0, ssa_module_size(m), steps,
+                t2 - t1, sum == sum0 ? "" : "  OUTPUT MISMATCH");
+            failed |= sum != sum0;
+            const char* wrong = steps > steps0 ? "executes more instructions than -O0" : ssa_level_check(ssa_bench_programs[p].name, m, size0);
+            if (wrong) printf("[OPT-BENCH] -O%-6s %-10s WRONG SHAPE: %s\n", ssa_opt_level->level, ssa_bench_programs[p].name, wrong);
+            failed |= wrong != NULL;
+            ssa_free_module(m);
+        }
+        ast_free(program);
+    }
+    ssa_opt_level = saved;
+    return failed;
+}
+
+// Profiles every benchmark program with an instrumented run, then compares the pipeline without
+// and with the profile: static size, executed instructions and taken jumps (transfers that do
+// not fall through). Output must match the uninstrumented, unoptimized run, the profile must match
+// every function, layout (when it runs) must not add taken jumps, and profile-guided inlining at
+// the default budget or above must speed up the hot helper of the profile program; returns
+// nonzero if not.
+int ssa_bench_pgo(int n) {
+    const char* saved = ssa_profile_in;
+    int failed = 0;
+    ssa_profile_in = NULL;
+    int count = (int)(sizeof(ssa_bench_programs) / sizeof(ssa_bench_programs[0]));
+    for (int p = 0; p < count; p++) {
+        ASTNode* program = ssa_bench_programs[p].build(n);
+        SSAExec base, train, plain, pgo;
+        SSAModule* m = ssa_build_module(program);
+        ssa_exec_run(m, NULL, 0, &base);
+        ssa_free_module(m);
+
+        m = ssa_build_module(program);
+        int counters = ssa_profile_instrument(m);
+        ssa_exec_run(m, NULL, 0, &train);       // writes the profile
+        ssa_free_module(m);
+
+        m = ssa_build_module(program);
+        ssa_optimize_module(m, NULL);
+        int size_plain = ssa_module_size(m);
+        ssa_exec_run(m, NULL, 0, &plain);
+        ssa_free_module(m);
+
+        m = ssa_build_module(program);
+        int nfuncs = m->nfuncs;
+        int applied = ssa_profile_read(m, ssa_profile_out);
+        ssa_optimize_module(m, NULL);
+        int size_pgo = ssa_module_size(m);
+        ssa_exec_run(m, NULL, 0, &pgo);
+        ssa_free_module(m);
+
+        printf("[PGO-BENCH] %-10s %d counters (+%.1f%% executed), %d functions profiled\n",
+            ssa_bench_programs[p].name, counters,
+            base.steps ? 100.0 * (double)(train.steps - base.steps) / (double)base.steps : 0.0, applied);
+        printf("[PGO-BENCH] %-10s -O%s instrs %d -> %d, executed %lld -> %lld (%.1f%%), taken jumps %lld -> %lld%s\n",
+            ssa_bench_programs[p].name, ssa_opt_level->level, size_plain, size_pgo, plain.steps, pgo.steps,
+            plain.steps ? 100.0 * (double)(pgo.steps - plain.steps) / (double)plain.steps : 0.0,
+            plain.taken, pgo.taken,
+            train.checksum == base.checksum && plain.checksum == base.checksum && pgo.checksum == base.checksum ? "" : "  OUTPUT MISMATCH");
+        failed |= train.checksum != base.checksum || plain.checksum != base.checksum || pgo.checksum != base.checksum;
+        const char* wrong = applied != nfuncs ? "the profile does not match every function"
+            : ssa_pipeline_runs("layout") && pgo.taken > plain.taken ? "layout added taken jumps"
+            : ssa_pipeline_runs("inline") && ssa_inline_params.growth_percent >= 50 &&
+              strcmp(ssa_bench_programs[p].name, "profile") == 0 && pgo.steps >= plain.steps ? "the hot helper was not inlined"
+            : NULL;
+        if (wrong) printf("[PGO-BENCH] %-10s WRONG SHAPE: %s\n", ssa_bench_programs[p].name, wrong);
+        failed |= wrong != NULL;
+        ast_free(program);
+    }
+    ssa_profile_in = saved;
+    return failed;
+}
+
+
+// rexion_vm.c – Rexion register VM (direct-threaded, computed-goto dispatch)
+// DOC: Executes Rexion IR (text/.rirb/.json) or RexionFullVM .bin without nasm/gcc
+// DOC: Register-based fixed-width instructions; each carries its handler address (direct threading)
+// DOC: IF/ELSE/WHILE nesting is resolved to jump targets at load time, so no loop stack at run time
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+#define VM_REGS 65536        // distinct names per program (operands are 16-bit)
+#define VM_CALL_DEPTH 1024
+#define VM_NEST_DEPTH 256
+
+#define VM_OPS(X) \
+    X(NOP) X(MOV) X(LOADK) X(LOADF) X(LOADS) \
+    X(ADD) X(SUB) X(MUL) X(DIV) X(MOD) \
+    X(ADDK) X(SUBK) X(MULK) X(DIVK) \
+    X(FADD) X(FSUB) X(FMUL) X(FDIV) \
+    X(EQ) X(NE) X(LT) X(LE) X(GT) X(GE) \
+    X(OUT) X(OUTF) X(OUTS) \
+    X(JMP) X(JZ) X(JNZ) X(CALL) X(RETURN) X(HALT)
+
+typedef enum {
+#define VM_ENUM(name) VM_##name,
+    VM_OPS(VM_ENUM)
+#undef VM_ENUM
+    VM_OP_COUNT
+} VMOpcode;
+
+const char* vm_op_names[VM_OP_COUNT] = {
+#define VM_NAME(name) #name,
+    VM_OPS(VM_NAME)
+#undef VM_NAME
+};
+
+typedef union {
+    int64_t i;
+    double f;
+} VMValue;
+
+typedef struct {
+    const void* h;      // handler address, filled in on first execution
+    uint8_t op;         // VMOpcode
+    uint16_t a, b, c;   // register operands: a = destination / tested register
+    union {
+        int32_t target; // JMP/JZ/JNZ/CALL: jump / call target (instruction index)
+        VMValue k;      // immediate (LOADK/LOADF/xxK), string-table id for OUTS/LOADS
+    };
+} VMInstr;
+
+typedef struct {
+    VMInstr* code;
+    int count;
+    int cap;
+    int threaded;       // handler addresses resolved
+    VMValue* regs;      // VM_REGS registers, allocated by the first vm_execute
+    const char* strtab; // OUTS/LOADS operands (the IR string table)
+    FILE* out;          // OUT/OUTF/OUTS stream, NULL = stdout
+} VMProgram;
+
+static VMInstr* vm_emit(VMProgram* p, VMOpcode op, int a, int b, int c) {
+    if (p->count == p->cap) {
+        p->cap = p->cap ? p->cap * 2 : 256;
+        p->code = realloc(p->code, (size_t)p->cap * sizeof(VMInstr));
+        if (!p->code) { perror("vm_emit"); exit(1); }
+    }
+    VMInstr* in = &p->code[p->count++];
+    memset(in, 0, sizeof(*in));
+    in->op = (uint8_t)op;
+    in->a = (uint16_t)a;
+    in->b = (uint16_t)b;
+    in->c = (uint16_t)c;
+    return in;
+}
+
+void vm_free(VMProgram* p) {
+    free(p->code);
+    free(p->regs);
+    memset(p, 0, sizeof(*p));
+}
+
+// === Interpreter ===
+
+// x / 0 and x % 0 are 0; x / -1 negates with INT64_MIN wrapping and x % -1 is 0, as in the native backends.
+static inline int64_t vm_div(int64_t a, int64_t b) {
+    if (b == -1) return (int64_t)(0 - (uint64_t)a);
+    return b ? a / b : 0;
+}
+
+static inline int64_t vm_mod(int64_t a, int64_t b) {
+    return b && b != -1 ? a % b : 0;
+}
+
+// Runs until HALT, RETURN with an empty call stack, or falling off the end.
+// Returns 0, or -1 on a runtime fault (call stack overflow).
+int vm_execute(VMProgram* p) {
+#if defined(__GNUC__)
+    static const void* labels[VM_OP_COUNT] = {
+#define VM_LABEL(name) &&op_##name,
+        VM_OPS(VM_LABEL)
+#undef VM_LABEL
+    };
+    if (!p->threaded) {
+        for (int i = 0; i < p->count; i++) p->code[i].h = labels[p->code[i].op];
+        p->threaded = 1;
+    }
+#define VM_CASE(name) op_##name:
+#define VM_DISPATCH() goto *ip->h
+#else
+#define VM_CASE(name) case VM_##name:
+#define VM_DISPATCH() goto dispatch
+#endif
+#define VM_NEXT() do { ip++; VM_DISPATCH(); } while (0)
+
+    VMValue* r = p->regs;
+    VMInstr* code = p->code;
+    VMInstr* ip = code;
+    VMInstr* end = code + p->count;
+    VMInstr* calls[VM_CALL_DEPTH];
+    int depth = 0;
+    FILE* out = p->out ? p->out : stdout;
+
+    if (p->count == 0 || code[p->count - 1].op != VM_HALT) {
+        fprintf(stderr, "[VM] program must end in HALT\n");
+        return -1;
+    }
+    if (!r && !(r = p->regs = calloc(VM_REGS, sizeof(VMValue)))) { perror("vm_execute"); return -1; }
+
+#if defined(__GNUC__)
+    VM_DISPATCH();
+#else
+dispatch:
+    switch (ip->op) {
+#endif
+
+    VM_CASE(NOP)    VM_NEXT();
+    VM_CASE(MOV)    r[ip->a] = r[ip->b]; VM_NEXT();
+    VM_CASE(LOADK)  r[ip->a].i = ip->k.i; VM_NEXT();
+    VM_CASE(LOADF)  r[ip->a].f = ip->k.f; VM_NEXT();
+    VM_CASE(LOADS)  r[ip->a].i = ip->k.i; VM_NEXT();
+
+    VM_CASE(ADD)    r[ip->a].i = r[ip->b].i + r[ip->c].i; VM_NEXT();
+    VM_CASE(SUB)    r[ip->a].i = r[ip->b].i - r[ip->c].i; VM_NEXT();
+    VM_CASE(MUL)    r[ip->a].i = r[ip->b].i * r[ip->c].i; VM_NEXT();
+    VM_CASE(DIV)    r[ip->a].i = vm_div(r[ip->b].i, r[ip->c].i); VM_NEXT();
+    VM_CASE(MOD)    r[ip->a].i = vm_mod(r[ip->b].i, r[ip->c].i); VM_NEXT();
+    VM_CASE(ADDK)   r[ip->a].i = r[ip->b].i + ip->k.i; VM_NEXT();
+    VM_CASE(SUBK)   r[ip->a].i = r[ip->b].i - ip->k.i; VM_NEXT();
+    VM_CASE(MULK)   r[ip->a].i = r[ip->b].i * ip->k.i; VM_NEXT();
+    VM_CASE(DIVK)   r[ip->a].i = vm_div(r[ip->b].i, ip->k.i); VM_NEXT();
+
+    VM_CASE(FADD)   r[ip->a].f = r[ip->b].f + r[ip->c].f; VM_NEXT();
+    VM_CASE(FSUB)   r[ip->a].f = r[ip->b].f - r[ip->c].f; VM_NEXT();
+    VM_CASE(FMUL)   r[ip->a].f = r[ip->b].f * r[ip->c].f; VM_NEXT();
+    VM_CASE(FDIV)   r[ip->a].f = r[ip->b].f / r[ip->c].f; VM_NEXT();
+
+    VM_CASE(EQ)     r[ip->a].i = r[ip->b].i == r[ip->c].i; VM_NEXT();
+    VM_CASE(NE)     r[ip->a].i = r[ip->b].i != r[ip->c].i; VM_NEXT();
+    VM_CASE(LT)     r[ip->a].i = r[ip->b].i <  r[ip->c].i; VM_NEXT();
+    VM_CASE(LE)     r[ip->a].i = r[ip->b].i <= r[ip->c].i; VM_NEXT();
+    VM_CASE(GT)     r[ip->a].i = r[ip->b].i >  r[ip->c].i; VM_NEXT();
+    VM_CASE(GE)     r[ip->a].i = r[ip->b].i >= r[ip->c].i; VM_NEXT();
+
+    VM_CASE(OUT)    fprintf(out, "%lld\n", (long long)r[ip->a].i); VM_NEXT();
+    VM_CASE(OUTF)   { char t[32]; ir_format_float(t, sizeof(t), r[ip->a].f); fprintf(out, "%s\n", t); } VM_NEXT();
+    VM_CASE(OUTS)   fprintf(out, "%s\n", p->strtab ? p->strtab + r[ip->a].i : ""); VM_NEXT();
+
+    VM_CASE(JMP)    ip = code + ip->target; VM_DISPATCH();
+    VM_CASE(JZ)     ip = r[ip->a].i == 0 ? code + ip->target : ip + 1; VM_DISPATCH();
+    VM_CASE(JNZ)    ip = r[ip->a].i != 0 ? code + ip->target : ip + 1; VM_DISPATCH();
+    VM_CASE(CALL)
+        if (depth == VM_CALL_DEPTH) { fprintf(stderr, "[VM] call stack overflow at %d\n", (int)(ip - code)); return -1; }
+        calls[depth++] = ip + 1;
+        ip = code + ip->target;
+        VM_DISPATCH();
+    VM_CASE(RETURN)
+        if (depth == 0) return 0;
+        ip = calls[--depth];
+        if (ip >= end) return 0;
+        VM_DISPATCH();
+    VM_CASE(HALT)   return 0;
+
+#if !defined(__GNUC__)
+    default:
+        fprintf(stderr, "[VM] illegal opcode %d at %d\n", ip->op, (int)(ip - code));
+        return -1;
+    }
+#endif
+#undef VM_CASE
+#undef VM_DISPATCH
+#undef VM_NEXT
+}
+
+// === Loading: Rexion IR ===
+
+typedef struct {
+    uint32_t id;        // IR string id of the name (0 = empty slot)
+    uint16_t reg;
+} VMRegSlot;
+
+typedef struct {
+    VMProgram* p;
+    VMRegSlot slots[VM_REGS * 2];
+    int nregs;
+    uint8_t is_float[VM_REGS];
+    uint8_t is_string[VM_REGS];
+    uint32_t* label_ids;    // LABEL/FUNC name ids, index-aligned with label_pc
+    int* label_pc;
+    int nlabels;
+    int* fixups;            // instructions whose target is still a label id
+    int nfixups;
+    int nest[VM_NEST_DEPTH];     // open IF/ELSE/WHILE instruction indices
+    int nest_kind[VM_NEST_DEPTH];
+    int depth;
+    int errors;
+} VMLoader;
+
+static int vm_reg(VMLoader* L, uint32_t id) {
+    unsigned h = (id * 2654435761u) % (VM_REGS * 2);
+    while (L->slots[h].id && L->slots[h].id != id) h = (h + 1) % (VM_REGS * 2);
+    if (L->slots[h].id) return L->slots[h].reg;
+    if (L->nregs == VM_REGS) {
+        if (!L->errors++) fprintf(stderr, "[VM] more than %d registers/variables\n", VM_REGS);
+        return 0;
+    }
+    L->slots[h].id = id;
+    L->slots[h].reg = (uint16_t)L->nregs;
+    return L->nregs++;
+}
+
+// Decimal only: 010 is ten, 0x10 is not a number; a value outside int64 is not an integer literal.
+static int vm_parse_int(const char* s, int64_t* out) {
+    char* e;
+    if (!*s) return 0;
+    errno = 0;
+    long long v = strtoll(s, &e, 10);
+    if (*e || errno == ERANGE) return 0;
+    *out = v;
+    return 1;
+}
+
+static int vm_parse_float(const char* s, double* out) {
+    char* e;
+    if (!*s || strpbrk(s, "xX")) return 0;
+    double v = strtod(s, &e);
+    if (*e) return 0;
+    *out = v;
+    return 1;
+}
+
+// Operand as register: immediates are materialized into scratch register $k0/$k1
+// (one per operand position, so "OP d, 2, 3" does not clobber its own input).
+static int vm_operand(VMLoader* L, uint32_t id, int scratch) {
+    int64_t k;
+    double f;
+    const char* s = ir_str(id);
+    const char* name = scratch ? "$k1" : "$k0";
+    if (vm_parse_int(s, &k)) {
+        int t = vm_reg(L, ir_intern(name, 3));
+        vm_emit(L->p, VM_LOADK, t, 0, 0)->k.i = k;
+        return t;
+    }
+    if (vm_parse_float(s, &f)) {
+        int t = vm_reg(L, ir_intern(name, 3));
+        vm_emit(L->p, VM_LOADF, t, 0, 0)->k.f = f;
+        L->is_float[t] = 1;
+        return t;
+    }
+    return vm_reg(L, id);
+}
+
+static void vm_jump_to_label(VMLoader* L, VMInstr* in, uint32_t label_id) {
+    in->target = (int32_t)label_id;
+    L->fixups = realloc(L->fixups, (size_t)(L->nfixups + 1) * sizeof(int));
+    L->fixups[L->nfixups++] = (int)(in - L->p->code);
+}
+
+static void vm_define_label(VMLoader* L, uint32_t id) {
+    L->label_ids = realloc(L->label_ids, (size_t)(L->nlabels + 1) * sizeof(uint32_t));
+    L->label_pc = realloc(L->label_pc, (size_t)(L->nlabels + 1) * sizeof(int));
+    L->label_ids[L->nlabels] = id;
+    L->label_pc[L->nlabels++] = L->p->count;
+}
+
+static void vm_open(VMLoader* L, int kind, int at) {
+    if (L->depth == VM_NEST_DEPTH) { fprintf(stderr, "[VM] IF/WHILE nested too deep\n"); L->errors++; return; }
+    L->nest_kind[L->depth] = kind;
+    L->nest[L->depth++] = at;
+}
+
+// Binary integer/float/compare op: "OP d, s" is d = d OP s, "OP d, a, b" is d = a OP b.
+static void vm_binop(VMLoader* L, const IRInstruction* in, VMOpcode op, VMOpcode opk) {
+    if (in->nargs < 2) { fprintf(stderr, "[VM] %s needs 2 operands\n", ir_str(in->op)); L->errors++; return; }
+    int d = vm_reg(L, in->arg[0]);
+    int64_t k;
+    if (in->nargs == 2) {
+        if (opk != VM_NOP && vm_parse_int(ir_str(in->arg[1]), &k)) {
+            vm_emit(L->p, opk, d, d, 0)->k.i = k;
+            return;
+        }
+        int s = vm_operand(L, in->arg[1], 1);
+        vm_emit(L->p, op, d, d, s);
+        return;
+    }
+    int a = vm_operand(L, in->arg[1], 0);
+    if (opk != VM_NOP && vm_parse_int(ir_str(in->arg[2]), &k)) {
+        vm_emit(L->p, opk, d, a, 0)->k.i = k;
+        return;
+    }
+    int b = vm_operand(L, in->arg[2], 1);
+    vm_emit(L->p, op, d, a, b);
+}
+
+static void vm_print(VMLoader* L, uint32_t id) {
+    int r = vm_operand(L, id, 0);
+    VMOpcode op = L->is_float[r] ? VM_OUTF : L->is_string[r] ? VM_OUTS : VM_OUT;
+    vm_emit(L->p, op, r, 0, 0);
+}
+
+// Translates ir[0..ir_count) into p. Returns 0 on success.
+int vm_load_ir(VMProgram* p) {
+    VMLoader* L = calloc(1, sizeof(VMLoader));
+    if (!L) { perror("vm_load_ir"); return -1; }
+    L->p = p;
+
+    for (int i = 0; i < ir_count; i++) {
+        const IRInstruction* in = &ir[i];
+        int d;
+        switch ((IROpcode)in->opcode) {
+            case IR_OP_NOP: case IR_OP_SECTION: case IR_OP_ENTRY: case IR_OP_IMPORT: case IR_OP_DECLARE:
+            case IR_OP_PARAM: case IR_OP_ARG:
+                break;
+            case IR_OP_LOAD: case IR_OP_MOV: case IR_OP_FLOAT_LOAD: {
+                int64_t k;
+                double f;
+                d = vm_reg(L, in->arg[0]);
+                if (in->opcode != IR_OP_FLOAT_LOAD && vm_parse_int(ir_str(in->arg[1]), &k)) {
+                    vm_emit(p, VM_LOADK, d, 0, 0)->k.i = k;
+                } else if (vm_parse_float(ir_str(in->arg[1]), &f)) {
+                    vm_emit(p, VM_LOADF, d, 0, 0)->k.f = f;
+                    L->is_float[d] = 1;
+                } else {
+                    int s = vm_reg(L, in->arg[1]);
+                    vm_emit(p, VM_MOV, d, s, 0);
+                    L->is_float[d] = L->is_float[s];
+                    L->is_string[d] = L->is_string[s];
+                }
+                break;
+            }
+            case IR_OP_LOAD_STR:
+                d = vm_reg(L, in->arg[0]);
+                vm_emit(p, VM_LOADS, d, 0, 0)->k.i = in->arg[1];
+                L->is_string[d] = 1;
+                break;
+            case IR_OP_STORE: {
+                // STORE var, src
+                d = vm_reg(L, in->arg[0]);
+                int s = vm_operand(L, in->arg[1], 0);
+                vm_emit(p, VM_MOV, d, s, 0);
+                L->is_float[d] = L->is_float[s];
+                L->is_string[d] = L->is_string[s];
+                break;
+            }
+            case IR_OP_ADD: vm_binop(L, in, VM_ADD, VM_ADDK); break;
+            case IR_OP_SUB: vm_binop(L, in, VM_SUB, VM_SUBK); break;
+            case IR_OP_MUL: vm_binop(L, in, VM_MUL, VM_MULK); break;
+            case IR_OP_DIV: vm_binop(L, in, VM_DIV, VM_DIVK); break;
+            case IR_OP_MOD: vm_binop(L, in, VM_MOD, VM_NOP); break;
+            case IR_OP_FLOAT_ADD: vm_binop(L, in, VM_FADD, VM_NOP); L->is_float[vm_reg(L, in->arg[0])] = 1; break;
+            case IR_OP_FLOAT_SUB: vm_binop(L, in, VM_FSUB, VM_NOP); L->is_float[vm_reg(L, in->arg[0])] = 1; break;
+            case IR_OP_FLOAT_MUL: vm_binop(L, in, VM_FMUL, VM_NOP); L->is_float[vm_reg(L, in->arg[0])] = 1; break;
+            case IR_OP_FLOAT_DIV: vm_binop(L, in, VM_FDIV, VM_NOP); L->is_float[vm_reg(L, in->arg[0])] = 1; break;
+            case IR_OP_CMP_EQ: vm_binop(L, in, VM_EQ, VM_NOP); break;
+            case IR_OP_CMP_NE: vm_binop(L, in, VM_NE, VM_NOP); break;
+            case IR_OP_CMP_LT: vm_binop(L, in, VM_LT, VM_NOP); break;
+            case IR_OP_CMP_LE: vm_binop(L, in, VM_LE, VM_NOP); break;
+            case IR_OP_CMP_GT: vm_binop(L, in, VM_GT, VM_NOP); break;
+            case IR_OP_CMP_GE: vm_binop(L, in, VM_GE, VM_NOP); break;
+            case IR_OP_PRINT: case IR_OP_PRINT_FLOAT_SYSCALL: case IR_OP_PRINT_FLOAT_PRINTF:
+                vm_print(L, in->arg[0]);
+                break;
+            case IR_OP_LABEL: case IR_OP_FUNC:
+                vm_define_label(L, in->arg[0]);
+                break;
+            case IR_OP_JMP:
+                vm_jump_to_label(L, vm_emit(p, VM_JMP, 0, 0, 0), in->arg[0]);
+                break;
+            case IR_OP_IFZ:
+                d = vm_operand(L, in->arg[0], 0);
+                vm_jump_to_label(L, vm_emit(p, VM_JZ, d, 0, 0), in->arg[1]);
+                break;
+            case IR_OP_CALL:
+                vm_jump_to_label(L, vm_emit(p, VM_CALL, 0, 0, 0), in->arg[0]);
+                break;
+            case IR_OP_RET:
+                // CALL f; RETURN is a tail call: jump to f and let its RETURN go straight back
+                if (p->count && p->code[p->count - 1].op == VM_CALL) p->code[p->count - 1].op = VM_JMP;
+                vm_emit(p, VM_RETURN, 0, 0, 0);
+                break;
+            case IR_OP_HALT:
+                vm_emit(p, VM_HALT, 0, 0, 0);
+                break;
+            case IR_OP_IF:
+                d = vm_operand(L, in->arg[0], 0);
+                vm_emit(p, VM_JZ, d, 0, 0);
+                vm_open(L, IR_OP_IF, p->count - 1);
+                break;
+            case IR_OP_ELSE:
+                if (!L->depth || L->nest_kind[L->depth - 1] != IR_OP_IF) {
+                    fprintf(stderr, "[VM] ELSE without IF\n"); L->errors++; break;
+                }
+                vm_emit(p, VM_JMP, 0, 0, 0);
+                p->code[L->nest[L->depth - 1]].target = p->count;   // IF false -> else body
+                L->nest[L->depth - 1] = p->count - 1;
+                L->nest_kind[L->depth - 1] = IR_OP_ELSE;
+                break;
+            case IR_OP_END_IF:
+                if (!L->depth || L->nest_kind[L->depth - 1] == IR_OP_WHILE) {
+                    fprintf(stderr, "[VM] END_IF without IF\n"); L->errors++; break;
+                }
+                p->code[L->nest[--L->depth]].target = p->count;
+                break;
+            case IR_OP_WHILE:
+                // WHILE r: test at the top, END_WHILE re-tests r at the bottom
+                d = vm_operand(L, in->arg[0], 0);
+                vm_emit(p, VM_JZ, d, 0, 0);
+                vm_open(L, IR_OP_WHILE, p->count - 1);
+                break;
+            case IR_OP_END_WHILE: {
+                if (!L->depth || L->nest_kind[L->depth - 1] != IR_OP_WHILE) {
+                    fprintf(stderr, "[VM] END_WHILE without WHILE\n"); L->errors++; break;
+                }
+                int head = L->nest[--L->depth];
+                vm_emit(p, VM_JNZ, p->code[head].a, 0, 0)->target = head + 1;
+                p->code[head].target = p->count;
+                break;
+            }
+            default:
+                fprintf(stderr, "[VM] unsupported IR op '%s'\n", ir_str(in->op));
+                L->errors++;
+        }
+    }
+    if (L->depth) { fprintf(stderr, "[VM] %d unterminated IF/WHILE block(s)\n", L->depth); L->errors++; }
+    vm_emit(p, VM_HALT, 0, 0, 0);     // always: a label or END_IF after a final HALT targets p->count
+
+    for (int f = 0; f < L->nfixups; f++) {
+        VMInstr* in = &p->code[L->fixups[f]];
+        uint32_t id = (uint32_t)in->target;
+        int l = 0;
+        while (l < L->nlabels && L->label_ids[l] != id) l++;
+        if (l == L->nlabels) { fprintf(stderr, "[VM] undefined label '%s'\n", ir_str(id)); L->errors++; in->target = p->count - 1; }
+        else in->target = L->label_pc[l];
+    }
+    p->strtab = ir_strtab;
+
+    int errors = L->errors;
+    free(L->label_ids); free(L->label_pc); free(L->fixups);
+    free(L);
+    return errors ? -1 : 0;
+}
+
+// === Loading: RexionFullVM .bin (python_version/ir_to_bin.py) ===
+
+// Byte layout: MOV r,v | ADD/SUB/MUL/DIV r,a,b | OUT r | CALL addr | RETURN |
+// IF r,skip | ELSE skip | END_IF | WHILE r,skip | END_WHILE | FUNC_END (0xFF).
+// Operands are single bytes; skips are relative to the byte after the operands.
+static int vm_bin_length(uint8_t op) {
+    switch (op) {
+        case 0x10: return 3;
+        case 0x11: case 0x12: case 0x13: case 0x14: return 4;
+        case 0x20: case 0x30: return 2;
+        case 0x50: case 0x60: return 3;
+        case 0x51: return 2;
+        default: return 1;
+    }
+}
+
+int vm_load_bin(VMProgram* p, const uint8_t* bin, size_t size) {
+    int* at = malloc((size + 1) * sizeof(int));   // byte offset -> instruction index
+    int loops[VM_NEST_DEPTH], nloops = 0, errors = 0;
+    if (!at) { perror("vm_load_bin"); return -1; }
+
+    // pass 1: every byte offset that starts an instruction gets the index of its first VM instr
+    int index = 0;
+    for (size_t pc = 0; pc <= size; ) {
+        at[pc] = index;
+        if (pc == size) break;
+        uint8_t op = bin[pc];
+        int len = vm_bin_length(op);
+        for (int k = 1; k < len && pc + k <= size; k++) at[pc + k] = index;
+        index += (op == 0x52 || op == 0x00) ? 0 : 1;
+        pc += (size_t)len;
+        if (pc > size) { at[size] = index; break; }
+    }
+
+    for (size_t pc = 0; pc < size; ) {
+        uint8_t op = bin[pc];
+        int len = vm_bin_length(op);
+        if (pc + (size_t)len > size) { fprintf(stderr, "[VM] truncated instruction at byte %zu\n", pc); errors++; break; }
+        const uint8_t* o = bin + pc + 1;
+        size_t next = pc + (size_t)len;
+        size_t jump;
+        switch (op) {
+            case 0x00: case 0x52: break;
+            case 0x10: vm_emit(p, VM_LOADK, o[0], 0, 0)->k.i = o[1]; break;
+            case 0x11: vm_emit(p, VM_LOADK, o[0], 0, 0)->k.i = (int64_t)o[1] + o[2]; break;
+            case 0x12: vm_emit(p, VM_LOADK, o[0], 0, 0)->k.i = (int64_t)o[1] - o[2]; break;
+            case 0x13: vm_emit(p, VM_LOADK, o[0], 0, 0)->k.i = (int64_t)o[1] * o[2]; break;
+            case 0x14: vm_emit(p, VM_LOADK, o[0], 0, 0)->k.i = o[2] ? o[1] / o[2] : 0; break;
+            case 0x20: vm_emit(p, VM_OUT, o[0], 0, 0); break;
+            case 0x30: vm_emit(p, VM_CALL, 0, 0, 0)->target = at[o[0] < size ? o[0] : size]; break;
+            case 0x40:
+                if (p->count && p->code[p->count - 1].op == VM_CALL) p->code[p->count - 1].op = VM_JMP;     // tail call
+                vm_emit(p, VM_RETURN, 0, 0, 0);
+                break;
+            case 0x50:
+                jump = next + o[1];
+                vm_emit(p, VM_JZ, o[0], 0, 0)->target = at[jump < size ? jump : size];
+                break;
+            case 0x51:
+                jump = next + o[0];
+                vm_emit(p, VM_JMP, 0, 0, 0)->target = at[jump < size ? jump : size];
+                break;
+            case 0x60:
+                jump = next + o[1];
+                vm_emit(p, VM_JZ, o[0], 0, 0)->target = at[jump < size ? jump : size];
+                if (nloops < VM_NEST_DEPTH) loops[nloops++] = p->count - 1;
+                break;
+            case 0x61:
+                if (!nloops) { fprintf(stderr, "[VM] END_WHILE without WHILE at byte %zu\n", pc); errors++; break; }
+                nloops--;
+                vm_emit(p, VM_JNZ, p->code[loops[nloops]].a, 0, 0)->target = loops[nloops] + 1;
+                break;
+            case 0xFF: vm_emit(p, VM_HALT, 0, 0, 0); break;
+            default:
+                fprintf(stderr, "[VM] illegal opcode 0x%02X at byte %zu\n", op, pc);
+                errors++;
+        }
+        pc = next;
+    }
+    vm_emit(p, VM_HALT, 0, 0, 0);     // always: at[size] (skips and calls past the end) is this HALT
+    free(at);
+    return errors ? -1 : 0;
+}
+
+// === Entry points ===
+
+int vm_run_file(const char* path) {
+    VMProgram p;
+    memset(&p, 0, sizeof(p));
+    const char* dot = strrchr(path, '.');
+    int rc;
+    if (dot && strcmp(dot, ".bin") == 0) {
+        FILE* f = fopen(path, "rb");
+        if (!f) { perror("vm_run_file"); return -1; }
+        fseek(f, 0, SEEK_END);
+        long size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        uint8_t* bin = malloc((size_t)size + 1);
+        size_t got = bin ? fread(bin, 1, (size_t)size, f) : 0;
+        fclose(f);
+        rc = vm_load_bin(&p, bin, got);
+        free(bin);
+    } else {
+        ir_reset();
+        if (ir_load_any(path) != 0) return -1;
+        rc = vm_load_ir(&p);
+    }
+    if (rc == 0) rc = vm_execute(&p);
+    fflush(stdout);
+    vm_free(&p);
+    return rc;
+}
+
+// Runs the IR already in ir[] with its output going to out; used to check rewritten IR.
+int vm_run_ir(FILE* out) {
+    VMProgram p;
+    memset(&p, 0, sizeof(p));
+    p.out = out;
+    int rc = vm_load_ir(&p);
+    if (rc == 0) rc = vm_execute(&p);
+    fflush(out);
+    vm_free(&p);
+    return rc;
+}
+
+void vm_dump(const VMProgram* p) {
+    for (int i = 0; i < p->count; i++) {
+        const VMInstr* in = &p->code[i];
+        printf("[VM] %4d  %-7s r%d, r%d, r%d", i, vm_op_names[in->op], in->a, in->b, in->c);
+        if (in->op >= VM_JMP && in->op <= VM_CALL) printf("  -> %d", in->target);
+        else if (in->op == VM_LOADF) printf("  k=%g", in->k.f);
+        else if (in->k.i) printf("  k=%lld", (long long)in->k.i);
+        printf("\n");
+    }
+}
+
+static double vm_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Dispatch-rate benchmark: a 3-op counting loop and a 9-op ALU/compare mix.
+void vm_bench_dispatch(long long iterations) {
+    for (int mix = 0; mix < 2; mix++) {
+        VMProgram p;
+        memset(&p, 0, sizeof(p));
+        vm_emit(&p, VM_LOADK, 0, 0, 0)->k.i = iterations;   // r0 = n
+        vm_emit(&p, VM_LOADK, 1, 0, 0)->k.i = 0;            // r1 = acc
+        vm_emit(&p, VM_LOADK, 2, 0, 0)->k.i = 3;
+        int head = p.count;
+        int per_iter;
+        if (!mix) {
+            vm_emit(&p, VM_ADD, 1, 1, 2);
+            vm_emit(&p, VM_SUBK, 0, 0, 0)->k.i = 1;
+            per_iter = 3;
+        } else {
+            vm_emit(&p, VM_MUL, 3, 0, 2);
+            vm_emit(&p, VM_ADD, 1, 1, 3);
+            vm_emit(&p, VM_DIVK, 4, 1, 0)->k.i = 7;
+            vm_emit(&p, VM_SUB, 1, 1, 4);
+            vm_emit(&p, VM_LT, 5, 1, 3);
+            vm_emit(&p, VM_ADD, 1, 1, 5);
+            vm_emit(&p, VM_MOV, 6, 1, 0);
+            vm_emit(&p, VM_SUBK, 0, 0, 0)->k.i = 1;
+            per_iter = 9;
+        }
+        vm_emit(&p, VM_JNZ, 0, 0, 0)->target = head;
+        vm_emit(&p, VM_HALT, 0, 0, 0);
+
+        double t0 = vm_now_ms();
+        vm_execute(&p);
+        double ms = vm_now_ms() - t0;
+        double n = (double)iterations * per_iter;
+        printf("[VM-BENCH] %-10s %lld dispatches in %.3f ms  (%.1f M dispatch/s, %.2f ns/op)  acc=%lld\n",
+            mix ? "alu-mix" : "count-loop", (long long)n, ms,
+            ms > 0 ? n / (ms * 1e3) : 0.0, n > 0 ? ms * 1e6 / n : 0.0, (long long)p.regs[1].i);
+        vm_free(&p);
+    }
+}
+// x64_encoder.c – Rexion x86-64 machine-code encoder
+// DOC: X64Inst = mnemonic + up to 3 operands (reg, xmm, imm, [base+index*scale+disp], label)
+// DOC: x64_emit() encodes one instruction (REX/ModRM/SIB/disp/imm) into a growable byte buffer
+// DOC: Branches and rip-relative operands reference labels; x64_finish() patches bound ones and
+// DOC: leaves the rest as fixups (external symbols for an object writer)
+// DOC: x64_features is the target's ISA beyond baseline SSE2 (--march=x86-64-v2/v3/v4, or cpuid for
+// DOC: native); it selects rlink's BMI2 runtime variants and the vector lane count, and rasm
+// DOC: rejects POPCNT/LZCNT/BMI instructions it lacks. No backend emits those forms on its own
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+enum {
+    X64_RAX, X64_RCX, X64_RDX, X64_RBX, X64_RSP, X64_RBP, X64_RSI, X64_RDI,
+    X64_R8, X64_R9, X64_R10, X64_R11, X64_R12, X64_R13, X64_R14, X64_R15,
+    X64_RIP = 16,
+    X64_NOREG = -1
+};
+
+typedef enum { X64_NONE, X64_REG, X64_XMM, X64_IMM, X64_MEM, X64_LABEL, X64_ST } X64OperandKind;
+
+typedef struct {
+    uint8_t kind;       // X64OperandKind
+    uint8_t size;       // bytes: 1/2/4/8 (REG, IMM width hint, MEM access size; 10 = x87 tword), 16 for XMM
+    int8_t reg;         // REG/XMM/ST number; MEM base register, X64_RIP or X64_NOREG
+    int8_t index;       // MEM index register or X64_NOREG
+    uint8_t scale;      // MEM index scale 1/2/4/8
+    int64_t imm;        // IMM value, MEM displacement
+    int label;          // LABEL target (imm = addend); IMM/MEM: symbol the value or disp is relative to, or -1
+} X64Operand;
+
+// Condition codes in encoding order (Jcc = 0x70 + cc, SETcc = 0F 90 + cc, CMOVcc = 0F 40 + cc)
+typedef enum {
+    X64_CC_O, X64_CC_NO, X64_CC_B, X64_CC_AE, X64_CC_E, X64_CC_NE, X64_CC_BE, X64_CC_A,
+    X64_CC_S, X64_CC_NS, X64_CC_P, X64_CC_NP, X64_CC_L, X64_CC_GE, X64_CC_LE, X64_CC_G
+} X64Cond;
+
+#define X64_MNEMONICS(X) \
+    X(MOV) X(LEA) X(ADD) X(OR) X(ADC) X(SBB) X(AND) X(SUB) X(XOR) X(CMP) X(TEST) \
+    X(IMUL) X(MUL) X(IDIV) X(DIV) X(NEG) X(NOT) X(INC) X(DEC) \
+    X(SHL) X(SHR) X(SAR) X(CQO) X(CDQ) X(PUSH) X(POP) \
+    X(CALL) X(RET) X(JMP) X(JCC) X(SETCC) X(CMOVCC) X(MOVZX) X(MOVSX) X(MOVSXD) \
+    X(SYSCALL) X(NOP) X(LEAVE) \
+    X(POPCNT) X(LZCNT) X(TZCNT) X(SHLX) X(SHRX) X(SARX) X(MULX) \
+    X(MOVSD) X(ADDSD) X(SUBSD) X(MULSD) X(DIVSD) X(SQRTSD) X(UCOMISD) X(COMISD) \
+    X(CVTSI2SD) X(CVTTSD2SI) X(MOVQ) X(XORPD) X(MOVAPD) \
+    X(FLD) X(FST) X(FSTP) X(FILD) X(FISTP) X(FADD) X(FSUB) X(FMUL) X(FDIV) \
+    X(FXCH) X(FRNDINT) X(FCHS) X(FABS) X(FLDZ) X(FLD1)
+
+typedef enum {
+#define X64_ENUM(name) X64_##name,
+    X64_MNEMONICS(X64_ENUM)
+#undef X64_ENUM
+    X64_OP_COUNT
+} X64Op;
+
+const char* x64_op_names[X64_OP_COUNT] = {
+#define X64_NAME(name) #name,
+    X64_MNEMONICS(X64_NAME)
+#undef X64_NAME
+};
+
+#define X64_SHORT 1         // X64Inst.flags: use the rel8 branch form
+
+typedef struct {
+    uint16_t op;            // X64Op
+    uint8_t cond;           // X64Cond for JCC/SETCC/CMOVCC
+    uint8_t flags;          // X64_SHORT
+    uint8_t nops;
+    X64Operand o[3];
+} X64Inst;
+
+typedef enum { X64_FIX_REL8, X64_FIX_REL32, X64_FIX_ABS32, X64_FIX_ABS32S, X64_FIX_ABS64 } X64FixupKind;
+
+typedef struct {
+    uint32_t offset;        // patch position in the buffer
+    int label;
+    uint8_t kind;           // X64FixupKind
+    int64_t addend;         // REL: value = target + addend - (offset + width)
+} X64Fixup;
+
+typedef struct {
+    uint8_t* code;
+    size_t len, cap;
+    int64_t* labels;        // label -> bound offset, -1 while unbound
+    int nlabels, label_cap;
+    X64Fixup* fixups;
+    int nfixups, fixup_cap;
+    int error;              // set on an unencodable instruction
+} X64Asm;
+
+// === Operand constructors ===
+
+X64Operand x64_r(int reg, int size) {
+    X64Operand o = { X64_REG, (uint8_t)size, (int8_t)reg, X64_NOREG, 1, 0, -1 };
+    return o;
+}
+X64Operand x64_r64(int reg) { return x64_r(reg, 8); }
+X64Operand x64_x(int xmm) {
+    X64Operand o = { X64_XMM, 16, (int8_t)xmm, X64_NOREG, 1, 0, -1 };
+    return o;
+}
+X64Operand x64_i(int64_t imm) {
+    X64Operand o = { X64_IMM, 0, X64_NOREG, X64_NOREG, 1, imm, -1 };
+    return o;
+}
+X64Operand x64_m(int base, int index, int scale, int64_t disp, int size) {
+    X64Operand o = { X64_MEM, (uint8_t)size, (int8_t)base, (int8_t)index, (uint8_t)scale, disp, -1 };
+    return o;
+}
+X64Operand x64_rip(int label, int64_t disp, int size) {
+    X64Operand o = { X64_MEM, (uint8_t)size, X64_RIP, X64_NOREG, 1, disp, label };
+    return o;
+}
+X64Operand x64_l(int label) {
+    X64Operand o = { X64_LABEL, 0, X64_NOREG, X64_NOREG, 1, 0, label };
+    return o;
+}
+X64Operand x64_st(int i) {
+    X64Operand o = { X64_ST, 10, (int8_t)i, X64_NOREG, 1, 0, -1 };
+    return o;
+}
+
+X64Inst x64_inst(X64Op op, int nops, X64Operand a, X64Operand b, X64Operand c) {
+    X64Inst in;
+    memset(&in, 0, sizeof(in));
+    in.op = (uint16_t)op;
+    in.nops = (uint8_t)nops;
+    in.o[0] = a; in.o[1] = b; in.o[2] = c;
+    return in;
+}
+
+// === Buffer / labels ===
+
+static void x64_byte(X64Asm* a, uint8_t b) {
+    if (a->len == a->cap) {
+        a->cap = a->cap ? a->cap * 2 : 4096;
+        a->code = realloc(a->code, a->cap);
+        if (!a->code) { perror("x64_byte"); exit(1); }
+    }
+    a->code[a->len++] = b;
+}
+
+static void x64_le(X64Asm* a, uint64_t v, int n) {
+    for (int i = 0; i < n; i++) x64_byte(a, (uint8_t)(v >> (8 * i)));
+}
+
+int x64_new_label(X64Asm* a) {
+    if (a->nlabels == a->label_cap) {
+        a->label_cap = a->label_cap ? a->label_cap * 2 : 64;
+        a->labels = realloc(a->labels, (size_t)a->label_cap * sizeof(int64_t));
+        if (!a->labels) { perror("x64_new_label"); exit(1); }
+    }
+    a->labels[a->nlabels] = -1;
+    return a->nlabels++;
+}
+
+void x64_bind(X64Asm* a, int label) {
+    a->labels[label] = (int64_t)a->len;
+}
+
+static void x64_fixup(X64Asm* a, int label, X64FixupKind kind, int64_t addend) {
+    if (a->nfixups == a->fixup_cap) {
+        a->fixup_cap = a->fixup_cap ? a->fixup_cap * 2 : 64;
+        a->fixups = realloc(a->fixups, (size_t)a->fixup_cap * sizeof(X64Fixup));
+        if (!a->fixups) { perror("x64_fixup"); exit(1); }
+    }
+    X64Fixup* f = &a->fixups[a->nfixups++];
+    f->offset = (uint32_t)a->len;
+    f->label = label;
+    f->kind = (uint8_t)kind;
+    f->addend = addend;
+}
+
+void x64_free(X64Asm* a) {
+    free(a->code); free(a->labels); free(a->fixups);
+    memset(a, 0, sizeof(*a));
+}
+
+// === Encoding ===
+
+static int x64_fits8(int64_t v) { return v >= -128 && v <= 127; }
+static int x64_fits32(int64_t v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
+static void x64_modrm_tail(X64Asm* a, int r, const X64Operand* rm, int imm_bytes);
+
+// Emits [prefix] [REX] opcode bytes ModRM [SIB] [disp] for reg field `r` and r/m operand `rm`.
+// `w` forces REX.W; `byte_regs` marks byte-register operands (1 = reg field, 2 = r/m), which
+// need a bare REX to reach spl/bpl/sil/dil; `imm_bytes` sizes any trailing immediate (rip addend).
+static void x64_modrm(X64Asm* a, int prefix, int w, const uint8_t* opc, int nopc, int r, const X64Operand* rm,
+                      int byte_regs, int imm_bytes) {
+    int rex = w ? 0x48 : 0;
+    if (r & 8) rex |= 0x44;
+    if (rm->kind == X64_REG || rm->kind == X64_XMM) {
+        if (rm->reg & 8) rex |= 0x41;
+    } else {
+        if (rm->reg >= 0 && rm->reg != X64_RIP && (rm->reg & 8)) rex |= 0x41;
+        if (rm->index >= 0 && (rm->index & 8)) rex |= 0x42;
+    }
+    // spl/bpl/sil/dil need a REX prefix to be addressable as byte registers
+    if (((byte_regs & 1) && r >= 4 && r < 8) || ((byte_regs & 2) && rm->kind == X64_REG && rm->reg >= 4 && rm->reg < 8))
+        rex |= 0x40;
+
+    if (prefix) x64_byte(a, (uint8_t)prefix);
+    if (rex) x64_byte(a, (uint8_t)rex);
+    for (int i = 0; i < nopc; i++) x64_byte(a, opc[i]);
+    x64_modrm_tail(a, r, rm, imm_bytes);
+}
+
+// ModRM [SIB] [disp] for reg field `r` and r/m operand `rm`, after the prefixes and opcode.
+static void x64_modrm_tail(X64Asm* a, int r, const X64Operand* rm, int imm_bytes) {
+    int rr = (r & 7) << 3;
+    if (rm->kind == X64_REG || rm->kind == X64_XMM) {
+        x64_byte(a, (uint8_t)(0xC0 | rr | (rm->reg & 7)));
+        return;
+    }
+    if (rm->kind != X64_MEM) { a->error = 1; return; }
+
+    int64_t disp = rm->imm;
+    if (rm->reg == X64_RIP) {
+        x64_byte(a, (uint8_t)(0x05 | rr));
+        if (rm->label >= 0) {
+            x64_fixup(a, rm->label, X64_FIX_REL32, disp - imm_bytes);
+            x64_le(a, 0, 4);
+        } else {
+            x64_le(a, (uint64_t)(disp - imm_bytes), 4);
+        }
+        return;
+    }
+    int base = rm->reg, index = rm->index;
+    int ss = rm->scale == 8 ? 3 : rm->scale == 4 ? 2 : rm->scale == 2 ? 1 : 0;
+    if (base < 0) {
+        // [index*scale + disp32] or [disp32]
+        x64_byte(a, (uint8_t)(0x04 | rr));
+        x64_byte(a, (uint8_t)((ss << 6) | ((index >= 0 ? index & 7 : 4) << 3) | 5));
+        if (rm->label >= 0) { x64_fixup(a, rm->label, X64_FIX_ABS32S, disp); disp = 0; }
+        x64_le(a, (uint64_t)disp, 4);
+        return;
+    }
+    // a symbolic displacement is always a relocated disp32
+    int mod = rm->label >= 0 ? 2 : (disp == 0 && (base & 7) != 5) ? 0 : x64_fits8(disp) ? 1 : 2;
+    if (index >= 0 || (base & 7) == 4) {
+        x64_byte(a, (uint8_t)((mod << 6) | rr | 4));
+        x64_byte(a, (uint8_t)((ss << 6) | ((index >= 0 ? index & 7 : 4) << 3) | (base & 7)));
+    } else {
+        x64_byte(a, (uint8_t)((mod << 6) | rr | (base & 7)));
+    }
+    if (mod == 1) x64_byte(a, (uint8_t)disp);
+    else if (mod == 2) {
+        if (rm->label >= 0) { x64_fixup(a, rm->label, X64_FIX_ABS32S, disp); disp = 0; }
+        x64_le(a, (uint64_t)disp, 4);
+    }
+}
+
+static void x64_rm(X64Asm* a, int size, uint8_t op8, uint8_t op, int r, const X64Operand* rm, int imm_bytes) {
+    uint8_t opc = size == 1 ? op8 : op;
+    x64_modrm(a, size == 2 ? 0x66 : 0, size == 8, &opc, 1, r, rm, size == 1 ? 3 : 0, imm_bytes);
+}
+
+// Same, for /digit forms: the reg field is an opcode extension, never a byte register.
+static void x64_rmd(X64Asm* a, int size, uint8_t op8, uint8_t op, int digit, const X64Operand* rm, int imm_bytes) {
+    uint8_t opc = size == 1 ? op8 : op;
+    x64_modrm(a, size == 2 ? 0x66 : 0, size == 8, &opc, 1, digit, rm, size == 1 ? 2 : 0, imm_bytes);
+}
+
+static void x64_rm2(X64Asm* a, int prefix, int w, uint8_t op1, uint8_t op2, int r, const X64Operand* rm, int byte_regs) {
+    uint8_t opc[2] = { op1, op2 };
+    x64_modrm(a, prefix, w, opc, 2, r, rm, byte_regs, 0);
+}
+
+// Three-byte VEX (C4) form for the BMI1/BMI2 integer instructions: `pp` is the implied prefix
+// (0 none, 1 66, 2 F3, 3 F2), `map` the opcode map (1 0F, 2 0F38, 3 0F3A), `v` the extra
+// register operand carried in VEX.vvvv.
+static void x64_vex(X64Asm* a, int pp, int map, int w, int v, uint8_t op, int r, const X64Operand* rm) {
+    int rxb = (r & 8) ? 0 : 0x80;
+    if (rm->kind == X64_REG) {
+        if (!(rm->reg & 8)) rxb |= 0x20;
+        rxb |= 0x40;
+    } else {
+        if (!(rm->index >= 0 && (rm->index & 8))) rxb |= 0x40;
+        if (!(rm->reg >= 0 && rm->reg != X64_RIP && (rm->reg & 8))) rxb |= 0x20;
+    }
+    x64_byte(a, 0xC4);
+    x64_byte(a, (uint8_t)(rxb | map));
+    x64_byte(a, (uint8_t)((w ? 0x80 : 0) | ((~v & 15) << 3) | pp));
+    x64_byte(a, op);
+    x64_modrm_tail(a, r, rm, 0);
+}
+
+static void x64_imm(X64Asm* a, int64_t v, int n) { x64_le(a, (uint64_t)v, n); }
+
+// Immediate field of width n; a symbolic immediate becomes an absolute fixup
+// (imm32 is sign-extended when the operation is 64-bit).
+static void x64_imm_op(X64Asm* a, const X64Operand* s, int n, int size) {
+    if (s->label < 0) { x64_imm(a, s->imm, n); return; }
+    if (n < 4) { a->error = 1; return; }
+    x64_fixup(a, s->label, n == 8 ? X64_FIX_ABS64 : size == 8 ? X64_FIX_ABS32S : X64_FIX_ABS32, s->imm);
+    x64_le(a, 0, n);
+}
+
+static int x64_opsize(const X64Inst* in) {
+    for (int i = 0; i < in->nops; i++)
+        if ((in->o[i].kind == X64_REG || in->o[i].kind == X64_MEM) && in->o[i].size) return in->o[i].size;
+    return 8;
+}
+
+static void x64_branch(X64Asm* a, const X64Inst* in, uint8_t short_op, const uint8_t* near_op, int near_len) {
+    const X64Operand* t = &in->o[0];
+    if (in->flags & X64_SHORT) {
+        x64_byte(a, short_op);
+        if (t->kind == X64_LABEL) { x64_fixup(a, t->label, X64_FIX_REL8, t->imm); x64_byte(a, 0); }
+        else x64_byte(a, (uint8_t)t->imm);
+        return;
+    }
+    for (int i = 0; i < near_len; i++) x64_byte(a, near_op[i]);
+    if (t->kind == X64_LABEL) { x64_fixup(a, t->label, X64_FIX_REL32, t->imm); x64_le(a, 0, 4); }
+    else x64_le(a, (uint64_t)t->imm, 4);
+}
+
+// Group-1 ALU (ADD OR ADC SBB AND SUB XOR CMP = /0../7)
+static void x64_alu(X64Asm* a, const X64Inst* in, int digit) {
+    const X64Operand* d = &in->o[0];
+    const X64Operand* s = &in->o[1];
+    int size = x64_opsize(in);
+    uint8_t base = (uint8_t)(digit << 3);
+    if (s->kind == X64_IMM) {
+        if (size == 1) {
+            if (d->kind == X64_REG && d->reg == X64_RAX) { x64_byte(a, (uint8_t)(base + 4)); x64_imm(a, s->imm, 1); return; }
+            x64_rmd(a, 1, 0x80, 0x80, digit, d, 1);
+            x64_imm(a, s->imm, 1);
+        } else if (s->label < 0 && x64_fits8(s->imm)) {
+            x64_rmd(a, size, 0x83, 0x83, digit, d, 1);
+            x64_imm(a, s->imm, 1);
+        } else {
+            int n = size == 2 ? 2 : 4;
+            if (d->kind == X64_REG && d->reg == X64_RAX) {
+                if (size == 2) x64_byte(a, 0x66);
+                if (size == 8) x64_byte(a, 0x48);
+                x64_byte(a, (uint8_t)(base + 5));
+            } else {
+                x64_rmd(a, size, 0x81, 0x81, digit, d, n);
+            }
+            x64_imm_op(a, s, n, size);
+        }
+    } else if (s->kind == X64_REG) {
+        x64_rm(a, size, base, (uint8_t)(base + 1), s->reg, d, 0);
+    } else if (s->kind == X64_MEM && d->kind == X64_REG) {
+        x64_rm(a, size, (uint8_t)(base + 2), (uint8_t)(base + 3), d->reg, s, 0);
+    } else {
+        a->error = 1;
+    }
+}
+
+static void x64_sse(X64Asm* a, int prefix, uint8_t op, const X64Inst* in) {
+    x64_rm2(a, prefix, 0, 0x0F, op, in->o[0].reg, &in->o[1], 0);
+}
+
+// Encodes one instruction at the end of the buffer.
+void x64_emit(X64Asm* a, const X64Inst* in) {
+    const X64Operand* d = &in->o[0];
+    const X64Operand* s = &in->o[1];
+    int size = x64_opsize(in);
+
+    switch ((X64Op)in->op) {
+        case X64_ADD: x64_alu(a, in, 0); break;
+        case X64_OR:  x64_alu(a, in, 1); break;
+        case X64_ADC: x64_alu(a, in, 2); break;
+        case X64_SBB: x64_alu(a, in, 3); break;
+        case X64_AND: x64_alu(a, in, 4); break;
+        case X64_SUB: x64_alu(a, in, 5); break;
+        case X64_XOR: x64_alu(a, in, 6); break;
+        case X64_CMP: x64_alu(a, in, 7); break;
+
+        case X64_MOV:
+            if (s->kind == X64_IMM && d->kind == X64_REG) {
+                if (size == 8 && (s->label >= 0 || (!x64_fits32(s->imm) && (uint64_t)s->imm > 0xFFFFFFFFull))) {
+                    // a symbol's address is not known to fit, so it always takes the imm64 form
+                    x64_byte(a, (uint8_t)(0x48 | ((d->reg & 8) ? 1 : 0)));
+                    x64_byte(a, (uint8_t)(0xB8 + (d->reg & 7)));
+                    x64_imm_op(a, s, 8, 8);
+                } else if (size == 8 && s->imm < 0) {
+                    x64_rmd(a, 8, 0xC7, 0xC7, 0, d, 4);   // sign-extended imm32
+                    x64_imm(a, s->imm, 4);
+                } else if (size == 1) {
+                    if (d->reg >= 4) x64_byte(a, (uint8_t)(0x40 | ((d->reg & 8) ? 1 : 0)));
+                    x64_byte(a, (uint8_t)(0xB0 + (d->reg & 7)));
+                    x64_imm(a, s->imm, 1);
+                } else {
+                    // mov r32, imm32 zero-extends, so it also covers 64-bit values < 2^32
+                    if (size == 2) x64_byte(a, 0x66);
+                    if (d->reg & 8) x64_byte(a, 0x41);
+                    x64_byte(a, (uint8_t)(0xB8 + (d->reg & 7)));
+                    x64_imm_op(a, s, size == 2 ? 2 : 4, 4);
+                }
+            } else if (s->kind == X64_IMM) {
+                int n = size == 1 ? 1 : size == 2 ? 2 : 4;
+                x64_rmd(a, size, 0xC6, 0xC7, 0, d, n);
+                x64_imm_op(a, s, n, size);
+            } else if (s->kind == X64_REG) {
+                x64_rm(a, size, 0x88, 0x89, s->reg, d, 0);
+            } else if (s->kind == X64_MEM && d->kind == X64_REG) {
+                x64_rm(a, size, 0x8A, 0x8B, d->reg, s, 0);
+            } else {
+                a->error = 1;
+            }
+            break;
+
+        case X64_LEA:
+            x64_rm(a, d->size, 0x8D, 0x8D, d->reg, s, 0);
+            break;
+
+        case X64_TEST:
+            if (s->kind == X64_IMM) {
+                int n = size == 1 ? 1 : size == 2 ? 2 : 4;
+                if (d->kind == X64_REG && d->reg == X64_RAX) {
+                    if (size == 2) x64_byte(a, 0x66);
+                    if (size == 8) x64_byte(a, 0x48);
+                    x64_byte(a, size == 1 ? 0xA8 : 0xA9);
+                } else {
+                    x64_rmd(a, size, 0xF6, 0xF7, 0, d, n);
+                }
+                x64_imm_op(a, s, n, size);
+            } else {
+                x64_rm(a, size, 0x84, 0x85, s->reg, d, 0);
+            }
+            break;
+
+        case X64_IMUL:
+            if (in->nops == 1) {
+                x64_rmd(a, size, 0xF6, 0xF7, 5, d, 0);
+            } else if (in->nops == 3 || s->kind == X64_IMM) {
+                const X64Operand* src = in->nops == 3 ? s : d;
+                int64_t k = in->nops == 3 ? in->o[2].imm : s->imm;
+                if (x64_fits8(k)) { x64_rm(a, size, 0x6B, 0x6B, d->reg, src, 1); x64_imm(a, k, 1); }
+                else { x64_rm(a, size, 0x69, 0x69, d->reg, src, 4); x64_imm(a, k, size == 2 ? 2 : 4); }
+            } else {
+                x64_rm2(a, size == 2 ? 0x66 : 0, size == 8, 0x0F, 0xAF, d->reg, s, 0);
+            }
+            break;
+
+        case X64_NOT:  x64_rmd(a, size, 0xF6, 0xF7, 2, d, 0); break;
+        case X64_NEG:  x64_rmd(a, size, 0xF6, 0xF7, 3, d, 0); break;
+        case X64_MUL:  x64_rmd(a, size, 0xF6, 0xF7, 4, d, 0); break;
+        case X64_DIV:  x64_rmd(a, size, 0xF6, 0xF7, 6, d, 0); break;
+        case X64_IDIV: x64_rmd(a, size, 0xF6, 0xF7, 7, d, 0); break;
+        case X64_INC:  x64_rmd(a, size, 0xFE, 0xFF, 0, d, 0); break;
+        case X64_DEC:  x64_rmd(a, size, 0xFE, 0xFF, 1, d, 0); break;
+
+        case X64_SHL: case X64_SHR: case X64_SAR: {
+            int digit = in->op == X64_SHL ? 4 : in->op == X64_SHR ? 5 : 7;
+            if (s->kind == X64_REG) x64_rmd(a, size, 0xD2, 0xD3, digit, d, 0);     // by cl
+            else if (s->imm == 1) x64_rmd(a, size, 0xD0, 0xD1, digit, d, 0);
+            else { x64_rmd(a, size, 0xC0, 0xC1, digit, d, 1); x64_imm(a, s->imm, 1); }
+            break;
+        }
+
+        case X64_CQO: x64_byte(a, 0x48); x64_byte(a, 0x99); break;
+        case X64_CDQ: x64_byte(a, 0x99); break;
+
+        case X64_PUSH:
+            if (d->kind == X64_REG) {
+                if (d->reg & 8) x64_byte(a, 0x41);
+                x64_byte(a, (uint8_t)(0x50 + (d->reg & 7)));
+            } else if (d->kind == X64_IMM) {
+                if (d->label < 0 && x64_fits8(d->imm)) { x64_byte(a, 0x6A); x64_imm(a, d->imm, 1); }
+                else { x64_byte(a, 0x68); x64_imm_op(a, d, 4, 8); }
+            } else {
+                x64_modrm(a, 0, 0, (const uint8_t*)"\xFF", 1, 6, d, 0, 0);
+            }
+            break;
+        case X64_POP:
+            if (d->kind == X64_REG) {
+                if (d->reg & 8) x64_byte(a, 0x41);
+                x64_byte(a, (uint8_t)(0x58 + (d->reg & 7)));
+            } else {
+                x64_modrm(a, 0, 0, (const uint8_t*)"\x8F", 1, 0, d, 0, 0);
+            }
+            break;
+
+        case X64_CALL:
+            if (d->kind == X64_LABEL || d->kind == X64_IMM) x64_branch(a, in, 0xE8, (const uint8_t*)"\xE8", 1);
+            else x64_modrm(a, 0, 0, (const uint8_t*)"\xFF", 1, 2, d, 0, 0);
+            break;
+        case X64_JMP:
+            if (d->kind == X64_LABEL || d->kind == X64_IMM) x64_branch(a, in, 0xEB, (const uint8_t*)"\xE9", 1);
+            else x64_modrm(a, 0, 0, (const uint8_t*)"\xFF", 1, 4, d, 0, 0);
+            break;
+        case X64_JCC: {
+            uint8_t near_op[2] = { 0x0F, (uint8_t)(0x80 + in->cond) };
+            x64_branch(a, in, (uint8_t)(0x70 + in->cond), near_op, 2);
+            break;
+        }
+        case X64_SETCC:
+            x64_rm2(a, 0, 0, 0x0F, (uint8_t)(0x90 + in->cond), 0, d, 2);
+            break;
+        case X64_CMOVCC:
+            x64_rm2(a, size == 2 ? 0x66 : 0, size == 8, 0x0F, (uint8_t)(0x40 + in->cond), d->reg, s, 0);
+            break;
+        case X64_MOVZX: case X64_MOVSX:
+            x64_rm2(a, d->size == 2 ? 0x66 : 0, d->size == 8, 0x0F,
+                (uint8_t)((in->op == X64_MOVZX ? 0xB6 : 0xBE) + (s->size == 2)), d->reg, s, s->size == 1 ? 2 : 0);
+            break;
+        case X64_MOVSXD:
+            x64_modrm(a, 0, 1, (const uint8_t*)"\x63", 1, d->reg, s, 0, 0);
+            break;
+
+        // F3 0F B8/BD/BC: popcnt (POPCNT), lzcnt (LZCNT/ABM), tzcnt (BMI1)
+        case X64_POPCNT: case X64_LZCNT: case X64_TZCNT:
+            x64_rm2(a, 0xF3, d->size == 8, 0x0F, in->op == X64_POPCNT ? 0xB8 : in->op == X64_LZCNT ? 0xBD : 0xBC, d->reg, s, 0);
+            break;
+        // BMI2: shifts by a count in any register (third operand), flags untouched
+        case X64_SHLX: case X64_SHRX: case X64_SARX:
+            x64_vex(a, in->op == X64_SHLX ? 1 : in->op == X64_SHRX ? 3 : 2, 2, d->size == 8, in->o[2].reg, 0xF7, d->reg, s);
+            break;
+        // mulx hi, lo, src: unsigned rdx * src into any two registers, flags untouched
+        case X64_MULX:
+            x64_vex(a, 3, 2, d->size == 8, s->reg, 0xF6, d->reg, &in->o[2]);
+            break;
+
+        case X64_RET:     x64_byte(a, 0xC3); break;
+        case X64_NOP:     x64_byte(a, 0x90); break;
+        case X64_LEAVE:   x64_byte(a, 0xC9); break;
+        case X64_SYSCALL: x64_byte(a, 0x0F); x64_byte(a, 0x05); break;
+
+        case X64_MOVSD:
+            if (d->kind == X64_MEM) x64_rm2(a, 0xF2, 0, 0x0F, 0x11, s->reg, d, 0);
+            else x64_sse(a, 0xF2, 0x10, in);
+            break;
+        case X64_ADDSD:   x64_sse(a, 0xF2, 0x58, in); break;
+        case X64_MULSD:   x64_sse(a, 0xF2, 0x59, in); break;
+        case X64_SUBSD:   x64_sse(a, 0xF2, 0x5C, in); break;
+        case X64_DIVSD:   x64_sse(a, 0xF2, 0x5E, in); break;
+        case X64_SQRTSD:  x64_sse(a, 0xF2, 0x51, in); break;
+        case X64_UCOMISD: x64_sse(a, 0x66, 0x2E, in); break;
+        case X64_COMISD:  x64_sse(a, 0x66, 0x2F, in); break;
+        case X64_XORPD:   x64_sse(a, 0x66, 0x57, in); break;
+        case X64_MOVAPD:  x64_sse(a, 0x66, 0x28, in); break;
+        case X64_CVTSI2SD:
+            x64_rm2(a, 0xF2, s->size == 8, 0x0F, 0x2A, d->reg, s, 0);
+            break;
+        case X64_CVTTSD2SI:
+            x64_rm2(a, 0xF2, d->size == 8, 0x0F, 0x2C, d->reg, s, 0);
+            break;
+        case X64_MOVQ:
+            if (d->kind == X64_XMM && s->kind != X64_REG) {
+                uint8_t opc[2] = { 0x0F, 0x7E };         // movq xmm, xmm/m64
+                x64_modrm(a, 0xF3, 0, opc, 2, d->reg, s, 0, 0);
+            } else if (d->kind == X64_MEM) {
+                x64_rm2(a, 0x66, 0, 0x0F, 0xD6, s->reg, d, 0);
+            } else if (d->kind == X64_XMM) {
+                x64_rm2(a, 0x66, 1, 0x0F, 0x6E, d->reg, s, 0);
+            } else {
+                x64_rm2(a, 0x66, 1, 0x0F, 0x7E, s->reg, d, 0);
+            }
+            break;
+
+        // x87: memory forms pick the opcode by operand size, register forms add st(i)
+        case X64_FLD:
+            if (d->kind == X64_ST) { x64_byte(a, 0xD9); x64_byte(a, (uint8_t)(0xC0 + d->reg)); }
+            else if (d->size == 10) x64_rmd(a, 4, 0xDB, 0xDB, 5, d, 0);
+            else x64_rmd(a, 4, 0xD9, d->size == 8 ? 0xDD : 0xD9, 0, d, 0);
+            break;
+        case X64_FST: case X64_FSTP: {
+            int pop = in->op == X64_FSTP;
+            if (d->kind == X64_ST) { x64_byte(a, 0xDD); x64_byte(a, (uint8_t)((pop ? 0xD8 : 0xD0) + d->reg)); }
+            else if (d->size == 10 && pop) x64_rmd(a, 4, 0xDB, 0xDB, 7, d, 0);
+            else x64_rmd(a, 4, 0xD9, d->size == 8 ? 0xDD : 0xD9, 2 + pop, d, 0);
+            break;
+        }
+        case X64_FILD:
+            if (d->size == 2) x64_rmd(a, 4, 0xDF, 0xDF, 0, d, 0);
+            else x64_rmd(a, 4, 0xDB, d->size == 8 ? 0xDF : 0xDB, d->size == 8 ? 5 : 0, d, 0);
+            break;
+        case X64_FISTP:
+            if (d->size == 2) x64_rmd(a, 4, 0xDF, 0xDF, 3, d, 0);
+            else x64_rmd(a, 4, 0xDB, d->size == 8 ? 0xDF : 0xDB, d->size == 8 ? 7 : 3, d, 0);
+            break;
+        case X64_FADD: case X64_FMUL: case X64_FSUB: case X64_FDIV: {
+            int digit = in->op == X64_FADD ? 0 : in->op == X64_FMUL ? 1 : in->op == X64_FSUB ? 4 : 6;
+            if (d->kind == X64_MEM) { x64_rmd(a, 4, 0xD8, d->size == 8 ? 0xDC : 0xD8, digit, d, 0); break; }
+            if (in->nops == 1 || d->reg == 0) {
+                // st0 op= st(i)
+                x64_byte(a, 0xD8);
+                x64_byte(a, (uint8_t)(0xC0 + digit * 8 + (in->nops == 1 ? d->reg : s->reg)));
+            } else {
+                // st(i) op= st0: the DC row swaps the sub/subr and div/divr slots
+                x64_byte(a, 0xDC);
+                x64_byte(a, (uint8_t)(0xC0 + (digit >= 4 ? digit + 1 : digit) * 8 + d->reg));
+            }
+            break;
+        }
+        case X64_FXCH:    x64_byte(a, 0xD9); x64_byte(a, (uint8_t)(0xC8 + (in->nops ? d->reg : 1))); break;
+        case X64_FRNDINT: x64_byte(a, 0xD9); x64_byte(a, 0xFC); break;
+        case X64_FCHS:    x64_byte(a, 0xD9); x64_byte(a, 0xE0); break;
+        case X64_FABS:    x64_byte(a, 0xD9); x64_byte(a, 0xE1); break;
+        case X64_FLDZ:    x64_byte(a, 0xD9); x64_byte(a, 0xEE); break;
+        case X64_FLD1:    x64_byte(a, 0xD9); x64_byte(a, 0xE8); break;
+
+        default:
+            a->error = 1;
+    }
+    if (a->error == 1) {
+        fprintf(stderr, "[X64] cannot encode %s\n", x64_op_names[in->op < X64_OP_COUNT ? in->op : 0]);
+        a->error = 2;
+    }
+}
+
+void x64_op(X64Asm* a, X64Op op, X64Operand d, X64Operand s) {
+    X64Inst in = x64_inst(op, s.kind == X64_NONE ? (d.kind == X64_NONE ? 0 : 1) : 2, d, s, (X64Operand){0});
+    x64_emit(a, &in);
+}
+
+void x64_op0(X64Asm* a, X64Op op) {
+    X64Inst in = x64_inst(op, 0, (X64Operand){0}, (X64Operand){0}, (X64Operand){0});
+    x64_emit(a, &in);
+}
+
+void x64_jcc(X64Asm* a, X64Cond cc, int label) {
+    X64Inst in = x64_inst(X64_JCC, 1, x64_l(label), (X64Operand){0}, (X64Operand){0});
+    in.cond = (uint8_t)cc;
+    x64_emit(a, &in);
+}
+
+void x64_setcc(X64Asm* a, X64Cond cc, int reg) {
+    X64Inst in = x64_inst(X64_SETCC, 1, x64_r(reg, 1), (X64Operand){0}, (X64Operand){0});
+    in.cond = (uint8_t)cc;
+    x64_emit(a, &in);
+}
+
+// Patches every fixup whose label is bound. Unbound ones stay in a->fixups (compacted)
+// for the caller to turn into relocations. Returns -1 if a rel8 target is out of range.
+int x64_finish(X64Asm* a) {
+    int kept = 0, rc = 0;
+    for (int i = 0; i < a->nfixups; i++) {
+        X64Fixup f = a->fixups[i];
+        int64_t target = f.label >= 0 && f.label < a->nlabels ? a->labels[f.label] : -1;
+        if (target < 0) { a->fixups[kept++] = f; continue; }
+        uint8_t* p = a->code + f.offset;
+        int64_t v;
+        switch (f.kind) {
+            case X64_FIX_REL8:
+                v = target + f.addend - (int64_t)(f.offset + 1);
+                if (!x64_fits8(v)) { rc = -1; fprintf(stderr, "[X64] short branch out of range at 0x%x\n", f.offset); }
+                p[0] = (uint8_t)v;
+                break;
+            case X64_FIX_REL32:
+                v = target + f.addend - (int64_t)(f.offset + 4);
+                for (int k = 0; k < 4; k++) p[k] = (uint8_t)((uint64_t)v >> (8 * k));
+                break;
+            case X64_FIX_ABS32: case X64_FIX_ABS32S: case X64_FIX_ABS64:
+                // absolute addresses need a load address: left for the object writer / JIT
+                a->fixups[kept++] = f;
+                break;
+        }
+    }
+    a->nfixups = kept;
+    return a->error ? -1 : rc;
+}
+
+// === NASM-syntax printer ===
+
+static const char* x64_reg_names[4][16] = {
+    { "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b" },
+    { "ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w" },
+    { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d" },
+    { "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" },
+};
+
+static const char* x64_cc_names[16] = {
+    "o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g"
+};
+
+const char* x64_reg_name(int reg, int size) {
+    int row = size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3;
+    return reg >= 0 && reg < 16 ? x64_reg_names[row][reg] : "?";
+}
+
+static void x64_print_label(FILE* f, int label, char** names) {
+    if (names && names[label]) fputs(names[label], f);
+    else fprintf(f, ".L%d", label);
+}
+
+static void x64_print_operand(FILE* f, const X64Operand* o, int sized, char** names) {
+    static const char* size_kw[11] = { "", "byte", "word", "", "dword", "", "", "", "qword", "", "tword" };
+    switch (o->kind) {
+        case X64_REG: fputs(x64_reg_name(o->reg, o->size), f); break;
+        case X64_XMM: fprintf(f, "xmm%d", o->reg); break;
+        case X64_ST: fprintf(f, "st%d", o->reg); break;
+        case X64_IMM:
+            if (o->label < 0) { fprintf(f, "%lld", (long long)o->imm); break; }
+            x64_print_label(f, o->label, names);
+            if (o->imm) fprintf(f, "%+lld", (long long)o->imm);
+            break;
+        case X64_LABEL:
+            x64_print_label(f, o->label, names);
+            if (o->imm) fprintf(f, "%+lld", (long long)o->imm);
+            break;
+        case X64_MEM: {
+            if (sized && o->size <= 10 && size_kw[o->size][0]) fprintf(f, "%s ", size_kw[o->size]);
+            fputc('[', f);
+            int first = 1;
+            if (o->reg == X64_RIP) {
+                fputs("rel ", f);
+                if (o->label >= 0) { x64_print_label(f, o->label, names); first = 0; }
+            } else {
+                if (o->label >= 0) { x64_print_label(f, o->label, names); first = 0; }
+                if (o->reg >= 0) { fprintf(f, "%s%s", first ? "" : "+", x64_reg_name(o->reg, 8)); first = 0; }
+            }
+            if (o->index >= 0) {
+                fprintf(f, "%s%s", first ? "" : "+", x64_reg_name(o->index, 8));
+                if (o->scale > 1) fprintf(f, "*%d", o->scale);
+                first = 0;
+            }
+            if (o->imm || first) fprintf(f, first ? "%lld" : "%+lld", (long long)o->imm);
+            fputc(']', f);
+            break;
+        }
+    }
+}
+
+// Prints one instruction the way it would be written for nasm (no trailing newline).
+void x64_print(FILE* f, const X64Inst* in, char** label_names) {
+    const char* name = x64_op_names[in->op];
+    char buf[16];
+    if (in->op == X64_JCC || in->op == X64_SETCC || in->op == X64_CMOVCC) {
+        snprintf(buf, sizeof(buf), "%s%s", in->op == X64_JCC ? "j" : in->op == X64_SETCC ? "set" : "cmov", x64_cc_names[in->cond & 15]);
+        name = buf;
+    }
+    for (const char* c = name; *c; c++) fputc(*c >= 'A' && *c <= 'Z' ? *c - 'A' + 'a' : *c, f);
+    if ((in->flags & X64_SHORT) && (in->op == X64_JMP || in->op == X64_JCC)) fputs(" short", f);
+    for (int i = 0; i < in->nops; i++) {
+        // a memory operand needs an explicit size unless a register operand implies it
+        int sized = in->o[i].kind == X64_MEM &&
+            !(in->op == X64_LEA) &&
+            (in->nops == 1 || in->op == X64_MOVZX || in->op == X64_MOVSX || in->op == X64_CVTSI2SD ||
+             in->op == X64_SHL || in->op == X64_SHR || in->op == X64_SAR ||
+             (in->o[0].kind != X64_REG && in->o[1].kind != X64_REG && in->o[0].kind != X64_XMM && in->o[1].kind != X64_XMM));
+        fputs(i ? ", " : " ", f);
+        x64_print_operand(f, &in->o[i], sized, label_names);
+    }
+}
+
+// === Target features ===
+
+#define X64_FEATURES(X) \
+    X(SSE3, "sse3") X(SSSE3, "ssse3") X(SSE41, "sse4.1") X(SSE42, "sse4.2") X(POPCNT, "popcnt") \
+    X(CX16, "cx16") X(LAHF, "lahf") X(AVX, "avx") X(AVX2, "avx2") X(BMI1, "bmi1") X(BMI2, "bmi2") \
+    X(LZCNT, "lzcnt") X(MOVBE, "movbe") X(FMA, "fma") X(F16C, "f16c") \
+    X(AVX512F, "avx512f") X(AVX512BW, "avx512bw") X(AVX512CD, "avx512cd") X(AVX512DQ, "avx512dq") X(AVX512VL, "avx512vl")
+
+enum {
+#define X64_FEAT_BIT(name, text) X64_FEAT_BIT_##name,
+    X64_FEATURES(X64_FEAT_BIT)
+#undef X64_FEAT_BIT
+    X64_FEAT_COUNT
+};
+
+enum {
+#define X64_FEAT_MASK(name, text) X64_FEAT_##name = 1u << X64_FEAT_BIT_##name,
+    X64_FEATURES(X64_FEAT_MASK)
+#undef X64_FEAT_MASK
+};
+
+static const char* x64_feature_names[X64_FEAT_COUNT] = {
+#define X64_FEAT_NAME(name, text) text,
+    X64_FEATURES(X64_FEAT_NAME)
+#undef X64_FEAT_NAME
+};
+
+// The psABI microarchitecture levels, each a superset of the one before.
+#define X64_LEVEL_V2 (X64_FEAT_SSE3 | X64_FEAT_SSSE3 | X64_FEAT_SSE41 | X64_FEAT_SSE42 | X64_FEAT_POPCNT | X64_FEAT_CX16 | X64_FEAT_LAHF)
+#define X64_LEVEL_V3 (X64_LEVEL_V2 | X64_FEAT_AVX | X64_FEAT_AVX2 | X64_FEAT_BMI1 | X64_FEAT_BMI2 | X64_FEAT_LZCNT | \
+                      X64_FEAT_MOVBE | X64_FEAT_FMA | X64_FEAT_F16C)
+#define X64_LEVEL_V4 (X64_LEVEL_V3 | X64_FEAT_AVX512F | X64_FEAT_AVX512BW | X64_FEAT_AVX512CD | X64_FEAT_AVX512DQ | X64_FEAT_AVX512VL)
+
+static const struct { const char* name; uint32_t features; } x64_marches[] = {
+    { "x86-64", 0 },
+    { "x86-64-v2", X64_LEVEL_V2 },
+    { "x86-64-v3", X64_LEVEL_V3 },
+    { "x86-64-v4", X64_LEVEL_V4 },
+};
+
+// Baseline x86-64 (SSE2) unless --march says otherwise: output runs on any x86-64 machine.
+uint32_t x64_features = 0;
+const char* x64_march = "x86-64";
+
+// The host's features from cpuid. AVX and AVX-512 also need the OS to save their registers
+// (XCR0), so a CPU that has them under a kernel that does not counts as not having them.
+uint32_t x64_detect_features(void) {
+    uint32_t f = 0;
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) return 0;
+    if (c & 1u << 0) f |= X64_FEAT_SSE3;
+    if (c & 1u << 9) f |= X64_FEAT_SSSE3;
+    if (c & 1u << 12) f |= X64_FEAT_FMA;
+    if (c & 1u << 13) f |= X64_FEAT_CX16;
+    if (c & 1u << 19) f |= X64_FEAT_SSE41;
+    if (c & 1u << 20) f |= X64_FEAT_SSE42;
+    if (c & 1u << 22) f |= X64_FEAT_MOVBE;
+    if (c & 1u << 23) f |= X64_FEAT_POPCNT;
+    if (c & 1u << 28) f |= X64_FEAT_AVX;
+    if (c & 1u << 29) f |= X64_FEAT_F16C;
+    uint64_t xcr0 = 0;
+    if (c & 1u << 27) {     // OSXSAVE: xgetbv is available
+        uint32_t lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = (uint64_t)hi << 32 | lo;
+    }
+    int ymm = (xcr0 & 0x06) == 0x06, zmm = (xcr0 & 0xE6) == 0xE6;
+    if (!ymm) f &= ~(uint32_t)(X64_FEAT_AVX | X64_FEAT_FMA | X64_FEAT_F16C);
+    if (__get_cpuid_max(0, NULL) >= 7) {
+        __cpuid_count(7, 0, a, b, c, d);
+        if (b & 1u << 3) f |= X64_FEAT_BMI1;
+        if ((b & 1u << 5) && ymm) f |= X64_FEAT_AVX2;
+        if (b & 1u << 8) f |= X64_FEAT_BMI2;
+        if (zmm) {
+            if (b & 1u << 16) f |= X64_FEAT_AVX512F;
+            if (b & 1u << 17) f |= X64_FEAT_AVX512DQ;
+            if (b & 1u << 28) f |= X64_FEAT_AVX512CD;
+            if (b & 1u << 30) f |= X64_FEAT_AVX512BW;
+            if (b & 1u << 31) f |= X64_FEAT_AVX512VL;
+        }
+    }
+    if (__get_cpuid(0x80000001, &a, &b, &c, &d)) {
+        if (c & 1u << 0) f |= X64_FEAT_LAHF;
+        if (c & 1u << 5) f |= X64_FEAT_LZCNT;
+    }
+#endif
+    return f;
+}
+
+// --march: a psABI level or "native" (this machine, from cpuid). Returns -1 for an unknown name.
+int x64_set_march(const char* name) {
+    if (strcmp(name, "native") == 0) {
+        x64_features = x64_detect_features();
+        x64_march = "native";
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(x64_marches) / sizeof(x64_marches[0]); i++)
+        if (strcmp(x64_marches[i].name, name) == 0) {
+            x64_features = x64_marches[i].features;
+            x64_march = x64_marches[i].name;
+            return 0;
+        }
+    return -1;
+}
+
+// Highest psABI level the target features cover.
+const char* x64_march_level(void) {
+    for (int i = (int)(sizeof(x64_marches) / sizeof(x64_marches[0])) - 1; i > 0; i--)
+        if ((x64_features & x64_marches[i].features) == x64_marches[i].features) return x64_marches[i].name;
+    return x64_marches[0].name;
+}
+
+// Widest vector ISA the vectorizer may use on the target (an ssa_set_vector_isa name).
+const char* x64_vector_isa(void) {
+    uint32_t avx512 = X64_FEAT_AVX512F | X64_FEAT_AVX512DQ | X64_FEAT_AVX512VL;
+    if ((x64_features & avx512) == avx512) return "avx512";
+    return x64_features & X64_FEAT_AVX2 ? "avx2" : "sse2";
+}
+
+// Name of a feature instruction `op` needs that the target lacks, or NULL if it may be used.
+const char* x64_missing_feature(int op) {
+    uint32_t need = op == X64_POPCNT ? X64_FEAT_POPCNT : op == X64_LZCNT ? X64_FEAT_LZCNT :
+        op == X64_TZCNT ? X64_FEAT_BMI1 :
+        op == X64_SHLX || op == X64_SHRX || op == X64_SARX || op == X64_MULX ? X64_FEAT_BMI2 : 0;
+    for (int i = 0; i < X64_FEAT_COUNT; i++)
+        if ((need & ~x64_features) >> i & 1) return x64_feature_names[i];
+    return NULL;
+}
+
+void x64_print_features(FILE* f) {
+    fprintf(f, "[X64] target %s (%s):", x64_march, x64_march_level());
+    if (!x64_features) fputs(" sse2", f);
+    for (int i = 0; i < X64_FEAT_COUNT; i++)
+        if (x64_features >> i & 1) fprintf(f, " %s", x64_feature_names[i]);
+    fputc('\n', f);
+}
+// rexion_jit.c – Rexion in-process x86-64 JIT
+// DOC: Lowers the IR buffer straight to machine code with x64_encoder.c, no nasm/ld/process spawn
+// DOC: IR names live in a frame of 8-byte slots addressed off rbx; the most-used integer
+// DOC: names are pinned to callee-saved r12-r15 for the whole run
+// DOC: Code is written into an mmap'd RW buffer, then flipped to RX (W^X) before the call
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#define JIT_PINNED 4
+#define JIT_NEST_DEPTH 256
+
+static const int jit_pin_regs[JIT_PINNED] = { X64_R12, X64_R13, X64_R14, X64_R15 };
+
+typedef struct {
+    void* code;             // RX mapping
+    size_t size;            // mapping size
+    size_t code_len;        // bytes of machine code
+    int nslots;             // frame slots (slot 0 holds the entry rsp)
+    int64_t* frame;
+    const char* strtab;     // LOAD_STR pointers point into this table
+} JITProgram;
+
+typedef struct {
+    uint32_t id;            // IR string id (0 = empty)
+    int slot;
+} JITSlot;
+
+typedef struct {
+    X64Asm a;
+    JITSlot* slots;
+    int slot_cap;
+    int nslots;
+    int* uses;              // per slot
+    uint8_t* is_float;
+    uint8_t* is_string;
+    int pinned[JIT_PINNED]; // slot pinned to jit_pin_regs[i], or -1
+    uint32_t* label_ids;
+    int* label_of;
+    int nlabels;
+    int exit_label;
+    int nest[JIT_NEST_DEPTH][2];     // open IF/WHILE: { skip label, loop head / end label }
+    int nest_kind[JIT_NEST_DEPTH];
+    int depth;
+    int errors;
+} JITCompiler;
+
+static void jit_print_int(int64_t v) { printf("%lld\n", (long long)v); }
+static void jit_print_float(double v) { char t[32]; ir_format_float(t, sizeof(t), v); printf("%s\n", t); }
+static void jit_print_str(const char* s) { printf("%s\n", s ? s : ""); }
+
+// Same literal rules as the VM: decimal only, the whole operand, within int64.
+static int jit_parse_int(const char* s, int64_t* out) {
+    char* e;
+    if (!*s) return 0;
+    errno = 0;
+    long long v = strtoll(s, &e, 10);
+    if (*e || errno == ERANGE) return 0;
+    *out = v;
+    return 1;
+}
+
+static int jit_parse_float(const char* s, double* out) {
+    char* e;
+    if (!*s || strpbrk(s, "xX")) return 0;
+    double v = strtod(s, &e);
+    if (*e) return 0;
+    *out = v;
+    return 1;
+}
+
+static int jit_is_literal(uint32_t id) {
+    int64_t k;
+    double f;
+    const char* s = ir_str(id);
+    return jit_parse_int(s, &k) || jit_parse_float(s, &f);
+}
+
+// Slot for an IR name; slots are numbered from 1 (slot 0 keeps the entry rsp).
+static int jit_slot(JITCompiler* J, uint32_t id) {
+    if (J->nslots * 2 >= J->slot_cap) {
+        int old_cap = J->slot_cap;
+        JITSlot* old = J->slots;
+        J->slot_cap = old_cap ? old_cap * 2 : 256;
+        J->slots = calloc((size_t)J->slot_cap, sizeof(JITSlot));
+        J->uses = realloc(J->uses, (size_t)J->slot_cap * sizeof(int));
+        J->is_float = realloc(J->is_float, (size_t)J->slot_cap);
+        J->is_string = realloc(J->is_string, (size_t)J->slot_cap);
+        if (!J->slots || !J->uses || !J->is_float || !J->is_string) { perror("jit_slot"); exit(1); }
+        memset(J->uses + old_cap, 0, (size_t)(J->slot_cap - old_cap) * sizeof(int));
+        memset(J->is_float + old_cap, 0, (size_t)(J->slot_cap - old_cap));
+        memset(J->is_string + old_cap, 0, (size_t)(J->slot_cap - old_cap));
+        for (int i = 0; i < old_cap; i++) {
+            if (!old[i].id) continue;
+            unsigned h = (old[i].id * 2654435761u) & (unsigned)(J->slot_cap - 1);
+            while (J->slots[h].id) h = (h + 1) & (unsigned)(J->slot_cap - 1);
+            J->slots[h] = old[i];
+        }
+        free(old);
+    }
+    unsigned h = (id * 2654435761u) & (unsigned)(J->slot_cap - 1);
+    while (J->slots[h].id && J->slots[h].id != id) h = (h + 1) & (unsigned)(J->slot_cap - 1);
+    if (!J->slots[h].id) {
+        J->slots[h].id = id;
+        J->slots[h].slot = ++J->nslots;
+    }
+    return J->slots[h].slot;
+}
+
+// Where a slot lives: its pinned register or [rbx + 8*slot].
+static X64Operand jit_home(JITCompiler* J, int slot) {
+    for (int i = 0; i < JIT_PINNED; i++)
+        if (J->pinned[i] == slot) return x64_r64(jit_pin_regs[i]);
+    return x64_m(X64_RBX, X64_NOREG, 1, (int64_t)slot * 8, 8);
+}
+
+// Integer source operand: an imm32 literal, a pinned register, or the slot in memory.
+// Wider literals are materialized into `scratch`.
+static X64Operand jit_src(JITCompiler* J, uint32_t id, int scratch) {
+    int64_t k;
+    double f;
+    const char* s = ir_str(id);
+    if (jit_parse_int(s, &k)) {
+        if (k >= INT32_MIN && k <= INT32_MAX) return x64_i(k);
+        x64_op(&J->a, X64_MOV, x64_r64(scratch), x64_i(k));
+        return x64_r64(scratch);
+    }
+    if (jit_parse_float(s, &f)) {
+        int64_t bits;
+        memcpy(&bits, &f, 8);
+        x64_op(&J->a, X64_MOV, x64_r64(scratch), x64_i(bits));
+        return x64_r64(scratch);
+    }
+    return jit_home(J, jit_slot(J, id));
+}
+
+static void jit_load(JITCompiler* J, int reg, uint32_t id) {
+    X64Operand s = jit_src(J, id, reg);
+    if (s.kind == X64_REG && s.reg == reg) return;
+    x64_op(&J->a, X64_MOV, x64_r64(reg), s);
+}
+
+static void jit_store(JITCompiler* J, int slot, int reg) {
+    x64_op(&J->a, X64_MOV, jit_home(J, slot), x64_r64(reg));
+}
+
+static void jit_load_xmm(JITCompiler* J, int xmm, uint32_t id) {
+    X64Operand s = jit_src(J, id, X64_RAX);
+    if (s.kind == X64_MEM) x64_op(&J->a, X64_MOVSD, x64_x(xmm), s);
+    else {
+        if (s.kind == X64_IMM) {
+            // an integer literal in float context
+            double f = (double)s.imm;
+            int64_t bits;
+            memcpy(&bits, &f, 8);
+            x64_op(&J->a, X64_MOV, x64_r64(X64_RAX), x64_i(bits));
+            s = x64_r64(X64_RAX);
+        }
+        x64_op(&J->a, X64_MOVQ, x64_x(xmm), s);
+    }
+}
+
+static void jit_label_ref(JITCompiler* J, uint32_t id, int* out) {
+    for (int i = 0; i < J->nlabels; i++)
+        if (J->label_ids[i] == id) { *out = J->label_of[i]; return; }
+    J->label_ids = realloc(J->label_ids, (size_t)(J->nlabels + 1) * sizeof(uint32_t));
+    J->label_of = realloc(J->label_of, (size_t)(J->nlabels + 1) * sizeof(int));
+    J->label_ids[J->nlabels] = id;
+    J->label_of[J->nlabels] = x64_new_label(&J->a);
+    *out = J->label_of[J->nlabels++];
+}
+
+// Calls a C helper with rdi/xmm0 already loaded; rbp keeps rsp across the 16-byte realignment.
+static void jit_call_helper(JITCompiler* J, void* fn) {
+    x64_op(&J->a, X64_MOV, x64_r64(X64_RAX), x64_i((int64_t)(intptr_t)fn));
+    x64_op(&J->a, X64_MOV, x64_r64(X64_RBP), x64_r64(X64_RSP));
+    x64_op(&J->a, X64_AND, x64_r64(X64_RSP), x64_i(-16));
+    x64_op(&J->a, X64_CALL, x64_r64(X64_RAX), (X64Operand){0});
+    x64_op(&J->a, X64_MOV, x64_r64(X64_RSP), x64_r64(X64_RBP));
+}
+
+// Two-address (d op= s) or three-address (d = a op b) integer op.
+static void jit_binop(JITCompiler* J, const IRInstruction* in, X64Op op) {
+    int d = jit_slot(J, in->arg[0]);
+    uint32_t a_id = in->nargs == 3 ? in->arg[1] : in->arg[0];
+    uint32_t b_id = in->nargs == 3 ? in->arg[2] : in->arg[1];
+    X64Operand home = jit_home(J, d);
+
+    if (in->nargs == 2 && home.kind == X64_REG && op != X64_IMUL) {
+        X64Operand b = jit_src(J, b_id, X64_RCX);
+        x64_op(&J->a, op, home, b);
+        return;
+    }
+    jit_load(J, X64_RAX, a_id);
+    X64Operand b = jit_src(J, b_id, X64_RCX);
+    if (op == X64_IMUL && b.kind == X64_IMM) {
+        X64Inst mul = x64_inst(X64_IMUL, 3, x64_r64(X64_RAX), x64_r64(X64_RAX), b);
+        x64_emit(&J->a, &mul);
+    } else {
+        x64_op(&J->a, op, x64_r64(X64_RAX), b);
+    }
+    jit_store(J, d, X64_RAX);
+}
+
+// DIV/MOD with the VM's semantics: a zero divisor yields 0, x / -1 negates (wrapping) and x % -1 is 0.
+static void jit_divmod(JITCompiler* J, const IRInstruction* in, int want_rem) {
+    int d = jit_slot(J, in->arg[0]);
+    uint32_t a_id = in->nargs == 3 ? in->arg[1] : in->arg[0];
+    uint32_t b_id = in->nargs == 3 ? in->arg[2] : in->arg[1];
+    int zero = x64_new_label(&J->a), done = x64_new_label(&J->a);
+    int minus1 = want_rem ? zero : x64_new_label(&J->a);
+    jit_load(J, X64_RAX, a_id);
+    jit_load(J, X64_RCX, b_id);
+    x64_op(&J->a, X64_TEST, x64_r64(X64_RCX), x64_r64(X64_RCX));
+    x64_jcc(&J->a, X64_CC_E, zero);
+    x64_op(&J->a, X64_CMP, x64_r64(X64_RCX), x64_i(-1));
+    x64_jcc(&J->a, X64_CC_E, minus1);      // idiv traps on INT64_MIN / -1
+    x64_op0(&J->a, X64_CQO);
+    x64_op(&J->a, X64_IDIV, x64_r64(X64_RCX), (X64Operand){0});
+    if (want_rem) x64_op(&J->a, X64_MOV, x64_r64(X64_RAX), x64_r64(X64_RDX));
+    x64_op(&J->a, X64_JMP, x64_l(done), (X64Operand){0});
+    if (!want_rem) {
+        x64_bind(&J->a, minus1);
+        x64_op(&J->a, X64_NEG, x64_r64(X64_RAX), (X64Operand){0});
+        x64_op(&J->a, X64_JMP, x64_l(done), (X64Operand){0});
+    }
+    x64_bind(&J->a, zero);
+    x64_op(&J->a, X64_XOR, x64_r(X64_RAX, 4), x64_r(X64_RAX, 4));
+    x64_bind(&J->a, done);
+    jit_store(J, d, X64_RAX);
+}
+
+static void jit_compare(JITCompiler* J, const IRInstruction* in, X64Cond cc) {
+    int d = jit_slot(J, in->arg[0]);
+    uint32_t a_id = in->nargs == 3 ? in->arg[1] : in->arg[0];
+    uint32_t b_id = in->nargs == 3 ? in->arg[2] : in->arg[1];
+    jit_load(J, X64_RAX, a_id);
+    x64_op(&J->a, X64_CMP, x64_r64(X64_RAX), jit_src(J, b_id, X64_RCX));
+    x64_setcc(&J->a, cc, X64_RAX);
+    x64_op(&J->a, X64_MOVZX, x64_r(X64_RAX, 4), x64_r(X64_RAX, 1));
+    jit_store(J, d, X64_RAX);
+}
+
+static void jit_float_op(JITCompiler* J, const IRInstruction* in, X64Op op) {
+    int d = jit_slot(J, in->arg[0]);
+    uint32_t a_id = in->nargs == 3 ? in->arg[1] : in->arg[0];
+    uint32_t b_id = in->nargs == 3 ? in->arg[2] : in->arg[1];
+    jit_load_xmm(J, 0, a_id);
+    jit_load_xmm(J, 1, b_id);
+    x64_op(&J->a, op, x64_x(0), x64_x(1));
+    X64Operand home = jit_home(J, d);
+    if (home.kind == X64_MEM) x64_op(&J->a, X64_MOVSD, home, x64_x(0));
+    else x64_op(&J->a, X64_MOVQ, home, x64_x(0));
+    J->is_float[d] = 1;
+}
+
+// Jump to `label` when the value named by id is zero.
+static void jit_branch_zero(JITCompiler* J, uint32_t id, int label) {
+    X64Operand v = jit_src(J, id, X64_RAX);
+    if (v.kind == X64_IMM) {
+        if (v.imm == 0) x64_op(&J->a, X64_JMP, x64_l(label), (X64Operand){0});
+        return;
+    }
+    if (v.kind == X64_REG) x64_op(&J->a, X64_TEST, v, v);
+    else x64_op(&J->a, X64_CMP, v, x64_i(0));
+    x64_jcc(&J->a, X64_CC_E, label);
+}
+
+// Pass 1: type and count every name so the hottest integer names get registers.
+static void jit_scan(JITCompiler* J) {
+    for (int i = 0; i < ir_count; i++) {
+        const IRInstruction* in = &ir[i];
+        switch ((IROpcode)in->opcode) {
+            case IR_OP_LABEL: case IR_OP_FUNC: case IR_OP_JMP: case IR_OP_CALL:
+            case IR_OP_SECTION: case IR_OP_ENTRY: case IR_OP_IMPORT: case IR_OP_DECLARE:
+                continue;
+            case IR_OP_IFZ:
+                if (!jit_is_literal(in->arg[0])) J->uses[jit_slot(J, in->arg[0])]++;
+                continue;
+            default:
+                break;
+        }
+        for (int k = 0; k < in->nargs; k++) {
+            if (jit_is_literal(in->arg[k]) || (in->opcode == IR_OP_LOAD_STR && k == 1)) continue;
+            int s = jit_slot(J, in->arg[k]);
+            J->uses[s]++;
+            if (k == 0 && (in->opcode == IR_OP_FLOAT_LOAD || in->opcode == IR_OP_FLOAT_ADD || in->opcode == IR_OP_FLOAT_SUB ||
+                           in->opcode == IR_OP_FLOAT_MUL || in->opcode == IR_OP_FLOAT_DIV))
+                J->is_float[s] = 1;
+            if (k == 0 && in->opcode == IR_OP_LOAD_STR) J->is_string[s] = 1;
+        }
+    }
+    // floats/strings spread through moves; a couple of rounds covers straight-line chains
+    for (int round = 0; round < 4; round++) {
+        for (int i = 0; i < ir_count; i++) {
+            const IRInstruction* in = &ir[i];
+            if ((in->opcode == IR_OP_MOV || in->opcode == IR_OP_LOAD || in->opcode == IR_OP_STORE) && in->nargs == 2 &&
+                !jit_is_literal(in->arg[1])) {
+                int d = jit_slot(J, in->arg[0]), s = jit_slot(J, in->arg[1]);
+                J->is_float[d] |= J->is_float[s];
+                J->is_string[d] |= J->is_string[s];
+            }
+            if (in->opcode == IR_OP_LOAD && in->nargs == 2) {
+                int64_t k;
+                double f;
+                const char* v = ir_str(in->arg[1]);
+                if (!jit_parse_int(v, &k) && jit_parse_float(v, &f)) J->is_float[jit_slot(J, in->arg[0])] = 1;
+            }
+        }
+    }
+    for (int i = 0; i < JIT_PINNED; i++) {
+        int best = -1;
+        for (int s = 1; s <= J->nslots; s++) {
+            int taken = 0;
+            for (int k = 0; k < i; k++) taken |= J->pinned[k] == s;
+            if (taken || J->is_float[s] || J->is_string[s]) continue;
+            if (best < 0 || J->uses[s] > J->uses[best]) best = s;
+        }
+        J->pinned[i] = best;
+    }
+}
+
+static void jit_lower(JITCompiler* J, const char* strtab) {
+    X64Asm* a = &J->a;
+    int d;
+    for (int i = 0; i < ir_count; i++) {
+        const IRInstruction* in = &ir[i];
+        switch ((IROpcode)in->opcode) {
+            case IR_OP_NOP: case IR_OP_SECTION: case IR_OP_ENTRY: case IR_OP_IMPORT: case IR_OP_DECLARE:
+            case IR_OP_PARAM: case IR_OP_ARG:
+                break;
+            case IR_OP_LOAD: case IR_OP_MOV: case IR_OP_STORE: case IR_OP_FLOAT_LOAD: {
+                d = jit_slot(J, in->arg[0]);
+                X64Operand home = jit_home(J, d);
+                int64_t k;
+                double f;
+                const char* v = ir_str(in->arg[1]);
+                if (jit_parse_float(v, &f) && (in->opcode == IR_OP_FLOAT_LOAD || !jit_parse_int(v, &k))) {
+                    // float literal: store its bit pattern
+                    memcpy(&k, &f, 8);
+                    x64_op(a, X64_MOV, x64_r64(X64_RAX), x64_i(k));
+                    jit_store(J, d, X64_RAX);
+                    break;
+                }
+                X64Operand s = jit_src(J, in->arg[1], X64_RAX);
+                if (home.kind == X64_MEM && s.kind == X64_MEM) {
+                    x64_op(a, X64_MOV, x64_r64(X64_RAX), s);
+                    s = x64_r64(X64_RAX);
+                }
+                if (!(s.kind == X64_REG && home.kind == X64_REG && s.reg == home.reg))
+                    x64_op(a, X64_MOV, home, s);
+                break;
+            }
+            case IR_OP_LOAD_STR:
+                d = jit_slot(J, in->arg[0]);
+                x64_op(a, X64_MOV, x64_r64(X64_RAX), x64_i((int64_t)(intptr_t)(strtab + in->arg[1])));
+                jit_store(J, d, X64_RAX);
+                break;
+            case IR_OP_ADD: jit_binop(J, in, X64_ADD); break;
+            case IR_OP_SUB: jit_binop(J, in, X64_SUB); break;
+            case IR_OP_MUL: jit_binop(J, in, X64_IMUL); break;
+            case IR_OP_DIV: jit_divmod(J, in, 0); break;
+            case IR_OP_MOD: jit_divmod(J, in, 1); break;
+            case IR_OP_FLOAT_ADD: jit_float_op(J, in, X64_ADDSD); break;
+            case IR_OP_FLOAT_SUB: jit_float_op(J, in, X64_SUBSD); break;
+            case IR_OP_FLOAT_MUL: jit_float_op(J, in, X64_MULSD); break;
+            case IR_OP_FLOAT_DIV: jit_float_op(J, in, X64_DIVSD); break;
+            case IR_OP_CMP_EQ: jit_compare(J, in, X64_CC_E); break;
+            case IR_OP_CMP_NE: jit_compare(J, in, X64_CC_NE); break;
+            case IR_OP_CMP_LT: jit_compare(J, in, X64_CC_L); break;
+            case IR_OP_CMP_LE: jit_compare(J, in, X64_CC_LE); break;
+            case IR_OP_CMP_GT: jit_compare(J, in, X64_CC_G); break;
+            case IR_OP_CMP_GE: jit_compare(J, in, X64_CC_GE); break;
+            case IR_OP_PRINT: case IR_OP_PRINT_FLOAT_SYSCALL: case IR_OP_PRINT_FLOAT_PRINTF: {
+                int is_float = in->opcode != IR_OP_PRINT;
+                int is_string = 0;
+                if (!jit_is_literal(in->arg[0])) {
+                    int s = jit_slot(J, in->arg[0]);
+                    is_float |= J->is_float[s];
+                    is_string = J->is_string[s];
+                } else {
+                    int64_t k;
+                    is_float = !jit_parse_int(ir_str(in->arg[0]), &k);
+                }
+                if (is_float) {
+                    jit_load_xmm(J, 0, in->arg[0]);
+                    jit_call_helper(J, (void*)jit_print_float);
+                } else {
+                    jit_load(J, X64_RDI, in->arg[0]);
+                    jit_call_helper(J, is_string ? (void*)jit_print_str : (void*)jit_print_int);
+                }
+                break;
+            }
+            case IR_OP_LABEL: case IR_OP_FUNC: {
+                int l;
+                jit_label_ref(J, in->arg[0], &l);
+                x64_bind(a, l);
+                break;
+            }
+            case IR_OP_JMP: {
+                int l;
+                jit_label_ref(J, in->arg[0], &l);
+                x64_op(a, X64_JMP, x64_l(l), (X64Operand){0});
+                break;
+            }
+            case IR_OP_IFZ: {
+                int l;
+                jit_label_ref(J, in->arg[1], &l);
+                jit_branch_zero(J, in->arg[0], l);
+                break;
+            }
+            case IR_OP_CALL: {
+                // a call right before RET is a tail call: jmp, so the callee's ret returns for both
+                int l;
+                jit_label_ref(J, in->arg[0], &l);
+                x64_op(a, i + 1 < ir_count && ir[i + 1].opcode == IR_OP_RET ? X64_JMP : X64_CALL, x64_l(l), (X64Operand){0});
+                break;
+            }
+            case IR_OP_RET:
+                x64_op0(a, X64_RET);
+                break;
+            case IR_OP_HALT:
+                x64_op(a, X64_JMP, x64_l(J->exit_label), (X64Operand){0});
+                break;
+            case IR_OP_IF:
+            case IR_OP_WHILE:
+                if (J->depth == JIT_NEST_DEPTH) { fprintf(stderr, "[JIT] IF/WHILE nested too deep\n"); J->errors++; break; }
+                J->nest_kind[J->depth] = in->opcode;
+                J->nest[J->depth][0] = x64_new_label(a);       // false / exit
+                J->nest[J->depth][1] = x64_new_label(a);       // loop head / end of else
+                if (in->opcode == IR_OP_WHILE) x64_bind(a, J->nest[J->depth][1]);
+                jit_branch_zero(J, in->arg[0], J->nest[J->depth][0]);
+                J->depth++;
+                break;
+            case IR_OP_ELSE:
+                if (!J->depth || J->nest_kind[J->depth - 1] != IR_OP_IF) { fprintf(stderr, "[JIT] ELSE without IF\n"); J->errors++; break; }
+                x64_op(a, X64_JMP, x64_l(J->nest[J->depth - 1][1]), (X64Operand){0});
+                x64_bind(a, J->nest[J->depth - 1][0]);
+                J->nest_kind[J->depth - 1] = IR_OP_ELSE;
+                break;
+            case IR_OP_END_IF:
+                if (!J->depth || J->nest_kind[J->depth - 1] == IR_OP_WHILE) { fprintf(stderr, "[JIT] END_IF without IF\n"); J->errors++; break; }
+                J->depth--;
+                x64_bind(a, J->nest[J->depth][J->nest_kind[J->depth] == IR_OP_ELSE ? 1 : 0]);
+                break;
+            case IR_OP_END_WHILE:
+                if (!J->depth || J->nest_kind[J->depth - 1] != IR_OP_WHILE) { fprintf(stderr, "[JIT] END_WHILE without WHILE\n"); J->errors++; break; }
+                J->depth--;
+                x64_op(a, X64_JMP, x64_l(J->nest[J->depth][1]), (X64Operand){0});
+                x64_bind(a, J->nest[J->depth][0]);
+                break;
+            default:
+                fprintf(stderr, "[JIT] unsupported IR op '%s'\n", ir_str(in->op));
+                J->errors++;
+        }
+    }
+    if (J->depth) { fprintf(stderr, "[JIT] %d unterminated IF/WHILE block(s)\n", J->depth); J->errors++; }
+}
+
+// Compiles ir[0..ir_count) into an executable mapping. Returns 0 on success.
+int jit_compile(JITProgram* P) {
+    static const int saved[] = { X64_RBX, X64_RBP, X64_R12, X64_R13, X64_R14, X64_R15 };
+    JITCompiler* J = calloc(1, sizeof(JITCompiler));
+    if (!J) { perror("jit_compile"); return -1; }
+    memset(P, 0, sizeof(*P));
+    X64Asm* a = &J->a;
+    for (int i = 0; i < JIT_PINNED; i++) J->pinned[i] = -1;
+    jit_scan(J);
+
+    // prologue: save callee-saved regs, rbx = frame, frame[0] = rsp for HALT from any depth
+    for (int i = 0; i < 6; i++) x64_op(a, X64_PUSH, x64_r64(saved[i]), (X64Operand){0});
+    x64_op(a, X64_MOV, x64_r64(X64_RBX), x64_r64(X64_RDI));
+    x64_op(a, X64_MOV, x64_m(X64_RBX, X64_NOREG, 1, 0, 8), x64_r64(X64_RSP));
+    for (int i = 0; i < JIT_PINNED; i++)
+        if (J->pinned[i] > 0) x64_op(a, X64_MOV, x64_r64(jit_pin_regs[i]), x64_m(X64_RBX, X64_NOREG, 1, (int64_t)J->pinned[i] * 8, 8));
+    int body = x64_new_label(a);
+    J->exit_label = x64_new_label(a);
+    x64_op(a, X64_CALL, x64_l(body), (X64Operand){0});     // a top-level RET lands on the exit path
+    x64_bind(a, J->exit_label);
+    x64_op(a, X64_MOV, x64_r64(X64_RSP), x64_m(X64_RBX, X64_NOREG, 1, 0, 8));
+    for (int i = 0; i < JIT_PINNED; i++)
+        if (J->pinned[i] > 0) x64_op(a, X64_MOV, x64_m(X64_RBX, X64_NOREG, 1, (int64_t)J->pinned[i] * 8, 8), x64_r64(jit_pin_regs[i]));
+    for (int i = 5; i >= 0; i--) x64_op(a, X64_POP, x64_r64(saved[i]), (X64Operand){0});
+    x64_op0(a, X64_RET);
+
+    x64_bind(a, body);
+    jit_lower(J, ir_strtab);
+    x64_op(a, X64_JMP, x64_l(J->exit_label), (X64Operand){0});
+
+    for (int i = 0; i < J->nlabels; i++) {
+        if (a->labels[J->label_of[i]] < 0) { fprintf(stderr, "[JIT] undefined label '%s'\n", ir_str(J->label_ids[i])); J->errors++; }
+    }
+    if (x64_finish(a) != 0 || a->nfixups) J->errors++;
+
+    int rc = -1;
+    if (!J->errors) {
+        size_t page = 4096;
+        size_t size = (a->len + page - 1) & ~(page - 1);
+        void* mem = mmap(NULL, size ? size : page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            perror("jit mmap");
+        } else {
+            memcpy(mem, a->code, a->len);
+            if (mprotect(mem, size ? size : page, PROT_READ | PROT_EXEC) != 0) {
+                perror("jit mprotect");
+                munmap(mem, size ? size : page);
+            } else {
+                P->code = mem;
+                P->size = size ? size : page;
+                P->code_len = a->len;
+                P->nslots = J->nslots + 1;
+                P->frame = calloc((size_t)P->nslots, sizeof(int64_t));
+                P->strtab = ir_strtab;
+                rc = 0;
+            }
+        }
+    }
+    x64_free(a);
+    free(J->slots); free(J->uses); free(J->is_float); free(J->is_string);
+    free(J->label_ids); free(J->label_of);
+    free(J);
+    return rc;
+}
+
+void jit_run(JITProgram* P) {
+    void (*entry)(int64_t*) = (void (*)(int64_t*))P->code;
+    entry(P->frame);
+    fflush(stdout);
+}
+
+void jit_release(JITProgram* P) {
+    if (P->code) munmap(P->code, P->size);
+    free(P->frame);
+    memset(P, 0, sizeof(*P));
+}
+
+static double jit_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Loads an IR program, JIT-compiles and runs it, reporting compile/run latency.
+int jit_run_file(const char* path) {
+    ir_reset();
+    if (ir_load_any(path) != 0) return -1;
+    JITProgram P;
+    double t0 = jit_now_us();
+    if (jit_compile(&P) != 0) return -1;
+    double t1 = jit_now_us();
+    jit_run(&P);
+    double t2 = jit_now_us();
+    fprintf(stderr, "[JIT] %d IR ops -> %zu bytes, compile %.1f us, run %.1f us\n",
+        ir_count, P.code_len, t1 - t0, t2 - t1);
+    jit_release(&P);
+    return 0;
+}
+
+// Latency/throughput benchmark: the same counting loop through the VM and the JIT.
+void jit_bench(long long iterations) {
+    char n[32];
+    snprintf(n, sizeof(n), "%lld", iterations);
+    ir_reset();
+    ir_emit("LOAD", "i", n);
+    ir_emit("LOAD", "acc", "0");
+    ir_emit("WHILE", "i", NULL);
+    ir_emit("ADD", "acc", "3");
+    ir_emit("SUB", "i", "1");
+    ir_emit("END_WHILE", NULL, NULL);
+    ir_emit("HALT", NULL, NULL);
+
+    VMProgram vm;
+    memset(&vm, 0, sizeof(vm));
+    double t0 = jit_now_us();
+    if (vm_load_ir(&vm) != 0) return;
+    double t1 = jit_now_us();
+    vm_execute(&vm);
+    double t2 = jit_now_us();
+    vm_free(&vm);
+
+    JITProgram P;
+    double t3 = jit_now_us();
+    if (jit_compile(&P) != 0) return;
+    double t4 = jit_now_us();
+    jit_run(&P);
+    double t5 = jit_now_us();
+    printf("[JIT-BENCH] %lld iterations, %d IR ops, %zu bytes of code\n", iterations, ir_count, P.code_len);
+    printf("[JIT-BENCH] vm   load %8.1f us  run %10.1f us\n", t1 - t0, t2 - t1);
+    printf("[JIT-BENCH] jit  compile %5.1f us  run %10.1f us  (%.1fx vs vm)\n",
+        t4 - t3, t5 - t4, t5 - t4 > 0 ? (t2 - t1) / (t5 - t4) : 0.0);
+    jit_release(&P);
+}
+// rexion_isel.c – Rexion IR -> x86-64 NASM backend (instruction selection, register allocation)
+// DOC: Replaces the fixed generate_asm_from_ir() template: every op of the IR buffer is lowered with
+// DOC: the VM's semantics (names are global, DIV/MOD by zero yield 0, a call right before RET is a jump)
+// DOC: Homes: the most-used integer names (uses weighted by loop depth, or by the --profile-use
+// DOC: count of their block) live in callee-saved rbx/r12-r15/rbp, the rest in rx_vars; a name
+// DOC: defined and used inside one basic block, and not across a call, is a temporary in a virtual register
+// DOC: Selection defers single-use temporaries to their user: add/sub/scale chains fold into one
+// DOC: lea [base+index*scale+disp], compares feed jcc directly, memory homes stay memory operands
+// DOC: Virtual registers get caller-saved registers by a linear scan over each block; a temporary
+// DOC: left without one is demoted to its memory home and the block is selected again
+// DOC: Before allocation each block is list-scheduled against a per-CPU latency/port model (--mtune)
+// DOC: so independent work fills load, multiply and divide latency
+// DOC: Output is NASM text for rexion_asm.c/rexion_link.c: main plus the linker's runtime members
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+
+#define ISEL_PINNED 6
+#define ISEL_NEST_DEPTH 256
+#define ISEL_FOLD_WINDOW 64     // IR ops a deferred definition may move down to its use
+#define ISEL_TEMP_SPAN 256      // IR ops a temporary may stay live
+#define ISEL_LABEL X64_OP_COUNT // IselInst pseudo-op: binds x.o[0]
+#define ISEL_XMM(n) (1u << (16 + (n)))
+#define ISEL_SCRATCH 0x0FC7u    // rax rcx rdx rsi rdi r8-r11
+#define ISEL_CALL_CLOBBERS (ISEL_SCRATCH | ISEL_XMM(0) | ISEL_XMM(1))
+
+static const int isel_pin_regs[ISEL_PINNED] = { X64_RBX, X64_R12, X64_R13, X64_R14, X64_R15, X64_RBP };
+static const int isel_scratch_regs[] = { X64_RAX, X64_RCX, X64_RDX, X64_RSI, X64_RDI, X64_R8, X64_R9, X64_R10, X64_R11 };
+
+// Backend switches; the --bench-isel baseline turns them off
+static int isel_fold_enabled = 1;       // defer single-use temporaries into their users
+static int isel_regs_enabled = 1;       // pinned names and temporaries in registers
+static int isel_sched_enabled = 1;      // list-schedule each block before register allocation
+static int isel_sched_report = 0;       // --sched-report: cycle estimates per block
+static const long long* isel_counts = NULL;     // per-ir[] profile counts for the homes, NULL = loop depth
+
+typedef struct {
+    X64Operand o;
+    int v, vi;              // virtual registers standing in for o.reg / o.index, 0 = physical
+} IselOpnd;
+
+typedef struct {
+    X64Inst x;
+    int v[3][2];            // per operand: virtual register of o.reg / o.index
+    uint32_t implicit;      // registers read or written without being operands (cqo/idiv: rax, rdx; calls)
+} IselInst;
+
+// base + index*scale + disp over registers
+typedef struct {
+    int has_base, has_index;
+    IselOpnd base, index;
+    int scale;
+    int64_t disp;
+} IselAddr;
+
+typedef struct {
+    uint32_t id;            // IR string id (0 = empty)
+    int val;
+} IselKey;
+
+typedef struct {
+    int pinned, temps;
+    int lea;                // deferred definitions folded into an address
+    int mem_operands;       // memory homes used in place
+    int fused;              // compares branched on directly
+    int strength;           // multiplies/divides by constants turned into lea/shifts
+    int demoted;            // temporaries moved back to memory by the allocator
+    int scheduled;          // scheduling windows reordered
+    int unscheduled;        // blocks put back in selection order because the schedule did not allocate
+    long long cycles_before, cycles_after;  // model estimate in selection / scheduled order
+} IselStats;
+
+typedef struct {
+    // names: one slot per distinct IR name
+    IselKey* names;
+    int name_cap, nslots;
+    long long* weight;      // mentions weighted by loop depth
+    int* nreads;
+    int* nwrites;
+    int* first;             // first / last IR op mentioning the name
+    int* last;
+    int* block_of;          // block of every mention, -1 once mentioned in two blocks
+    uint8_t* first_def;     // first mention writes without reading
+    uint8_t* is_float;
+    uint8_t* is_string;
+    uint8_t* temp;
+    int8_t* pin;            // index into the backend's pinned registers, -1 for a memory home
+    int npin;               // pinned registers the backend has (ISEL_PINNED here)
+    int* pending;           // IR op of a deferred definition, -1 when none
+    int* vreg;              // temporary's virtual register in the block being selected
+    // IR ops
+    int* block;
+    int* ctl;               // IF/ELSE/END_IF/WHILE/END_WHILE: two labels per op
+    uint8_t* fold;          // definition deferred to its single use
+    IselKey* labels;        // LABEL/FUNC name -> label
+    int label_cap, nlabel_keys;
+    // machine code
+    IselInst* code;
+    int ncode, code_cap;
+    char** sym;             // label -> symbol name, NULL for a local .L label
+    int* label_pos;         // label -> IR op binding it, -1 while undefined
+    int nlabels, sym_cap;
+    int nvregs, block_v0;
+    int* vreg_slot;         // virtual register -> name slot of a temporary, -1 for a scratch value
+    int vreg_cap;
+    IselKey* strs;          // LOAD_STR string id -> label
+    int str_cap, nstrs;
+    uint64_t* floats;       // constant pool (bit patterns)
+    int* float_label;
+    int nfloats, float_cap;
+    int l_vars, l_sp, l_body, l_exit;
+    int l_print[3];         // rx_print_int / rx_print_str / rx_print_float
+    uint8_t used_print[3];
+    IselStats st;
+    int errors;
+} IselCompiler;
+
+enum { ISEL_PRINT_INT, ISEL_PRINT_STR, ISEL_PRINT_FLOAT };
+
+// Literals as the VM reads them: decimal, the whole operand, within int64 (else a float literal).
+static int isel_int_literal(uint32_t id, int64_t* out) {
+    char* e;
+    const char* s = ir_str(id);
+    if (!*s) return 0;
+    errno = 0;
+    long long v = strtoll(s, &e, 10);
+    if (*e || errno == ERANGE) return 0;
+    *out = v;
+    return 1;
+}
+
+static int isel_float_literal(uint32_t id, double* out) {
+    char* e;
+    const char* s = ir_str(id);
+    if (!*s || strpbrk(s, "xX")) return 0;
+    double v = strtod(s, &e);
+    if (*e) return 0;
+    *out = v;
+    return 1;
+}
+
+static int isel_is_literal(uint32_t id) {
+    int64_t k;
+    double f;
+    return isel_int_literal(id, &k) || isel_float_literal(id, &f);
+}
+
+// Open-addressing map from an IR string id; returns the value, -1 for a new key.
+static int* isel_map(IselKey** tab, int* cap, int* n, uint32_t id) {
+    if (*n * 2 >= *cap) {
+        int old_cap = *cap;
+        IselKey* old = *tab;
+        *cap = old_cap ? old_cap * 2 : 256;
+        *tab = calloc((size_t)*cap, sizeof(IselKey));
+        if (!*tab) { perror("isel_map"); exit(1); }
+        for (int i = 0; i < old_cap; i++) {
+            if (!old[i].id) continue;
+            unsigned h = (old[i].id * 2654435761u) & (unsigned)(*cap - 1);
+            while ((*tab)[h].id) h = (h + 1) & (unsigned)(*cap - 1);
+            (*tab)[h] = old[i];
+        }
+        free(old);
+    }
+    unsigned h = (id * 2654435761u) & (unsigned)(*cap - 1);
+    while ((*tab)[h].id && (*tab)[h].id != id) h = (h + 1) & (unsigned)(*cap - 1);
+    if (!(*tab)[h].id) {
+        (*tab)[h].id = id;
+        (*tab)[h].val = -1;
+        (*n)++;
+    }
+    return &(*tab)[h].val;
+}
+
+static int isel_slot(IselCompiler* S, uint32_t id) {
+    int* v = isel_map(&S->names, &S->name_cap, &S->nslots, id);
+    if (*v < 0) *v = S->nslots - 1;
+    return *v;
+}
+
+static int isel_new_label(IselCompiler* S, const char* sym) {
+    if (S->nlabels == S->sym_cap) {
+        S->sym_cap = S->sym_cap ? S->sym_cap * 2 : 256;
+        S->sym = realloc(S->sym, (size_t)S->sym_cap * sizeof(char*));
+        S->label_pos = realloc(S->label_pos, (size_t)S->sym_cap * sizeof(int));
+        if (!S->sym || !S->label_pos) { perror("isel_new_label"); exit(1); }
+    }
+    S->sym[S->nlabels] = sym ? strdup(sym) : NULL;
+    S->label_pos[S->nlabels] = -1;
+    return S->nlabels++;
+}
+
+static int isel_label_of(IselCompiler* S, uint32_t id) {
+    int* v = isel_map(&S->labels, &S->label_cap, &S->nlabel_keys, id);
+    if (*v < 0) *v = isel_new_label(S, NULL);
+    return *v;
+}
+
+// Keyed by id + 1: the empty string is id 0.
+static int isel_string(IselCompiler* S, uint32_t id) {
+    int* v = isel_map(&S->strs, &S->str_cap, &S->nstrs, id + 1);
+    if (*v < 0) {
+        char name[32];
+        snprintf(name, sizeof(name), "rx_s%d", S->nstrs - 1);
+        *v = isel_new_label(S, name);
+    }
+    return *v;
+}
+
+static int isel_float_const(IselCompiler* S, double f) {
+    uint64_t bits;
+    memcpy(&bits, &f, 8);
+    for (int i = 0; i < S->nfloats; i++)
+        if (S->floats[i] == bits) return S->float_label[i];
+    if (S->nfloats == S->float_cap) {
+        S->float_cap = S->float_cap ? S->float_cap * 2 : 16;
+        S->floats = realloc(S->floats, (size_t)S->float_cap * sizeof(uint64_t));
+        S->float_label = realloc(S->float_label, (size_t)S->float_cap * sizeof(int));
+        if (!S->floats || !S->float_label) { perror("isel_float_const"); exit(1); }
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "rx_f%d", S->nfloats);
+    S->floats[S->nfloats] = bits;
+    S->float_label[S->nfloats] = isel_new_label(S, name);
+    return S->float_label[S->nfloats++];
+}
+
+// Which args an op reads and writes as names (bit k = arg k); literals are neither.
+static void isel_roles(const IRInstruction* in, int* reads, int* writes) {
+    *reads = *writes = 0;
+    switch ((IROpcode)in->opcode) {
+        case IR_OP_LOAD: case IR_OP_MOV: case IR_OP_STORE: case IR_OP_FLOAT_LOAD:
+            *writes = 1; *reads = 2;
+            break;
+        case IR_OP_LOAD_STR:
+            *writes = 1;
+            break;
+        case IR_OP_ADD: case IR_OP_SUB: case IR_OP_MUL: case IR_OP_DIV: case IR_OP_MOD:
+        case IR_OP_FLOAT_ADD: case IR_OP_FLOAT_SUB: case IR_OP_FLOAT_MUL: case IR_OP_FLOAT_DIV:
+        case IR_OP_CMP_EQ: case IR_OP_CMP_NE: case IR_OP_CMP_LT: case IR_OP_CMP_LE: case IR_OP_CMP_GT: case IR_OP_CMP_GE:
+            *writes = 1; *reads = in->nargs == 3 ? 6 : 3;
+            break;
+        case IR_OP_IFZ: case IR_OP_IF: case IR_OP_WHILE:
+        case IR_OP_PRINT: case IR_OP_PRINT_FLOAT_SYSCALL: case IR_OP_PRINT_FLOAT_PRINTF:
+            *reads = 1;
+            break;
+        default:
+            return;
+    }
+    for (int k = 0; k < 3; k++) {
+        if (k < in->nargs && in->arg[k] && !isel_is_literal(in->arg[k])) continue;
+        *reads &= ~(1 << k);
+        *writes &= ~(1 << k);
+    }
+}
+
+static int isel_starts_block(int op) {
+    return op == IR_OP_LABEL || op == IR_OP_FUNC || op == IR_OP_WHILE || op == IR_OP_END_IF;
+}
+
+static int isel_ends_block(int op) {
+    return op == IR_OP_JMP || op == IR_OP_IFZ || op == IR_OP_RET || op == IR_OP_HALT || op == IR_OP_IF ||
+           op == IR_OP_WHILE || op == IR_OP_ELSE || op == IR_OP_END_WHILE;
+}
+
+static int isel_is_call(int op) {
+    return op == IR_OP_CALL || op == IR_OP_PRINT || op == IR_OP_PRINT_FLOAT_SYSCALL || op == IR_OP_PRINT_FLOAT_PRINTF;
+}
+
+// Pass 1: blocks, control-flow labels, loop depth, name statistics, homes and deferrable definitions.
+static void isel_scan(IselCompiler* S) {
+    int n = ir_count;
+    S->block = calloc((size_t)n + 1, sizeof(int));
+    S->ctl = calloc(2 * (size_t)n + 2, sizeof(int));
+    S->fold = calloc((size_t)n + 1, 1);
+    int* depth = calloc((size_t)n + 2, sizeof(int));
+    int* clob = calloc((size_t)n + 2, sizeof(int));     // calls and prints before each op
+    if (!S->block || !S->ctl || !S->fold || !depth || !clob) { perror("isel_scan"); exit(1); }
+
+    int blk = 0, open = 0, nd = 0;
+    int nest[ISEL_NEST_DEPTH];
+    for (int i = 0; i < n; i++) {
+        const IRInstruction* in = &ir[i];
+        int op = in->opcode, r, w;
+        isel_roles(in, &r, &w);
+        for (int k = 0; k < 3; k++)
+            if ((r | w) >> k & 1) isel_slot(S, in->arg[k]);
+        if ((op == IR_OP_LABEL || op == IR_OP_FUNC) && in->nargs >= 1) {
+            int l = isel_label_of(S, in->arg[0]);
+            if (S->label_pos[l] >= 0) { fprintf(stderr, "[ISEL] label '%s' defined twice\n", ir_str(in->arg[0])); S->errors++; }
+            S->label_pos[l] = i;
+        }
+        if ((op == IR_OP_JMP || op == IR_OP_CALL) && in->nargs >= 1) isel_label_of(S, in->arg[0]);
+        if (op == IR_OP_IFZ && in->nargs >= 2) isel_label_of(S, in->arg[1]);
+        if (isel_starts_block(op) && open) blk++;
+        S->block[i] = blk;
+        open = 1;
+        if (isel_ends_block(op)) { blk++; open = 0; }
+        clob[i + 1] = clob[i] + isel_is_call(op);
+
+        int top = nd ? nest[nd - 1] : -1;
+        switch (op) {
+            case IR_OP_IF: case IR_OP_WHILE:
+                if (nd == ISEL_NEST_DEPTH) { fprintf(stderr, "[ISEL] IF/WHILE nested too deep\n"); S->errors++; break; }
+                S->ctl[2 * i] = isel_new_label(S, NULL);         // false / exit
+                S->ctl[2 * i + 1] = isel_new_label(S, NULL);     // end of else / loop head
+                nest[nd++] = i;
+                break;
+            case IR_OP_ELSE:
+                if (top < 0 || ir[top].opcode != IR_OP_IF) { fprintf(stderr, "[ISEL] ELSE without IF\n"); S->errors++; break; }
+                S->ctl[2 * i] = S->ctl[2 * top];
+                S->ctl[2 * i + 1] = S->ctl[2 * top + 1];
+                nest[nd - 1] = i;
+                break;
+            case IR_OP_END_IF:
+                if (top < 0 || ir[top].opcode == IR_OP_WHILE) { fprintf(stderr, "[ISEL] END_IF without IF\n"); S->errors++; break; }
+                nd--;
+                S->ctl[2 * i] = S->ctl[2 * top + (ir[top].opcode == IR_OP_ELSE)];
+                break;
+            case IR_OP_END_WHILE:
+                if (top < 0 || ir[top].opcode != IR_OP_WHILE) { fprintf(stderr, "[ISEL] END_WHILE without WHILE\n"); S->errors++; break; }
+                nd--;
+                S->ctl[2 * i] = S->ctl[2 * top];
+                S->ctl[2 * i + 1] = S->ctl[2 * top + 1];
+                depth[top]++;
+                depth[i + 1]--;
+                break;
+            default:
+                break;
+        }
+    }
+    if (nd) { fprintf(stderr, "[ISEL] %d unterminated IF/WHILE block(s)\n", nd); S->errors++; }
+    for (int h = 0; h < S->label_cap; h++) {
+        if (!S->labels[h].id || S->label_pos[S->labels[h].val] >= 0) continue;
+        fprintf(stderr, "[ISEL] undefined label '%s'\n", ir_str(S->labels[h].id));
+        S->errors++;
+    }
+    // a backward jump closes a loop over everything from its target on
+    for (int i = 0; i < n; i++) {
+        const IRInstruction* in = &ir[i];
+        uint32_t target = in->opcode == IR_OP_JMP && in->nargs >= 1 ? in->arg[0] : in->opcode == IR_OP_IFZ && in->nargs >= 2 ? in->arg[1] : 0;
+        if (!target) continue;
+        int j = S->label_pos[isel_label_of(S, target)];
+        if (j >= 0 && j <= i) { depth[j]++; depth[i + 1]--; }
+    }
+
+    int ns = S->nslots;
+    S->weight = calloc((size_t)ns + 1, sizeof(long long));
+    S->nreads = calloc((size_t)ns + 1, sizeof(int));
+    S->nwrites = calloc((size_t)ns + 1, sizeof(int));
+    S->first = malloc(((size_t)ns + 1) * sizeof(int));
+    S->last = calloc((size_t)ns + 1, sizeof(int));
+    S->block_of = calloc((size_t)ns + 1, sizeof(int));
+    S->first_def = calloc((size_t)ns + 1, 1);
+    S->is_float = calloc((size_t)ns + 1, 1);
+    S->is_string = calloc((size_t)ns + 1, 1);
+    S->temp = calloc((size_t)ns + 1, 1);
+    S->pin = malloc((size_t)ns + 1);
+    S->pending = malloc(((size_t)ns + 1) * sizeof(int));
+    S->vreg = calloc((size_t)ns + 1, sizeof(int));
+    if (!S->weight || !S->nreads || !S->nwrites || !S->first || !S->last || !S->block_of || !S->first_def ||
+        !S->is_float || !S->is_string || !S->temp || !S->pin || !S->pending || !S->vreg) { perror("isel_scan"); exit(1); }
+    for (int s = 0; s <= ns; s++) { S->first[s] = -1; S->pin[s] = -1; S->pending[s] = -1; }
+
+    int d = 0;
+    for (int i = 0; i < n; i++) {
+        const IRInstruction* in = &ir[i];
+        d += depth[i];
+        long long w = isel_counts ? isel_counts[i] : 1LL << (3 * (d < 6 ? (d > 0 ? d : 0) : 6));
+        int r, wr;
+        isel_roles(in, &r, &wr);
+        for (int pass = 0; pass < 2; pass++) {
+            int mask = pass ? wr : r;
+            for (int k = 0; k < 3; k++) {
+                if (!(mask >> k & 1)) continue;
+                int s = isel_slot(S, in->arg[k]);
+                if (S->first[s] < 0) {
+                    S->first[s] = i;
+                    S->first_def[s] = (uint8_t)pass;
+                    S->block_of[s] = S->block[i];
+                } else if (S->block_of[s] != S->block[i]) {
+                    S->block_of[s] = -1;
+                }
+                S->last[s] = i;
+                S->weight[s] += w;
+                if (pass) S->nwrites[s]++;
+                else S->nreads[s]++;
+            }
+        }
+        if (wr & 1) {
+            int s = isel_slot(S, in->arg[0]);
+            if (in->opcode == IR_OP_FLOAT_LOAD || (in->opcode >= IR_OP_FLOAT_ADD && in->opcode <= IR_OP_FLOAT_DIV)) S->is_float[s] = 1;
+            if (in->opcode == IR_OP_LOAD_STR) S->is_string[s] = 1;
+        }
+    }
+    // floats/strings spread through moves, as in the JIT
+    for (int round = 0; round < 4; round++) {
+        for (int i = 0; i < n; i++) {
+            const IRInstruction* in = &ir[i];
+            if ((in->opcode != IR_OP_MOV && in->opcode != IR_OP_LOAD && in->opcode != IR_OP_STORE) || in->nargs != 2) continue;
+            int r, wr;
+            isel_roles(in, &r, &wr);
+            if (!(wr & 1)) continue;
+            int dst = isel_slot(S, in->arg[0]);
+            if (r & 2) {
+                int src = isel_slot(S, in->arg[1]);
+                S->is_float[dst] |= S->is_float[src];
+                S->is_string[dst] |= S->is_string[src];
+            } else {
+                int64_t k;
+                double f;
+                if (!isel_int_literal(in->arg[1], &k) && isel_float_literal(in->arg[1], &f)) S->is_float[dst] = 1;
+            }
+        }
+    }
+
+    for (int s = 0; s < ns && isel_regs_enabled; s++) {
+        int f = S->first[s], l = S->last[s];
+        S->temp[s] = f >= 0 && S->block_of[s] >= 0 && S->first_def[s] && !S->is_float[s] && l - f <= ISEL_TEMP_SPAN &&
+                     (l <= f + 1 || clob[l] == clob[f + 1]);
+        S->st.temps += S->temp[s];
+    }
+    for (int p = 0; p < S->npin && isel_regs_enabled; p++) {
+        int best = -1;
+        for (int s = 0; s < ns; s++) {
+            if (S->temp[s] || S->is_float[s] || S->pin[s] >= 0 || !S->weight[s]) continue;
+            if (best < 0 || S->weight[s] > S->weight[best]) best = s;
+        }
+        if (best < 0) break;
+        S->pin[best] = (int8_t)p;
+        S->st.pinned++;
+    }
+
+    // Deferrable definitions, last first so a chain knows where its value is finally needed.
+    for (int i = n - 1; i >= 0 && isel_fold_enabled; i--) {
+        const IRInstruction* in = &ir[i];
+        int r, wr;
+        isel_roles(in, &r, &wr);
+        if (!(wr & 1)) continue;
+        int s = isel_slot(S, in->arg[0]);
+        if (!S->temp[s] || S->nwrites[s] != 1 || S->nreads[s] != 1 || S->last[s] <= i) continue;
+        int u = S->last[s], ok = 0;
+        int use = ir[u].opcode;
+        int64_t k;
+        switch ((IROpcode)in->opcode) {
+            case IR_OP_LOAD: case IR_OP_MOV: case IR_OP_STORE:
+                ok = in->nargs == 2 && (isel_int_literal(in->arg[1], &k) || (r & 2));
+                break;
+            case IR_OP_ADD: case IR_OP_SUB: case IR_OP_MUL:
+                ok = in->nargs == 3 && (use == IR_OP_ADD || use == IR_OP_SUB || use == IR_OP_MUL);
+                break;
+            case IR_OP_CMP_EQ: case IR_OP_CMP_NE: case IR_OP_CMP_LT: case IR_OP_CMP_LE: case IR_OP_CMP_GT: case IR_OP_CMP_GE:
+                ok = in->nargs == 3 && (use == IR_OP_IFZ || use == IR_OP_IF) && ir[u].arg[0] == in->arg[0];
+                break;
+            default:
+                break;
+        }
+        if (!ok) continue;
+        // the value is computed where the last deferred link of its chain is used
+        int at = u;
+        while (S->fold[at]) at = S->last[isel_slot(S, ir[at].arg[0])];
+        if (at - i > ISEL_FOLD_WINDOW || clob[at] != clob[i + 1]) continue;
+        for (int p = i + 1; p < at && ok; p++) {
+            int pr, pw;
+            isel_roles(&ir[p], &pr, &pw);
+            for (int a = 0; a < 3 && ok; a++)
+                for (int b = 0; b < 3; b++)
+                    if ((pw >> a & 1) && (r >> b & 1) && ir[p].arg[a] == in->arg[b]) ok = 0;
+        }
+        S->fold[i] = (uint8_t)ok;
+    }
+    free(depth);
+    free(clob);
+}
+
+// === Operands and emission ===
+
+static IselOpnd isel_none(void) {
+    IselOpnd o;
+    memset(&o, 0, sizeof(o));
+    o.o.reg = o.o.index = X64_NOREG;
+    o.o.label = -1;
+    return o;
+}
+
+static IselOpnd isel_preg(int reg, int size) {
+    IselOpnd o = isel_none();
+    o.o = x64_r(reg, size);
+    return o;
+}
+
+static IselOpnd isel_imm(int64_t k) {
+    IselOpnd o = isel_none();
+    o.o = x64_i(k);
+    return o;
+}
+
+static IselOpnd isel_sym(int label, int64_t disp, int size) {
+    IselOpnd o = isel_none();
+    o.o = x64_rip(label, disp, size);
+    return o;
+}
+
+static IselOpnd isel_lab(int label) {
+    IselOpnd o = isel_none();
+    o.o = x64_l(label);
+    return o;
+}
+
+static IselOpnd isel_sized(IselOpnd o, int size) {
+    o.o.size = (uint8_t)size;
+    return o;
+}
+
+static IselOpnd isel_new_vreg(IselCompiler* S, int slot) {
+    int v = ++S->nvregs;
+    if (v >= S->vreg_cap) {
+        S->vreg_cap = S->vreg_cap ? S->vreg_cap * 2 : 1024;
+        S->vreg_slot = realloc(S->vreg_slot, (size_t)S->vreg_cap * sizeof(int));
+        if (!S->vreg_slot) { perror("isel_new_vreg"); exit(1); }
+    }
+    S->vreg_slot[v] = slot;
+    IselOpnd o = isel_preg(X64_RAX, 8);
+    o.v = v;
+    return o;
+}
+
+static int isel_same(IselOpnd a, IselOpnd b) {
+    if (a.o.kind != b.o.kind) return 0;
+    if (a.o.kind == X64_REG) return a.v || b.v ? a.v == b.v : a.o.reg == b.o.reg;
+    if (a.o.kind == X64_MEM)
+        return !a.v && !b.v && !a.vi && !b.vi && a.o.reg == b.o.reg && a.o.index == b.o.index && a.o.label == b.o.label && a.o.imm == b.o.imm;
+    return 0;
+}
+
+static IselInst* isel_emit(IselCompiler* S, int op, int cond, IselOpnd a, IselOpnd b, IselOpnd c, uint32_t implicit) {
+    if (S->ncode == S->code_cap) {
+        S->code_cap = S->code_cap ? S->code_cap * 2 : 1024;
+        S->code = realloc(S->code, (size_t)S->code_cap * sizeof(IselInst));
+        if (!S->code) { perror("isel_emit"); exit(1); }
+    }
+    IselInst* in = &S->code[S->ncode++];
+    memset(in, 0, sizeof(*in));
+    IselOpnd ops[3] = { a, b, c };
+    in->x.op = (uint16_t)op;
+    in->x.cond = (uint8_t)cond;
+    for (int k = 0; k < 3; k++) {
+        if (ops[k].o.kind == X64_NONE) break;
+        in->x.o[k] = ops[k].o;
+        in->v[k][0] = ops[k].v;
+        in->v[k][1] = ops[k].vi;
+        in->x.nops = (uint8_t)(k + 1);
+    }
+    in->implicit = implicit;
+    return in;
+}
+
+static void isel_op(IselCompiler* S, int op, IselOpnd a, IselOpnd b) {
+    isel_emit(S, op, 0, a, b, isel_none(), 0);
+}
+
+static void isel_bind(IselCompiler* S, int label) {
+    isel_emit(S, ISEL_LABEL, 0, isel_lab(label), isel_none(), isel_none(), 0);
+}
+
+static void isel_jcc(IselCompiler* S, int cc, int label) {
+    isel_emit(S, X64_JCC, cc, isel_lab(label), isel_none(), isel_none(), 0);
+}
+
+static void isel_move(IselCompiler* S, IselOpnd dst, IselOpnd src) {
+    if (isel_same(dst, src)) return;
+    if (src.o.kind == X64_IMM) {
+        if (dst.o.kind == X64_REG && src.o.imm == 0) {
+            isel_op(S, X64_XOR, isel_sized(dst, 4), isel_sized(dst, 4));
+            return;
+        }
+        if (dst.o.kind == X64_MEM && (src.o.imm < INT32_MIN || src.o.imm > INT32_MAX)) {
+            IselOpnd t = isel_new_vreg(S, -1);
+            isel_op(S, X64_MOV, t, src);
+            src = t;
+        }
+    } else if (dst.o.kind == X64_MEM && src.o.kind == X64_MEM) {
+        IselOpnd t = isel_new_vreg(S, -1);
+        isel_op(S, X64_MOV, t, src);
+        src = t;
+    }
+    isel_op(S, X64_MOV, dst, src);
+}
+
+// Register holding `o`: itself, or a virtual register it is loaded into.
+static IselOpnd isel_in_reg(IselCompiler* S, IselOpnd o) {
+    if (o.o.kind == X64_REG) return o;
+    IselOpnd t = isel_new_vreg(S, -1);
+    isel_op(S, X64_MOV, t, o);
+    return t;
+}
+
+static void isel_lower(IselCompiler* S, int i, int force);
+
+// Where name slot `s` lives: its temporary's virtual register, pinned register or rx_vars entry.
+static IselOpnd isel_home(IselCompiler* S, int s) {
+    if (S->temp[s]) {
+        if (S->vreg[s] <= S->block_v0) S->vreg[s] = isel_new_vreg(S, s).v;
+        IselOpnd o = isel_preg(X64_RAX, 8);
+        o.v = S->vreg[s];
+        return o;
+    }
+    if (S->pin[s] >= 0) return isel_preg(isel_pin_regs[S->pin[s]], 8);
+    return isel_sym(S->l_vars, 8 * (int64_t)s, 8);
+}
+
+// Destination of a definition of slot `s`; a temporary's first definition in the block gets a new register.
+static IselOpnd isel_dest(IselCompiler* S, int s) {
+    return isel_home(S, s);
+}
+
+static const IRInstruction* isel_take_pending(IselCompiler* S, uint32_t id, int* s) {
+    if (isel_is_literal(id)) return NULL;
+    *s = isel_slot(S, id);
+    return S->pending[*s] >= 0 ? &ir[S->pending[*s]] : NULL;
+}
+
+// Source operand for IR arg `id`: an imm32, a register or a memory home. Wider literals go through a
+// virtual register; a deferred definition is copied through or computed here.
+static IselOpnd isel_value(IselCompiler* S, uint32_t id) {
+    int64_t k;
+    double f;
+    if (isel_int_literal(id, &k) || (isel_float_literal(id, &f) && (memcpy(&k, &f, 8), 1))) {
+        if (k >= INT32_MIN && k <= INT32_MAX) return isel_imm(k);
+        IselOpnd t = isel_new_vreg(S, -1);
+        isel_op(S, X64_MOV, t, isel_imm(k));
+        return t;
+    }
+    int s;
+    const IRInstruction* def = isel_take_pending(S, id, &s);
+    if (def) {
+        int p = S->pending[s];
+        S->pending[s] = -1;
+        if (def->opcode == IR_OP_LOAD || def->opcode == IR_OP_MOV || def->opcode == IR_OP_STORE) return isel_value(S, def->arg[1]);
+        isel_lower(S, p, 1);
+    }
+    return isel_home(S, s);
+}
+
+static int isel_names(IselCompiler* S, uint32_t id, int s) {
+    return !isel_is_literal(id) && isel_slot(S, id) == s;
+}
+
+static int isel_is_pending(IselCompiler* S, uint32_t id) {
+    int s;
+    return isel_take_pending(S, id, &s) != NULL;
+}
+
+// === Addressing modes ===
+
+static void isel_addr_reg(IselAddr* A, IselOpnd r) {
+    memset(A, 0, sizeof(*A));
+    A->has_base = 1;
+    A->base = r;
+    A->scale = 1;
+}
+
+static IselOpnd isel_addr_opnd(const IselAddr* A, int size) {
+    IselOpnd o = isel_none();
+    o.o = x64_m(A->has_base ? A->base.o.reg : X64_NOREG, A->has_index ? A->index.o.reg : X64_NOREG,
+                A->has_index ? A->scale : 1, A->disp, size);
+    o.v = A->has_base ? A->base.v : 0;
+    o.vi = A->has_index ? A->index.v : 0;
+    return o;
+}
+
+// dst = A in the shortest form: mov, add or lea.
+static void isel_finalize(IselCompiler* S, IselOpnd dst, const IselAddr* A0) {
+    IselAddr A = *A0;
+    if (A.has_index && !A.has_base && A.scale <= 2) {
+        A.has_base = 1;
+        A.base = A.index;
+        A.has_index = A.scale == 2;
+        A.scale = 1;
+    }
+    if (!A.has_base && !A.has_index) { isel_move(S, dst, isel_imm(A.disp)); return; }
+    if (A.has_base && !A.has_index && !A.disp) { isel_move(S, dst, A.base); return; }
+    if (dst.o.kind != X64_REG) {
+        IselOpnd t = isel_new_vreg(S, -1);
+        isel_finalize(S, t, &A);
+        isel_move(S, dst, t);
+        return;
+    }
+    if (A.has_base && isel_same(A.base, dst)) {
+        if (!A.has_index) { isel_op(S, X64_ADD, dst, isel_imm(A.disp)); return; }
+        if (A.scale == 1 && !A.disp) { isel_op(S, X64_ADD, dst, A.index); return; }
+    }
+    if (A.has_base && A.has_index && A.scale == 1 && !A.disp && isel_same(A.index, dst)) {
+        isel_op(S, X64_ADD, dst, A.base);
+        return;
+    }
+    isel_op(S, X64_LEA, dst, isel_addr_opnd(&A, 8));
+}
+
+static IselOpnd isel_addr_value(IselCompiler* S, const IselAddr* A) {
+    if (A->has_base && !A->has_index && !A->disp) return A->base;
+    IselOpnd t = isel_new_vreg(S, -1);
+    isel_finalize(S, t, A);
+    return t;
+}
+
+// A += B if the sum still fits base + index*scale + disp32.
+static int isel_addr_combine(IselAddr* A, const IselAddr* B) {
+    int64_t disp = A->disp + B->disp;
+    if (disp < INT32_MIN || disp > INT32_MAX) return 0;
+    if (A->has_base + A->has_index + B->has_base + B->has_index > 2 || (A->has_index && B->has_index)) return 0;
+    IselAddr R = *A;
+    R.disp = disp;
+    if (B->has_index) { R.has_index = 1; R.index = B->index; R.scale = B->scale; }
+    if (B->has_base) {
+        if (!R.has_base) { R.has_base = 1; R.base = B->base; }
+        else { R.has_index = 1; R.index = B->base; R.scale = 1; }
+    }
+    *A = R;
+    return 1;
+}
+
+// A += B, computing either side into a register when the sum needs three.
+static void isel_addr_add(IselCompiler* S, IselAddr* A, const IselAddr* B0) {
+    IselAddr B = *B0;
+    if (isel_addr_combine(A, &B)) return;
+    isel_addr_reg(A, isel_addr_value(S, A));
+    if (isel_addr_combine(A, &B)) return;
+    isel_addr_reg(&B, isel_addr_value(S, &B));
+    isel_addr_combine(A, &B);
+}
+
+static int isel_addr_scale(int64_t k) {
+    return k == 1 || k == 2 || k == 3 || k == 4 || k == 5 || k == 8 || k == 9;
+}
+
+// A *= k for k in 1/2/4/8 (index scale) or 3/5/9 (base + index scale).
+static void isel_addr_mul(IselCompiler* S, IselAddr* A, int64_t k) {
+    if (k == 1) return;
+    if (A->has_index || A->disp < INT32_MIN / 9 || A->disp > INT32_MAX / 9) isel_addr_reg(A, isel_addr_value(S, A));
+    A->disp *= k;
+    if (!A->has_base) return;
+    A->has_index = 1;
+    A->index = A->base;
+    if (k == 3 || k == 5 || k == 9) {
+        A->scale = (int)k - 1;
+    } else {
+        A->has_base = 0;
+        A->scale = (int)k;
+    }
+}
+
+// Address expression for the value of IR arg `id`; deferred add/sub/scale chains fold in.
+static void isel_addr(IselCompiler* S, uint32_t id, IselAddr* A) {
+    int64_t k;
+    memset(A, 0, sizeof(*A));
+    A->scale = 1;
+    if (isel_int_literal(id, &k) && k >= INT32_MIN && k <= INT32_MAX) { A->disp = k; return; }
+    int s;
+    const IRInstruction* def = isel_take_pending(S, id, &s);
+    if (def) {
+        IselAddr B;
+        switch ((IROpcode)def->opcode) {
+            case IR_OP_LOAD: case IR_OP_MOV: case IR_OP_STORE:
+                S->pending[s] = -1;
+                isel_addr(S, def->arg[1], A);
+                return;
+            case IR_OP_ADD:
+                S->pending[s] = -1;
+                S->st.lea++;
+                isel_addr(S, def->arg[1], A);
+                isel_addr(S, def->arg[2], &B);
+                isel_addr_add(S, A, &B);
+                return;
+            case IR_OP_SUB:
+                if (!isel_int_literal(def->arg[2], &k) || k <= INT32_MIN || k > INT32_MAX) break;
+                S->pending[s] = -1;
+                S->st.lea++;
+                isel_addr(S, def->arg[1], A);
+                memset(&B, 0, sizeof(B));
+                B.scale = 1;
+                B.disp = -k;
+                isel_addr_add(S, A, &B);
+                return;
+            case IR_OP_MUL: {
+                uint32_t x = def->arg[1];
+                if (!isel_int_literal(def->arg[2], &k)) {
+                    if (!isel_int_literal(def->arg[1], &k)) break;
+                    x = def->arg[2];
+                }
+                if (!isel_addr_scale(k)) break;
+                S->pending[s] = -1;
+                S->st.lea++;
+                isel_addr(S, x, A);
+                isel_addr_mul(S, A, k);
+                return;
+            }
+            default:
+                break;
+        }
+    }
+    isel_addr_reg(A, isel_in_reg(S, isel_value(S, id)));
+}
+
+// === Instruction selection ===
+
+static void isel_operands(const IRInstruction* in, uint32_t* a, uint32_t* b) {
+    *a = in->nargs == 3 ? in->arg[1] : in->arg[0];
+    *b = in->nargs == 3 ? in->arg[2] : in->arg[1];
+}
+
+static void isel_add(IselCompiler* S, const IRInstruction* in) {
+    int d = isel_slot(S, in->arg[0]);
+    uint32_t a_id, b_id;
+    isel_operands(in, &a_id, &b_id);
+    if (isel_names(S, b_id, d) && !isel_names(S, a_id, d)) { uint32_t t = a_id; a_id = b_id; b_id = t; }
+    if (isel_names(S, a_id, d) && !isel_is_pending(S, b_id)) {
+        // d += b, in place even when d lives in memory
+        IselOpnd b = isel_value(S, b_id);
+        IselOpnd dst = isel_dest(S, d);
+        if (dst.o.kind == X64_MEM && b.o.kind == X64_MEM) b = isel_in_reg(S, b);
+        if (dst.o.kind == X64_MEM || b.o.kind == X64_MEM) S->st.mem_operands++;
+        if (b.o.kind != X64_IMM || b.o.imm) isel_op(S, X64_ADD, dst, b);
+        return;
+    }
+    if (!isel_is_pending(S, a_id) && !isel_is_pending(S, b_id)) {
+        IselOpnd a = isel_value(S, a_id), b = isel_value(S, b_id);
+        if (a.o.kind == X64_MEM || b.o.kind == X64_MEM) {
+            // mov r, x / add r, [mem]
+            if (b.o.kind != X64_MEM) { IselOpnd t = a; a = b; b = t; }
+            IselOpnd dst = isel_dest(S, d);
+            IselOpnd r = dst.o.kind == X64_REG && !isel_same(dst, b) ? dst : isel_new_vreg(S, -1);
+            isel_move(S, r, a);
+            isel_op(S, X64_ADD, r, b);
+            isel_move(S, dst, r);
+            S->st.mem_operands++;
+            return;
+        }
+        IselAddr A, B;
+        memset(&A, 0, sizeof(A));
+        memset(&B, 0, sizeof(B));
+        A.scale = B.scale = 1;
+        if (a.o.kind == X64_IMM) A.disp = a.o.imm; else isel_addr_reg(&A, a);
+        if (b.o.kind == X64_IMM) B.disp = b.o.imm; else isel_addr_reg(&B, b);
+        isel_addr_add(S, &A, &B);
+        isel_finalize(S, isel_dest(S, d), &A);
+        return;
+    }
+    IselAddr A, B;
+    isel_addr(S, a_id, &A);
+    isel_addr(S, b_id, &B);
+    isel_addr_add(S, &A, &B);
+    isel_finalize(S, isel_dest(S, d), &A);
+}
+
+static void isel_sub(IselCompiler* S, const IRInstruction* in) {
+    int d = isel_slot(S, in->arg[0]);
+    uint32_t a_id, b_id;
+    isel_operands(in, &a_id, &b_id);
+    int64_t k;
+    if (isel_names(S, a_id, d) && !isel_is_pending(S, b_id)) {
+        IselOpnd b = isel_value(S, b_id);
+        IselOpnd dst = isel_dest(S, d);
+        if (dst.o.kind == X64_MEM && b.o.kind == X64_MEM) b = isel_in_reg(S, b);
+        if (dst.o.kind == X64_MEM || b.o.kind == X64_MEM) S->st.mem_operands++;
+        if (b.o.kind != X64_IMM || b.o.imm) isel_op(S, X64_SUB, dst, b);
+        return;
+    }
+    if (isel_int_literal(b_id, &k) && k > INT32_MIN && k <= INT32_MAX) {
+        IselAddr A, B;
+        isel_addr(S, a_id, &A);
+        memset(&B, 0, sizeof(B));
+        B.scale = 1;
+        B.disp = -k;
+        isel_addr_add(S, &A, &B);
+        isel_finalize(S, isel_dest(S, d), &A);
+        return;
+    }
+    IselOpnd a = isel_value(S, a_id), b = isel_value(S, b_id);
+    IselOpnd dst = isel_dest(S, d);
+    IselOpnd r = dst.o.kind == X64_REG && !isel_same(dst, b) ? dst : isel_new_vreg(S, -1);
+    isel_move(S, r, a);
+    isel_op(S, X64_SUB, r, b);
+    isel_move(S, dst, r);
+    if (b.o.kind == X64_MEM) S->st.mem_operands++;
+}
+
+static int isel_log2(int64_t k) {
+    int n = 0;
+    while (n < 63 && ((int64_t)1 << n) != k) n++;
+    return n < 63 ? n : -1;
+}
+
+static void isel_mul(IselCompiler* S, const IRInstruction* in) {
+    int d = isel_slot(S, in->arg[0]);
+    uint32_t a_id, b_id;
+    isel_operands(in, &a_id, &b_id);
+    int64_t ka, kb;
+    int la = isel_int_literal(a_id, &ka), lb = isel_int_literal(b_id, &kb);
+    if (la && lb) { isel_move(S, isel_dest(S, d), isel_imm((int64_t)((uint64_t)ka * (uint64_t)kb))); return; }
+    if (la) { uint32_t t = a_id; a_id = b_id; b_id = t; kb = ka; lb = 1; }
+    if (lb) {
+        if (kb == 0) { isel_move(S, isel_dest(S, d), isel_imm(0)); return; }
+        if (isel_addr_scale(kb)) {
+            IselAddr A;
+            isel_addr(S, a_id, &A);
+            isel_addr_mul(S, &A, kb);
+            isel_finalize(S, isel_dest(S, d), &A);
+            S->st.strength += kb != 1;
+            return;
+        }
+        int n = kb > 0 ? isel_log2(kb) : -1;
+        IselOpnd a = isel_value(S, a_id);
+        IselOpnd dst = isel_dest(S, d);
+        IselOpnd r = dst.o.kind == X64_REG ? dst : isel_new_vreg(S, -1);
+        if (n > 0) {
+            isel_move(S, r, a);
+            isel_op(S, X64_SHL, r, isel_imm(n));
+            S->st.strength++;
+        } else if (kb >= INT32_MIN && kb <= INT32_MAX) {
+            if (a.o.kind == X64_IMM) a = isel_in_reg(S, a);
+            isel_emit(S, X64_IMUL, 0, r, a, isel_imm(kb), 0);
+        } else {
+            IselOpnd t = isel_new_vreg(S, -1);
+            isel_op(S, X64_MOV, t, isel_imm(kb));
+            isel_move(S, r, a);
+            isel_op(S, X64_IMUL, r, t);
+        }
+        isel_move(S, dst, r);
+        return;
+    }
+    if (isel_names(S, b_id, d) && !isel_names(S, a_id, d)) { uint32_t t = a_id; a_id = b_id; b_id = t; }
+    IselOpnd a = isel_value(S, a_id), b = isel_value(S, b_id);
+    if (b.o.kind == X64_IMM) b = isel_in_reg(S, b);
+    IselOpnd dst = isel_dest(S, d);
+    IselOpnd r = dst.o.kind == X64_REG && !isel_same(dst, b) ? dst : isel_new_vreg(S, -1);
+    isel_move(S, r, a);
+    isel_op(S, X64_IMUL, r, b);
+    isel_move(S, dst, r);
+    if (b.o.kind == X64_MEM) S->st.mem_operands++;
+}
+
+// DIV/MOD with the VM's semantics: a zero divisor yields 0.
+static void isel_divmod(IselCompiler* S, const IRInstruction* in, int want_rem) {
+    int d = isel_slot(S, in->arg[0]);
+    uint32_t a_id, b_id;
+    isel_operands(in, &a_id, &b_id);
+    int64_t ka, kb;
+    IselOpnd rax = isel_preg(X64_RAX, 8), rdx = isel_preg(X64_RDX, 8);
+    // a deferred constant temporary arrives as an immediate: idiv and cmp need it as a constant divisor
+    IselOpnd b = isel_none();
+    int konst = isel_int_literal(b_id, &kb);
+    if (!konst) {
+        b = isel_value(S, b_id);
+        if (b.o.kind == X64_IMM) { kb = b.o.imm; konst = 1; }
+    }
+    if (konst) {
+        if (kb == 0 || (want_rem && (kb == 1 || kb == -1))) { isel_move(S, isel_dest(S, d), isel_imm(0)); return; }
+        if (isel_int_literal(a_id, &ka) && !(ka == INT64_MIN && kb == -1)) {
+            isel_move(S, isel_dest(S, d), isel_imm(want_rem ? ka % kb : ka / kb));
+            return;
+        }
+        if (kb == 1) { isel_move(S, isel_dest(S, d), isel_value(S, a_id)); return; }
+        int n = kb > 1 ? isel_log2(kb) : -1;
+        if (kb == -1 || n > 0) {
+            IselOpnd x = isel_in_reg(S, isel_value(S, a_id));
+            IselOpnd t = isel_new_vreg(S, -1);
+            isel_op(S, X64_MOV, t, x);
+            if (kb == -1) {
+                isel_op(S, X64_NEG, t, isel_none());
+            } else {
+                // round toward zero: add 2^n-1 to negative dividends before shifting
+                isel_op(S, X64_SAR, t, isel_imm(63));
+                isel_op(S, X64_SHR, t, isel_imm(64 - n));
+                isel_op(S, X64_ADD, t, x);
+                if (want_rem) {
+                    isel_op(S, X64_SHR, t, isel_imm(n));
+                    isel_op(S, X64_SHL, t, isel_imm(n));
+                    IselOpnd r = isel_new_vreg(S, -1);
+                    isel_op(S, X64_MOV, r, x);
+                    isel_op(S, X64_SUB, r, t);
+                    t = r;
+                } else {
+                    isel_op(S, X64_SAR, t, isel_imm(n));
+                }
+            }
+            isel_move(S, isel_dest(S, d), t);
+            S->st.strength++;
+            return;
+        }
+        // constant divisor other than 0 and -1: no zero or overflow test
+        b = isel_new_vreg(S, -1);
+        isel_op(S, X64_MOV, b, isel_imm(kb));
+        isel_move(S, rax, isel_value(S, a_id));
+        isel_emit(S, X64_CQO, 0, isel_none(), isel_none(), isel_none(), 1u << X64_RAX | 1u << X64_RDX);
+        isel_emit(S, X64_IDIV, 0, b, isel_none(), isel_none(), 1u << X64_RAX | 1u << X64_RDX);
+        isel_move(S, isel_dest(S, d), want_rem ? rdx : rax);
+        return;
+    }
+    IselOpnd a = isel_value(S, a_id);
+    int zero = isel_new_label(S, NULL), done = isel_new_label(S, NULL);
+    isel_move(S, rax, a);
+    if (b.o.kind == X64_REG) isel_op(S, X64_TEST, b, b);
+    else isel_op(S, X64_CMP, b, isel_imm(0));
+    isel_jcc(S, X64_CC_E, zero);
+    // x / -1 negates (INT64_MIN wraps) and x % -1 is 0, as with a constant -1; idiv would trap on INT64_MIN
+    int minus1 = want_rem ? zero : isel_new_label(S, NULL);
+    isel_op(S, X64_CMP, b, isel_imm(-1));
+    isel_jcc(S, X64_CC_E, minus1);
+    isel_emit(S, X64_CQO, 0, isel_none(), isel_none(), isel_none(), 1u << X64_RAX | 1u << X64_RDX);
+    isel_emit(S, X64_IDIV, 0, b, isel_none(), isel_none(), 1u << X64_RAX | 1u << X64_RDX);
+    if (want_rem) isel_op(S, X64_MOV, rax, rdx);
+    isel_op(S, X64_JMP, isel_lab(done), isel_none());
+    if (!want_rem) {
+        isel_bind(S, minus1);
+        isel_op(S, X64_NEG, rax, isel_none());
+        isel_op(S, X64_JMP, isel_lab(done), isel_none());
+    }
+    isel_bind(S, zero);
+    isel_op(S, X64_XOR, isel_preg(X64_RAX, 4), isel_preg(X64_RAX, 4));
+    isel_bind(S, done);
+    isel_move(S, isel_dest(S, d), rax);
+    if (b.o.kind == X64_MEM) S->st.mem_operands++;
+}
+
+static int isel_cmp_cc(int opcode) {
+    static const uint8_t cc[6] = { X64_CC_E, X64_CC_NE, X64_CC_L, X64_CC_LE, X64_CC_G, X64_CC_GE };
+    return cc[opcode - IR_OP_CMP_EQ];
+}
+
+static int isel_cmp_const(const IRInstruction* in, int64_t* out) {
+    uint32_t a_id, b_id;
+    int64_t a, b;
+    isel_operands(in, &a_id, &b_id);
+    if (!isel_int_literal(a_id, &a) || !isel_int_literal(b_id, &b)) return 0;
+    switch (in->opcode) {
+        case IR_OP_CMP_EQ: *out = a == b; break;
+        case IR_OP_CMP_NE: *out = a != b; break;
+        case IR_OP_CMP_LT: *out = a < b; break;
+        case IR_OP_CMP_LE: *out = a <= b; break;
+        case IR_OP_CMP_GT: *out = a > b; break;
+        default: *out = a >= b; break;
+    }
+    return 1;
+}
+
+// Operands of a compare, the immediate second; returns the condition that holds when it is true.
+static int isel_cmp_operands(IselCompiler* S, const IRInstruction* in, IselOpnd* a, IselOpnd* b) {
+    uint32_t a_id, b_id;
+    isel_operands(in, &a_id, &b_id);
+    int cc = isel_cmp_cc(in->opcode);
+    *a = isel_value(S, a_id);
+    *b = isel_value(S, b_id);
+    if (a->o.kind == X64_IMM) {
+        IselOpnd t = *a; *a = *b; *b = t;
+        if (cc == X64_CC_L) cc = X64_CC_G;
+        else if (cc == X64_CC_G) cc = X64_CC_L;
+        else if (cc == X64_CC_LE) cc = X64_CC_GE;
+        else if (cc == X64_CC_GE) cc = X64_CC_LE;
+    }
+    if (a->o.kind == X64_IMM || (a->o.kind == X64_MEM && b->o.kind == X64_MEM)) *a = isel_in_reg(S, *a);
+    if (a->o.kind == X64_MEM || b->o.kind == X64_MEM) S->st.mem_operands++;
+    return cc;
+}
+
+// cmp a, b; test a, a sets the same flags against zero and is shorter.
+static void isel_cmp_emit(IselCompiler* S, IselOpnd a, IselOpnd b) {
+    if (a.o.kind == X64_REG && b.o.kind == X64_IMM && b.o.imm == 0) isel_op(S, X64_TEST, a, a);
+    else isel_op(S, X64_CMP, a, b);
+}
+
+static void isel_compare(IselCompiler* S, const IRInstruction* in) {
+    int d = isel_slot(S, in->arg[0]);
+    int64_t k;
+    if (isel_cmp_const(in, &k)) { isel_move(S, isel_dest(S, d), isel_imm(k)); return; }
+    IselOpnd a, b;
+    int cc = isel_cmp_operands(S, in, &a, &b);
+    IselOpnd dst = isel_dest(S, d);
+    // zero the result before cmp so setcc needs no zero extension
+    IselOpnd r = dst.o.kind == X64_REG && !isel_same(dst, a) && !isel_same(dst, b) ? dst : isel_new_vreg(S, -1);
+    isel_op(S, X64_XOR, isel_sized(r, 4), isel_sized(r, 4));
+    isel_cmp_emit(S, a, b);
+    isel_emit(S, X64_SETCC, cc, isel_sized(r, 1), isel_none(), isel_none(), 0);
+    isel_move(S, dst, r);
+}
+
+// Jump to `label` when the value of `id` is zero; a deferred compare becomes cmp + jcc.
+static void isel_branch_zero(IselCompiler* S, uint32_t id, int label) {
+    int s;
+    const IRInstruction* def = isel_take_pending(S, id, &s);
+    if (def && def->opcode >= IR_OP_CMP_EQ && def->opcode <= IR_OP_CMP_GE) {
+        S->pending[s] = -1;
+        int64_t k;
+        if (isel_cmp_const(def, &k)) {
+            if (!k) isel_op(S, X64_JMP, isel_lab(label), isel_none());
+            return;
+        }
+        IselOpnd a, b;
+        int cc = isel_cmp_operands(S, def, &a, &b);
+        isel_cmp_emit(S, a, b);
+        isel_jcc(S, cc ^ 1, label);
+        S->st.fused++;
+        return;
+    }
+    IselOpnd v = isel_value(S, id);
+    if (v.o.kind == X64_IMM) {
+        if (!v.o.imm) isel_op(S, X64_JMP, isel_lab(label), isel_none());
+        return;
+    }
+    if (v.o.kind == X64_REG) isel_op(S, X64_TEST, v, v);
+    else isel_op(S, X64_CMP, v, isel_imm(0));
+    isel_jcc(S, X64_CC_E, label);
+}
+
+// Float operand: a memory home or pool constant, or a register holding the bits.
+static IselOpnd isel_float_src(IselCompiler* S, uint32_t id) {
+    int64_t k;
+    double f;
+    if (isel_int_literal(id, &k)) return isel_sym(isel_float_const(S, (double)k), 0, 8);
+    if (isel_float_literal(id, &f)) return isel_sym(isel_float_const(S, f), 0, 8);
+    return isel_value(S, id);
+}
+
+static void isel_load_xmm(IselCompiler* S, int xmm, IselOpnd src) {
+    IselOpnd x = isel_none();
+    x.o = x64_x(xmm);
+    isel_op(S, src.o.kind == X64_MEM ? X64_MOVSD : X64_MOVQ, x, src);
+}
+
+static void isel_float_op(IselCompiler* S, const IRInstruction* in, int op) {
+    int d = isel_slot(S, in->arg[0]);
+    uint32_t a_id, b_id;
+    isel_operands(in, &a_id, &b_id);
+    IselOpnd a = isel_float_src(S, a_id), b = isel_float_src(S, b_id);
+    IselOpnd x0 = isel_none(), x1 = isel_none();
+    x0.o = x64_x(0);
+    x1.o = x64_x(1);
+    isel_load_xmm(S, 0, a);
+    if (b.o.kind == X64_MEM) {
+        isel_op(S, op, x0, b);
+        S->st.mem_operands++;
+    } else {
+        isel_load_xmm(S, 1, b);
+        isel_op(S, op, x0, x1);
+    }
+    IselOpnd dst = isel_dest(S, d);
+    isel_op(S, dst.o.kind == X64_MEM ? X64_MOVSD : X64_MOVQ, dst, x0);
+}
+
+static void isel_print(IselCompiler* S, const IRInstruction* in) {
+    uint32_t id = in->arg[0];
+    int kind = in->opcode != IR_OP_PRINT ? ISEL_PRINT_FLOAT : ISEL_PRINT_INT;
+    int64_t k;
+    if (!isel_is_literal(id)) {
+        int s = isel_slot(S, id);
+        if (S->is_float[s]) kind = ISEL_PRINT_FLOAT;
+        else if (S->is_string[s] && kind == ISEL_PRINT_INT) kind = ISEL_PRINT_STR;
+    } else if (!isel_int_literal(id, &k)) {
+        kind = ISEL_PRINT_FLOAT;
+    }
+    if (kind == ISEL_PRINT_FLOAT) isel_load_xmm(S, 0, isel_float_src(S, id));
+    else isel_move(S, isel_preg(kind == ISEL_PRINT_STR ? X64_RSI : X64_RDI, 8), isel_value(S, id));
+    isel_emit(S, X64_CALL, 0, isel_lab(S->l_print[kind]), isel_none(), isel_none(), ISEL_CALL_CLOBBERS);
+    S->used_print[kind] = 1;
+}
+
+// Lowers ir[i]; a deferred definition only records itself unless `force`d by its use.
+static void isel_lower(IselCompiler* S, int i, int force) {
+    const IRInstruction* in = &ir[i];
+    int op = in->opcode;
+    if (!force && S->fold[i] && S->temp[isel_slot(S, in->arg[0])]) {
+        S->pending[isel_slot(S, in->arg[0])] = i;
+        return;
+    }
+    switch ((IROpcode)op) {
+        case IR_OP_NOP: case IR_OP_SECTION: case IR_OP_ENTRY: case IR_OP_IMPORT: case IR_OP_DECLARE:
+        case IR_OP_PARAM: case IR_OP_ARG:
+            break;
+        case IR_OP_LOAD: case IR_OP_MOV: case IR_OP_STORE: case IR_OP_FLOAT_LOAD: {
+            if (in->nargs < 2) break;
+            int d = isel_slot(S, in->arg[0]);
+            int64_t k;
+            double f;
+            if (isel_float_literal(in->arg[1], &f) && (op == IR_OP_FLOAT_LOAD || !isel_int_literal(in->arg[1], &k))) {
+                memcpy(&k, &f, 8);
+                isel_move(S, isel_dest(S, d), isel_imm(k));
+                break;
+            }
+            IselOpnd v = isel_value(S, in->arg[1]);
+            isel_move(S, isel_dest(S, d), v);
+            break;
+        }
+        case IR_OP_LOAD_STR: {
+            IselOpnd dst = isel_dest(S, isel_slot(S, in->arg[0]));
+            IselOpnd r = dst.o.kind == X64_REG ? dst : isel_new_vreg(S, -1);
+            isel_op(S, X64_LEA, r, isel_sym(isel_string(S, in->arg[1]), 0, 8));
+            isel_move(S, dst, r);
+            break;
+        }
+        case IR_OP_ADD: isel_add(S, in); break;
+        case IR_OP_SUB: isel_sub(S, in); break;
+        case IR_OP_MUL: isel_mul(S, in); break;
+        case IR_OP_DIV: isel_divmod(S, in, 0); break;
+        case IR_OP_MOD: isel_divmod(S, in, 1); break;
+        case IR_OP_FLOAT_ADD: isel_float_op(S, in, X64_ADDSD); break;
+        case IR_OP_FLOAT_SUB: isel_float_op(S, in, X64_SUBSD); break;
+        case IR_OP_FLOAT_MUL: isel_float_op(S, in, X64_MULSD); break;
+        case IR_OP_FLOAT_DIV: isel_float_op(S, in, X64_DIVSD); break;
+        case IR_OP_CMP_EQ: case IR_OP_CMP_NE: case IR_OP_CMP_LT: case IR_OP_CMP_LE: case IR_OP_CMP_GT: case IR_OP_CMP_GE:
+            isel_compare(S, in);
+            break;
+        case IR_OP_PRINT: case IR_OP_PRINT_FLOAT_SYSCALL: case IR_OP_PRINT_FLOAT_PRINTF:
+            isel_print(S, in);
+            break;
+        case IR_OP_LABEL: case IR_OP_FUNC:
+            isel_bind(S, isel_label_of(S, in->arg[0]));
+            break;
+        case IR_OP_JMP:
+            isel_op(S, X64_JMP, isel_lab(isel_label_of(S, in->arg[0])), isel_none());
+            break;
+        case IR_OP_IFZ:
+            isel_branch_zero(S, in->arg[0], isel_label_of(S, in->arg[1]));
+            break;
+        case IR_OP_CALL: {
+            // a call right before RET is a tail call: jmp, so the callee's ret returns for both
+            int tail = i + 1 < ir_count && ir[i + 1].opcode == IR_OP_RET;
+            isel_emit(S, tail ? X64_JMP : X64_CALL, 0, isel_lab(isel_label_of(S, in->arg[0])), isel_none(), isel_none(),
+                      ISEL_CALL_CLOBBERS);
+            break;
+        }
+        case IR_OP_RET:
+            isel_emit(S, X64_RET, 0, isel_none(), isel_none(), isel_none(), 1u << X64_RAX);
+            break;
+        case IR_OP_HALT:
+            isel_op(S, X64_JMP, isel_lab(S->l_exit), isel_none());
+            break;
+        case IR_OP_IF:
+            isel_branch_zero(S, in->arg[0], S->ctl[2 * i]);
+            break;
+        case IR_OP_ELSE:
+            isel_op(S, X64_JMP, isel_lab(S->ctl[2 * i + 1]), isel_none());
+            isel_bind(S, S->ctl[2 * i]);
+            break;
+        case IR_OP_END_IF:
+            isel_bind(S, S->ctl[2 * i]);
+            break;
+        case IR_OP_WHILE:
+            isel_bind(S, S->ctl[2 * i + 1]);
+            isel_branch_zero(S, in->arg[0], S->ctl[2 * i]);
+            break;
+        case IR_OP_END_WHILE:
+            isel_op(S, X64_JMP, isel_lab(S->ctl[2 * i + 1]), isel_none());
+            isel_bind(S, S->ctl[2 * i]);
+            break;
+        default:
+            fprintf(stderr, "[ISEL] unsupported IR op '%s'\n", ir_str(in->op));
+            S->errors++;
+    }
+}
+
+// === Scheduling ===
+
+// List scheduling between selection and allocation, so register choices follow the new order.
+// Straight-line runs between labels, branches and calls are cut into windows; each window's
+// dependence DAG (registers, flags, memory) is scheduled cycle by cycle against the latency/port
+// model, longest latency-weighted path first, and kept only if the model says it issues faster.
+
+enum {
+    ISEL_SC_ALU, ISEL_SC_SHIFT, ISEL_SC_LEA, ISEL_SC_LEA3, ISEL_SC_IMUL, ISEL_SC_DIV, ISEL_SC_LOAD,
+    ISEL_SC_STORE, ISEL_SC_FADD, ISEL_SC_FMUL, ISEL_SC_FDIV, ISEL_SC_FMOV, ISEL_SC_BRANCH, ISEL_SC_COUNT
+};
+
+typedef struct {
+    uint8_t latency;        // cycles until the result can be used
+    uint8_t busy;           // cycles the port stays taken (unpipelined dividers)
+    uint16_t ports;         // execution ports that accept it, bit per port
+} IselSchedCost;
+
+typedef struct {
+    const char* name;
+    int width;              // instructions issued per cycle
+    IselSchedCost cost[ISEL_SC_COUNT];
+} IselSchedModel;
+
+// Latencies and ports after the vendors' optimization manuals and measured instruction tables;
+// generic is a conservative middle that schedules well on all of them.
+static const IselSchedModel isel_sched_models[] = {
+    //                  ALU              SHIFT            LEA              LEA3             IMUL             DIV               LOAD             STORE             FADD              FMUL             FDIV             FMOV             BRANCH
+    { "generic", 4, { { 1, 1, 0x00F }, { 1, 1, 0x009 }, { 1, 1, 0x006 }, { 3, 1, 0x002 }, { 3, 1, 0x002 }, { 40, 20, 0x001 }, { 5, 1, 0x030 }, { 1, 1, 0x040 }, { 4, 1, 0x003 }, { 4, 1, 0x003 }, { 14, 5, 0x001 }, { 3, 1, 0x005 }, { 1, 1, 0x009 } } },
+    { "skylake", 4, { { 1, 1, 0x063 }, { 1, 1, 0x041 }, { 1, 1, 0x022 }, { 3, 1, 0x002 }, { 3, 1, 0x002 }, { 42, 24, 0x001 }, { 5, 1, 0x00C }, { 1, 1, 0x010 }, { 4, 1, 0x003 }, { 4, 1, 0x003 }, { 14, 4, 0x001 }, { 2, 1, 0x021 }, { 1, 1, 0x041 } } },
+    { "icelake", 5, { { 1, 1, 0x063 }, { 1, 1, 0x041 }, { 1, 1, 0x022 }, { 1, 1, 0x022 }, { 3, 1, 0x002 }, { 15, 10, 0x001 }, { 5, 1, 0x00C }, { 1, 1, 0x210 }, { 4, 1, 0x003 }, { 4, 1, 0x003 }, { 14, 4, 0x001 }, { 3, 1, 0x021 }, { 1, 1, 0x041 } } },
+    { "zen3",    6, { { 1, 1, 0x00F }, { 1, 1, 0x00F }, { 1, 1, 0x00F }, { 2, 1, 0x00F }, { 3, 1, 0x002 }, { 14, 7, 0x004 },  { 4, 1, 0x070 }, { 1, 1, 0x180 }, { 3, 1, 0x1800 }, { 3, 1, 0x600 }, { 13, 5, 0x400 }, { 3, 1, 0x200 }, { 1, 1, 0x009 } } },
+};
+
+static const IselSchedModel* isel_sched_model = &isel_sched_models[0];
+
+int isel_set_tune(const char* name) {
+    for (size_t i = 0; i < sizeof(isel_sched_models) / sizeof(isel_sched_models[0]); i++)
+        if (strcmp(isel_sched_models[i].name, name) == 0) { isel_sched_model = &isel_sched_models[i]; return 0; }
+    return -1;
+}
+
+void isel_set_sched_report(int on) {
+    isel_sched_report = on;
+}
+
+#define ISEL_SCHED_WINDOW 64    // instructions per scheduling window: bounds the DAG and register pressure
+#define ISEL_RES_FLAGS 32       // resources: 0-15 GPRs, 16-31 xmm, flags, then the block's virtual registers
+#define ISEL_RES_VREG 33
+
+typedef struct {
+    int cls;
+    int load, store;        // reads / writes memory through `mem`
+    int latency;
+    const X64Operand* mem;
+    int nreads, nwrites;
+    int reads[12], writes[12];
+} IselSchedNode;
+
+static int isel_sched_barrier(int op) {
+    return op == ISEL_LABEL || op == X64_JMP || op == X64_JCC || op == X64_CALL || op == X64_RET ||
+           op == X64_PUSH || op == X64_POP || op == X64_SYSCALL || op == X64_LEAVE || op >= X64_FLD;
+}
+
+static void isel_sched_use(IselSchedNode* n, int res, int write) {
+    if (write) n->writes[n->nwrites++] = res;
+    else n->reads[n->nreads++] = res;
+}
+
+// Resource of operand k's register (j = 0) or index register (j = 1), -1 for none.
+static int isel_sched_res(const IselInst* in, int k, int j, int v0) {
+    const X64Operand* o = &in->x.o[k];
+    if (in->v[k][j]) return ISEL_RES_VREG + in->v[k][j] - v0 - 1;
+    int r = j ? o->index : o->reg;
+    if (r < 0 || r >= 16) return -1;
+    return o->kind == X64_XMM ? 16 + r : r;
+}
+
+// What an instruction reads and writes, its class and latency under the current model.
+static void isel_sched_analyze(const IselInst* in, int v0, IselSchedNode* n) {
+    int op = in->x.op;
+    memset(n, 0, sizeof(*n));
+    int dst_read = 1, dst_write = 1, src_read = 1;
+    int flags_read = op == X64_ADC || op == X64_SBB || op == X64_SETCC || op == X64_CMOVCC;
+    int flags_write = op == X64_ADD || op == X64_OR || op == X64_ADC || op == X64_SBB || op == X64_AND ||
+                      op == X64_SUB || op == X64_XOR || op == X64_CMP || op == X64_TEST || op == X64_IMUL ||
+                      op == X64_MUL || op == X64_IDIV || op == X64_DIV || op == X64_NEG || op == X64_INC ||
+                      op == X64_DEC || op == X64_SHL || op == X64_SHR || op == X64_SAR || op == X64_UCOMISD || op == X64_COMISD;
+    switch (op) {
+        case X64_MOV: case X64_LEA: case X64_MOVZX: case X64_MOVSX: case X64_MOVSXD: case X64_MOVQ:
+        case X64_MOVSD: case X64_MOVAPD: case X64_CVTSI2SD: case X64_CVTTSD2SI: case X64_SQRTSD:
+            dst_read = 0;
+            break;
+        case X64_CMP: case X64_TEST: case X64_UCOMISD: case X64_COMISD: case X64_IDIV: case X64_DIV: case X64_MUL:
+            dst_write = 0;
+            break;
+        case X64_IMUL:
+            dst_read = in->x.nops < 3;
+            break;
+        case X64_XOR: case X64_SUB: case X64_XORPD:
+            // xor r, r / sub r, r: a zero idiom, no dependence on the old value
+            if (in->x.nops == 2 && in->x.o[0].kind == in->x.o[1].kind && in->x.o[0].kind != X64_MEM &&
+                in->x.o[0].kind != X64_IMM && in->x.o[0].reg == in->x.o[1].reg && in->v[0][0] == in->v[1][0])
+                dst_read = src_read = 0;
+            break;
+    }
+    if (flags_read) isel_sched_use(n, ISEL_RES_FLAGS, 0);
+    for (int k = 0; k < in->x.nops; k++) {
+        const X64Operand* o = &in->x.o[k];
+        int rd = k ? src_read : dst_read, wr = !k && dst_write;
+        if (o->kind == X64_REG || o->kind == X64_XMM) {
+            int r = isel_sched_res(in, k, 0, v0);
+            if (r >= 0 && rd) isel_sched_use(n, r, 0);
+            if (r >= 0 && wr) isel_sched_use(n, r, 1);
+        } else if (o->kind == X64_MEM) {
+            for (int j = 0; j < 2; j++) {
+                int r = isel_sched_res(in, k, j, v0);
+                if (r >= 0) isel_sched_use(n, r, 0);
+            }
+            if (op != X64_LEA) {
+                n->mem = o;
+                n->load |= rd;
+                n->store |= wr;
+            }
+        }
+    }
+    for (int r = 0; r < 32; r++)
+        if (in->implicit >> r & 1) {
+            isel_sched_use(n, r, 0);
+            isel_sched_use(n, r, 1);
+        }
+    if (flags_write) isel_sched_use(n, ISEL_RES_FLAGS, 1);
+
+    switch (op) {
+        case X64_MOV: case X64_MOVZX: case X64_MOVSX: case X64_MOVSXD:
+            n->cls = n->store ? ISEL_SC_STORE : n->load ? ISEL_SC_LOAD : ISEL_SC_ALU;
+            break;
+        case X64_MOVQ: case X64_MOVSD: case X64_MOVAPD:
+            n->cls = n->store ? ISEL_SC_STORE : n->load ? ISEL_SC_LOAD : ISEL_SC_FMOV;
+            break;
+        case X64_LEA: {
+            const X64Operand* o = &in->x.o[1];
+            int parts = (in->v[1][0] || (o->reg >= 0 && o->reg < 16)) + (in->v[1][1] || o->index >= 0) + (o->imm != 0);
+            n->cls = parts == 3 ? ISEL_SC_LEA3 : ISEL_SC_LEA;
+            break;
+        }
+        case X64_SHL: case X64_SHR: case X64_SAR: n->cls = ISEL_SC_SHIFT; break;
+        case X64_IMUL: case X64_MUL: n->cls = ISEL_SC_IMUL; break;
+        case X64_IDIV: case X64_DIV: n->cls = ISEL_SC_DIV; break;
+        case X64_ADDSD: case X64_SUBSD: n->cls = ISEL_SC_FADD; break;
+        case X64_MULSD: n->cls = ISEL_SC_FMUL; break;
+        case X64_DIVSD: case X64_SQRTSD: n->cls = ISEL_SC_FDIV; break;
+        case X64_UCOMISD: case X64_COMISD: case X64_CVTSI2SD: case X64_CVTTSD2SI: case X64_XORPD: n->cls = ISEL_SC_FMOV; break;
+        default: n->cls = ISEL_SC_ALU; break;
+    }
+    n->latency = isel_sched_model->cost[n->cls].latency;
+    if (n->load && n->cls != ISEL_SC_LOAD) n->latency += isel_sched_model->cost[ISEL_SC_LOAD].latency;
+}
+
+// rx_vars entries (rip-relative, no index) alias only when their bytes overlap.
+static int isel_sched_alias(const X64Operand* a, const X64Operand* b) {
+    if (a->reg != X64_RIP || b->reg != X64_RIP || a->index >= 0 || b->index >= 0) return 1;
+    if (a->label != b->label) return 0;
+    return a->imm < b->imm + b->size && b->imm < a->imm + a->size;
+}
+
+typedef struct {
+    IselSchedNode node[ISEL_SCHED_WINDOW];
+    int16_t edge[ISEL_SCHED_WINDOW][ISEL_SCHED_WINDOW];    // latency of i -> j, -1 for none
+    int height[ISEL_SCHED_WINDOW];                         // longest latency-weighted path to the window's end
+    int n;
+} IselSchedDag;
+
+static void isel_sched_edge(IselSchedDag* D, int from, int to, int latency) {
+    if (from >= 0 && from != to && D->edge[from][to] < latency) D->edge[from][to] = (int16_t)latency;
+}
+
+// DAG of code[from, from + n): true dependences carry the producer's latency, anti and output
+// dependences only keep the order. `writer`/`readers`/`stamp` are per-resource scratch.
+static void isel_sched_build(IselCompiler* S, int from, int n, IselSchedDag* D, int* writer, uint64_t* readers, int* stamp, int window) {
+    D->n = n;
+    memset(D->edge, 0xFF, sizeof(D->edge));
+    for (int i = 0; i < n; i++) {
+        IselSchedNode* x = &D->node[i];
+        isel_sched_analyze(&S->code[from + i], S->block_v0, x);
+        for (int k = 0; k < x->nreads + x->nwrites; k++) {
+            int r = k < x->nreads ? x->reads[k] : x->writes[k - x->nreads];
+            if (stamp[r] != window) { stamp[r] = window; writer[r] = -1; readers[r] = 0; }
+        }
+        for (int k = 0; k < x->nreads; k++) {
+            int r = x->reads[k];
+            if (writer[r] >= 0) isel_sched_edge(D, writer[r], i, D->node[writer[r]].latency);
+        }
+        for (int k = 0; k < x->nwrites; k++) {
+            int r = x->writes[k];
+            isel_sched_edge(D, writer[r], i, 0);
+            for (int j = 0; j < i; j++)
+                if (readers[r] >> j & 1) isel_sched_edge(D, j, i, 0);
+        }
+        for (int k = 0; k < x->nreads; k++) readers[x->reads[k]] |= 1ull << i;
+        for (int k = 0; k < x->nwrites; k++) { writer[x->writes[k]] = i; readers[x->writes[k]] = 0; }
+        if (x->mem)
+            for (int j = 0; j < i; j++) {
+                const IselSchedNode* y = &D->node[j];
+                if (!y->mem || !(x->store || y->store) || !isel_sched_alias(x->mem, y->mem)) continue;
+                isel_sched_edge(D, j, i, y->store && x->load ? y->latency : 0);
+            }
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        D->height[i] = D->node[i].latency;
+        for (int j = i + 1; j < n; j++)
+            if (D->edge[i][j] >= 0 && D->edge[i][j] + D->height[j] > D->height[i]) D->height[i] = D->edge[i][j] + D->height[j];
+    }
+}
+
+typedef struct {
+    int cycle, used;        // current issue cycle and instructions issued in it
+    int port_free[16];      // first cycle each port is free again
+} IselSchedState;
+
+// Issues node x at `cycle` if the cycle has a slot and every micro-op a free port; returns 0 otherwise.
+static int isel_sched_issue(IselSchedState* T, const IselSchedNode* x, int cycle, int commit) {
+    const IselSchedModel* M = isel_sched_model;
+    if (cycle == T->cycle && T->used >= M->width) return 0;
+    int uops[3], nuops = 0, taken[3];
+    if (x->cls != ISEL_SC_LOAD && x->cls != ISEL_SC_STORE) uops[nuops++] = x->cls;
+    if (x->load) uops[nuops++] = ISEL_SC_LOAD;
+    if (x->store) uops[nuops++] = ISEL_SC_STORE;
+    if (!nuops) uops[nuops++] = x->cls;
+    for (int u = 0; u < nuops; u++) {
+        taken[u] = -1;
+        for (int p = 0; p < 16 && taken[u] < 0; p++) {
+            if (!(M->cost[uops[u]].ports >> p & 1) || T->port_free[p] > cycle) continue;
+            int dup = 0;
+            for (int w = 0; w < u; w++) dup |= taken[w] == p;
+            if (!dup) taken[u] = p;
+        }
+        if (taken[u] < 0) return 0;
+    }
+    if (commit) {
+        if (cycle != T->cycle) { T->cycle = cycle; T->used = 0; }
+        T->used++;
+        for (int u = 0; u < nuops; u++) T->port_free[taken[u]] = cycle + M->cost[uops[u]].busy;
+    }
+    return 1;
+}
+
+// Cycles to issue and complete the window in `order`, in order.
+static int isel_sched_cycles(const IselSchedDag* D, const int* order) {
+    IselSchedState T;
+    memset(&T, 0, sizeof(T));
+    int ready[ISEL_SCHED_WINDOW] = { 0 }, end = 0;
+    for (int k = 0; k < D->n; k++) {
+        int i = order[k], c = ready[i] > T.cycle ? ready[i] : T.cycle;
+        while (!isel_sched_issue(&T, &D->node[i], c, 1)) c++;
+        for (int j = i + 1; j < D->n; j++)
+            if (D->edge[i][j] >= 0 && c + D->edge[i][j] > ready[j]) ready[j] = c + D->edge[i][j];
+        if (c + D->node[i].latency > end) end = c + D->node[i].latency;
+    }
+    return end;
+}
+
+// Cycle-driven list scheduling: each cycle takes the ready instruction with the longest path to
+// the end (selection order breaks ties) while slots and ports last.
+static void isel_sched_list(const IselSchedDag* D, int* order) {
+    IselSchedState T;
+    memset(&T, 0, sizeof(T));
+    int ready[ISEL_SCHED_WINDOW] = { 0 }, npred[ISEL_SCHED_WINDOW], done = 0, cycle = 0;
+    for (int i = 0; i < D->n; i++) {
+        npred[i] = 0;
+        for (int j = 0; j < i; j++) npred[i] += D->edge[j][i] >= 0;
+    }
+    while (done < D->n) {
+        int best = -1, next = INT_MAX;
+        for (int i = 0; i < D->n; i++) {
+            if (npred[i]) continue;
+            if (ready[i] > cycle) { if (ready[i] < next) next = ready[i]; continue; }
+            if (!isel_sched_issue(&T, &D->node[i], cycle, 0)) { next = cycle + 1; continue; }
+            if (best < 0 || D->height[i] > D->height[best]) best = i;
+        }
+        if (best < 0) { cycle = next; continue; }
+        isel_sched_issue(&T, &D->node[best], cycle, 1);
+        npred[best] = -1;
+        order[done++] = best;
+        for (int j = best + 1; j < D->n; j++)
+            if (D->edge[best][j] >= 0) {
+                npred[j]--;
+                if (cycle + D->edge[best][j] > ready[j]) ready[j] = cycle + D->edge[best][j];
+            }
+    }
+}
+
+// Schedules code[from, ncode) of the block being selected. Returns the selection order when
+// anything moved (NULL otherwise) and the model's cycle estimates before and after.
+static IselInst* isel_schedule(IselCompiler* S, int from, int* before, int* after) {
+    int nres = ISEL_RES_VREG + S->nvregs - S->block_v0;
+    int* writer = malloc((size_t)nres * sizeof(int));
+    uint64_t* readers = malloc((size_t)nres * sizeof(uint64_t));
+    int* stamp = malloc((size_t)nres * sizeof(int));
+    IselSchedDag* D = malloc(sizeof(IselSchedDag));
+    if (!writer || !readers || !stamp || !D) { perror("isel_schedule"); exit(1); }
+    for (int r = 0; r < nres; r++) stamp[r] = -1;
+    IselInst* saved = NULL;
+    int window = 0;
+    *before = *after = 0;
+    for (int p = from; p < S->ncode; ) {
+        if (isel_sched_barrier(S->code[p].x.op)) {
+            *before += S->code[p].x.op != ISEL_LABEL;
+            *after += S->code[p].x.op != ISEL_LABEL;
+            p++;
+            continue;
+        }
+        int n = 0;
+        while (p + n < S->ncode && n < ISEL_SCHED_WINDOW && !isel_sched_barrier(S->code[p + n].x.op)) n++;
+        int order[ISEL_SCHED_WINDOW], sched[ISEL_SCHED_WINDOW];
+        for (int i = 0; i < n; i++) order[i] = i;
+        isel_sched_build(S, p, n, D, writer, readers, stamp, window++);
+        int c0 = isel_sched_cycles(D, order), c1 = c0;
+        if (n > 2) {
+            isel_sched_list(D, sched);
+            c1 = isel_sched_cycles(D, sched);
+        }
+        *before += c0;
+        if (c1 < c0) {
+            if (!saved) {
+                saved = malloc((size_t)(S->ncode - from) * sizeof(IselInst));
+                if (!saved) { perror("isel_schedule"); exit(1); }
+                memcpy(saved, S->code + from, (size_t)(S->ncode - from) * sizeof(IselInst));
+            }
+            IselInst tmp[ISEL_SCHED_WINDOW];
+            for (int i = 0; i < n; i++) tmp[i] = S->code[p + sched[i]];
+            memcpy(S->code + p, tmp, (size_t)n * sizeof(IselInst));
+            S->st.scheduled++;
+            *after += c1;
+        } else {
+            *after += c0;
+        }
+        p += n;
+    }
+    free(writer); free(readers); free(stamp); free(D);
+    return saved;
+}
+
+// === Register allocation ===
+
+// Physical registers an instruction touches: register operands, address registers and implicit ones.
+static uint32_t isel_phys(const IselInst* in) {
+    uint32_t m = in->implicit;
+    for (int k = 0; k < in->x.nops; k++) {
+        const X64Operand* o = &in->x.o[k];
+        if (o->kind == X64_REG && !in->v[k][0]) m |= 1u << o->reg;
+        if (o->kind == X64_MEM) {
+            if (o->reg >= 0 && o->reg < 16 && !in->v[k][0]) m |= 1u << o->reg;
+            if (o->index >= 0 && !in->v[k][1]) m |= 1u << o->index;
+        }
+    }
+    return m;
+}
+
+// Physical registers whose value is still needed after each instruction of code[from..), by a
+// backward scan: scheduling can move a virtual register's range across a fixed-register sequence
+// (mov rax, x / cqo / idiv) without touching it.
+static uint32_t* isel_live_phys(IselCompiler* S, int from, int v0) {
+    uint32_t* live = malloc((size_t)(S->ncode - from + 1) * sizeof(uint32_t));
+    if (!live) { perror("isel_live_phys"); exit(1); }
+    uint32_t l = 0;
+    for (int p = S->ncode - 1; p >= from; p--) {
+        live[p - from] = l;
+        int op = S->code[p].x.op;
+        if (op == X64_CALL) {
+            // clobbers every scratch register and reads at most the print helpers' rdi / rsi
+            l = (l & ~ISEL_SCRATCH) | 1u << X64_RDI | 1u << X64_RSI;
+            continue;
+        }
+        if (op == X64_JMP || op == X64_JCC || op == X64_RET) continue;  // implicit masks here are clobbers, not reads
+        IselSchedNode n;
+        isel_sched_analyze(&S->code[p], v0, &n);
+        for (int k = 0; k < n.nwrites; k++)
+            if (n.writes[k] < 16) l &= ~(1u << n.writes[k]);
+        for (int k = 0; k < n.nreads; k++)
+            if (n.reads[k] < 16) l |= 1u << n.reads[k];
+    }
+    return live;
+}
+
+// Linear scan over the virtual registers created since v0 in code[from..). A register is free for
+// a virtual one if no instruction over its live range touches it or needs its value afterwards, and
+// the previous holder's last use is at or before this one's definition. When one is left without a register, returns the
+// temporary to spill: of it and the temporaries holding registers there, the one used furthest
+// away (0 when everything fits, the failing register if no temporary is involved).
+static int isel_allocate(IselCompiler* S, int from, int v0) {
+    int n = S->nvregs - v0;
+    if (n <= 0) return 0;
+    int* first = malloc((size_t)n * sizeof(int));
+    int* last = malloc((size_t)n * sizeof(int));
+    int* reg = malloc((size_t)n * sizeof(int));
+    int* order = malloc((size_t)n * sizeof(int));
+    uint32_t* live = isel_live_phys(S, from, v0);
+    if (!first || !last || !reg || !order) { perror("isel_allocate"); exit(1); }
+    for (int i = 0; i < n; i++) first[i] = -1;
+    int norder = 0;
+    for (int p = from; p < S->ncode; p++)
+        for (int k = 0; k < 3; k++)
+            for (int j = 0; j < 2; j++) {
+                int v = S->code[p].v[k][j] - v0 - 1;
+                if (v < 0) continue;
+                if (first[v] < 0) { first[v] = p; order[norder++] = v; }
+                last[v] = p;
+            }
+    int until[16], holder[16];
+    for (int r = 0; r < 16; r++) until[r] = holder[r] = -1;
+    int bad = 0;
+    for (int i = 0; i < norder && !bad; i++) {
+        int v = order[i];
+        uint32_t mask = 0;
+        for (int p = first[v]; p <= last[v]; p++) mask |= isel_phys(&S->code[p]) | live[p - from];
+        reg[v] = -1;
+        for (size_t r = 0; r < sizeof(isel_scratch_regs) / sizeof(isel_scratch_regs[0]); r++) {
+            int R = isel_scratch_regs[r];
+            if ((mask >> R & 1) || until[R] > first[v]) continue;
+            reg[v] = R;
+            until[R] = last[v];
+            holder[R] = v;
+            break;
+        }
+        if (reg[v] >= 0) continue;
+        int spill = S->vreg_slot[v0 + 1 + v] >= 0 ? v : -1;
+        for (int R = 0; R < 16; R++) {
+            int h = holder[R];
+            if (h < 0 || until[R] <= first[v] || S->vreg_slot[v0 + 1 + h] < 0) continue;
+            if (spill < 0 || last[h] > last[spill]) spill = h;
+        }
+        bad = v0 + 1 + (spill >= 0 ? spill : v);
+    }
+    if (!bad)
+        for (int p = from; p < S->ncode; p++)
+            for (int k = 0; k < 3; k++) {
+                IselInst* in = &S->code[p];
+                if (in->v[k][0]) in->x.o[k].reg = (int8_t)reg[in->v[k][0] - v0 - 1];
+                if (in->v[k][1]) in->x.o[k].index = (int8_t)reg[in->v[k][1] - v0 - 1];
+            }
+    free(first); free(last); free(reg); free(order); free(live);
+    return bad;
+}
+
+// Selects and allocates IR ops [from, to) of one block, demoting temporaries until it fits.
+static void isel_block(IselCompiler* S, int from, int to) {
+    int c0 = S->ncode;
+    IselStats st0 = S->st;
+    for (;;) {
+        S->block_v0 = S->nvregs;
+        for (int i = from; i < to; i++) isel_lower(S, i, 0);
+        int before = 0, after = 0, windows = S->st.scheduled;
+        IselInst* selected = isel_sched_enabled ? isel_schedule(S, c0, &before, &after) : NULL;
+        int bad = isel_allocate(S, c0, S->block_v0);
+        if (bad && selected) {
+            // the new order kept too many values live at once: allocate the selected one instead
+            memcpy(S->code + c0, selected, (size_t)(S->ncode - c0) * sizeof(IselInst));
+            after = before;
+            S->st.scheduled = windows;
+            S->st.unscheduled++;
+            bad = isel_allocate(S, c0, S->block_v0);
+        }
+        free(selected);
+        if (!bad) {
+            S->st.cycles_before += before;
+            S->st.cycles_after += after;
+            if (isel_sched_report && isel_sched_enabled)
+                fprintf(stderr, "[SCHED] block %d: %d instructions, %d -> %d cycles\n", S->block[from], S->ncode - c0, before, after);
+            return;
+        }
+        int slot = S->vreg_slot[bad], demoted = 0;
+        S->nvregs = S->block_v0;
+        S->ncode = c0;
+        if (slot >= 0) {
+            S->temp[slot] = 0;
+            demoted = 1;
+        } else {
+            for (int s = 0; s < S->nslots; s++)
+                if (S->temp[s] && S->first[s] >= from && S->first[s] < to) { S->temp[s] = 0; demoted++; }
+        }
+        for (int s = 0; s < S->nslots; s++)
+            if (S->first[s] >= from && S->first[s] < to) { S->pending[s] = -1; S->vreg[s] = 0; }
+        if (!demoted) { fprintf(stderr, "[ISEL] register allocation failed\n"); S->errors++; return; }
+        st0.demoted += demoted;
+        st0.temps -= demoted;
+        S->st = st0;
+    }
+}
+
+// === Output ===
+
+static void isel_print_inst(IselCompiler* S, FILE* out, const IselInst* in) {
+    if (in->x.op == ISEL_LABEL) {
+        x64_print_label(out, in->x.o[0].label, S->sym);
+        fputs(":\n", out);
+        return;
+    }
+    fputs("    ", out);
+    x64_print(out, &in->x, S->sym);
+    fputc('\n', out);
+}
+
+static void isel_write(IselCompiler* S, FILE* out) {
+    static const char* runtime_names[3] = { "int_to_str", "float_to_str", "out_write" };
+    fprintf(out, "; generated by rexion_isel.c from %d IR ops\nsection .text\nglobal main\n", ir_count);
+    int uses[3] = { S->used_print[ISEL_PRINT_INT], S->used_print[ISEL_PRINT_FLOAT],
+                    S->used_print[ISEL_PRINT_INT] | S->used_print[ISEL_PRINT_STR] | S->used_print[ISEL_PRINT_FLOAT] };
+    for (int r = 0; r < 3; r++)
+        if (uses[r]) fprintf(out, "extern %s\n", runtime_names[r]);
+    fputs("main:\n", out);
+    for (int p = 0; p < S->ncode; p++) isel_print_inst(S, out, &S->code[p]);
+
+    // PRINT helpers: value in rdi / rsi / xmm0, text and newline appended to the runtime's stdout
+    // buffer; string constants carry their length in the qword before their first byte
+    if (S->used_print[ISEL_PRINT_INT])
+        fputs("rx_print_int:\n"
+              "    lea rsi, [rel rx_digits]\n"
+              "    call int_to_str\n"
+              "    mov byte [rsi + rax], 10\n"
+              "    lea rdx, [rax + 1]\n"
+              "    jmp out_write\n", out);
+    if (S->used_print[ISEL_PRINT_STR])
+        fputs("rx_print_str:\n"
+              "    test rsi, rsi\n"
+              "    jz .newline\n"
+              "    mov rdx, [rsi - 8]\n"
+              "    call out_write\n"
+              ".newline:\n"
+              "    lea rsi, [rel rx_newline]\n"
+              "    mov edx, 1\n"
+              "    jmp out_write\n", out);
+    if (S->used_print[ISEL_PRINT_FLOAT])
+        fputs("rx_print_float:\n"
+              "    lea rdi, [rel rx_digits]\n"
+              "    call float_to_str\n"
+              "    lea rsi, [rel rx_digits]\n"
+              "    mov byte [rsi + rax], 10\n"
+              "    lea rdx, [rax + 1]\n"
+              "    jmp out_write\n", out);
+
+    fputs("section .rodata\nrx_newline db 10, 0\n", out);
+    for (int h = 0; h < S->str_cap; h++) {
+        if (!S->strs[h].id) continue;
+        const char* s = ir_str(S->strs[h].id - 1);
+        fprintf(out, "    dq %zu\n%s db ", strlen(s), S->sym[S->strs[h].val]);
+        for (const char* c = s; *c; c++) fprintf(out, "%d, ", (unsigned char)*c);
+        fputs("0\n", out);
+    }
+    if (S->nfloats) fputs("align 8\n", out);
+    for (int i = 0; i < S->nfloats; i++) fprintf(out, "%s dq 0x%016llx\n", S->sym[S->float_label[i]], (unsigned long long)S->floats[i]);
+    fprintf(out, "section .bss\nalignb 8\nrx_sp resq 1\nrx_vars resq %d\nrx_digits resb 32\n", S->nslots ? S->nslots : 1);
+}
+
+static void isel_free(IselCompiler* S) {
+    for (int l = 0; l < S->nlabels; l++) free(S->sym[l]);
+    free(S->sym); free(S->label_pos);
+    free(S->names); free(S->labels); free(S->strs);
+    free(S->weight); free(S->nreads); free(S->nwrites); free(S->first); free(S->last); free(S->block_of);
+    free(S->first_def); free(S->is_float); free(S->is_string); free(S->temp); free(S->pin);
+    free(S->pending); free(S->vreg);
+    free(S->block); free(S->ctl); free(S->fold);
+    free(S->code); free(S->vreg_slot); free(S->floats); free(S->float_label);
+    free(S);
+}
+
+// Lowers ir[0..ir_count) to NASM text on `out`. Returns the instruction count, -1 on errors.
+int isel_compile(FILE* out, IselStats* stats) {
+    static const int saved[ISEL_PINNED] = { X64_RBX, X64_RBP, X64_R12, X64_R13, X64_R14, X64_R15 };
+    IselCompiler* S = calloc(1, sizeof(IselCompiler));
+    if (!S) { perror("isel_compile"); return -1; }
+    S->l_vars = isel_new_label(S, "rx_vars");
+    S->l_sp = isel_new_label(S, "rx_sp");
+    S->l_print[ISEL_PRINT_INT] = isel_new_label(S, "rx_print_int");
+    S->l_print[ISEL_PRINT_STR] = isel_new_label(S, "rx_print_str");
+    S->l_print[ISEL_PRINT_FLOAT] = isel_new_label(S, "rx_print_float");
+    S->l_body = isel_new_label(S, NULL);
+    S->l_exit = isel_new_label(S, NULL);
+    S->npin = ISEL_PINNED;
+    isel_scan(S);
+
+    // main: save callee-saved regs and rsp (HALT unwinds from any depth), zero the pinned names;
+    // a top-level RET returns from the body call onto the exit path
+    IselOpnd rsp = isel_preg(X64_RSP, 8);
+    for (int r = 0; r < ISEL_PINNED; r++) isel_op(S, X64_PUSH, isel_preg(saved[r], 8), isel_none());
+    isel_op(S, X64_MOV, isel_sym(S->l_sp, 0, 8), rsp);
+    for (int s = 0; s < S->nslots; s++)
+        if (S->pin[s] >= 0) isel_move(S, isel_preg(isel_pin_regs[S->pin[s]], 8), isel_imm(0));
+    isel_op(S, X64_CALL, isel_lab(S->l_body), isel_none());
+    isel_bind(S, S->l_exit);
+    isel_op(S, X64_MOV, rsp, isel_sym(S->l_sp, 0, 8));
+    for (int r = ISEL_PINNED - 1; r >= 0; r--) isel_op(S, X64_POP, isel_preg(saved[r], 8), isel_none());
+    isel_op(S, X64_XOR, isel_preg(X64_RAX, 4), isel_preg(X64_RAX, 4));
+    isel_emit(S, X64_RET, 0, isel_none(), isel_none(), isel_none(), 0);
+    isel_bind(S, S->l_body);
+
+    for (int i = 0; i < ir_count && !S->errors; ) {
+        int j = i + 1;
+        while (j < ir_count && S->block[j] == S->block[i]) j++;
+        isel_block(S, i, j);
+        i = j;
+    }
+    int tail = ir_count ? ir[ir_count - 1].opcode : IR_OP_NOP;
+    if (tail != IR_OP_HALT && tail != IR_OP_JMP && tail != IR_OP_RET) isel_op(S, X64_JMP, isel_lab(S->l_exit), isel_none());
+
+    int rc = S->errors ? -1 : 0;
+    if (!rc) isel_write(S, out);
+    if (stats) *stats = S->st;
+    int ncode = S->ncode;
+    isel_free(S);
+    return rc < 0 ? rc : ncode;
+}
+
+static double isel_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Writes the NASM for the current IR buffer to `path` and reports what the backend did.
+int isel_write_asm(const char* path) {
+    if (ir_count == 0) {
+        fprintf(stderr, "[ISEL] the IR buffer is empty: nothing to compile into %s\n", path);
+        return -1;
+    }
+    FILE* out = fopen(path, "w");
+    if (!out) { perror(path); return -1; }
+    IselStats st;
+    int n = isel_compile(out, &st);
+    fclose(out);
+    if (n < 0) return -1;
+    fprintf(stderr, "[ISEL] %d IR ops -> %d instructions: %d names in registers, %d temporaries, %d folded into addresses, "
+        "%d memory operands, %d fused compare-branches, %d strength-reduced, %d demoted\n",
+        ir_count, n, st.pinned, st.temps, st.lea, st.mem_operands, st.fused, st.strength, st.demoted);
+    if (isel_sched_enabled)
+        fprintf(stderr, "[ISEL] schedule (%s): %d windows reordered, %d blocks kept in selection order, est. %lld -> %lld cycles\n",
+            isel_sched_model->name, st.scheduled, st.unscheduled, st.cycles_before, st.cycles_after);
+    return 0;
+}
+
+int ssa_optimize_ir(FILE* report);
+extern long long* ssa_ir_counts;
+extern int ssa_ir_ncounts;
+
+// Loads an IR program, runs it through the SSA pipeline if `optimize` is set, and compiles it to
+// NASM at `asm_path`. With --profile-use, register homes are ranked by the profile's block counts.
+int isel_compile_file(const char* ir_path, const char* asm_path, int optimize) {
+    ir_reset();
+    if (ir_load_any(ir_path) != 0) return -1;
+    if (optimize && ssa_optimize_ir(stderr) && ssa_ir_counts && ssa_ir_ncounts == ir_count) isel_counts = ssa_ir_counts;
+    int rc = isel_write_asm(asm_path);
+    isel_counts = NULL;
+    return rc;
+}
+
+int rlink_link_files(const char** asm_paths, int npaths, const char* exe_path);
+
+static void isel_bench_emit(const char* op, const char* d, const char* a, const char* b) {
+    const char* args[3] = { d, a, b };
+    size_t lens[3] = { d ? strlen(d) : 0, a ? strlen(a) : 0, b ? strlen(b) : 0 };
+    ir_append(op, strlen(op), args, lens, b ? 3 : a ? 2 : d ? 1 : 0);
+}
+
+static const char* isel_bench_modes[3] = { "naive", "isel", "sched" };
+
+// Compiles the IR buffer in every backend mode, runs it and compares its whole output with `expect`.
+static int isel_bench_check(const char* what, const char* expect) {
+    int bad = 0;
+    for (int mode = 0; mode < 3; mode++) {
+        const char* asm_path = "rexion_isel_bench.asm";
+        const char* exe_path = "./rexion_isel_bench.exe";
+        isel_fold_enabled = isel_regs_enabled = mode > 0;
+        isel_sched_enabled = mode > 1;
+        int rc = isel_write_asm(asm_path);
+        isel_fold_enabled = isel_regs_enabled = isel_sched_enabled = 1;
+        if (rc != 0 || rlink_link_files(&asm_path, 1, exe_path) != 0) return 1;
+        char got[256];
+        size_t len = 0;
+        FILE* p = popen(exe_path, "r");
+        if (p) {
+            len = fread(got, 1, sizeof(got) - 1, p);
+            pclose(p);
+        }
+        got[len] = '\0';
+        if (strcmp(got, expect) != 0) {
+            printf("[ISEL-BENCH] %s (%s): WRONG, got \"%s\"\n", what, isel_bench_modes[mode], got);
+            bad = 1;
+        }
+        remove(asm_path);
+        remove(exe_path);
+    }
+    if (!bad) printf("[ISEL-BENCH] %s: ok\n", what);
+    return bad;
+}
+
+// Division by a constant temporary folded into its use, and by a -1/0 only known at run time.
+static int isel_bench_divmod(void) {
+    ir_reset();
+    isel_bench_emit("LOAD", "x", "-100", NULL);
+    isel_bench_emit("LOAD", "k", "7", NULL);
+    isel_bench_emit("DIV", "q", "x", "k");
+    isel_bench_emit("PRINT", "q", NULL, NULL);
+    isel_bench_emit("LOAD", "k2", "7", NULL);
+    isel_bench_emit("MOD", "r", "x", "k2");
+    isel_bench_emit("PRINT", "r", NULL, NULL);
+    isel_bench_emit("LOAD", "m", "-1", NULL);
+    isel_bench_emit("LOAD", "z", "0", NULL);
+    isel_bench_emit("LOAD", "big", "-9223372036854775808", NULL);
+    isel_bench_emit("LABEL", "runtime", NULL, NULL);
+    isel_bench_emit("DIV", "q", "big", "m");
+    isel_bench_emit("PRINT", "q", NULL, NULL);
+    isel_bench_emit("MOD", "r", "big", "m");
+    isel_bench_emit("PRINT", "r", NULL, NULL);
+    isel_bench_emit("DIV", "q", "x", "m");
+    isel_bench_emit("PRINT", "q", NULL, NULL);
+    isel_bench_emit("MOD", "r", "x", "z");
+    isel_bench_emit("PRINT", "r", NULL, NULL);
+    isel_bench_emit("HALT", NULL, NULL, NULL);
+    return isel_bench_check("divmod by folded constants, -1 and 0", "-14\n-2\n-9223372036854775808\n0\n100\n0\n");
+}
+
+// Builds, links and runs one loop program naively, with selection/allocation, and scheduled too.
+int isel_bench(int n) {
+    if (isel_bench_divmod() != 0) return 1;
+    char count[32];
+    snprintf(count, sizeof(count), "%d", n);
+    // acc += base + i*8 + 16, minus one when i % 4 == 0
+    ir_reset();
+    isel_bench_emit("LOAD", "i", count, NULL);
+    isel_bench_emit("LOAD", "acc", "0", NULL);
+    isel_bench_emit("LOAD", "base", "1000", NULL);
+    isel_bench_emit("LABEL", "loop", NULL, NULL);
+    isel_bench_emit("IFZ", "i", "done", NULL);
+    isel_bench_emit("MUL", "t1", "i", "8");
+    isel_bench_emit("ADD", "t2", "base", "t1");
+    isel_bench_emit("ADD", "t3", "t2", "16");
+    isel_bench_emit("ADD", "acc", "acc", "t3");
+    isel_bench_emit("MOD", "t4", "i", "4");
+    isel_bench_emit("CMP_EQ", "t5", "t4", "0");
+    isel_bench_emit("IFZ", "t5", "skip", NULL);
+    isel_bench_emit("SUB", "acc", "acc", "1");
+    isel_bench_emit("LABEL", "skip", NULL, NULL);
+    isel_bench_emit("SUB", "i", "i", "1");
+    isel_bench_emit("JMP", "loop", NULL, NULL);
+    isel_bench_emit("LABEL", "done", NULL, NULL);
+    isel_bench_emit("PRINT", "acc", NULL, NULL);
+    isel_bench_emit("HALT", NULL, NULL, NULL);
+
+    long long expect = 0;
+    for (long long i = n; i; i--) expect += 1000 + i * 8 + 16 - (i % 4 == 0);
+    printf("[ISEL-BENCH] %d iterations, %d IR ops, expected %lld\n", n, ir_count, expect);
+    double ms[3] = { 0, 0, 0 };
+    int bad = 0;
+    for (int mode = 0; mode < 3; mode++) {
+        const char* asm_path = "rexion_isel_bench.asm";
+        const char* exe_path = "./rexion_isel_bench.exe";
+        isel_fold_enabled = isel_regs_enabled = mode > 0;
+        isel_sched_enabled = mode > 1;
+        int rc = isel_write_asm(asm_path);
+        isel_fold_enabled = isel_regs_enabled = isel_sched_enabled = 1;
+        if (rc != 0 || rlink_link_files(&asm_path, 1, exe_path) != 0) return 1;
+        double t0 = isel_now_ms();
+        FILE* p = popen(exe_path, "r");
+        long long got = 0;
+        if (!p || fscanf(p, "%lld", &got) != 1) got = expect + 1;
+        if (p) pclose(p);
+        ms[mode] = isel_now_ms() - t0;
+        printf("[ISEL-BENCH] %-5s run %10.1f ms  %s", isel_bench_modes[mode], ms[mode], got == expect ? "ok" : "WRONG");
+        if (mode) printf("  (%.2fx vs naive)", ms[mode] > 0 ? ms[0] / ms[mode] : 0.0);
+        printf("\n");
+        bad |= got != expect;
+        remove(asm_path);
+        remove(exe_path);
+    }
+    return bad;
+}
+// rexion_asm.c – Rexion built-in assembler (NASM subset -> x64_encoder.c -> object sections)
+// DOC: Replaces system("nasm -felf64 ...") for the instructions and directives the backend emits
+// DOC: Source lines become RasmItems whose operands stay symbolic; layout runs in passes until
+// DOC: label offsets settle, growing short jumps to near ones only when they do not reach
+// DOC: Encodings follow nasm -Ox: shortest immediate/displacement forms, short jumps where possible
+// DOC: Backends can also build a RasmModule directly (rasm_section/rasm_label/rasm_inst) and skip text
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+#define RASM_MAX_SECTIONS 16
+#define RASM_EXPR_TERMS 4
+#define RASM_MAX_PASSES 64
+
+// value = k + sum(coef[i] * symbol[i])
+typedef struct {
+    int64_t k;
+    int nterms;
+    int sym[RASM_EXPR_TERMS];
+    int8_t coef[RASM_EXPR_TERMS];
+} RasmExpr;
+
+typedef struct {
+    X64Operand x;           // kind/size/registers; imm/label are filled from expr when encoding
+    RasmExpr expr;          // IMM value, MEM displacement or branch target
+    uint8_t rel;            // MEM: [rel ...]
+} RasmOperand;
+
+typedef enum { RASM_INST, RASM_DATA, RASM_LABEL, RASM_ALIGN, RASM_RESERVE } RasmItemKind;
+
+#define RASM_NEAR 2         // RasmItem.flags: branch form pinned by `near` (X64_SHORT = 1 pins short)
+#define RASM_FIXED 4        // RasmItem.flags: form chosen explicitly, never relaxed
+
+typedef struct {
+    uint8_t kind;           // RasmItemKind
+    uint8_t section;
+    uint8_t width;          // DATA: width of a symbolic value (expr), 0 for plain bytes
+    uint8_t flags;          // INST: X64_SHORT / RASM_NEAR / RASM_FIXED
+    uint16_t op;            // INST: X64Op
+    uint8_t cond;
+    uint8_t nops;
+    int line;
+    int sym;                // LABEL: symbol
+    int64_t value;          // ALIGN: boundary, RESERVE: bytes
+    uint32_t data_off, data_len;    // DATA: plain bytes in the module pool
+    int64_t offset;         // section offset from the last layout pass
+    uint32_t size;          // bytes from the last layout pass
+    RasmOperand o[3];       // INST operands; DATA: o[0].expr is the symbolic value
+} RasmItem;
+
+typedef struct {
+    uint32_t offset;
+    int sym;
+    uint8_t kind;           // X64FixupKind
+    uint8_t branch;         // call/jmp target (PLT-style reference for externals)
+    int64_t addend;         // X64Fixup addend: REL value = S + addend - (P + width)
+} RasmReloc;
+
+typedef struct {
+    char name[32];
+    uint8_t nobits;         // .bss: size only
+    uint8_t exec, write, alloc;
+    int align;
+    int64_t size;
+    X64Asm out;             // encoded bytes after rasm_assemble()
+    RasmReloc* relocs;
+    int nrelocs, reloc_cap;
+} RasmSection;
+
+typedef struct {
+    char* name;
+    int section;            // defining section, -1 while undefined / external
+    int64_t value;          // section offset
+    RasmExpr equ;
+    uint8_t is_equ, global, external, internal, defined;
+    int line;
+} RasmSymbol;
+
+typedef struct {
+    RasmSection sec[RASM_MAX_SECTIONS];
+    int nsec, cur;
+    RasmSymbol* syms;
+    int nsyms, sym_cap;
+    int* hash;              // symbol index + 1, open addressing
+    int hash_cap;
+    RasmItem* items;
+    int nitems, item_cap;
+    uint8_t* pool;
+    size_t pool_len, pool_cap;
+    char scope[128];        // last non-local label, prefix for .local labels
+    const char* file;
+    int line;
+    int default_rel;
+    int final;              // encoding pass: unresolved symbols are errors
+    int errors;
+} RasmModule;
+
+static void rasm_error(RasmModule* M, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "%s:%d: error: ", M->file ? M->file : "<asm>", M->line);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    M->errors++;
+}
+
+// === Symbols ===
+
+static unsigned rasm_hash_name(const char* s) {
+    unsigned h = 2166136261u;
+    while (*s) h = (h ^ (uint8_t)*s++) * 16777619u;
+    return h;
+}
+
+int rasm_symbol(RasmModule* M, const char* name) {
+    if (M->nsyms * 2 >= M->hash_cap) {
+        M->hash_cap = M->hash_cap ? M->hash_cap * 2 : 256;
+        free(M->hash);
+        M->hash = calloc((size_t)M->hash_cap, sizeof(int));
+        if (!M->hash) { perror("rasm_symbol"); exit(1); }
+        for (int i = 0; i < M->nsyms; i++) {
+            unsigned h = rasm_hash_name(M->syms[i].name) & (unsigned)(M->hash_cap - 1);
+            while (M->hash[h]) h = (h + 1) & (unsigned)(M->hash_cap - 1);
+            M->hash[h] = i + 1;
+        }
+    }
+    unsigned h = rasm_hash_name(name) & (unsigned)(M->hash_cap - 1);
+    while (M->hash[h]) {
+        if (strcmp(M->syms[M->hash[h] - 1].name, name) == 0) return M->hash[h] - 1;
+        h = (h + 1) & (unsigned)(M->hash_cap - 1);
+    }
+    if (M->nsyms == M->sym_cap) {
+        M->sym_cap = M->sym_cap ? M->sym_cap * 2 : 128;
+        M->syms = realloc(M->syms, (size_t)M->sym_cap * sizeof(RasmSymbol));
+        if (!M->syms) { perror("rasm_symbol"); exit(1); }
+    }
+    RasmSymbol* s = &M->syms[M->nsyms];
+    memset(s, 0, sizeof(*s));
+    s->name = strdup(name);
+    s->section = -1;
+    s->line = M->line;
+    M->hash[h] = M->nsyms + 1;
+    return M->nsyms++;
+}
+
+// Looks a symbol up without creating it; -1 when the module never mentions `name`.
+int rasm_find(RasmModule* M, const char* name) {
+    if (!M->hash_cap) return -1;
+    unsigned h = rasm_hash_name(name) & (unsigned)(M->hash_cap - 1);
+    while (M->hash[h]) {
+        if (strcmp(M->syms[M->hash[h] - 1].name, name) == 0) return M->hash[h] - 1;
+        h = (h + 1) & (unsigned)(M->hash_cap - 1);
+    }
+    return -1;
+}
+
+// Anonymous symbol for `$`, `$$` and generated labels; never written to the object.
+static int rasm_internal_symbol(RasmModule* M) {
+    char name[32];
+    snprintf(name, sizeof(name), "..@%d", M->nsyms);
+    int s = rasm_symbol(M, name);
+    M->syms[s].internal = 1;
+    return s;
+}
+
+// === Items ===
+
+static RasmItem* rasm_item(RasmModule* M, RasmItemKind kind) {
+    if (M->nitems == M->item_cap) {
+        M->item_cap = M->item_cap ? M->item_cap * 2 : 1024;
+        M->items = realloc(M->items, (size_t)M->item_cap * sizeof(RasmItem));
+        if (!M->items) { perror("rasm_item"); exit(1); }
+    }
+    RasmItem* it = &M->items[M->nitems++];
+    memset(it, 0, sizeof(*it));
+    it->kind = (uint8_t)kind;
+    it->section = (uint8_t)M->cur;
+    it->line = M->line;
+    it->sym = -1;
+    return it;
+}
+
+static void rasm_pool_reserve(RasmModule* M, size_t n) {
+    if (M->pool_len + n <= M->pool_cap) return;
+    while (M->pool_len + n > M->pool_cap) M->pool_cap = M->pool_cap ? M->pool_cap * 2 : 4096;
+    M->pool = realloc(M->pool, M->pool_cap);
+    if (!M->pool) { perror("rasm_pool"); exit(1); }
+}
+
+// Appends plain bytes, extending the previous data item when it ends the pool.
+void rasm_data(RasmModule* M, const void* bytes, size_t n) {
+    RasmItem* last = M->nitems ? &M->items[M->nitems - 1] : NULL;
+    rasm_pool_reserve(M, n);
+    memcpy(M->pool + M->pool_len, bytes, n);
+    if (last && last->kind == RASM_DATA && !last->width && last->section == M->cur &&
+        last->data_off + last->data_len == M->pool_len) {
+        last->data_len += (uint32_t)n;
+    } else {
+        RasmItem* it = rasm_item(M, RASM_DATA);
+        it->data_off = (uint32_t)M->pool_len;
+        it->data_len = (uint32_t)n;
+    }
+    M->pool_len += n;
+}
+
+int rasm_section(RasmModule* M, const char* name) {
+    for (int i = 0; i < M->nsec; i++)
+        if (strcmp(M->sec[i].name, name) == 0) return M->cur = i;
+    if (M->nsec == RASM_MAX_SECTIONS) { rasm_error(M, "too many sections"); return M->cur; }
+    RasmSection* s = &M->sec[M->nsec];
+    memset(s, 0, sizeof(*s));
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    // nasm's elf64 defaults
+    s->alloc = 1;
+    s->align = 1;
+    if (strcmp(name, ".text") == 0) { s->exec = 1; s->align = 16; }
+    else if (strcmp(name, ".data") == 0) { s->write = 1; s->align = 4; }
+    else if (strcmp(name, ".rodata") == 0) { s->align = 4; }
+    else if (strcmp(name, ".bss") == 0) { s->write = 1; s->nobits = 1; s->align = 4; }
+    else s->alloc = 0;
+    return M->cur = M->nsec++;
+}
+
+void rasm_label(RasmModule* M, int sym) {
+    RasmSymbol* s = &M->syms[sym];
+    if (s->defined) { rasm_error(M, "symbol `%s' redefined", s->name); return; }
+    s->defined = 1;
+    s->section = M->cur;
+    RasmItem* it = rasm_item(M, RASM_LABEL);
+    it->sym = sym;
+}
+
+// Adds a machine instruction; symbolic operands use label = symbol, imm = addend.
+void rasm_inst(RasmModule* M, const X64Inst* in) {
+    RasmItem* it = rasm_item(M, RASM_INST);
+    it->op = in->op;
+    it->cond = in->cond;
+    it->nops = in->nops;
+    it->flags = in->flags & X64_SHORT ? (X64_SHORT | RASM_FIXED) : 0;
+    for (int i = 0; i < in->nops; i++) {
+        RasmOperand* o = &it->o[i];
+        o->x = in->o[i];
+        o->expr.k = in->o[i].imm;
+        if (in->o[i].label >= 0) {
+            o->expr.nterms = 1;
+            o->expr.sym[0] = in->o[i].label;
+            o->expr.coef[0] = 1;
+        }
+        if (o->x.kind == X64_MEM && o->x.reg == X64_RIP) { o->rel = 1; o->x.reg = X64_NOREG; }
+    }
+}
+
+RasmModule* rasm_new(const char* file) {
+    RasmModule* M = calloc(1, sizeof(RasmModule));
+    if (!M) { perror("rasm_new"); exit(1); }
+    M->file = file;
+    rasm_section(M, ".text");
+    return M;
+}
+
+void rasm_free(RasmModule* M) {
+    if (!M) return;
+    for (int i = 0; i < M->nsec; i++) { x64_free(&M->sec[i].out); free(M->sec[i].relocs); }
+    for (int i = 0; i < M->nsyms; i++) free(M->syms[i].name);
+    free(M->syms); free(M->hash); free(M->items); free(M->pool);
+    free(M);
+}
+
+// === Expressions ===
+
+static void rasm_expr_add(RasmModule* M, RasmExpr* e, int sym, int coef) {
+    for (int i = 0; i < e->nterms; i++) {
+        if (e->sym[i] != sym) continue;
+        e->coef[i] = (int8_t)(e->coef[i] + coef);
+        if (!e->coef[i]) {
+            e->nterms--;
+            e->sym[i] = e->sym[e->nterms];
+            e->coef[i] = e->coef[e->nterms];
+        }
+        return;
+    }
+    if (e->nterms == RASM_EXPR_TERMS) { rasm_error(M, "expression has too many symbols"); return; }
+    e->sym[e->nterms] = sym;
+    e->coef[e->nterms++] = (int8_t)coef;
+}
+
+static void rasm_expr_combine(RasmModule* M, RasmExpr* a, const RasmExpr* b, int sign) {
+    a->k += sign * b->k;
+    for (int i = 0; i < b->nterms; i++) rasm_expr_add(M, a, b->sym[i], sign * b->coef[i]);
+}
+
+static int rasm_ident_start(int c) { return isalpha(c) || c == '_' || c == '.' || c == '?' || c == '@'; }
+static int rasm_ident_char(int c) { return isalnum(c) || c == '_' || c == '.' || c == '?' || c == '@' || c == '$' || c == '#' || c == '~'; }
+
+static const char* rasm_skip(const char* p) {
+    while (*p == ' ' || *p == '\t') p++;
+    return p;
+}
+
+// Register name -> number and size in bytes (16 = xmm, 10 = x87 st).
+static int rasm_register(const char* name, size_t len, int* reg, int* size) {
+    char buf[8];
+    if (len == 0 || len >= sizeof(buf)) return 0;
+    for (size_t i = 0; i < len; i++) buf[i] = (char)tolower((unsigned char)name[i]);
+    buf[len] = 0;
+    static const int sizes[4] = { 1, 2, 4, 8 };
+    for (int row = 0; row < 4; row++)
+        for (int r = 0; r < 16; r++)
+            if (strcmp(buf, x64_reg_names[row][r]) == 0) { *reg = r; *size = sizes[row]; return 1; }
+    if (len >= 3 && buf[0] == 'r' && buf[len - 1] == 'l') {
+        // r8l..r15l spell the low bytes too
+        int n = atoi(buf + 1);
+        if (n >= 8 && n <= 15) { *reg = n; *size = 1; return 1; }
+    }
+    if (strncmp(buf, "xmm", 3) == 0 && isdigit((unsigned char)buf[3])) {
+        int n = atoi(buf + 3);
+        if (n <= 15) { *reg = n; *size = 16; return 1; }
+    }
+    if (strncmp(buf, "st", 2) == 0 && (len == 3 && isdigit((unsigned char)buf[2]) && buf[2] < '8')) {
+        *reg = buf[2] - '0'; *size = 10; return 1;
+    }
+    return 0;
+}
+
+static int rasm_size_keyword(const char* p, size_t len) {
+    static const struct { const char* kw; int size; } kws[] = {
+        { "byte", 1 }, { "word", 2 }, { "dword", 4 }, { "qword", 8 }, { "tword", 10 }, { "tbyte", 10 },
+    };
+    for (size_t i = 0; i < sizeof(kws) / sizeof(kws[0]); i++)
+        if (strlen(kws[i].kw) == len && strncasecmp(p, kws[i].kw, len) == 0) return kws[i].size;
+    return 0;
+}
+
+// NASM numbers: 123, 0x7F, 7Fh, 0b101, 101b, 0o17, 17q/17o
+static int rasm_number(RasmModule* M, const char** pp, int64_t* out) {
+    const char* p = *pp;
+    const char* e = p;
+    while (isalnum((unsigned char)*e) || *e == '_') e++;
+    size_t len = (size_t)(e - p);
+    char buf[80];
+    size_t n = 0;
+    for (size_t i = 0; i < len && n + 1 < sizeof(buf); i++) if (p[i] != '_') buf[n++] = p[i];
+    buf[n] = 0;
+    int base = 10;
+    char* digits = buf;
+    char last = n ? (char)tolower((unsigned char)buf[n - 1]) : 0;
+    if (n > 2 && buf[0] == '0' && (buf[1] == 'x' || buf[1] == 'X')) { base = 16; digits = buf + 2; }
+    else if (n > 2 && buf[0] == '0' && (buf[1] == 'b' || buf[1] == 'B') && !(last == 'h')) { base = 2; digits = buf + 2; }
+    else if (n > 2 && buf[0] == '0' && (buf[1] == 'o' || buf[1] == 'O' || buf[1] == 'q' || buf[1] == 'Q')) { base = 8; digits = buf + 2; }
+    else if (last == 'h') { base = 16; buf[n - 1] = 0; }
+    else if (last == 'b' && n > 1) { base = 2; buf[n - 1] = 0; }
+    else if ((last == 'q' || last == 'o') && n > 1) { base = 8; buf[n - 1] = 0; }
+    char* end;
+    uint64_t v = strtoull(digits, &end, base);
+    if (*end || end == digits) { rasm_error(M, "invalid number `%.*s'", (int)len, p); v = 0; }
+    *out = (int64_t)v;
+    *pp = e;
+    return 1;
+}
+
+// Quoted string/character constant: '...' and "..." are literal, `...` takes C escapes.
+static int rasm_string(RasmModule* M, const char** pp, char* out, size_t cap, size_t* len) {
+    const char* p = *pp;
+    char q = *p++;
+    size_t n = 0;
+    while (*p && *p != q) {
+        int c = (unsigned char)*p++;
+        if (q == '`' && c == '\\' && *p) {
+            c = (unsigned char)*p++;
+            switch (c) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case '0': c = 0; break;
+                case 'e': c = 27; break;
+                case 'x': {
+                    int v = 0, k = 0;
+                    while (k < 2 && isxdigit((unsigned char)*p)) {
+                        v = v * 16 + (isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10));
+                        p++; k++;
+                    }
+                    c = v;
+                    break;
+                }
+                default: break;     // \\ \' \" \` stand for themselves
+            }
+        }
+        if (n < cap) out[n] = (char)c;
+        n++;
+    }
+    if (*p != q) { rasm_error(M, "unterminated string"); *pp = p; *len = 0; return 0; }
+    *pp = p + 1;
+    *len = n < cap ? n : cap;
+    return 1;
+}
+
+static void rasm_expr_sum(RasmModule* M, const char** pp, RasmExpr* e);
+
+static void rasm_expr_factor(RasmModule* M, const char** pp, RasmExpr* e) {
+    const char* p = rasm_skip(*pp);
+    memset(e, 0, sizeof(*e));
+    if (*p == '-' || *p == '+' || *p == '~') {
+        char unary = *p;
+        p++;
+        rasm_expr_factor(M, &p, e);
+        if (unary == '-') {
+            e->k = -e->k;
+            for (int i = 0; i < e->nterms; i++) e->coef[i] = (int8_t)-e->coef[i];
+        } else if (unary == '~') {
+            if (e->nterms) rasm_error(M, "`~' needs a constant");
+            e->k = ~e->k;
+        }
+    } else if (*p == '(') {
+        p++;
+        rasm_expr_sum(M, &p, e);
+        p = rasm_skip(p);
+        if (*p == ')') p++;
+        else rasm_error(M, "expected `)'");
+    } else if (isdigit((unsigned char)*p)) {
+        rasm_number(M, &p, &e->k);
+    } else if (*p == '\'' || *p == '"' || *p == '`') {
+        char buf[8];
+        size_t n;
+        rasm_string(M, &p, buf, sizeof(buf), &n);
+        for (size_t i = 0; i < n; i++) e->k |= (int64_t)(uint8_t)buf[i] << (8 * i);
+    } else if (p[0] == '$' && p[1] == '$') {
+        // start of the current section
+        int s = rasm_internal_symbol(M);
+        M->syms[s].defined = 1;
+        M->syms[s].section = M->cur;
+        M->syms[s].value = 0;
+        rasm_expr_add(M, e, s, 1);
+        p += 2;
+    } else if (p[0] == '$' && !rasm_ident_char((unsigned char)p[1])) {
+        // start of the current line: an internal label at this position
+        int s = rasm_internal_symbol(M);
+        rasm_label(M, s);
+        rasm_expr_add(M, e, s, 1);
+        p++;
+    } else if (rasm_ident_start((unsigned char)*p) || *p == '$') {
+        if (*p == '$') p++;     // $name escapes a reserved word
+        const char* s = p;
+        while (rasm_ident_char((unsigned char)*p)) p++;
+        int reg, size;
+        if (rasm_register(s, (size_t)(p - s), &reg, &size) || rasm_size_keyword(s, (size_t)(p - s))) {
+            rasm_error(M, "invalid operand `%.*s' in expression", (int)(p - s), s);
+        } else {
+            char name[256];
+            if (*s == '.' && s[1] != '.') snprintf(name, sizeof(name), "%s%.*s", M->scope, (int)(p - s), s);
+            else snprintf(name, sizeof(name), "%.*s", (int)(p - s), s);
+            rasm_expr_add(M, e, rasm_symbol(M, name), 1);
+        }
+    } else {
+        rasm_error(M, "expression syntax error near `%s'", p);
+        p += *p != 0;
+    }
+    *pp = p;
+}
+
+static void rasm_expr_term(RasmModule* M, const char** pp, RasmExpr* e) {
+    rasm_expr_factor(M, pp, e);
+    for (;;) {
+        const char* p = rasm_skip(*pp);
+        char op = *p;
+        if (op == '/' && p[1] == '/') { p++; }      // signed division `//`
+        if (op != '*' && op != '/' && op != '%') break;
+        p++;
+        RasmExpr r;
+        rasm_expr_factor(M, &p, &r);
+        *pp = p;
+        if (op == '*' && (!e->nterms || !r.nterms)) {
+            // k * (sym + c) keeps a symbol only when k is 1
+            RasmExpr* c = e->nterms ? &r : e;
+            RasmExpr* v = e->nterms ? e : &r;
+            if (v->nterms && c->k != 1) { rasm_error(M, "symbol multiplied by a constant"); continue; }
+            RasmExpr out = *v;
+            out.k = v->k * c->k;
+            *e = out;
+        } else if (!e->nterms && !r.nterms) {
+            if (!r.k) { rasm_error(M, "division by zero"); continue; }
+            e->k = op == '%' ? e->k % r.k : e->k / r.k;
+        } else {
+            rasm_error(M, "`%c' needs constant operands", op);
+        }
+    }
+}
+
+static void rasm_expr_sum(RasmModule* M, const char** pp, RasmExpr* e) {
+    rasm_expr_term(M, pp, e);
+    for (;;) {
+        const char* p = rasm_skip(*pp);
+        if (*p != '+' && *p != '-') break;
+        int sign = *p == '-' ? -1 : 1;
+        p++;
+        RasmExpr r;
+        rasm_expr_term(M, &p, &r);
+        *pp = p;
+        rasm_expr_combine(M, e, &r, sign);
+    }
+}
+
+// Parses a whole expression from [p, end); trailing text is an error.
+static int rasm_expr_text(RasmModule* M, const char* p, const char* end, RasmExpr* e) {
+    char buf[512];
+    size_t n = (size_t)(end - p);
+    if (n >= sizeof(buf)) { rasm_error(M, "expression too long"); return 0; }
+    memcpy(buf, p, n);
+    buf[n] = 0;
+    const char* q = buf;
+    int before = M->errors;
+    rasm_expr_sum(M, &q, e);
+    q = rasm_skip(q);
+    if (*q) rasm_error(M, "unexpected `%s' in expression", q);
+    return M->errors == before;
+}
+
+// Resolves an expression against the current layout: *sym = -1 for an absolute value,
+// otherwise value = address(*sym) + *k. Same-section differences cancel.
+static int rasm_eval(RasmModule* M, const RasmExpr* e, int64_t* k, int* sym, int depth) {
+    int sec_coef[RASM_MAX_SECTIONS] = { 0 };
+    int rep[RASM_MAX_SECTIONS];
+    int ext = -1, ext_coef = 0;
+    int64_t v = e->k;
+    for (int i = 0; i < RASM_MAX_SECTIONS; i++) rep[i] = -1;
+    *sym = -1;
+    for (int i = 0; i < e->nterms; i++) {
+        RasmSymbol* s = &M->syms[e->sym[i]];
+        int c = e->coef[i];
+        if (s->is_equ) {
+            if (depth > 32) { rasm_error(M, "recursive equ `%s'", s->name); return -1; }
+            int64_t ek;
+            int es;
+            if (rasm_eval(M, &s->equ, &ek, &es, depth + 1) != 0) return -1;
+            v += c * ek;
+            if (es >= 0) {
+                RasmSymbol* t = &M->syms[es];
+                if (t->section >= 0 && t->defined) {
+                    v += c * t->value;
+                    sec_coef[t->section] += c;
+                    if (c > 0) rep[t->section] = es;
+                } else {
+                    if (ext >= 0 && ext != es) { rasm_error(M, "expression references two external symbols"); return -1; }
+                    ext = es; ext_coef += c;
+                }
+            }
+        } else if (s->defined && s->section >= 0) {
+            v += c * s->value;
+            sec_coef[s->section] += c;
+            if (c > 0) rep[s->section] = e->sym[i];
+        } else {
+            if (M->final && !s->external) { rasm_error(M, "symbol `%s' not defined", s->name); return -1; }
+            if (ext >= 0 && ext != e->sym[i]) { rasm_error(M, "expression references two external symbols"); return -1; }
+            ext = e->sym[i];
+            ext_coef += c;
+        }
+    }
+    int relative = -1;
+    for (int i = 0; i < RASM_MAX_SECTIONS; i++) {
+        if (!sec_coef[i]) continue;
+        if (sec_coef[i] != 1 || relative >= 0 || rep[i] < 0) { rasm_error(M, "expression is not relocatable"); return -1; }
+        relative = i;
+    }
+    if (ext_coef && (ext_coef != 1 || relative >= 0)) { rasm_error(M, "expression is not relocatable"); return -1; }
+    if (ext_coef) *sym = ext;
+    else if (relative >= 0) { *sym = rep[relative]; v -= M->syms[*sym].value; }
+    *k = v;
+    return 0;
+}
+
+// === Operands ===
+
+static void rasm_mem_term(RasmModule* M, const char* p, const char* end, int sign, RasmOperand* o) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    const char* star = memchr(p, '*', (size_t)(end - p));
+    int reg, size;
+    if (!star && rasm_register(p, (size_t)(end - p), &reg, &size) && size == 8) {
+        if (sign < 0) { rasm_error(M, "register subtracted in address"); return; }
+        if (o->x.reg == X64_NOREG) o->x.reg = (int8_t)reg;
+        else if (o->x.index == X64_NOREG) o->x.index = (int8_t)reg;
+        else rasm_error(M, "too many registers in address");
+        return;
+    }
+    if (star) {
+        const char* a = p, *ae = star, *b = star + 1, *be = end;
+        while (ae > a && (ae[-1] == ' ' || ae[-1] == '\t')) ae--;
+        while (b < be && (*b == ' ' || *b == '\t')) b++;
+        int r;
+        RasmExpr scale;
+        int found = 0;
+        if (rasm_register(a, (size_t)(ae - a), &reg, &size) && size == 8) { found = rasm_expr_text(M, b, be, &scale); r = reg; }
+        else if (rasm_register(b, (size_t)(be - b), &reg, &size) && size == 8) { found = rasm_expr_text(M, a, ae, &scale); r = reg; }
+        if (found) {
+            if (sign < 0 || scale.nterms || (scale.k != 1 && scale.k != 2 && scale.k != 4 && scale.k != 8)) {
+                rasm_error(M, "invalid index scale");
+                return;
+            }
+            if (o->x.index != X64_NOREG) { rasm_error(M, "two index registers in address"); return; }
+            o->x.index = (int8_t)r;
+            o->x.scale = (uint8_t)scale.k;
+            return;
+        }
+    }
+    RasmExpr e;
+    if (rasm_expr_text(M, p, end, &e)) rasm_expr_combine(M, &o->expr, &e, sign);
+}
+
+// Parses one operand; *branch_form gets X64_SHORT / RASM_NEAR from `short`/`near`.
+static int rasm_operand(RasmModule* M, const char* p, const char* end, RasmOperand* o, int* branch_form) {
+    memset(o, 0, sizeof(*o));
+    o->x.reg = X64_NOREG;
+    o->x.index = X64_NOREG;
+    o->x.scale = 1;
+    o->x.label = -1;
+    for (;;) {
+        p = rasm_skip(p);
+        const char* w = p;
+        while (p < end && isalpha((unsigned char)*p)) p++;
+        size_t len = (size_t)(p - w);
+        if (p < end && rasm_ident_char((unsigned char)*p)) { p = w; break; }
+        int size = rasm_size_keyword(w, len);
+        if (size) { o->x.size = (uint8_t)size; continue; }
+        if (len == 5 && strncasecmp(w, "short", 5) == 0) { *branch_form = X64_SHORT; continue; }
+        if (len == 4 && strncasecmp(w, "near", 4) == 0) { *branch_form = RASM_NEAR; continue; }
+        if (len == 6 && strncasecmp(w, "strict", 6) == 0) continue;
+        p = w;
+        break;
+    }
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    if (p == end) { rasm_error(M, "missing operand"); return -1; }
+
+    if (*p == '[') {
+        if (end[-1] != ']') { rasm_error(M, "expected `]'"); return -1; }
+        o->x.kind = X64_MEM;
+        p++;
+        end--;
+        p = rasm_skip(p);
+        if (end - p > 4 && strncasecmp(p, "rel", 3) == 0 && (p[3] == ' ' || p[3] == '\t')) { o->rel = 1; p += 4; }
+        else if (end - p > 4 && strncasecmp(p, "abs", 3) == 0 && (p[3] == ' ' || p[3] == '\t')) { o->rel = 2; p += 4; }
+        // split on top-level + / -
+        int depth = 0, sign = 1;
+        const char* t = p;
+        for (const char* q = p; q <= end; q++) {
+            if (q < end && *q == '(') depth++;
+            else if (q < end && *q == ')') depth--;
+            else if (q < end && (*q == '\'' || *q == '"' || *q == '`')) {
+                char c = *q++;
+                while (q < end && *q != c) q++;
+                continue;
+            }
+            if (q == end || (!depth && (*q == '+' || *q == '-') && q > t)) {
+                const char* s = t;
+                while (s < q && (*s == ' ' || *s == '\t')) s++;
+                if (s < q) rasm_mem_term(M, s, q, sign, o);
+                if (q < end) { sign = *q == '-' ? -1 : 1; t = q + 1; }
+            }
+        }
+        if (o->x.index == X64_NOREG && o->x.reg == X64_RSP) { /* rsp can only be a base */ }
+        else if (o->x.index == X64_RSP) {
+            if (o->x.scale == 1 && o->x.reg != X64_RSP) { int8_t r = o->x.reg; o->x.reg = o->x.index; o->x.index = r; }
+            else rasm_error(M, "rsp cannot be an index register");
+        }
+        return 0;
+    }
+
+    int reg, size;
+    if (rasm_register(p, (size_t)(end - p), &reg, &size)) {
+        o->x.kind = size == 16 ? X64_XMM : size == 10 ? X64_ST : X64_REG;
+        o->x.reg = (int8_t)reg;
+        o->x.size = (uint8_t)size;
+        return 0;
+    }
+    if ((end - p) >= 5 && strncasecmp(p, "st(", 3) == 0 && end[-1] == ')' && isdigit((unsigned char)p[3]) && p[3] < '8') {
+        o->x.kind = X64_ST;
+        o->x.reg = (int8_t)(p[3] - '0');
+        o->x.size = 10;
+        return 0;
+    }
+    if ((end - p) == 2 && strncasecmp(p, "st", 2) == 0) {
+        o->x.kind = X64_ST;
+        o->x.reg = 0;
+        o->x.size = 10;
+        return 0;
+    }
+    o->x.kind = X64_IMM;
+    return rasm_expr_text(M, p, end, &o->expr) ? 0 : -1;
+}
+
+// Mnemonic -> X64Op (+ condition code for jcc/setcc/cmovcc)
+static int rasm_mnemonic(const char* m, int* op, int* cond) {
+    static const struct { const char* name; int cc; } ccs[] = {
+        { "o", X64_CC_O }, { "no", X64_CC_NO }, { "b", X64_CC_B }, { "c", X64_CC_B }, { "nae", X64_CC_B },
+        { "ae", X64_CC_AE }, { "nb", X64_CC_AE }, { "nc", X64_CC_AE }, { "e", X64_CC_E }, { "z", X64_CC_E },
+        { "ne", X64_CC_NE }, { "nz", X64_CC_NE }, { "be", X64_CC_BE }, { "na", X64_CC_BE },
+        { "a", X64_CC_A }, { "nbe", X64_CC_A }, { "s", X64_CC_S }, { "ns", X64_CC_NS },
+        { "p", X64_CC_P }, { "pe", X64_CC_P }, { "np", X64_CC_NP }, { "po", X64_CC_NP },
+        { "l", X64_CC_L }, { "nge", X64_CC_L }, { "ge", X64_CC_GE }, { "nl", X64_CC_GE },
+        { "le", X64_CC_LE }, { "ng", X64_CC_LE }, { "g", X64_CC_G }, { "nle", X64_CC_G },
+    };
+    static const struct { const char* prefix; int op; } cc_ops[] = {
+        { "j", X64_JCC }, { "set", X64_SETCC }, { "cmov", X64_CMOVCC },
+    };
+    char lower[16];
+    size_t n = strlen(m);
+    if (n >= sizeof(lower)) return 0;
+    for (size_t i = 0; i <= n; i++) lower[i] = (char)tolower((unsigned char)m[i]);
+    if (strcmp(lower, "sal") == 0) { *op = X64_SHL; return 1; }
+    for (int i = 0; i < X64_OP_COUNT; i++) {
+        if (i == X64_JCC || i == X64_SETCC || i == X64_CMOVCC) continue;
+        if (strcasecmp(lower, x64_op_names[i]) == 0) { *op = i; return 1; }
+    }
+    for (size_t k = 0; k < sizeof(cc_ops) / sizeof(cc_ops[0]); k++) {
+        size_t pl = strlen(cc_ops[k].prefix);
+        if (strncmp(lower, cc_ops[k].prefix, pl) != 0) continue;
+        for (size_t c = 0; c < sizeof(ccs) / sizeof(ccs[0]); c++)
+            if (strcmp(lower + pl, ccs[c].name) == 0) { *op = cc_ops[k].op; *cond = ccs[c].cc; return 1; }
+    }
+    return 0;
+}
+
+// Splits [p, end) on top-level commas. Returns the number of pieces.
+static int rasm_split(const char* p, const char* end, const char** starts, const char** ends, int max) {
+    int n = 0, depth = 0;
+    const char* s = p;
+    for (const char* q = p; q <= end; q++) {
+        if (q < end && (*q == '\'' || *q == '"' || *q == '`')) {
+            char c = *q++;
+            while (q < end && *q != c) { if (c == '`' && *q == '\\' && q + 1 < end) q++; q++; }
+            continue;
+        }
+        if (q < end && (*q == '(' || *q == '[')) depth++;
+        else if (q < end && (*q == ')' || *q == ']')) depth--;
+        else if (q == end || (*q == ',' && !depth)) {
+            if (n == max) return n + 1;
+            starts[n] = s;
+            ends[n] = q;
+            n++;
+            s = q + 1;
+        }
+    }
+    return n;
+}
+
+
+// Memory operands without an explicit size take it from the register operand, as nasm does.
+static int rasm_infer_size(RasmModule* M, RasmOperand* o, int nops, int op) {
+    int other = 0;
+    for (int i = 0; i < nops; i++) {
+        if (o[i].x.kind == X64_REG) { other = o[i].x.size; break; }
+        if (o[i].x.kind == X64_XMM) { other = 8; break; }
+    }
+    for (int i = 0; i < nops; i++) {
+        if (o[i].x.kind != X64_MEM || o[i].x.size) continue;
+        if (op == X64_LEA) continue;
+        if (op == X64_PUSH || op == X64_POP || op == X64_CALL || op == X64_JMP) { o[i].x.size = 8; continue; }
+        // movzx/movsx/cvtsi2sd sources and shifted operands do not follow the other operand
+        if (other && op != X64_MOVZX && op != X64_MOVSX && op != X64_CVTSI2SD &&
+            op != X64_SHL && op != X64_SHR && op != X64_SAR) { o[i].x.size = (uint8_t)other; continue; }
+        rasm_error(M, "operation size not specified");
+        return -1;
+    }
+    return 0;
+}
+
+static void rasm_instruction(RasmModule* M, int op, int cond, const char* p, const char* end) {
+    const char* s[4], *e[4];
+    RasmOperand o[3];
+    int form = 0;
+    const char* missing = x64_missing_feature(op);
+    if (missing) { rasm_error(M, "%s needs %s, which --march=%s does not have", x64_op_names[op], missing, x64_march); return; }
+    p = rasm_skip(p);
+    int n = p < end ? rasm_split(p, end, s, e, 3) : 0;
+    if (n > 3) { rasm_error(M, "too many operands"); return; }
+    // operands first, so a `$` label lands in front of the instruction
+    for (int i = 0; i < n; i++)
+        if (rasm_operand(M, s[i], e[i], &o[i], &form) != 0) return;
+    if (rasm_infer_size(M, o, n, op) != 0) return;
+    int branch = op == X64_JMP || op == X64_JCC || op == X64_CALL;
+    for (int i = 0; i < n; i++) {
+        if (branch && o[i].x.kind == X64_IMM) o[i].x.kind = X64_LABEL;
+        if (o[i].x.kind == X64_MEM && !o[i].rel && M->default_rel && o[i].x.reg == X64_NOREG &&
+            o[i].x.index == X64_NOREG && o[i].expr.nterms)
+            o[i].rel = 1;
+    }
+    RasmItem* it = rasm_item(M, RASM_INST);
+    it->op = (uint16_t)op;
+    it->cond = (uint8_t)cond;
+    it->nops = (uint8_t)n;
+    memcpy(it->o, o, sizeof(RasmOperand) * (size_t)n);
+    if (form == X64_SHORT) it->flags = X64_SHORT | RASM_FIXED;
+    else if (form == RASM_NEAR || op == X64_CALL) it->flags = RASM_NEAR | RASM_FIXED;
+}
+
+// === Data directives ===
+
+static int rasm_is_float(const char* p, const char* end) {
+    if (p < end && (*p == '-' || *p == '+')) p++;
+    if (p >= end || !isdigit((unsigned char)*p)) return 0;
+    if (end - p > 1 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) return 0;
+    int dot = 0, exp = 0;
+    for (const char* q = p; q < end; q++) {
+        if (*q == '.') dot = 1;
+        else if ((*q == 'e' || *q == 'E') && !memchr(p, 'h', (size_t)(end - p))) exp = 1;
+        else if (!isdigit((unsigned char)*q) && *q != '+' && *q != '-' && *q != '_') return 0;
+    }
+    return dot || exp;
+}
+
+static void rasm_value_bytes(RasmModule* M, int64_t v, int width) {
+    uint8_t b[8];
+    for (int i = 0; i < width; i++) b[i] = (uint8_t)((uint64_t)v >> (8 * i));
+    rasm_data(M, b, (size_t)width);
+}
+
+// db/dw/dd/dq value list; elements may be strings, floats, expressions or `N dup (list)`.
+static void rasm_data_list(RasmModule* M, int width, const char* p, const char* end) {
+    const char* s[256], *e[256];
+    int n = rasm_split(p, end, s, e, 256);
+    if (n > 256) { rasm_error(M, "too many values on one line"); return; }
+    for (int i = 0; i < n; i++) {
+        const char* a = rasm_skip(s[i]);
+        const char* b = e[i];
+        while (b > a && (b[-1] == ' ' || b[-1] == '\t')) b--;
+        if (a == b) { rasm_error(M, "missing value"); continue; }
+
+        // N dup (values)
+        const char* dup = NULL;
+        for (const char* q = a; q + 3 <= b; q++)
+            if (strncasecmp(q, "dup", 3) == 0 && q > a && (q[-1] == ' ' || q[-1] == '\t' || q[-1] == ')') &&
+                (q + 3 == b || q[3] == ' ' || q[3] == '(')) { dup = q; break; }
+        if (dup) {
+            RasmExpr count;
+            const char* open = strchr(dup, '(');
+            if (!open || open > b || b[-1] != ')' || !rasm_expr_text(M, a, dup, &count)) { rasm_error(M, "invalid dup"); continue; }
+            if (count.nterms || count.k < 0) { rasm_error(M, "dup count must be a non-negative constant"); continue; }
+            size_t before = M->pool_len;
+            int first = M->nitems;
+            rasm_data_list(M, width, open + 1, b - 1);
+            RasmItem* last = M->nitems ? &M->items[M->nitems - 1] : NULL;
+            if (M->nitems <= first + 1 && last && last->kind == RASM_DATA && !last->width &&
+                last->data_off + last->data_len == M->pool_len && M->pool_len - before <= last->data_len) {
+                // plain bytes: repeat them in place
+                size_t unit = M->pool_len - before;
+                if (!count.k) { last->data_len -= (uint32_t)unit; M->pool_len = before; continue; }
+                rasm_pool_reserve(M, unit * (size_t)(count.k - 1));
+                for (int64_t r = 1; r < count.k; r++) memcpy(M->pool + before + unit * (size_t)r, M->pool + before, unit);
+                M->pool_len += unit * (size_t)(count.k - 1);
+                last->data_len += (uint32_t)(unit * (size_t)(count.k - 1));
+            } else {
+                int added = M->nitems - first;
+                for (int64_t r = 1; r < count.k; r++)
+                    for (int k = 0; k < added; k++) {
+                    RasmItem copy = M->items[first + k];
+                    *rasm_item(M, RASM_DATA) = copy;
+                }
+            }
+            continue;
+        }
+        if (*a == '\'' || *a == '"' || *a == '`') {
+            char buf[1024];
+            size_t len;
+            const char* q = a;
+            if (rasm_string(M, &q, buf, sizeof(buf), &len) && rasm_skip(q) == b) {
+                rasm_data(M, buf, len);
+                // strings in dw/dd/dq are zero-padded to the unit
+                size_t pad = (size_t)((width - (int)(len % (size_t)width)) % width);
+                static const uint8_t zeros[8];
+                if (pad) rasm_data(M, zeros, pad);
+                continue;
+            }
+        }
+        if ((width == 4 || width == 8) && rasm_is_float(a, b)) {
+            char buf[128];
+            size_t n2 = 0;
+            for (const char* q = a; q < b && n2 + 1 < sizeof(buf); q++) if (*q != '_') buf[n2++] = *q;
+            buf[n2] = 0;
+            double d = strtod(buf, NULL);
+            if (width == 8) rasm_data(M, &d, 8);
+            else { float f = (float)d; rasm_data(M, &f, 4); }
+            continue;
+        }
+        RasmExpr x;
+        if (!rasm_expr_text(M, a, b, &x)) continue;
+        if (!x.nterms) { rasm_value_bytes(M, x.k, width); continue; }
+        RasmItem* it = rasm_item(M, RASM_DATA);
+        it->width = (uint8_t)width;
+        it->o[0].expr = x;
+    }
+}
+
+static int rasm_data_width(const char* w, size_t len, int* reserve) {
+    static const char* names[] = { "db", "dw", "dd", "dq", "resb", "resw", "resd", "resq" };
+    static const int widths[] = { 1, 2, 4, 8 };
+    for (int i = 0; i < 8; i++)
+        if (strlen(names[i]) == len && strncasecmp(w, names[i], len) == 0) {
+            *reserve = i >= 4;
+            return widths[i & 3];
+        }
+    return 0;
+}
+
+// === Lines ===
+
+static void rasm_define_label(RasmModule* M, const char* name, size_t len) {
+    char full[256];
+    if (*name == '.' && !(len > 1 && name[1] == '.')) snprintf(full, sizeof(full), "%s%.*s", M->scope, (int)len, name);
+    else {
+        snprintf(full, sizeof(full), "%.*s", (int)len, name);
+        if (*name != '.') snprintf(M->scope, sizeof(M->scope), "%.*s", (int)len, name);
+    }
+    rasm_label(M, rasm_symbol(M, full));
+}
+
+static void rasm_statement(RasmModule* M, const char* p, const char* end);
+
+static void rasm_directive_names(RasmModule* M, const char* p, const char* end, int global) {
+    const char* s[64], *e[64];
+    int n = rasm_split(p, end, s, e, 64);
+    for (int i = 0; i < n && i < 64; i++) {
+        const char* a = rasm_skip(s[i]);
+        const char* b = a;
+        while (b < e[i] && rasm_ident_char((unsigned char)*b)) b++;     // drops `:function` etc.
+        if (a == b) { rasm_error(M, "expected a symbol name"); continue; }
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", (int)(b - a), a);
+        int k = rasm_symbol(M, name);      // may grow M->syms
+        RasmSymbol* sym = &M->syms[k];
+        if (global) sym->global = 1;
+        else sym->external = 1;
+    }
+}
+
+// One statement after any label: directive, data, times or instruction.
+static void rasm_statement(RasmModule* M, const char* p, const char* end) {
+    p = rasm_skip(p);
+    if (p >= end) return;
+    const char* w = p;
+    while (p < end && (isalnum((unsigned char)*p) || *p == '_' || *p == '.')) p++;
+    size_t len = (size_t)(p - w);
+    char word[32];
+    snprintf(word, sizeof(word), "%.*s", (int)(len < 31 ? len : 31), w);
+    for (char* c = word; *c; c++) *c = (char)tolower((unsigned char)*c);
+
+    if (strcmp(word, "section") == 0 || strcmp(word, "segment") == 0) {
+        p = rasm_skip(p);
+        const char* n = p;
+        while (p < end && !isspace((unsigned char)*p)) p++;
+        char name[32];
+        snprintf(name, sizeof(name), "%.*s", (int)(p - n), n);
+        rasm_section(M, name);      // attributes (align=, progbits, ...) keep the defaults
+        return;
+    }
+    if (strcmp(word, "global") == 0) { rasm_directive_names(M, p, end, 1); return; }
+    if (strcmp(word, "extern") == 0) { rasm_directive_names(M, p, end, 0); return; }
+    if (strcmp(word, "bits") == 0 || strcmp(word, "cpu") == 0) return;
+    if (strcmp(word, "default") == 0) {
+        p = rasm_skip(p);
+        M->default_rel = strncasecmp(p, "rel", 3) == 0;
+        return;
+    }
+    if (strcmp(word, "align") == 0 || strcmp(word, "alignb") == 0) {
+        RasmExpr e;
+        if (!rasm_expr_text(M, p, end, &e)) return;
+        if (e.nterms || e.k <= 0 || (e.k & (e.k - 1))) { rasm_error(M, "alignment must be a power of two"); return; }
+        RasmItem* it = rasm_item(M, word[5] == 'b' ? RASM_RESERVE : RASM_ALIGN);
+        it->value = e.k;
+        it->flags = 1;      // RESERVE with flags = alignb padding
+        if (it->kind == RASM_ALIGN && e.k > M->sec[M->cur].align) M->sec[M->cur].align = (int)e.k;
+        return;
+    }
+    if (strcmp(word, "times") == 0) {
+        const char* q = rasm_skip(p);
+        // the count runs up to the next word that starts a statement
+        const char* stop = q;
+        while (stop < end) {
+            const char* t = stop;
+            while (t < end && isalpha((unsigned char)*t)) t++;
+            int reserve, op, cond;
+            char kw[16];
+            snprintf(kw, sizeof(kw), "%.*s", (int)((size_t)(t - stop) < 15 ? t - stop : 15), stop);
+            if (t > stop && (stop == q || !rasm_ident_char((unsigned char)stop[-1])) &&
+                (rasm_data_width(stop, (size_t)(t - stop), &reserve) || rasm_mnemonic(kw, &op, &cond)))
+                break;
+            stop++;
+        }
+        RasmExpr count;
+        if (stop == end || !rasm_expr_text(M, q, stop, &count)) { rasm_error(M, "invalid times"); return; }
+        if (count.nterms || count.k < 0) { rasm_error(M, "times count must be a non-negative constant"); return; }
+        size_t before = M->pool_len;
+        int first = M->nitems;
+        rasm_statement(M, stop, end);
+        RasmItem* last = M->nitems ? &M->items[M->nitems - 1] : NULL;
+        if (M->nitems <= first + 1 && last && last->kind == RASM_DATA && !last->width &&
+            M->pool_len > before && last->data_off + last->data_len == M->pool_len) {
+            size_t unit = M->pool_len - before;
+            if (!count.k) { last->data_len -= (uint32_t)unit; M->pool_len = before; return; }
+            rasm_pool_reserve(M, unit * (size_t)(count.k - 1));
+            for (int64_t r = 1; r < count.k; r++) memcpy(M->pool + before + unit * (size_t)r, M->pool + before, unit);
+            M->pool_len += unit * (size_t)(count.k - 1);
+            last->data_len += (uint32_t)(unit * (size_t)(count.k - 1));
+        } else {
+            int added = M->nitems - first;
+            if (!count.k) { M->nitems = first; return; }
+            for (int64_t r = 1; r < count.k; r++)
+                for (int k = 0; k < added; k++) {
+                    RasmItem copy = M->items[first + k];
+                    *rasm_item(M, RASM_INST) = copy;
+                }
+        }
+        return;
+    }
+    int reserve;
+    int width = rasm_data_width(w, len, &reserve);
+    if (width) {
+        if (reserve) {
+            RasmExpr e;
+            if (!rasm_expr_text(M, p, end, &e)) return;
+            if (e.nterms || e.k < 0) { rasm_error(M, "reserve count must be a non-negative constant"); return; }
+            RasmItem* it = rasm_item(M, RASM_RESERVE);
+            it->value = e.k * width;
+        } else {
+            rasm_data_list(M, width, p, end);
+        }
+        return;
+    }
+    int op = 0, cond = 0;
+    if (!rasm_mnemonic(word, &op, &cond)) { rasm_error(M, "unknown instruction `%s'", word); return; }
+    rasm_instruction(M, op, cond, p, end);
+}
+
+static void rasm_line(RasmModule* M, const char* p, const char* end) {
+    // strip the comment, honouring quotes
+    for (const char* q = p; q < end; q++) {
+        if (*q == '\'' || *q == '"' || *q == '`') {
+            char c = *q++;
+            while (q < end && *q != c) { if (c == '`' && *q == '\\' && q + 1 < end) q++; q++; }
+            continue;
+        }
+        if (*q == ';') { end = q; break; }
+    }
+    p = rasm_skip(p);
+    while (end > p && isspace((unsigned char)end[-1])) end--;
+    if (p >= end) return;
+    if (*p == '[' && end[-1] == ']') {
+        // [section .data] / [bits 64] primitive forms
+        rasm_statement(M, p + 1, end - 1);
+        return;
+    }
+    const char* w = p;
+    while (p < end && rasm_ident_char((unsigned char)*p)) p++;
+    size_t len = (size_t)(p - w);
+    const char* after = rasm_skip(p);
+    if (len && after < end && *after == ':') {
+        rasm_define_label(M, w, len);
+        rasm_statement(M, after + 1, end);
+        return;
+    }
+    if (len && after < end) {
+        // `name db ...`, `name equ ...`, `name resq ...` without a colon
+        const char* n = after;
+        while (n < end && isalpha((unsigned char)*n)) n++;
+        int reserve;
+        if ((size_t)(n - after) == 3 && strncasecmp(after, "equ", 3) == 0) {
+            char name[256];
+            snprintf(name, sizeof(name), "%.*s", (int)len, w);
+            int s = rasm_symbol(M, name);
+            RasmExpr e;
+            if (!rasm_expr_text(M, n, end, &e)) return;
+            if (M->syms[s].defined) { rasm_error(M, "symbol `%s' redefined", name); return; }
+            M->syms[s].is_equ = 1;
+            M->syms[s].defined = 1;
+            M->syms[s].equ = e;
+            return;
+        }
+        int op, cond;
+        char word[16];
+        snprintf(word, sizeof(word), "%.*s", (int)(len < 15 ? len : 15), w);
+        if ((rasm_data_width(after, (size_t)(n - after), &reserve) || strncasecmp(after, "times", 5) == 0) &&
+            !rasm_mnemonic(word, &op, &cond) && !rasm_data_width(w, len, &reserve)) {
+            rasm_define_label(M, w, len);
+            rasm_statement(M, after, end);
+            return;
+        }
+    }
+    rasm_statement(M, w, end);
+}
+
+// Parses NASM-syntax source into the module.
+int rasm_parse(RasmModule* M, const char* src, size_t len) {
+    const char* p = src, *end = src + len;
+    M->line = 0;
+    while (p < end) {
+        const char* nl = memchr(p, '\n', (size_t)(end - p));
+        const char* e = nl ? nl : end;
+        M->line++;
+        rasm_line(M, p, e);
+        p = nl ? nl + 1 : end;
+    }
+    return M->errors ? -1 : 0;
+}
+
+// === Layout and encoding ===
+
+// A constant immediate must fit its field: imm8 shift counts, imm32 sign-extended in 64-bit
+// operations (only mov r64 takes imm64), and signed or unsigned values of the operand size below that.
+static int rasm_imm_fits(const RasmItem* it, int64_t k) {
+    int size = 8;
+    for (int i = 0; i < it->nops; i++)
+        if ((it->o[i].x.kind == X64_REG || it->o[i].x.kind == X64_MEM) && it->o[i].x.size) { size = it->o[i].x.size; break; }
+    if (it->op == X64_SHL || it->op == X64_SHR || it->op == X64_SAR) size = 1;
+    else if (it->op == X64_PUSH) size = 8;
+    else if (it->op == X64_MOV && size == 8 && it->o[0].x.kind == X64_REG) return 1;
+    if (size == 8) return k == (int32_t)k;
+    return k >= -(INT64_C(1) << (8 * size - 1)) && k < (INT64_C(1) << (8 * size));
+}
+
+// Builds the encoder instruction for an item against the current symbol values.
+static int rasm_lower(RasmModule* M, const RasmItem* it, X64Inst* in) {
+    memset(in, 0, sizeof(*in));
+    in->op = it->op;
+    in->cond = it->cond;
+    in->nops = it->nops;
+    in->flags = it->flags & X64_SHORT;
+    for (int i = 0; i < it->nops; i++) {
+        const RasmOperand* o = &it->o[i];
+        X64Operand x = o->x;
+        if (x.kind == X64_IMM || x.kind == X64_MEM || x.kind == X64_LABEL) {
+            int64_t k;
+            int sym;
+            if (rasm_eval(M, &o->expr, &k, &sym, 0) != 0) return -1;
+            x.imm = k;
+            x.label = sym;
+            if (x.kind == X64_LABEL && sym < 0) { rasm_error(M, "branch to an absolute address"); return -1; }
+            if (x.kind == X64_IMM && sym < 0 && !rasm_imm_fits(it, k)) {
+                rasm_error(M, "immediate %lld out of range", (long long)k);
+                return -1;
+            }
+            if (x.kind == X64_MEM && sym < 0 && k != (int32_t)k) {
+                rasm_error(M, "displacement %lld out of range", (long long)k);
+                return -1;
+            }
+            if (x.kind == X64_MEM && o->rel == 1 && x.reg == X64_NOREG && x.index == X64_NOREG) {
+                x.reg = X64_RIP;
+                if (sym < 0) { rasm_error(M, "rip-relative operand needs a symbol"); return -1; }
+            }
+        }
+        in->o[i] = x;
+    }
+    return 0;
+}
+
+// Symbol's section offset, or -1 when it is not a label in `section`.
+static int64_t rasm_target_in(RasmModule* M, int sym, int section) {
+    const RasmSymbol* s = &M->syms[sym];
+    return s->defined && !s->is_equ && s->section == section ? s->value : -1;
+}
+
+static int rasm_layout(RasmModule* M, X64Asm* scratch) {
+    int64_t offset[RASM_MAX_SECTIONS] = { 0 };
+    int changed = 0;
+    for (int i = 0; i < M->nitems; i++) {
+        RasmItem* it = &M->items[i];
+        int64_t* at = &offset[it->section];
+        M->line = it->line;
+        it->offset = *at;
+        switch ((RasmItemKind)it->kind) {
+            case RASM_LABEL: {
+                RasmSymbol* s = &M->syms[it->sym];
+                if (s->value != *at) { s->value = *at; changed = 1; }
+                it->size = 0;
+                break;
+            }
+            case RASM_INST: {
+                X64Inst in;
+                scratch->len = 0;
+                scratch->nfixups = 0;
+                scratch->error = 0;
+                if (rasm_lower(M, it, &in) != 0) return -1;
+                x64_emit(scratch, &in);
+                if (scratch->error) { rasm_error(M, "invalid combination of opcode and operands"); return -1; }
+                if (it->size != scratch->len) changed = 1;
+                it->size = (uint32_t)scratch->len;
+                break;
+            }
+            case RASM_DATA:
+                it->size = it->width ? it->width : it->data_len;
+                break;
+            case RASM_ALIGN:
+                it->size = (uint32_t)((it->value - (*at % it->value)) % it->value);
+                break;
+            case RASM_RESERVE:
+                it->size = (uint32_t)(it->flags ? (it->value - (*at % it->value)) % it->value : it->value);
+                break;
+        }
+        *at += it->size;
+    }
+    for (int s = 0; s < M->nsec; s++) M->sec[s].size = offset[s];
+
+    // grow short branches that no longer reach (never shrink: guarantees termination)
+    for (int i = 0; i < M->nitems; i++) {
+        RasmItem* it = &M->items[i];
+        if (it->kind != RASM_INST || !(it->flags & X64_SHORT)) continue;
+        int64_t k;
+        int sym;
+        M->line = it->line;
+        if (rasm_eval(M, &it->o[0].expr, &k, &sym, 0) != 0) return -1;
+        int64_t target = sym >= 0 ? rasm_target_in(M, sym, it->section) : -1;
+        int64_t disp = target < 0 ? 1 << 30 : target + k - (it->offset + it->size);
+        if (disp >= -128 && disp <= 127) continue;
+        if (it->flags & RASM_FIXED) {
+            if (target >= 0 || M->final) { rasm_error(M, "short jump is out of range"); return -1; }
+            continue;
+        }
+        it->flags &= (uint8_t)~X64_SHORT;
+        changed = 1;
+    }
+    return changed;
+}
+
+static void rasm_reloc(RasmSection* sec, uint32_t offset, int sym, int kind, int branch, int64_t addend) {
+    if (sec->nrelocs == sec->reloc_cap) {
+        sec->reloc_cap = sec->reloc_cap ? sec->reloc_cap * 2 : 64;
+        sec->relocs = realloc(sec->relocs, (size_t)sec->reloc_cap * sizeof(RasmReloc));
+        if (!sec->relocs) { perror("rasm_reloc"); exit(1); }
+    }
+    RasmReloc* r = &sec->relocs[sec->nrelocs++];
+    r->offset = offset;
+    r->sym = sym;
+    r->kind = (uint8_t)kind;
+    r->branch = (uint8_t)branch;
+    r->addend = addend;
+}
+
+// Lays out and encodes every section. Branches start short and grow until the layout settles.
+int rasm_assemble(RasmModule* M) {
+    if (M->errors) return -1;
+    X64Asm scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    for (int i = 0; i < M->nitems; i++) {
+        RasmItem* it = &M->items[i];
+        if (it->kind == RASM_INST && (it->op == X64_JMP || it->op == X64_JCC) &&
+            it->o[0].x.kind == X64_LABEL && !(it->flags & RASM_FIXED))
+            it->flags |= X64_SHORT;
+    }
+    for (int i = 0; i < M->nsyms; i++) {
+        RasmSymbol* s = &M->syms[i];
+        M->line = s->line;
+        if (s->global && s->external) rasm_error(M, "symbol `%s' is both global and extern", s->name);
+        else if (s->global && !s->defined) rasm_error(M, "symbol `%s' declared global but not defined", s->name);
+        else if (s->external && s->defined) s->external = 0;    // extern of a local definition
+    }
+    int pass = 0, rc;
+    while ((rc = rasm_layout(M, &scratch)) > 0 && ++pass < RASM_MAX_PASSES) {}
+    if (rc > 0) rasm_error(M, "layout did not converge after %d passes", RASM_MAX_PASSES);
+    if (M->errors) { x64_free(&scratch); return -1; }
+
+    // final pass: encode into the sections, patch local branches, keep the rest as relocations
+    M->final = 1;
+    for (int s = 0; s < M->nsec; s++) {
+        x64_free(&M->sec[s].out);
+        M->sec[s].nrelocs = 0;
+    }
+    for (int i = 0; i < M->nitems; i++) {
+        RasmItem* it = &M->items[i];
+        RasmSection* sec = &M->sec[it->section];
+        X64Asm* a = &sec->out;
+        M->line = it->line;
+        if (sec->nobits) {
+            if (it->kind == RASM_INST || (it->kind == RASM_DATA && it->width))
+                rasm_error(M, "code or relocated data in a nobits section");
+            continue;
+        }
+        switch ((RasmItemKind)it->kind) {
+            case RASM_LABEL:
+                break;
+            case RASM_INST: {
+                X64Inst in;
+                int first = a->nfixups;
+                if (rasm_lower(M, it, &in) != 0) break;
+                x64_emit(a, &in);
+                int branch = it->op == X64_CALL || it->op == X64_JMP || it->op == X64_JCC;
+                for (int f = first; f < a->nfixups; f++) {
+                    X64Fixup* fx = &a->fixups[f];
+                    int64_t target = rasm_target_in(M, fx->label, it->section);
+                    if (target >= 0 && (fx->kind == X64_FIX_REL8 || fx->kind == X64_FIX_REL32)) {
+                        int w = fx->kind == X64_FIX_REL8 ? 1 : 4;
+                        int64_t v = target + fx->addend - (int64_t)(fx->offset + w);
+                        if (w == 1 && (v < -128 || v > 127)) { rasm_error(M, "short jump is out of range"); break; }
+                        for (int k = 0; k < w; k++) a->code[fx->offset + k] = (uint8_t)((uint64_t)v >> (8 * k));
+                    } else if (fx->kind == X64_FIX_REL8) {
+                        rasm_error(M, "short jump to a symbol outside the section");
+                    } else {
+                        rasm_reloc(sec, fx->offset, fx->label, fx->kind, branch, fx->addend);
+                    }
+                }
+                a->nfixups = 0;
+                break;
+            }
+            case RASM_DATA:
+                if (!it->width) {
+                    for (uint32_t k = 0; k < it->data_len; k++) x64_byte(a, M->pool[it->data_off + k]);
+                } else {
+                    int64_t k;
+                    int sym;
+                    if (rasm_eval(M, &it->o[0].expr, &k, &sym, 0) != 0) break;
+                    if (sym >= 0) {
+                        if (it->width < 4) { rasm_error(M, "relocated value does not fit in %d bytes", it->width); break; }
+                        rasm_reloc(sec, (uint32_t)a->len, sym, it->width == 8 ? X64_FIX_ABS64 : X64_FIX_ABS32, 0, k);
+                        k = 0;
+                    }
+                    x64_le(a, (uint64_t)k, it->width);
+                }
+                break;
+            case RASM_ALIGN:
+                for (uint32_t k = 0; k < it->size; k++) x64_byte(a, 0x90);     // nasm's align pads with nop
+                break;
+            case RASM_RESERVE:
+                for (uint32_t k = 0; k < it->size; k++) x64_byte(a, 0);
+                break;
+        }
+        if (!M->errors && (int64_t)a->len != it->offset + it->size) {
+            rasm_error(M, "internal: encoding size changed after layout");
+        }
+    }
+    x64_free(&scratch);
+    return M->errors ? -1 : 0;
+}
+
+// === Listing (--emit-asm) ===
+
+// Writes the assembled module back as NASM source, each line commented with offset and bytes.
+void rasm_list(RasmModule* M, FILE* f) {
+    char** names = calloc((size_t)M->nsyms + 1, sizeof(char*));
+    if (!names) { perror("rasm_list"); return; }
+    for (int i = 0; i < M->nsyms; i++) names[i] = M->syms[i].name;
+    for (int i = 0; i < M->nsyms; i++) {
+        const RasmSymbol* s = &M->syms[i];
+        if (s->external) fprintf(f, "extern %s\n", s->name);
+        if (s->global) fprintf(f, "global %s\n", s->name);
+    }
+    int section = -1;
+    for (int i = 0; i < M->nitems; i++) {
+        RasmItem* it = &M->items[i];
+        const RasmSection* sec = &M->sec[it->section];
+        if (it->section != section) {
+            section = it->section;
+            fprintf(f, "\nsection %s\n", sec->name);
+        }
+        char text[256];
+        FILE* mem = fmemopen(text, sizeof(text), "w");
+        if (!mem) continue;
+        switch ((RasmItemKind)it->kind) {
+            case RASM_LABEL:
+                if (M->syms[it->sym].internal) { fclose(mem); continue; }
+                fprintf(mem, "%s:", M->syms[it->sym].name);
+                break;
+            case RASM_INST: {
+                X64Inst in;
+                M->line = it->line;
+                if (rasm_lower(M, it, &in) == 0) { fputs("    ", mem); x64_print(mem, &in, names); }
+                break;
+            }
+            case RASM_DATA:
+                if (it->width) {
+                    int64_t k;
+                    int sym;
+                    static const char* dx[9] = { "", "db", "dw", "", "dd", "", "", "", "dq" };
+                    if (rasm_eval(M, &it->o[0].expr, &k, &sym, 0) == 0) {
+                        if (sym >= 0) fprintf(mem, "    %s %s%+lld", dx[it->width], names[sym], (long long)k);
+                        else fprintf(mem, "    %s %lld", dx[it->width], (long long)k);
+                    }
+                } else {
+                    int same = 1;
+                    for (uint32_t k = 1; k < it->data_len; k++) same &= M->pool[it->data_off + k] == M->pool[it->data_off];
+                    if (same && it->data_len > 1) {
+                        fprintf(mem, "    times %u db 0x%02X", it->data_len, M->pool[it->data_off]);
+                    } else {
+                        fputs("    db ", mem);
+                        for (uint32_t k = 0; k < it->data_len && k < 16; k++)
+                            fprintf(mem, "%s0x%02X", k ? ", " : "", M->pool[it->data_off + k]);
+                        if (it->data_len > 16) {
+                            // long runs continue on plain db lines
+                            fclose(mem);
+                            fprintf(f, "%-47s ; %08llX\n", text, (unsigned long long)it->offset);
+                            for (uint32_t k = 16; k < it->data_len; k += 16) {
+                                fputs("    db ", f);
+                                for (uint32_t j = k; j < it->data_len && j < k + 16; j++)
+                                    fprintf(f, "%s0x%02X", j > k ? ", " : "", M->pool[it->data_off + j]);
+                                fputc('\n', f);
+                            }
+                            continue;
+                        }
+                    }
+                }
+                break;
+            case RASM_ALIGN:
+                fprintf(mem, "    align %lld", (long long)it->value);
+                break;
+            case RASM_RESERVE:
+                if (it->flags) fprintf(mem, "    alignb %lld", (long long)it->value);
+                else fprintf(mem, "    resb %lld", (long long)it->value);
+                break;
+        }
+        fclose(mem);
+        fprintf(f, "%-47s ; %08llX", text, (unsigned long long)it->offset);
+        if (it->kind == RASM_INST && !sec->nobits && (int64_t)sec->out.len >= it->offset + it->size) {
+            fputc(' ', f);
+            for (uint32_t k = 0; k < it->size; k++) fprintf(f, " %02X", sec->out.code[it->offset + k]);
+        }
+        fputc('\n', f);
+    }
+    free(names);
+}
+
+// Reads and assembles a NASM source file into a module (caller frees with rasm_free).
+RasmModule* rasm_assemble_source(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) { perror(path); return NULL; }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* src = malloc((size_t)size + 1);
+    if (!src) { fclose(f); perror("rasm_assemble_source"); return NULL; }
+    size_t n = fread(src, 1, (size_t)size, f);
+    src[n] = 0;
+    fclose(f);
+    RasmModule* M = rasm_new(path);
+    int rc = rasm_parse(M, src, n);
+    free(src);
+    if (rc == 0) rc = rasm_assemble(M);
+    if (rc != 0) { rasm_free(M); return NULL; }
+    return M;
+}
+// elf64_object.c – ELF64 relocatable object writer for assembled Rexion modules
+// DOC: Writes an x86-64 ET_REL file (sections, .symtab/.strtab, .rela.*) the system linker accepts
+// DOC: Relocations against local labels use the section symbol plus offset, as nasm does;
+// DOC: globals and externs are referenced by name, calls to externs as R_X86_64_PLT32
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <elf.h>
+
+typedef struct {
+    uint8_t* data;
+    size_t len, cap;
+} ElfBuffer;
+
+static void elf_put(ElfBuffer* b, const void* p, size_t n) {
+    if (b->len + n > b->cap) {
+        while (b->len + n > b->cap) b->cap = b->cap ? b->cap * 2 : 4096;
+        b->data = realloc(b->data, b->cap);
+        if (!b->data) { perror("elf_put"); exit(1); }
+    }
+    if (p) memcpy(b->data + b->len, p, n);
+    else memset(b->data + b->len, 0, n);
+    b->len += n;
+}
+
+static void elf_align(ElfBuffer* b, size_t align) {
+    if (align > 1 && b->len % align) elf_put(b, NULL, align - b->len % align);
+}
+
+static uint32_t elf_string(ElfBuffer* strtab, const char* s) {
+    uint32_t at = (uint32_t)strtab->len;
+    elf_put(strtab, s, strlen(s) + 1);
+    return at;
+}
+
+// Converts an encoder fixup into an ELF relocation type and addend.
+static int elf_reloc_type(const RasmReloc* r, int external, int64_t base, int64_t* addend) {
+    switch ((X64FixupKind)r->kind) {
+        case X64_FIX_REL32:  *addend = base + r->addend - 4; return r->branch && external ? R_X86_64_PLT32 : R_X86_64_PC32;
+        case X64_FIX_ABS32:  *addend = base + r->addend; return R_X86_64_32;
+        case X64_FIX_ABS32S: *addend = base + r->addend; return R_X86_64_32S;
+        case X64_FIX_ABS64:  *addend = base + r->addend; return R_X86_64_64;
+        default: return -1;
+    }
+}
+
+int elf64_write_object(RasmModule* M, const char* path) {
+    ElfBuffer out = { 0 }, strtab = { 0 }, shstrtab = { 0 }, symtab = { 0 };
+    int nsec = M->nsec;
+    int* elf_index = malloc(((size_t)M->nsyms + 1) * sizeof(int));     // module symbol -> .symtab index
+    Elf64_Shdr* sh = calloc((size_t)(2 * nsec + 4), sizeof(Elf64_Shdr));
+    if (!elf_index || !sh) { perror("elf64_write_object"); free(elf_index); free(sh); return -1; }
+
+    elf_put(&strtab, "", 1);
+    elf_put(&shstrtab, "", 1);
+
+    // .symtab: null, file, section symbols, locals, then globals/externs
+    Elf64_Sym sym;
+    memset(&sym, 0, sizeof(sym));
+    elf_put(&symtab, &sym, sizeof(sym));
+    const char* base = strrchr(M->file ? M->file : "rexion.asm", '/');
+    sym.st_name = elf_string(&strtab, base ? base + 1 : (M->file ? M->file : "rexion.asm"));
+    sym.st_info = ELF64_ST_INFO(STB_LOCAL, STT_FILE);
+    sym.st_shndx = SHN_ABS;
+    elf_put(&symtab, &sym, sizeof(sym));
+    for (int s = 0; s < nsec; s++) {
+        memset(&sym, 0, sizeof(sym));
+        sym.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+        sym.st_shndx = (uint16_t)(s + 1);
+        elf_put(&symtab, &sym, sizeof(sym));
+    }
+    int count = 2 + nsec;
+    for (int i = 0; i < M->nsyms; i++) elf_index[i] = -1;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < M->nsyms; i++) {
+            RasmSymbol* s = &M->syms[i];
+            int is_global = s->global || s->external;
+            if (s->internal || is_global != pass) continue;
+            if (!pass && !s->defined) continue;
+            memset(&sym, 0, sizeof(sym));
+            sym.st_name = elf_string(&strtab, s->name);
+            sym.st_info = ELF64_ST_INFO(pass ? STB_GLOBAL : STB_LOCAL, STT_NOTYPE);
+            if (s->external) {
+                sym.st_shndx = SHN_UNDEF;
+            } else if (s->is_equ) {
+                int64_t k;
+                int rs;
+                if (rasm_eval(M, &s->equ, &k, &rs, 0) != 0) continue;
+                if (rs >= 0) {
+                    // equ of a label: same place as that label
+                    sym.st_shndx = (uint16_t)(M->syms[rs].section + 1);
+                    sym.st_value = (uint64_t)(M->syms[rs].value + k);
+                } else {
+                    sym.st_shndx = SHN_ABS;
+                    sym.st_value = (uint64_t)k;
+                }
+            } else {
+                sym.st_shndx = (uint16_t)(s->section + 1);
+                sym.st_value = (uint64_t)s->value;
+            }
+            elf_index[i] = count++;
+            elf_put(&symtab, &sym, sizeof(sym));
+        }
+        if (pass == 0) sh[nsec + 2].sh_info = (uint32_t)count;     // first non-local symbol
+    }
+    Elf64_Ehdr eh;
+    memset(&eh, 0, sizeof(eh));
+    elf_put(&out, &eh, sizeof(eh));
+
+    // user sections
+    for (int s = 0; s < nsec; s++) {
+        RasmSection* sec = &M->sec[s];
+        Elf64_Shdr* h = &sh[s + 1];
+        h->sh_name = elf_string(&shstrtab, sec->name);
+        h->sh_type = sec->nobits ? SHT_NOBITS : SHT_PROGBITS;
+        h->sh_flags = (sec->alloc ? SHF_ALLOC : 0) | (sec->write ? SHF_WRITE : 0) | (sec->exec ? SHF_EXECINSTR : 0);
+        h->sh_addralign = (uint64_t)sec->align;
+        h->sh_size = (uint64_t)sec->size;
+        elf_align(&out, (size_t)sec->align);
+        h->sh_offset = out.len;
+        if (!sec->nobits) elf_put(&out, sec->out.code, sec->out.len);
+    }
+
+    // relocation sections
+    int nrela = 0;
+    int rela_at = nsec + 4;
+    for (int s = 0; s < nsec; s++) {
+        RasmSection* sec = &M->sec[s];
+        if (!sec->nrelocs) continue;
+        char name[48];
+        snprintf(name, sizeof(name), ".rela%s", sec->name);
+        Elf64_Shdr* h = &sh[rela_at + nrela++];
+        h->sh_name = elf_string(&shstrtab, name);
+        h->sh_type = SHT_RELA;
+        h->sh_flags = SHF_INFO_LINK;
+        h->sh_link = (uint32_t)(nsec + 2);
+        h->sh_info = (uint32_t)(s + 1);
+        h->sh_addralign = 8;
+        h->sh_entsize = sizeof(Elf64_Rela);
+        elf_align(&out, 8);
+        h->sh_offset = out.len;
+        for (int r = 0; r < sec->nrelocs; r++) {
+            const RasmReloc* rel = &sec->relocs[r];
+            const RasmSymbol* t = &M->syms[rel->sym];
+            int external = t->external;
+            int64_t where = 0, addend = 0;
+            uint32_t index;
+            if (t->global || t->external) {
+                index = (uint32_t)elf_index[rel->sym];
+            } else {
+                index = (uint32_t)(2 + t->section);       // section symbol
+                where = t->value;
+            }
+            int type = elf_reloc_type(rel, external, where, &addend);
+            Elf64_Rela ra;
+            ra.r_offset = rel->offset;
+            ra.r_info = ELF64_R_INFO(index, (uint32_t)type);
+            ra.r_addend = addend;
+            elf_put(&out, &ra, sizeof(ra));
+        }
+        h->sh_size = out.len - h->sh_offset;
+    }
+
+    // .shstrtab / .symtab / .strtab
+    sh[nsec + 1].sh_name = elf_string(&shstrtab, ".shstrtab");
+    sh[nsec + 2].sh_name = elf_string(&shstrtab, ".symtab");
+    sh[nsec + 3].sh_name = elf_string(&shstrtab, ".strtab");
+
+    sh[nsec + 1].sh_type = SHT_STRTAB;
+    sh[nsec + 1].sh_addralign = 1;
+    sh[nsec + 1].sh_offset = out.len;
+    sh[nsec + 1].sh_size = shstrtab.len;
+    elf_put(&out, shstrtab.data, shstrtab.len);
+
+    elf_align(&out, 8);
+    sh[nsec + 2].sh_type = SHT_SYMTAB;
+    sh[nsec + 2].sh_addralign = 8;
+    sh[nsec + 2].sh_entsize = sizeof(Elf64_Sym);
+    sh[nsec + 2].sh_link = (uint32_t)(nsec + 3);
+    sh[nsec + 2].sh_offset = out.len;
+    sh[nsec + 2].sh_size = symtab.len;
+    elf_put(&out, symtab.data, symtab.len);
+
+    sh[nsec + 3].sh_type = SHT_STRTAB;
+    sh[nsec + 3].sh_addralign = 1;
+    sh[nsec + 3].sh_offset = out.len;
+    sh[nsec + 3].sh_size = strtab.len;
+    elf_put(&out, strtab.data, strtab.len);
+
+    elf_align(&out, 16);
+    size_t shoff = out.len;
+    int shnum = rela_at + nrela;
+    elf_put(&out, sh, (size_t)shnum * sizeof(Elf64_Shdr));
+
+    Elf64_Ehdr* e = (Elf64_Ehdr*)out.data;
+    memcpy(e->e_ident, ELFMAG, SELFMAG);
+    e->e_ident[EI_CLASS] = ELFCLASS64;
+    e->e_ident[EI_DATA] = ELFDATA2LSB;
+    e->e_ident[EI_VERSION] = EV_CURRENT;
+    e->e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    e->e_type = ET_REL;
+    e->e_machine = EM_X86_64;
+    e->e_version = EV_CURRENT;
+    e->e_shoff = shoff;
+    e->e_ehsize = sizeof(Elf64_Ehdr);
+    e->e_shentsize = sizeof(Elf64_Shdr);
+    e->e_shnum = (uint16_t)shnum;
+    e->e_shstrndx = (uint16_t)(nsec + 1);
+
+    int rc = 0;
+    FILE* f = fopen(path, "wb");
+    if (!f || fwrite(out.data, 1, out.len, f) != out.len) { perror(path); rc = -1; }
+    if (f && fclose(f) != 0) rc = -1;
+    free(out.data); free(strtab.data); free(shstrtab.data); free(symtab.data);
+    free(elf_index); free(sh);
+    return rc;
+}
+
+// Assembles `asm_path` in-process and writes an ELF64 object to `obj_path` (nasm -felf64 equivalent).
+int rasm_assemble_file(const char* asm_path, const char* obj_path) {
+    RasmModule* M = rasm_assemble_source(asm_path);
+    if (!M) return -1;
+    int rc = elf64_write_object(M, obj_path);
+    rasm_free(M);
+    return rc;
+}
+
+// Prints the built-in assembler's view of a NASM source (--emit-asm).
+int rasm_list_file(const char* asm_path, FILE* out) {
+    RasmModule* M = rasm_assemble_source(asm_path);
+    if (!M) return -1;
+    rasm_list(M, out);
+    rasm_free(M);
+    return 0;
+}
+
+// rexion_link.c – Rexion built-in static linker (assembled modules + runtime -> ELF64 executable)
+// DOC: Replaces system("gcc -no-pie rexion.o ...") / ld for single-program builds
+// DOC: Runtime routines (_start, buffered stdout, print_string, int_to_str, float_to_str) are small NASM members
+// DOC: assembled in-process and pulled in only when a module references them, like archive members
+// DOC: Layout: R+X segment (headers, .text, .rodata) at 0x400000, then a page-aligned R+W segment
+// DOC: (.data, then .bss as memory-only); every relocation is resolved, nothing is left for ld.so
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <math.h>
+#include <elf.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define RLINK_MAX_MODULES 16
+#define RLINK_BASE 0x400000ULL
+#define RLINK_PAGE 0x1000ULL
+
+typedef struct {
+    const char* name;       // global symbol the member defines
+    const char* source;     // NASM text
+    void (*tables)(FILE* out);  // appends generated data to the source, or NULL
+    uint32_t features;      // X64_FEAT_* the source needs (see x64_features)
+} RlinkMember;
+
+// Ryu's 128-bit power-of-5 tables for float_to_str, generated when the member is pulled in:
+//   float_to_str_pow5[i]      5^i normalized to 125 bits                       (i < 326, 2^-e2 side)
+//   float_to_str_pow5_inv[q]  floor(2^(bits(5^q) - 1 + 125) / 5^q) + 1          (q < 342, 2^e2 side)
+#define RLINK_POW5_COUNT 326
+#define RLINK_POW5_INV_COUNT 342
+#define RLINK_BIG_WORDS 26      // 832 bits hold 5^341 and the long-division remainder
+
+static int rlink_big_bits(const uint32_t* a) {
+    for (int i = RLINK_BIG_WORDS - 1; i >= 0; i--)
+        if (a[i]) return 32 * i + 32 - __builtin_clz(a[i]);
+    return 0;
+}
+
+static void rlink_big_mul5(uint32_t* a) {
+    uint64_t carry = 0;
+    for (int i = 0; i < RLINK_BIG_WORDS; i++) {
+        carry += (uint64_t)a[i] * 5;
+        a[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+// Low 128 bits of a * 2^shift (shift may be negative)
+static unsigned __int128 rlink_big_u128(const uint32_t* a, int shift) {
+    unsigned __int128 v = 0;
+    for (int k = 0; k < 128; k++) {
+        int bit = k - shift;
+        if (bit >= 0 && bit < 32 * RLINK_BIG_WORDS && (a[bit / 32] >> (bit % 32)) & 1) v |= (unsigned __int128)1 << k;
+    }
+    return v;
+}
+
+static int rlink_big_less(const uint32_t* a, const uint32_t* b) {
+    for (int i = RLINK_BIG_WORDS - 1; i >= 0; i--)
+        if (a[i] != b[i]) return a[i] < b[i];
+    return 0;
+}
+
+static void rlink_big_sub(uint32_t* a, const uint32_t* b) {
+    int64_t borrow = 0;
+    for (int i = 0; i < RLINK_BIG_WORDS; i++) {
+        int64_t d = (int64_t)a[i] - b[i] - borrow;
+        borrow = d < 0;
+        a[i] = (uint32_t)d;
+    }
+}
+
+static void rlink_big_shl1(uint32_t* a) {
+    for (int i = RLINK_BIG_WORDS - 1; i > 0; i--) a[i] = a[i] << 1 | a[i - 1] >> 31;
+    a[0] <<= 1;
+}
+
+static void rlink_emit_u128(FILE* out, const char* quad, unsigned __int128 v) {
+    fprintf(out, "    %s 0x%016llx, 0x%016llx\n", quad, (unsigned long long)v, (unsigned long long)(v >> 64));
+}
+
+// Both tables as `quad lo, hi` rows: "dq" for NASM, ".quad" for the AArch64 backend's GNU as output.
+static void rlink_pow5_tables(FILE* out, const char* quad) {
+    uint32_t p[RLINK_BIG_WORDS] = { 1 };
+    fprintf(out, "float_to_str_pow5:\n");
+    for (int i = 0; i < RLINK_POW5_COUNT; i++, rlink_big_mul5(p))
+        rlink_emit_u128(out, quad, rlink_big_u128(p, 125 - rlink_big_bits(p)));
+    memset(p, 0, sizeof(p));
+    p[0] = 1;
+    fprintf(out, "float_to_str_pow5_inv:\n");
+    for (int q = 0; q < RLINK_POW5_INV_COUNT; q++, rlink_big_mul5(p)) {
+        // Long division of 2^(bits - 1 + 125) by 5^q: the quotient's top bit is bit 125, where the
+        // running remainder is 2^(bits - 1).
+        int bits = rlink_big_bits(p);
+        uint32_t r[RLINK_BIG_WORDS] = { 0 };
+        r[(bits - 1) / 32] = 1u << ((bits - 1) % 32);
+        unsigned __int128 quotient = 0;
+        for (int k = 125; k >= 0; k--) {
+            if (k < 125) rlink_big_shl1(r);
+            if (!rlink_big_less(r, p)) {
+                rlink_big_sub(r, p);
+                quotient |= (unsigned __int128)1 << k;
+            }
+        }
+        rlink_emit_u128(out, quad, quotient + 1);
+    }
+}
+
+static void rlink_float_tables(FILE* out) {
+    fprintf(out, "section .rodata\nalign 16\n");
+    rlink_pow5_tables(out, "dq");
+}
+
+// Runtime calling conventions:
+//   _start                  argc/argv/envp -> main(rdi, rsi, rdx), out_flush, exit(eax)
+//   out_write               rsi = bytes, rdx = length -> appended to the 64 KiB stdout buffer, rax = length;
+//                           a full buffer is flushed first, a write larger than the buffer goes straight out
+//   out_flush               one write(1) of everything buffered (also before exit and before input)
+//   read_stdin              rdi = buffer, rsi = capacity -> out_flush, then rax = read(0, rdi, rsi)
+//   print_string            rsi = NUL-terminated string -> out_write, rax = bytes written
+//   int_to_str              rdi = signed value, rsi = buffer (>= 26 bytes, the tail is scratch) -> NUL-terminated digits,
+//                           rax = length; preserves rsi and every callee-saved register
+//   float_to_str            xmm0 = value, rdi = buffer (>= 28 bytes) -> shortest digits that read back as the same
+//                           double (Ryu), "3.25" / "0.0001" / "1e-05" / "1.5e+300" / "inf" / "nan", rax = length
+//   float_to_str_mulshift   rcx = m, r10 = 128-bit table entry, r11 = shift -> rax = (m * entry) >> (r11 + 64);
+//                           clobbers rcx, rdx, r9
+// A member may be listed more than once: the first whose `features` the target has is linked.
+static const RlinkMember rlink_runtime[] = {
+    { .name = "_start", .source =
+        "section .text\n"
+        "global _start\n"
+        "extern main\n"
+        "extern out_flush\n"
+        "_start:\n"
+        "    xor ebp, ebp\n"
+        "    mov rdi, [rsp]\n"
+        "    lea rsi, [rsp + 8]\n"
+        "    lea rdx, [rsi + rdi*8 + 8]\n"
+        "    and rsp, -16\n"
+        "    call main\n"
+        "    mov ebx, eax\n"
+        "    call out_flush\n"
+        "    mov edi, ebx\n"
+        "    mov eax, 60\n"
+        "    syscall\n" },
+    { .name = "out_flush", .source =
+        "section .bss\n"
+        "alignb 8\n"
+        "global out_len\n"
+        "global out_buf\n"
+        "out_len resq 1\n"
+        "out_buf resb 65536\n"
+        "section .text\n"
+        "global out_flush\n"
+        "out_flush:\n"
+        "    lea rsi, [rel out_buf]\n"
+        "    mov rdx, [rel out_len]\n"
+        "    mov qword [rel out_len], 0\n"
+        ".write:\n"
+        "    test rdx, rdx\n"
+        "    jz .done\n"
+        "    mov eax, 1\n"
+        "    mov edi, 1\n"
+        "    syscall\n"
+        "    test rax, rax\n"
+        "    jle .done\n"                 // a failed write drops the rest, as stdio does
+        "    add rsi, rax\n"
+        "    sub rdx, rax\n"
+        "    jmp .write\n"
+        ".done:\n"
+        "    ret\n" },
+    { .name = "out_write", .source =
+        "section .text\n"
+        "global out_write\n"
+        "extern out_flush\n"
+        "extern out_buf\n"
+        "extern out_len\n"
+        "out_write:\n"
+        "    mov rax, [rel out_len]\n"
+        "    lea rcx, [rax + rdx]\n"
+        "    cmp rcx, 65536\n"
+        "    jbe .append\n"
+        "    push rsi\n"
+        "    push rdx\n"
+        "    call out_flush\n"
+        "    pop rdx\n"
+        "    pop rsi\n"
+        "    xor eax, eax\n"
+        "    cmp rdx, 65536\n"
+        "    jbe .append\n"
+        "    mov r8, rdx\n"
+        ".direct:\n"
+        "    mov eax, 1\n"
+        "    mov edi, 1\n"
+        "    syscall\n"
+        "    test rax, rax\n"
+        "    jle .direct_done\n"
+        "    add rsi, rax\n"
+        "    sub rdx, rax\n"
+        "    jnz .direct\n"
+        ".direct_done:\n"
+        "    mov rax, r8\n"
+        "    ret\n"
+        ".append:\n"
+        "    lea rdi, [rel out_buf]\n"
+        "    add rdi, rax\n"
+        "    add rax, rdx\n"
+        "    mov [rel out_len], rax\n"
+        "    mov rax, rdx\n"
+        "    cmp rdx, 8\n"
+        "    jb .bytes\n"
+        ".qwords:\n"
+        "    mov rcx, [rsi]\n"
+        "    mov [rdi], rcx\n"
+        "    add rsi, 8\n"
+        "    add rdi, 8\n"
+        "    sub rdx, 8\n"
+        "    cmp rdx, 8\n"
+        "    jae .qwords\n"
+        ".bytes:\n"
+        "    test rdx, rdx\n"
+        "    jz .done\n"
+        "    mov cl, [rsi]\n"
+        "    mov [rdi], cl\n"
+        "    inc rsi\n"
+        "    inc rdi\n"
+        "    dec rdx\n"
+        "    jmp .bytes\n"
+        ".done:\n"
+        "    ret\n" },
+    { .name = "read_stdin", .source =
+        "section .text\n"
+        "global read_stdin\n"
+        "extern out_flush\n"
+        "read_stdin:\n"
+        "    push rdi\n"
+        "    push rsi\n"
+        "    call out_flush\n"                // prompts reach the terminal before the read blocks
+        "    pop rdx\n"
+        "    pop rsi\n"
+        "    xor eax, eax\n"
+        "    xor edi, edi\n"
+        "    syscall\n"
+        "    ret\n" },
+    { .name = "print_string", .source =
+        "section .text\n"
+        "global print_string\n"
+        "extern out_write\n"
+        "print_string:\n"
+        "    mov rdx, rsi\n"
+        ".scan:\n"
+        "    cmp byte [rdx], 0\n"
+        "    je .write\n"
+        "    inc rdx\n"
+        "    jmp .scan\n"
+        ".write:\n"
+        "    sub rdx, rsi\n"
+        "    jmp out_write\n" },
+    { .name = "int_to_str", .source =
+        "section .rodata\n"
+        "int_to_str_pairs db \"00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899\"\n"
+        "section .text\n"
+        "global int_to_str\n"
+        "int_to_str:\n"
+        "    mov rax, rdi\n"
+        "    mov r8, rsi\n"
+        "    test rax, rax\n"
+        "    jns .positive\n"
+        "    mov byte [r8], '-'\n"
+        "    inc r8\n"
+        "    neg rax\n"                 // INT64_MIN stays 2^63 as an unsigned value
+        ".positive:\n"
+        "    lea r9, [rsp - 8]\n"       // digits go right to left below rsp (leaf: red zone)
+        "    lea r10, [rel int_to_str_pairs]\n"
+        "    mov r11, 0x346DC5D63886594B\n"
+        ".quads:\n"                     // four digits per step: one reciprocal multiply by 1/10000,
+        "    cmp rax, 10000\n"          // then 32-bit x*5243 >> 19 = x/100 splits them into pairs
+        "    jb .pair\n"
+        "    mov rcx, rax\n"
+        "    shr rax, 4\n"
+        "    mul r11\n"
+        "    shr rdx, 7\n"              // rdx = value / 10000 (exact for all 64-bit values)
+        "    imul rax, rdx, 10000\n"
+        "    sub ecx, eax\n"
+        "    imul eax, ecx, 5243\n"
+        "    shr eax, 19\n"
+        "    imul edi, eax, 100\n"
+        "    sub ecx, edi\n"
+        "    movzx eax, word [r10 + rax*2]\n"
+        "    movzx ecx, word [r10 + rcx*2]\n"
+        "    sub r9, 4\n"
+        "    mov [r9], ax\n"
+        "    mov [r9 + 2], cx\n"
+        "    mov rax, rdx\n"
+        "    jmp .quads\n"
+        ".pair:\n"
+        "    cmp eax, 100\n"
+        "    jb .last\n"
+        "    imul ecx, eax, 5243\n"
+        "    shr ecx, 19\n"
+        "    imul edi, ecx, 100\n"
+        "    sub eax, edi\n"
+        "    movzx eax, word [r10 + rax*2]\n"
+        "    sub r9, 2\n"
+        "    mov [r9], ax\n"
+        "    mov eax, ecx\n"
+        ".last:\n"
+        "    cmp eax, 10\n"
+        "    jb .single\n"
+        "    movzx eax, word [r10 + rax*2]\n"
+        "    sub r9, 2\n"
+        "    mov [r9], ax\n"
+        "    jmp .copy\n"
+        ".single:\n"
+        "    add al, '0'\n"
+        "    dec r9\n"
+        "    mov [r9], al\n"
+        ".copy:\n"                      // at most 19 digits: three unconditional 8-byte moves
+        "    lea rcx, [rsp - 8]\n"
+        "    sub rcx, r9\n"
+        "    mov rax, [r9]\n"
+        "    mov rdx, [r9 + 8]\n"
+        "    mov rdi, [r9 + 16]\n"
+        "    mov [r8], rax\n"
+        "    mov [r8 + 8], rdx\n"
+        "    mov [r8 + 16], rdi\n"
+        "    add r8, rcx\n"
+        "    mov byte [r8], 0\n"
+        "    mov rax, r8\n"
+        "    sub rax, rsi\n"
+        "    ret\n" },
+    { .name = "float_to_str", .source =
+        "section .text\n"
+        "global float_to_str\n"
+        "extern int_to_str\n"
+        "extern float_to_str_mulshift\n"
+        "float_to_str:\n"
+        "    push rbx\n"
+        "    push rbp\n"
+        "    push r12\n"
+        "    push r13\n"
+        "    push r14\n"
+        "    push r15\n"
+        "    sub rsp, 88\n"
+        "    mov [rsp + 40], rdi\n"
+        "    movq rax, xmm0\n"
+        "    test rax, rax\n"
+        "    jns .positive\n"
+        "    mov byte [rdi], '-'\n"
+        "    inc rdi\n"
+        "    shl rax, 1\n"
+        "    shr rax, 1\n"
+        ".positive:\n"
+        "    mov [rsp + 32], rdi\n"
+        "    mov r8, 0xFFFFFFFFFFFFF\n"
+        "    and r8, rax\n"
+        "    shr rax, 52\n"
+        "    cmp eax, 0x7FF\n"
+        "    je .special\n"
+        "    test eax, eax\n"
+        "    jnz .normal\n"
+        "    test r8, r8\n"
+        "    jz .zero\n"
+        "    mov r12, r8\n"
+        "    mov r13, -1076\n"
+        "    jmp .bounds\n"
+        ".normal:\n"
+        "    mov r12, 0x10000000000000\n"
+        "    or r12, r8\n"
+        "    lea r13, [rax - 1077]\n"           // e2 = exponent - bias - mantissa bits - 2
+        ".bounds:\n"
+        "    xor ecx, ecx\n"
+        "    test r8, r8\n"
+        "    setnz cl\n"
+        "    cmp eax, 1\n"
+        "    setbe dl\n"
+        "    or cl, dl\n"
+        "    mov [rsp], rcx\n"                  // mmShift: the lower bound is closer at a power of two
+        "    mov eax, r12d\n"
+        "    not eax\n"
+        "    and eax, 1\n"
+        "    mov [rsp + 80], rax\n"             // acceptBounds: even mantissas round-trip from the bounds
+        "    xor eax, eax\n"
+        "    mov [rsp + 16], rax\n"
+        "    mov [rsp + 24], rax\n"
+        "    mov rbp, r12\n"
+        "    shl rbp, 2\n"
+        "    test r13, r13\n"
+        "    js .negative_e2\n"
+        "    imul eax, r13d, 78913\n"           // q = log10(2^e2), minus one above 2^3
+        "    shr eax, 18\n"
+        "    xor ecx, ecx\n"
+        "    cmp r13d, 3\n"
+        "    setg cl\n"
+        "    sub eax, ecx\n"
+        "    mov [rsp + 8], rax\n"
+        "    mov r12d, eax\n"
+        "    imul ecx, eax, 1217359\n"
+        "    shr ecx, 19\n"
+        "    add ecx, 61\n"
+        "    add ecx, eax\n"
+        "    sub ecx, r13d\n"
+        "    mov r11d, ecx\n"
+        "    lea r10, [rel float_to_str_pow5_inv]\n"
+        "    shl rax, 4\n"
+        "    add r10, rax\n"
+        "    mov r8, [rsp]\n"
+        "    call .mulshift_all\n"
+        "    cmp r12d, 21\n"
+        "    ja .digits\n"
+        "    mov rax, rbp\n"
+        "    xor edx, edx\n"
+        "    mov ecx, 5\n"
+        "    div rcx\n"
+        "    test rdx, rdx\n"
+        "    jnz .mv_not5\n"
+        "    mov rax, rbp\n"
+        "    call .pow5_factor\n"
+        "    cmp ecx, r12d\n"
+        "    jb .digits\n"
+        "    mov qword [rsp + 24], 1\n"
+        "    jmp .digits\n"
+        ".mv_not5:\n"
+        "    cmp qword [rsp + 80], 0\n"
+        "    je .vp_adjust\n"
+        "    mov rax, rbp\n"
+        "    sub rax, [rsp]\n"
+        "    dec rax\n"
+        "    call .pow5_factor\n"
+        "    cmp ecx, r12d\n"
+        "    jb .digits\n"
+        "    mov qword [rsp + 16], 1\n"
+        "    jmp .digits\n"
+        ".vp_adjust:\n"
+        "    lea rax, [rbp + 2]\n"
+        "    call .pow5_factor\n"
+        "    cmp ecx, r12d\n"
+        "    jb .digits\n"
+        "    dec r15\n"
+        "    jmp .digits\n"
+        ".negative_e2:\n"
+        "    mov eax, r13d\n"
+        "    neg eax\n"
+        "    imul ecx, eax, 732923\n"           // q = log10(5^-e2), minus one above 5^1
+        "    shr ecx, 20\n"
+        "    xor edx, edx\n"
+        "    cmp eax, 1\n"
+        "    setg dl\n"
+        "    sub ecx, edx\n"
+        "    lea rdx, [rcx + r13]\n"
+        "    mov [rsp + 8], rdx\n"
+        "    sub eax, ecx\n"
+        "    imul edx, eax, 1217359\n"
+        "    shr edx, 19\n"
+        "    mov r12d, ecx\n"
+        "    mov r11d, ecx\n"
+        "    sub r11d, edx\n"
+        "    add r11d, 60\n"
+        "    lea r10, [rel float_to_str_pow5]\n"
+        "    shl rax, 4\n"
+        "    add r10, rax\n"
+        "    mov r8, [rsp]\n"
+        "    call .mulshift_all\n"
+        "    cmp r12d, 1\n"
+        "    ja .q_large\n"
+        "    mov qword [rsp + 24], 1\n"
+        "    cmp qword [rsp + 80], 0\n"
+        "    je .vp_dec\n"
+        "    mov rax, [rsp]\n"
+        "    mov [rsp + 16], rax\n"
+        "    jmp .digits\n"
+        ".vp_dec:\n"
+        "    dec r15\n"
+        "    jmp .digits\n"
+        ".q_large:\n"
+        "    cmp r12d, 63\n"
+        "    jae .digits\n"
+        "    mov ecx, r12d\n"
+        "    mov rax, 1\n"
+        "    shl rax, cl\n"
+        "    dec rax\n"
+        "    test rbp, rax\n"
+        "    jnz .digits\n"
+        "    mov qword [rsp + 24], 1\n"
+        ".digits:\n"
+        "    xor r12d, r12d\n"
+        "    xor r13d, r13d\n"
+        "    mov rcx, 0xCCCCCCCCCCCCCCCD\n"
+        "    mov rax, [rsp + 16]\n"
+        "    or rax, [rsp + 24]\n"
+        "    jnz .general\n"                    // vr/vp/vm may end in zeros: Ryu's general loop
+        "    mov rax, r15\n"
+        "    shr rax, 2\n"
+        "    mov r11, 0x28F5C28F5C28F5C3\n"
+        "    mul r11\n"
+        "    mov r8, rdx\n"
+        "    shr r8, 2\n"
+        "    mov rax, rbx\n"
+        "    shr rax, 2\n"
+        "    mul r11\n"
+        "    mov r9, rdx\n"
+        "    shr r9, 2\n"
+        "    cmp r8, r9\n"
+        "    jbe .by10\n"
+        "    mov rax, r14\n"
+        "    shr rax, 2\n"
+        "    mul r11\n"
+        "    shr rdx, 2\n"
+        "    imul rax, rdx, 100\n"
+        "    mov r10, r14\n"
+        "    sub r10, rax\n"
+        "    cmp r10, 50\n"
+        "    setae r13b\n"
+        "    mov r14, rdx\n"
+        "    mov r15, r8\n"
+        "    mov rbx, r9\n"
+        "    mov r12d, 2\n"
+        ".by10:\n"
+        "    mov rax, r15\n"
+        "    mul rcx\n"
+        "    mov r8, rdx\n"
+        "    shr r8, 3\n"
+        "    mov rax, rbx\n"
+        "    mul rcx\n"
+        "    mov r9, rdx\n"
+        "    shr r9, 3\n"
+        "    cmp r8, r9\n"
+        "    jbe .round\n"
+        "    mov rax, r14\n"
+        "    mul rcx\n"
+        "    shr rdx, 3\n"
+        "    lea rax, [rdx + rdx*4]\n"
+        "    add rax, rax\n"
+        "    mov r10, r14\n"
+        "    sub r10, rax\n"
+        "    xor r13d, r13d\n"
+        "    cmp r10, 5\n"
+        "    setae r13b\n"
+        "    mov r14, rdx\n"
+        "    mov r15, r8\n"
+        "    mov rbx, r9\n"
+        "    inc r12\n"
+        "    jmp .by10\n"
+        ".round:\n"
+        "    cmp r14, rbx\n"
+        "    sete al\n"
+        "    or al, r13b\n"
+        "    movzx eax, al\n"
+        "    add r14, rax\n"
+        "    jmp .format\n"
+        ".general:\n"
+        "    mov rax, r15\n"
+        "    mul rcx\n"
+        "    mov r8, rdx\n"
+        "    shr r8, 3\n"
+        "    mov rax, rbx\n"
+        "    mul rcx\n"
+        "    mov r9, rdx\n"
+        "    shr r9, 3\n"
+        "    cmp r8, r9\n"
+        "    jbe .general_vm\n"
+        "    lea rax, [r9 + r9*4]\n"
+        "    add rax, rax\n"
+        "    cmp rbx, rax\n"
+        "    je .general_vm_zero\n"
+        "    mov qword [rsp + 16], 0\n"
+        ".general_vm_zero:\n"
+        "    test r13, r13\n"
+        "    jz .general_vr_zero\n"
+        "    mov qword [rsp + 24], 0\n"
+        ".general_vr_zero:\n"
+        "    mov rax, r14\n"
+        "    mul rcx\n"
+        "    shr rdx, 3\n"
+        "    lea rax, [rdx + rdx*4]\n"
+        "    add rax, rax\n"
+        "    mov r13, r14\n"
+        "    sub r13, rax\n"
+        "    mov r14, rdx\n"
+        "    mov r15, r8\n"
+        "    mov rbx, r9\n"
+        "    inc r12\n"
+        "    jmp .general\n"
+        ".general_vm:\n"
+        "    cmp qword [rsp + 16], 0\n"
+        "    je .general_round\n"
+        ".general_vm_loop:\n"
+        "    mov rax, rbx\n"
+        "    mul rcx\n"
+        "    mov r9, rdx\n"
+        "    shr r9, 3\n"
+        "    lea rax, [r9 + r9*4]\n"
+        "    add rax, rax\n"
+        "    cmp rbx, rax\n"
+        "    jne .general_round\n"
+        "    test r13, r13\n"
+        "    jz .general_vm_vr\n"
+        "    mov qword [rsp + 24], 0\n"
+        ".general_vm_vr:\n"
+        "    mov rax, r14\n"
+        "    mul rcx\n"
+        "    shr rdx, 3\n"
+        "    lea rax, [rdx + rdx*4]\n"
+        "    add rax, rax\n"
+        "    mov r13, r14\n"
+        "    sub r13, rax\n"
+        "    mov r14, rdx\n"
+        "    mov rax, r15\n"
+        "    mul rcx\n"
+        "    shr rdx, 3\n"
+        "    mov r15, rdx\n"
+        "    mov rbx, r9\n"
+        "    inc r12\n"
+        "    jmp .general_vm_loop\n"
+        ".general_round:\n"
+        "    cmp qword [rsp + 24], 0\n"
+        "    je .general_up\n"
+        "    cmp r13, 5\n"
+        "    jne .general_up\n"
+        "    test r14d, 1\n"
+        "    jnz .general_up\n"
+        "    mov r13d, 4\n"
+        ".general_up:\n"
+        "    xor eax, eax\n"
+        "    cmp r14, rbx\n"
+        "    jne .general_digit\n"
+        "    cmp qword [rsp + 80], 0\n"
+        "    je .general_inc\n"
+        "    cmp qword [rsp + 16], 0\n"
+        "    je .general_inc\n"
+        ".general_digit:\n"
+        "    cmp r13, 5\n"
+        "    jb .general_add\n"
+        ".general_inc:\n"
+        "    mov eax, 1\n"
+        ".general_add:\n"
+        "    add r14, rax\n"
+        ".format:\n"
+        "    mov rdi, r14\n"                    // r14 = shortest digits, [rsp + 8] + r12 = their decimal exponent
+        "    lea rsi, [rsp + 48]\n"
+        "    call int_to_str\n"
+        "    mov r8, rax\n"
+        "    mov r9, [rsp + 8]\n"
+        "    add r9, r12\n"
+        "    lea r10, [r9 + r8 - 1]\n"
+        "    mov rdi, [rsp + 32]\n"
+        "    lea rsi, [rsp + 48]\n"
+        "    cmp r10, -4\n"                     // printf %g's switch to exponent form at 1e-5, but only from 1e16 up
+        "    jl .scientific\n"
+        "    cmp r10, 16\n"
+        "    jge .scientific\n"
+        "    test r9, r9\n"
+        "    js .fraction\n"
+        "    mov rcx, r8\n"
+        "    call .copy\n"
+        "    test r9, r9\n"
+        "    jz .finish\n"
+        ".trailing_zeros:\n"
+        "    mov byte [rdi], '0'\n"
+        "    inc rdi\n"
+        "    dec r9\n"
+        "    jnz .trailing_zeros\n"
+        "    jmp .finish\n"
+        ".fraction:\n"
+        "    test r10, r10\n"
+        "    js .leading_zeros\n"
+        "    lea rcx, [r10 + 1]\n"
+        "    sub r8, rcx\n"
+        "    call .copy\n"
+        "    mov byte [rdi], '.'\n"
+        "    inc rdi\n"
+        "    mov rcx, r8\n"
+        "    call .copy\n"
+        "    jmp .finish\n"
+        ".leading_zeros:\n"
+        "    mov word [rdi], 0x2E30\n"
+        "    add rdi, 2\n"
+        "    mov rcx, -1\n"
+        "    sub rcx, r10\n"
+        "    jz .leading_digits\n"
+        ".leading_zero:\n"
+        "    mov byte [rdi], '0'\n"
+        "    inc rdi\n"
+        "    dec rcx\n"
+        "    jnz .leading_zero\n"
+        ".leading_digits:\n"
+        "    mov rcx, r8\n"
+        "    call .copy\n"
+        "    jmp .finish\n"
+        ".scientific:\n"
+        "    mov rcx, 1\n"
+        "    call .copy\n"
+        "    dec r8\n"
+        "    jz .exponent\n"
+        "    mov byte [rdi], '.'\n"
+        "    inc rdi\n"
+        "    mov rcx, r8\n"
+        "    call .copy\n"
+        ".exponent:\n"
+        "    mov byte [rdi], 'e'\n"
+        "    mov byte [rdi + 1], '+'\n"
+        "    test r10, r10\n"
+        "    jns .exponent_sign\n"
+        "    mov byte [rdi + 1], '-'\n"
+        "    neg r10\n"
+        ".exponent_sign:\n"
+        "    add rdi, 2\n"
+        "    mov eax, r10d\n"
+        "    cmp eax, 100\n"
+        "    jb .exponent_digits\n"
+        "    xor edx, edx\n"
+        "    mov ecx, 100\n"
+        "    div ecx\n"
+        "    add al, '0'\n"
+        "    mov [rdi], al\n"
+        "    inc rdi\n"
+        "    mov eax, edx\n"
+        ".exponent_digits:\n"
+        "    xor edx, edx\n"
+        "    mov ecx, 10\n"
+        "    div ecx\n"
+        "    add al, '0'\n"
+        "    add dl, '0'\n"
+        "    mov [rdi], al\n"
+        "    mov [rdi + 1], dl\n"
+        "    add rdi, 2\n"
+        "    jmp .finish\n"
+        ".special:\n"
+        "    mov dword [rdi], 0x666E69\n"
+        "    test r8, r8\n"
+        "    jz .special_end\n"
+        "    mov dword [rdi], 0x6E616E\n"
+        ".special_end:\n"
+        "    add rdi, 3\n"
+        "    jmp .finish\n"
+        ".zero:\n"
+        "    mov byte [rdi], '0'\n"
+        "    inc rdi\n"
+        ".finish:\n"
+        "    mov byte [rdi], 0\n"
+        "    mov rax, rdi\n"
+        "    sub rax, [rsp + 40]\n"
+        "    add rsp, 88\n"
+        "    pop r15\n"
+        "    pop r14\n"
+        "    pop r13\n"
+        "    pop r12\n"
+        "    pop rbp\n"
+        "    pop rbx\n"
+        "    ret\n"
+        ".copy:\n"
+        "    mov al, [rsi]\n"
+        "    mov [rdi], al\n"
+        "    inc rsi\n"
+        "    inc rdi\n"
+        "    dec rcx\n"
+        "    jnz .copy\n"
+        "    ret\n"
+        ".mulshift_all:\n"                      // r14/r15/rbx = vr/vp/vm = (4m, 4m + 2, 4m - 1 - mmShift) * table entry >> (r11 + 128)
+        "    mov rcx, rbp\n"
+        "    call float_to_str_mulshift\n"
+        "    mov r14, rax\n"
+        "    lea rcx, [rbp + 2]\n"
+        "    call float_to_str_mulshift\n"
+        "    mov r15, rax\n"
+        "    mov rcx, rbp\n"
+        "    sub rcx, r8\n"
+        "    dec rcx\n"
+        "    call float_to_str_mulshift\n"
+        "    mov rbx, rax\n"
+        "    ret\n"
+        ".pow5_factor:\n"                       // ecx = how often 5 divides rax (rax != 0)
+        "    xor ecx, ecx\n"
+        "    mov r9d, 5\n"
+        ".pow5_divide:\n"
+        "    xor edx, edx\n"
+        "    div r9\n"
+        "    test rdx, rdx\n"
+        "    jnz .pow5_done\n"
+        "    inc ecx\n"
+        "    jmp .pow5_divide\n"
+        ".pow5_done:\n"
+        "    ret\n",
+        .tables = rlink_float_tables },
+    // BMI2: mulx leaves rax alone and sets no flags, shrx/shlx take the count from any register
+    { .name = "float_to_str_mulshift", .source =
+        "section .text\n"
+        "global float_to_str_mulshift\n"
+        "float_to_str_mulshift:\n"
+        "    mov rdx, rcx\n"
+        "    mulx r9, rax, [r10]\n"
+        "    mulx rdx, rax, [r10 + 8]\n"
+        "    add rax, r9\n"
+        "    adc rdx, 0\n"
+        "    shrx rax, rax, r11\n"
+        "    mov ecx, r11d\n"
+        "    neg ecx\n"
+        "    shlx rdx, rdx, rcx\n"
+        "    or rax, rdx\n"
+        "    ret\n",
+        .features = X64_FEAT_BMI2 },
+    { .name = "float_to_str_mulshift", .source =
+        "section .text\n"
+        "global float_to_str_mulshift\n"
+        "float_to_str_mulshift:\n"
+        "    mov rax, rcx\n"
+        "    mul qword [r10]\n"
+        "    mov r9, rdx\n"
+        "    mov rax, rcx\n"
+        "    mul qword [r10 + 8]\n"
+        "    add rax, r9\n"
+        "    adc rdx, 0\n"
+        "    mov ecx, r11d\n"
+        "    shr rax, cl\n"
+        "    neg ecx\n"
+        "    shl rdx, cl\n"
+        "    or rax, rdx\n"
+        "    ret\n" },
+};
+
+#define RLINK_RUNTIME_COUNT ((int)(sizeof(rlink_runtime) / sizeof(rlink_runtime[0])))
+
+// Output section classes, in address order
+enum { RLINK_TEXT, RLINK_RODATA, RLINK_DATA, RLINK_BSS, RLINK_CLASSES };
+
+static const char* rlink_class_names[RLINK_CLASSES] = { ".text", ".rodata", ".data", ".bss" };
+
+typedef struct {
+    RasmModule* mod[RLINK_MAX_MODULES];
+    int owned[RLINK_MAX_MODULES];                       // runtime members are freed by the linker
+    int nmod;
+    uint64_t addr[RLINK_MAX_MODULES][RASM_MAX_SECTIONS];    // virtual address of each input section
+    uint64_t class_start[RLINK_CLASSES], class_end[RLINK_CLASSES];
+    int errors;
+} RlinkImage;
+
+static void rlink_error(RlinkImage* L, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "rexion-link: error: ");
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    L->errors++;
+}
+
+static int rlink_class(const RasmSection* s) {
+    if (!s->alloc) return -1;
+    if (s->nobits) return RLINK_BSS;
+    if (s->exec) return RLINK_TEXT;
+    return s->write ? RLINK_DATA : RLINK_RODATA;
+}
+
+// Finds the module that defines global `name`; *sym receives its index there.
+static int rlink_definition(RlinkImage* L, const char* name, int* sym) {
+    for (int m = 0; m < L->nmod; m++) {
+        int s = rasm_find(L->mod[m], name);
+        if (s >= 0 && L->mod[m]->syms[s].global && (L->mod[m]->syms[s].defined || L->mod[m]->syms[s].is_equ)) {
+            *sym = s;
+            return m;
+        }
+    }
+    return -1;
+}
+
+static int rlink_add(RlinkImage* L, RasmModule* M, int owned) {
+    if (L->nmod == RLINK_MAX_MODULES) { rlink_error(L, "too many modules"); return -1; }
+    L->owned[L->nmod] = owned;
+    L->mod[L->nmod++] = M;
+    return 0;
+}
+
+// Pulls runtime members in until every referenced global (and the _start entry) is defined.
+static void rlink_resolve_runtime(RlinkImage* L) {
+    int progress = 1;
+    while (progress && !L->errors) {
+        progress = 0;
+        for (int r = 0; r < RLINK_RUNTIME_COUNT; r++) {
+            const char* name = rlink_runtime[r].name;
+            if (rlink_runtime[r].features & ~x64_features) continue;
+            int sym, needed = strcmp(name, "_start") == 0;
+            if (rlink_definition(L, name, &sym) >= 0) continue;
+            for (int m = 0; m < L->nmod && !needed; m++) {
+                int s = rasm_find(L->mod[m], name);
+                needed = s >= 0 && L->mod[m]->syms[s].external;
+            }
+            if (!needed) continue;
+            char file[64];
+            snprintf(file, sizeof(file), "<runtime:%s>", name);
+            RasmModule* M = rasm_new(file);
+            const char* src = rlink_runtime[r].source;
+            char* text = NULL;
+            size_t len = strlen(src);
+            if (rlink_runtime[r].tables) {
+                FILE* mem = open_memstream(&text, &len);
+                fputs(src, mem);
+                rlink_runtime[r].tables(mem);
+                fclose(mem);
+                src = text;
+            }
+            int rc = rasm_parse(M, src, len);
+            free(text);
+            if (rc != 0 || rasm_assemble(M) != 0) {
+                rlink_error(L, "runtime member %s failed to assemble", name);
+                rasm_free(M);
+                return;
+            }
+            if (rlink_add(L, M, 1) != 0) { rasm_free(M); return; }
+            progress = 1;
+        }
+    }
+}
+
+// Assigns addresses: R+X segment from the headers on, R+W segment on the next page.
+static void rlink_layout(RlinkImage* L, uint64_t header_size) {
+    uint64_t at = RLINK_BASE + header_size;
+    for (int c = 0; c < RLINK_CLASSES; c++) {
+        if (c == RLINK_DATA) at = (at + RLINK_PAGE - 1) & ~(RLINK_PAGE - 1);
+        int first = 1;
+        L->class_start[c] = at;
+        for (int m = 0; m < L->nmod; m++) {
+            RasmModule* M = L->mod[m];
+            for (int s = 0; s < M->nsec; s++) {
+                if (rlink_class(&M->sec[s]) != c) continue;
+                uint64_t align = (uint64_t)(M->sec[s].align > 0 ? M->sec[s].align : 1);
+                at = (at + align - 1) / align * align;
+                if (first) L->class_start[c] = at;
+                first = 0;
+                L->addr[m][s] = at;
+                at += (uint64_t)M->sec[s].size;
+            }
+        }
+        L->class_end[c] = at;
+    }
+}
+
+// Address of symbol `sym` as seen from module `m` (locals first, then the global definition).
+static int rlink_symbol_value(RlinkImage* L, int m, int sym, uint64_t* value) {
+    RasmModule* M = L->mod[m];
+    RasmSymbol* s = &M->syms[sym];
+    if (s->is_equ) {
+        int64_t k;
+        int rs;
+        if (rasm_eval(M, &s->equ, &k, &rs, 0) != 0) { L->errors++; return -1; }
+        uint64_t base = 0;
+        if (rs >= 0 && rlink_symbol_value(L, m, rs, &base) != 0) return -1;
+        *value = base + (uint64_t)k;
+        return 0;
+    }
+    if (s->defined && s->section >= 0) {
+        *value = L->addr[m][s->section] + (uint64_t)s->value;
+        return 0;
+    }
+    int ds, dm = rlink_definition(L, s->name, &ds);
+    if (dm < 0) {
+        rlink_error(L, "undefined reference to `%s' (from %s)", s->name, M->file ? M->file : "<asm>");
+        return -1;
+    }
+    return rlink_symbol_value(L, dm, ds, value);
+}
+
+static void rlink_apply(RlinkImage* L, int m, int s, uint8_t* image) {
+    RasmModule* M = L->mod[m];
+    RasmSection* sec = &M->sec[s];
+    for (int r = 0; r < sec->nrelocs; r++) {
+        const RasmReloc* rel = &sec->relocs[r];
+        uint64_t S;
+        if (rlink_symbol_value(L, m, rel->sym, &S) != 0) continue;
+        uint64_t P = L->addr[m][s] + rel->offset;
+        uint8_t* at = image + (L->addr[m][s] - RLINK_BASE) + rel->offset;
+        int64_t v = (int64_t)(S + (uint64_t)rel->addend);
+        int width = 4;
+        switch ((X64FixupKind)rel->kind) {
+            case X64_FIX_REL32:
+                v -= (int64_t)(P + 4);
+                if (v != (int32_t)v) rlink_error(L, "relocation to `%s' out of range", M->syms[rel->sym].name);
+                break;
+            case X64_FIX_ABS32:
+                if ((uint64_t)v > 0xFFFFFFFFULL) rlink_error(L, "relocation to `%s' out of range", M->syms[rel->sym].name);
+                break;
+            case X64_FIX_ABS32S:
+                if (v != (int32_t)v) rlink_error(L, "relocation to `%s' out of range", M->syms[rel->sym].name);
+                break;
+            case X64_FIX_ABS64:
+                width = 8;
+                break;
+            default:
+                rlink_error(L, "unsupported relocation kind %d", rel->kind);
+                continue;
+        }
+        for (int k = 0; k < width; k++) at[k] = (uint8_t)((uint64_t)v >> (8 * k));
+    }
+}
+
+// Section headers and a symbol table so objdump/gdb can read the executable.
+static void rlink_write_sections(RlinkImage* L, ElfBuffer* out, Elf64_Ehdr* eh) {
+    ElfBuffer shstrtab = { 0 }, strtab = { 0 }, symtab = { 0 };
+    Elf64_Shdr sh[RLINK_CLASSES + 4];
+    int index[RLINK_CLASSES] = { 0 };
+    int n = 1;
+    memset(sh, 0, sizeof(sh));
+    elf_put(&shstrtab, "", 1);
+    elf_put(&strtab, "", 1);
+    for (int c = 0; c < RLINK_CLASSES; c++) {
+        if (L->class_end[c] == L->class_start[c]) continue;
+        Elf64_Shdr* h = &sh[n];
+        index[c] = n++;
+        h->sh_name = elf_string(&shstrtab, rlink_class_names[c]);
+        h->sh_type = c == RLINK_BSS ? SHT_NOBITS : SHT_PROGBITS;
+        h->sh_flags = SHF_ALLOC | (c == RLINK_TEXT ? SHF_EXECINSTR : 0) | (c >= RLINK_DATA ? SHF_WRITE : 0);
+        h->sh_addr = L->class_start[c];
+        h->sh_offset = L->class_start[c] - RLINK_BASE;
+        h->sh_size = L->class_end[c] - L->class_start[c];
+        h->sh_addralign = 16;
+    }
+
+    Elf64_Sym sym;
+    memset(&sym, 0, sizeof(sym));
+    elf_put(&symtab, &sym, sizeof(sym));
+    int first_global = 1;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int m = 0; m < L->nmod; m++) {
+            RasmModule* M = L->mod[m];
+            for (int i = 0; i < M->nsyms; i++) {
+                RasmSymbol* s = &M->syms[i];
+                if (s->internal || s->external || s->is_equ || !s->defined || s->section < 0 || s->global != pass) continue;
+                int c = rlink_class(&M->sec[s->section]);
+                if (c < 0) continue;
+                memset(&sym, 0, sizeof(sym));
+                sym.st_name = elf_string(&strtab, s->name);
+                sym.st_info = ELF64_ST_INFO(pass ? STB_GLOBAL : STB_LOCAL, c == RLINK_TEXT ? STT_FUNC : STT_OBJECT);
+                sym.st_shndx = (uint16_t)index[c];
+                sym.st_value = L->addr[m][s->section] + (uint64_t)s->value;
+                elf_put(&symtab, &sym, sizeof(sym));
+                if (!pass) first_global++;
+            }
+        }
+    }
+
+    int shstr = n++, symidx = n++, stridx = n++;
+    sh[shstr].sh_name = elf_string(&shstrtab, ".shstrtab");
+    sh[symidx].sh_name = elf_string(&shstrtab, ".symtab");
+    sh[stridx].sh_name = elf_string(&shstrtab, ".strtab");
+
+    sh[symidx].sh_type = SHT_SYMTAB;
+    sh[symidx].sh_addralign = 8;
+    sh[symidx].sh_entsize = sizeof(Elf64_Sym);
+    sh[symidx].sh_link = (uint32_t)stridx;
+    sh[symidx].sh_info = (uint32_t)first_global;
+    elf_align(out, 8);
+    sh[symidx].sh_offset = out->len;
+    sh[symidx].sh_size = symtab.len;
+    elf_put(out, symtab.data, symtab.len);
+
+    sh[stridx].sh_type = SHT_STRTAB;
+    sh[stridx].sh_addralign = 1;
+    sh[stridx].sh_offset = out->len;
+    sh[stridx].sh_size = strtab.len;
+    elf_put(out, strtab.data, strtab.len);
+
+    sh[shstr].sh_type = SHT_STRTAB;
+    sh[shstr].sh_addralign = 1;
+    sh[shstr].sh_offset = out->len;
+    sh[shstr].sh_size = shstrtab.len;
+    elf_put(out, shstrtab.data, shstrtab.len);
+
+    elf_align(out, 8);
+    eh->e_shoff = out->len;
+    eh->e_shentsize = sizeof(Elf64_Shdr);
+    eh->e_shnum = (uint16_t)n;
+    eh->e_shstrndx = (uint16_t)shstr;
+    elf_put(out, sh, (size_t)n * sizeof(Elf64_Shdr));
+    free(shstrtab.data); free(strtab.data); free(symtab.data);
+}
+
+// Links assembled modules (plus the runtime members they need) into a static ELF64 executable.
+int rlink_link_modules(RasmModule** mods, int nmods, const char* exe_path) {
+    RlinkImage* L = calloc(1, sizeof(RlinkImage));
+    if (!L) { perror("rlink_link_modules"); return -1; }
+    for (int i = 0; i < nmods && !L->errors; i++) rlink_add(L, mods[i], 0);
+
+    // one definition per global
+    for (int m = 0; m < L->nmod && !L->errors; m++) {
+        RasmModule* M = L->mod[m];
+        for (int i = 0; i < M->nsyms; i++) {
+            RasmSymbol* s = &M->syms[i];
+            if (!s->global) continue;
+            int ds, dm = rlink_definition(L, s->name, &ds);
+            if (dm != m) rlink_error(L, "multiple definition of `%s' (%s and %s)", s->name,
+                                     L->mod[dm]->file ? L->mod[dm]->file : "<asm>", M->file ? M->file : "<asm>");
+        }
+    }
+    rlink_resolve_runtime(L);
+
+    int entry_sym = -1, entry_mod = L->errors ? -1 : rlink_definition(L, "_start", &entry_sym);
+    if (!L->errors && entry_mod < 0) rlink_error(L, "no _start or main to use as the entry point");
+
+    int has_rw = 0;
+    for (int m = 0; m < L->nmod; m++)
+        for (int s = 0; s < L->mod[m]->nsec; s++)
+            if (rlink_class(&L->mod[m]->sec[s]) >= RLINK_DATA && L->mod[m]->sec[s].size) has_rw = 1;
+    int nphdr = has_rw ? 3 : 2;     // R+X, [R+W], GNU_STACK
+    rlink_layout(L, sizeof(Elf64_Ehdr) + (uint64_t)nphdr * sizeof(Elf64_Phdr));
+
+    uint64_t entry = 0;
+    if (!L->errors) rlink_symbol_value(L, entry_mod, entry_sym, &entry);
+
+    // image = file bytes of both segments; .bss is memory-only
+    ElfBuffer out = { 0 };
+    size_t file_size = (size_t)(L->class_end[RLINK_DATA] - RLINK_BASE);
+    if (!has_rw) file_size = (size_t)(L->class_end[RLINK_RODATA] - RLINK_BASE);
+    elf_put(&out, NULL, file_size);
+    for (int m = 0; m < L->nmod && !L->errors; m++) {
+        RasmModule* M = L->mod[m];
+        for (int s = 0; s < M->nsec; s++) {
+            int c = rlink_class(&M->sec[s]);
+            if (c < 0 || c == RLINK_BSS) continue;
+            memcpy(out.data + (L->addr[m][s] - RLINK_BASE), M->sec[s].out.code, M->sec[s].out.len);
+            rlink_apply(L, m, s, out.data);
+        }
+    }
+
+    int rc = -1;
+    if (!L->errors) {
+        Elf64_Ehdr* eh = (Elf64_Ehdr*)out.data;
+        memcpy(eh->e_ident, ELFMAG, SELFMAG);
+        eh->e_ident[EI_CLASS] = ELFCLASS64;
+        eh->e_ident[EI_DATA] = ELFDATA2LSB;
+        eh->e_ident[EI_VERSION] = EV_CURRENT;
+        eh->e_ident[EI_OSABI] = ELFOSABI_SYSV;
+        eh->e_type = ET_EXEC;
+        eh->e_machine = EM_X86_64;
+        eh->e_version = EV_CURRENT;
+        eh->e_entry = entry;
+        eh->e_phoff = sizeof(Elf64_Ehdr);
+        eh->e_ehsize = sizeof(Elf64_Ehdr);
+        eh->e_phentsize = sizeof(Elf64_Phdr);
+        eh->e_phnum = (uint16_t)nphdr;
+
+        Elf64_Phdr* ph = (Elf64_Phdr*)(out.data + sizeof(Elf64_Ehdr));
+        ph[0].p_type = PT_LOAD;
+        ph[0].p_flags = PF_R | PF_X;
+        ph[0].p_offset = 0;
+        ph[0].p_vaddr = ph[0].p_paddr = RLINK_BASE;
+        ph[0].p_filesz = ph[0].p_memsz = L->class_end[RLINK_RODATA] - RLINK_BASE;
+        ph[0].p_align = RLINK_PAGE;
+        if (has_rw) {
+            ph[1].p_type = PT_LOAD;
+            ph[1].p_flags = PF_R | PF_W;
+            ph[1].p_offset = L->class_start[RLINK_DATA] - RLINK_BASE;
+            ph[1].p_vaddr = ph[1].p_paddr = L->class_start[RLINK_DATA];
+            ph[1].p_filesz = L->class_end[RLINK_DATA] - L->class_start[RLINK_DATA];
+            ph[1].p_memsz = L->class_end[RLINK_BSS] - L->class_start[RLINK_DATA];
+            ph[1].p_align = RLINK_PAGE;
+        }
+        ph[nphdr - 1].p_type = PT_GNU_STACK;
+        ph[nphdr - 1].p_flags = PF_R | PF_W;
+        ph[nphdr - 1].p_align = 16;
+
+        Elf64_Ehdr header = *eh;
+        rlink_write_sections(L, &out, &header);
+        memcpy(out.data, &header, sizeof(header));      // out.data may have moved
+
+        FILE* f = fopen(exe_path, "wb");
+        rc = 0;
+        if (!f || fwrite(out.data, 1, out.len, f) != out.len) { perror(exe_path); rc = -1; }
+        if (f && fclose(f) != 0) rc = -1;
+        if (rc == 0) chmod(exe_path, 0755);
+    }
+    for (int m = 0; m < L->nmod; m++)
+        if (L->owned[m]) rasm_free(L->mod[m]);
+    free(out.data);
+    free(L);
+    return rc;
+}
+
+// Assembles and links NASM sources in-process (nasm + ld/gcc equivalent).
+int rlink_link_files(const char** asm_paths, int npaths, const char* exe_path) {
+    RasmModule* mods[RLINK_MAX_MODULES];
+    int n = 0, rc = 0;
+    if (npaths > RLINK_MAX_MODULES) { fprintf(stderr, "rexion-link: error: too many modules\n"); return -1; }
+    for (int i = 0; i < npaths; i++) {
+        RasmModule* M = rasm_assemble_source(asm_paths[i]);
+        if (!M) { rc = -1; continue; }
+        mods[n++] = M;
+    }
+    if (rc == 0) rc = rlink_link_modules(mods, n, exe_path);
+    for (int i = 0; i < n; i++) rasm_free(mods[i]);
+    return rc;
+}
+
+// The div-by-10 int_to_str the runtime used before (one hardware divide per digit), for --bench-itoa
+static const char* rlink_itoa_div10 =
+    "int_to_str_div10:\n"
+    "    push rbx\n"
+    "    sub rsp, 32\n"
+    "    mov rax, rdi\n"
+    "    mov r8, rsi\n"
+    "    lea r9, [rsp + 32]\n"
+    "    mov ebx, 10\n"
+    "    test rax, rax\n"
+    "    jns .digits\n"
+    "    mov byte [r8], '-'\n"
+    "    inc r8\n"
+    "    neg rax\n"                 // INT64_MIN stays 2^63 as an unsigned dividend
+    ".digits:\n"
+    "    xor edx, edx\n"
+    "    div rbx\n"
+    "    add dl, '0'\n"
+    "    dec r9\n"
+    "    mov [r9], dl\n"
+    "    test rax, rax\n"
+    "    jnz .digits\n"
+    "    lea rcx, [rsp + 32]\n"
+    ".copy:\n"
+    "    mov dl, [r9]\n"
+    "    mov [r8], dl\n"
+    "    inc r8\n"
+    "    inc r9\n"
+    "    cmp r9, rcx\n"
+    "    jne .copy\n"
+    "    mov byte [r8], 0\n"
+    "    mov rax, r8\n"
+    "    sub rax, rsi\n"
+    "    add rsp, 32\n"
+    "    pop rbx\n"
+    "    ret\n";
+
+static double rlink_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Bench program: n pseudo-random values of every magnitude and sign. mode 0 checks int_to_str
+// against the div-by-10 routine byte for byte (exit status 1 on a mismatch), mode 1 / 2 only
+// formats with the old / new routine, mode 3 calls a routine that formats nothing (loop cost).
+static int rlink_bench_itoa_write(const char* path, long long n, int mode) {
+    static const char* callee[4] = { "int_to_str_div10", "int_to_str_div10", "int_to_str", "int_to_str_none" };
+    FILE* f = fopen(path, "w");
+    if (!f) { perror(path); return -1; }
+    fprintf(f, "section .bss\nbench_a resb 32\nbench_b resb 32\nsection .text\nglobal main\n%s",
+        mode == 0 || mode == 2 ? "extern int_to_str\n" : "");
+    if (mode < 2) fputs(rlink_itoa_div10, f);
+    if (mode == 3) fputs("int_to_str_none:\n    xor eax, eax\n    ret\n", f);
+    fprintf(f,
+        "main:\n"
+        "    push rbx\n"
+        "    push r12\n"
+        "    push r13\n"
+        "    push r14\n"
+        "    push r15\n"
+        "    mov rbx, %lld\n"
+        "    mov r12, 0x9E3779B97F4A7C15\n"
+        "    xor r13d, r13d\n"
+        ".loop:\n"
+        "    mov rax, 6364136223846793005\n"
+        "    imul r12, rax\n"
+        "    mov rax, 1442695040888963407\n"
+        "    add r12, rax\n"
+        "    mov r15, r12\n"
+        "    mov ecx, ebx\n"
+        "    and ecx, 63\n"
+        "    sar r15, cl\n"
+        "    mov rdi, r15\n"
+        "    lea rsi, [rel bench_a]\n"
+        "    call %s\n", n, callee[mode]);
+    if (mode == 0)
+        fputs("    mov r14, rax\n"
+              "    mov rdi, r15\n"
+              "    lea rsi, [rel bench_b]\n"
+              "    call int_to_str\n"
+              "    cmp rax, r14\n"
+              "    jne .bad\n"
+              "    lea r8, [rel bench_a]\n"
+              "    lea r9, [rel bench_b]\n"
+              "    xor ecx, ecx\n"
+              ".cmp:\n"
+              "    mov dl, [r8 + rcx]\n"
+              "    cmp dl, [r9 + rcx]\n"
+              "    jne .bad\n"
+              "    inc rcx\n"
+              "    cmp rcx, rax\n"
+              "    jbe .cmp\n"
+              "    jmp .next\n"
+              ".bad:\n"
+              "    inc r13\n"
+              ".next:\n", f);
+    fputs("    dec rbx\n"
+          "    jnz .loop\n"
+          "    xor eax, eax\n"
+          "    test r13, r13\n"
+          "    setnz al\n"
+          "    pop r15\n"
+          "    pop r14\n"
+          "    pop r13\n"
+          "    pop r12\n"
+          "    pop rbx\n"
+          "    ret\n", f);
+    return fclose(f);
+}
+
+#define RLINK_BENCH_RUNS 3
+
+// --bench-itoa: the runtime's int_to_str against the div-by-10 routine, linked and run as programs.
+// Each timing is the best of RLINK_BENCH_RUNS runs; the loop's own cost (value generation, call,
+// process start) is measured separately and taken off both routines before they are compared.
+void rlink_bench_int_to_str(long long n) {
+    static const char* names[4] = { "check", "div10", "pairs", "loop" };
+    static const int order[4] = { 0, 3, 1, 2 };
+    const char* asm_path = "rexion_itoa_bench.asm";
+    const char* exe_path = "./rexion_itoa_bench.exe";
+    double ms[4] = { 0, 0, 0, 0 };
+    printf("[ITOA-BENCH] %lld values, best of %d runs\n", n, RLINK_BENCH_RUNS);
+    for (int k = 0; k < 4; k++) {
+        int mode = order[k], status = 0;
+        if (rlink_bench_itoa_write(asm_path, n, mode) != 0 || rlink_link_files(&asm_path, 1, exe_path) != 0) return;
+        for (int run = 0; run < (mode ? RLINK_BENCH_RUNS : 1); run++) {
+            double t0 = rlink_now_ms();
+            status = system(exe_path);
+            double t = rlink_now_ms() - t0;
+            if (!run || t < ms[mode]) ms[mode] = t;
+        }
+        remove(asm_path);
+        remove(exe_path);
+        if (mode == 0) {
+            int ok = status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            printf("[ITOA-BENCH] %s: int_to_str %s the div-by-10 routine\n", names[mode], ok ? "matches" : "DIFFERS from");
+            if (!ok) return;
+            continue;
+        }
+        if (mode == 3) {
+            printf("[ITOA-BENCH] %s  %10.1f ms  %6.1f ns/value (taken off below)\n", names[mode], ms[3], n > 0 ? ms[3] * 1e6 / n : 0.0);
+            continue;
+        }
+        double net = ms[mode] - ms[3];
+        printf("[ITOA-BENCH] %s %10.1f ms  %6.1f ns/value", names[mode], net, n > 0 ? net * 1e6 / n : 0.0);
+        if (mode == 2) printf("  (%.2fx vs div10)", net > 0 ? (ms[1] - ms[3]) / net : 0.0);
+        printf("\n");
+    }
+}
+
+// Bench values: the fixed cases, then n pseudo-random doubles cycling through raw bit patterns
+// (every exponent, subnormals, inf, nan), integers of every magnitude and decimals /1000 and /3.
+// The bench program computes the same sequence with the same SSE2 operations.
+static const double rlink_dtoa_divisors[2] = { 1000.0, 3.0 };
+
+static uint64_t rlink_f64_bits(double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, 8);
+    return bits;
+}
+
+static int rlink_dtoa_fixed(double* v) {
+    static const char* cases[] = {
+        "0", "-0", "1", "-1.5", "0.1", "0.2", "0.3", "2.5", "4.35", "123.456", "0.0001", "0.00012345", "1e-5",
+        "1.25e-7", "100", "299792458", "1e15", "1e16", "1e17", "123456789012345678", "9007199254740993",
+        "1e21", "1e22", "1e23", "9.999999999999999e22", "6.02214076e23", "1.602176634e-19", "1e300",
+        "5e-324", "5e-310", "2.225073858507201e-308", "2.2250738585072014e-308", "1.7976931348623157e308",
+        "inf", "-inf", "nan",
+    };
+    int n = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) v[n++] = strtod(cases[i], NULL);
+    v[n++] = 1.0 / 3;
+    v[n++] = 2.0 / 3;
+    for (int e = -1074; e <= 1023; e++) v[n++] = ldexp(1.0, e);
+    for (int e = -323; e <= 308; e++) {
+        char text[16];
+        snprintf(text, sizeof(text), "1e%d", e);
+        v[n++] = strtod(text, NULL);
+    }
+    return n;
+}
+
+static double rlink_dtoa_random(uint64_t* state, long long left) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    int64_t x = (int64_t)*state;
+    double d;
+    switch (left & 3) {
+    case 0: memcpy(&d, state, 8); return d;
+    case 1: return (double)(x >> (left & 63));
+    default: return (double)(x >> 40) / rlink_dtoa_divisors[(left & 3) - 2];
+    }
+}
+
+// mode 0 prints every value, mode 1 only formats.
+static int rlink_bench_dtoa_write(const char* path, const double* fixed, int nfixed, long long n, int mode) {
+    FILE* f = fopen(path, "w");
+    if (!f) { perror(path); return -1; }
+    fprintf(f, "section .rodata\nalign 8\nbench_divisors dq 0x%016llx, 0x%016llx\nbench_fixed:\n",
+        (unsigned long long)rlink_f64_bits(rlink_dtoa_divisors[0]), (unsigned long long)rlink_f64_bits(rlink_dtoa_divisors[1]));
+    for (int i = 0; i < nfixed; i++) fprintf(f, "    dq 0x%016llx\n", (unsigned long long)rlink_f64_bits(fixed[i]));
+    fprintf(f,
+        "section .bss\nbench_buf resb 32\nsection .text\nglobal main\nextern float_to_str\n%s"
+        "main:\n"
+        "    push rbx\n"
+        "    push r12\n"
+        "    push r13\n"
+        "    xor r13d, r13d\n"
+        ".fixed:\n"
+        "    cmp r13, %d\n"
+        "    jae .random\n"
+        "    lea rax, [rel bench_fixed]\n"
+        "    movsd xmm0, [rax + r13*8]\n"
+        "    call .emit\n"
+        "    inc r13\n"
+        "    jmp .fixed\n"
+        ".random:\n"
+        "    mov rbx, %lld\n"
+        "    mov r12, 0x9E3779B97F4A7C15\n"
+        "    test rbx, rbx\n"
+        "    jz .done\n"
+        ".loop:\n"
+        "    mov rax, 6364136223846793005\n"
+        "    imul r12, rax\n"
+        "    mov rax, 1442695040888963407\n"
+        "    add r12, rax\n"
+        "    mov eax, ebx\n"
+        "    and eax, 3\n"
+        "    jnz .integer\n"
+        "    movq xmm0, r12\n"
+        "    jmp .value\n"
+        ".integer:\n"
+        "    cmp eax, 1\n"
+        "    jne .decimal\n"
+        "    mov rdi, r12\n"
+        "    mov ecx, ebx\n"
+        "    and ecx, 63\n"
+        "    sar rdi, cl\n"
+        "    cvtsi2sd xmm0, rdi\n"
+        "    jmp .value\n"
+        ".decimal:\n"
+        "    mov rdi, r12\n"
+        "    sar rdi, 40\n"
+        "    cvtsi2sd xmm0, rdi\n"
+        "    lea rcx, [rel bench_divisors]\n"
+        "    divsd xmm0, [rcx + rax*8 - 16]\n"
+        ".value:\n"
+        "    call .emit\n"
+        "    dec rbx\n"
+        "    jnz .loop\n"
+        ".done:\n"
+        "    xor eax, eax\n"
+        "    pop r13\n"
+        "    pop r12\n"
+        "    pop rbx\n"
+        "    ret\n"
+        ".emit:\n"
+        "    lea rdi, [rel bench_buf]\n"
+        "    call float_to_str\n", mode == 0 ? "extern print_string\n" : "", nfixed, n);
+    if (mode == 0)
+        fputs("    lea rsi, [rel bench_buf]\n"
+              "    mov word [rsi + rax], 10\n"
+              "    jmp print_string\n", f);
+    else
+        fputs("    ret\n", f);
+    return fclose(f);
+}
+
+// One printed value against strtod: it must read back bit for bit, no shorter digit string may
+// read back, and it must be the correctly rounded value of its digit count whenever that one reads
+// back too. Returns what failed, or NULL.
+static const char* rlink_dtoa_check(double d, const char* text) {
+    if (isnan(d)) return strcmp(text, signbit(d) ? "-nan" : "nan") == 0 ? NULL : "nan";
+    char* end;
+    double back = strtod(text, &end);
+    if (*end || rlink_f64_bits(back) != rlink_f64_bits(d)) return "round trip";
+    if (isinf(d) || d == 0) return NULL;
+    char digits[32], want[40];
+    int n = 0;
+    for (const char* c = text; *c && *c != 'e'; c++)
+        if (*c >= '0' && *c <= '9' && (n || *c != '0') && n < 31) digits[n++] = *c;
+    while (n > 1 && digits[n - 1] == '0') n--;
+    if (n > 17) return "too long";
+    if (n > 1) {
+        snprintf(want, sizeof(want), "%.*e", n - 2, d);
+        if (strtod(want, NULL) == d) return "not shortest";
+    }
+    snprintf(want, sizeof(want), "%.*e", n - 1, d);
+    if (strtod(want, NULL) != d) return NULL;      // below the closer bound of a power of two
+    for (int i = 0, k = 0; i < n; i++, k++) {
+        if (want[k] == '-') k++;
+        if (want[k] == '.') k++;
+        if (want[k] != digits[i]) return "not closest";
+    }
+    return NULL;
+}
+
+// --bench-dtoa: sweeps float_to_str against strtod, then times it against libc's %.17g.
+void rlink_bench_float_to_str(long long n) {
+    const char* asm_path = "rexion_dtoa_bench.asm";
+    const char* exe_path = "./rexion_dtoa_bench.exe";
+    double* fixed = malloc(4096 * sizeof(double));
+    int nfixed = rlink_dtoa_fixed(fixed);
+    printf("[DTOA-BENCH] %d fixed cases + %lld random values\n", nfixed, n);
+
+    if (rlink_bench_dtoa_write(asm_path, fixed, nfixed, n, 0) != 0 || rlink_link_files(&asm_path, 1, exe_path) != 0) { free(fixed); return; }
+    FILE* p = popen(exe_path, "r");
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    long long seen = 0, failures = 0;
+    char line[64];
+    while (p && seen < nfixed + n && fgets(line, sizeof(line), p)) {
+        line[strcspn(line, "\n")] = 0;
+        double d = seen < nfixed ? fixed[seen] : rlink_dtoa_random(&state, n - (seen - nfixed));
+        const char* why = rlink_dtoa_check(d, line);
+        if (why && failures++ < 5) printf("[DTOA-BENCH] %s: %.17g printed as \"%s\"\n", why, d, line);
+        seen++;
+    }
+    if (p) pclose(p);
+    printf("[DTOA-BENCH] sweep: %lld of %lld values checked, %lld failures\n", seen, nfixed + n, failures);
+    remove(asm_path);
+    remove(exe_path);
+    if (failures || seen != nfixed + n) { free(fixed); return; }
+
+    if (rlink_bench_dtoa_write(asm_path, fixed, nfixed, n, 1) != 0 || rlink_link_files(&asm_path, 1, exe_path) != 0) { free(fixed); return; }
+    double t0 = rlink_now_ms();
+    system(exe_path);
+    double ms_rt = rlink_now_ms() - t0;
+    remove(asm_path);
+    remove(exe_path);
+
+    char buf[32];
+    long long sink = 0;
+    state = 0x9E3779B97F4A7C15ULL;
+    t0 = rlink_now_ms();
+    for (int i = 0; i < nfixed; i++) sink += snprintf(buf, sizeof(buf), "%.17g", fixed[i]);
+    for (long long left = n; left > 0; left--) sink += snprintf(buf, sizeof(buf), "%.17g", rlink_dtoa_random(&state, left));
+    double ms_libc = rlink_now_ms() - t0;
+    long long total = nfixed + n;
+    printf("[DTOA-BENCH] libc %%.17g %10.1f ms  %6.1f ns/value  (%lld bytes)\n", ms_libc, ms_libc * 1e6 / total, sink);
+    printf("[DTOA-BENCH] float_to_str %7.1f ms  %6.1f ns/value  (%.2fx vs libc)\n", ms_rt, ms_rt * 1e6 / total,
+        ms_rt > 0 ? ms_libc / ms_rt : 0.0);
+    free(fixed);
+}
+
+// rexion_isel_arm64.c – Rexion IR -> AArch64 GNU assembly backend (instruction selection, register allocation)
+// DOC: The ARCH_ARM64 side of generate_asm(): the IR buffer is scanned by rexion_isel.c's isel_scan
+// DOC: (blocks, loop- or profile-weighted homes, temporaries, deferred single-use definitions) and lowered with
+// DOC: the same VM semantics, then selected for AArch64 instead of x86-64
+// DOC: Homes: the most-used integer names live in callee-saved x19-x27, the most-used float names in
+// DOC: d8-d15, the rest in rx_vars off x28; temporaries are virtual registers given x0-x15 by a
+// DOC: linear scan over each block, demoted to memory and reselected when they do not fit
+// DOC: Selection: a deferred x*2^k becomes a shifted add/sub operand, a deferred x*y fuses into
+// DOC: madd/msub, compares feed b.cond (cbz/cbnz against zero); sdiv already yields 0 for x/0
+// DOC: Output is a self-contained static program for GNU as/ld (aarch64-linux-gnu): _start, a 64 KiB
+// DOC: stdout buffer and the x86-64 runtime's int_to_str/float_to_str (Ryu) ported to AArch64
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define A64_PINNED 9
+#define A64_FPINNED 8
+#define A64_XZR 31
+#define A64_SP 32
+#define A64_VARS 28                     // x28: base of rx_vars
+#define A64_IP0 16                      // x16: address scratch (constant pool, far rx_vars entries)
+#define A64_CALL_CLOBBERS 0x4003FFFFu   // x0-x17, x30
+
+static const int a64_pin_regs[A64_PINNED] = { 19, 20, 21, 22, 23, 24, 25, 26, 27 };
+static const int a64_fpin_regs[A64_FPINNED] = { 8, 9, 10, 11, 12, 13, 14, 15 };
+static const int a64_scratch_regs[] = { 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+
+enum { A64_NONE, A64_X, A64_D, A64_IMM, A64_MEM, A64_LAB };
+
+typedef struct {
+    uint8_t kind;
+    int8_t reg;             // A64_X / A64_D register, A64_MEM base register
+    int v;                  // virtual register standing in for reg, 0 = physical
+    int64_t imm;            // A64_IMM value, A64_MEM offset
+    int label;              // A64_LAB target, A64_MEM [reg, :lo12:label]; -1 when unused
+} A64Opnd;
+
+enum {
+    A64_LABEL, A64_MOV, A64_MOVZ, A64_MOVN, A64_MOVK, A64_ADD, A64_SUB, A64_NEG, A64_MUL, A64_MADD, A64_MSUB,
+    A64_SDIV, A64_LSL, A64_LSR, A64_ASR, A64_AND, A64_CMP, A64_CMN, A64_CSET, A64_CSEL, A64_CBZ, A64_CBNZ,
+    A64_B, A64_BCC, A64_BL, A64_RET, A64_LDR, A64_STR, A64_ADRP, A64_ADD_LO12,
+    A64_FMOV, A64_FADD, A64_FSUB, A64_FMUL, A64_FDIV, A64_PUSH_LR, A64_POP_LR, A64_OP_COUNT
+};
+
+static const char* const a64_mnemonic[A64_OP_COUNT] = {
+    "", "mov", "movz", "movn", "movk", "add", "sub", "neg", "mul", "madd", "msub",
+    "sdiv", "lsl", "lsr", "asr", "and", "cmp", "cmn", "cset", "csel", "cbz", "cbnz",
+    "b", "b.", "bl", "ret", "ldr", "str", "adrp", "add",
+    "fmov", "fadd", "fsub", "fmul", "fdiv", "str", "ldr"
+};
+
+enum { A64_EQ = 0, A64_NE = 1, A64_GE = 10, A64_LT = 11, A64_GT = 12, A64_LE = 13 };
+static const char* const a64_cond_name[14] = { "eq", "ne", "hs", "lo", "mi", "pl", "vs", "vc", "hi", "ls", "ge", "lt", "gt", "le" };
+
+typedef struct {
+    uint8_t op, cond, nops;
+    uint8_t shift_op;       // A64_LSL / A64_LSR applied to the last operand, 0 for none
+    uint8_t shift;
+    A64Opnd o[4];
+    uint32_t implicit;      // x registers clobbered without being operands (calls)
+} A64Inst;
+
+typedef struct {
+    int pinned, fpinned, temps;
+    int shifted;            // deferred x*2^k used as a shifted register operand
+    int madd;               // deferred multiplies fused into madd/msub
+    int fused;              // compares branched on directly
+    int strength;           // multiplies/divides by constants turned into shifts
+    int demoted;            // temporaries moved back to memory by the allocator
+} A64Stats;
+
+typedef struct {
+    IselCompiler* S;        // names, blocks, labels and constant pools from rexion_isel.c's scan
+    int8_t* fpin;           // float name -> index into a64_fpin_regs, -1 when not pinned
+    A64Inst* code;
+    int ncode, code_cap;
+    int l_body, l_exit;
+    A64Stats st;
+} A64Compiler;
+
+// === Operands and emission ===
+
+static A64Opnd a64_none(void) {
+    A64Opnd o;
+    memset(&o, 0, sizeof(o));
+    o.label = -1;
+    return o;
+}
+
+static A64Opnd a64_x(int reg) {
+    A64Opnd o = a64_none();
+    o.kind = A64_X;
+    o.reg = (int8_t)reg;
+    return o;
+}
+
+static A64Opnd a64_d(int reg) {
+    A64Opnd o = a64_none();
+    o.kind = A64_D;
+    o.reg = (int8_t)reg;
+    return o;
+}
+
+static A64Opnd a64_imm(int64_t k) {
+    A64Opnd o = a64_none();
+    o.kind = A64_IMM;
+    o.imm = k;
+    return o;
+}
+
+static A64Opnd a64_mem(A64Opnd base, int64_t off) {
+    base.kind = A64_MEM;
+    base.imm = off;
+    return base;
+}
+
+static A64Opnd a64_lo12(int reg, int label) {
+    A64Opnd o = a64_mem(a64_x(reg), 0);
+    o.label = label;
+    return o;
+}
+
+static A64Opnd a64_lab(int label) {
+    A64Opnd o = a64_none();
+    o.kind = A64_LAB;
+    o.label = label;
+    return o;
+}
+
+static A64Opnd a64_vreg(A64Compiler* A, int slot) {
+    A64Opnd o = a64_x(0);
+    o.v = isel_new_vreg(A->S, slot).v;
+    return o;
+}
+
+static int a64_same(A64Opnd a, A64Opnd b) {
+    if (a.kind != b.kind) return 0;
+    if (a.kind == A64_X || a.kind == A64_D) return a.v || b.v ? a.v == b.v : a.reg == b.reg;
+    if (a.kind == A64_MEM) return !a.v && !b.v && a.reg == b.reg && a.imm == b.imm && a.label == b.label;
+    return 0;
+}
+
+static A64Inst* a64_emit(A64Compiler* A, int op, A64Opnd a, A64Opnd b, A64Opnd c, A64Opnd d) {
+    if (A->ncode == A->code_cap) {
+        A->code_cap = A->code_cap ? A->code_cap * 2 : 1024;
+        A->code = realloc(A->code, (size_t)A->code_cap * sizeof(A64Inst));
+        if (!A->code) { perror("a64_emit"); exit(1); }
+    }
+    A64Inst* in = &A->code[A->ncode++];
+    memset(in, 0, sizeof(*in));
+    A64Opnd ops[4] = { a, b, c, d };
+    in->op = (uint8_t)op;
+    for (int k = 0; k < 4 && ops[k].kind != A64_NONE; k++) {
+        in->o[k] = ops[k];
+        in->nops = (uint8_t)(k + 1);
+    }
+    return in;
+}
+
+static A64Inst* a64_op(A64Compiler* A, int op, A64Opnd a, A64Opnd b, A64Opnd c) {
+    return a64_emit(A, op, a, b, c, a64_none());
+}
+
+static void a64_shifted(A64Inst* in, int shift_op, int n) {
+    if (!n) return;
+    in->shift_op = (uint8_t)shift_op;
+    in->shift = (uint8_t)n;
+}
+
+static void a64_bind(A64Compiler* A, int label) {
+    a64_op(A, A64_LABEL, a64_lab(label), a64_none(), a64_none());
+}
+
+static void a64_jump(A64Compiler* A, int label) {
+    a64_op(A, A64_B, a64_lab(label), a64_none(), a64_none());
+}
+
+static void a64_bcc(A64Compiler* A, int cc, int label) {
+    a64_op(A, A64_BCC, a64_lab(label), a64_none(), a64_none())->cond = (uint8_t)cc;
+}
+
+// bl keeping the link register: IR calls nest and the helpers are called from inside them, so
+// every call site saves x30 around its bl.
+static void a64_call(A64Compiler* A, int label) {
+    a64_op(A, A64_PUSH_LR, a64_none(), a64_none(), a64_none());
+    a64_op(A, A64_BL, a64_lab(label), a64_none(), a64_none())->implicit = A64_CALL_CLOBBERS;
+    a64_op(A, A64_POP_LR, a64_none(), a64_none(), a64_none());
+}
+
+// === Immediates and moves ===
+
+// add/sub/cmp immediate: 12 bits, optionally shifted left by 12
+static int a64_arith_imm(int64_t k) {
+    return k >= 0 && (k < 4096 || ((k & 0xFFF) == 0 && k < (1 << 24)));
+}
+
+// fmov immediate: +-n/16 * 2^r with n in 16..31 and r in -3..4
+static int a64_fp_imm(int64_t bits) {
+    double f;
+    memcpy(&f, &bits, 8);
+    for (int n = 16; n < 32; n++)
+        for (int r = -3; r <= 4; r++) {
+            double v = n / 16.0 * (r < 0 ? 1.0 / (1 << -r) : (double)(1 << r));
+            if (f == v || f == -v) return 1;
+        }
+    return 0;
+}
+
+// movz (or movn when most 16-bit chunks are all ones) for the first chunk that differs from the
+// background, movk for the others.
+static void a64_load_imm(A64Compiler* A, A64Opnd r, int64_t k) {
+    uint64_t u = (uint64_t)k;
+    int ones = 0, zeros = 0;
+    for (int h = 0; h < 4; h++) {
+        uint16_t c = (uint16_t)(u >> (16 * h));
+        ones += c == 0xFFFF;
+        zeros += c == 0;
+    }
+    int neg = ones > zeros, first = 1;
+    uint16_t bg = neg ? 0xFFFF : 0;
+    for (int h = 0; h < 4; h++) {
+        uint16_t c = (uint16_t)(u >> (16 * h));
+        if (c == bg) continue;
+        int op = !first ? A64_MOVK : neg ? A64_MOVN : A64_MOVZ;
+        a64_shifted(a64_op(A, op, r, a64_imm(op == A64_MOVN ? (uint16_t)~c : c), a64_none()), A64_LSL, 16 * h);
+        first = 0;
+    }
+    if (first) a64_op(A, neg ? A64_MOVN : A64_MOVZ, r, a64_imm(0), a64_none());
+}
+
+// ldr/str against a memory operand; rx_vars offsets past the scaled 12-bit range go through x16.
+static void a64_ldst(A64Compiler* A, int op, A64Opnd r, A64Opnd m) {
+    if (m.label < 0 && m.imm > 32760) {
+        A64Opnd ip = a64_x(A64_IP0);
+        A64Opnd base = m;
+        base.kind = A64_X;
+        base.imm = 0;
+        a64_op(A, A64_ADD, ip, base, a64_imm(m.imm & ~(int64_t)0xFFF));
+        m = a64_mem(ip, m.imm & 0xFFF);
+    }
+    a64_op(A, op, r, m, a64_none());
+}
+
+static A64Opnd a64_reg(A64Compiler* A, A64Opnd o);
+
+// Copies the 64 bits of `src` (register, immediate, memory home) to `dst`: integer and float homes
+// exchange raw bits, as in the VM.
+static void a64_move(A64Compiler* A, A64Opnd dst, A64Opnd src) {
+    if (a64_same(dst, src)) return;
+    if (dst.kind == A64_MEM) {
+        if (src.kind == A64_IMM && src.imm == 0) src = a64_x(A64_XZR);
+        else if (src.kind == A64_IMM || src.kind == A64_MEM) src = a64_reg(A, src);
+        a64_ldst(A, A64_STR, src, dst);
+        return;
+    }
+    if (src.kind == A64_MEM) {
+        a64_ldst(A, A64_LDR, dst, src);
+        return;
+    }
+    if (src.kind == A64_IMM && dst.kind == A64_X) {
+        a64_load_imm(A, dst, src.imm);
+        return;
+    }
+    if (src.kind == A64_IMM) {
+        // d register: fmov immediate, xzr, or the constant pool
+        if (src.imm == 0) {
+            a64_op(A, A64_FMOV, dst, a64_x(A64_XZR), a64_none());
+        } else if (a64_fp_imm(src.imm)) {
+            a64_op(A, A64_FMOV, dst, src, a64_none());
+        } else {
+            double f;
+            memcpy(&f, &src.imm, 8);
+            int l = isel_float_const(A->S, f);
+            a64_op(A, A64_ADRP, a64_x(A64_IP0), a64_lab(l), a64_none());
+            a64_op(A, A64_LDR, dst, a64_lo12(A64_IP0, l), a64_none());
+        }
+        return;
+    }
+    a64_op(A, dst.kind == A64_X && src.kind == A64_X ? A64_MOV : A64_FMOV, dst, src, a64_none());
+}
+
+// An x register holding `o`: itself, or a virtual register it is loaded into.
+static A64Opnd a64_reg(A64Compiler* A, A64Opnd o) {
+    if (o.kind == A64_X) return o;
+    A64Opnd t = a64_vreg(A, -1);
+    a64_move(A, t, o);
+    return t;
+}
+
+// Register to compute a result for `dst` in: dst itself when it is an x register.
+static A64Opnd a64_result(A64Compiler* A, A64Opnd dst) {
+    return dst.kind == A64_X ? dst : a64_vreg(A, -1);
+}
+
+// === Names ===
+
+static void a64_lower(A64Compiler* A, int i, int force);
+
+// Where name slot `s` lives: its temporary's virtual register, pinned x or d register, or rx_vars entry.
+static A64Opnd a64_home(A64Compiler* A, int s) {
+    IselCompiler* S = A->S;
+    if (S->temp[s]) {
+        if (S->vreg[s] <= S->block_v0) S->vreg[s] = a64_vreg(A, s).v;
+        A64Opnd o = a64_x(0);
+        o.v = S->vreg[s];
+        return o;
+    }
+    if (S->pin[s] >= 0) return a64_x(a64_pin_regs[S->pin[s]]);
+    if (A->fpin[s] >= 0) return a64_d(a64_fpin_regs[A->fpin[s]]);
+    return a64_mem(a64_x(A64_VARS), 8 * (int64_t)s);
+}
+
+// Source operand for IR arg `id` (isel_value's rules): an immediate (float literals as their bits),
+// a register or a memory home; a deferred definition is copied through or computed here.
+static A64Opnd a64_value(A64Compiler* A, uint32_t id) {
+    int64_t k;
+    double f;
+    if (isel_int_literal(id, &k) || (isel_float_literal(id, &f) && (memcpy(&k, &f, 8), 1))) return a64_imm(k);
+    int s;
+    const IRInstruction* def = isel_take_pending(A->S, id, &s);
+    if (def) {
+        int p = A->S->pending[s];
+        A->S->pending[s] = -1;
+        if (def->opcode == IR_OP_LOAD || def->opcode == IR_OP_MOV || def->opcode == IR_OP_STORE) return a64_value(A, def->arg[1]);
+        a64_lower(A, p, 1);
+    }
+    return a64_home(A, s);
+}
+
+static A64Opnd a64_value_reg(A64Compiler* A, uint32_t id) {
+    return a64_reg(A, a64_value(A, id));
+}
+
+// === Instruction selection ===
+
+// add/sub of an immediate; negative ones flip the operation, wide ones take a register.
+static void a64_addsub_imm(A64Compiler* A, int op, A64Opnd r, A64Opnd a, int64_t k) {
+    if (k < 0 && k != INT64_MIN) {
+        k = -k;
+        op = op == A64_ADD ? A64_SUB : A64_ADD;
+    }
+    if (!k) a64_move(A, r, a);
+    else if (a64_arith_imm(k)) a64_op(A, op, r, a, a64_imm(k));
+    else if (k < (1 << 24)) {
+        a64_op(A, op, r, a, a64_imm(k & ~(int64_t)0xFFF));
+        a64_op(A, op, r, r, a64_imm(k & 0xFFF));
+    } else {
+        a64_op(A, op, r, a, a64_reg(A, a64_imm(k)));
+    }
+}
+
+// ADD/SUB; a deferred multiply on the right becomes a shifted operand (by 2^k) or madd/msub.
+static void a64_addsub(A64Compiler* A, const IRInstruction* in, int sub) {
+    IselCompiler* S = A->S;
+    int d = isel_slot(S, in->arg[0]);
+    uint32_t a_id, b_id;
+    isel_operands(in, &a_id, &b_id);
+    int64_t ka, kb;
+    int la = isel_int_literal(a_id, &ka), lb = isel_int_literal(b_id, &kb);
+    if (la && lb) {
+        a64_move(A, a64_home(A, d), a64_imm((int64_t)(sub ? (uint64_t)ka - (uint64_t)kb : (uint64_t)ka + (uint64_t)kb)));
+        return;
+    }
+    int s;
+    const IRInstruction* ma = isel_take_pending(S, a_id, &s);
+    const IRInstruction* mb = isel_take_pending(S, b_id, &s);
+    if (!sub && (la || (ma && ma->opcode == IR_OP_MUL && !(mb && mb->opcode == IR_OP_MUL)))) {
+        uint32_t t = a_id; a_id = b_id; b_id = t;
+        mb = ma;
+    }
+    if (mb && mb->opcode == IR_OP_MUL && mb->nargs == 3) {
+        isel_take_pending(S, b_id, &s);
+        S->pending[s] = -1;
+        A64Opnd a = a64_value_reg(A, a_id);
+        uint32_t x_id, y_id;
+        isel_operands(mb, &x_id, &y_id);
+        int64_t k;
+        if (isel_int_literal(x_id, &k)) { uint32_t t = x_id; x_id = y_id; y_id = t; }
+        A64Opnd dst = a64_home(A, d);
+        A64Opnd r = a64_result(A, dst);
+        if (isel_int_literal(y_id, &k) && k > 0 && isel_log2(k) >= 0) {
+            A64Opnd x = a64_value_reg(A, x_id);
+            a64_shifted(a64_op(A, sub ? A64_SUB : A64_ADD, r, a, x), A64_LSL, isel_log2(k));
+            A->st.shifted += k > 1;
+        } else {
+            A64Opnd x = a64_value_reg(A, x_id), y = a64_value_reg(A, y_id);
+            a64_emit(A, sub ? A64_MSUB : A64_MADD, r, x, y, a);
+            A->st.madd++;
+        }
+        a64_move(A, dst, r);
+        return;
+    }
+    A64Opnd a = a64_value(A, a_id), b = a64_value(A, b_id);
+    if (!sub && a.kind == A64_IMM) { A64Opnd t = a; a = b; b = t; }
+    a = a64_reg(A, a);
+    A64Opnd dst = a64_home(A, d);
+    A64Opnd r = a64_result(A, dst);
+    if (b.kind == A64_IMM) a64_addsub_imm(A, sub ? A64_SUB : A64_ADD, r, a, b.imm);
+    else a64_op(A, sub ? A64_SUB : A64_ADD, r, a, a64_reg(A, b));
+    a64_move(A, dst, r);
+}
+
+static void a64_mul(A64Compiler* A, const IRInstruction* in) {
+    IselCompiler* S = A->S;
+    int d = isel_slot(S, in->arg[0]);
+    uint32_t a_id, b_id;
+    isel_operands(in, &a_id, &b_id);
+    int64_t ka, kb;
+    int la = isel_int_literal(a_id, &ka), lb = isel_int_literal(b_id, &kb);
+    if (la && lb) { a64_move(A, a64_home(A, d), a64_imm((int64_t)((uint64_t)ka * (uint64_t)kb))); return; }
+    if (la) { uint32_t t = a_id; a_id = b_id; b_id = t; kb = ka; lb = 1; }
+    if (lb && kb == 0) { a64_move(A, a64_home(A, d), a64_imm(0)); return; }
+    A64Opnd a = a64_value_reg(A, a_id);
+    A64Opnd dst = a64_home(A, d);
+    A64Opnd r = a64_result(A, dst);
+    int n = lb && kb > 0 ? isel_log2(kb) : -1;
+    int n1 = lb && kb > 2 ? isel_log2(kb - 1) : -1;
+    if (lb && kb == 1) {
+        a64_move(A, r, a);
+    } else if (n > 0) {
+        a64_op(A, A64_LSL, r, a, a64_imm(n));
+        A->st.strength++;
+    } else if (n1 > 0) {
+        // x * (2^n + 1) = x + (x << n)
+        a64_shifted(a64_op(A, A64_ADD, r, a, a), A64_LSL, n1);
+        A->st.strength++;
+    } else if (lb && kb == -1) {
+        a64_op(A, A64_NEG, r, a, a64_none());
+    } else {
+        a64_op(A, A64_MUL, r, a, lb ? a64_reg(A, a64_imm(kb)) : a64_value_reg(A, b_id));
+    }
+    a64_move(A, dst, r);
+}
+
+// DIV/MOD with the VM's semantics. sdiv already yields 0 for a zero divisor; the remainder
+// a - (a/b)*b would then be a, so it is replaced by 0 with csel.
+static void a64_divmod(A64Compiler* A, const IRInstruction* in, int want_rem) {
+    IselCompiler* S = A->S;
+    int d = isel_slot(S, in->arg[0]);
+    uint32_t a_id, b_id;
+    isel_operands(in, &a_id, &b_id);
+    int64_t ka, kb;
+    if (isel_int_literal(b_id, &kb)) {
+        if (kb == 0 || (want_rem && (kb == 1 || kb == -1))) { a64_move(A, a64_home(A, d), a64_imm(0)); return; }
+        if (isel_int_literal(a_id, &ka) && !(ka == INT64_MIN && kb == -1)) {
+            a64_move(A, a64_home(A, d), a64_imm(want_rem ? ka % kb : ka / kb));
+            return;
+        }
+        if (kb == 1) { a64_move(A, a64_home(A, d), a64_value(A, a_id)); return; }
+        int n = kb > 1 ? isel_log2(kb) : -1;
+        A64Opnd x = a64_value_reg(A, a_id);
+        A64Opnd t = a64_vreg(A, -1);
+        if (kb == -1) {
+            a64_op(A, A64_NEG, t, x, a64_none());
+        } else if (n > 0) {
+            // round toward zero: add 2^n-1 to negative dividends before shifting
+            a64_op(A, A64_ASR, t, x, a64_imm(63));
+            a64_shifted(a64_op(A, A64_ADD, t, x, t), A64_LSR, 64 - n);
+            if (want_rem) {
+                a64_op(A, A64_AND, t, t, a64_imm((int64_t)~(((uint64_t)1 << n) - 1)));
+                A64Opnd r = a64_vreg(A, -1);
+                a64_op(A, A64_SUB, r, x, t);
+                t = r;
+            } else {
+                a64_op(A, A64_ASR, t, t, a64_imm(n));
+            }
+            A->st.strength++;
+        } else {
+            // nonzero constant divisor: no zero test
+            A64Opnd b = a64_reg(A, a64_imm(kb));
+            a64_op(A, A64_SDIV, t, x, b);
+            if (want_rem) {
+                A64Opnd r = a64_vreg(A, -1);
+                a64_emit(A, A64_MSUB, r, t, b, x);
+                t = r;
+            }
+        }
+        a64_move(A, a64_home(A, d), t);
+        return;
+    }
+    A64Opnd x = a64_value_reg(A, a_id), b = a64_value_reg(A, b_id);
+    A64Opnd q = a64_vreg(A, -1);
+    a64_op(A, A64_SDIV, q, x, b);
+    if (want_rem) {
+        A64Opnd r = a64_vreg(A, -1);
+        a64_emit(A, A64_MSUB, r, q, b, x);
+        a64_op(A, A64_CMP, b, a64_imm(0), a64_none());
+        a64_op(A, A64_CSEL, r, r, a64_x(A64_XZR))->cond = A64_NE;
+        q = r;
+    }
+    a64_move(A, a64_home(A, d), q);
+}
+
+static int a64_cmp_cc(int opcode) {
+    static const uint8_t cc[6] = { A64_EQ, A64_NE, A64_LT, A64_LE, A64_GT, A64_GE };
+    return cc[opcode - IR_OP_CMP_EQ];
+}
+
+// cmp with the register first (cmn for a negated immediate); returns the condition that holds when
+// the compare is true.
+static int a64_cmp(A64Compiler* A, const IRInstruction* in) {
+    uint32_t a_id, b_id;
+    isel_operands(in, &a_id, &b_id);
+    int cc = a64_cmp_cc(in->opcode);
+    A64Opnd a = a64_value(A, a_id), b = a64_value(A, b_id);
+    if (a.kind == A64_IMM && b.kind != A64_IMM) {
+        A64Opnd t = a; a = b; b = t;
+        if (cc == A64_LT) cc = A64_GT;
+        else if (cc == A64_GT) cc = A64_LT;
+        else if (cc == A64_LE) cc = A64_GE;
+        else if (cc == A64_GE) cc = A64_LE;
+    }
+    a = a64_reg(A, a);
+    if (b.kind == A64_IMM && a64_arith_imm(b.imm)) a64_op(A, A64_CMP, a, b, a64_none());
+    else if (b.kind == A64_IMM && b.imm != INT64_MIN && a64_arith_imm(-b.imm)) a64_op(A, A64_CMN, a, a64_imm(-b.imm), a64_none());
+    else a64_op(A, A64_CMP, a, a64_reg(A, b), a64_none());
+    return cc;
+}
+
+static void a64_compare(A64Compiler* A, const IRInstruction* in) {
+    int d = isel_slot(A->S, in->arg[0]);
+    int64_t k;
+    if (isel_cmp_const(in, &k)) { a64_move(A, a64_home(A, d), a64_imm(k)); return; }
+    int cc = a64_cmp(A, in);
+    A64Opnd dst = a64_home(A, d);
+    A64Opnd r = a64_result(A, dst);
+    a64_op(A, A64_CSET, r, a64_none(), a64_none())->cond = (uint8_t)cc;
+    a64_move(A, dst, r);
+}
+
+// Jump to `label` when the value of `id` is zero: a deferred compare becomes cmp + b.cond (cbz/cbnz
+// when it tests against zero), any other value cbz.
+static void a64_branch_zero(A64Compiler* A, uint32_t id, int label) {
+    int s;
+    const IRInstruction* def = isel_take_pending(A->S, id, &s);
+    if (def && def->opcode >= IR_OP_CMP_EQ && def->opcode <= IR_OP_CMP_GE) {
+        A->S->pending[s] = -1;
+        int64_t k;
+        if (isel_cmp_const(def, &k)) {
+            if (!k) a64_jump(A, label);
+            return;
+        }
+        A->st.fused++;
+        uint32_t a_id, b_id;
+        isel_operands(def, &a_id, &b_id);
+        if (isel_int_literal(a_id, &k) && !k) { uint32_t t = a_id; a_id = b_id; b_id = t; }
+        if ((def->opcode == IR_OP_CMP_EQ || def->opcode == IR_OP_CMP_NE) && isel_int_literal(b_id, &k) && !k) {
+            A64Opnd x = a64_value_reg(A, a_id);
+            a64_op(A, def->opcode == IR_OP_CMP_EQ ? A64_CBNZ : A64_CBZ, x, a64_lab(label), a64_none());
+            return;
+        }
+        a64_bcc(A, a64_cmp(A, def) ^ 1, label);
+        return;
+    }
+    A64Opnd v = a64_value(A, id);
+    if (v.kind == A64_IMM) {
+        if (!v.imm) a64_jump(A, label);
+        return;
+    }
+    a64_op(A, A64_CBZ, a64_reg(A, v), a64_lab(label), a64_none());
+}
+
+// Float operand in a d register: a pinned home as it is, anything else loaded into d`scratch`.
+static A64Opnd a64_float_src(A64Compiler* A, uint32_t id, int scratch) {
+    int64_t k;
+    double f;
+    A64Opnd v;
+    if (isel_int_literal(id, &k)) {
+        f = (double)k;
+        memcpy(&k, &f, 8);
+        v = a64_imm(k);
+    } else {
+        v = a64_value(A, id);
+    }
+    if (v.kind == A64_D) return v;
+    a64_move(A, a64_d(scratch), v);
+    return a64_d(scratch);
+}
+
+static void a64_float_op(A64Compiler* A, const IRInstruction* in, int op) {
+    int d = isel_slot(A->S, in->arg[0]);
+    uint32_t a_id, b_id;
+    isel_operands(in, &a_id, &b_id);
+    A64Opnd a = a64_float_src(A, a_id, 0), b = a64_float_src(A, b_id, 1);
+    A64Opnd dst = a64_home(A, d);
+    A64Opnd r = dst.kind == A64_D ? dst : a64_d(0);
+    a64_op(A, op, r, a, b);
+    a64_move(A, dst, r);
+}
+
+static void a64_print(A64Compiler* A, const IRInstruction* in) {
+    IselCompiler* S = A->S;
+    uint32_t id = in->arg[0];
+    int kind = in->opcode != IR_OP_PRINT ? ISEL_PRINT_FLOAT : ISEL_PRINT_INT;
+    int64_t k;
+    if (!isel_is_literal(id)) {
+        int s = isel_slot(S, id);
+        if (S->is_float[s]) kind = ISEL_PRINT_FLOAT;
+        else if (S->is_string[s] && kind == ISEL_PRINT_INT) kind = ISEL_PRINT_STR;
+    } else if (!isel_int_literal(id, &k)) {
+        kind = ISEL_PRINT_FLOAT;
+    }
+    if (kind == ISEL_PRINT_FLOAT) a64_move(A, a64_d(0), a64_float_src(A, id, 0));
+    else a64_move(A, a64_x(kind == ISEL_PRINT_STR ? 1 : 0), a64_value(A, id));
+    a64_call(A, S->l_print[kind]);
+    S->used_print[kind] = 1;
+}
+
+// Lowers ir[i]; a deferred definition only records itself unless `force`d by its use.
+static void a64_lower(A64Compiler* A, int i, int force) {
+    IselCompiler* S = A->S;
+    const IRInstruction* in = &ir[i];
+    int op = in->opcode;
+    if (!force && S->fold[i] && S->temp[isel_slot(S, in->arg[0])]) {
+        S->pending[isel_slot(S, in->arg[0])] = i;
+        return;
+    }
+    switch ((IROpcode)op) {
+        case IR_OP_NOP: case IR_OP_SECTION: case IR_OP_ENTRY: case IR_OP_IMPORT: case IR_OP_DECLARE:
+        case IR_OP_PARAM: case IR_OP_ARG:
+            break;
+        case IR_OP_LOAD: case IR_OP_MOV: case IR_OP_STORE: case IR_OP_FLOAT_LOAD: {
+            if (in->nargs < 2) break;
+            int d = isel_slot(S, in->arg[0]);
+            int64_t k;
+            double f;
+            if (isel_float_literal(in->arg[1], &f) && (op == IR_OP_FLOAT_LOAD || !isel_int_literal(in->arg[1], &k))) {
+                memcpy(&k, &f, 8);
+                a64_move(A, a64_home(A, d), a64_imm(k));
+                break;
+            }
+            A64Opnd v = a64_value(A, in->arg[1]);
+            a64_move(A, a64_home(A, d), v);
+            break;
+        }
+        case IR_OP_LOAD_STR: {
+            A64Opnd dst = a64_home(A, isel_slot(S, in->arg[0]));
+            A64Opnd r = a64_result(A, dst);
+            int l = isel_string(S, in->arg[1]);
+            a64_op(A, A64_ADRP, r, a64_lab(l), a64_none());
+            a64_op(A, A64_ADD_LO12, r, r, a64_lab(l));
+            a64_move(A, dst, r);
+            break;
+        }
+        case IR_OP_ADD: a64_addsub(A, in, 0); break;
+        case IR_OP_SUB: a64_addsub(A, in, 1); break;
+        case IR_OP_MUL: a64_mul(A, in); break;
+        case IR_OP_DIV: a64_divmod(A, in, 0); break;
+        case IR_OP_MOD: a64_divmod(A, in, 1); break;
+        case IR_OP_FLOAT_ADD: a64_float_op(A, in, A64_FADD); break;
+        case IR_OP_FLOAT_SUB: a64_float_op(A, in, A64_FSUB); break;
+        case IR_OP_FLOAT_MUL: a64_float_op(A, in, A64_FMUL); break;
+        case IR_OP_FLOAT_DIV: a64_float_op(A, in, A64_FDIV); break;
+        case IR_OP_CMP_EQ: case IR_OP_CMP_NE: case IR_OP_CMP_LT: case IR_OP_CMP_LE: case IR_OP_CMP_GT: case IR_OP_CMP_GE:
+            a64_compare(A, in);
+            break;
+        case IR_OP_PRINT: case IR_OP_PRINT_FLOAT_SYSCALL: case IR_OP_PRINT_FLOAT_PRINTF:
+            a64_print(A, in);
+            break;
+        case IR_OP_LABEL: case IR_OP_FUNC:
+            a64_bind(A, isel_label_of(S, in->arg[0]));
+            break;
+        case IR_OP_JMP:
+            a64_jump(A, isel_label_of(S, in->arg[0]));
+            break;
+        case IR_OP_IFZ:
+            a64_branch_zero(A, in->arg[0], isel_label_of(S, in->arg[1]));
+            break;
+        case IR_OP_CALL:
+            // a call right before RET is a tail call: b, so the callee's ret returns for both
+            if (i + 1 < ir_count && ir[i + 1].opcode == IR_OP_RET) a64_jump(A, isel_label_of(S, in->arg[0]));
+            else a64_call(A, isel_label_of(S, in->arg[0]));
+            break;
+        case IR_OP_RET:
+            a64_op(A, A64_RET, a64_none(), a64_none(), a64_none());
+            break;
+        case IR_OP_HALT:
+            a64_jump(A, A->l_exit);
+            break;
+        case IR_OP_IF:
+            a64_branch_zero(A, in->arg[0], S->ctl[2 * i]);
+            break;
+        case IR_OP_ELSE:
+            a64_jump(A, S->ctl[2 * i + 1]);
+            a64_bind(A, S->ctl[2 * i]);
+            break;
+        case IR_OP_END_IF:
+            a64_bind(A, S->ctl[2 * i]);
+            break;
+        case IR_OP_WHILE:
+            a64_bind(A, S->ctl[2 * i + 1]);
+            a64_branch_zero(A, in->arg[0], S->ctl[2 * i]);
+            break;
+        case IR_OP_END_WHILE:
+            a64_jump(A, S->ctl[2 * i + 1]);
+            a64_bind(A, S->ctl[2 * i]);
+            break;
+        default:
+            fprintf(stderr, "[A64] unsupported IR op '%s'\n", ir_str(in->op));
+            S->errors++;
+    }
+}
+
+// === Register allocation ===
+
+// Physical x registers an instruction touches: register operands, address bases and implicit ones.
+static uint32_t a64_phys(const A64Inst* in) {
+    uint32_t m = in->implicit;
+    for (int k = 0; k < in->nops; k++) {
+        const A64Opnd* o = &in->o[k];
+        if ((o->kind == A64_X || o->kind == A64_MEM) && !o->v && o->reg >= 0 && o->reg < A64_XZR) m |= 1u << o->reg;
+    }
+    return m;
+}
+
+// isel_allocate's linear scan over the virtual registers created since v0 in code[from..), with
+// x9-x15 then x0-x8 as the scratch registers. Returns the temporary to demote, 0 when all fit.
+static int a64_allocate(A64Compiler* A, int from, int v0) {
+    IselCompiler* S = A->S;
+    int n = S->nvregs - v0;
+    if (n <= 0) return 0;
+    int* first = malloc((size_t)n * sizeof(int));
+    int* last = malloc((size_t)n * sizeof(int));
+    int* reg = malloc((size_t)n * sizeof(int));
+    int* order = malloc((size_t)n * sizeof(int));
+    if (!first || !last || !reg || !order) { perror("a64_allocate"); exit(1); }
+    for (int i = 0; i < n; i++) first[i] = -1;
+    int norder = 0;
+    for (int p = from; p < A->ncode; p++)
+        for (int k = 0; k < A->code[p].nops; k++) {
+            int v = A->code[p].o[k].v - v0 - 1;
+            if (v < 0) continue;
+            if (first[v] < 0) { first[v] = p; order[norder++] = v; }
+            last[v] = p;
+        }
+    int until[32], holder[32];
+    for (int r = 0; r < 32; r++) until[r] = holder[r] = -1;
+    int bad = 0;
+    for (int i = 0; i < norder && !bad; i++) {
+        int v = order[i];
+        uint32_t mask = 0;
+        for (int p = first[v]; p <= last[v]; p++) mask |= a64_phys(&A->code[p]);
+        reg[v] = -1;
+        for (size_t r = 0; r < sizeof(a64_scratch_regs) / sizeof(a64_scratch_regs[0]); r++) {
+            int R = a64_scratch_regs[r];
+            if ((mask >> R & 1) || until[R] > first[v]) continue;
+            reg[v] = R;
+            until[R] = last[v];
+            holder[R] = v;
+            break;
+        }
+        if (reg[v] >= 0) continue;
+        int spill = S->vreg_slot[v0 + 1 + v] >= 0 ? v : -1;
+        for (int R = 0; R < 32; R++) {
+            int h = holder[R];
+            if (h < 0 || until[R] <= first[v] || S->vreg_slot[v0 + 1 + h] < 0) continue;
+            if (spill < 0 || last[h] > last[spill]) spill = h;
+        }
+        bad = v0 + 1 + (spill >= 0 ? spill : v);
+    }
+    if (!bad)
+        for (int p = from; p < A->ncode; p++)
+            for (int k = 0; k < A->code[p].nops; k++) {
+                A64Opnd* o = &A->code[p].o[k];
+                if (o->v) o->reg = (int8_t)reg[o->v - v0 - 1];
+            }
+    free(first); free(last); free(reg); free(order);
+    return bad;
+}
+
+// Selects and allocates IR ops [from, to) of one block, demoting temporaries until it fits.
+static void a64_block(A64Compiler* A, int from, int to) {
+    IselCompiler* S = A->S;
+    int c0 = A->ncode;
+    A64Stats st0 = A->st;
+    for (;;) {
+        S->block_v0 = S->nvregs;
+        for (int i = from; i < to; i++) a64_lower(A, i, 0);
+        int bad = a64_allocate(A, c0, S->block_v0);
+        if (!bad) return;
+        int slot = S->vreg_slot[bad], demoted = 0;
+        S->nvregs = S->block_v0;
+        A->ncode = c0;
+        if (slot >= 0) {
+            S->temp[slot] = 0;
+            demoted = 1;
+        } else {
+            for (int s = 0; s < S->nslots; s++)
+                if (S->temp[s] && S->first[s] >= from && S->first[s] < to) { S->temp[s] = 0; demoted++; }
+        }
+        for (int s = 0; s < S->nslots; s++)
+            if (S->first[s] >= from && S->first[s] < to) { S->pending[s] = -1; S->vreg[s] = 0; }
+        if (!demoted) { fprintf(stderr, "[A64] register allocation failed\n"); S->errors++; return; }
+        st0.demoted += demoted;
+        st0.temps -= demoted;
+        A->st = st0;
+    }
+}
+
+// === Runtime ===
+
+// Runtime conventions (AAPCS64 registers: x19-x28 and d8-d15 survive every routine):
+//   rx_exit         out_flush, then exit_group(0)
+//   out_write       x1 = bytes, x2 = length -> appended to the 64 KiB stdout buffer, x0 = length; a full
+//                   buffer is flushed first, a write larger than the buffer goes straight out
+//   out_flush       write(1) of everything buffered
+//   int_to_str      x0 = signed value, x1 = buffer (>= 26 bytes, the tail is scratch) -> NUL-terminated
+//                   digits, x0 = length; preserves x1
+//   float_to_str    d0 = value, x0 = buffer (>= 28 bytes) -> the x86-64 member's shortest digits, x0 = length
+static const char a64_rt_exit[] =
+    "rx_exit:\n"
+    "    bl out_flush\n"
+    "    mov x0, #0\n"
+    "    mov x8, #94\n"
+    "    svc #0\n"
+    "out_flush:\n"
+    "    adrp x3, out_len\n"
+    "    add x3, x3, :lo12:out_len\n"
+    "    ldr x2, [x3]\n"
+    "    add x1, x3, #8\n"
+    ".Lflush_loop:\n"
+    "    cbz x2, .Lflush_done\n"
+    "    mov x0, #1\n"
+    "    mov x8, #64\n"
+    "    svc #0\n"
+    "    cmp x0, #0\n"
+    "    b.le .Lflush_done\n"
+    "    add x1, x1, x0\n"
+    "    sub x2, x2, x0\n"
+    "    b .Lflush_loop\n"
+    ".Lflush_done:\n"
+    "    str xzr, [x3]\n"
+    "    ret\n";
+
+static const char a64_rt_out_write[] =
+    "out_write:\n"
+    "    adrp x3, out_len\n"
+    "    add x3, x3, :lo12:out_len\n"
+    "    ldr x4, [x3]\n"
+    "    add x5, x4, x2\n"
+    "    cmp x5, #16, lsl #12\n"
+    "    b.ls .Lout_copy\n"
+    "    stp x1, x2, [sp, #-32]!\n"
+    "    str x30, [sp, #16]\n"
+    "    bl out_flush\n"
+    "    ldr x30, [sp, #16]\n"
+    "    ldp x1, x2, [sp], #32\n"
+    "    mov x4, #0\n"
+    "    mov x5, x2\n"
+    "    cmp x2, #16, lsl #12\n"
+    "    b.ls .Lout_copy\n"
+    "    mov x9, x2\n"
+    ".Lout_direct:\n"
+    "    mov x0, #1\n"
+    "    mov x8, #64\n"
+    "    svc #0\n"
+    "    cmp x0, #0\n"
+    "    b.le .Lout_direct_done\n"
+    "    add x1, x1, x0\n"
+    "    subs x2, x2, x0\n"
+    "    b.ne .Lout_direct\n"
+    ".Lout_direct_done:\n"
+    "    mov x0, x9\n"
+    "    ret\n"
+    ".Lout_copy:\n"
+    "    str x5, [x3]\n"
+    "    add x6, x3, #8\n"
+    "    add x6, x6, x4\n"
+    "    mov x0, x2\n"
+    ".Lout_qwords:\n"
+    "    cmp x2, #8\n"
+    "    b.lo .Lout_bytes\n"
+    "    ldr x7, [x1], #8\n"
+    "    str x7, [x6], #8\n"
+    "    sub x2, x2, #8\n"
+    "    b .Lout_qwords\n"
+    ".Lout_bytes:\n"
+    "    cbz x2, .Lout_done\n"
+    "    ldrb w7, [x1], #1\n"
+    "    strb w7, [x6], #1\n"
+    "    sub x2, x2, #1\n"
+    "    b .Lout_bytes\n"
+    ".Lout_done:\n"
+    "    ret\n";
+
+// Digits two at a time from the end of the scratch area (x/100 as umulh by 2^67/100 + 1 after
+// dropping two bits, as in the x86-64 member), then copied down to the buffer.
+static const char a64_rt_print_int[] =
+    "rx_print_int:\n"
+    "    stp x29, x30, [sp, #-16]!\n"
+    "    adrp x1, rx_digits\n"
+    "    add x1, x1, :lo12:rx_digits\n"
+    "    bl int_to_str\n"
+    "    mov w2, #10\n"
+    "    strb w2, [x1, x0]\n"
+    "    add x2, x0, #1\n"
+    "    ldp x29, x30, [sp], #16\n"
+    "    b out_write\n"
+    "int_to_str:\n"
+    "    mov x2, x1\n"
+    "    tbz x0, #63, .Litoa_positive\n"
+    "    mov w3, #45\n"
+    "    strb w3, [x2], #1\n"
+    "    neg x0, x0\n"
+    ".Litoa_positive:\n"
+    "    add x3, x2, #24\n"
+    "    mov x4, x3\n"
+    "    movz x5, #0xF5C3\n"
+    "    movk x5, #0x5C28, lsl #16\n"
+    "    movk x5, #0xC28F, lsl #32\n"
+    "    movk x5, #0x28F5, lsl #48\n"
+    "    adrp x6, int_to_str_pairs\n"
+    "    add x6, x6, :lo12:int_to_str_pairs\n"
+    "    mov x9, #100\n"
+    ".Litoa_pairs:\n"
+    "    cmp x0, #100\n"
+    "    b.lo .Litoa_last\n"
+    "    lsr x7, x0, #2\n"
+    "    umulh x7, x7, x5\n"
+    "    lsr x7, x7, #2\n"
+    "    msub x8, x7, x9, x0\n"
+    "    ldrh w8, [x6, x8, lsl #1]\n"
+    "    strh w8, [x4, #-2]!\n"
+    "    mov x0, x7\n"
+    "    b .Litoa_pairs\n"
+    ".Litoa_last:\n"
+    "    cmp x0, #10\n"
+    "    b.lo .Litoa_one\n"
+    "    ldrh w8, [x6, x0, lsl #1]\n"
+    "    strh w8, [x4, #-2]!\n"
+    "    b .Litoa_copy\n"
+    ".Litoa_one:\n"
+    "    add w8, w0, #48\n"
+    "    strb w8, [x4, #-1]!\n"
+    ".Litoa_copy:\n"
+    "    ldrb w8, [x4], #1\n"
+    "    strb w8, [x2], #1\n"
+    "    cmp x4, x3\n"
+    "    b.ne .Litoa_copy\n"
+    "    strb wzr, [x2]\n"
+    "    sub x0, x2, x1\n"
+    "    ret\n";
+
+static const char a64_rt_print_str[] =
+    "rx_print_str:\n"
+    "    cbz x1, .Lprint_str_newline\n"
+    "    stp x29, x30, [sp, #-16]!\n"
+    "    ldur x2, [x1, #-8]\n"
+    "    bl out_write\n"
+    "    ldp x29, x30, [sp], #16\n"
+    ".Lprint_str_newline:\n"
+    "    adrp x1, rx_newline\n"
+    "    add x1, x1, :lo12:rx_newline\n"
+    "    mov x2, #1\n"
+    "    b out_write\n";
+
+// Ryu, register for register after the x86-64 member: x3 m2 / q / removed digits, x4 e2 / last
+// removed digit, x5 mv, x6 vr, x7 vp, x8 vm, x9 mmShift, x10 e10, x11 vmIsTrailingZeros,
+// x12 vrIsTrailingZeros, x13 acceptBounds, x14 shift / 2^67/10 + 1, x15 table row.
+static const char a64_rt_print_float[] =
+    "rx_print_float:\n"
+    "    stp x29, x30, [sp, #-16]!\n"
+    "    adrp x0, rx_digits\n"
+    "    add x0, x0, :lo12:rx_digits\n"
+    "    bl float_to_str\n"
+    "    adrp x1, rx_digits\n"
+    "    add x1, x1, :lo12:rx_digits\n"
+    "    mov w2, #10\n"
+    "    strb w2, [x1, x0]\n"
+    "    add x2, x0, #1\n"
+    "    ldp x29, x30, [sp], #16\n"
+    "    b out_write\n"
+    "float_to_str:\n"
+    "    str x30, [sp, #-48]!\n"
+    "    mov x1, x0\n"
+    "    fmov x2, d0\n"
+    "    tbz x2, #63, .Lf2s_positive\n"
+    "    mov w16, #45\n"
+    "    strb w16, [x0], #1\n"
+    "    and x2, x2, #0x7fffffffffffffff\n"
+    ".Lf2s_positive:\n"
+    "    and x17, x2, #0xfffffffffffff\n"
+    "    lsr x2, x2, #52\n"
+    "    cmp x2, #0x7ff\n"
+    "    b.eq .Lf2s_special\n"
+    "    cbnz x2, .Lf2s_normal\n"
+    "    cbz x17, .Lf2s_zero\n"
+    "    mov x3, x17\n"
+    "    mov x4, #-1076\n"
+    "    b .Lf2s_bounds\n"
+    ".Lf2s_normal:\n"
+    "    orr x3, x17, #0x10000000000000\n"
+    "    sub x4, x2, #1077\n"
+    ".Lf2s_bounds:\n"
+    "    cmp x17, #0\n"
+    "    cset x9, ne\n"
+    "    cmp x2, #1\n"
+    "    cset x16, ls\n"
+    "    orr x9, x9, x16\n"
+    "    and x13, x3, #1\n"
+    "    eor x13, x13, #1\n"
+    "    mov x11, #0\n"
+    "    mov x12, #0\n"
+    "    lsl x5, x3, #2\n"
+    "    tbnz x4, #63, .Lf2s_negative_e2\n"
+    "    movz w16, #0x3441\n"
+    "    movk w16, #0x1, lsl #16\n"
+    "    mul w2, w4, w16\n"
+    "    lsr w2, w2, #18\n"
+    "    cmp w4, #3\n"
+    "    cset w16, gt\n"
+    "    sub w2, w2, w16\n"
+    "    mov x10, x2\n"
+    "    mov x3, x2\n"
+    "    movz w16, #0x934F\n"
+    "    movk w16, #0x12, lsl #16\n"
+    "    mul w14, w2, w16\n"
+    "    lsr w14, w14, #19\n"
+    "    add w14, w14, #61\n"
+    "    add w14, w14, w2\n"
+    "    sub w14, w14, w4\n"
+    "    adrp x15, float_to_str_pow5_inv\n"
+    "    add x15, x15, :lo12:float_to_str_pow5_inv\n"
+    "    add x15, x15, x2, lsl #4\n"
+    "    bl .Lf2s_mulshift_all\n"
+    "    cmp w3, #21\n"
+    "    b.hi .Lf2s_digits\n"
+    "    mov x16, #5\n"
+    "    udiv x17, x5, x16\n"
+    "    msub x17, x17, x16, x5\n"
+    "    cbnz x17, .Lf2s_mv_not5\n"
+    "    mov x2, x5\n"
+    "    bl .Lf2s_pow5_factor\n"
+    "    cmp w4, w3\n"
+    "    b.lo .Lf2s_digits\n"
+    "    mov x12, #1\n"
+    "    b .Lf2s_digits\n"
+    ".Lf2s_mv_not5:\n"
+    "    cbz x13, .Lf2s_vp_adjust\n"
+    "    sub x2, x5, x9\n"
+    "    sub x2, x2, #1\n"
+    "    bl .Lf2s_pow5_factor\n"
+    "    cmp w4, w3\n"
+    "    b.lo .Lf2s_digits\n"
+    "    mov x11, #1\n"
+    "    b .Lf2s_digits\n"
+    ".Lf2s_vp_adjust:\n"
+    "    add x2, x5, #2\n"
+    "    bl .Lf2s_pow5_factor\n"
+    "    cmp w4, w3\n"
+    "    b.lo .Lf2s_digits\n"
+    "    sub x7, x7, #1\n"
+    "    b .Lf2s_digits\n"
+    ".Lf2s_negative_e2:\n"
+    "    neg w2, w4\n"
+    "    movz w16, #0x2EFB\n"
+    "    movk w16, #0xB, lsl #16\n"
+    "    mul w16, w2, w16\n"
+    "    lsr w16, w16, #20\n"
+    "    cmp w2, #1\n"
+    "    cset w17, gt\n"
+    "    sub w16, w16, w17\n"
+    "    add x10, x16, x4\n"
+    "    sub w2, w2, w16\n"
+    "    movz w17, #0x934F\n"
+    "    movk w17, #0x12, lsl #16\n"
+    "    mul w17, w2, w17\n"
+    "    lsr w17, w17, #19\n"
+    "    mov x3, x16\n"
+    "    sub w14, w16, w17\n"
+    "    add w14, w14, #60\n"
+    "    adrp x15, float_to_str_pow5\n"
+    "    add x15, x15, :lo12:float_to_str_pow5\n"
+    "    add x15, x15, x2, lsl #4\n"
+    "    bl .Lf2s_mulshift_all\n"
+    "    cmp w3, #1\n"
+    "    b.hi .Lf2s_q_large\n"
+    "    mov x12, #1\n"
+    "    cbz x13, .Lf2s_vp_dec\n"
+    "    mov x11, x9\n"
+    "    b .Lf2s_digits\n"
+    ".Lf2s_vp_dec:\n"
+    "    sub x7, x7, #1\n"
+    "    b .Lf2s_digits\n"
+    ".Lf2s_q_large:\n"
+    "    cmp w3, #63\n"
+    "    b.hs .Lf2s_digits\n"
+    "    mov x16, #1\n"
+    "    lsl x16, x16, x3\n"
+    "    sub x16, x16, #1\n"
+    "    tst x5, x16\n"
+    "    b.ne .Lf2s_digits\n"
+    "    mov x12, #1\n"
+    ".Lf2s_digits:\n"
+    "    mov x3, #0\n"
+    "    mov x4, #0\n"
+    "    movz x14, #0xCCCD\n"
+    "    movk x14, #0xCCCC, lsl #16\n"
+    "    movk x14, #0xCCCC, lsl #32\n"
+    "    movk x14, #0xCCCC, lsl #48\n"
+    "    orr x16, x11, x12\n"
+    "    cbnz x16, .Lf2s_general\n"
+    "    movz x15, #0xF5C3\n"
+    "    movk x15, #0x5C28, lsl #16\n"
+    "    movk x15, #0xC28F, lsl #32\n"
+    "    movk x15, #0x28F5, lsl #48\n"
+    "    lsr x16, x7, #2\n"
+    "    umulh x16, x16, x15\n"
+    "    lsr x16, x16, #2\n"
+    "    lsr x17, x8, #2\n"
+    "    umulh x17, x17, x15\n"
+    "    lsr x17, x17, #2\n"
+    "    cmp x16, x17\n"
+    "    b.ls .Lf2s_by10\n"
+    "    lsr x2, x6, #2\n"
+    "    umulh x2, x2, x15\n"
+    "    lsr x2, x2, #2\n"
+    "    mov x9, #100\n"
+    "    msub x9, x2, x9, x6\n"
+    "    cmp x9, #50\n"
+    "    cset x4, hs\n"
+    "    mov x6, x2\n"
+    "    mov x7, x16\n"
+    "    mov x8, x17\n"
+    "    mov x3, #2\n"
+    ".Lf2s_by10:\n"
+    "    umulh x16, x7, x14\n"
+    "    lsr x16, x16, #3\n"
+    "    umulh x17, x8, x14\n"
+    "    lsr x17, x17, #3\n"
+    "    cmp x16, x17\n"
+    "    b.ls .Lf2s_round\n"
+    "    umulh x2, x6, x14\n"
+    "    lsr x2, x2, #3\n"
+    "    add x9, x2, x2, lsl #2\n"
+    "    sub x9, x6, x9, lsl #1\n"
+    "    cmp x9, #5\n"
+    "    cset x4, hs\n"
+    "    mov x6, x2\n"
+    "    mov x7, x16\n"
+    "    mov x8, x17\n"
+    "    add x3, x3, #1\n"
+    "    b .Lf2s_by10\n"
+    ".Lf2s_round:\n"
+    "    cmp x6, x8\n"
+    "    cset x16, eq\n"
+    "    orr x16, x16, x4\n"
+    "    add x6, x6, x16\n"
+    "    b .Lf2s_format\n"
+    ".Lf2s_general:\n"
+    "    umulh x16, x7, x14\n"
+    "    lsr x16, x16, #3\n"
+    "    umulh x17, x8, x14\n"
+    "    lsr x17, x17, #3\n"
+    "    cmp x16, x17\n"
+    "    b.ls .Lf2s_general_vm\n"
+    "    add x9, x17, x17, lsl #2\n"
+    "    lsl x9, x9, #1\n"
+    "    cmp x8, x9\n"
+    "    b.eq .Lf2s_general_vm_zero\n"
+    "    mov x11, #0\n"
+    ".Lf2s_general_vm_zero:\n"
+    "    cbz x4, .Lf2s_general_vr_zero\n"
+    "    mov x12, #0\n"
+    ".Lf2s_general_vr_zero:\n"
+    "    umulh x2, x6, x14\n"
+    "    lsr x2, x2, #3\n"
+    "    add x9, x2, x2, lsl #2\n"
+    "    sub x4, x6, x9, lsl #1\n"
+    "    mov x6, x2\n"
+    "    mov x7, x16\n"
+    "    mov x8, x17\n"
+    "    add x3, x3, #1\n"
+    "    b .Lf2s_general\n"
+    ".Lf2s_general_vm:\n"
+    "    cbz x11, .Lf2s_general_round\n"
+    ".Lf2s_general_vm_loop:\n"
+    "    umulh x17, x8, x14\n"
+    "    lsr x17, x17, #3\n"
+    "    add x9, x17, x17, lsl #2\n"
+    "    lsl x9, x9, #1\n"
+    "    cmp x8, x9\n"
+    "    b.ne .Lf2s_general_round\n"
+    "    cbz x4, .Lf2s_general_vm_vr\n"
+    "    mov x12, #0\n"
+    ".Lf2s_general_vm_vr:\n"
+    "    umulh x2, x6, x14\n"
+    "    lsr x2, x2, #3\n"
+    "    add x9, x2, x2, lsl #2\n"
+    "    sub x4, x6, x9, lsl #1\n"
+    "    mov x6, x2\n"
+    "    umulh x16, x7, x14\n"
+    "    lsr x7, x16, #3\n"
+    "    mov x8, x17\n"
+    "    add x3, x3, #1\n"
+    "    b .Lf2s_general_vm_loop\n"
+    ".Lf2s_general_round:\n"
+    "    cbz x12, .Lf2s_general_up\n"
+    "    cmp x4, #5\n"
+    "    b.ne .Lf2s_general_up\n"
+    "    tbnz x6, #0, .Lf2s_general_up\n"
+    "    mov x4, #4\n"
+    ".Lf2s_general_up:\n"
+    "    mov x16, #0\n"
+    "    cmp x6, x8\n"
+    "    b.ne .Lf2s_general_digit\n"
+    "    cbz x13, .Lf2s_general_inc\n"
+    "    cbz x11, .Lf2s_general_inc\n"
+    ".Lf2s_general_digit:\n"
+    "    cmp x4, #5\n"
+    "    b.lo .Lf2s_general_add\n"
+    ".Lf2s_general_inc:\n"
+    "    mov x16, #1\n"
+    ".Lf2s_general_add:\n"
+    "    add x6, x6, x16\n"
+    ".Lf2s_format:\n"
+    "    add x17, sp, #48\n"
+    "    mov x16, x17\n"
+    ".Lf2s_output_digit:\n"
+    "    umulh x2, x6, x14\n"
+    "    lsr x2, x2, #3\n"
+    "    add x9, x2, x2, lsl #2\n"
+    "    sub x9, x6, x9, lsl #1\n"
+    "    add w9, w9, #48\n"
+    "    strb w9, [x16, #-1]!\n"
+    "    mov x6, x2\n"
+    "    cbnz x6, .Lf2s_output_digit\n"
+    "    sub x5, x17, x16\n"
+    "    add x9, x10, x3\n"
+    "    add x13, x9, x5\n"
+    "    sub x13, x13, #1\n"
+    "    cmn x13, #4\n"
+    "    b.lt .Lf2s_scientific\n"
+    "    cmp x13, #16\n"
+    "    b.ge .Lf2s_scientific\n"
+    "    tbnz x9, #63, .Lf2s_fraction\n"
+    "    mov x15, x5\n"
+    "    bl .Lf2s_copy\n"
+    "    cbz x9, .Lf2s_finish\n"
+    ".Lf2s_trailing_zeros:\n"
+    "    mov w17, #48\n"
+    "    strb w17, [x0], #1\n"
+    "    subs x9, x9, #1\n"
+    "    b.ne .Lf2s_trailing_zeros\n"
+    "    b .Lf2s_finish\n"
+    ".Lf2s_fraction:\n"
+    "    tbnz x13, #63, .Lf2s_leading_zeros\n"
+    "    add x15, x13, #1\n"
+    "    sub x5, x5, x15\n"
+    "    bl .Lf2s_copy\n"
+    "    mov w17, #46\n"
+    "    strb w17, [x0], #1\n"
+    "    mov x15, x5\n"
+    "    bl .Lf2s_copy\n"
+    "    b .Lf2s_finish\n"
+    ".Lf2s_leading_zeros:\n"
+    "    mov w17, #0x2E30\n"
+    "    strh w17, [x0], #2\n"
+    "    mvn x15, x13\n"
+    "    cbz x15, .Lf2s_leading_digits\n"
+    ".Lf2s_leading_zero:\n"
+    "    mov w17, #48\n"
+    "    strb w17, [x0], #1\n"
+    "    subs x15, x15, #1\n"
+    "    b.ne .Lf2s_leading_zero\n"
+    ".Lf2s_leading_digits:\n"
+    "    mov x15, x5\n"
+    "    bl .Lf2s_copy\n"
+    "    b .Lf2s_finish\n"
+    ".Lf2s_scientific:\n"
+    "    mov x15, #1\n"
+    "    bl .Lf2s_copy\n"
+    "    subs x5, x5, #1\n"
+    "    b.eq .Lf2s_exponent\n"
+    "    mov w17, #46\n"
+    "    strb w17, [x0], #1\n"
+    "    mov x15, x5\n"
+    "    bl .Lf2s_copy\n"
+    ".Lf2s_exponent:\n"
+    "    mov w17, #0x2B65\n"
+    "    tbz x13, #63, .Lf2s_exponent_sign\n"
+    "    mov w17, #0x2D65\n"
+    "    neg x13, x13\n"
+    ".Lf2s_exponent_sign:\n"
+    "    strh w17, [x0], #2\n"
+    "    cmp x13, #100\n"
+    "    b.lo .Lf2s_exponent_digits\n"
+    "    mov x16, #100\n"
+    "    udiv x17, x13, x16\n"
+    "    msub x13, x17, x16, x13\n"
+    "    add w17, w17, #48\n"
+    "    strb w17, [x0], #1\n"
+    ".Lf2s_exponent_digits:\n"
+    "    mov x16, #10\n"
+    "    udiv x17, x13, x16\n"
+    "    msub x13, x17, x16, x13\n"
+    "    add w17, w17, #48\n"
+    "    strb w17, [x0], #1\n"
+    "    add w13, w13, #48\n"
+    "    strb w13, [x0], #1\n"
+    "    b .Lf2s_finish\n"
+    ".Lf2s_special:\n"
+    "    movz w16, #0x6E69\n"
+    "    movk w16, #0x66, lsl #16\n"
+    "    cbz x17, .Lf2s_special_end\n"
+    "    movz w16, #0x616E\n"
+    "    movk w16, #0x6E, lsl #16\n"
+    ".Lf2s_special_end:\n"
+    "    str w16, [x0]\n"
+    "    add x0, x0, #3\n"
+    "    b .Lf2s_finish\n"
+    ".Lf2s_zero:\n"
+    "    mov w16, #48\n"
+    "    strb w16, [x0], #1\n"
+    ".Lf2s_finish:\n"
+    "    strb wzr, [x0]\n"
+    "    sub x0, x0, x1\n"
+    "    ldr x30, [sp], #48\n"
+    "    ret\n"
+    ".Lf2s_copy:\n"
+    "    ldrb w17, [x16], #1\n"
+    "    strb w17, [x0], #1\n"
+    "    subs x15, x15, #1\n"
+    "    b.ne .Lf2s_copy\n"
+    "    ret\n"
+    // vr, vp, vm = mulShift(4*m2, 4*m2 + 2, 4*m2 - 1 - mmShift) against the 128-bit row at x15, >> x14
+    ".Lf2s_mulshift_all:\n"
+    "    str x30, [sp, #-16]!\n"
+    "    mov x2, x5\n"
+    "    bl .Lf2s_mulshift\n"
+    "    mov x6, x2\n"
+    "    add x2, x5, #2\n"
+    "    bl .Lf2s_mulshift\n"
+    "    mov x7, x2\n"
+    "    sub x2, x5, x9\n"
+    "    sub x2, x2, #1\n"
+    "    bl .Lf2s_mulshift\n"
+    "    mov x8, x2\n"
+    "    ldr x30, [sp], #16\n"
+    "    ret\n"
+    ".Lf2s_mulshift:\n"
+    "    ldp x16, x17, [x15]\n"
+    "    umulh x4, x2, x16\n"
+    "    mul x16, x2, x17\n"
+    "    umulh x17, x2, x17\n"
+    "    adds x16, x16, x4\n"
+    "    adc x17, x17, xzr\n"
+    "    lsr x16, x16, x14\n"
+    "    neg x4, x14\n"
+    "    lsl x17, x17, x4\n"
+    "    orr x2, x16, x17\n"
+    "    ret\n"
+    // x4 = times 5 divides x2
+    ".Lf2s_pow5_factor:\n"
+    "    mov x4, #0\n"
+    "    mov x17, #5\n"
+    ".Lf2s_pow5_divide:\n"
+    "    udiv x16, x2, x17\n"
+    "    msub x2, x16, x17, x2\n"
+    "    cbnz x2, .Lf2s_pow5_done\n"
+    "    add x4, x4, #1\n"
+    "    mov x2, x16\n"
+    "    b .Lf2s_pow5_divide\n"
+    ".Lf2s_pow5_done:\n"
+    "    ret\n";
+
+// === Output ===
+
+static void a64_print_label(A64Compiler* A, FILE* out, int label) {
+    if (A->S->sym[label]) fputs(A->S->sym[label], out);
+    else fprintf(out, ".L%d", label);
+}
+
+static void a64_print_opnd(A64Compiler* A, FILE* out, const A64Inst* in, const A64Opnd* o) {
+    switch (o->kind) {
+        case A64_X:
+            if (o->reg == A64_XZR) fputs("xzr", out);
+            else if (o->reg == A64_SP) fputs("sp", out);
+            else fprintf(out, "x%d", o->reg);
+            break;
+        case A64_D:
+            fprintf(out, "d%d", o->reg);
+            break;
+        case A64_IMM:
+            if (in->op == A64_AND) fprintf(out, "#0x%llx", (unsigned long long)o->imm);
+            else if (in->op == A64_FMOV) {
+                double f;
+                memcpy(&f, &o->imm, 8);
+                fprintf(out, "#%.7f", f);
+            } else {
+                fprintf(out, "#%lld", (long long)o->imm);
+            }
+            break;
+        case A64_MEM:
+            fprintf(out, "[x%d", o->reg);
+            if (o->label >= 0) {
+                fputs(", :lo12:", out);
+                a64_print_label(A, out, o->label);
+            } else if (o->imm) {
+                fprintf(out, ", #%lld", (long long)o->imm);
+            }
+            fputc(']', out);
+            break;
+        case A64_LAB:
+            if (in->op == A64_ADD_LO12) fputs(":lo12:", out);
+            a64_print_label(A, out, o->label);
+            break;
+    }
+}
+
+static void a64_print_inst(A64Compiler* A, FILE* out, const A64Inst* in) {
+    if ((in->op == A64_MOV || in->op == A64_FMOV) && in->o[1].kind == in->o[0].kind && in->o[1].reg == in->o[0].reg) return;
+    switch (in->op) {
+        case A64_LABEL:
+            a64_print_label(A, out, in->o[0].label);
+            fputs(":\n", out);
+            return;
+        case A64_PUSH_LR: fputs("    str x30, [sp, #-16]!\n", out); return;
+        case A64_POP_LR: fputs("    ldr x30, [sp], #16\n", out); return;
+        case A64_BCC: fprintf(out, "    b.%s ", a64_cond_name[in->cond]); break;
+        default: fprintf(out, "    %s", a64_mnemonic[in->op]); break;
+    }
+    for (int k = 0; k < in->nops; k++) {
+        fputs(k ? ", " : in->op == A64_BCC ? "" : " ", out);
+        a64_print_opnd(A, out, in, &in->o[k]);
+    }
+    if (in->op == A64_CSET || in->op == A64_CSEL) fprintf(out, ", %s", a64_cond_name[in->cond]);
+    if (in->shift_op) fprintf(out, ", %s #%d", in->shift_op == A64_LSR ? "lsr" : "lsl", in->shift);
+    fputc('\n', out);
+}
+
+static void a64_write(A64Compiler* A, FILE* out) {
+    IselCompiler* S = A->S;
+    int used_any = S->used_print[ISEL_PRINT_INT] | S->used_print[ISEL_PRINT_STR] | S->used_print[ISEL_PRINT_FLOAT];
+    fprintf(out, "// generated by rexion_isel_arm64.c from %d IR ops\n    .text\n    .globl _start\n", ir_count);
+    for (int p = 0; p < A->ncode; p++) a64_print_inst(A, out, &A->code[p]);
+    fputs(a64_rt_exit, out);
+    if (used_any) fputs(a64_rt_out_write, out);
+    if (S->used_print[ISEL_PRINT_INT]) fputs(a64_rt_print_int, out);
+    if (S->used_print[ISEL_PRINT_STR]) fputs(a64_rt_print_str, out);
+    if (S->used_print[ISEL_PRINT_FLOAT]) fputs(a64_rt_print_float, out);
+
+    // string constants carry their length in the quad before their first byte
+    fputs("    .section .rodata\nrx_newline:\n    .byte 10, 0\n", out);
+    for (int h = 0; h < S->str_cap; h++) {
+        if (!S->strs[h].id) continue;
+        const char* s = ir_str(S->strs[h].id - 1);
+        fprintf(out, "    .balign 8\n    .quad %zu\n%s:\n    .byte ", strlen(s), S->sym[S->strs[h].val]);
+        for (const char* c = s; *c; c++) fprintf(out, "%d, ", (unsigned char)*c);
+        fputs("0\n", out);
+    }
+    if (S->nfloats) fputs("    .balign 8\n", out);
+    for (int i = 0; i < S->nfloats; i++) fprintf(out, "%s:\n    .quad 0x%016llx\n", S->sym[S->float_label[i]], (unsigned long long)S->floats[i]);
+    if (S->used_print[ISEL_PRINT_INT]) {
+        fputs("int_to_str_pairs:\n", out);
+        for (int d = 0; d < 100; d += 10) {
+            fputs("    .ascii \"", out);
+            for (int k = d; k < d + 10; k++) fprintf(out, "%02d", k);
+            fputs("\"\n", out);
+        }
+    }
+    if (S->used_print[ISEL_PRINT_FLOAT]) {
+        fputs("    .balign 16\n", out);
+        rlink_pow5_tables(out, ".quad");
+    }
+    fprintf(out, "    .bss\n    .balign 8\nrx_vars:\n    .skip %d\nrx_digits:\n    .skip 64\nout_len:\n    .skip 8\nout_buf:\n    .skip 65536\n",
+        8 * (S->nslots ? S->nslots : 1));
+}
+
+static void a64_free(A64Compiler* A) {
+    isel_free(A->S);
+    free(A->fpin); free(A->code);
+    free(A);
+}
+
+// Lowers ir[0..ir_count) to AArch64 GNU assembly on `out`. Returns the instruction count, -1 on errors.
+int a64_compile(FILE* out, A64Stats* stats) {
+    A64Compiler* A = calloc(1, sizeof(A64Compiler));
+    IselCompiler* S = A ? calloc(1, sizeof(IselCompiler)) : NULL;
+    if (!S) { perror("a64_compile"); return -1; }
+    A->S = S;
+    int l_start = isel_new_label(S, "_start");
+    S->l_print[ISEL_PRINT_INT] = isel_new_label(S, "rx_print_int");
+    S->l_print[ISEL_PRINT_STR] = isel_new_label(S, "rx_print_str");
+    S->l_print[ISEL_PRINT_FLOAT] = isel_new_label(S, "rx_print_float");
+    A->l_body = isel_new_label(S, "rx_body");
+    A->l_exit = isel_new_label(S, "rx_exit");
+    S->npin = A64_PINNED;
+    isel_scan(S);
+    A->st.pinned = S->st.pinned;
+    A->st.temps = S->st.temps;
+
+    // the most-used float names go to d8-d15, the callee-saved half of the vector registers
+    A->fpin = malloc((size_t)S->nslots + 1);
+    if (!A->fpin) { perror("a64_compile"); exit(1); }
+    memset(A->fpin, -1, (size_t)S->nslots + 1);
+    for (int p = 0; p < A64_FPINNED && isel_regs_enabled; p++) {
+        int best = -1;
+        for (int s = 0; s < S->nslots; s++) {
+            if (!S->is_float[s] || S->temp[s] || S->pin[s] >= 0 || A->fpin[s] >= 0 || !S->weight[s]) continue;
+            if (best < 0 || S->weight[s] > S->weight[best]) best = s;
+        }
+        if (best < 0) break;
+        A->fpin[best] = (int8_t)p;
+        A->st.fpinned++;
+    }
+
+    // _start: rx_vars base in x28, pinned names zeroed; a top-level RET returns from the body onto
+    // the exit path, HALT branches there from any depth
+    a64_bind(A, l_start);
+    a64_op(A, A64_ADRP, a64_x(A64_VARS), a64_lab(isel_new_label(S, "rx_vars")), a64_none());
+    a64_op(A, A64_ADD_LO12, a64_x(A64_VARS), a64_x(A64_VARS), a64_lab(S->nlabels - 1));
+    for (int s = 0; s < S->nslots; s++) {
+        if (S->pin[s] >= 0) a64_move(A, a64_x(a64_pin_regs[S->pin[s]]), a64_imm(0));
+        if (A->fpin[s] >= 0) a64_move(A, a64_d(a64_fpin_regs[A->fpin[s]]), a64_imm(0));
+    }
+    a64_op(A, A64_BL, a64_lab(A->l_body), a64_none(), a64_none());
+    a64_jump(A, A->l_exit);
+    a64_bind(A, A->l_body);
+
+    for (int i = 0; i < ir_count && !S->errors; ) {
+        int j = i + 1;
+        while (j < ir_count && S->block[j] == S->block[i]) j++;
+        a64_block(A, i, j);
+        i = j;
+    }
+    int tail = ir_count ? ir[ir_count - 1].opcode : IR_OP_NOP;
+    if (tail != IR_OP_HALT && tail != IR_OP_JMP && tail != IR_OP_RET) a64_jump(A, A->l_exit);
+
+    int rc = S->errors ? -1 : 0;
+    if (!rc) a64_write(A, out);
+    if (stats) *stats = A->st;
+    int ncode = A->ncode;
+    a64_free(A);
+    return rc < 0 ? rc : ncode;
+}
+
+// Writes the AArch64 assembly for the current IR buffer to `path` and reports what the backend did.
+int a64_write_asm(const char* path) {
+    FILE* out = fopen(path, "w");
+    if (!out) { perror(path); return -1; }
+    A64Stats st;
+    int n = a64_compile(out, &st);
+    fclose(out);
+    if (n < 0) return -1;
+    fprintf(stderr, "[A64] %d IR ops -> %d instructions: %d names in x registers, %d in d registers, %d temporaries, "
+        "%d shifted operands, %d multiply-adds, %d fused compare-branches, %d strength-reduced, %d demoted\n",
+        ir_count, n, st.pinned, st.fpinned, st.temps, st.shifted, st.madd, st.fused, st.strength, st.demoted);
+    return 0;
+}
+
+int ssa_optimize_ir(FILE* report);
+extern long long* ssa_ir_counts;
+extern int ssa_ir_ncounts;
+
+// Loads an IR program, runs it through the SSA pipeline if `optimize` is set, and compiles it to
+// AArch64 assembly at `asm_path`, homes ranked by --profile-use block counts as on x86-64.
+int a64_compile_file(const char* ir_path, const char* asm_path, int optimize) {
+    ir_reset();
+    if (ir_load_any(ir_path) != 0) return -1;
+    if (optimize && ssa_optimize_ir(stderr) && ssa_ir_counts && ssa_ir_ncounts == ir_count) isel_counts = ssa_ir_counts;
+    int rc = a64_write_asm(asm_path);
+    isel_counts = NULL;
+    return rc;
+}
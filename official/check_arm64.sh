@@ -0,0 +1,79 @@
+#!/bin/sh
+# check_arm64.sh – run rexionc --native-arm64 output and compare it with the JIT
+#
+#   check_arm64.sh [rexionc options] program.ir ...
+#
+# Each program is compiled to rexion_arm64.s (options such as -O2 or --profile-use FILE go in front
+# of --native-arm64), assembled with aarch64-linux-gnu-as or llvm-mc, linked with
+# aarch64-linux-gnu-ld or ld.lld, run under qemu-aarch64 (directly on an AArch64 host) and its
+# output compared with `rexionc program.ir --run-jit`. Missing tools are reported and the later
+# steps skipped; the exit status is 1 if any program fails to compile, assemble, link or match.
+#
+# REXIONC  compiler to use (default: rexionc next to this script, then rexionc on PATH)
+# REF      reference run (default: --run-jit; use --run-vm on a non-x86-64 host)
+
+here=$(cd "$(dirname "$0")" && pwd)
+if [ -z "$REXIONC" ]; then
+    if [ -x "$here/rexionc" ]; then REXIONC="$here/rexionc"; else REXIONC=rexionc; fi
+fi
+REF=${REF:---run-jit}
+
+have() { command -v "$1" >/dev/null 2>&1; }
+
+if have aarch64-linux-gnu-as; then assemble() { aarch64-linux-gnu-as -o "$2" "$1"; }
+elif have llvm-mc; then assemble() { llvm-mc -triple=aarch64-linux-gnu -filetype=obj -o "$2" "$1"; }
+fi
+
+if have aarch64-linux-gnu-ld; then link() { aarch64-linux-gnu-ld -static -o "$2" "$1"; }
+elif have ld.lld; then link() { ld.lld -static -o "$2" "$1"; }
+fi
+
+if [ "$(uname -m)" = aarch64 ]; then run() { "$1"; }
+elif have qemu-aarch64; then run() { qemu-aarch64 "$1"; }
+elif have qemu-aarch64-static; then run() { qemu-aarch64-static "$1"; }
+fi
+
+have aarch64-linux-gnu-as || have llvm-mc || { echo "[A64-CHECK] no aarch64-linux-gnu-as or llvm-mc: nothing to check" >&2; exit 1; }
+have aarch64-linux-gnu-ld || have ld.lld || echo "[A64-CHECK] no aarch64-linux-gnu-ld or ld.lld: assembling only" >&2
+[ "$(uname -m)" = aarch64 ] || have qemu-aarch64 || have qemu-aarch64-static ||
+    echo "[A64-CHECK] no qemu-aarch64: programs are built but not run" >&2
+
+opts=""
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --profile-use|--inline-budget|--enable-pass|--disable-pass|--vector-isa) opts="$opts $1 $2"; shift 2 ;;
+        -*) opts="$opts $1"; shift ;;
+        *) break ;;
+    esac
+done
+[ $# -gt 0 ] || { echo "usage: $0 [rexionc options] program.ir ..." >&2; exit 2; }
+
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+failed=0 passed=0 built=0
+for prog in "$@"; do
+    abs=$(cd "$(dirname "$prog")" && pwd)/$(basename "$prog")
+    if ! (cd "$work" && "$REXIONC" "$abs" $opts --native-arm64 >compile.log 2>&1) || [ ! -s "$work/rexion_arm64.s" ]; then
+        echo "[A64-CHECK] $prog: compile failed"; cat "$work/compile.log"; failed=$((failed + 1)); continue
+    fi
+    if ! assemble "$work/rexion_arm64.s" "$work/prog.o" 2>"$work/as.log"; then
+        echo "[A64-CHECK] $prog: assembly failed"; head -20 "$work/as.log"; failed=$((failed + 1)); continue
+    fi
+    if ! have aarch64-linux-gnu-ld && ! have ld.lld; then built=$((built + 1)); continue; fi
+    if ! link "$work/prog.o" "$work/prog" 2>"$work/ld.log"; then
+        echo "[A64-CHECK] $prog: link failed"; head -20 "$work/ld.log"; failed=$((failed + 1)); continue
+    fi
+    if [ "$(uname -m)" != aarch64 ] && ! have qemu-aarch64 && ! have qemu-aarch64-static; then built=$((built + 1)); continue; fi
+    "$REXIONC" "$abs" $REF >"$work/want.txt" 2>/dev/null
+    run "$work/prog" >"$work/got.txt" 2>/dev/null
+    if cmp -s "$work/want.txt" "$work/got.txt"; then
+        passed=$((passed + 1))
+    else
+        echo "[A64-CHECK] $prog: output differs from $REF"
+        diff "$work/want.txt" "$work/got.txt" | head -20
+        failed=$((failed + 1))
+    fi
+    rm -f "$work/rexion_arm64.s" "$work/prog.o" "$work/prog"
+done
+echo "[A64-CHECK] $# programs: $passed match $REF, $built built but not run, $failed failed"
+[ "$failed" -eq 0 ]